@@ -11,6 +11,7 @@
 #include <logging.h>
 #include <module.h>
 #include <printf.h>
+#include <trace.h>
 
 /* Programmable interrupt controller */
 #define PIC1           0x20
@@ -147,10 +148,18 @@ void irq_ack(size_t irq_no) {
 	outportb(PIC1_COMMAND, PIC_EOI);
 }
 
+/* Set by the random module to collect timing jitter from every
+ * interrupt; NULL until then, costing untimed kernels one branch. */
+void (*irq_entropy_hook)(unsigned int irq) = NULL;
+
 void irq_handler(struct regs *r) {
 	/* Disable interrupts when handling */
 	int_disable();
 	if (r->int_no <= 47 && r->int_no >= 32) {
+		trace_event(TRACE_IRQ_ENTER, r->int_no - 32);
+		if (irq_entropy_hook) {
+			irq_entropy_hook(r->int_no - 32);
+		}
 		for (size_t i = 0; i < IRQ_CHAIN_DEPTH; i++) {
 			irq_handler_chain_t handler = irq_routines[i * IRQ_CHAIN_SIZE + (r->int_no - 32)];
 			if (handler && handler(r)) {
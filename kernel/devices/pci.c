@@ -7,6 +7,7 @@
  */
 
 #include <system.h>
+#include <logging.h>
 #include <pci.h>
 #include <pci_list.h>
 
@@ -95,7 +96,12 @@ void pci_scan_bus(pci_func_t f, int type, int bus, void * extra) {
 	}
 }
 
-void pci_scan(pci_func_t f, int type, void * extra) {
+/*
+ * Raw enumeration: walks config space directly. Used once to build
+ * the device cache; everything else goes through pci_scan, which
+ * iterates the cache instead of hammering the config ports.
+ */
+static void pci_scan_raw(pci_func_t f, int type, void * extra) {
 
 	if ((pci_read_field(0, PCI_HEADER_TYPE, 1) & 0x80) == 0) {
 		pci_scan_bus(f,type,0,extra);
@@ -112,3 +118,90 @@ void pci_scan(pci_func_t f, int type, void * extra) {
 	}
 }
 
+/* Device cache, filled by the first pci_scan. */
+#define PCI_MAX_CACHED 64
+
+static pci_dev_t pci_devices[PCI_MAX_CACHED];
+static int pci_device_count = 0;
+static int pci_cache_built = 0;
+
+static void pci_cache_hit(uint32_t device, uint16_t vendor_id, uint16_t device_id, void * extra) {
+	if (pci_device_count >= PCI_MAX_CACHED) return;
+	pci_dev_t * dev = &pci_devices[pci_device_count++];
+	dev->device    = device;
+	dev->vendor_id = vendor_id;
+	dev->device_id = device_id;
+	dev->type      = pci_find_type(device);
+	dev->irq       = pci_read_field(device, PCI_INTERRUPT_LINE, 1);
+	for (int bar = 0; bar < 6; ++bar) {
+		dev->bars[bar] = pci_read_field(device, PCI_BAR0 + 4 * bar, 4);
+	}
+}
+
+static void pci_build_cache(void) {
+	pci_scan_raw(pci_cache_hit, -1, NULL);
+	pci_cache_built = 1;
+	debug_print(NOTICE, "Cached %d PCI devices", pci_device_count);
+}
+
+void pci_scan(pci_func_t f, int type, void * extra) {
+	if (!pci_cache_built) {
+		pci_build_cache();
+	}
+	for (int i = 0; i < pci_device_count; ++i) {
+		if (type == -1 || type == pci_devices[i].type) {
+			f(pci_devices[i].device, pci_devices[i].vendor_id, pci_devices[i].device_id, extra);
+		}
+	}
+}
+
+static pci_dev_t * pci_get_cached(uint32_t device) {
+	if (!pci_cache_built) {
+		pci_build_cache();
+	}
+	for (int i = 0; i < pci_device_count; ++i) {
+		if (pci_devices[i].device == device) {
+			return &pci_devices[i];
+		}
+	}
+	return NULL;
+}
+
+uint32_t pci_find_device(uint16_t vendor_id, uint16_t device_id) {
+	if (!pci_cache_built) {
+		pci_build_cache();
+	}
+	for (int i = 0; i < pci_device_count; ++i) {
+		if (pci_devices[i].vendor_id == vendor_id && pci_devices[i].device_id == device_id) {
+			return pci_devices[i].device;
+		}
+	}
+	return PCI_NO_DEVICE;
+}
+
+uint32_t pci_get_bar(uint32_t device, int bar) {
+	pci_dev_t * dev = pci_get_cached(device);
+	if (dev && bar >= 0 && bar < 6) {
+		return dev->bars[bar];
+	}
+	return pci_read_field(device, PCI_BAR0 + 4 * bar, 4);
+}
+
+uint8_t pci_get_interrupt(uint32_t device) {
+	pci_dev_t * dev = pci_get_cached(device);
+	if (dev) {
+		return dev->irq;
+	}
+	return pci_read_field(device, PCI_INTERRUPT_LINE, 1);
+}
+
+/*
+ * Install a handler on a device's interrupt line using the cached
+ * routing. Lines are shared: the IRQ layer already chains handlers
+ * and stops at the first one that claims the interrupt, so drivers
+ * sharing a line just need to check their own device's status.
+ */
+void pci_install_interrupt_handler(uint32_t device, irq_handler_chain_t handler) {
+	irq_install_handler(pci_get_interrupt(device), handler);
+}
+
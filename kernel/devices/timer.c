@@ -8,6 +8,9 @@
 #include <system.h>
 #include <logging.h>
 #include <process.h>
+#include <mem.h>
+#include <timepage.h>
+#include <trace.h>
 
 #define PIT_A 0x40
 #define PIT_B 0x41
@@ -20,7 +23,6 @@
 
 #define TIMER_IRQ 0
 
-#define SUBTICKS_PER_TICK 1000
 #define RESYNC_TIME 1
 
 /*
@@ -47,10 +49,102 @@ signed long _timer_drift = 0;
 
 static int behind = 0;
 
+/*
+ * The shared time page (see timepage.h). Every process maps the one
+ * backing frame read-only at USER_TIME_PAGE - the page fault handler
+ * wires it up on first touch - so gettimeofday doesn't need a
+ * syscall. The frame is pinned so address space teardown can't free
+ * it out from under anyone.
+ */
+static time_page_t * time_page = NULL;
+static uint32_t _time_page_frame = 0;
+
+uint32_t time_page_frame(void) {
+	return _time_page_frame;
+}
+
+static void time_page_update(void) {
+	if (!time_page) return;
+	time_page->seq++;
+	time_page->ticks    = timer_ticks;
+	time_page->subticks = timer_subticks;
+	time_page->drift    = timer_drift;
+	time_page->seq++;
+}
+
+/* Subticks still owed to the clock from a tickless sleep */
+static unsigned long tickless_pending = 0;
+
+/* Longest one-shot the 16-bit PIT reload register can represent */
+#define PIT_MAX_SPAN (0xFFFF / (PIT_SCALE / SUBTICKS_PER_TICK))
+
+/*
+ * Program channel 0 for a single span of `span` subticks.
+ */
+static void timer_oneshot(unsigned long span) {
+	unsigned long divisor = (PIT_SCALE / SUBTICKS_PER_TICK) * span;
+	outportb(PIT_CONTROL, PIT_SET);
+	outportb(PIT_A, divisor & PIT_MASK);
+	outportb(PIT_A, (divisor >> 8) & PIT_MASK);
+}
+
+/*
+ * Bulk-advance the clock after sleeping through several subticks.
+ */
+static void timer_account(unsigned long subticks) {
+	timer_subticks += subticks;
+	while (timer_subticks >= SUBTICKS_PER_TICK) {
+		timer_subticks -= SUBTICKS_PER_TICK;
+		timer_ticks++;
+	}
+	time_page_update();
+}
+
+/*
+ * Called from the idle loop (interrupts off) when nothing is runnable:
+ * stretch the timer out to the next pending deadline so the hlt in the
+ * idle loop actually halts between events.
+ */
+void timer_idle_tickless(void) {
+	if (tickless_pending) return;
+	unsigned long delta = timerwheel_soonest(sleep_wheel);
+	if (delta <= 1) return; /* Next event is imminent; keep the normal tick */
+	if (delta > PIT_MAX_SPAN) delta = PIT_MAX_SPAN;
+	tickless_pending = delta;
+	timer_oneshot(delta);
+}
+
+/*
+ * Undo a tickless stretch after a non-timer interrupt woke us early.
+ * Reads back the PIT counter to account for however much of the span
+ * actually elapsed, then restores the periodic phase.
+ */
+void timer_tickless_cancel(void) {
+	if (!tickless_pending) return;
+	outportb(PIT_CONTROL, 0); /* Latch channel 0 */
+	unsigned long remaining = inportb(PIT_A);
+	remaining |= inportb(PIT_A) << 8;
+	unsigned long elapsed = tickless_pending - (remaining / (PIT_SCALE / SUBTICKS_PER_TICK));
+	if (elapsed > tickless_pending) elapsed = tickless_pending;
+	timer_account(elapsed);
+	tickless_pending = 0;
+	timer_phase(SUBTICKS_PER_TICK);
+}
+
 /*
  * IRQ handler for when the timer fires
  */
 int timer_handler(struct regs *r) {
+	/* Sample the interrupted context before anything else runs in
+	 * this handler, least of all the switch_task below. */
+	trace_sample(r->eip);
+	if (tickless_pending) {
+		/* We slept through these; account for all but the one the
+		 * regular path below adds, then restore the periodic tick. */
+		timer_account(tickless_pending - 1);
+		tickless_pending = 0;
+		timer_phase(SUBTICKS_PER_TICK);
+	}
 	if (++timer_subticks == SUBTICKS_PER_TICK || (behind && ++timer_subticks == SUBTICKS_PER_TICK)) {
 		timer_ticks++;
 		timer_subticks = 0;
@@ -61,10 +155,21 @@ int timer_handler(struct regs *r) {
 			else behind = 0;
 		}
 	}
+	time_page_update();
 	irq_ack(TIMER_IRQ);
 
 	wakeup_sleepers(timer_ticks, timer_subticks);
-	switch_task(1);
+
+	/* Preempt only when the current slice is spent, or when something
+	 * more important than the current process has become runnable. */
+	if (current_process && current_process->slice_remaining > 0) {
+		current_process->slice_remaining--;
+	}
+	if (!current_process || current_process->slice_remaining == 0 ||
+	    (cpu_current()->ready_bitmap &&
+	     __builtin_ctz(cpu_current()->ready_bitmap) < current_process->priority)) {
+		switch_task(1);
+	}
 	return 1;
 }
 
@@ -84,6 +189,13 @@ void relative_time(unsigned long seconds, unsigned long subseconds, unsigned lon
 void timer_install(void) {
 	debug_print(NOTICE,"Initializing interval timer");
 	boot_time = read_cmos();
+
+	time_page = (time_page_t *)kvmalloc(0x1000);
+	memset(time_page, 0x00, 0x1000);
+	time_page->boot_time = boot_time;
+	_time_page_frame = map_to_physical((uintptr_t)time_page) / 0x1000;
+	frame_pin(_time_page_frame);
+
 	irq_install_handler(TIMER_IRQ, timer_handler);
 	timer_phase(SUBTICKS_PER_TICK); /* 100Hz */
 }
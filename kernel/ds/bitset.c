@@ -39,22 +39,67 @@ void bitset_set(bitset_t *set, size_t bit) {
 	if (set->size <= index) {
 		bitset_resize(set, set->size << 1);
 	}
-	set->data[index] |= mask;
+	__sync_fetch_and_or(&set->data[index], mask);
 }
 
-int bitset_ffub(bitset_t *set) {
-	for (size_t i = 0; i < set->size * 8; i++) {
-		if (bitset_test(set, i)) {
-			continue;
+int bitset_test_and_set(bitset_t *set, size_t bit) {
+	iom;
+	if (set->size <= index) {
+		bitset_resize(set, set->size << 1);
+	}
+	/* Atomically claim the bit; returns whether it was already set,
+	 * so concurrent claimants can race without an outer lock. */
+	return !!(__sync_fetch_and_or(&set->data[index], mask) & mask);
+}
+
+int bitset_ffub_raw(unsigned char *data, size_t bytes, size_t start) {
+	/* Find the first unset bit at or after start, scanning a word at
+	 * a time: whole words of set bits are skipped with one compare,
+	 * and __builtin_ffs picks the bit out of the interesting word. */
+	size_t i = start >> 3;
+
+	if (i >= bytes) return -1;
+
+	/* Leading partial byte */
+	if (start & 7) {
+		unsigned char c = data[i] | ((1 << (start & 7)) - 1);
+		if (c != 0xFF) {
+			return (int)(i * 8 + __builtin_ffs(~c & 0xFF) - 1);
 		}
-		return (int)i;
+		i++;
 	}
+
+	/* Whole words */
+	while (i + sizeof(uint32_t) <= bytes) {
+		if (((uintptr_t)(data + i) & 3) == 0) {
+			uint32_t word = *(uint32_t *)(data + i);
+			if (word != 0xFFFFFFFF) {
+				return (int)(i * 8 + __builtin_ffs(~word) - 1);
+			}
+			i += sizeof(uint32_t);
+		} else {
+			if (data[i] != 0xFF) break;
+			i++;
+		}
+	}
+
+	/* Trailing bytes */
+	for (; i < bytes; i++) {
+		if (data[i] != 0xFF) {
+			return (int)(i * 8 + __builtin_ffs(~data[i] & 0xFF) - 1);
+		}
+	}
+
 	return -1;
 }
 
+int bitset_ffub(bitset_t *set) {
+	return bitset_ffub_raw(set->data, set->size, 0);
+}
+
 void bitset_clear(bitset_t *set, size_t bit) {
 	iom;
-	set->data[index] &= ~mask;
+	__sync_fetch_and_and(&set->data[index], ~mask);
 }
 
 int bitset_test(bitset_t *set, size_t bit) {
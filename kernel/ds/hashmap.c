@@ -7,13 +7,14 @@
 #include "hashmap.h"
 
 unsigned int hashmap_string_hash(void * _key) {
-	unsigned int hash = 0;
+	unsigned int hash = 2166136261UL;
 	char * key = (char *)_key;
 	int c;
-	/* This is the so-called "sdbm" hash. It comes from a piece of
-	 * public domain code from a clone of ndbm. */
+	/* 32-bit FNV-1a; mixes every input bit into every output bit,
+	 * which keeps probe sequences short in the flat maps below. */
 	while ((c = *key++)) {
-		hash = c + (hash << 6) + (hash << 16) - hash;
+		hash ^= c;
+		hash *= 16777619;
 	}
 	return hash;
 }
@@ -56,6 +57,10 @@ hashmap_t * hashmap_create(int size) {
 	map->entries = malloc(sizeof(hashmap_entry_t *) * size);
 	memset(map->entries, 0x00, sizeof(hashmap_entry_t *) * size);
 
+	map->flat  = 0;
+	map->count = 0;
+	map->slots = NULL;
+
 	return map;
 }
 
@@ -72,10 +77,155 @@ hashmap_t * hashmap_create_int(int size) {
 	map->entries = malloc(sizeof(hashmap_entry_t *) * size);
 	memset(map->entries, 0x00, sizeof(hashmap_entry_t *) * size);
 
+	map->flat  = 0;
+	map->count = 0;
+	map->slots = NULL;
+
+	return map;
+}
+
+/*
+ * Flat maps keep their entries inline in an open-addressed slot array
+ * with linear probing - no per-entry malloc on insert, and lookups walk
+ * adjacent memory instead of chasing chain pointers. Deletion shifts
+ * the rest of the probe cluster back, so there are no tombstones and
+ * probe sequences never degrade. The table doubles when it passes 3/4
+ * full. Same hooks, same operations; only the storage differs.
+ */
+static hashmap_t * hashmap_create_flat_common(int size) {
+	if (size < 8) size = 8;
+
+	hashmap_t * map = malloc(sizeof(hashmap_t));
+
+	map->size = size;
+	map->entries = NULL;
+
+	map->flat  = 1;
+	map->count = 0;
+	map->slots = malloc(sizeof(hashmap_flat_slot_t) * size);
+	memset(map->slots, 0x00, sizeof(hashmap_flat_slot_t) * size);
+
+	return map;
+}
+
+hashmap_t * hashmap_create_flat(int size) {
+	hashmap_t * map = hashmap_create_flat_common(size);
+
+	map->hash_func     = &hashmap_string_hash;
+	map->hash_comp     = &hashmap_string_comp;
+	map->hash_key_dup  = &hashmap_string_dupe;
+	map->hash_key_free = &free;
+	map->hash_val_free = &free;
+
 	return map;
 }
 
+hashmap_t * hashmap_create_flat_int(int size) {
+	hashmap_t * map = hashmap_create_flat_common(size);
+
+	map->hash_func     = &hashmap_int_hash;
+	map->hash_comp     = &hashmap_int_comp;
+	map->hash_key_dup  = &hashmap_int_dupe;
+	map->hash_key_free = &hashmap_int_free;
+	map->hash_val_free = &free;
+
+	return map;
+}
+
+static void hashmap_flat_grow(hashmap_t * map) {
+	size_t old_size = map->size;
+	hashmap_flat_slot_t * old = map->slots;
+
+	map->size = old_size * 2;
+	map->slots = malloc(sizeof(hashmap_flat_slot_t) * map->size);
+	memset(map->slots, 0x00, sizeof(hashmap_flat_slot_t) * map->size);
+
+	for (size_t i = 0; i < old_size; ++i) {
+		if (!old[i].state) continue;
+		size_t j = old[i].hash % map->size;
+		while (map->slots[j].state) {
+			j = (j + 1) % map->size;
+		}
+		map->slots[j] = old[i];
+	}
+
+	free(old);
+}
+
+static void * hashmap_flat_set(hashmap_t * map, void * key, void * value) {
+	unsigned int hash = map->hash_func(key);
+	size_t i = hash % map->size;
+
+	while (map->slots[i].state) {
+		if (map->slots[i].hash == hash && map->hash_comp(map->slots[i].key, key)) {
+			void * out = map->slots[i].value;
+			map->slots[i].value = value;
+			return out;
+		}
+		i = (i + 1) % map->size;
+	}
+
+	if ((map->count + 1) * 4 > map->size * 3) {
+		hashmap_flat_grow(map);
+		i = hash % map->size;
+		while (map->slots[i].state) {
+			i = (i + 1) % map->size;
+		}
+	}
+
+	map->slots[i].key   = map->hash_key_dup(key);
+	map->slots[i].value = value;
+	map->slots[i].hash  = hash;
+	map->slots[i].state = 1;
+	map->count++;
+	return NULL;
+}
+
+static hashmap_flat_slot_t * hashmap_flat_find(hashmap_t * map, void * key) {
+	unsigned int hash = map->hash_func(key);
+	size_t i = hash % map->size;
+
+	while (map->slots[i].state) {
+		if (map->slots[i].hash == hash && map->hash_comp(map->slots[i].key, key)) {
+			return &map->slots[i];
+		}
+		i = (i + 1) % map->size;
+	}
+	return NULL;
+}
+
+static void * hashmap_flat_remove(hashmap_t * map, void * key) {
+	hashmap_flat_slot_t * slot = hashmap_flat_find(map, key);
+	if (!slot) return NULL;
+
+	void * out = slot->value;
+	map->hash_key_free(slot->key);
+
+	/* Shift the rest of the probe cluster back over the hole; an
+	 * entry may only move if that doesn't put it before its home
+	 * slot, or later lookups would stop short of it. */
+	size_t j = slot - map->slots;
+	size_t n = j;
+	for (;;) {
+		n = (n + 1) % map->size;
+		if (!map->slots[n].state) break;
+		size_t home = map->slots[n].hash % map->size;
+		int reachable = (j < n) ? (home > j && home <= n) : (home > j || home <= n);
+		if (!reachable) {
+			map->slots[j] = map->slots[n];
+			j = n;
+		}
+	}
+	map->slots[j].key   = NULL;
+	map->slots[j].value = NULL;
+	map->slots[j].state = 0;
+	map->count--;
+	return out;
+}
+
 void * hashmap_set(hashmap_t * map, void * key, void * value) {
+	if (map->flat) return hashmap_flat_set(map, key, value);
+
 	unsigned int hash = map->hash_func(key) % map->size;
 
 	hashmap_entry_t * x = map->entries[hash];
@@ -109,6 +259,11 @@ void * hashmap_set(hashmap_t * map, void * key, void * value) {
 }
 
 void * hashmap_get(hashmap_t * map, void * key) {
+	if (map->flat) {
+		hashmap_flat_slot_t * slot = hashmap_flat_find(map, key);
+		return slot ? slot->value : NULL;
+	}
+
 	unsigned int hash = map->hash_func(key) % map->size;
 
 	hashmap_entry_t * x = map->entries[hash];
@@ -126,6 +281,8 @@ void * hashmap_get(hashmap_t * map, void * key) {
 }
 
 void * hashmap_remove(hashmap_t * map, void * key) {
+	if (map->flat) return hashmap_flat_remove(map, key);
+
 	unsigned int hash = map->hash_func(key) % map->size;
 
 	hashmap_entry_t * x = map->entries[hash];
@@ -158,6 +315,8 @@ void * hashmap_remove(hashmap_t * map, void * key) {
 }
 
 int hashmap_has(hashmap_t * map, void * key) {
+	if (map->flat) return hashmap_flat_find(map, key) != NULL;
+
 	unsigned int hash = map->hash_func(key) % map->size;
 
 	hashmap_entry_t * x = map->entries[hash];
@@ -178,6 +337,15 @@ int hashmap_has(hashmap_t * map, void * key) {
 list_t * hashmap_keys(hashmap_t * map) {
 	list_t * l = list_create();
 
+	if (map->flat) {
+		for (unsigned int i = 0; i < map->size; ++i) {
+			if (map->slots[i].state) {
+				list_insert(l, map->slots[i].key);
+			}
+		}
+		return l;
+	}
+
 	for (unsigned int i = 0; i < map->size; ++i) {
 		hashmap_entry_t * x = map->entries[i];
 		while (x) {
@@ -192,6 +360,15 @@ list_t * hashmap_keys(hashmap_t * map) {
 list_t * hashmap_values(hashmap_t * map) {
 	list_t * l = list_create();
 
+	if (map->flat) {
+		for (unsigned int i = 0; i < map->size; ++i) {
+			if (map->slots[i].state) {
+				list_insert(l, map->slots[i].value);
+			}
+		}
+		return l;
+	}
+
 	for (unsigned int i = 0; i < map->size; ++i) {
 		hashmap_entry_t * x = map->entries[i];
 		while (x) {
@@ -203,7 +380,41 @@ list_t * hashmap_values(hashmap_t * map) {
 	return l;
 }
 
+/*
+ * Visit every entry without allocating anything, unlike
+ * hashmap_keys(). A non-zero return from the callback stops the walk
+ * and is passed back to the caller.
+ */
+int hashmap_for_each(hashmap_t * map, hashmap_callback_t func, void * extra) {
+	if (map->flat) {
+		for (unsigned int i = 0; i < map->size; ++i) {
+			if (!map->slots[i].state) continue;
+			int out = func(map->slots[i].key, map->slots[i].value, extra);
+			if (out) return out;
+		}
+		return 0;
+	}
+
+	for (unsigned int i = 0; i < map->size; ++i) {
+		for (hashmap_entry_t * x = map->entries[i]; x; x = x->next) {
+			int out = func(x->key, x->value, extra);
+			if (out) return out;
+		}
+	}
+	return 0;
+}
+
 void hashmap_free(hashmap_t * map) {
+	if (map->flat) {
+		for (unsigned int i = 0; i < map->size; ++i) {
+			if (map->slots[i].state) {
+				map->hash_key_free(map->slots[i].key);
+			}
+		}
+		free(map->slots);
+		return;
+	}
+
 	for (unsigned int i = 0; i < map->size; ++i) {
 		hashmap_entry_t * x = map->entries[i], * p;
 		while (x) {
@@ -10,9 +10,40 @@
 
 #ifdef _KERNEL_
 #	include <system.h>
+#	include <kcache.h>
+
+/*
+ * List nodes are the most frequently allocated structure in the
+ * kernel; recycle them through an object cache instead of hitting
+ * the allocator bins for every insert.
+ */
+static kcache_t * node_cache = NULL;
+
+static node_t * node_alloc(void) {
+	if (!node_cache) {
+		node_cache = kcache_create("list_node", sizeof(node_t), 512);
+	}
+	return kcache_alloc(node_cache);
+}
+
+static void node_release(node_t * node) {
+	if (node_cache) {
+		kcache_free(node_cache, node);
+	} else {
+		free(node);
+	}
+}
 #else
 #	include <stddef.h>
 #	include <stdlib.h>
+
+static node_t * node_alloc(void) {
+	return malloc(sizeof(node_t));
+}
+
+static void node_release(node_t * node) {
+	free(node);
+}
 #endif
 
 void list_destroy(list_t * list) {
@@ -29,7 +60,7 @@ void list_free(list_t * list) {
 	node_t * n = list->head;
 	while (n) {
 		node_t * s = n->next;
-		free(n);
+		node_release(n);
 		n = s;
 	}
 }
@@ -55,7 +86,7 @@ void list_append(list_t * list, node_t * node) {
 
 node_t * list_insert(list_t * list, void * item) {
 	/* Insert an item into a list */
-	node_t * node = malloc(sizeof(node_t));
+	node_t * node = node_alloc();
 	node->value = item;
 	node->next  = NULL;
 	node->prev  = NULL;
@@ -92,7 +123,7 @@ void list_append_after(list_t * list, node_t * before, node_t * node) {
 }
 
 node_t * list_insert_after(list_t * list, node_t * before, void * item) {
-	node_t * node = malloc(sizeof(node_t));
+	node_t * node = node_alloc();
 	node->value = item;
 	node->next  = NULL;
 	node->prev  = NULL;
@@ -128,7 +159,7 @@ void list_append_before(list_t * list, node_t * after, node_t * node) {
 }
 
 node_t * list_insert_before(list_t * list, node_t * after, void * item) {
-	node_t * node = malloc(sizeof(node_t));
+	node_t * node = node_alloc();
 	node->value = item;
 	node->next  = NULL;
 	node->prev  = NULL;
@@ -146,6 +177,16 @@ list_t * list_create(void) {
 	return out;
 }
 
+void list_init(list_t * list) {
+	/* Prepare a caller-owned (embedded) list header. Together with
+	 * list_append / list_delete on embedded nodes, this gives fully
+	 * intrusive lists - see sched_node and sleep_node in process_t.
+	 * Don't free() a header initialized this way. */
+	list->head = NULL;
+	list->tail = NULL;
+	list->length = 0;
+}
+
 node_t * list_find(list_t * list, void * value) {
 	foreach(item, list) {
 		if (item->value == value) {
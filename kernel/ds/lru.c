@@ -0,0 +1,197 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ *
+ * Fixed-capacity LRU cache.
+ *
+ * A flat hashmap indexes entries by key and a doubly-linked list keeps
+ * them in recency order, so lookup, insert, and eviction are all O(1).
+ * The entry pool and the index are sized at creation and never grow,
+ * so a warmed-up cache allocates nothing on the hot path. Eviction
+ * (capacity overflow, lru_shrink, lru_free) hands the value to the
+ * cache's callback; lru_remove hands it back to the caller instead.
+ */
+#include "hashmap.h"
+#include "lru.h"
+
+static lru_t * lru_create_common(size_t capacity, lru_evict_t on_evict, void * extra) {
+	if (capacity < 2) capacity = 2;
+
+	lru_t * cache = malloc(sizeof(lru_t));
+
+	cache->entries = malloc(sizeof(lru_entry_t) * capacity);
+	cache->unused  = NULL;
+	for (size_t i = 0; i < capacity; ++i) {
+		cache->entries[i].newer = cache->unused;
+		cache->unused = &cache->entries[i];
+	}
+
+	cache->newest   = NULL;
+	cache->oldest   = NULL;
+	cache->count    = 0;
+	cache->capacity = capacity;
+	cache->on_evict = on_evict;
+	cache->extra    = extra;
+
+	return cache;
+}
+
+lru_t * lru_create(size_t capacity, lru_evict_t on_evict, void * extra) {
+	lru_t * cache = lru_create_common(capacity, on_evict, extra);
+	/* Twice the capacity keeps the index under its 3/4 load limit,
+	 * so it never has to grow. */
+	cache->index    = hashmap_create_flat(capacity * 2);
+	cache->key_dup  = &hashmap_string_dupe;
+	cache->key_free = &free;
+	return cache;
+}
+
+static void * lru_key_identity(void * key) {
+	return key;
+}
+
+static void lru_key_noop(void * key) {
+	return;
+}
+
+lru_t * lru_create_int(size_t capacity, lru_evict_t on_evict, void * extra) {
+	lru_t * cache = lru_create_common(capacity, on_evict, extra);
+	cache->index    = hashmap_create_flat_int(capacity * 2);
+	cache->key_dup  = &lru_key_identity;
+	cache->key_free = &lru_key_noop;
+	return cache;
+}
+
+static void lru_unlink(lru_t * cache, lru_entry_t * entry) {
+	if (entry->newer) {
+		entry->newer->older = entry->older;
+	} else {
+		cache->newest = entry->older;
+	}
+	if (entry->older) {
+		entry->older->newer = entry->newer;
+	} else {
+		cache->oldest = entry->newer;
+	}
+}
+
+static void lru_link_newest(lru_t * cache, lru_entry_t * entry) {
+	entry->newer = NULL;
+	entry->older = cache->newest;
+	if (cache->newest) {
+		cache->newest->newer = entry;
+	} else {
+		cache->oldest = entry;
+	}
+	cache->newest = entry;
+}
+
+static void lru_touch(lru_t * cache, lru_entry_t * entry) {
+	if (cache->newest == entry) return;
+	lru_unlink(cache, entry);
+	lru_link_newest(cache, entry);
+}
+
+/* Drop an entry, handing the value to the eviction callback. */
+static void lru_evict(lru_t * cache, lru_entry_t * entry) {
+	hashmap_remove(cache->index, entry->key);
+	lru_unlink(cache, entry);
+	if (cache->on_evict) {
+		cache->on_evict(entry->key, entry->value, cache->extra);
+	}
+	cache->key_free(entry->key);
+	entry->newer = cache->unused;
+	cache->unused = entry;
+	cache->count--;
+}
+
+void * lru_get(lru_t * cache, void * key) {
+	lru_entry_t * entry = hashmap_get(cache->index, key);
+	if (!entry) return NULL;
+	lru_touch(cache, entry);
+	return entry->value;
+}
+
+void * lru_peek(lru_t * cache, void * key) {
+	lru_entry_t * entry = hashmap_get(cache->index, key);
+	return entry ? entry->value : NULL;
+}
+
+void lru_set(lru_t * cache, void * key, void * value) {
+	lru_entry_t * entry = hashmap_get(cache->index, key);
+	if (entry) {
+		if (entry->value != value && cache->on_evict) {
+			cache->on_evict(entry->key, entry->value, cache->extra);
+		}
+		entry->value = value;
+		lru_touch(cache, entry);
+		return;
+	}
+
+	if (cache->count == cache->capacity) {
+		lru_evict(cache, cache->oldest);
+	}
+
+	entry = cache->unused;
+	cache->unused = entry->newer;
+	entry->key   = cache->key_dup(key);
+	entry->value = value;
+	hashmap_set(cache->index, entry->key, entry);
+	lru_link_newest(cache, entry);
+	cache->count++;
+}
+
+/* Take an entry out without the eviction callback; the caller gets
+ * the value back (for dirty writeback and the like). */
+void * lru_remove(lru_t * cache, void * key) {
+	lru_entry_t * entry = hashmap_get(cache->index, key);
+	if (!entry) return NULL;
+
+	void * out = entry->value;
+	hashmap_remove(cache->index, entry->key);
+	lru_unlink(cache, entry);
+	cache->key_free(entry->key);
+	entry->newer = cache->unused;
+	cache->unused = entry;
+	cache->count--;
+	return out;
+}
+
+void lru_shrink(lru_t * cache, size_t target) {
+	while (cache->count > target) {
+		lru_evict(cache, cache->oldest);
+	}
+}
+
+void lru_free(lru_t * cache) {
+	lru_shrink(cache, 0);
+	hashmap_free(cache->index);
+	free(cache->index);
+	free(cache->entries);
+	free(cache);
+}
+
+#ifdef _KERNEL_
+/*
+ * Memory pressure: caches that opt in get halved when the frame
+ * allocator runs low. The notifier runs with the frame allocator lock
+ * held, so this path (and the eviction callbacks of caches registered
+ * here) must only free memory, never allocate it.
+ */
+static list_t * lru_pressure_caches = NULL;
+
+static void lru_low_memory(void) {
+	foreach(node, lru_pressure_caches) {
+		lru_t * cache = node->value;
+		lru_shrink(cache, cache->count / 2);
+	}
+}
+
+void lru_autoshrink(lru_t * cache) {
+	if (!lru_pressure_caches) {
+		lru_pressure_caches = list_create();
+		register_low_memory_notifier(lru_low_memory);
+	}
+	list_insert(lru_pressure_caches, cache);
+}
+#endif
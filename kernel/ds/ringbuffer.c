@@ -35,17 +35,14 @@ size_t ring_buffer_available(ring_buffer_t * ring_buffer) {
 	}
 }
 
-static inline void ring_buffer_increment_read(ring_buffer_t * ring_buffer) {
-	ring_buffer->read_ptr++;
-	if (ring_buffer->read_ptr == ring_buffer->size) {
-		ring_buffer->read_ptr = 0;
-	}
-}
-
-static inline void ring_buffer_increment_write(ring_buffer_t * ring_buffer) {
-	ring_buffer->write_ptr++;
-	if (ring_buffer->write_ptr == ring_buffer->size) {
-		ring_buffer->write_ptr = 0;
+/* Copy `count` unread bytes out starting at read_ptr without moving it;
+ * the wraparound split means at most two memcpys. */
+static void ring_buffer_copy_out(ring_buffer_t * ring_buffer, size_t count, uint8_t * buffer) {
+	size_t first = ring_buffer->size - ring_buffer->read_ptr;
+	if (first > count) first = count;
+	memcpy(buffer, ring_buffer->buffer + ring_buffer->read_ptr, first);
+	if (count > first) {
+		memcpy(buffer + first, ring_buffer->buffer, count - first);
 	}
 }
 
@@ -73,10 +70,12 @@ size_t ring_buffer_read(ring_buffer_t * ring_buffer, size_t size, uint8_t * buff
 	size_t collected = 0;
 	while (collected == 0) {
 		spin_lock(ring_buffer->lock);
-		while (ring_buffer_unread(ring_buffer) > 0 && collected < size) {
-			buffer[collected] = ring_buffer->buffer[ring_buffer->read_ptr];
-			ring_buffer_increment_read(ring_buffer);
-			collected++;
+		size_t unread = ring_buffer_unread(ring_buffer);
+		if (unread > 0) {
+			size_t count = (unread < size) ? unread : size;
+			ring_buffer_copy_out(ring_buffer, count, buffer);
+			ring_buffer->read_ptr = (ring_buffer->read_ptr + count) % ring_buffer->size;
+			collected = count;
 		}
 		spin_unlock(ring_buffer->lock);
 		wakeup_queue(ring_buffer->wait_queue_writers);
@@ -91,15 +90,52 @@ size_t ring_buffer_read(ring_buffer_t * ring_buffer, size_t size, uint8_t * buff
 	return collected;
 }
 
+/**
+ * Copy up to `size` unread bytes out without consuming them, so protocol
+ * parsers can inspect a header and decide before committing to a read.
+ * Pair with ring_buffer_discard to drop what was examined.
+ */
+size_t ring_buffer_peek(ring_buffer_t * ring_buffer, size_t size, uint8_t * buffer) {
+	spin_lock(ring_buffer->lock);
+	size_t unread = ring_buffer_unread(ring_buffer);
+	size_t count = (unread < size) ? unread : size;
+	if (count > 0) {
+		ring_buffer_copy_out(ring_buffer, count, buffer);
+	}
+	spin_unlock(ring_buffer->lock);
+	return count;
+}
+
+/**
+ * Drop up to `size` unread bytes without copying them anywhere.
+ */
+size_t ring_buffer_discard(ring_buffer_t * ring_buffer, size_t size) {
+	spin_lock(ring_buffer->lock);
+	size_t unread = ring_buffer_unread(ring_buffer);
+	size_t count = (unread < size) ? unread : size;
+	ring_buffer->read_ptr = (ring_buffer->read_ptr + count) % ring_buffer->size;
+	spin_unlock(ring_buffer->lock);
+	wakeup_queue(ring_buffer->wait_queue_writers);
+	return count;
+}
+
 size_t ring_buffer_write(ring_buffer_t * ring_buffer, size_t size, uint8_t * buffer) {
 	size_t written = 0;
 	while (written < size) {
 		spin_lock(ring_buffer->lock);
 
-		while (ring_buffer_available(ring_buffer) > 0 && written < size) {
-			ring_buffer->buffer[ring_buffer->write_ptr] = buffer[written];
-			ring_buffer_increment_write(ring_buffer);
-			written++;
+		size_t available = ring_buffer_available(ring_buffer);
+		if (available > 0) {
+			size_t count = size - written;
+			if (count > available) count = available;
+			size_t first = ring_buffer->size - ring_buffer->write_ptr;
+			if (first > count) first = count;
+			memcpy(ring_buffer->buffer + ring_buffer->write_ptr, buffer + written, first);
+			if (count > first) {
+				memcpy(ring_buffer->buffer, buffer + written + first, count - first);
+			}
+			ring_buffer->write_ptr = (ring_buffer->write_ptr + count) % ring_buffer->size;
+			written += count;
 		}
 
 		spin_unlock(ring_buffer->lock);
@@ -0,0 +1,120 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ *
+ * Hierarchical timer wheel.
+ *
+ * Timers are hashed into one of several levels of slots based on how
+ * far in the future they expire. Insertion, cancellation, and per-tick
+ * expiry are all O(1) (amortized); distant timers cascade down to finer
+ * levels as the wheel turns.
+ */
+
+#include <system.h>
+#include <timerwheel.h>
+
+/* Span (in subticks) covered by one full rotation of the given level */
+#define LEVEL_SPAN(level) (1ULL << (TIMERWHEEL_SLOT_BITS * ((level) + 1)))
+#define LEVEL_SHIFT(level) (TIMERWHEEL_SLOT_BITS * (level))
+#define SLOT_MASK (TIMERWHEEL_SLOTS - 1)
+
+timerwheel_t * timerwheel_create(unsigned long long now) {
+	timerwheel_t * wheel = malloc(sizeof(timerwheel_t));
+	memset(wheel, 0x00, sizeof(timerwheel_t));
+	wheel->time = now;
+	return wheel;
+}
+
+/*
+ * Hash an entry into the slot it belongs in given the current time.
+ */
+static list_t * timerwheel_slot_for(timerwheel_t * wheel, unsigned long long expiry) {
+	if (expiry <= wheel->time) {
+		/* Already expired; fire on the next advance */
+		return &wheel->slots[0][(wheel->time + 1) & SLOT_MASK];
+	}
+	unsigned long long delta = expiry - wheel->time;
+	int level = 0;
+	while (level < TIMERWHEEL_LEVELS - 1 && delta >= LEVEL_SPAN(level)) {
+		level++;
+	}
+	if (delta >= LEVEL_SPAN(level)) {
+		/* Beyond the top level; park it as far out as we can and let
+		 * it re-cascade when the wheel gets there. */
+		expiry = wheel->time + LEVEL_SPAN(TIMERWHEEL_LEVELS - 1) - 1;
+	}
+	return &wheel->slots[level][(expiry >> LEVEL_SHIFT(level)) & SLOT_MASK];
+}
+
+timerwheel_entry_t * timerwheel_insert(timerwheel_t * wheel, unsigned long long expiry, timerwheel_callback_t callback, void * extra) {
+	timerwheel_entry_t * entry = malloc(sizeof(timerwheel_entry_t));
+	entry->expiry   = expiry;
+	entry->callback = callback;
+	entry->extra    = extra;
+	entry->node     = list_insert(timerwheel_slot_for(wheel, expiry), entry);
+	wheel->count++;
+	return entry;
+}
+
+void timerwheel_cancel(timerwheel_t * wheel, timerwheel_entry_t * entry) {
+	wheel->count--;
+	list_delete((list_t *)entry->node->owner, entry->node);
+	free(entry->node);
+	free(entry);
+}
+
+/*
+ * Move all entries from a coarse slot back into the wheel; they will
+ * hash into a finer level (or fire) based on their remaining delta.
+ */
+static void timerwheel_cascade(timerwheel_t * wheel, int level) {
+	list_t * slot = &wheel->slots[level][(wheel->time >> LEVEL_SHIFT(level)) & SLOT_MASK];
+	while (slot->head) {
+		node_t * node = list_dequeue(slot);
+		timerwheel_entry_t * entry = node->value;
+		free(node);
+		entry->node = list_insert(timerwheel_slot_for(wheel, entry->expiry), entry);
+	}
+}
+
+void timerwheel_advance(timerwheel_t * wheel, unsigned long long now) {
+	while (wheel->time < now) {
+		wheel->time++;
+		/* Each time a level wraps, pull the next coarser slot apart */
+		for (int level = 1; level < TIMERWHEEL_LEVELS; ++level) {
+			if (wheel->time & (LEVEL_SPAN(level - 1) - 1)) break;
+			timerwheel_cascade(wheel, level);
+		}
+		list_t * slot = &wheel->slots[0][wheel->time & SLOT_MASK];
+		while (slot->head) {
+			node_t * node = list_dequeue(slot);
+			timerwheel_entry_t * entry = node->value;
+			free(node);
+			timerwheel_callback_t callback = entry->callback;
+			void * extra = entry->extra;
+			free(entry);
+			wheel->count--;
+			callback(extra);
+		}
+	}
+}
+
+/*
+ * How many subticks until the wheel next needs attention?
+ *
+ * Returns the delta to the next level-0 expiry, or to the next cascade
+ * boundary if something coarser is pending, or (unsigned long)-1 if the
+ * wheel is empty.
+ */
+unsigned long timerwheel_soonest(timerwheel_t * wheel) {
+	if (!wheel->count) return (unsigned long)-1;
+	unsigned long boundary = TIMERWHEEL_SLOTS - (wheel->time & SLOT_MASK);
+	for (unsigned long delta = 1; delta < boundary; ++delta) {
+		if (wheel->slots[0][(wheel->time + delta) & SLOT_MASK].head) {
+			return delta;
+		}
+	}
+	/* Whatever is pending lives past the next cascade; wake there and
+	 * let the cascade sort out where it actually lands. */
+	return boundary;
+}
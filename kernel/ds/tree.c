@@ -15,25 +15,102 @@
 #	include <stdlib.h>
 #endif
 
+/*
+ * Nodes either come from the general allocator or, for arena trees,
+ * are bumped out of the tree's chunk list. Arena nodes are never
+ * returned individually - removal just unlinks them - and the whole
+ * lot goes away in one pass when the tree is freed.
+ */
+static tree_node_t * tree_node_alloc(tree_t * tree) {
+	if (tree && tree->arena_chunk_size) {
+		tree_arena_chunk_t * chunk = tree->arena;
+		if (!chunk || chunk->used + sizeof(tree_node_t) > tree->arena_chunk_size) {
+			chunk = malloc(sizeof(tree_arena_chunk_t) + tree->arena_chunk_size);
+			chunk->next = tree->arena;
+			chunk->used = 0;
+			tree->arena = chunk;
+		}
+		tree_node_t * out = (tree_node_t *)((char *)(chunk + 1) + chunk->used);
+		chunk->used += sizeof(tree_node_t);
+		out->in_arena = 1;
+		return out;
+	}
+	tree_node_t * out = malloc(sizeof(tree_node_t));
+	out->in_arena = 0;
+	return out;
+}
+
+static void tree_node_release(tree_node_t * node) {
+	if (!node->in_arena) {
+		free(node);
+	}
+}
+
+static tree_node_t * tree_node_create_in(tree_t * tree, void * value) {
+	tree_node_t * out = tree_node_alloc(tree);
+	out->value = value;
+	out->parent = NULL;
+	out->first_child = NULL;
+	out->last_child = NULL;
+	out->next_sibling = NULL;
+	out->prev_sibling = NULL;
+	return out;
+}
+
+tree_node_t * tree_node_create(void * value) {
+	/* Create a new tree node pointing to the given value */
+	return tree_node_create_in(NULL, value);
+}
+
+/* Unlink a node from its parent and siblings; children stay attached */
+static void tree_node_detach(tree_node_t * node) {
+	if (node->parent) {
+		if (node->parent->first_child == node) {
+			node->parent->first_child = node->next_sibling;
+		}
+		if (node->parent->last_child == node) {
+			node->parent->last_child = node->prev_sibling;
+		}
+	}
+	if (node->prev_sibling) {
+		node->prev_sibling->next_sibling = node->next_sibling;
+	}
+	if (node->next_sibling) {
+		node->next_sibling->prev_sibling = node->prev_sibling;
+	}
+	node->parent = NULL;
+	node->prev_sibling = NULL;
+	node->next_sibling = NULL;
+}
+
 tree_t * tree_create(void) {
 	/* Create a new tree */
 	tree_t * out = malloc(sizeof(tree_t));
 	out->nodes  = 0;
 	out->root   = NULL;
+	out->arena  = NULL;
+	out->arena_chunk_size = 0;
+	return out;
+}
+
+tree_t * tree_create_arena(size_t chunk_size) {
+	/* Create a tree whose nodes come from a private arena */
+	tree_t * out = tree_create();
+	out->arena_chunk_size = chunk_size ? chunk_size : 4096;
 	return out;
 }
 
 void tree_set_root(tree_t * tree, void * value) {
 	/* Set the root node for a new tree. */
-	tree_node_t * root = tree_node_create(value);
+	tree_node_t * root = tree_node_create_in(tree, value);
 	tree->root = root;
 	tree->nodes = 1;
 }
 
 void tree_node_destroy(tree_node_t * node) {
 	/* Free the contents of a node and its children, but not the nodes themselves */
-	foreach(child, node->children) {
-		tree_node_destroy((tree_node_t *)child->value);
+	foreach_child(child, node) {
+		tree_node_destroy(child);
 	}
 	free(node->value);
 }
@@ -48,53 +125,66 @@ void tree_destroy(tree_t * tree) {
 void tree_node_free(tree_node_t * node) {
 	/* Free a node and its children, but not their contents */
 	if (!node) return;
-	foreach(child, node->children) {
-		tree_node_free(child->value);
+	tree_node_t * child = node->first_child;
+	while (child) {
+		tree_node_t * next = child->next_sibling;
+		tree_node_free(child);
+		child = next;
 	}
-	free(node);
+	tree_node_release(node);
 }
 
 void tree_free(tree_t * tree) {
 	/* Free all of the nodes in a tree, but not their contents */
+	if (tree->arena_chunk_size) {
+		/* Arena trees drop every node at once */
+		tree_arena_chunk_t * chunk = tree->arena;
+		while (chunk) {
+			tree_arena_chunk_t * next = chunk->next;
+			free(chunk);
+			chunk = next;
+		}
+		tree->arena = NULL;
+		tree->root  = NULL;
+		tree->nodes = 0;
+		return;
+	}
 	tree_node_free(tree->root);
 }
 
-tree_node_t * tree_node_create(void * value) {
-	/* Create a new tree node pointing to the given value */
-	tree_node_t * out = malloc(sizeof(tree_node_t));
-	out->value = value;
-	out->children = list_create();
-	out->parent = NULL;
-	return out;
-}
-
 void tree_node_insert_child_node(tree_t * tree, tree_node_t * parent, tree_node_t * node) {
-	/* Insert a node as a child of parent */
-	list_insert(parent->children, node);
+	/* Insert a node as the last child of parent */
 	node->parent = parent;
+	node->next_sibling = NULL;
+	node->prev_sibling = parent->last_child;
+	if (parent->last_child) {
+		parent->last_child->next_sibling = node;
+	} else {
+		parent->first_child = node;
+	}
+	parent->last_child = node;
 	tree->nodes++;
 }
 
 tree_node_t * tree_node_insert_child(tree_t * tree, tree_node_t * parent, void * value) {
 	/* Insert a (fresh) node as a child of parent */
-	tree_node_t * out = tree_node_create(value);
+	tree_node_t * out = tree_node_create_in(tree, value);
 	tree_node_insert_child_node(tree, parent, out);
 	return out;
 }
 
 tree_node_t * tree_node_find_parent(tree_node_t * haystack, tree_node_t * needle) {
 	/* Recursive node part of tree_find_parent */
-	tree_node_t * found = NULL;
-	foreach(child, haystack->children) {
-		if (child->value == needle) {
+	foreach_child(child, haystack) {
+		if (child == needle) {
 			return haystack;
 		}
-		found = tree_node_find_parent((tree_node_t *)child->value, needle);
+		tree_node_t * found = tree_node_find_parent(child, needle);
 		if (found) {
-			break;
+			return found;
 		}
 	}
-	return found;
+	return NULL;
 }
 
 tree_node_t * tree_find_parent(tree_t * tree, tree_node_t * node) {
@@ -103,21 +193,30 @@ tree_node_t * tree_find_parent(tree_t * tree, tree_node_t * node) {
 	return tree_node_find_parent(tree->root, node);
 }
 
+size_t tree_node_child_count(tree_node_t * node) {
+	/* return the number of direct children this node has */
+	size_t out = 0;
+	foreach_child(child, node) {
+		out++;
+	}
+	return out;
+}
+
 size_t tree_count_children(tree_node_t * node) {
-	/* return the number of children this node has */
+	/* return the number of children this node has, recursively */
 	if (!node) return 0;
-	if (!node->children) return 0;
-	size_t out = node->children->length;
-	foreach(child, node->children) {
-		out += tree_count_children((tree_node_t *)child->value);
+	size_t out = 0;
+	foreach_child(child, node) {
+		out += 1 + tree_count_children(child);
 	}
 	return out;
 }
 
 void tree_node_parent_remove(tree_t * tree, tree_node_t * parent, tree_node_t * node) {
 	/* remove a node when we know its parent; update node counts for the tree */
+	(void)parent;
 	tree->nodes -= tree_count_children(node) + 1;
-	list_delete(parent->children, list_find(parent->children, node));
+	tree_node_detach(node);
 	tree_node_free(node);
 }
 
@@ -130,10 +229,27 @@ void tree_node_remove(tree_t * tree, tree_node_t * node) {
 			tree->root  = NULL;
 			tree_node_free(node);
 		}
+		return;
 	}
 	tree_node_parent_remove(tree, parent, node);
 }
 
+/* Reattach all of node's children under new_parent, preserving order */
+static void tree_node_reparent_children(tree_t * tree, tree_node_t * node, tree_node_t * new_parent) {
+	tree_node_t * child = node->first_child;
+	while (child) {
+		tree_node_t * next = child->next_sibling;
+		child->parent = NULL;
+		child->prev_sibling = NULL;
+		child->next_sibling = NULL;
+		tree_node_insert_child_node(tree, new_parent, child);
+		tree->nodes--; /* not a new node, just moved */
+		child = next;
+	}
+	node->first_child = NULL;
+	node->last_child  = NULL;
+}
+
 void tree_remove(tree_t * tree, tree_node_t * node) {
 	/* Remove this node and move its children into its parent's list of children */
 	tree_node_t * parent = node->parent;
@@ -146,13 +262,9 @@ void tree_remove(tree_t * tree, tree_node_t * node) {
 	 */
 	if (!parent) return;
 	tree->nodes--;
-	list_delete(parent->children, list_find(parent->children, node));
-	foreach(child, node->children) {
-		/* Reassign the parents */
-		((tree_node_t *)child->value)->parent = parent;
-	}
-	list_merge(parent->children, node->children);
-	free(node);
+	tree_node_detach(node);
+	tree_node_reparent_children(tree, node, parent);
+	tree_node_release(node);
 }
 
 void tree_remove_reparent_root(tree_t * tree, tree_node_t * node) {
@@ -160,19 +272,14 @@ void tree_remove_reparent_root(tree_t * tree, tree_node_t * node) {
 	tree_node_t * parent = node->parent;
 	if (!parent) return;
 	tree->nodes--;
-	list_delete(parent->children, list_find(parent->children, node));
-	foreach(child, node->children) {
-		/* Reassign the parents */
-		((tree_node_t *)child->value)->parent = tree->root;
-	}
-	list_merge(tree->root->children, node->children);
-	free(node);
+	tree_node_detach(node);
+	tree_node_reparent_children(tree, node, tree->root);
+	tree_node_release(node);
 }
 
 void tree_break_off(tree_t * tree, tree_node_t * node) {
-	tree_node_t * parent = node->parent;
-	if (!parent) return;
-	list_delete(parent->children, list_find(parent->children, node));
+	if (!node->parent) return;
+	tree_node_detach(node);
 }
 
 tree_node_t * tree_node_find(tree_node_t * node, void * search, tree_comparator_t comparator) {
@@ -180,8 +287,8 @@ tree_node_t * tree_node_find(tree_node_t * node, void * search, tree_comparator_
 		return node;
 	}
 	tree_node_t * found;
-	foreach(child, node->children) {
-		found = tree_node_find((tree_node_t *)child->value, search, comparator);
+	foreach_child(child, node) {
+		found = tree_node_find(child, search, comparator);
 		if (found) return found;
 	}
 	return NULL;
@@ -0,0 +1,284 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ *
+ * Asynchronous I/O contexts.
+ *
+ * An aio fd is a queue pair dressed up as a file: writing an array of
+ * aio_op descriptors submits reads and writes, which a kernel worker
+ * carries out in the background; reading returns aio_event completion
+ * records; and the fd answers selectcheck/selectwait, so fswait() can
+ * poll for completions alongside pipes and sockets. This lets a single
+ * process keep several disk requests in flight while it computes.
+ *
+ * Data moves through kernel bounce buffers - write payloads are
+ * captured at submission and read results are copied out at
+ * collection - so the worker never touches another process's address
+ * space.
+ */
+#include <system.h>
+#include <fs.h>
+#include <printf.h>
+#include <process.h>
+#include <logging.h>
+#include <list.h>
+#include <kcache.h>
+#include <aio.h>
+
+typedef struct aio_ctx {
+	list_t * completed;       /* Finished requests awaiting collection */
+	list_t * alert_waiters;   /* Processes in fswait() on this fd */
+	list_t * collect;         /* Processes blocked in read() */
+	int pending;              /* Submitted but not yet completed */
+	int next_id;
+	int closed;
+	spin_lock_t lock;
+} aio_ctx_t;
+
+typedef struct aio_req {
+	aio_ctx_t * ctx;
+	int id;
+	int write;
+	fs_node_t * node;         /* Our reference to the target file */
+	uint32_t offset;
+	uint32_t size;
+	uint8_t * kbuf;           /* Kernel bounce buffer */
+	uint8_t * ubuf;           /* Submitter's buffer, copied at collection */
+	int result;
+} aio_req_t;
+
+static list_t * aio_queue = NULL;   /* Submissions, oldest first */
+static list_t * aio_wait = NULL;    /* The worker sleeps here */
+static spin_lock_t aio_lock = { 0 };
+
+static void aio_req_discard(aio_req_t * req) {
+	free(req->kbuf);
+	free(req);
+}
+
+static void aio_alert_waiters(aio_ctx_t * ctx) {
+	if (ctx->alert_waiters) {
+		while (ctx->alert_waiters->head) {
+			node_t * node = list_dequeue(ctx->alert_waiters);
+			process_t * p = node->value;
+			process_alert_node(p, ctx);
+			free(node);
+		}
+	}
+}
+
+static void aio_worker(void * data, char * name) {
+	while (1) {
+		spin_lock(aio_lock);
+		node_t * n = list_dequeue(aio_queue);
+		spin_unlock(aio_lock);
+
+		if (!n) {
+			sleep_on(aio_wait);
+			continue;
+		}
+
+		aio_req_t * req = n->value;
+		free(n);
+
+		if (req->write) {
+			req->result = (int)write_fs(req->node, req->offset, req->size, req->kbuf);
+		} else {
+			req->result = (int)read_fs(req->node, req->offset, req->size, req->kbuf);
+		}
+		close_fs(req->node);
+		req->node = NULL;
+
+		aio_ctx_t * ctx = req->ctx;
+		spin_lock(ctx->lock);
+		ctx->pending--;
+		if (ctx->closed) {
+			/* Nobody is coming back for this */
+			aio_req_discard(req);
+			if (!ctx->pending) {
+				spin_unlock(ctx->lock);
+				list_free(ctx->completed);
+				free(ctx->completed);
+				free(ctx->collect);
+				if (ctx->alert_waiters) {
+					free(ctx->alert_waiters);
+				}
+				free(ctx);
+				continue;
+			}
+		} else {
+			list_insert(ctx->completed, req);
+			wakeup_queue(ctx->collect);
+			aio_alert_waiters(ctx);
+		}
+		spin_unlock(ctx->lock);
+	}
+}
+
+/*
+ * Submission: each whole aio_op descriptor in the buffer is queued for
+ * the worker. Returns the number of bytes consumed; an op with a bad
+ * descriptor stops the batch there.
+ */
+static uint32_t aio_write(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	aio_ctx_t * ctx = node->device;
+	aio_op_t * ops = (aio_op_t *)buffer;
+	uint32_t count = size / sizeof(aio_op_t);
+	uint32_t done = 0;
+
+	for (uint32_t i = 0; i < count; ++i) {
+		if (ops[i].fd < 0 || ops[i].fd >= (int)current_process->fds->length ||
+				!current_process->fds->entries[ops[i].fd]) {
+			break;
+		}
+		fs_node_t * target = current_process->fds->entries[ops[i].fd];
+
+		aio_req_t * req = malloc(sizeof(aio_req_t));
+		req->ctx    = ctx;
+		req->write  = ops[i].write ? 1 : 0;
+		req->node   = clone_fs(target);
+		req->offset = ops[i].offset;
+		req->size   = ops[i].size;
+		req->kbuf   = malloc(ops[i].size ? ops[i].size : 1);
+		req->ubuf   = ops[i].buffer;
+		req->result = 0;
+
+		if (req->write) {
+			/* Capture the payload now, in the submitter's context */
+			memcpy(req->kbuf, ops[i].buffer, ops[i].size);
+		}
+
+		spin_lock(ctx->lock);
+		req->id = ctx->next_id++;
+		ctx->pending++;
+		spin_unlock(ctx->lock);
+
+		spin_lock(aio_lock);
+		list_insert(aio_queue, req);
+		spin_unlock(aio_lock);
+		wakeup_queue(aio_wait);
+
+		done++;
+	}
+
+	return done * sizeof(aio_op_t);
+}
+
+/*
+ * Collection: fill the buffer with completion records. Blocks while
+ * requests are in flight and none have finished; returns 0 when the
+ * queue is idle.
+ */
+static uint32_t aio_read(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	aio_ctx_t * ctx = node->device;
+	aio_event_t * events = (aio_event_t *)buffer;
+	uint32_t space = size / sizeof(aio_event_t);
+	uint32_t out = 0;
+
+	if (!space) return 0;
+
+	while (1) {
+		spin_lock(ctx->lock);
+		while (out < space && ctx->completed->head) {
+			node_t * n = list_dequeue(ctx->completed);
+			aio_req_t * req = n->value;
+			free(n);
+			spin_unlock(ctx->lock);
+
+			if (!req->write && req->result > 0) {
+				/* Deliver the data into the submitter's buffer */
+				memcpy(req->ubuf, req->kbuf, req->result);
+			}
+			events[out].id     = req->id;
+			events[out].result = req->result;
+			out++;
+			aio_req_discard(req);
+
+			spin_lock(ctx->lock);
+		}
+		int pending = ctx->pending;
+		spin_unlock(ctx->lock);
+
+		if (out || !pending) break;
+		if (sleep_on(ctx->collect)) break; /* Interrupted by a signal */
+	}
+
+	return out * sizeof(aio_event_t);
+}
+
+static int aio_check(fs_node_t * node) {
+	aio_ctx_t * ctx = node->device;
+	return ctx->completed->head ? 0 : 1;
+}
+
+static int aio_wait_select(fs_node_t * node, void * process) {
+	aio_ctx_t * ctx = node->device;
+	if (!ctx->alert_waiters) {
+		ctx->alert_waiters = list_create();
+	}
+	list_insert(ctx->alert_waiters, process);
+	list_insert(((process_t *)process)->node_waits, ctx);
+	return 0;
+}
+
+static void aio_close(fs_node_t * node) {
+	aio_ctx_t * ctx = node->device;
+	spin_lock(ctx->lock);
+	ctx->closed = 1;
+	while (ctx->completed->head) {
+		node_t * n = list_dequeue(ctx->completed);
+		aio_req_discard((aio_req_t *)n->value);
+		free(n);
+	}
+	if (ctx->pending) {
+		/* The worker frees the context after the last request lands */
+		spin_unlock(ctx->lock);
+		return;
+	}
+	spin_unlock(ctx->lock);
+	list_free(ctx->completed);
+	free(ctx->completed);
+	free(ctx->collect);
+	if (ctx->alert_waiters) {
+		free(ctx->alert_waiters);
+	}
+	free(ctx);
+}
+
+fs_node_t * aio_create_context(void) {
+	if (!aio_queue) return NULL;
+
+	aio_ctx_t * ctx = malloc(sizeof(aio_ctx_t));
+	ctx->completed = list_create();
+	ctx->alert_waiters = NULL;
+	ctx->collect = list_create();
+	ctx->pending = 0;
+	ctx->next_id = 0;
+	ctx->closed = 0;
+	spin_init(ctx->lock);
+
+	fs_node_t * fnode = kcache_alloc(fs_node_cache);
+	memset(fnode, 0x00, sizeof(fs_node_t));
+	fnode->device = ctx;
+	sprintf(fnode->name, "[aio]");
+	fnode->uid   = current_process->user;
+	fnode->gid   = current_process->user;
+	fnode->mask  = 0600;
+	fnode->flags = FS_CHARDEVICE;
+	fnode->read  = aio_read;
+	fnode->write = aio_write;
+	fnode->close = aio_close;
+	fnode->selectcheck = aio_check;
+	fnode->selectwait  = aio_wait_select;
+	fnode->refcount = 0;
+
+	return fnode;
+}
+
+void aio_install(void) {
+	aio_queue = list_create();
+	aio_wait = list_create();
+	spin_init(aio_lock);
+	create_kernel_tasklet(aio_worker, "[aio]", NULL);
+	debug_print(NOTICE, "Asynchronous I/O worker started");
+}
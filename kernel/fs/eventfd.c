@@ -0,0 +1,250 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ *
+ * Event and timer descriptors.
+ *
+ * Pure-signaling descriptors for event loops built on fswait(): an
+ * event fd is a 64-bit counter that reads nonzero-and-reset and wakes
+ * waiters on write; a timer fd ticks periodically off the sleep wheel
+ * and reads back how many expirations occurred. Both answer
+ * selectcheck/selectwait, so they mix freely with pipes and pex
+ * descriptors in a wait set without the buffer and copy overhead of
+ * signaling through a pipe pair.
+ */
+#include <system.h>
+#include <fs.h>
+#include <printf.h>
+#include <process.h>
+#include <logging.h>
+#include <list.h>
+#include <kcache.h>
+#include <timerwheel.h>
+#include <eventfd.h>
+
+typedef struct eventfd_ctx {
+	uint64_t count;
+	list_t * collect;         /* Processes blocked in read() */
+	list_t * alert_waiters;   /* Processes in fswait() on this fd */
+} eventfd_ctx_t;
+
+typedef struct timerfd_ctx {
+	unsigned long interval;   /* Subticks between expirations; 0 = disarmed */
+	unsigned long long next;  /* Absolute subtick of the next expiry */
+	uint64_t expirations;
+	timerwheel_entry_t * entry; /* Pending wheel entry, NULL when disarmed */
+	list_t * collect;
+	list_t * alert_waiters;
+} timerfd_ctx_t;
+
+static void alert_waiters(list_t * alert_list, void * ident) {
+	if (alert_list) {
+		while (alert_list->head) {
+			node_t * node = list_dequeue(alert_list);
+			process_t * p = node->value;
+			process_alert_node(p, ident);
+			free(node);
+		}
+	}
+}
+
+/*
+ * Both descriptor types read a uint64_t: the counter (or expiration
+ * count) since the last read. Blocks while it is zero. The counter is
+ * bumped from interrupt context for timers, so the check-then-sleep
+ * has to close over the interrupt flag.
+ */
+static uint32_t counter_read(uint64_t * counter, list_t * collect, uint32_t size, uint8_t * buffer) {
+	if (size < sizeof(uint64_t)) return 0;
+
+	while (1) {
+		IRQ_OFF;
+		if (*counter) {
+			uint64_t out = *counter;
+			*counter = 0;
+			IRQ_RES;
+			memcpy(buffer, &out, sizeof(uint64_t));
+			return sizeof(uint64_t);
+		}
+		if (sleep_on(collect)) {
+			return -EINTR;
+		}
+	}
+}
+
+/* Event descriptors */
+
+static uint32_t eventfd_read(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	eventfd_ctx_t * ctx = node->device;
+	return counter_read(&ctx->count, ctx->collect, size, buffer);
+}
+
+static uint32_t eventfd_write(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	eventfd_ctx_t * ctx = node->device;
+	if (size < sizeof(uint64_t)) return 0;
+
+	uint64_t value;
+	memcpy(&value, buffer, sizeof(uint64_t));
+
+	IRQ_OFF;
+	ctx->count += value;
+	IRQ_RES;
+
+	wakeup_queue(ctx->collect);
+	alert_waiters(ctx->alert_waiters, ctx);
+
+	return sizeof(uint64_t);
+}
+
+static int eventfd_check(fs_node_t * node) {
+	eventfd_ctx_t * ctx = node->device;
+	return ctx->count ? 0 : 1;
+}
+
+static int eventfd_wait(fs_node_t * node, void * process) {
+	eventfd_ctx_t * ctx = node->device;
+	if (!ctx->alert_waiters) {
+		ctx->alert_waiters = list_create();
+	}
+	list_insert(ctx->alert_waiters, process);
+	list_insert(((process_t *)process)->node_waits, ctx);
+	return 0;
+}
+
+static void eventfd_close(fs_node_t * node) {
+	eventfd_ctx_t * ctx = node->device;
+	free(ctx->collect);
+	if (ctx->alert_waiters) {
+		free(ctx->alert_waiters);
+	}
+	free(ctx);
+}
+
+fs_node_t * eventfd_create(unsigned int initial) {
+	eventfd_ctx_t * ctx = malloc(sizeof(eventfd_ctx_t));
+	ctx->count = initial;
+	ctx->collect = list_create();
+	ctx->alert_waiters = NULL;
+
+	fs_node_t * fnode = kcache_alloc(fs_node_cache);
+	memset(fnode, 0x00, sizeof(fs_node_t));
+	fnode->device = ctx;
+	sprintf(fnode->name, "[eventfd]");
+	fnode->uid   = current_process->user;
+	fnode->gid   = current_process->user;
+	fnode->mask  = 0600;
+	fnode->flags = FS_CHARDEVICE;
+	fnode->read  = eventfd_read;
+	fnode->write = eventfd_write;
+	fnode->close = eventfd_close;
+	fnode->selectcheck = eventfd_check;
+	fnode->selectwait  = eventfd_wait;
+	fnode->refcount = 0;
+
+	return fnode;
+}
+
+/* Timer descriptors */
+
+/*
+ * Expiry callback; runs from the timer interrupt with the sleep wheel
+ * locked. Re-inserting from here is safe: the new expiry is in the
+ * future, so it hashes to a different slot than the one being drained.
+ */
+static void timerfd_fire(void * extra) {
+	timerfd_ctx_t * ctx = extra;
+	ctx->entry = NULL;
+	ctx->expirations++;
+	wakeup_queue(ctx->collect);
+	alert_waiters(ctx->alert_waiters, ctx);
+	if (ctx->interval) {
+		ctx->next += ctx->interval;
+		ctx->entry = timerwheel_insert(sleep_wheel, ctx->next, timerfd_fire, ctx);
+	}
+}
+
+/* Runs under the sleep wheel lock via ktimer_locked, so arming cannot
+ * race an in-flight expiry of the old entry. */
+static void timerfd_arm_locked(void * extra) {
+	timerfd_ctx_t * ctx = extra;
+	if (ctx->entry) {
+		timerwheel_cancel(sleep_wheel, ctx->entry);
+		ctx->entry = NULL;
+	}
+	if (ctx->interval) {
+		ctx->next = (unsigned long long)timer_ticks * SUBTICKS_PER_TICK + timer_subticks + ctx->interval;
+		ctx->entry = timerwheel_insert(sleep_wheel, ctx->next, timerfd_fire, ctx);
+	}
+}
+
+static uint32_t timerfd_read(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	timerfd_ctx_t * ctx = node->device;
+	return counter_read(&ctx->expirations, ctx->collect, size, buffer);
+}
+
+static int timerfd_ioctl(fs_node_t * node, int request, void * argp) {
+	timerfd_ctx_t * ctx = node->device;
+	switch (request) {
+		case TIMERFD_SET:
+			if (!argp) return -EINVAL;
+			/* Milliseconds are subticks */
+			ctx->interval = *(unsigned long *)argp;
+			ktimer_locked(timerfd_arm_locked, ctx);
+			return 0;
+		case TIMERFD_GET:
+			return ctx->interval;
+		default:
+			return -EINVAL;
+	}
+}
+
+static int timerfd_check(fs_node_t * node) {
+	timerfd_ctx_t * ctx = node->device;
+	return ctx->expirations ? 0 : 1;
+}
+
+static int timerfd_wait(fs_node_t * node, void * process) {
+	timerfd_ctx_t * ctx = node->device;
+	if (!ctx->alert_waiters) {
+		ctx->alert_waiters = list_create();
+	}
+	list_insert(ctx->alert_waiters, process);
+	list_insert(((process_t *)process)->node_waits, ctx);
+	return 0;
+}
+
+static void timerfd_close(fs_node_t * node) {
+	timerfd_ctx_t * ctx = node->device;
+
+	ctx->interval = 0;
+	ktimer_locked(timerfd_arm_locked, ctx); /* Cancels any pending entry */
+
+	free(ctx->collect);
+	if (ctx->alert_waiters) {
+		free(ctx->alert_waiters);
+	}
+	free(ctx);
+}
+
+fs_node_t * timerfd_create(void) {
+	timerfd_ctx_t * ctx = malloc(sizeof(timerfd_ctx_t));
+	memset(ctx, 0x00, sizeof(timerfd_ctx_t));
+	ctx->collect = list_create();
+
+	fs_node_t * fnode = kcache_alloc(fs_node_cache);
+	memset(fnode, 0x00, sizeof(fs_node_t));
+	fnode->device = ctx;
+	sprintf(fnode->name, "[timerfd]");
+	fnode->uid   = current_process->user;
+	fnode->gid   = current_process->user;
+	fnode->mask  = 0600;
+	fnode->flags = FS_CHARDEVICE;
+	fnode->read  = timerfd_read;
+	fnode->ioctl = timerfd_ioctl;
+	fnode->close = timerfd_close;
+	fnode->selectcheck = timerfd_check;
+	fnode->selectwait  = timerfd_wait;
+	fnode->refcount = 0;
+
+	return fnode;
+}
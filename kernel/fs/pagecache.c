@@ -0,0 +1,453 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ *
+ * Unified page cache.
+ *
+ * Caches file contents in 4KB pages keyed by (device, inode, page),
+ * independent of which filesystem the file lives on. read_fs() and
+ * write_fs() consult the cache before calling into the driver, so
+ * re-reading the same binaries and data files is served from memory.
+ *
+ * Writes to existing file contents are absorbed as dirty pages and
+ * written back by a background tasklet (or on eviction); writes that
+ * extend a file go straight to the driver so the filesystem handles
+ * the resize, and the cached copy is refreshed afterwards.
+ *
+ * Each cached file keeps a private clone of its fs_node so dirty
+ * pages can still be written back after the last descriptor closes.
+ */
+#include <system.h>
+#include <fs.h>
+#include <mem.h>
+#include <process.h>
+#include <logging.h>
+#include <hashmap.h>
+#include <list.h>
+#include <pagecache.h>
+
+#define PC_PAGE_SIZE 0x1000
+#define PC_MAX_PAGES 2048          /* 8MB of cached file data */
+#define PC_FLUSH_INTERVAL 2        /* Seconds between writeback passes */
+#define PC_READAHEAD 8             /* Pages to prefetch ahead of a sequential reader */
+
+typedef struct pc_file {
+	void * device;
+	uint32_t inode;
+	fs_node_t node;                /* Private clone, used for fill and writeback */
+	hashmap_t * pages;             /* page index -> pc_page_t * */
+	uint32_t next_offset;          /* Where a sequential reader would continue */
+	uint8_t ra_pending;            /* A readahead job for this file is queued */
+} pc_file_t;
+
+typedef struct ra_job {
+	pc_file_t * file;
+	uint32_t index;                /* First page to prefetch */
+	uint32_t count;
+} ra_job_t;
+
+typedef struct pc_page {
+	pc_file_t * file;
+	uint32_t index;                /* Page number within the file */
+	uint32_t bytes;                /* Valid bytes in data */
+	uint8_t dirty;
+	uint8_t pinned;                /* Mapped into user space; never evicted */
+	uint8_t * data;
+	node_t lru_node;               /* Position in the global LRU */
+} pc_page_t;
+
+static hashmap_t * pc_devices = NULL;  /* device -> (inode -> pc_file_t *) */
+static list_t * pc_lru = NULL;         /* Least-recently-used cached pages, oldest first */
+static list_t * ra_queue = NULL;       /* Pending readahead jobs, guarded by pc_lock */
+static list_t * ra_wait = NULL;        /* The readahead tasklet sleeps here */
+static uint32_t pc_pages = 0;
+static uint32_t pc_dirty = 0;
+static spin_lock_t pc_lock = { 0 };
+
+/*
+ * Only regular files with a usable (device, inode) identity are
+ * cached; devices, pipes, and anonymous nodes go straight through.
+ */
+static int pc_cacheable(fs_node_t * node) {
+	if (!pc_devices) return 0;
+	if (node->open_flags & O_DIRECT) return 0; /* Uncached by request */
+	if (!(node->flags & FS_FILE)) return 0;
+	if (node->flags & (FS_CHARDEVICE | FS_BLOCKDEVICE | FS_PIPE)) return 0;
+	if (!node->device && !node->inode) return 0;
+	return node->read != NULL;
+}
+
+static pc_file_t * pc_file_get(fs_node_t * node, int create) {
+	hashmap_t * inodes = hashmap_get(pc_devices, node->device);
+	if (!inodes) {
+		if (!create) return NULL;
+		inodes = hashmap_create_int(16);
+		hashmap_set(pc_devices, node->device, inodes);
+	}
+	pc_file_t * file = hashmap_get(inodes, (void *)(uintptr_t)node->inode);
+	if (!file && create) {
+		file = malloc(sizeof(pc_file_t));
+		file->device = node->device;
+		file->inode  = node->inode;
+		memcpy(&file->node, node, sizeof(fs_node_t));
+		file->node.refcount = -1; /* The cache's clone is never closed out */
+		file->pages = hashmap_create_int(16);
+		file->next_offset = 0;
+		file->ra_pending = 0;
+		hashmap_set(inodes, (void *)(uintptr_t)node->inode, file);
+	}
+	return file;
+}
+
+static void pc_page_writeback(pc_page_t * page) {
+	if (!page->dirty) return;
+	if (page->file->node.write) {
+		page->file->node.write(&page->file->node, page->index * PC_PAGE_SIZE, page->bytes, page->data);
+	}
+	page->dirty = 0;
+	pc_dirty--;
+}
+
+static void pc_page_drop(pc_page_t * page) {
+	pc_page_writeback(page);
+	hashmap_remove(page->file->pages, (void *)(uintptr_t)page->index);
+	if (page->lru_node.owner) {
+		list_delete((list_t *)page->lru_node.owner, &page->lru_node);
+	}
+	free(page->data);
+	free(page);
+	pc_pages--;
+}
+
+/* Throw out the least recently used page that isn't pinned. */
+static void pc_evict(void) {
+	foreach(n, pc_lru) {
+		pc_page_t * page = (pc_page_t *)n->value;
+		if (!page->pinned) {
+			pc_page_drop(page);
+			return;
+		}
+	}
+}
+
+static void pc_touch(pc_page_t * page) {
+	list_delete(pc_lru, &page->lru_node);
+	list_append(pc_lru, &page->lru_node);
+}
+
+/*
+ * Bring one page of a file into the cache, reading through the
+ * file's private node clone. Returns NULL at or past end of file.
+ */
+static pc_page_t * pc_page_fill(pc_file_t * file, uint32_t index) {
+	/* Page-aligned so mmap() can point user pages at the backing frame */
+	uint8_t * data = valloc(PC_PAGE_SIZE);
+	uint32_t bytes = file->node.read(&file->node, index * PC_PAGE_SIZE, PC_PAGE_SIZE, data);
+	if (bytes == 0 || bytes > PC_PAGE_SIZE) {
+		free(data);
+		return NULL;
+	}
+	if (bytes < PC_PAGE_SIZE) {
+		/* Don't leak stale heap contents past the end of the file */
+		memset(data + bytes, 0x00, PC_PAGE_SIZE - bytes);
+	}
+
+	pc_page_t * page = malloc(sizeof(pc_page_t));
+	page->file   = file;
+	page->index  = index;
+	page->bytes  = bytes;
+	page->dirty  = 0;
+	page->pinned = 0;
+	page->data   = data;
+	page->lru_node.value = page;
+	page->lru_node.prev = NULL;
+	page->lru_node.next = NULL;
+	page->lru_node.owner = NULL;
+
+	hashmap_set(file->pages, (void *)(uintptr_t)index, page);
+	list_append(pc_lru, &page->lru_node);
+	pc_pages++;
+
+	if (pc_pages > PC_MAX_PAGES) {
+		pc_evict();
+	}
+
+	return page;
+}
+
+int pagecache_read(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer, uint32_t * out) {
+	if (!pc_cacheable(node)) return 0;
+
+	spin_lock(pc_lock);
+	pc_file_t * file = pc_file_get(node, 1);
+
+	uint32_t start_offset = offset;
+	uint32_t end = offset + size;
+	uint32_t total = 0;
+	while (offset < end) {
+		uint32_t index = offset / PC_PAGE_SIZE;
+		uint32_t poff  = offset % PC_PAGE_SIZE;
+		pc_page_t * page = hashmap_get(file->pages, (void *)(uintptr_t)index);
+		if (page) {
+			pc_touch(page);
+		} else {
+			page = pc_page_fill(file, index);
+			if (!page) break; /* End of file */
+		}
+		uint32_t avail = (page->bytes > poff) ? page->bytes - poff : 0;
+		uint32_t want  = end - offset;
+		if (want > avail) want = avail;
+		if (!want) break;
+		memcpy(buffer + total, page->data + poff, want);
+		total  += want;
+		offset += want;
+		if (avail < PC_PAGE_SIZE - poff) break; /* Short page: end of file */
+	}
+
+	/*
+	 * If this read picked up exactly where the last one left off, the
+	 * file is being streamed; prefetch the next stretch in the
+	 * background so the device round trip overlaps with the consumer.
+	 */
+	if (total && start_offset == file->next_offset && !file->ra_pending && ra_queue) {
+		file->ra_pending = 1;
+		ra_job_t * job = malloc(sizeof(ra_job_t));
+		job->file  = file;
+		job->index = offset / PC_PAGE_SIZE + 1;
+		job->count = PC_READAHEAD;
+		list_insert(ra_queue, job);
+		wakeup_queue(ra_wait);
+	}
+	file->next_offset = offset;
+	spin_unlock(pc_lock);
+
+	*out = total;
+	return 1;
+}
+
+int pagecache_write(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer, uint32_t * out) {
+	if (!pc_cacheable(node) || !node->write) return 0;
+
+	if (offset + size > node->length) {
+		/*
+		 * Extending write: let the driver grow the file, then patch
+		 * up whatever we had cached so readers see the new contents.
+		 */
+		uint32_t ret = node->write(node, offset, size, buffer);
+		spin_lock(pc_lock);
+		pc_file_t * file = pc_file_get(node, 0);
+		if (file) {
+			file->node.length = node->length;
+			for (uint32_t o = offset; o < offset + ret;) {
+				uint32_t index = o / PC_PAGE_SIZE;
+				uint32_t poff  = o % PC_PAGE_SIZE;
+				uint32_t n = PC_PAGE_SIZE - poff;
+				if (n > offset + ret - o) n = offset + ret - o;
+				pc_page_t * page = hashmap_get(file->pages, (void *)(uintptr_t)index);
+				if (page) {
+					memcpy(page->data + poff, buffer + (o - offset), n);
+					if (poff + n > page->bytes) page->bytes = poff + n;
+				}
+				o += n;
+			}
+		}
+		spin_unlock(pc_lock);
+		*out = ret;
+		return 1;
+	}
+
+	/* Write within the existing extent: absorb it as dirty pages */
+	spin_lock(pc_lock);
+	pc_file_t * file = pc_file_get(node, 1);
+	uint32_t end = offset + size;
+	uint32_t total = 0;
+	while (offset < end) {
+		uint32_t index = offset / PC_PAGE_SIZE;
+		uint32_t poff  = offset % PC_PAGE_SIZE;
+		uint32_t n = PC_PAGE_SIZE - poff;
+		if (n > end - offset) n = end - offset;
+		pc_page_t * page = hashmap_get(file->pages, (void *)(uintptr_t)index);
+		if (page) {
+			pc_touch(page);
+		} else {
+			page = pc_page_fill(file, index);
+		}
+		if (!page) {
+			/* Couldn't bring the page in; let the driver take the rest */
+			spin_unlock(pc_lock);
+			uint32_t ret = node->write(node, offset, end - offset, buffer + total);
+			*out = total + ret;
+			return 1;
+		}
+		memcpy(page->data + poff, buffer + total, n);
+		if (poff + n > page->bytes) page->bytes = poff + n;
+		if (!page->dirty) {
+			page->dirty = 1;
+			pc_dirty++;
+		}
+		total  += n;
+		offset += n;
+	}
+	spin_unlock(pc_lock);
+
+	*out = total;
+	return 1;
+}
+
+/*
+ * Hand out the physical frame backing one cached page of a file, for
+ * mapping directly into a process. The page is pinned against
+ * eviction for as long as the system runs, since we can't tell when
+ * the last mapping of it goes away. Returns 0 at or past end of file.
+ */
+uintptr_t pagecache_map_frame(fs_node_t * node, uint32_t offset) {
+	if (!pc_cacheable(node)) return 0;
+
+	spin_lock(pc_lock);
+	pc_file_t * file = pc_file_get(node, 1);
+	uint32_t index = offset / PC_PAGE_SIZE;
+	pc_page_t * page = hashmap_get(file->pages, (void *)(uintptr_t)index);
+	if (page) {
+		pc_touch(page);
+	} else {
+		page = pc_page_fill(file, index);
+	}
+	uintptr_t frame = 0;
+	if (page) {
+		page->pinned = 1;
+		frame = map_to_physical((uintptr_t)page->data) / PC_PAGE_SIZE;
+	}
+	spin_unlock(pc_lock);
+	return frame;
+}
+
+/*
+ * Drop everything cached for a file - called when the file is
+ * truncated or unlinked underneath us. Dirty pages are discarded,
+ * not written back; the caller is destroying the contents anyway.
+ */
+void pagecache_invalidate(fs_node_t * node) {
+	if (!pc_devices) return;
+	spin_lock(pc_lock);
+	pc_file_t * file = pc_file_get(node, 0);
+	if (file) {
+		list_t * keys = hashmap_keys(file->pages);
+		foreach(n, keys) {
+			pc_page_t * page = hashmap_get(file->pages, n->value);
+			if (page) {
+				if (page->dirty) {
+					page->dirty = 0;
+					pc_dirty--;
+				}
+				if (page->pinned) {
+					/*
+					 * Still mapped into somebody's address space as
+					 * shared text. Detach it from the file so future
+					 * opens see the new contents, but keep the data
+					 * alive - the processes running the old binary get
+					 * to finish with the pages they started with.
+					 */
+					hashmap_remove(file->pages, n->value);
+					list_delete(pc_lru, &page->lru_node);
+					pc_pages--;
+					free(page);
+				} else {
+					pc_page_drop(page);
+				}
+			}
+		}
+		list_free(keys);
+		free(keys);
+		file->node.length = 0;
+	}
+	spin_unlock(pc_lock);
+}
+
+/*
+ * Write one file's dirty pages back to its filesystem - the fsync
+ * durability point. Cheap when the file has nothing cached.
+ */
+void pagecache_sync_node(fs_node_t * node) {
+	if (!pc_devices) return;
+	spin_lock(pc_lock);
+	pc_file_t * file = pc_file_get(node, 0);
+	if (file) {
+		list_t * keys = hashmap_keys(file->pages);
+		foreach(n, keys) {
+			pc_page_t * page = hashmap_get(file->pages, n->value);
+			if (page) {
+				pc_page_writeback(page);
+			}
+		}
+		list_free(keys);
+		free(keys);
+	}
+	spin_unlock(pc_lock);
+}
+
+/*
+ * Write every dirty page back to its filesystem.
+ */
+void pagecache_sync(void) {
+	if (!pc_devices) return;
+	spin_lock(pc_lock);
+	foreach(n, pc_lru) {
+		pc_page_writeback((pc_page_t *)n->value);
+	}
+	spin_unlock(pc_lock);
+}
+
+/*
+ * Pull readahead jobs off the queue and fill the requested pages,
+ * stopping early at end of file or if the page is already cached.
+ */
+static void pagecache_readahead_task(void * data, char * name) {
+	while (1) {
+		spin_lock(pc_lock);
+		node_t * n = list_dequeue(ra_queue);
+		spin_unlock(pc_lock);
+
+		if (!n) {
+			sleep_on(ra_wait);
+			continue;
+		}
+
+		ra_job_t * job = n->value;
+		free(n);
+
+		spin_lock(pc_lock);
+		for (uint32_t i = 0; i < job->count; ++i) {
+			if (!hashmap_get(job->file->pages, (void *)(uintptr_t)(job->index + i))) {
+				if (!pc_page_fill(job->file, job->index + i)) {
+					break; /* End of file */
+				}
+			}
+		}
+		job->file->ra_pending = 0;
+		spin_unlock(pc_lock);
+		free(job);
+	}
+}
+
+static void pagecache_flush_task(void * data, char * name) {
+	while (1) {
+		unsigned long s, ss;
+		relative_time(PC_FLUSH_INTERVAL, 0, &s, &ss);
+		sleep_until((process_t *)current_process, s, ss);
+		switch_task(0);
+		if (pc_dirty) {
+			pagecache_sync();
+		}
+	}
+}
+
+void pagecache_install(void) {
+	pc_devices = hashmap_create_int(16);
+	pc_lru = list_create();
+	ra_queue = list_create();
+	ra_wait = list_create();
+	spin_init(pc_lock);
+	create_kernel_tasklet(pagecache_flush_task, "[pagecache]", NULL);
+	create_kernel_tasklet(pagecache_readahead_task, "[readahead]", NULL);
+	debug_print(NOTICE, "Page cache installed (%d pages max)", PC_MAX_PAGES);
+}
@@ -12,9 +12,14 @@
 #include <printf.h>
 #include <pipe.h>
 #include <logging.h>
+#include <kcache.h>
 
 #define DEBUG_PIPES 0
 
+/* Registry of live pipes, for the debug shell's `stats pipes`. */
+static list_t * pipe_list = NULL;
+static spin_lock_t pipe_list_lock = { 0 };
+
 uint32_t read_pipe(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
 uint32_t write_pipe(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
 void open_pipe(fs_node_t *node, unsigned int flags);
@@ -53,22 +58,63 @@ int pipe_unsize(fs_node_t * node) {
 	return pipe_available(pipe);
 }
 
-static inline void pipe_increment_read(pipe_device_t * pipe) {
-	pipe->read_ptr++;
-	if (pipe->read_ptr == pipe->size) {
+/**
+ * Replace the circular buffer with one of `new_size` bytes, carrying
+ * the unread data over. Caller must hold lock_write; we stop the
+ * reader (and the world) for the actual swap, so the contents can't
+ * shift under the copy.
+ */
+static void pipe_resize(pipe_device_t * pipe, size_t new_size) {
+	uint8_t * new_buffer = malloc(new_size);
+
+	spin_lock(pipe->lock_read);
+	IRQ_OFF;
+
+	size_t unread = pipe_unread(pipe);
+	if (new_size > unread) {
+		/* Linearize the live data to the front of the new buffer */
+		size_t read_ptr = pipe->read_ptr;
+		size_t first = pipe->size - read_ptr;
+		if (first > unread) first = unread;
+		memcpy(new_buffer, pipe->buffer + read_ptr, first);
+		if (unread > first) {
+			memcpy(new_buffer + first, pipe->buffer, unread - first);
+		}
+		free(pipe->buffer);
+		pipe->buffer = new_buffer;
 		pipe->read_ptr = 0;
+		pipe->write_ptr = unread;
+		pipe->size = new_size;
+		new_buffer = NULL;
 	}
-}
 
-static inline void pipe_increment_write(pipe_device_t * pipe) {
-	pipe->write_ptr++;
-	if (pipe->write_ptr == pipe->size) {
-		pipe->write_ptr = 0;
-	}
+	IRQ_RES;
+	spin_unlock(pipe->lock_read);
+
+	/* Shrinking below the unread count is refused */
+	if (new_buffer) free(new_buffer);
 }
 
-static inline void pipe_increment_write_by(pipe_device_t * pipe, size_t amount) {
-	pipe->write_ptr = (pipe->write_ptr + amount) % pipe->size;
+static int pipe_ioctl(fs_node_t * node, int request, void * argp) {
+	pipe_device_t * pipe = (pipe_device_t *)node->device;
+	switch (request) {
+		case IOCTL_PIPE_SETSZ: {
+			size_t requested = (size_t)argp;
+			if (requested < 2 || requested > PIPE_MAX_SIZE) {
+				return -1;
+			}
+			spin_lock(pipe->lock_write);
+			pipe_resize(pipe, requested);
+			/* Explicit sizing pins the cap, too */
+			pipe->max_size = pipe->size;
+			spin_unlock(pipe->lock_write);
+			return pipe->size;
+		}
+		case IOCTL_PIPE_GETSZ:
+			return pipe->size;
+		default:
+			return -1;
+	}
 }
 
 static void pipe_alert_waiters(pipe_device_t * pipe) {
@@ -108,17 +154,42 @@ uint32_t read_pipe(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buf
 
 	size_t collected = 0;
 	while (collected == 0) {
+		/* The lock only serializes readers against each other - forked
+		 * pipelines can share an end - so the common one-reader case
+		 * never contends with the writer here. */
 		spin_lock(pipe->lock_read);
-		while (pipe_unread(pipe) > 0 && collected < size) {
-			buffer[collected] = pipe->buffer[pipe->read_ptr];
-			pipe_increment_read(pipe);
-			collected++;
+		size_t unread = pipe_unread(pipe);
+		if (unread > 0) {
+			size_t to_read = unread < size ? unread : size;
+			size_t read_ptr = pipe->read_ptr;
+			/* At most two copies to handle the wraparound */
+			size_t first = pipe->size - read_ptr;
+			if (first > to_read) first = to_read;
+			memcpy(buffer, pipe->buffer + read_ptr, first);
+			if (to_read > first) {
+				memcpy(buffer + first, pipe->buffer, to_read - first);
+			}
+			/* Check for a blocked writer and publish the new read
+			 * pointer in one atomic step, so a writer parking itself
+			 * at the same time can't slip between the two. */
+			IRQ_OFF;
+			int was_full = (pipe_available(pipe) == 0);
+			pipe->read_ptr = (read_ptr + to_read) % pipe->size;
+			IRQ_RES;
+			collected = to_read;
+			if (was_full) {
+				wakeup_queue(pipe->wait_queue_writers);
+			}
 		}
 		spin_unlock(pipe->lock_read);
-		wakeup_queue(pipe->wait_queue_writers);
 		/* Deschedule and switch */
 		if (collected == 0) {
-			sleep_on(pipe->wait_queue_readers);
+			IRQ_OFF;
+			if (pipe_unread(pipe) == 0) {
+				sleep_on(pipe->wait_queue_readers);
+			} else {
+				IRQ_RES;
+			}
 		}
 	}
 
@@ -152,34 +223,44 @@ uint32_t write_pipe(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *bu
 
 	size_t written = 0;
 	while (written < size) {
+		/* As with reading, the lock only serializes other writers. */
 		spin_lock(pipe->lock_write);
-
-#if 0
-		size_t available = 0;
-		if (pipe->read_ptr <= pipe->write_ptr) {
-			available = pipe->size - pipe->write_ptr;
-		} else {
-			available = pipe->read_ptr - pipe->write_ptr - 1;
+		size_t available = pipe_available(pipe);
+		if (available > 0) {
+			size_t to_write = available < (size - written) ? available : (size - written);
+			size_t write_ptr = pipe->write_ptr;
+			size_t first = pipe->size - write_ptr;
+			if (first > to_write) first = to_write;
+			memcpy(pipe->buffer + write_ptr, buffer + written, first);
+			if (to_write > first) {
+				memcpy(pipe->buffer, buffer + written + first, to_write - first);
+			}
+			/* Atomically check for sleeping readers and publish */
+			IRQ_OFF;
+			int was_empty = (pipe_unread(pipe) == 0);
+			pipe->write_ptr = (write_ptr + to_write) % pipe->size;
+			IRQ_RES;
+			written += to_write;
+			if (was_empty) {
+				wakeup_queue(pipe->wait_queue_readers);
+			}
+			pipe_alert_waiters(pipe);
 		}
-		if (available) {
-			available = min(available, size - written);
-			memcpy(&pipe->buffer[pipe->write_ptr], buffer, available);
-			pipe_increment_write_by(pipe, available);
-			written += available;
+		/* Rather than block a bursty producer, grow the buffer up to
+		 * the cap; only then do we start context-switching per fill. */
+		if (written < size && pipe->size < pipe->max_size) {
+			size_t new_size = pipe->size * 2;
+			if (new_size > pipe->max_size) new_size = pipe->max_size;
+			pipe_resize(pipe, new_size);
 		}
-#else
-		while (pipe_available(pipe) > 0 && written < size) {
-			pipe->buffer[pipe->write_ptr] = buffer[written];
-			pipe_increment_write(pipe);
-			written++;
-		}
-#endif
-
 		spin_unlock(pipe->lock_write);
-		wakeup_queue(pipe->wait_queue_readers);
-		pipe_alert_waiters(pipe);
 		if (written < size) {
-			sleep_on(pipe->wait_queue_writers);
+			IRQ_OFF;
+			if (pipe_available(pipe) == 0) {
+				sleep_on(pipe->wait_queue_writers);
+			} else {
+				IRQ_RES;
+			}
 		}
 	}
 
@@ -209,6 +290,13 @@ void close_pipe(fs_node_t * node) {
 
 	/* Check the reference count number */
 	if (pipe->refcount == 0) {
+		spin_lock(pipe_list_lock);
+		node_t * n = list_find(pipe_list, pipe);
+		if (n) {
+			list_delete(pipe_list, n);
+			free(n);
+		}
+		spin_unlock(pipe_list_lock);
 #if 0
 		/* No other references exist, free the pipe (but not its buffer) */
 		free(pipe->buffer);
@@ -247,7 +335,7 @@ static int pipe_wait(fs_node_t * node, void * process) {
 }
 
 fs_node_t * make_pipe(size_t size) {
-	fs_node_t * fnode = malloc(sizeof(fs_node_t));
+	fs_node_t * fnode = kcache_alloc(fs_node_cache);
 	pipe_device_t * pipe = malloc(sizeof(pipe_device_t));
 	memset(fnode, 0, sizeof(fs_node_t));
 	memset(pipe, 0, sizeof(pipe_device_t));
@@ -265,7 +353,7 @@ fs_node_t * make_pipe(size_t size) {
 	fnode->close = close_pipe;
 	fnode->readdir = NULL;
 	fnode->finddir = NULL;
-	fnode->ioctl   = NULL; /* TODO ioctls for pipes? maybe */
+	fnode->ioctl   = pipe_ioctl;
 	fnode->get_size = pipe_size;
 
 	fnode->selectcheck = pipe_check;
@@ -281,6 +369,7 @@ fs_node_t * make_pipe(size_t size) {
 	pipe->write_ptr = 0;
 	pipe->read_ptr  = 0;
 	pipe->size      = size;
+	pipe->max_size  = size;
 	pipe->refcount  = 0;
 	pipe->dead      = 0;
 
@@ -290,5 +379,30 @@ fs_node_t * make_pipe(size_t size) {
 	pipe->wait_queue_writers = list_create();
 	pipe->wait_queue_readers = list_create();
 
+	spin_lock(pipe_list_lock);
+	if (!pipe_list) {
+		pipe_list = list_create();
+	}
+	list_insert(pipe_list, pipe);
+	spin_unlock(pipe_list_lock);
+
 	return fnode;
 }
+
+/*
+ * Occupancy of every live pipe, for the debug shell. Reads are
+ * unlocked - this is an operator's eyeball tool, and the numbers
+ * move while you look at them anyway.
+ */
+void pipe_debug_stats(fs_node_t * tty) {
+	if (!pipe_list || !pipe_list->length) {
+		fprintf(tty, "No live pipes.\n");
+		return;
+	}
+	fprintf(tty, "%-10s %-10s %-10s %s\n", "pipe", "capacity", "unread", "refs");
+	foreach(node, pipe_list) {
+		pipe_device_t * pipe = node->value;
+		fprintf(tty, "0x%-8x %-10d %-10d %d\n",
+				(uintptr_t)pipe, pipe->size, pipe_unread(pipe), pipe->refcount);
+	}
+}
@@ -0,0 +1,180 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ *
+ * Persistent wait sets.
+ *
+ * fswait() makes the caller hand over its descriptor list on every
+ * call: the fds are copied in, validated, and resolved to nodes each
+ * time, so wait setup scales with the set size even when the set never
+ * changes. A pollset fd holds the interest set in the kernel instead —
+ * descriptors are resolved and pinned once at POLLSET_ADD, and each
+ * POLLSET_WAIT goes straight to the prebuilt node list and returns
+ * every ready descriptor, not just the first.
+ *
+ * Node wait queues remain one-shot (a node alerts and forgets its
+ * waiters), so the scheduler-side registration still happens per wait;
+ * what this removes is all the per-call marshalling and fd resolution.
+ */
+#include <system.h>
+#include <fs.h>
+#include <printf.h>
+#include <process.h>
+#include <logging.h>
+#include <list.h>
+#include <kcache.h>
+#include <pollset.h>
+
+typedef struct pollset_entry {
+	int fd;
+	fs_node_t * node;
+} pollset_entry_t;
+
+typedef struct pollset_ctx {
+	list_t * entries;
+	spin_lock_t lock;
+} pollset_ctx_t;
+
+static int pollset_add(pollset_ctx_t * ctx, int fd) {
+	fd_table_t * fds = current_process->fds;
+	if (fd < 0 || fd >= (int)fds->length || !fds->entries[fd]) {
+		return -EBADF;
+	}
+	fs_node_t * node = fds->entries[fd];
+
+	spin_lock(ctx->lock);
+	foreach(n, ctx->entries) {
+		pollset_entry_t * entry = n->value;
+		if (entry->fd == fd) {
+			spin_unlock(ctx->lock);
+			return -EINVAL; /* Already watching this one */
+		}
+	}
+
+	pollset_entry_t * entry = malloc(sizeof(pollset_entry_t));
+	entry->fd = fd;
+	entry->node = node;
+
+	/* Pin the node so a close() elsewhere can't free it under us */
+	if (node->refcount >= 0) {
+		__sync_fetch_and_add(&node->refcount, 1);
+	}
+
+	list_insert(ctx->entries, entry);
+	spin_unlock(ctx->lock);
+
+	return 0;
+}
+
+static int pollset_remove(pollset_ctx_t * ctx, int fd) {
+	spin_lock(ctx->lock);
+	foreach(n, ctx->entries) {
+		pollset_entry_t * entry = n->value;
+		if (entry->fd == fd) {
+			list_delete(ctx->entries, n);
+			spin_unlock(ctx->lock);
+			close_fs(entry->node);
+			free(entry);
+			free(n);
+			return 0;
+		}
+	}
+	spin_unlock(ctx->lock);
+	return -EINVAL;
+}
+
+/* Fill in every currently-ready descriptor, up to the caller's cap. */
+static int pollset_collect(pollset_ctx_t * ctx, pollset_wait_t * w) {
+	int count = 0;
+	spin_lock(ctx->lock);
+	foreach(n, ctx->entries) {
+		pollset_entry_t * entry = n->value;
+		if (count >= w->max) break;
+		if (selectcheck_fs(entry->node) == 0) {
+			w->fds[count++] = entry->fd;
+		}
+	}
+	spin_unlock(ctx->lock);
+	return count;
+}
+
+static int pollset_do_wait(pollset_ctx_t * ctx, pollset_wait_t * w) {
+	if (w->max <= 0) return -EINVAL;
+	if (!ctx->entries->length) return -EINVAL;
+
+	while (1) {
+		int count = pollset_collect(ctx, w);
+		if (count || w->timeout == 0) {
+			return count;
+		}
+
+		spin_lock(ctx->lock);
+		int n = ctx->entries->length;
+		fs_node_t ** nodes = malloc(sizeof(fs_node_t *) * (n + 1));
+		int i = 0;
+		foreach(node, ctx->entries) {
+			nodes[i++] = ((pollset_entry_t *)node->value)->node;
+		}
+		nodes[i] = NULL;
+		spin_unlock(ctx->lock);
+
+		int result = process_wait_nodes((process_t *)current_process, nodes, w->timeout);
+		free(nodes);
+
+		if (result == -2) {
+			return 0; /* Timed out */
+		}
+		/* Something fired (or we were alerted spuriously); recheck. */
+	}
+}
+
+static int pollset_ioctl(fs_node_t * node, int request, void * argp) {
+	pollset_ctx_t * ctx = node->device;
+	switch (request) {
+		case POLLSET_ADD:
+			if (!argp) return -EINVAL;
+			return pollset_add(ctx, *(int *)argp);
+		case POLLSET_REMOVE:
+			if (!argp) return -EINVAL;
+			return pollset_remove(ctx, *(int *)argp);
+		case POLLSET_WAIT:
+			if (!argp) return -EINVAL;
+			return pollset_do_wait(ctx, (pollset_wait_t *)argp);
+		default:
+			return -EINVAL;
+	}
+}
+
+static void pollset_close(fs_node_t * node) {
+	pollset_ctx_t * ctx = node->device;
+
+	while (ctx->entries->head) {
+		node_t * n = list_dequeue(ctx->entries);
+		pollset_entry_t * entry = n->value;
+		close_fs(entry->node);
+		free(entry);
+		free(n);
+	}
+	free(ctx->entries);
+	free(ctx);
+}
+
+fs_node_t * pollset_create(void) {
+	pollset_ctx_t * ctx = malloc(sizeof(pollset_ctx_t));
+	ctx->entries = list_create();
+	spin_init(ctx->lock);
+
+	fs_node_t * fnode = kcache_alloc(fs_node_cache);
+	memset(fnode, 0x00, sizeof(fs_node_t));
+	fnode->device = ctx;
+	sprintf(fnode->name, "[pollset]");
+	fnode->uid   = current_process->user;
+	fnode->gid   = current_process->user;
+	fnode->mask  = 0600;
+	fnode->flags = FS_CHARDEVICE;
+	fnode->ioctl = pollset_ioctl;
+	fnode->close = pollset_close;
+	fnode->refcount = 0;
+
+	return fnode;
+}
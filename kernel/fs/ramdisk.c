@@ -74,6 +74,14 @@ static fs_node_t * ramdisk_device_create(int device_number, uintptr_t location,
 	return fnode;
 }
 
+/* Memory-backed devices don't need caching on top of them; consumers
+ * that know about ramdisks can ask for the backing region and serve
+ * data straight out of it. Returns NULL for anything else. */
+void * ramdisk_fetch(fs_node_t * node) {
+	if (!node || node->read != read_ramdisk) return NULL;
+	return (void *)node->inode;
+}
+
 static int last_device_number = 0;
 fs_node_t * ramdisk_mount(uintptr_t location, size_t size) {
 	fs_node_t * ramdisk = ramdisk_device_create(last_device_number, location, size);
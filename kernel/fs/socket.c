@@ -0,0 +1,37 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ *
+ * Socket syscall plumbing.
+ *
+ * The network stack lives in a module, so the kernel can't call it
+ * directly; the module installs a socket_interface at init and the
+ * socket/connect syscalls dispatch through it. Until a stack is
+ * installed (or if none ever is), the calls fail cleanly.
+ *
+ * This replaces connection setup through finddir on /dev/net, which
+ * canonicalized and tokenized a host:port path for every connection.
+ */
+#include <system.h>
+#include <fs.h>
+#include <logging.h>
+#include <socket.h>
+
+static socket_interface_t * _socket_interface = NULL;
+
+void socket_install_interface(socket_interface_t * interface) {
+	if (_socket_interface) {
+		debug_print(WARNING, "Replacing already-installed socket interface");
+	}
+	_socket_interface = interface;
+}
+
+fs_node_t * socket_create(uint32_t type) {
+	if (!_socket_interface) return NULL;
+	return _socket_interface->socket(type);
+}
+
+int socket_connect(fs_node_t * node, uint32_t ip, uint16_t port) {
+	if (!_socket_interface) return -EINVAL;
+	return _socket_interface->connect(node, ip, port);
+}
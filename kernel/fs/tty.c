@@ -48,11 +48,9 @@ list_t * pty_list = NULL;
 #define OUT(character)  ring_buffer_write(pty->out, 1, (uint8_t *)&(character))
 
 static void dump_input_buffer(pty_t * pty) {
-	char * c = pty->canon_buffer;
-	while (pty->canon_buflen > 0) {
-		IN(*c);
-		pty->canon_buflen--;
-		c++;
+	if (pty->canon_buflen > 0) {
+		ring_buffer_write(pty->in, pty->canon_buflen, (uint8_t *)pty->canon_buffer);
+		pty->canon_buflen = 0;
 	}
 }
 
@@ -69,6 +67,33 @@ static void output_process(pty_t * pty, uint8_t c) {
 	OUT(c);
 }
 
+/**
+ * Feed a whole run of bytes to the output buffer. Aside from newline
+ * translation there is nothing per-character about output processing,
+ * so spans between newlines go to the ring buffer in one write each
+ * instead of one locked single-byte write per character.
+ */
+static void output_process_run(pty_t * pty, uint8_t * buffer, size_t size) {
+	if (!(pty->tios.c_oflag & ONLCR)) {
+		ring_buffer_write(pty->out, size, buffer);
+		return;
+	}
+	size_t i = 0;
+	while (i < size) {
+		size_t run = i;
+		while (run < size && buffer[run] != '\n') run++;
+		if (run > i) {
+			ring_buffer_write(pty->out, run - i, buffer + i);
+		}
+		if (run < size) {
+			uint8_t crlf[] = {'\r', '\n'};
+			ring_buffer_write(pty->out, 2, crlf);
+			run++;
+		}
+		i = run;
+	}
+}
+
 static void input_process(pty_t * pty, uint8_t c) {
 	if (pty->tios.c_lflag & ICANON) {
 		if (c == pty->tios.c_cc[VKILL]) {
@@ -211,9 +236,49 @@ uint32_t  read_pty_master(fs_node_t * node, uint32_t offset, uint32_t size, uint
 uint32_t write_pty_master(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t *buffer) {
 	pty_t * pty = (pty_t *)node->device;
 
+	if (!(pty->tios.c_lflag & ICANON)) {
+		/* Raw mode has no line editing; echo and deliver whole runs */
+		if (pty->tios.c_lflag & ECHO) {
+			output_process_run(pty, buffer, size);
+		}
+		ring_buffer_write(pty->in, size, buffer);
+		return size;
+	}
+
 	size_t l = 0;
-	for (uint8_t * c = buffer; l < size; ++c, ++l) {
-		input_process(pty, *c);
+	while (l < size) {
+		uint8_t c = buffer[l];
+		if (c == pty->tios.c_cc[VKILL] || c == pty->tios.c_cc[VERASE] ||
+			c == pty->tios.c_cc[VINTR] || c == pty->tios.c_cc[VQUIT] ||
+			c == pty->tios.c_cc[VEOF]  || c == '\n') {
+			/* Line editing characters take the one-at-a-time path */
+			input_process(pty, c);
+			l++;
+			continue;
+		}
+		/* Plain characters run to the next special byte or the end of
+		 * the line buffer, and move in one copy */
+		size_t space = pty->canon_bufsize - pty->canon_buflen;
+		if (!space) {
+			dump_input_buffer(pty);
+			space = pty->canon_bufsize;
+		}
+		size_t run = l + 1;
+		while (run < size && run - l < space) {
+			uint8_t d = buffer[run];
+			if (d == pty->tios.c_cc[VKILL] || d == pty->tios.c_cc[VERASE] ||
+				d == pty->tios.c_cc[VINTR] || d == pty->tios.c_cc[VQUIT] ||
+				d == pty->tios.c_cc[VEOF]  || d == '\n') {
+				break;
+			}
+			run++;
+		}
+		memcpy(pty->canon_buffer + pty->canon_buflen, buffer + l, run - l);
+		pty->canon_buflen += run - l;
+		if (pty->tios.c_lflag & ECHO) {
+			output_process_run(pty, buffer + l, run - l);
+		}
+		l = run;
 	}
 
 	return l;
@@ -242,12 +307,9 @@ uint32_t  read_pty_slave(fs_node_t * node, uint32_t offset, uint32_t size, uint8
 uint32_t write_pty_slave(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t *buffer) {
 	pty_t * pty = (pty_t *)node->device;
 
-	size_t l = 0;
-	for (uint8_t * c = buffer; l < size; ++c, ++l) {
-		output_process(pty, *c);
-	}
+	output_process_run(pty, buffer, size);
 
-	return l;
+	return size;
 }
 void      open_pty_slave(fs_node_t * node, unsigned int flags) {
 	return;
@@ -15,11 +15,17 @@
 #include <process.h>
 #include <logging.h>
 #include <hashmap.h>
+#include <kcache.h>
+#include <pagecache.h>
+#include <watch.h>
+#include <arena.h>
 
 #define MAX_SYMLINK_DEPTH 8
 #define MAX_SYMLINK_SIZE 4096
 
 tree_t    * fs_tree = NULL; /* File system mountpoint tree */
+static hashmap_t * mount_table = NULL; /* Normalized mount path -> vfs_entry, for fast prefix lookups */
+kcache_t  * fs_node_cache = NULL; /* Recycled fs_node_t allocations */
 fs_node_t * fs_root = NULL; /* Pointer to the root mount fs_node (must be some form of filesystem, even ramdisk) */
 
 hashmap_t * fs_types = NULL;
@@ -62,10 +68,9 @@ static struct dirent * readdir_mapper(fs_node_t *node, uint32_t index) {
 
 	index -= 2;
 	unsigned int i = 0;
-	foreach(child, d->children) {
+	foreach_child(tchild, d) {
 		if (i == index) {
 			/* Recursively print the children */
-			tree_node_t * tchild = (tree_node_t *)child->value;
 			struct vfs_entry * n = (struct vfs_entry *)tchild->value;
 			struct dirent * dir = malloc(sizeof(struct dirent));
 
@@ -81,7 +86,7 @@ static struct dirent * readdir_mapper(fs_node_t *node, uint32_t index) {
 }
 
 static fs_node_t * vfs_mapper(void) {
-	fs_node_t * fnode = malloc(sizeof(fs_node_t));
+	fs_node_t * fnode = kcache_alloc(fs_node_cache);
 	memset(fnode, 0x00, sizeof(fs_node_t));
 	fnode->mask = 0666;
 	fnode->flags   = FS_DIRECTORY;
@@ -124,11 +129,30 @@ int selectwait_fs(fs_node_t * node, void * process) {
  * @param buffer  A buffer to copy of the read data into
  * @returns Bytes read
  */
+/*
+ * Reader/writer exclusion applies only to regular files: concurrent
+ * readers share, writers exclude. Pipes, ttys, and other devices
+ * block inside their read handlers waiting for writers, so locking
+ * them here would deadlock - they do their own synchronization.
+ */
+static int fs_node_lockable(fs_node_t * node) {
+	if (!(node->flags & FS_FILE)) return 0;
+	return !(node->flags & (FS_CHARDEVICE | FS_BLOCKDEVICE | FS_PIPE));
+}
+
 uint32_t read_fs(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
 	if (!node) return -1;
 
 	if (node->read) {
-		uint32_t ret = node->read(node, offset, size, buffer);
+		uint32_t ret;
+		int lock = fs_node_lockable(node);
+		if (lock) rwlock_acquire_read(&node->rwlock);
+		if (pagecache_read(node, offset, size, buffer, &ret)) {
+			if (lock) rwlock_release_read(&node->rwlock);
+			return ret;
+		}
+		ret = node->read(node, offset, size, buffer);
+		if (lock) rwlock_release_read(&node->rwlock);
 		return ret;
 	} else {
 		return -1;
@@ -148,20 +172,25 @@ uint32_t write_fs(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buff
 	if (!node) return -1;
 
 	if (node->write) {
-		uint32_t ret = node->write(node, offset, size, buffer);
+		uint32_t ret;
+		int lock = fs_node_lockable(node);
+		if (lock) rwlock_acquire_write(&node->rwlock);
+		if (pagecache_write(node, offset, size, buffer, &ret)) {
+			if (lock) rwlock_release_write(&node->rwlock);
+			if (watch_active && (int32_t)ret > 0) watch_notify(node, NULL, WATCH_EVENT_MODIFY);
+			return ret;
+		}
+		ret = node->write(node, offset, size, buffer);
+		if (lock) rwlock_release_write(&node->rwlock);
+		if (watch_active && (int32_t)ret > 0) watch_notify(node, NULL, WATCH_EVENT_MODIFY);
 		return ret;
 	} else {
 		return -1;
 	}
 }
 
-//volatile uint8_t tmp_refcount_lock = 0;
-static spin_lock_t tmp_refcount_lock = { 0 };
-
 void vfs_lock(fs_node_t * node) {
-	spin_lock(tmp_refcount_lock);
 	node->refcount = -1;
-	spin_unlock(tmp_refcount_lock);
 }
 
 /**
@@ -174,10 +203,22 @@ void open_fs(fs_node_t *node, unsigned int flags) {
 
 	if (!node) return;
 
+	if (flags & O_TRUNC) {
+		/* The driver is about to destroy the contents */
+		pagecache_invalidate(node);
+	}
+
+	if (flags & O_DIRECT) {
+		/* Make sure the uncached handle doesn't race stale or dirty
+		 * cached pages; direct I/O talks to the driver alone. */
+		pagecache_sync();
+		pagecache_invalidate(node);
+	}
+
+	node->open_flags = flags;
+
 	if (node->refcount >= 0) {
-		spin_lock(tmp_refcount_lock);
-		node->refcount++;
-		spin_unlock(tmp_refcount_lock);
+		__sync_fetch_and_add(&node->refcount, 1);
 	}
 
 	if (node->open) {
@@ -200,18 +241,16 @@ void close_fs(fs_node_t *node) {
 
 	if (node->refcount == -1) return;
 
-	spin_lock(tmp_refcount_lock);
-	node->refcount--;
-	if (node->refcount == 0) {
+	/* Exactly one closer sees the count hit zero and tears down */
+	if (__sync_sub_and_fetch(&node->refcount, 1) == 0) {
 		debug_print(NOTICE, "Node refcount [%s] is now 0: %d", node->name, node->refcount);
 
 		if (node->close) {
 			node->close(node);
 		}
 
-		free(node);
+		kcache_free(fs_node_cache, node);
 	}
-	spin_unlock(tmp_refcount_lock);
 }
 
 /**
@@ -242,6 +281,189 @@ struct dirent *readdir_fs(fs_node_t *node, uint32_t index) {
 	}
 }
 
+/*
+ * Dentry cache.
+ *
+ * Path resolution walks every component with finddir_fs(), which for
+ * disk filesystems means re-reading directory blocks on every open.
+ * We remember (parent, name) -> child lookups - including failed ones -
+ * keyed on the parent's (device, inode) identity, and hand out copies
+ * of the remembered node so repeated opens skip the component walk.
+ *
+ * Only read-only opens consult the cache for the final component, so a
+ * writer (O_TRUNC, O_CREAT, append...) always sees and produces fresh
+ * metadata; creating or unlinking a name drops its entry.
+ */
+#define DENTRY_MAX 256
+
+typedef struct dentry {
+	int negative;              /* The name is known not to exist */
+	fs_node_t node;            /* Copied out to each hitting caller */
+} dentry_t;
+
+static hashmap_t * dentry_cache = NULL;
+static uint32_t dentry_count = 0;
+static spin_lock_t dentry_lock = { 0 };
+
+static int dentry_cacheable(fs_node_t * parent) {
+	if (!dentry_cache) return 0;
+	if (!(parent->flags & FS_DIRECTORY)) return 0;
+	return parent->device || parent->inode;
+}
+
+static char * dentry_key(fs_node_t * parent, char * name) {
+	char * key = malloc(strlen(name) + 24);
+	sprintf(key, "%x:%x:%s", (unsigned int)(uintptr_t)parent->device, (unsigned int)parent->inode, name);
+	return key;
+}
+
+/* Crude but effective: when the cache fills up, dump all of it. */
+static void dentry_flush(void) {
+	list_t * values = hashmap_values(dentry_cache);
+	foreach(n, values) {
+		free(n->value);
+	}
+	list_free(values);
+	free(values);
+	hashmap_free(dentry_cache);
+	free(dentry_cache);
+	dentry_cache = hashmap_create(DENTRY_MAX);
+	dentry_count = 0;
+}
+
+void dentry_invalidate(fs_node_t * parent, char * name) {
+	if (!dentry_cacheable(parent)) return;
+	char * key = dentry_key(parent, name);
+	spin_lock(dentry_lock);
+	dentry_t * d = hashmap_remove(dentry_cache, key);
+	if (d) {
+		free(d);
+		dentry_count--;
+	}
+	spin_unlock(dentry_lock);
+	free(key);
+}
+
+/*
+ * finddir_fs through the dentry cache. A negative hit returns NULL,
+ * which is indistinguishable from the lookup failing - which is
+ * exactly what it means.
+ */
+static fs_node_t * dentry_finddir(fs_node_t * node, char * name, int use_cache) {
+	if (!use_cache || !dentry_cacheable(node)) {
+		return finddir_fs(node, name);
+	}
+
+	char * key = dentry_key(node, name);
+	spin_lock(dentry_lock);
+	dentry_t * d = hashmap_get(dentry_cache, key);
+	if (d) {
+		fs_node_t * ret = NULL;
+		if (!d->negative) {
+			ret = kcache_alloc(fs_node_cache);
+			memcpy(ret, &d->node, sizeof(fs_node_t));
+			ret->refcount = 0;
+		}
+		spin_unlock(dentry_lock);
+		free(key);
+		return ret;
+	}
+	spin_unlock(dentry_lock);
+
+	fs_node_t * ret = finddir_fs(node, name);
+
+	spin_lock(dentry_lock);
+	if (!hashmap_has(dentry_cache, key)) {
+		if (dentry_count >= DENTRY_MAX) {
+			dentry_flush();
+		}
+		d = malloc(sizeof(dentry_t));
+		d->negative = !ret;
+		if (ret) {
+			memcpy(&d->node, ret, sizeof(fs_node_t));
+			d->node.refcount = 0;
+		}
+		hashmap_set(dentry_cache, key, d);
+		dentry_count++;
+	}
+	spin_unlock(dentry_lock);
+	free(key);
+	return ret;
+}
+
+/*
+ * Symlink target cache.
+ *
+ * Every traversal through a link otherwise costs a readlink_fs() - a
+ * disk read for ext2 links too long for the inode - so we remember
+ * resolved targets keyed on the link's (device, inode) identity.
+ * Links only change by being unlinked and recreated, both rare, so
+ * those paths just dump the whole cache rather than chase identities.
+ */
+#define SYMLINK_CACHE_MAX 64
+
+static hashmap_t * symlink_cache = NULL;
+static uint32_t symlink_count = 0;
+static spin_lock_t symlink_lock = { 0 };
+
+static char * symlink_key(fs_node_t * node) {
+	char * key = malloc(24);
+	sprintf(key, "%x:%x", (unsigned int)(uintptr_t)node->device, (unsigned int)node->inode);
+	return key;
+}
+
+/* Caller holds symlink_lock. */
+static void symlink_cache_flush(void) {
+	if (!symlink_cache) return;
+	list_t * values = hashmap_values(symlink_cache);
+	foreach(n, values) {
+		free(n->value);
+	}
+	list_free(values);
+	free(values);
+	hashmap_free(symlink_cache);
+	free(symlink_cache);
+	symlink_cache = hashmap_create(SYMLINK_CACHE_MAX);
+	symlink_count = 0;
+}
+
+/* readlink_fs through the target cache; same return contract. */
+static int symlink_target(fs_node_t * node, char * buf, size_t size) {
+	if (!symlink_cache || (!node->device && !node->inode)) {
+		return readlink_fs(node, buf, size);
+	}
+
+	char * key = symlink_key(node);
+	spin_lock(symlink_lock);
+	char * target = hashmap_get(symlink_cache, key);
+	if (target) {
+		int len = strlen(target);
+		if ((size_t)len < size) {
+			memcpy(buf, target, len + 1);
+			spin_unlock(symlink_lock);
+			free(key);
+			return len;
+		}
+	}
+	spin_unlock(symlink_lock);
+
+	int len = readlink_fs(node, buf, size);
+
+	if (len >= 0 && buf[len] == '\0') {
+		spin_lock(symlink_lock);
+		if (!hashmap_has(symlink_cache, key)) {
+			if (symlink_count >= SYMLINK_CACHE_MAX) {
+				symlink_cache_flush();
+			}
+			hashmap_set(symlink_cache, key, strdup(buf));
+			symlink_count++;
+		}
+		spin_unlock(symlink_lock);
+	}
+	free(key);
+	return len;
+}
+
 /**
  * finddir_fs: Find the requested file in the directory and return an fs_node for it
  *
@@ -321,6 +543,8 @@ int create_file_fs(char *name, uint16_t permission) {
 
 	if (parent->create) {
 		parent->create(parent, f_path, permission);
+		dentry_invalidate(parent, f_path);
+		if (watch_active) watch_notify(parent, f_path, WATCH_EVENT_CREATE);
 	}
 
 	free(path);
@@ -358,6 +582,11 @@ int unlink_fs(char * name) {
 
 	if (parent->unlink) {
 		parent->unlink(parent, f_path);
+		dentry_invalidate(parent, f_path);
+		spin_lock(symlink_lock);
+		symlink_cache_flush();
+		spin_unlock(symlink_lock);
+		if (watch_active) watch_notify(parent, f_path, WATCH_EVENT_UNLINK);
 	}
 
 	free(path);
@@ -404,6 +633,8 @@ int mkdir_fs(char *name, uint16_t permission) {
 
 	if (parent->mkdir) {
 		parent->mkdir(parent, f_path, permission);
+		dentry_invalidate(parent, f_path);
+		if (watch_active) watch_notify(parent, f_path, WATCH_EVENT_CREATE);
 	}
 
 	free(path);
@@ -416,9 +647,7 @@ fs_node_t *clone_fs(fs_node_t *source) {
 	if (!source) return NULL;
 
 	if (source->refcount >= 0) {
-		spin_lock(tmp_refcount_lock);
-		source->refcount++;
-		spin_unlock(tmp_refcount_lock);
+		__sync_fetch_and_add(&source->refcount, 1);
 	}
 
 	return source;
@@ -453,6 +682,11 @@ int symlink_fs(char * target, char * name) {
 
 	if (parent->symlink) {
 		parent->symlink(parent, target, f_path);
+		dentry_invalidate(parent, f_path);
+		spin_lock(symlink_lock);
+		symlink_cache_flush();
+		spin_unlock(symlink_lock);
+		if (watch_active) watch_notify(parent, f_path, WATCH_EVENT_CREATE);
 	}
 
 	free(path);
@@ -479,9 +713,29 @@ int readlink_fs(fs_node_t *node, char * buf, uint32_t size) {
  * @param input Path to append or canonicalize on
  * @returns An absolute path string
  */
+/* Push a copy of a path element onto the canonicalizer stack; both
+ * the node and the string come out of the scratch arena. */
+static void path_push(arena_t * scratch, list_t * out, char * element) {
+	node_t * n = arena_alloc(scratch, sizeof(node_t));
+	n->value = arena_strdup(scratch, element);
+	n->prev  = NULL;
+	n->next  = NULL;
+	n->owner = NULL;
+	list_append(out, n);
+}
+
 char *canonicalize_path(char *cwd, char *input) {
-	/* This is a stack-based canonicalizer; we use a list as a stack */
-	list_t *out = list_create();
+	/* This is a stack-based canonicalizer; we use a list as a stack.
+	 * All of the intermediate strings and stack nodes come from one
+	 * arena and are dropped together at the end - this runs on every
+	 * open, so it shouldn't be doing dozens of matched malloc/free
+	 * pairs per call. */
+	arena_t scratch;
+	arena_init(&scratch, 512);
+
+	list_t stack;
+	list_init(&stack);
+	list_t * out = &stack;
 
 	/*
 	 * If we have a relative path, we need to canonicalize
@@ -489,8 +743,7 @@ char *canonicalize_path(char *cwd, char *input) {
 	 */
 	if (strlen(input) && input[0] != PATH_SEPARATOR) {
 		/* Make a copy of the working directory */
-		char *path = malloc((strlen(cwd) + 1) * sizeof(char));
-		memcpy(path, cwd, strlen(cwd) + 1);
+		char *path = arena_strdup(&scratch, cwd);
 
 		/* Setup tokenizer */
 		char *pch;
@@ -499,19 +752,14 @@ char *canonicalize_path(char *cwd, char *input) {
 
 		/* Start tokenizing */
 		while (pch != NULL) {
-			/* Make copies of the path elements */
-			char *s = malloc(sizeof(char) * (strlen(pch) + 1));
-			memcpy(s, pch, strlen(pch) + 1);
-			/* And push them */
-			list_insert(out, s);
+			/* Push copies of the path elements */
+			path_push(&scratch, out, pch);
 			pch = strtok_r(NULL,PATH_SEPARATOR_STRING,&save);
 		}
-		free(path);
 	}
 
 	/* Similarly, we need to push the elements from the new path */
-	char *path = malloc((strlen(input) + 1) * sizeof(char));
-	memcpy(path, input, strlen(input) + 1);
+	char *path = arena_strdup(&scratch, input);
 
 	/* Initialize the tokenizer... */
 	char *pch;
@@ -527,13 +775,10 @@ char *canonicalize_path(char *cwd, char *input) {
 		if (!strcmp(pch,PATH_UP)) {
 			/*
 			 * Path = ..
-			 * Pop the stack to move up a directory
+			 * Pop the stack to move up a directory;
+			 * the node stays in the arena until the end
 			 */
-			node_t * n = list_pop(out);
-			if (n) {
-				free(n->value);
-				free(n);
-			}
+			list_pop(out);
 		} else if (!strcmp(pch,PATH_DOT)) {
 			/*
 			 * Path = .
@@ -544,13 +789,10 @@ char *canonicalize_path(char *cwd, char *input) {
 			 * Regular path, push it
 			 * XXX: Path elements should be checked for existence!
 			 */
-			char * s = malloc(sizeof(char) * (strlen(pch) + 1));
-			memcpy(s, pch, strlen(pch) + 1);
-			list_insert(out, s);
+			path_push(&scratch, out, pch);
 		}
 		pch = strtok_r(NULL, PATH_SEPARATOR_STRING, &save);
 	}
-	free(path);
 
 	/* Calculate the size of the path string */
 	size_t size = 0;
@@ -581,17 +823,20 @@ char *canonicalize_path(char *cwd, char *input) {
 	}
 
 	/* Clean up the various things we used to get here */
-	list_destroy(out);
-	list_free(out);
-	free(out);
+	arena_reset(&scratch);
 
 	/* And return a working, absolute path */
 	return output;
 }
 
 void vfs_install(void) {
-	/* Initialize the mountpoint tree */
-	fs_tree = tree_create();
+	/* Initialize the mountpoint tree; nodes come from an arena so the
+	 * mount walk in vfs_mount stays within a few cache lines */
+	fs_tree = tree_create_arena(4096);
+	fs_node_cache = kcache_create("fs_node_t", sizeof(fs_node_t), 64);
+	dentry_cache = hashmap_create(DENTRY_MAX);
+	symlink_cache = hashmap_create(SYMLINK_CACHE_MAX);
+	mount_table = hashmap_create(16);
 
 	struct vfs_entry * root = malloc(sizeof(struct vfs_entry));
 
@@ -696,8 +941,7 @@ void * vfs_mount(char * path, fs_node_t * local_root) {
 			}
 			int found = 0;
 			debug_print(NOTICE, "Searching for %s", at);
-			foreach(child, node->children) {
-				tree_node_t * tchild = (tree_node_t *)child->value;
+			foreach_child(tchild, node) {
 				struct vfs_entry * ent = (struct vfs_entry *)tchild->value;
 				if (!strcmp(ent->name, at)) {
 					found = 1;
@@ -721,6 +965,17 @@ void * vfs_mount(char * path, fs_node_t * local_root) {
 		}
 		ent->file = local_root;
 		ret_val = node;
+
+		/* Record the normalized path so get_mount_point can find this
+		 * mount with hash lookups instead of walking the tree. */
+		char * flat = malloc(path_len + 2);
+		size_t flen = 0;
+		for (char * tok = p + 1; tok < p + path_len; tok += strlen(tok) + 1) {
+			if (!*tok) continue;
+			flen += sprintf(flat + flen, "/%s", tok);
+		}
+		hashmap_set(mount_table, flat, ent);
+		free(flat);
 	}
 
 	free(p);
@@ -760,9 +1015,9 @@ void debug_print_vfs_tree_node(tree_node_t * node, size_t height) {
 	/* Linefeed */
 	debug_print(NOTICE, "%s", tmp);
 	free(tmp);
-	foreach(child, node->children) {
+	foreach_child(child, node) {
 		/* Recursively print the children */
-		debug_print_vfs_tree_node(child->value, height + 1);
+		debug_print_vfs_tree_node(child, height + 1);
 	}
 }
 
@@ -783,43 +1038,35 @@ fs_node_t *get_mount_point(char * path, unsigned int path_depth, char **outpath,
 
 	/* Last available node */
 	fs_node_t   * last = fs_root;
-	tree_node_t * node = fs_tree->root;
 
 	char * at = *outpath;
 	int _depth = 1;
 	int _tree_depth = 0;
 
-	while (1) {
-		if (at >= path) {
-			break;
-		}
-		int found = 0;
-		debug_print(INFO, "Searching for %s", at);
-		foreach(child, node->children) {
-			tree_node_t * tchild = (tree_node_t *)child->value;
-			struct vfs_entry * ent = (struct vfs_entry *)tchild->value;
-			if (!strcmp(ent->name, at)) {
-				found = 1;
-				node = tchild;
-				at = at + strlen(at) + 1;
-				if (ent->file) {
-					_tree_depth = _depth;
-					last = ent->file;
-					*outpath = at;
-				}
-				break;
-			}
-		}
-		if (!found) {
-			break;
+	/*
+	 * Rebuild the path one component at a time and take the deepest
+	 * prefix with something mounted on it - one hash lookup per
+	 * component instead of a name scan against every tree level.
+	 */
+	char * prefix = malloc((size_t)(path - at) + 2);
+	size_t plen = 0;
+	while (at < path) {
+		plen += sprintf(prefix + plen, "/%s", at);
+		at += strlen(at) + 1;
+		struct vfs_entry * ent = mount_table ? hashmap_get(mount_table, prefix) : NULL;
+		if (ent && ent->file) {
+			_tree_depth = _depth;
+			last = ent->file;
+			*outpath = at;
 		}
 		_depth++;
 	}
+	free(prefix);
 
 	*outdepth = _tree_depth;
 
 	if (last) {
-		fs_node_t * last_clone = malloc(sizeof(fs_node_t));
+		fs_node_t * last_clone = kcache_alloc(fs_node_cache);
 		memcpy(last_clone, last, sizeof(fs_node_t));
 		return last_clone;
 	}
@@ -836,13 +1083,20 @@ fs_node_t *kopen_recur(char *filename, uint32_t flags, uint32_t symlink_depth, c
 
 	/* Canonicalize the (potentially relative) path... */
 	char *path = canonicalize_path(relative_to, filename);
-	/* And store the length once to save recalculations */
+	/* Writers need fresh metadata for the final component */
+	int use_cache = !(flags & (O_WRONLY | O_RDWR | O_TRUNC | O_CREAT | O_APPEND));
+
+	/* Symlinks splice their target into the path and jump back here,
+	 * so a chain of links costs one walk each rather than a recursive
+	 * re-resolution, and symlink_depth is a plain hop budget. */
+restart: ;
+	/* Store the length once to save recalculations */
 	size_t path_len = strlen(path);
 
 	/* If strlen(path) == 1, then path = "/"; return root */
 	if (path_len == 1) {
 		/* Clone the root file system node */
-		fs_node_t *root_clone = malloc(sizeof(fs_node_t));
+		fs_node_t *root_clone = kcache_alloc(fs_node_cache);
 		memcpy(root_clone, fs_root, sizeof(fs_node_t));
 
 		/* Free the path */
@@ -895,8 +1149,12 @@ fs_node_t *kopen_recur(char *filename, uint32_t flags, uint32_t symlink_depth, c
 	for (; depth < path_depth; ++depth) {
 		/* Search the active directory for the requested directory */
 		debug_print(INFO, "... Searching for %s", path_offset);
-		node_next = finddir_fs(node_ptr, path_offset);
-		free(node_ptr); /* Always a clone or an unopened thing */
+		int leaf = (depth == path_depth - 1);
+		if (leaf && !use_cache) {
+			dentry_invalidate(node_ptr, path_offset);
+		}
+		node_next = dentry_finddir(node_ptr, path_offset, use_cache || !leaf);
+		kcache_free(fs_node_cache, node_ptr); /* Always a clone or an unopened thing */
 		node_ptr = node_next;
 		if (!node_ptr) {
 			/* We failed to find the requested directory */
@@ -928,12 +1186,8 @@ fs_node_t *kopen_recur(char *filename, uint32_t flags, uint32_t symlink_depth, c
 				free(node_ptr);
 				return NULL;
 			}
-			/* 
-			 * This may actually be big enough that we wouldn't want to allocate it on
-			 * the stack, especially considering this function is called recursively
-			 */
 			char symlink_buf[MAX_SYMLINK_SIZE];
-			int len = readlink_fs(node_ptr, symlink_buf, sizeof(symlink_buf));
+			int len = symlink_target(node_ptr, symlink_buf, sizeof(symlink_buf));
 			if (len < 0) {
 				/* TODO(gerow): should probably be setting errno from this */
 				debug_print(WARNING, "Got error %d from symlink for %s.", len, node_ptr->name);
@@ -948,8 +1202,9 @@ fs_node_t *kopen_recur(char *filename, uint32_t flags, uint32_t symlink_depth, c
 				free(node_ptr);
 				return NULL;
 			}
-			fs_node_t * old_node_ptr = node_ptr;
-			/* Rebuild our path up to this point. This is hella hacky. */
+			/* Rebuild the parent prefix of the link so a relative
+			 * target resolves against the right directory. This is
+			 * hella hacky. */
 			char * relpath = malloc(path_len + 1);
 			char * ptr = relpath;
 			memcpy(relpath, path, path_len + 1);
@@ -959,15 +1214,21 @@ fs_node_t *kopen_recur(char *filename, uint32_t flags, uint32_t symlink_depth, c
 				}
 				*ptr = PATH_SEPARATOR;
 			}
-			node_ptr = kopen_recur(symlink_buf, 0, symlink_depth + 1, relpath);
-			free(relpath);
-			free(old_node_ptr);
-			if (!node_ptr) {
-				/* Dangling symlink? */
-				debug_print(WARNING, "Failed to open symlink path %s. Perhaps it's a dangling symlink?", symlink_buf);
-				free((void *)path);
-				return NULL;
+			/* Splice the target in place of the link, keeping whatever
+			 * came after it, and walk the new path from the top. */
+			char * rest = path_offset + strlen(path_offset) + 1;
+			char * spliced = malloc(len + path_len + 2);
+			char * w = spliced + sprintf(spliced, "%s", symlink_buf);
+			for (char * r = rest; r < path + path_len; r += strlen(r) + 1) {
+				w += sprintf(w, "/%s", r);
 			}
+			free(node_ptr);
+			free(path);
+			path = canonicalize_path(relpath, spliced);
+			free(relpath);
+			free(spliced);
+			symlink_depth++;
+			goto restart;
 		}
 		if (depth == path_depth - 1) {
 			/* We found the file and are done, open the node */
@@ -0,0 +1,260 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ *
+ * File watch descriptors.
+ *
+ * A watch fd lets a process find out about file creation, removal and
+ * modification without rescanning directories: ioctl(WATCH_ADD) with a
+ * path registers interest in that node, reading returns watch_event
+ * records as things happen, and the fd answers selectcheck/selectwait
+ * so fswait() can block on it alongside pipes and sockets.
+ *
+ * Watches are keyed on the (device, inode) identity of the target, the
+ * same identity the dentry cache uses, so renames of the path string do
+ * not confuse them. The VFS calls watch_notify() from the spots where
+ * it already invalidates dentries, which is exactly the set of
+ * operations a directory poller is trying to observe.
+ */
+#include <system.h>
+#include <fs.h>
+#include <printf.h>
+#include <process.h>
+#include <logging.h>
+#include <list.h>
+#include <kcache.h>
+#include <watch.h>
+
+/* Cap the backlog of a slow reader; further events are dropped. */
+#define WATCH_EVENT_MAX 128
+
+typedef struct watch {
+	int wd;
+	void * device;            /* Identity of the watched node... */
+	uint32_t inode;           /* ...same key the dentry cache uses */
+} watch_t;
+
+typedef struct watch_ctx {
+	list_t * watches;         /* Registered watch_t records */
+	list_t * events;          /* Queued watch_event_t records */
+	list_t * alert_waiters;   /* Processes in fswait() on this fd */
+	list_t * collect;         /* Processes blocked in read() */
+	int next_wd;
+	spin_lock_t lock;
+} watch_ctx_t;
+
+static list_t * watch_contexts = NULL;
+static spin_lock_t watch_lock = { 0 };
+
+/* Cheap guard for the write_fs() hot path: nonzero while any watch
+ * is registered anywhere. */
+volatile int watch_active = 0;
+
+static void watch_alert_waiters(watch_ctx_t * ctx) {
+	if (ctx->alert_waiters) {
+		while (ctx->alert_waiters->head) {
+			node_t * node = list_dequeue(ctx->alert_waiters);
+			process_t * p = node->value;
+			process_alert_node(p, ctx);
+			free(node);
+		}
+	}
+}
+
+/*
+ * Called by the VFS after a create/unlink/modify. @node is the parent
+ * directory for namespace events (with @name the affected child) or
+ * the file itself for modifications (with @name NULL).
+ */
+void watch_notify(fs_node_t * node, char * name, int type) {
+	if (!watch_active || !node) return;
+	if (!node->device && !node->inode) return; /* Anonymous nodes have no identity */
+
+	spin_lock(watch_lock);
+	foreach(cnode, watch_contexts) {
+		watch_ctx_t * ctx = cnode->value;
+		spin_lock(ctx->lock);
+		foreach(wnode, ctx->watches) {
+			watch_t * watch = wnode->value;
+			if (watch->device == node->device && watch->inode == node->inode) {
+				if (ctx->events->length < WATCH_EVENT_MAX) {
+					watch_event_t * event = malloc(sizeof(watch_event_t));
+					event->wd = watch->wd;
+					event->type = type;
+					memset(event->name, 0x00, sizeof(event->name));
+					if (name) {
+						strncpy(event->name, name, sizeof(event->name) - 1);
+					}
+					list_insert(ctx->events, event);
+				}
+				wakeup_queue(ctx->collect);
+				watch_alert_waiters(ctx);
+				break; /* One event per context is plenty */
+			}
+		}
+		spin_unlock(ctx->lock);
+	}
+	spin_unlock(watch_lock);
+}
+
+/*
+ * Collection: fill the buffer with event records. Blocks until at
+ * least one event is available.
+ */
+static uint32_t watch_read(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	watch_ctx_t * ctx = node->device;
+	watch_event_t * events = (watch_event_t *)buffer;
+	uint32_t space = size / sizeof(watch_event_t);
+	uint32_t out = 0;
+
+	if (!space) return 0;
+
+	while (1) {
+		spin_lock(ctx->lock);
+		while (out < space && ctx->events->head) {
+			node_t * n = list_dequeue(ctx->events);
+			memcpy(&events[out], n->value, sizeof(watch_event_t));
+			free(n->value);
+			free(n);
+			out++;
+		}
+		spin_unlock(ctx->lock);
+
+		if (out) break;
+		if (sleep_on(ctx->collect)) break; /* Interrupted by a signal */
+	}
+
+	return out * sizeof(watch_event_t);
+}
+
+static int watch_add(watch_ctx_t * ctx, char * path) {
+	char * p = canonicalize_path((char *)current_process->wd_name, path);
+	fs_node_t * target = kopen(p, 0);
+	free(p);
+	if (!target) return -ENOENT;
+
+	watch_t * watch = malloc(sizeof(watch_t));
+	watch->device = target->device;
+	watch->inode  = target->inode;
+	close_fs(target);
+
+	spin_lock(ctx->lock);
+	watch->wd = ctx->next_wd++;
+	list_insert(ctx->watches, watch);
+	spin_unlock(ctx->lock);
+	watch_active++;
+
+	return watch->wd;
+}
+
+static int watch_remove(watch_ctx_t * ctx, int wd) {
+	spin_lock(ctx->lock);
+	foreach(wnode, ctx->watches) {
+		watch_t * watch = wnode->value;
+		if (watch->wd == wd) {
+			list_delete(ctx->watches, wnode);
+			spin_unlock(ctx->lock);
+			free(watch);
+			free(wnode);
+			watch_active--;
+			return 0;
+		}
+	}
+	spin_unlock(ctx->lock);
+	return -EINVAL;
+}
+
+static int watch_ioctl(fs_node_t * node, int request, void * argp) {
+	watch_ctx_t * ctx = node->device;
+	switch (request) {
+		case WATCH_ADD:
+			if (!argp) return -EINVAL;
+			return watch_add(ctx, (char *)argp);
+		case WATCH_REMOVE:
+			if (!argp) return -EINVAL;
+			return watch_remove(ctx, *(int *)argp);
+		default:
+			return -EINVAL;
+	}
+}
+
+static int watch_check(fs_node_t * node) {
+	watch_ctx_t * ctx = node->device;
+	return ctx->events->head ? 0 : 1;
+}
+
+static int watch_wait(fs_node_t * node, void * process) {
+	watch_ctx_t * ctx = node->device;
+	if (!ctx->alert_waiters) {
+		ctx->alert_waiters = list_create();
+	}
+	list_insert(ctx->alert_waiters, process);
+	list_insert(((process_t *)process)->node_waits, ctx);
+	return 0;
+}
+
+static void watch_close(fs_node_t * node) {
+	watch_ctx_t * ctx = node->device;
+
+	spin_lock(watch_lock);
+	node_t * cnode = list_find(watch_contexts, ctx);
+	if (cnode) {
+		list_delete(watch_contexts, cnode);
+		free(cnode);
+	}
+	spin_unlock(watch_lock);
+
+	while (ctx->watches->head) {
+		node_t * n = list_dequeue(ctx->watches);
+		free(n->value);
+		free(n);
+		watch_active--;
+	}
+	free(ctx->watches);
+	list_free(ctx->events);
+	free(ctx->events);
+	free(ctx->collect);
+	if (ctx->alert_waiters) {
+		free(ctx->alert_waiters);
+	}
+	free(ctx);
+}
+
+fs_node_t * watch_create_context(void) {
+	if (!watch_contexts) return NULL;
+
+	watch_ctx_t * ctx = malloc(sizeof(watch_ctx_t));
+	ctx->watches = list_create();
+	ctx->events = list_create();
+	ctx->alert_waiters = NULL;
+	ctx->collect = list_create();
+	ctx->next_wd = 0;
+	spin_init(ctx->lock);
+
+	spin_lock(watch_lock);
+	list_insert(watch_contexts, ctx);
+	spin_unlock(watch_lock);
+
+	fs_node_t * fnode = kcache_alloc(fs_node_cache);
+	memset(fnode, 0x00, sizeof(fs_node_t));
+	fnode->device = ctx;
+	sprintf(fnode->name, "[watch]");
+	fnode->uid   = current_process->user;
+	fnode->gid   = current_process->user;
+	fnode->mask  = 0600;
+	fnode->flags = FS_CHARDEVICE;
+	fnode->read  = watch_read;
+	fnode->ioctl = watch_ioctl;
+	fnode->close = watch_close;
+	fnode->selectcheck = watch_check;
+	fnode->selectwait  = watch_wait;
+	fnode->refcount = 0;
+
+	return fnode;
+}
+
+void watch_install(void) {
+	watch_contexts = list_create();
+	spin_init(watch_lock);
+	debug_print(NOTICE, "File watch subsystem installed");
+}
@@ -0,0 +1,25 @@
+#ifndef KL_AIO_H
+#define KL_AIO_H
+
+#include <system.h>
+#include <fs.h>
+
+/* Submission descriptor: write() an array of these to an aio fd */
+typedef struct aio_op {
+	int      fd;       /* Descriptor to read or write */
+	int      write;    /* 0 = read, 1 = write */
+	uint32_t offset;   /* Absolute file offset */
+	uint32_t size;     /* Bytes to transfer */
+	void *   buffer;   /* Caller's buffer */
+} aio_op_t;
+
+/* Completion record: read() an array of these back */
+typedef struct aio_event {
+	int id;            /* Submission id, in submission order per fd */
+	int result;        /* Bytes transferred, or negative error */
+} aio_event_t;
+
+extern void aio_install(void);
+extern fs_node_t * aio_create_context(void);
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef KL_ARENA_H
+#define KL_ARENA_H
+
+#include <system.h>
+
+/*
+ * Region allocator for request-scoped scratch memory.
+ *
+ * An arena bump-allocates out of malloc'd chunks; nothing is freed
+ * individually, and arena_reset() returns every chunk at once. Use
+ * one for work like path canonicalization where a pile of small
+ * allocations all die together - the matched malloc/free pairs
+ * collapse into a single reset.
+ *
+ * The arena_t itself lives wherever the caller wants (usually the
+ * stack); arena_init() does not allocate.
+ */
+
+typedef struct arena_chunk {
+	struct arena_chunk * next;
+	size_t used;
+	size_t size;
+	/* allocations follow */
+} arena_chunk_t;
+
+typedef struct arena {
+	arena_chunk_t * chunks;
+	size_t chunk_size;
+} arena_t;
+
+extern void arena_init(arena_t * arena, size_t chunk_size);
+extern void * arena_alloc(arena_t * arena, size_t size);
+extern char * arena_strdup(arena_t * arena, const char * s);
+extern void arena_reset(arena_t * arena);
+
+#endif
@@ -41,6 +41,9 @@
 #define ATAPI_CMD_READ       0xA8
 #define ATAPI_CMD_EJECT      0x1B
 
+/* Block until all deferred writes have reached the disk */
+#define IOCTL_ATA_FLUSH      0x4101
+
 #define ATA_IDENT_DEVICETYPE   0
 #define ATA_IDENT_CYLINDERS    2
 #define ATA_IDENT_HEADS        6
@@ -14,7 +14,12 @@ void bitset_free(bitset_t *set);
 void bitset_set(bitset_t *set, size_t bit);
 void bitset_clear(bitset_t *set, size_t bit);
 int bitset_test(bitset_t *set, size_t bit);
+/* Atomically set a bit; returns its previous state */
+int bitset_test_and_set(bitset_t *set, size_t bit);
 /* Find first unset bit */
 int bitset_ffub(bitset_t *set);
+/* Same, over a raw bitmap (e.g. an on-disk block bitmap), starting
+ * from a given bit */
+int bitset_ffub_raw(unsigned char *data, size_t bytes, size_t start);
 
 #endif
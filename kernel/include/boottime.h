@@ -0,0 +1,30 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ *
+ * Boot milestone timestamps.
+ *
+ * kmain stages, module loads, and userspace milestones (via sysfunc
+ * 16, root only) each drop a named timestamp here; /proc/boottime
+ * reads them back after boot so release checklists can diff boot
+ * timelines. Marks recorded before the timer is running show 0.000.
+ */
+#ifndef BOOTTIME_H
+#define BOOTTIME_H
+
+#include <types.h>
+
+#define BOOT_MARKS_MAX  64
+#define BOOT_MARK_NAME  48
+
+typedef struct {
+	char name[BOOT_MARK_NAME];
+	uint32_t ticks;            /* Seconds since the timer started */
+	uint32_t subticks;         /* Milliseconds */
+} boot_mark_t;
+
+extern void boot_mark(const char * name);
+extern boot_mark_t * boot_marks_get(size_t * count);
+
+#endif /* BOOTTIME_H */
@@ -98,6 +98,10 @@ typedef struct {
 #define PT_NULL    0 /* Unused, skip me */
 #define PT_LOAD    1 /* Loadable segment */
 #define PT_DYNAMIC 2 /* Dynamic linking information */
+
+#define PF_X 0x1 /* Segment is executable */
+#define PF_W 0x2 /* Segment is writable */
+#define PF_R 0x4 /* Segment is readable */
 #define PT_INTERP  3 /* Interpreter (null-terminated string, pathname) */
 #define PT_NOTE    4 /* Auxillary information */
 #define PT_SHLIB   5 /* Reserved. */
@@ -0,0 +1,14 @@
+#ifndef KL_EVENTFD_H
+#define KL_EVENTFD_H
+
+#include <system.h>
+#include <fs.h>
+
+/* ioctl requests on a timer fd; intervals are in milliseconds */
+#define TIMERFD_SET 0x5801   /* argp = unsigned long * interval; 0 disarms */
+#define TIMERFD_GET 0x5802   /* returns the current interval */
+
+extern fs_node_t * eventfd_create(unsigned int initial);
+extern fs_node_t * timerfd_create(void);
+
+#endif
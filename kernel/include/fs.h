@@ -17,6 +17,7 @@
 #define O_EXCL       0x0800
 #define O_NOFOLLOW   0x1000
 #define O_PATH       0x2000
+#define O_DIRECT     0x4000
 
 #define FS_FILE        0x01
 #define FS_DIRECTORY   0x02
@@ -35,6 +36,10 @@
 #define     _IFSOCK 0140000 /* socket */
 #define     _IFIFO  0010000 /* fifo */
 
+/* Node ioctl issued by fsync: flush any filesystem write-back state
+ * for this node's backing store down to the underlying device. */
+#define IOCTL_SYNC 0x4653
+
 struct fs_node;
 
 typedef uint32_t (*read_type_t) (struct fs_node *, uint32_t, uint32_t, uint8_t *);
@@ -90,6 +95,7 @@ typedef struct fs_node {
 	struct fs_node *ptr;   /* Alias pointer, for symlinks. */
 	uint32_t offset;       /* Offset for read operations XXX move this to new "file descriptor" entry */
 	int32_t refcount;
+	rwlock_t rwlock;       /* Readers share, writers exclude (regular files) */
 	uint32_t nlink;
 
 	selectcheck_type_t selectcheck;
@@ -120,12 +126,19 @@ struct stat  {
 	uint32_t  st_blocks;
 };
 
+/* Batched readdir+stat record; see sys_readdirstat. */
+struct dirent_stat {
+	struct dirent d;
+	struct stat st;
+};
+
 struct vfs_entry {
 	char * name;
 	fs_node_t * file;
 };
 
 extern fs_node_t *fs_root;
+extern struct kcache * fs_node_cache;
 extern int pty_create(void *size, fs_node_t ** fs_master, fs_node_t ** fs_slave);
 
 int has_permission(fs_node_t *node, int permission_bit);
@@ -135,6 +148,7 @@ void open_fs(fs_node_t *node, unsigned int flags);
 void close_fs(fs_node_t *node);
 struct dirent *readdir_fs(fs_node_t *node, uint32_t index);
 fs_node_t *finddir_fs(fs_node_t *node, char *name);
+void dentry_invalidate(fs_node_t * parent, char * name);
 int mkdir_fs(char *name, uint16_t permission);
 int create_file_fs(char *name, uint16_t permission);
 fs_node_t *kopen(char *filename, uint32_t flags);
@@ -148,6 +162,9 @@ int readlink_fs(fs_node_t * node, char * buf, size_t size);
 int selectcheck_fs(fs_node_t * node);
 int selectwait_fs(fs_node_t * node, void * process);
 
+fs_node_t * ramdisk_mount(uintptr_t location, size_t size);
+void * ramdisk_fetch(fs_node_t * node);
+
 void vfs_install(void);
 void * vfs_mount(char * path, fs_node_t * local_root);
 typedef fs_node_t * (*vfs_mount_callback)(char * arg, char * mount_point);
@@ -15,6 +15,7 @@ typedef unsigned int (*hashmap_hash_t) (void * key);
 typedef int (*hashmap_comp_t) (void * a, void * b);
 typedef void (*hashmap_free_t) (void *);
 typedef void * (*hashmap_dupe_t) (void *);
+typedef int (*hashmap_callback_t) (void * key, void * value, void * extra);
 
 typedef struct hashmap_entry {
 	char * key;
@@ -22,6 +23,13 @@ typedef struct hashmap_entry {
 	struct hashmap_entry * next;
 } hashmap_entry_t;
 
+typedef struct hashmap_flat_slot {
+	void * key;
+	void * value;
+	unsigned int hash;
+	int state; /* 0 = empty, 1 = occupied */
+} hashmap_flat_slot_t;
+
 typedef struct hashmap {
 	hashmap_hash_t hash_func;
 	hashmap_comp_t hash_comp;
@@ -30,16 +38,23 @@ typedef struct hashmap {
 	hashmap_free_t hash_val_free;
 	size_t         size;
 	hashmap_entry_t ** entries;
+	/* Flat (open addressing) maps store slots inline instead */
+	int            flat;
+	size_t         count;
+	hashmap_flat_slot_t * slots;
 } hashmap_t;
 
 hashmap_t * hashmap_create(int size);
 hashmap_t * hashmap_create_int(int size);
+hashmap_t * hashmap_create_flat(int size);
+hashmap_t * hashmap_create_flat_int(int size);
 void * hashmap_set(hashmap_t * map, void * key, void * value);
 void * hashmap_get(hashmap_t * map, void * key);
 void * hashmap_remove(hashmap_t * map, void * key);
 int hashmap_has(hashmap_t * map, void * key);
 list_t * hashmap_keys(hashmap_t * map);
 list_t * hashmap_values(hashmap_t * map);
+int hashmap_for_each(hashmap_t * map, hashmap_callback_t func, void * extra);
 void hashmap_free(hashmap_t * map);
 
 unsigned int hashmap_string_hash(void * key);
@@ -2,6 +2,7 @@
 #define _IPV4_H
 
 #include <system.h>
+#include <ringbuffer.h>
 
 struct ethernet_packet {
 	uint8_t destination[6];
@@ -125,6 +126,21 @@ struct tcp_check_header {
 #define ETHERNET_TYPE_IPV4 0x0800
 #define ETHERNET_TYPE_ARP  0x0806
 
+#define ARP_OPER_REQUEST 1
+#define ARP_OPER_REPLY   2
+
+struct arp_packet {
+	uint16_t htype;
+	uint16_t ptype;
+	uint8_t  hlen;
+	uint8_t  plen;
+	uint16_t oper;
+	uint8_t  sender_ha[6];
+	uint32_t sender_ip;
+	uint8_t  target_ha[6];
+	uint32_t target_ip;
+} __attribute__ ((packed));
+
 extern uint32_t ip_aton(const char * in);
 extern void ip_ntoa(uint32_t src_addr, char * out);
 extern uint16_t calculate_ipv4_checksum(struct ipv4_packet * p);
@@ -135,28 +151,42 @@ struct tcp_socket {
 	uint32_t seq_no;
 	uint32_t ack_no;
 	int status;
+
+	/* Transmit state: retransmission queue and Reno congestion control */
+	list_t * unacked;        /* Sent-but-unacknowledged segments, in order */
+	list_t * send_wait;      /* Senders blocked on the transmit window */
+	spin_lock_t tx_lock;
+	uint32_t snd_una;        /* Oldest unacknowledged sequence number */
+	uint32_t cwnd;           /* Congestion window, bytes */
+	uint32_t ssthresh;       /* Slow start threshold, bytes */
+	uint32_t srtt;           /* Smoothed RTT, milliseconds */
+	uint32_t rttvar;         /* RTT variance, milliseconds */
+	uint32_t rto;            /* Retransmission timeout, milliseconds */
+	uint16_t peer_window;    /* Last window the peer advertised */
+	uint8_t  dup_acks;       /* Duplicate ACK run, for fast retransmit */
 };
 
 // Note: for now, not sure what to put in here, so removing from the union to get rid of compiler warnings about empty struct
-// struct udp_socket {
-// };
+struct udp_socket {
+	list_t * packets;       /* Queued datagrams (sized_blob), bounded */
+	uint32_t queue_bytes;
+	uint32_t drops;         /* Datagrams dropped against the queue cap */
+	uint32_t remote;        /* Remote address filter; 0 matches anyone */
+};
 
 struct socket {
 	uint32_t ip;
 	uint8_t  mac[6];
 	uint32_t port_dest;
 	uint32_t port_recv;
-	list_t* packet_queue;
-	spin_lock_t packet_queue_lock;
+	ring_buffer_t * recv_buf;  /* Fixed receive buffer; free space is the advertised window */
+	uint8_t window_stalled;    /* We dropped for lack of window; ACK when space opens */
 	list_t* packet_wait;
 	int32_t status;
-	size_t bytes_available;
-	size_t bytes_read;
-	void * current_packet;
 	uint32_t sock_type;
 	union {
 		struct tcp_socket tcp_socket;
-		// struct udp_socket udp_socket;
+		struct udp_socket udp_socket;
 	} proto_sock;
 };
 
@@ -181,9 +211,4 @@ struct sockaddr_in {
 	char			sin_zero[8];  // zero this if you want to
 };
 
-typedef struct {
-	uint8_t	*payload;
-	size_t	payload_size;
-} tcpdata_t;
-
 #endif
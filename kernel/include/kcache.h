@@ -0,0 +1,34 @@
+#ifndef KL_KCACHE_H
+#define KL_KCACHE_H
+
+#include <system.h>
+
+/*
+ * Object cache over klmalloc.
+ *
+ * A cache keeps a bounded free list of recycled objects of one size so
+ * hot allocation paths (processes, file nodes, list nodes, pipe
+ * buffers) can reuse recently-freed objects instead of going back
+ * through the general-purpose allocator on every call.
+ *
+ * Objects are individually malloc()ed on a miss, so it is always safe
+ * to release a cache-allocated object with plain free() - it just
+ * won't be reused.
+ */
+
+typedef struct kcache {
+	char * name;            /* For debugging */
+	size_t object_size;
+	size_t max_cached;      /* Free list cap */
+	size_t cached;          /* Objects currently on the free list */
+	void * head;            /* Intrusive free list through the first word */
+	unsigned long allocs;
+	unsigned long hits;
+	spin_lock_t lock;
+} kcache_t;
+
+extern kcache_t * kcache_create(char * name, size_t object_size, size_t max_cached);
+extern void * kcache_alloc(kcache_t * cache);
+extern void kcache_free(kcache_t * cache, void * object);
+
+#endif
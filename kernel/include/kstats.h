@@ -0,0 +1,35 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ *
+ * Named kernel event counters.
+ *
+ * Any subsystem can register a counter by name and bump it from hot
+ * paths with KSTAT_INC - an atomic add, no lock, no formatting. The
+ * whole registry is listed by /proc/kstats, replacing one-off
+ * debug_print counting. Register lazily at first use so callers
+ * don't need an install hook:
+ *
+ *     static kstat_t * faults = NULL;
+ *     if (__builtin_expect(!faults, 0)) faults = kstat_register("mem.page_faults");
+ *     KSTAT_INC(faults);
+ */
+#ifndef KSTATS_H
+#define KSTATS_H
+
+#include <types.h>
+
+typedef struct kstat {
+	const char * name;         /* dotted, subsystem-first: "mem.page_faults" */
+	volatile uint32_t value;
+	struct kstat * next;
+} kstat_t;
+
+#define KSTAT_INC(k) __sync_fetch_and_add(&(k)->value, 1)
+#define KSTAT_ADD(k, n) __sync_fetch_and_add(&(k)->value, (n))
+
+extern kstat_t * kstat_register(const char * name);
+extern kstat_t * kstat_first(void);
+
+#endif /* KSTATS_H */
@@ -18,6 +18,7 @@ extern int memcmp(const void *vl, const void *vr, size_t n);
 extern char * strdup(const char * s);
 extern char * stpcpy(char * restrict d, const char * restrict s);
 extern char * strcpy(char * restrict dest, const char * restrict src);
+extern char * strncpy(char * restrict dest, const char * restrict src, size_t n);
 extern char * strchrnul(const char * s, int c);
 extern char * strchr(const char * s, int c);
 extern char * strrchr(const char * s, int c);
@@ -28,6 +28,7 @@ typedef struct {
 
 void list_destroy(list_t * list);
 void list_free(list_t * list);
+void list_init(list_t * list);
 void list_append(list_t * list, node_t * item);
 node_t * list_insert(list_t * list, void * item);
 list_t * list_create(void);
@@ -13,6 +13,8 @@ typedef enum {
 extern log_type_t debug_level;
 extern void * debug_file;
 extern void _debug_print(char * title, int line_no, log_type_t level, char *fmt, ...);
+extern void logging_install_flusher(void);
+extern void logging_direct(void);
 extern void (*debug_hook)(void *, char *);
 extern void (*debug_video_crash)(char **);
 
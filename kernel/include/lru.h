@@ -0,0 +1,49 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ *
+ * Fixed-capacity LRU cache: hashmap index plus a doubly-linked
+ * recency list, so get/set/evict are all O(1).
+ */
+#ifndef KL_LRU_H
+#define KL_LRU_H
+
+#include "hashmap.h"
+
+/* Called when an entry is evicted (capacity, shrink, or lru_free);
+ * the callback owns the value. Not called for lru_remove. */
+typedef void (*lru_evict_t) (void * key, void * value, void * extra);
+
+typedef struct lru_entry {
+	void * key;
+	void * value;
+	struct lru_entry * newer;
+	struct lru_entry * older;
+} lru_entry_t;
+
+typedef struct lru {
+	hashmap_t * index;     /* key -> lru_entry_t * */
+	lru_entry_t * entries; /* preallocated pool, capacity entries */
+	lru_entry_t * unused;  /* free entries, threaded through ->newer */
+	lru_entry_t * newest;
+	lru_entry_t * oldest;
+	size_t count;
+	size_t capacity;
+	lru_evict_t on_evict;
+	void * extra;
+	hashmap_dupe_t key_dup;
+	hashmap_free_t key_free;
+} lru_t;
+
+lru_t * lru_create(size_t capacity, lru_evict_t on_evict, void * extra);
+lru_t * lru_create_int(size_t capacity, lru_evict_t on_evict, void * extra);
+void * lru_get(lru_t * cache, void * key);  /* marks the entry most-recently used */
+void * lru_peek(lru_t * cache, void * key); /* leaves recency alone */
+void lru_set(lru_t * cache, void * key, void * value);
+void * lru_remove(lru_t * cache, void * key);
+void lru_shrink(lru_t * cache, size_t target);
+void lru_free(lru_t * cache);
+
+#ifdef _KERNEL_
+void lru_autoshrink(lru_t * cache);
+#endif
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef KL_MMAP_H
+#define KL_MMAP_H
+
+#include <system.h>
+#include <fs.h>
+#include <process.h>
+
+#define PROT_READ   0x01
+#define PROT_WRITE  0x02
+
+#define MAP_SHARED  0x01
+#define MAP_PRIVATE 0x02
+
+/* Bottom of the file-mapping window; mappings grow up from here */
+#define MMAP_START  0x90000000
+
+typedef struct mmap_region {
+	uintptr_t base;        /* Page-aligned start address */
+	size_t size;           /* Length, in bytes, page-aligned */
+	fs_node_t * node;      /* The backing file (we hold a reference) */
+	uint32_t offset;       /* Offset into the file of base */
+	size_t file_limit;     /* Bytes from base actually file-backed; the rest reads as zeroes */
+	int prot;
+	int flags;
+} mmap_region_t;
+
+extern void * mmap_map(fs_node_t * node, uint32_t offset, size_t length, int prot, int flags);
+extern void mmap_map_fixed(fs_node_t * node, uintptr_t base, uint32_t offset, size_t length, int prot, int flags, size_t file_limit);
+extern int mmap_fault(uintptr_t address);
+extern void mmap_release_all(process_t * proc);
+
+#endif
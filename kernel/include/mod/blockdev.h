@@ -0,0 +1,48 @@
+#ifndef KERNEL_MOD_BLOCKDEV_H
+#define KERNEL_MOD_BLOCKDEV_H
+
+#include <fs.h>
+#include <system.h>
+#include <hashmap.h>
+
+struct blockdev;
+
+/* Sector-granular transfers; the block layer takes care of slicing
+ * byte-oriented VFS requests, so drivers only ever see whole sectors. */
+typedef int (*blockdev_io_fn)(struct blockdev * bdev, uint32_t lba, unsigned int count, uint8_t * buf);
+typedef int (*blockdev_flush_fn)(struct blockdev * bdev);
+
+struct blockdev {
+	void * driver;             /* Driver's device handle */
+	uint32_t sector_size;
+	uint64_t total_sectors;
+	uint32_t lba_offset;       /* Added at submission time (partition views) */
+	struct blockdev * phys;    /* Cache owner; self unless this is a view */
+	blockdev_io_fn read;
+	blockdev_io_fn write;      /* NULL for read-only media */
+	blockdev_flush_fn flush;   /* NULL if the driver writes synchronously */
+
+	hashmap_t * cache;         /* Write-through sector cache */
+	unsigned int cache_count;
+	spin_lock_t lock;
+	uint8_t dev_id;            /* Small ordinal for trace records */
+};
+
+/* One captured request, as read from /dev/blktrace. Capture runs while
+ * the node is held open; LBAs are absolute on the physical device.
+ * Userspace sees this through the matching header shipped with newlib -
+ * keep the two in sync. */
+typedef struct {
+	uint32_t ticks;            /* Submission time */
+	uint32_t subticks;
+	uint32_t lba;              /* Absolute starting sector */
+	uint16_t count;            /* Sectors transferred */
+	uint8_t  write;            /* 0 = read, 1 = write */
+	uint8_t  dev;              /* Physical device ordinal */
+} blktrace_rec_t;
+
+fs_node_t * blockdev_create(char * name, void * driver, uint32_t sector_size, uint64_t total_sectors, blockdev_io_fn read, blockdev_io_fn write, blockdev_flush_fn flush);
+fs_node_t * blockdev_create_view(fs_node_t * master, char * name, uint32_t lba_offset, uint64_t total_sectors);
+struct blockdev * blockdev_from_node(fs_node_t * node);
+
+#endif /* KERNEL_MOD_BLOCKDEV_H */
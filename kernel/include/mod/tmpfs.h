@@ -16,7 +16,7 @@ struct tmpfs_file {
 	size_t length;
 	size_t block_count;
 	size_t pointers;
-	char ** blocks;
+	uintptr_t * blocks; /* Frame indexes; 0 is a hole */
 	char * target;
 };
 
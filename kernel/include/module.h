@@ -17,16 +17,30 @@ typedef struct {
     uintptr_t end;
     size_t deps_length;
     char * deps;
+    volatile int initialized;
 } module_data_t;
 
 void (* symbol_find(const char * name))(void);
 
+/* Nearest symbol at or below addr, for backtraces and fault reports */
+extern char * ksym_find(uintptr_t addr, uintptr_t * out_addr);
+
+/* Address-ordered enumeration of the same index, for /proc/ksyms */
+extern size_t ksym_total(void);
+extern char * ksym_get(size_t i, uintptr_t * out_addr);
+
 extern int module_quickcheck(void * blob);
 extern void * module_load_direct(void * blob, size_t size);
 extern void * module_load(char * filename);
 extern void module_unload(char * name);
 extern void modules_install(void);
 
+/* Boot-time concurrent module init: while this is set, loads defer
+ * initialize() to tasklets that honor moddeps ordering; the barrier
+ * waits for all of them to finish. */
+extern int module_init_async;
+extern void modules_init_barrier(void);
+
 #define MODULE_DEF(n,init,fini) \
         module_defs module_info_ ## n = { \
             .name       = #n, \
@@ -15,6 +15,10 @@ typedef struct {
 	int32_t x_difference;
 	int32_t y_difference;
 	mouse_click_t buttons;
+	/* Kernel time when the packet was completed, so consumers can
+	 * measure input latency: seconds and milliseconds since boot. */
+	uint32_t ticks;
+	uint32_t subticks;
 } mouse_device_packet_t;
 
 #define MOUSE_MAGIC 0xFEED1234
@@ -0,0 +1,15 @@
+#ifndef KL_PAGECACHE_H
+#define KL_PAGECACHE_H
+
+#include <system.h>
+#include <fs.h>
+
+extern void pagecache_install(void);
+extern int  pagecache_read(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer, uint32_t * out);
+extern int  pagecache_write(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer, uint32_t * out);
+extern uintptr_t pagecache_map_frame(fs_node_t * node, uint32_t offset);
+extern void pagecache_invalidate(fs_node_t * node);
+extern void pagecache_sync(void);
+extern void pagecache_sync_node(fs_node_t * node);
+
+#endif
@@ -37,8 +37,21 @@
 
 #define PCI_NONE 0xFFFF
 
+#define PCI_NO_DEVICE 0xFFFFFFFF
+
 typedef void (*pci_func_t)(uint32_t device, uint16_t vendor_id, uint16_t device_id, void * extra);
 
+/* One cached device: identity, class, and config fields drivers ask
+ * for at probe time, read once during the boot enumeration. */
+typedef struct pci_dev {
+	uint32_t device;
+	uint16_t vendor_id;
+	uint16_t device_id;
+	uint16_t type;
+	uint8_t  irq;
+	uint32_t bars[6];
+} pci_dev_t;
+
 static inline int pci_extract_bus(uint32_t device) {
 	return (uint8_t)((device >> 16));
 }
@@ -68,5 +81,11 @@ void pci_scan_slot(pci_func_t f, int type, int bus, int slot, void * extra);
 void pci_scan_bus(pci_func_t f, int type, int bus, void * extra);
 void pci_scan(pci_func_t f, int type, void * extra);
 
+/* Cached lookups; the first call builds the device table. */
+uint32_t pci_find_device(uint16_t vendor_id, uint16_t device_id);
+uint32_t pci_get_bar(uint32_t device, int bar);
+uint8_t pci_get_interrupt(uint32_t device);
+void pci_install_interrupt_handler(uint32_t device, irq_handler_chain_t handler);
+
 
 #endif
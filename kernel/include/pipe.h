@@ -10,20 +10,30 @@
 
 typedef struct _pipe_device {
 	uint8_t * buffer;
-	size_t write_ptr;
-	size_t read_ptr;
+	volatile size_t write_ptr; /* Owned by the writer; single-store published */
+	volatile size_t read_ptr;  /* Owned by the reader */
 	size_t size;
+	size_t max_size;           /* Auto-grow cap; == size disables growth */
 	size_t refcount;
-	volatile int lock_read[2];
-	volatile int lock_write[2];
+	spin_lock_t lock_read;
+	spin_lock_t lock_write;
 	list_t * wait_queue_readers;
 	list_t * wait_queue_writers;
 	int dead;
 	list_t * alert_waiters;
 } pipe_device_t;
 
+/* Set or query the buffer capacity; argp is the requested size in
+ * bytes, passed by value. Setting also pins the auto-grow cap. */
+#define IOCTL_PIPE_SETSZ 0x5150
+#define IOCTL_PIPE_GETSZ 0x5151
+
+/* Hard ceiling for both the ioctl and auto-growth */
+#define PIPE_MAX_SIZE 0x100000
+
 fs_node_t * make_pipe(size_t size);
 int pipe_size(fs_node_t * node);
 int pipe_unsize(fs_node_t * node);
+void pipe_debug_stats(fs_node_t * tty);
 
 #endif
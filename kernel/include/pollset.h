@@ -0,0 +1,22 @@
+#ifndef KL_POLLSET_H
+#define KL_POLLSET_H
+
+#include <system.h>
+#include <fs.h>
+
+/* ioctl requests on a pollset fd */
+#define POLLSET_ADD    0x5901   /* argp = int * fd to watch */
+#define POLLSET_REMOVE 0x5902   /* argp = int * fd to forget */
+#define POLLSET_WAIT   0x5903   /* argp = pollset_wait_t */
+
+/* Wait request/response: fds[] receives the descriptors with data
+ * ready; the ioctl returns how many were filled in. */
+typedef struct pollset_wait {
+	int timeout;   /* Milliseconds; -1 blocks, 0 just polls */
+	int max;       /* Capacity of fds[] */
+	int fds[];     /* Out: ready descriptors */
+} pollset_wait_t;
+
+extern fs_node_t * pollset_create(void);
+
+#endif
@@ -8,9 +8,17 @@
 #include <tree.h>
 #include <signal.h>
 #include <task.h>
+#include <timerwheel.h>
 
 #define KERNEL_STACK_SIZE 0x8000
 
+/* Scheduler priority levels; lower value = scheduled sooner */
+#define PROCESS_PRIORITY_LEVELS 4
+#define PRIORITY_INTERACTIVE 0
+#define PRIORITY_DEFAULT     1
+#define PRIORITY_BATCH       2
+#define PRIORITY_IDLE        3
+
 typedef signed int    pid_t;
 typedef unsigned int  user_t;
 typedef unsigned char status_t;
@@ -48,7 +56,8 @@ typedef struct image {
 	uintptr_t user_stack;  /* User stack */
 	uintptr_t start;
 	uintptr_t shm_heap;
-	volatile int lock[2];
+	uintptr_t mmap_heap;   /* Next free address for file mappings */
+	spin_lock_t lock;
 } image_t;
 
 /* Resizable descriptor table */
@@ -90,23 +99,53 @@ typedef struct process {
 	status_t      status;            /* Process status */
 	sig_table_t   signals;           /* Signal table */
 	uint8_t       finished;          /* Status indicator */
+	uint8_t       awaited;           /* Parent has collected our status */
 	uint8_t       started;
 	uint8_t       running;
 	struct regs * syscall_registers; /* Registers at interrupt */
 	list_t *      wait_queue;
 	list_t *      shm_mappings;      /* Shared memory chunk mappings */
+	list_t *      mmaps;             /* File-backed memory mappings */
 	list_t *      signal_queue;      /* Queued signals */
+	volatile uint64_t signals_pending; /* Bitmap of queued signals; zero skips the slow path */
+	uint64_t      signals_blocked;   /* Bitmap of blocked signals; delivery deferred while set */
 	thread_t      signal_state;
 	char *        signal_kstack;
 	node_t        sched_node;
+	uint8_t       priority;          /* Ready queue priority level */
+	uint8_t       cpu;               /* Home CPU for scheduling */
+	uint8_t       slice_remaining;   /* Subticks left in current slice */
+	unsigned long long cpu_total;    /* Accumulated CPU time, in subticks */
+	unsigned long cpu_recent;        /* Decaying average of recent usage */
+	unsigned long long sched_in;     /* When we were last scheduled, in subticks */
 	node_t        sleep_node;
-	node_t *      timed_sleep_node;
+	timerwheel_entry_t * timed_sleep_node; /* Pending sleep timer, if any */
 	uint8_t       is_tasklet;
 	volatile uint8_t sleep_interrupted;
-	list_t *      node_waits;
+	list_t *      node_waits;        /* &node_waits_list while in fswait, else NULL */
+	list_t        node_waits_list;   /* Embedded header, so fswait never allocates one */
 	int           awoken_index;
 } process_t;
 
+/*
+ * Per-CPU scheduler state. Groundwork for SMP: only CPU 0 is brought
+ * online today, but the run queues are already per-CPU and the
+ * scheduler steals work across them when its own queues are empty.
+ */
+#define MAX_CPUS 8
+typedef struct kcpu {
+	int               index;
+	uint8_t           online;
+	volatile struct process * current;
+	struct process *  idle;
+	list_t *          queues[PROCESS_PRIORITY_LEVELS];
+	volatile uint32_t ready_bitmap;
+} kcpu_t;
+
+extern kcpu_t scheduler_cpus[MAX_CPUS];
+extern int scheduler_cpu_count;
+extern kcpu_t * cpu_current(void);
+
 typedef struct {
 	unsigned long end_tick;
 	unsigned long end_subtick;
@@ -132,11 +171,17 @@ extern int process_is_ready(process_t * proc);
 
 extern void wakeup_sleepers(unsigned long seconds, unsigned long subseconds);
 extern void sleep_until(process_t * process, unsigned long seconds, unsigned long subseconds);
+extern void ktimer_locked(void (*func)(void *), void * extra);
 
 extern volatile process_t * current_process;
 extern process_t * kernel_idle_task;
+extern timerwheel_t * sleep_wheel;
 extern list_t * process_list;
 
+extern int wakeup_queue_irq(list_t * queue);
+extern int wakeup_queue_irq_interrupted(list_t * queue);
+extern void process_run_deferred_wakeups(void);
+
 extern int process_wait_nodes(process_t * process,fs_node_t * nodes[], int timeout);
 extern int process_alert_node(process_t * process, void * value);
 extern int process_awaken_from_fswait(process_t * process, int index);
@@ -149,6 +194,8 @@ extern void release_directory_for_exec(page_directory_t * dir);
 
 extern void cleanup_process(process_t * proc, int retval);
 extern void reap_process(process_t * proc);
+extern void reap_process_later(process_t * proc);
+extern void reaper_install(void);
 extern int waitpid(int pid, int * status, int options);
 
 #endif
@@ -0,0 +1,25 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ */
+#ifndef KERNEL_PROCFS_H
+#define KERNEL_PROCFS_H
+
+#include <types.h>
+
+/* Fixed-size process record served by /proc/processes: one read
+ * returns an array of these, built straight from the process tree
+ * with no text formatting. Must match struct proc_info in the
+ * userspace <procfs.h>. */
+struct proc_info {
+	uint32_t pid;
+	uint32_t ppid;
+	uint32_t tgid;
+	uint32_t uid;
+	uint32_t cpu_total;      /* accumulated CPU time, msec */
+	uint8_t  state;          /* 'R' or 'S' */
+	char     name[35];       /* basename of the command */
+	char     cmdline[200];   /* full command line, space separated */
+};
+
+#endif
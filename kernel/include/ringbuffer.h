@@ -6,7 +6,7 @@ typedef struct {
 	size_t write_ptr;
 	size_t read_ptr;
 	size_t size;
-	volatile int lock[2];
+	spin_lock_t lock;
 	list_t * wait_queue_readers;
 	list_t * wait_queue_writers;
 	int internal_stop;
@@ -18,6 +18,8 @@ size_t ring_buffer_size(fs_node_t * node);
 size_t ring_buffer_available(ring_buffer_t * ring_buffer);
 size_t ring_buffer_read(ring_buffer_t * ring_buffer, size_t size, uint8_t * buffer);
 size_t ring_buffer_write(ring_buffer_t * ring_buffer, size_t size, uint8_t * buffer);
+size_t ring_buffer_peek(ring_buffer_t * ring_buffer, size_t size, uint8_t * buffer);
+size_t ring_buffer_discard(ring_buffer_t * ring_buffer, size_t size);
 
 ring_buffer_t * ring_buffer_create(size_t size);
 void ring_buffer_destroy(ring_buffer_t * ring_buffer);
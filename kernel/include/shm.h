@@ -36,10 +36,12 @@ typedef struct {
 
 /* Syscalls */
 extern void * shm_obtain(char * path, size_t * size);
+extern void * shm_resize(char * path, size_t * size);
 extern int    shm_release(char * path);
 
 /* Other exposed functions */
 extern void shm_install(void);
 extern void shm_release_all(process_t * proc);
+extern int  shm_fault(uintptr_t address);
 
 #endif
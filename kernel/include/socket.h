@@ -0,0 +1,22 @@
+#ifndef KL_SOCKET_H
+#define KL_SOCKET_H
+
+#include <system.h>
+#include <fs.h>
+
+/*
+ * Hooks a network stack module fills in so the socket syscalls can
+ * reach it: socket() produces an unconnected descriptor node,
+ * connect() attaches it to a remote host. Send and receive are just
+ * read/write on the node.
+ */
+typedef struct socket_interface {
+	fs_node_t * (*socket)(uint32_t type);
+	int (*connect)(fs_node_t * node, uint32_t ip, uint16_t port);
+} socket_interface_t;
+
+extern void socket_install_interface(socket_interface_t * interface);
+extern fs_node_t * socket_create(uint32_t type);
+extern int socket_connect(fs_node_t * node, uint32_t ip, uint16_t port);
+
+#endif
@@ -0,0 +1,29 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ *
+ * Per-syscall invocation counts and latency histograms.
+ *
+ * When enabled (sysfunc 15, root only), the dispatcher times every
+ * call with the subtick clock and buckets the latency by log2. The
+ * table is read back whole from /proc/syscalls as an array of
+ * syscall_stat_t indexed by syscall number. Disabled cost is one
+ * predictable branch in the dispatcher.
+ */
+#ifndef SYSCALLSTATS_H
+#define SYSCALLSTATS_H
+
+#include <types.h>
+
+#define SYSCALL_HIST_BUCKETS 16
+
+typedef struct {
+	uint32_t count;                          /* Invocations since enable */
+	uint32_t buckets[SYSCALL_HIST_BUCKETS];  /* [i] holds latencies of ~2^i subticks */
+} syscall_stat_t;
+
+extern int syscall_stats_set_enabled(int enable);
+extern syscall_stat_t * syscall_stats_get(uint32_t * count);
+
+#endif /* SYSCALLSTATS_H */
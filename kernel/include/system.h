@@ -3,6 +3,34 @@
 #ifndef __SYSTEM_H
 #define __SYSTEM_H
 #include <types.h>
+
+/* spin.c */
+/* Ticket lock: [0] = next ticket, [1] = now serving, [2] = owner,
+ * [3] = saved owner priority + 1, [4] = acquisitions, [5] = contended
+ * acquisitions. Waiters are served in the order they arrived. */
+typedef volatile int spin_lock_t[6];
+extern void spin_init(spin_lock_t lock);
+extern void spin_lock(spin_lock_t lock);
+extern void spin_unlock(spin_lock_t lock);
+
+/* Contended-lock registry for the debug shell */
+typedef struct spin_stat {
+	volatile int * lock;
+	unsigned long contentions;
+} spin_stat_t;
+extern spin_stat_t * spin_lock_stats(int * count);
+
+/* Reader/writer lock: parallel readers, exclusive writers */
+typedef struct rwlock {
+	spin_lock_t lock;
+	volatile int readers;
+} rwlock_t;
+extern void rwlock_init(rwlock_t * lock);
+extern void rwlock_acquire_read(rwlock_t * lock);
+extern void rwlock_release_read(rwlock_t * lock);
+extern void rwlock_acquire_write(rwlock_t * lock);
+extern void rwlock_release_write(rwlock_t * lock);
+
 #include <fs.h>
 #include <va_list.h>
 #include <list.h>
@@ -41,12 +69,6 @@ extern char * boot_arg_extra; /* Extra data to pass to init */
 
 extern void *sbrk(uintptr_t increment);
 
-/* spin.c */
-typedef volatile int spin_lock_t[2];
-extern void spin_init(spin_lock_t lock);
-extern void spin_lock(spin_lock_t lock);
-extern void spin_unlock(spin_lock_t lock);
-
 extern void return_to_userspace(void);
 
 /* Kernel Main */
@@ -113,13 +135,17 @@ extern void irq_uninstall_handler(size_t irq);
 extern int irq_is_handler_free(size_t irq);
 extern void irq_gates(void);
 extern void irq_ack(size_t);
+extern void (*irq_entropy_hook)(unsigned int irq);
 
 /* Timer */
+#define SUBTICKS_PER_TICK 1000
 extern void timer_install(void);
 extern unsigned long timer_ticks;
 extern unsigned long timer_subticks;
 extern signed long timer_drift;
 extern void relative_time(unsigned long seconds, unsigned long subseconds, unsigned long * out_seconds, unsigned long * out_subseconds);
+extern void timer_idle_tickless(void);
+extern void timer_tickless_cancel(void);
 
 /* Memory Management */
 extern uintptr_t placement_pointer;
@@ -145,6 +171,7 @@ extern void invalidate_tables_at(uintptr_t addr);
 extern page_t *get_page(uintptr_t address, int make, page_directory_t * dir);
 extern void page_fault(struct regs *r);
 extern void dma_frame(page_t * page, int, int, uintptr_t);
+extern void dma_large_frame(uintptr_t virtual, int, int, uintptr_t physical);
 extern void debug_print_directory(page_directory_t *);
 
 int debug_shell_start(void);
@@ -153,8 +180,25 @@ void heap_install(void);
 
 void alloc_frame(page_t *page, int is_kernel, int is_writeable);
 void free_frame(page_t *page);
+extern uint32_t alloc_frames(int order);
+extern void free_frames(uint32_t frame, int order);
+extern void lazy_zero_frame(page_t * page);
+extern void frame_ref(uint32_t frame);
+extern uint32_t frame_unref(uint32_t frame);
+extern uint32_t frame_refcount(uint32_t frame);
+extern void frame_pin(uint32_t frame);
+
+/* Backing frame of the shared time page (0 until the timer is up) */
+extern uint32_t time_page_frame(void);
+extern int cow_fault(uintptr_t address);
 uintptr_t memory_use(void);
 uintptr_t memory_total(void);
+extern void register_low_memory_notifier(void (*callback)(void));
+extern int klmalloc_bin_usage(int bin, uint32_t * object_size, uint32_t * pages, uint32_t * live);
+#ifdef KMALLOC_TRACK
+/* Allocation-site tracking; only built with KMALLOC_TRACK=1 */
+extern void kmalloc_track_dump(void (*cb)(uintptr_t site, uint32_t live, uint32_t total, uint32_t live_bytes, void * extra), void * extra);
+#endif
 
 /* klmalloc */
 void * __attribute__ ((malloc)) malloc(size_t size);
@@ -225,11 +269,15 @@ typedef struct {
 } signal_t;
 
 extern void handle_signal(process_t *, signal_t *);
+extern signal_t * process_pop_signal(process_t * proc);
 
 extern int send_signal(pid_t process, uint32_t signal);
 
 #define USER_STACK_BOTTOM 0xAFF00000
 #define USER_STACK_TOP    0xB0000000
+/* How much stack is mapped eagerly at exec; the rest faults in,
+ * down to a permanent guard page at USER_STACK_BOTTOM. */
+#define USER_STACK_PREALLOC 0x4000
 #define SHM_START         0xB0000000
 
 extern void validate(void * ptr);
@@ -9,7 +9,12 @@ typedef struct page {
 	unsigned int user:1;
 	unsigned int writethrough:1;
 	unsigned int cachedisable:1;
-	unsigned int unused:7;
+	unsigned int accessed:1;
+	unsigned int dirty:1;
+	unsigned int pat:1;
+	unsigned int global:1;
+	unsigned int cow:1;        /* Avail bit: copy-on-write pending */
+	unsigned int unused:2;
 	unsigned int frame:20;
 } __attribute__((packed)) page_t;
 
@@ -0,0 +1 @@
+../../toolchain/patches/newlib/include/timepage.h
\ No newline at end of file
@@ -0,0 +1,36 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ *
+ * Hierarchical timer wheel for kernel timers.
+ */
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <types.h>
+#include <list.h>
+
+#define TIMERWHEEL_LEVELS     4
+#define TIMERWHEEL_SLOT_BITS  6
+#define TIMERWHEEL_SLOTS      (1 << TIMERWHEEL_SLOT_BITS)
+
+typedef void (*timerwheel_callback_t) (void * extra);
+
+typedef struct timer_entry {
+	unsigned long long    expiry;   /* Absolute time, in subticks */
+	timerwheel_callback_t callback;
+	void *                extra;
+	node_t *              node;     /* Node in the wheel slot holding this entry */
+} timerwheel_entry_t;
+
+typedef struct timerwheel {
+	unsigned long long time;  /* Last time the wheel was advanced to */
+	unsigned long      count; /* Number of pending entries */
+	list_t slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];
+} timerwheel_t;
+
+timerwheel_t * timerwheel_create(unsigned long long now);
+timerwheel_entry_t * timerwheel_insert(timerwheel_t * wheel, unsigned long long expiry, timerwheel_callback_t callback, void * extra);
+void timerwheel_cancel(timerwheel_t * wheel, timerwheel_entry_t * entry);
+void timerwheel_advance(timerwheel_t * wheel, unsigned long long now);
+unsigned long timerwheel_soonest(timerwheel_t * wheel);
+
+#endif
@@ -0,0 +1,57 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ */
+#ifndef KERNEL_TRACE_H
+#define KERNEL_TRACE_H
+
+#include <types.h>
+
+/*
+ * Static tracepoints.
+ *
+ * debug_print formats text synchronously in the caller's context,
+ * which is exactly the kind of perturbation that hides timing bugs.
+ * Tracepoints instead append a fixed-size binary record to a per-CPU
+ * ring; formatting happens in whatever tool drains /proc/trace.
+ * While disabled a tracepoint costs a single predicted-not-taken
+ * branch, so they can live on the hottest paths.
+ */
+
+#define TRACE_SYSCALL_ENTER 1
+#define TRACE_SYSCALL_EXIT  2
+#define TRACE_SWITCH_TASK   3
+#define TRACE_IRQ_ENTER     4
+#define TRACE_SAMPLE        5
+
+typedef struct {
+	uint32_t ticks;     /* timer_ticks when the record was written */
+	uint32_t subticks;
+	uint16_t type;      /* TRACE_* */
+	uint16_t pid;       /* process running when the event fired */
+	uint32_t data;      /* syscall number, IRQ line, EIP, or outgoing pid */
+} trace_event_t;
+
+extern int trace_enabled;
+extern int trace_sample_enabled;
+extern void trace_emit(uint16_t type, uint32_t data);
+extern int trace_set_enabled(int enabled);
+extern int trace_sample_set_enabled(int enabled);
+extern size_t trace_dequeue(uint8_t * buffer, size_t size);
+
+static inline void trace_event(uint16_t type, uint32_t data) {
+	if (__builtin_expect(trace_enabled, 0)) {
+		trace_emit(type, data);
+	}
+}
+
+/* Profiling sample from the timer interrupt: the interrupted EIP,
+ * with the pid filled in by trace_emit as usual. Gated separately
+ * from the tracepoints so either can run without the other. */
+static inline void trace_sample(uint32_t eip) {
+	if (__builtin_expect(trace_sample_enabled, 0)) {
+		trace_emit(TRACE_SAMPLE, eip);
+	}
+}
+
+#endif
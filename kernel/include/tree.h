@@ -1,5 +1,5 @@
 /* vim: tabstop=4 shiftwidth=4 noexpandtab
- * 
+ *
  * General-purpose tree implementation
  */
 #ifndef TREE_H
@@ -7,20 +7,41 @@
 
 #include "list.h"
 
+/*
+ * Children are linked through sibling pointers embedded in the nodes
+ * themselves rather than a separate list of list nodes, so walking a
+ * node's children touches the nodes and nothing else. Iterate with
+ * foreach_child(i, node); i is the child tree_node_t directly.
+ */
 typedef struct tree_node {
 	void * value;
-	list_t * children;
 	struct tree_node * parent;
+	struct tree_node * first_child;
+	struct tree_node * last_child;
+	struct tree_node * next_sibling;
+	struct tree_node * prev_sibling;
+	uint8_t in_arena;
 } tree_node_t;
 
+typedef struct tree_arena_chunk {
+	struct tree_arena_chunk * next;
+	size_t used;
+	/* node storage follows */
+} tree_arena_chunk_t;
+
 typedef struct {
 	size_t nodes;
 	tree_node_t * root;
+	/* Arena trees bump-allocate nodes out of chunks; tree_free
+	 * releases the chunks in one pass instead of walking the tree. */
+	tree_arena_chunk_t * arena;
+	size_t arena_chunk_size;
 } tree_t;
 
 typedef uint8_t (*tree_comparator_t) (void *, void *);
 
 tree_t * tree_create(void);
+tree_t * tree_create_arena(size_t chunk_size);
 void tree_set_root(tree_t * tree, void * value);
 void tree_node_destroy(tree_node_t * node);
 void tree_destroy(tree_t * tree);
@@ -29,11 +50,14 @@ tree_node_t * tree_node_create(void * value);
 void tree_node_insert_child_node(tree_t * tree, tree_node_t * parent, tree_node_t * node);
 tree_node_t * tree_node_insert_child(tree_t * tree, tree_node_t * parent, void * value);
 tree_node_t * tree_node_find_parent(tree_node_t * haystack, tree_node_t * needle);
+size_t tree_count_children(tree_node_t * node);
+size_t tree_node_child_count(tree_node_t * node);
 void tree_node_parent_remove(tree_t * tree, tree_node_t * parent, tree_node_t * node);
 void tree_node_remove(tree_t * tree, tree_node_t * node);
 void tree_remove(tree_t * tree, tree_node_t * node);
 tree_node_t * tree_find(tree_t * tree, void * value, tree_comparator_t comparator);
 void tree_break_off(tree_t * tree, tree_node_t * node);
 
+#define foreach_child(i, node) for (tree_node_t * i = (node)->first_child; i != NULL; i = i->next_sibling)
 
 #endif
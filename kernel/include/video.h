@@ -6,6 +6,33 @@
 #define IO_VID_DEPTH  0x5003
 #define IO_VID_ADDR   0x5004
 #define IO_VID_SIGNAL 0x5005
+#define IO_VID_VSYNC  0x5006
+#define IO_VID_CURSOR 0x5007
+#define IO_VID_SET    0x5008
+
+/*
+ * Argument to IO_VID_CURSOR: an ARGB cursor image for the display
+ * backend to draw on its own cursor plane. A width of 0 hides the
+ * cursor. Fails when no backend can draw one.
+ */
+typedef struct vid_cursor {
+	uint32_t width;
+	uint32_t height;
+	uint32_t hot_x;
+	uint32_t hot_y;
+	uint32_t * data;
+} vid_cursor_t;
+
+/*
+ * Argument to IO_VID_SET: a new display mode. The driver reprograms
+ * the adapter live and notifies the IO_VID_SIGNAL recipient, so the
+ * compositor reinitializes without a restart. Fails when the adapter
+ * cannot change modes (eg. a bootloader-preset framebuffer).
+ */
+typedef struct vid_mode {
+	uint32_t width;
+	uint32_t height;
+} vid_mode_t;
 
 #ifdef _KERNEL_
 extern void lfb_set_resolution(uint16_t x, uint16_t y);
@@ -13,6 +40,10 @@ extern uint16_t lfb_resolution_x;
 extern uint16_t lfb_resolution_y;
 extern uint16_t lfb_resolution_b;
 extern uint8_t * lfb_vid_memory;
+
+/* Set by a backend (eg. the VirtualBox guest driver) that can draw
+ * the cursor itself; NULL when there is no cursor plane. */
+extern int (*lfb_set_cursor)(vid_cursor_t * cursor);
 #endif
 
 #endif
@@ -0,0 +1,29 @@
+#ifndef KL_WATCH_H
+#define KL_WATCH_H
+
+#include <system.h>
+#include <fs.h>
+
+/* ioctl requests on a watch fd */
+#define WATCH_ADD    0x5701   /* argp = path; returns watch descriptor */
+#define WATCH_REMOVE 0x5702   /* argp = int * watch descriptor */
+
+/* Event types */
+#define WATCH_EVENT_CREATE 1
+#define WATCH_EVENT_UNLINK 2
+#define WATCH_EVENT_MODIFY 3
+
+/* Completion record: read() an array of these from the watch fd */
+typedef struct watch_event {
+	int wd;               /* Which watch fired */
+	int type;             /* WATCH_EVENT_* */
+	char name[256];       /* Affected child name, for directory watches */
+} watch_event_t;
+
+extern volatile int watch_active;
+
+extern void watch_install(void);
+extern fs_node_t * watch_create_context(void);
+extern void watch_notify(fs_node_t * node, char * name, int type);
+
+#endif
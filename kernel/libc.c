@@ -164,6 +164,15 @@ char * strcpy(char * restrict dest, const char * restrict src) {
 	return dest;
 }
 
+char * strncpy(char * restrict dest, const char * restrict src, size_t n) {
+	char * d = dest;
+	for (; n && (*d = *src); n--, d++, src++);
+	for (; n; n--, d++) {
+		*d = '\0';
+	}
+	return dest;
+}
+
 size_t strspn(const char * s, const char * c) {
 	const char * a = s;
 	size_t byteset[32/sizeof(size_t)] = { 0 };
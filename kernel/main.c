@@ -46,12 +46,15 @@
 #include <logging.h>
 #include <process.h>
 #include <shm.h>
+#include <pagecache.h>
+#include <aio.h>
+#include <watch.h>
 #include <args.h>
 #include <module.h>
+#include <boottime.h>
 
 uintptr_t initial_esp = 0;
 
-fs_node_t * ramdisk_mount(uintptr_t, size_t);
 
 #ifdef EARLY_BOOT_LOG
 #define EARLY_LOG_DEVICE 0x3F8
@@ -153,22 +156,33 @@ int kmain(struct multiboot *mboot, uint32_t mboot_mag, uintptr_t esp) {
 	/* Memory management */
 	heap_install();     /* Kernel heap */
 
+	boot_mark("kmain: memory ready");
+
 	if (cmdline) {
 		args_parse(cmdline);
 	}
 
 	vfs_install();
 	tasking_install();  /* Multi-tasking */
+	logging_install_flusher(); /* Deferred log writer */
 	timer_install();    /* PIC driver */
 	fpu_install();      /* FPU/SSE magic */
 	syscalls_install(); /* Install the system calls */
 	shm_install();      /* Install shared memory */
+	pagecache_install(); /* Unified page cache */
+	aio_install();      /* Asynchronous I/O worker */
+	watch_install();    /* File watch descriptors */
 	modules_install();  /* Modules! */
 
+	boot_mark("kmain: core services");
+
 	DISABLE_EARLY_BOOT_LOG();
 
-	/* Load modules from bootloader */
+	/* Load modules from bootloader. Loading and relocation stay in
+	 * order, but each module's initialize() runs in its own tasklet
+	 * so hardware probe delays overlap instead of adding up. */
 	debug_print(NOTICE, "%d modules to load", mboot_mods_count);
+	module_init_async = 1;
 	for (unsigned int i = 0; i < mboot_ptr->mods_count; ++i ) {
 		mboot_mod_t * mod = &mboot_mods[i];
 		uint32_t module_start = mod->mod_start;
@@ -205,6 +219,12 @@ int kmain(struct multiboot *mboot, uint32_t mboot_mag, uintptr_t esp) {
 		}
 	}
 
+	/* Everything past here needs the drivers up */
+	modules_init_barrier();
+	module_init_async = 0;
+
+	boot_mark("kmain: modules loaded");
+
 	/* Map /dev to a device mapper */
 	map_vfs_directory("/dev");
 
@@ -245,6 +265,7 @@ int kmain(struct multiboot *mboot, uint32_t mboot_mag, uintptr_t esp) {
 	while (argv[argc]) {
 		argc++;
 	}
+	boot_mark("kmain: spawn init");
 	system(argv[0], argc, argv); /* Run init */
 
 	debug_print(CRITICAL, "init failed");
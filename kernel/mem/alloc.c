@@ -103,6 +103,7 @@
 
 /* Includes {{{ */
 #include <system.h>
+#include <process.h>
 /* }}} */
 /* Definitions {{{ */
 
@@ -135,10 +136,147 @@ static void klfree(void * ptr);
 
 static spin_lock_t mem_lock =  { 0 };
 
+/*
+ * Per-CPU magazines.
+ *
+ * Small per-CPU arrays of free objects for each small bin. The common
+ * allocation and free paths hit only the local CPU's magazine (with
+ * interrupts off, so a preempting task on the same CPU can't race us)
+ * and never touch mem_lock; the locked global bins are only the refill
+ * and overflow path. Big-bin allocations always go to the global
+ * allocator.
+ */
+#define MAGAZINE_ROUNDS 8
+
+typedef struct _klmalloc_magazine {
+	void * rounds[NUM_BINS - 1][MAGAZINE_ROUNDS];
+	int    count[NUM_BINS - 1];
+} klmalloc_magazine;
+
+static klmalloc_magazine klmalloc_magazines[MAX_CPUS];
+
+static void * klmalloc_magazine_pop(uintptr_t size);
+static int klmalloc_magazine_push(void * ptr);
+
+#ifdef KMALLOC_TRACK
+/*
+ * Allocation-site tracking (build with KMALLOC_TRACK=1).
+ *
+ * Every allocation is tagged with its caller's return address and
+ * recorded in a fixed side table, so live counts per call site can
+ * be dumped in the field (debug shell `leaks` command) without an
+ * instrumented rebuild. The layout of heap objects is unchanged;
+ * only the wrapper functions below know about any of this.
+ */
+#define KMALLOC_TRACK_SITES 256
+#define KMALLOC_TRACK_PTRS  16384
+
+typedef struct {
+	uintptr_t site;       /* Return address of the allocation call */
+	uint32_t  live;       /* Allocations not yet freed */
+	uint32_t  total;      /* All allocations ever */
+	uint32_t  live_bytes; /* Requested bytes not yet freed */
+} kmalloc_site_t;
+
+typedef struct {
+	void *    ptr;
+	uint32_t  site;       /* Index into kmalloc_sites, +1 (0 = empty) */
+	uint32_t  size;
+} kmalloc_ptr_t;
+
+/* Slot 0 collects allocations once the site table overflows */
+static kmalloc_site_t kmalloc_sites[KMALLOC_TRACK_SITES];
+static kmalloc_ptr_t  kmalloc_ptrs[KMALLOC_TRACK_PTRS];
+static uint32_t kmalloc_track_dropped = 0;
+static spin_lock_t track_lock = { 0 };
+
+static uint32_t kmalloc_site_index(uintptr_t site) {
+	uint32_t i = (site >> 2) % (KMALLOC_TRACK_SITES - 1) + 1;
+	for (uint32_t probes = 1; probes < KMALLOC_TRACK_SITES; ++probes) {
+		if (kmalloc_sites[i].site == site) return i;
+		if (!kmalloc_sites[i].site) {
+			kmalloc_sites[i].site = site;
+			return i;
+		}
+		i = i % (KMALLOC_TRACK_SITES - 1) + 1;
+	}
+	return 0; /* Table full; lump it into the overflow slot */
+}
+
+static void kmalloc_track_alloc(void * ptr, uintptr_t size, uintptr_t site) {
+	if (!ptr) return;
+	spin_lock(track_lock);
+	uint32_t s = kmalloc_site_index(site);
+	kmalloc_sites[s].live++;
+	kmalloc_sites[s].total++;
+	kmalloc_sites[s].live_bytes += size;
+	uint32_t i = ((uintptr_t)ptr >> 4) % KMALLOC_TRACK_PTRS;
+	int free_slot = -1;
+	for (uint32_t probes = 0; probes < KMALLOC_TRACK_PTRS; ++probes) {
+		if (!kmalloc_ptrs[i].site) {
+			/* Never-used slot ends the probe chain */
+			if (free_slot < 0) free_slot = i;
+			break;
+		}
+		if (!kmalloc_ptrs[i].ptr && free_slot < 0) {
+			/* Tombstone; remember it but keep looking for the chain end */
+			free_slot = i;
+		}
+		i = (i + 1) % KMALLOC_TRACK_PTRS;
+	}
+	if (free_slot >= 0) {
+		kmalloc_ptrs[free_slot].ptr  = ptr;
+		kmalloc_ptrs[free_slot].site = s + 1;
+		kmalloc_ptrs[free_slot].size = size;
+	} else {
+		kmalloc_track_dropped++;
+	}
+	spin_unlock(track_lock);
+}
+
+static void kmalloc_track_free(void * ptr) {
+	if (!ptr) return;
+	spin_lock(track_lock);
+	uint32_t i = ((uintptr_t)ptr >> 4) % KMALLOC_TRACK_PTRS;
+	for (uint32_t probes = 0; probes < KMALLOC_TRACK_PTRS; ++probes) {
+		if (kmalloc_ptrs[i].site && kmalloc_ptrs[i].ptr == ptr) {
+			uint32_t s = kmalloc_ptrs[i].site - 1;
+			kmalloc_sites[s].live--;
+			kmalloc_sites[s].live_bytes -= kmalloc_ptrs[i].size;
+			/* Tombstone: keep probing chains intact */
+			kmalloc_ptrs[i].ptr  = NULL;
+			kmalloc_ptrs[i].size = 0;
+			break;
+		}
+		if (!kmalloc_ptrs[i].site) {
+			/* Never-used slot: ptr was dropped or predates tracking */
+			break;
+		}
+		i = (i + 1) % KMALLOC_TRACK_PTRS;
+	}
+	spin_unlock(track_lock);
+}
+
+void kmalloc_track_dump(void (*cb)(uintptr_t site, uint32_t live, uint32_t total, uint32_t live_bytes, void * extra), void * extra) {
+	for (uint32_t i = 0; i < KMALLOC_TRACK_SITES; ++i) {
+		if (kmalloc_sites[i].total || (i == 0 && kmalloc_track_dropped)) {
+			cb(kmalloc_sites[i].site, kmalloc_sites[i].live, kmalloc_sites[i].total, kmalloc_sites[i].live_bytes, extra);
+		}
+	}
+}
+#else
+#	define kmalloc_track_alloc(ptr, size, site)
+#	define kmalloc_track_free(ptr)
+#endif
+
 void * __attribute__ ((malloc)) malloc(uintptr_t size) {
-	spin_lock(mem_lock);
-	void * ret = klmalloc(size);
-	spin_unlock(mem_lock);
+	void * ret = klmalloc_magazine_pop(size);
+	if (!ret) {
+		spin_lock(mem_lock);
+		ret = klmalloc(size);
+		spin_unlock(mem_lock);
+	}
+	kmalloc_track_alloc(ret, size, (uintptr_t)__builtin_return_address(0));
 	return ret;
 }
 
@@ -146,6 +284,8 @@ void * __attribute__ ((malloc)) realloc(void * ptr, uintptr_t size) {
 	spin_lock(mem_lock);
 	void * ret = klrealloc(ptr, size);
 	spin_unlock(mem_lock);
+	kmalloc_track_free(ptr);
+	kmalloc_track_alloc(ret, size, (uintptr_t)__builtin_return_address(0));
 	return ret;
 }
 
@@ -153,6 +293,7 @@ void * __attribute__ ((malloc)) calloc(uintptr_t nmemb, uintptr_t size) {
 	spin_lock(mem_lock);
 	void * ret = klcalloc(nmemb, size);
 	spin_unlock(mem_lock);
+	kmalloc_track_alloc(ret, nmemb * size, (uintptr_t)__builtin_return_address(0));
 	return ret;
 }
 
@@ -160,15 +301,20 @@ void * __attribute__ ((malloc)) valloc(uintptr_t size) {
 	spin_lock(mem_lock);
 	void * ret = klvalloc(size);
 	spin_unlock(mem_lock);
+	kmalloc_track_alloc(ret, size, (uintptr_t)__builtin_return_address(0));
 	return ret;
 }
 
 void free(void * ptr) {
-	spin_lock(mem_lock);
 	if ((uintptr_t)ptr > placement_pointer) {
+		kmalloc_track_free(ptr);
+		if (klmalloc_magazine_push(ptr)) {
+			return;
+		}
+		spin_lock(mem_lock);
 		klfree(ptr);
+		spin_unlock(mem_lock);
 	}
-	spin_unlock(mem_lock);
 }
 
 
@@ -246,7 +392,79 @@ static struct _klmalloc_big_bins {
 } klmalloc_big_bins;
 static klmalloc_big_bin_header * klmalloc_newest_big = NULL;		/* Newest big bin */
 
+/*
+ * Occupancy statistics, reported through /proc/meminfo: how many
+ * pages each bin has claimed from sbrk() and how many allocations out
+ * of them are currently live (objects parked in the per-CPU magazines
+ * count as live).
+ */
+static uint32_t klmalloc_bin_pages[NUM_BINS];
+static uint32_t klmalloc_bin_live[NUM_BINS];
+
+int klmalloc_bin_usage(int bin, uint32_t * object_size, uint32_t * pages, uint32_t * live) {
+	if (bin < 0 || bin >= (int)NUM_BINS) return 0;
+	*object_size = (bin == (int)BIG_BIN) ? 0 : (1UL << (bin + SMALLEST_BIN_LOG));
+	*pages = klmalloc_bin_pages[bin];
+	*live  = klmalloc_bin_live[bin];
+	return 1;
+}
+
 /* }}} Bin management */
+/* Magazines {{{ */
+
+/*
+ * Try to satisfy an allocation from the local CPU's magazine.
+ * Returns NULL on a miss (or for big-bin sizes), in which case the
+ * caller falls back to the locked global allocator.
+ */
+static void * klmalloc_magazine_pop(uintptr_t size) {
+	if (__builtin_expect(size == 0, 0)) {
+		return NULL;
+	}
+	unsigned int bucket_id = klmalloc_bin_size(size);
+	if (bucket_id >= BIG_BIN) {
+		return NULL;
+	}
+	klmalloc_magazine * mag = &klmalloc_magazines[cpu_current()->index];
+	void * ret = NULL;
+	IRQ_OFF;
+	if (mag->count[bucket_id]) {
+		ret = mag->rounds[bucket_id][--mag->count[bucket_id]];
+	}
+	IRQ_RES;
+	return ret;
+}
+
+/*
+ * Try to stash a freed object in the local CPU's magazine.
+ * Returns 0 if the object is not a small-bin cell or the magazine is
+ * full; the caller then frees through the global bins as before.
+ */
+static int klmalloc_magazine_push(void * ptr) {
+	if (!ptr || (uintptr_t)ptr % PAGE_SIZE == 0) {
+		/* Page-aligned means a big bin or a valloc()ed block */
+		return 0;
+	}
+	klmalloc_bin_header * header = (klmalloc_bin_header *)((uintptr_t)ptr & (uintptr_t)~PAGE_MASK);
+	if (header->bin_magic != BIN_MAGIC) {
+		return 0;
+	}
+	uintptr_t bucket_id = header->size;
+	if (bucket_id >= (uintptr_t)BIG_BIN) {
+		return 0;
+	}
+	klmalloc_magazine * mag = &klmalloc_magazines[cpu_current()->index];
+	int pushed = 0;
+	IRQ_OFF;
+	if (mag->count[bucket_id] < MAGAZINE_ROUNDS) {
+		mag->rounds[bucket_id][mag->count[bucket_id]++] = ptr;
+		pushed = 1;
+	}
+	IRQ_RES;
+	return pushed;
+}
+
+/* }}} Magazines */
 /* Doubly-Linked List {{{ */
 
 /*
@@ -590,6 +808,7 @@ static void * __attribute__ ((malloc)) klmalloc(uintptr_t size) {
 			 */
 			bin_header = (klmalloc_bin_header*)sbrk(PAGE_SIZE);
 			bin_header->bin_magic = BIN_MAGIC;
+			klmalloc_bin_pages[bucket_id]++;
 			assert((uintptr_t)bin_header % PAGE_SIZE == 0);
 
 			/*
@@ -628,6 +847,7 @@ static void * __attribute__ ((malloc)) klmalloc(uintptr_t size) {
 		if (klmalloc_stack_empty(bin_header)) {
 			klmalloc_list_decouple(&(klmalloc_bin_head[bucket_id]),bin_header);
 		}
+		klmalloc_bin_live[bucket_id]++;
 		return item;
 	} else {
 		/*
@@ -644,6 +864,7 @@ static void * __attribute__ ((malloc)) klmalloc(uintptr_t size) {
 			 * Retreive the head of the block.
 			 */
 			uintptr_t ** item = klmalloc_stack_pop((klmalloc_bin_header *)bin_header);
+			klmalloc_bin_live[BIG_BIN]++;
 #if 0
 			/*
 			 * Resize block, if necessary
@@ -695,6 +916,8 @@ static void * __attribute__ ((malloc)) klmalloc(uintptr_t size) {
 			uintptr_t pages = (size + sizeof(klmalloc_big_bin_header)) / PAGE_SIZE + 1;
 			bin_header = (klmalloc_big_bin_header*)sbrk(PAGE_SIZE * pages);
 			bin_header->bin_magic = BIN_MAGIC;
+			klmalloc_bin_pages[BIG_BIN] += pages;
+			klmalloc_bin_live[BIG_BIN]++;
 			assert((uintptr_t)bin_header % PAGE_SIZE == 0);
 			/*
 			 * Give the header the remaining space.
@@ -757,6 +980,7 @@ static void klfree(void *ptr) {
 	uintptr_t bucket_id = header->size;
 	if (bucket_id > (uintptr_t)NUM_BINS) {
 		bucket_id = BIG_BIN;
+		klmalloc_bin_live[BIG_BIN]--;
 		klmalloc_big_bin_header *bheader = (klmalloc_big_bin_header*)header;
 
 		assert(bheader);
@@ -843,6 +1067,7 @@ static void klfree(void *ptr) {
 		 */
 		klmalloc_skip_list_insert(bheader);
 	} else {
+		klmalloc_bin_live[bucket_id]--;
 		/*
 		 * If the stack is empty, we are freeing
 		 * a block from a previously full bin.
@@ -0,0 +1,51 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ *
+ * Region allocator for request-scoped scratch memory.
+ */
+#include <system.h>
+#include <arena.h>
+
+#define ARENA_ALIGN(s) (((s) + sizeof(uintptr_t) - 1) & ~(sizeof(uintptr_t) - 1))
+
+void arena_init(arena_t * arena, size_t chunk_size) {
+	arena->chunks = NULL;
+	arena->chunk_size = chunk_size ? chunk_size : 512;
+}
+
+void * arena_alloc(arena_t * arena, size_t size) {
+	size = ARENA_ALIGN(size);
+
+	arena_chunk_t * chunk = arena->chunks;
+	if (!chunk || chunk->used + size > chunk->size) {
+		/* Requests bigger than a chunk get a chunk of their own */
+		size_t chunk_size = size > arena->chunk_size ? size : arena->chunk_size;
+		chunk = malloc(sizeof(arena_chunk_t) + chunk_size);
+		chunk->next = arena->chunks;
+		chunk->used = 0;
+		chunk->size = chunk_size;
+		arena->chunks = chunk;
+	}
+
+	void * out = (char *)(chunk + 1) + chunk->used;
+	chunk->used += size;
+	return out;
+}
+
+char * arena_strdup(arena_t * arena, const char * s) {
+	size_t len = strlen(s) + 1;
+	char * out = arena_alloc(arena, len);
+	memcpy(out, s, len);
+	return out;
+}
+
+void arena_reset(arena_t * arena) {
+	arena_chunk_t * chunk = arena->chunks;
+	while (chunk) {
+		arena_chunk_t * next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	arena->chunks = NULL;
+}
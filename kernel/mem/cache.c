@@ -0,0 +1,63 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ *
+ * Object caches for hot kernel structures.
+ *
+ * Process and file churn allocates and frees the same few structure
+ * sizes constantly. These caches keep a short free list per structure
+ * so the common case is a pointer pop instead of a trip through the
+ * klmalloc bins.
+ */
+#include <system.h>
+#include <logging.h>
+#include <kcache.h>
+
+kcache_t * kcache_create(char * name, size_t object_size, size_t max_cached) {
+	/* Objects must be able to hold the free list link */
+	if (object_size < sizeof(void *)) {
+		object_size = sizeof(void *);
+	}
+
+	kcache_t * cache = malloc(sizeof(kcache_t));
+	cache->name        = name;
+	cache->object_size = object_size;
+	cache->max_cached  = max_cached;
+	cache->cached      = 0;
+	cache->head        = NULL;
+	cache->allocs      = 0;
+	cache->hits        = 0;
+	spin_init(cache->lock);
+
+	debug_print(INFO, "Object cache '%s': %d bytes, up to %d cached", name, object_size, max_cached);
+	return cache;
+}
+
+void * kcache_alloc(kcache_t * cache) {
+	spin_lock(cache->lock);
+	cache->allocs++;
+	if (cache->head) {
+		void * object = cache->head;
+		cache->head = *(void **)object;
+		cache->cached--;
+		cache->hits++;
+		spin_unlock(cache->lock);
+		return object;
+	}
+	spin_unlock(cache->lock);
+	return (void *)malloc(cache->object_size);
+}
+
+void kcache_free(kcache_t * cache, void * object) {
+	if (!object) return;
+	spin_lock(cache->lock);
+	if (cache->cached < cache->max_cached) {
+		*(void **)object = cache->head;
+		cache->head = object;
+		cache->cached++;
+		spin_unlock(cache->lock);
+		return;
+	}
+	spin_unlock(cache->lock);
+	free(object);
+}
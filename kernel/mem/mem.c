@@ -14,6 +14,10 @@
 #include <signal.h>
 #include <hashmap.h>
 #include <module.h>
+#include <shm.h>
+#include <mmap.h>
+#include <timepage.h>
+#include <kstats.h>
 
 #define KERNEL_HEAP_INIT 0x00800000
 #define KERNEL_HEAP_END  0x20000000
@@ -135,18 +139,204 @@ kvmalloc_p(
 uint32_t *frames;
 uint32_t nframes;
 
+/* Whether the CPU supports (and we have enabled) 4MB PSE pages */
+static int pse_enabled = 0;
+
+/*
+ * Per-frame reference counts for copy-on-write sharing.
+ * A count of zero means the frame is either free or owned by exactly
+ * one mapping that was established without going through alloc_frame.
+ */
+static uint16_t * frame_refs = NULL;
+
+/* A saturated count pins the frame forever (eg. the shared zero page) */
+#define FRAME_REF_PINNED 0xFFFF
+
+void frame_ref(uint32_t frame) {
+	if (frame_refs && frame < nframes && frame_refs[frame] != FRAME_REF_PINNED) {
+		frame_refs[frame]++;
+	}
+}
+
+/*
+ * Drop a reference; returns the number of references remaining.
+ */
+uint32_t frame_unref(uint32_t frame) {
+	if (!frame_refs || frame >= nframes) return 0;
+	if (frame_refs[frame] == FRAME_REF_PINNED) {
+		return FRAME_REF_PINNED;
+	}
+	if (frame_refs[frame] > 0) {
+		frame_refs[frame]--;
+	}
+	return frame_refs[frame];
+}
+
+uint32_t frame_refcount(uint32_t frame) {
+	if (!frame_refs || frame >= nframes) return 0;
+	return frame_refs[frame];
+}
+
+/*
+ * Pin a frame so it is never freed or made writable, no matter how
+ * many address spaces map and unmap it.
+ */
+void frame_pin(uint32_t frame) {
+	if (frame_refs && frame < nframes) {
+		frame_refs[frame] = FRAME_REF_PINNED;
+	}
+}
+
 #define INDEX_FROM_BIT(b) (b / 0x20)
 #define OFFSET_FROM_BIT(b) (b % 0x20)
 
+/*
+ * Binary buddy allocator over the physical frames.
+ *
+ * Per order we keep a bitmap with one bit per block of 2^order frames;
+ * a set bit means the whole block is free. Single frames and aligned
+ * contiguous runs both come out of word scans of these (mostly empty)
+ * bitmaps plus split/merge, instead of a linear walk of the old frame
+ * bitmap from zero. The classic `frames` used-bitmap is kept in sync
+ * for test_frame() and memory accounting.
+ */
+#define BUDDY_MAX_ORDER 12
+
+static uint32_t * buddy_free[BUDDY_MAX_ORDER + 1];
+static uint32_t   buddy_blocks[BUDDY_MAX_ORDER + 1];
+
+/* Running count of allocated frames, so /proc/meminfo is O(1) */
+static uint32_t used_frames = 0;
+
+static void frames_mark_used(uint32_t frame) {
+	if (frame < nframes) {
+		if (!(frames[INDEX_FROM_BIT(frame)] & ((uint32_t)0x1 << OFFSET_FROM_BIT(frame)))) {
+			used_frames++;
+		}
+		frames[INDEX_FROM_BIT(frame)] |= ((uint32_t)0x1 << OFFSET_FROM_BIT(frame));
+	}
+}
+
+static void frames_mark_free(uint32_t frame) {
+	if (frame < nframes) {
+		if (frames[INDEX_FROM_BIT(frame)] & ((uint32_t)0x1 << OFFSET_FROM_BIT(frame))) {
+			used_frames--;
+		}
+		frames[INDEX_FROM_BIT(frame)] &= ~((uint32_t)0x1 << OFFSET_FROM_BIT(frame));
+	}
+}
+
+static int buddy_test(uint32_t block, int order) {
+	return (buddy_free[order][INDEX_FROM_BIT(block)] >> OFFSET_FROM_BIT(block)) & 1;
+}
+
+static void buddy_set(uint32_t block, int order) {
+	buddy_free[order][INDEX_FROM_BIT(block)] |= ((uint32_t)0x1 << OFFSET_FROM_BIT(block));
+}
+
+static void buddy_clear(uint32_t block, int order) {
+	buddy_free[order][INDEX_FROM_BIT(block)] &= ~((uint32_t)0x1 << OFFSET_FROM_BIT(block));
+}
+
+/*
+ * Find any free block of the given order. Scans whole words at a
+ * time, so this is fast even when the order is sparsely populated.
+ */
+static uint32_t buddy_find(int order) {
+	uint32_t words = (buddy_blocks[order] + 31) / 32;
+	for (uint32_t i = 0; i < words; ++i) {
+		if (buddy_free[order][i]) {
+			return i * 32 + __builtin_ctz(buddy_free[order][i]);
+		}
+	}
+	return 0xFFFFFFFF;
+}
+
+/*
+ * Return a block of 2^order frames to the allocator, merging with its
+ * buddy as far up as possible.
+ */
+void free_frames(uint32_t frame, int order) {
+	uint32_t block = frame >> order;
+	for (uint32_t i = frame; i < frame + (1 << order); ++i) {
+		frames_mark_free(i);
+	}
+	while (order < BUDDY_MAX_ORDER) {
+		uint32_t buddy = block ^ 1;
+		if (buddy >= buddy_blocks[order] || !buddy_test(buddy, order)) {
+			break;
+		}
+		buddy_clear(buddy, order);
+		block >>= 1;
+		order++;
+	}
+	buddy_set(block, order);
+}
+
+/*
+ * Allocate 2^order naturally-aligned contiguous frames.
+ * Returns the first frame index, or 0xFFFFFFFF if nothing fits.
+ */
+uint32_t alloc_frames(int order) {
+	int k = order;
+	uint32_t block = 0xFFFFFFFF;
+	while (k <= BUDDY_MAX_ORDER) {
+		block = buddy_find(k);
+		if (block != 0xFFFFFFFF) break;
+		k++;
+	}
+	if (block == 0xFFFFFFFF) {
+		return 0xFFFFFFFF;
+	}
+	buddy_clear(block, k);
+	/* Split back down, freeing the upper halves as we go */
+	while (k > order) {
+		k--;
+		block <<= 1;
+		buddy_set(block ^ 1, k);
+	}
+	uint32_t frame = block << order;
+	for (uint32_t i = frame; i < frame + (1 << order); ++i) {
+		frames_mark_used(i);
+	}
+	return frame;
+}
+
+/*
+ * Carve one specific frame out of whatever free block contains it.
+ */
+static void buddy_reserve(uint32_t frame) {
+	for (int order = 0; order <= BUDDY_MAX_ORDER; ++order) {
+		uint32_t block = frame >> order;
+		if (block >= buddy_blocks[order] || !buddy_test(block, order)) {
+			continue;
+		}
+		buddy_clear(block, order);
+		/* Split down; halves not containing the frame go back free */
+		while (order > 0) {
+			order--;
+			block <<= 1;
+			if ((frame >> order) & 1) {
+				buddy_set(block, order);
+				block |= 1;
+			} else {
+				buddy_set(block | 1, order);
+			}
+		}
+		return;
+	}
+}
+
 void
 set_frame(
 		uintptr_t frame_addr
 		) {
 	if (frame_addr < nframes * 4 * 0x400) {
-		uint32_t frame  = frame_addr / 0x1000;
-		uint32_t index  = INDEX_FROM_BIT(frame);
-		uint32_t offset = OFFSET_FROM_BIT(frame);
-		frames[index] |= ((uint32_t)0x1 << offset);
+		uint32_t frame = frame_addr / 0x1000;
+		if (buddy_free[0]) {
+			buddy_reserve(frame);
+		}
+		frames_mark_used(frame);
 	}
 }
 
@@ -154,10 +344,12 @@ void
 clear_frame(
 		uintptr_t frame_addr
 		) {
-	uint32_t frame  = frame_addr / 0x1000;
-	uint32_t index  = INDEX_FROM_BIT(frame);
-	uint32_t offset = OFFSET_FROM_BIT(frame);
-	frames[index] &= ~((uint32_t)0x1 << offset);
+	uint32_t frame = frame_addr / 0x1000;
+	if (buddy_free[0]) {
+		free_frames(frame, 0);
+	} else {
+		frames_mark_free(frame);
+	}
 }
 
 uint32_t test_frame(uintptr_t frame_addr) {
@@ -168,31 +360,63 @@ uint32_t test_frame(uintptr_t frame_addr) {
 }
 
 uint32_t first_n_frames(int n) {
-	for (uint32_t i = 0; i < nframes * 0x1000; i += 0x1000) {
-		int bad = 0;
-		for (int j = 0; j < n; ++j) {
-			if (test_frame(i + 0x1000 * j)) {
-				bad = j+1;
-			}
-		}
-		if (!bad) {
-			return i / 0x1000;
-		}
+	int order = 0;
+	while ((1 << order) < n && order < BUDDY_MAX_ORDER) {
+		order++;
+	}
+	if ((1 << order) < n) {
+		return 0xFFFFFFFF;
+	}
+	uint32_t block = buddy_find(order);
+	int k = order;
+	while (block == 0xFFFFFFFF && k < BUDDY_MAX_ORDER) {
+		block = buddy_find(++k);
+	}
+	if (block == 0xFFFFFFFF) {
+		return 0xFFFFFFFF;
+	}
+	/* Caller claims the frames with set_frame() */
+	return block << k;
+}
+
+/*
+ * Caches (block cache, page cache, ...) can register a callback here
+ * to be told when frame allocation is about to fail, so they get a
+ * chance to give memory back before we give up and panic. Callbacks
+ * run with the frame allocator lock held and must only free memory,
+ * never allocate it.
+ */
+static list_t * low_memory_notifiers = NULL;
+
+void register_low_memory_notifier(void (*callback)(void)) {
+	if (!low_memory_notifiers) {
+		low_memory_notifiers = list_create();
+	}
+	list_insert(low_memory_notifiers, (void *)callback);
+}
+
+static void memory_pressure(void) {
+	debug_print(WARNING, "Memory pressure: %d of %d frames in use, asking caches to shrink.", used_frames, nframes);
+	if (!low_memory_notifiers) return;
+	foreach(node, low_memory_notifiers) {
+		((void (*)(void))node->value)();
 	}
-	return 0xFFFFFFFF;
 }
 
 uint32_t first_frame(void) {
-	uint32_t i, j;
-
-	for (i = 0; i < INDEX_FROM_BIT(nframes); ++i) {
-		if (frames[i] != 0xFFFFFFFF) {
-			for (j = 0; j < 32; ++j) {
-				uint32_t testFrame = (uint32_t)0x1 << j;
-				if (!(frames[i] & testFrame)) {
-					return i * 0x20 + j;
-				}
-			}
+	for (int order = 0; order <= BUDDY_MAX_ORDER; ++order) {
+		uint32_t block = buddy_find(order);
+		if (block != 0xFFFFFFFF) {
+			return block << order;
+		}
+	}
+
+	/* Nothing free: lean on the caches, then try once more */
+	memory_pressure();
+	for (int order = 0; order <= BUDDY_MAX_ORDER; ++order) {
+		uint32_t block = buddy_find(order);
+		if (block != 0xFFFFFFFF) {
+			return block << order;
 		}
 	}
 
@@ -203,13 +427,6 @@ uint32_t first_frame(void) {
 		debug_video_crash(msgs);
 	}
 
-#if 0
-	signal_t * sig = malloc(sizeof(signal_t));
-	sig->handler = current_process->signals.functions[SIGSEGV];
-	sig->signum  = SIGSEGV;
-	handle_signal((process_t *)current_process, sig);
-#endif
-
 	STOP;
 
 	return -1;
@@ -229,10 +446,17 @@ alloc_frame(
 		return;
 	} else {
 		spin_lock(frame_alloc_lock);
-		uint32_t index = first_frame();
-		assert(index != (uint32_t)-1 && "Out of frames.");
-		set_frame(index * 0x1000);
+		uint32_t index = alloc_frames(0);
+		if (index == (uint32_t)-1) {
+			/* first_frame() asks the caches to shrink and retries; on
+			 * success it only finds the frame, so claim it here before
+			 * anyone else can. On failure it reports the out-of-memory
+			 * condition and does not return. */
+			index = first_frame();
+			set_frame(index * 0x1000);
+		}
 		page->frame   = index;
+		if (frame_refs) frame_refs[index] = 1;
 		spin_unlock(frame_alloc_lock);
 		page->present = 1;
 		page->rw      = (is_writeable == 1) ? 1 : 0;
@@ -256,6 +480,38 @@ dma_frame(
 	set_frame(address);
 }
 
+/*
+ * Map a full 4MB region with a single PSE large page - one TLB entry
+ * instead of a thousand, which matters for things like the linear
+ * framebuffer. If the CPU doesn't do large pages, or either address
+ * isn't 4MB-aligned, this quietly falls back to ordinary 4KB pages.
+ *
+ * Large pages live directly in the page directory; the corresponding
+ * table slot is set to the 0xFFFFFFFF marker that clone_directory and
+ * release_directory already know to leave alone.
+ */
+void
+dma_large_frame(
+		uintptr_t virtual,
+		int is_kernel,
+		int is_writeable,
+		uintptr_t physical
+		) {
+	if (!pse_enabled || (virtual & 0x3FFFFF) || (physical & 0x3FFFFF)) {
+		for (uintptr_t i = 0; i < 0x400000; i += 0x1000) {
+			dma_frame(get_page(virtual + i, 1, kernel_directory), is_kernel, is_writeable, physical + i);
+		}
+		return;
+	}
+	for (uintptr_t i = 0; i < 0x400000; i += 0x1000) {
+		set_frame(physical + i);
+	}
+	uint32_t table = virtual / (0x1000 * 1024);
+	kernel_directory->tables[table] = (page_table_t *)0xFFFFFFFF;
+	kernel_directory->physical_tables[table] =
+		physical | 0x80 | 0x01 | (is_writeable ? 0x02 : 0x00) | (is_kernel ? 0x00 : 0x04);
+}
+
 void
 free_frame(
 		page_t *page
@@ -265,23 +521,18 @@ free_frame(
 		assert(0);
 		return;
 	} else {
+		if (frame_unref(frame) > 0) {
+			/* Someone else still holds a COW reference to this frame */
+			page->frame = 0x0;
+			return;
+		}
 		clear_frame(frame * 0x1000);
 		page->frame = 0x0;
 	}
 }
 
 uintptr_t memory_use(void ) {
-	uintptr_t ret = 0;
-	uint32_t i, j;
-	for (i = 0; i < INDEX_FROM_BIT(nframes); ++i) {
-		for (j = 0; j < 32; ++j) {
-			uint32_t testFrame = (uint32_t)0x1 << j;
-			if (frames[i] & testFrame) {
-				ret++;
-			}
-		}
-	}
-	return ret * 4;
+	return used_frames * 4;
 }
 
 uintptr_t memory_total(){
@@ -293,6 +544,38 @@ void paging_install(uint32_t memsize) {
 	frames  = (uint32_t *)kmalloc(INDEX_FROM_BIT(nframes * 8));
 	memset(frames, 0, INDEX_FROM_BIT(nframes * 8));
 
+	frame_refs = (uint16_t *)kmalloc(nframes * sizeof(uint16_t));
+	memset(frame_refs, 0, nframes * sizeof(uint16_t));
+
+	/* Buddy free-block bitmaps, one per order */
+	for (int order = 0; order <= BUDDY_MAX_ORDER; ++order) {
+		buddy_blocks[order] = nframes >> order;
+		size_t bytes = ((buddy_blocks[order] + 31) / 32) * sizeof(uint32_t);
+		buddy_free[order] = (uint32_t *)kmalloc(bytes ? bytes : sizeof(uint32_t));
+		memset(buddy_free[order], 0, bytes ? bytes : sizeof(uint32_t));
+	}
+	/* Seed the allocator: everything is free, in the largest aligned
+	 * blocks that fit; boot-time set_frame() calls carve pieces out. */
+	uint32_t frame = 0;
+	while (frame < nframes) {
+		int order = BUDDY_MAX_ORDER;
+		while (order > 0 && ((frame & ((1 << order) - 1)) || frame + (1 << order) > nframes)) {
+			order--;
+		}
+		buddy_set(frame >> order, order);
+		frame += 1 << order;
+	}
+
+	/* Turn on 4MB pages if the CPU has them */
+	uint32_t _ecx, _edx;
+	asm volatile ("cpuid" : "=c"(_ecx), "=d"(_edx) : "a"(1) : "ebx");
+	if (_edx & (1 << 3)) {
+		uint32_t cr4;
+		asm volatile ("mov %%cr4, %0" : "=r"(cr4));
+		asm volatile ("mov %0, %%cr4" : : "r"(cr4 | 0x10));
+		pse_enabled = 1;
+	}
+
 	uintptr_t phys;
 	kernel_directory = (page_directory_t *)kvmalloc_p(sizeof(page_directory_t),&phys);
 	memset(kernel_directory, 0, sizeof(page_directory_t));
@@ -316,8 +599,21 @@ void paging_finalize(void) {
 	for (uintptr_t i = 0x80000; i < 0x100000; i += 0x1000) {
 		dma_frame(get_page(i, 1, kernel_directory), 1, 0, i);
 	}
-	for (uintptr_t i = 0x100000; i < placement_pointer + 0x3000; i += 0x1000) {
-		dma_frame(get_page(i, 1, kernel_directory), 1, 0, i);
+	/*
+	 * The rest of the identity map covers the kernel, modules, and the
+	 * ramdisk; use 4MB pages for the aligned bulk of it and 4KB pages
+	 * for the unaligned head and tail. (The first megabyte stays 4KB
+	 * mapped above because its permissions are mixed.)
+	 */
+	uintptr_t ident_end = placement_pointer + 0x3000;
+	for (uintptr_t i = 0x100000; i < ident_end; ) {
+		if (pse_enabled && !(i & 0x3FFFFF) && ident_end - i >= 0x400000) {
+			dma_large_frame(i, 1, 0, i);
+			i += 0x400000;
+		} else {
+			dma_frame(get_page(i, 1, kernel_directory), 1, 0, i);
+			i += 0x1000;
+		}
 	}
 	debug_print(INFO, "Mapping VGA text-mode directly.");
 	for (uintptr_t j = 0xb8000; j < 0xc0000; j += 0x1000) {
@@ -354,6 +650,10 @@ uintptr_t map_to_physical(uintptr_t virtual) {
 	uintptr_t table = frame / 1024;
 	uintptr_t subframe = frame % 1024;
 
+	if ((uintptr_t)current_directory->tables[table] == (uintptr_t)0xFFFFFFFF) {
+		return (current_directory->physical_tables[table] & 0xFFC00000) + (virtual & 0x3FFFFF);
+	}
+
 	if (current_directory->tables[table]) {
 		page_t * p = &current_directory->tables[table]->pages[subframe];
 		return p->frame * 0x1000 + remaining;
@@ -399,10 +699,16 @@ switch_page_directory(
 		page_directory_t * dir
 		) {
 	current_directory = dir;
+	/*
+	 * PG enables paging; WP makes write protection apply to ring 0 as
+	 * well, so a kernel write to a copy-on-write page (read() into a
+	 * forked heap, say) faults and breaks the share like a user write
+	 * would, instead of silently scribbling on the shared frame.
+	 */
 	asm volatile (
 			"mov %0, %%cr3\n"
 			"mov %%cr0, %%eax\n"
-			"orl $0x80000000, %%eax\n"
+			"orl $0x80010000, %%eax\n"
 			"mov %%eax, %%cr0\n"
 			:: "r"(dir->physical_address)
 			: "%eax");
@@ -430,6 +736,10 @@ get_page(
 		) {
 	address /= 0x1000;
 	uint32_t table_index = address / 1024;
+	if ((uintptr_t)dir->tables[table_index] == (uintptr_t)0xFFFFFFFF) {
+		/* 4MB large page; there are no 4KB entries to hand out */
+		return 0;
+	}
 	if (dir->tables[table_index]) {
 		return &dir->tables[table_index]->pages[address % 1024];
 	} else if(make) {
@@ -444,6 +754,69 @@ get_page(
 	}
 }
 
+/*
+ * Resolve a write fault on a copy-on-write page.
+ *
+ * If we are the last holder of the frame we simply restore write
+ * access; otherwise we break the share by copying into a fresh frame.
+ *
+ * @return 1 if this was a COW fault and it has been resolved.
+ */
+/*
+ * The shared zero page. Lazily-grown heap pages all map this one frame
+ * read-only; a real frame is only allocated when a write faults, via
+ * the regular copy-on-write path. The pinned reference count keeps it
+ * from ever being restored writable or freed.
+ */
+static uint32_t zero_frame = 0;
+
+static uint32_t get_zero_frame(void) {
+	if (!zero_frame) {
+		uintptr_t zp = kvmalloc(0x1000);
+		memset((void *)zp, 0x00, 0x1000);
+		zero_frame = map_to_physical(zp) / 0x1000;
+		frame_refs[zero_frame] = FRAME_REF_PINNED;
+	}
+	return zero_frame;
+}
+
+/*
+ * Map a page as lazily zero-filled: present and readable immediately,
+ * backed by the shared zero page until something writes to it.
+ */
+void lazy_zero_frame(page_t * page) {
+	ASSUME(page != NULL);
+	page->frame   = get_zero_frame();
+	page->present = 1;
+	page->rw      = 0;
+	page->user    = 1;
+	page->cow     = 1;
+}
+
+int cow_fault(uintptr_t address) {
+	page_t * page = get_page(address, 0, current_directory);
+	if (!page || !page->present || !page->cow) {
+		return 0;
+	}
+	uint32_t old_frame = page->frame;
+	if (frame_refcount(old_frame) <= 1) {
+		/* Every other sharer has already copied or exited */
+		page->cow = 0;
+		page->rw  = 1;
+	} else {
+		page->frame = 0;
+		page->cow   = 0;
+		alloc_frame(page, 0, 1);
+		copy_page_physical(old_frame * 0x1000, page->frame * 0x1000);
+		frame_unref(old_frame);
+	}
+	invalidate_tables_at(address);
+	return 1;
+}
+
+static kstat_t * stat_page_faults = NULL;
+static kstat_t * stat_cow_breaks = NULL;
+
 void
 page_fault(
 		struct regs *r)  {
@@ -451,6 +824,12 @@ page_fault(
 	uint32_t faulting_address;
 	asm volatile("mov %%cr2, %0" : "=r"(faulting_address));
 
+	if (__builtin_expect(!stat_page_faults, 0)) {
+		stat_page_faults = kstat_register("mem.page_faults");
+		stat_cow_breaks  = kstat_register("mem.cow_breaks");
+	}
+	KSTAT_INC(stat_page_faults);
+
 	if (r->eip == SIGNAL_RETURN) {
 		return_from_signal_handler();
 	} else if (r->eip == THREAD_RETURN) {
@@ -458,6 +837,54 @@ page_fault(
 		kexit(0);
 	}
 
+	/* Write protection violation may just be a pending copy-on-write */
+	if ((r->err_code & 0x3) == 0x3 && cow_fault(faulting_address)) {
+		KSTAT_INC(stat_cow_breaks);
+		return;
+	}
+
+	/*
+	 * A not-present fault in the stack region grows the stack on
+	 * demand. The bottom page is never mapped this way, leaving a
+	 * guard that turns runaway recursion into a normal segfault.
+	 */
+	if (!(r->err_code & 0x1) &&
+			faulting_address >= USER_STACK_BOTTOM + 0x1000 &&
+			faulting_address <  USER_STACK_TOP) {
+		page_t * page = get_page(faulting_address & 0xFFFFF000, 1, current_directory);
+		if (page && !page->present) {
+			alloc_frame(page, 0, 1);
+			invalidate_tables_at(faulting_address & 0xFFFFF000);
+			return;
+		}
+	}
+
+	/* First touch of the shared time page in this address space */
+	if (!(r->err_code & 0x1) &&
+			faulting_address >= USER_TIME_PAGE &&
+			faulting_address <  USER_TIME_PAGE + 0x1000 &&
+			time_page_frame()) {
+		page_t * page = get_page(USER_TIME_PAGE, 1, current_directory);
+		if (page && !page->present) {
+			page->frame   = time_page_frame();
+			page->present = 1;
+			page->rw      = 0;
+			page->user    = 1;
+			invalidate_tables_at(USER_TIME_PAGE);
+			return;
+		}
+	}
+
+	/* Shared memory chunks populate their frames on first touch */
+	if (!(r->err_code & 0x1) && shm_fault(faulting_address)) {
+		return;
+	}
+
+	/* File mappings pull their pages from the page cache on first touch */
+	if (!(r->err_code & 0x1) && mmap_fault(faulting_address)) {
+		return;
+	}
+
 #if 1
 	int present  = !(r->err_code & 0x1) ? 1 : 0;
 	int rw       = r->err_code & 0x2    ? 1 : 0;
@@ -470,35 +897,13 @@ page_fault(
 
 	if (r->eip < heap_end) {
 		/* find closest symbol */
-		char * closest  = NULL;
-		size_t distance = 0xFFFFFFFF;
 		uintptr_t  addr = 0;
+		char * closest = ksym_find(r->eip, &addr);
 
 		if (modules_get_symbols()) {
-			list_t * hash_keys = hashmap_keys(modules_get_symbols());
-			foreach(_key, hash_keys) {
-				char * key = (char *)_key->value;
-				uintptr_t a = (uintptr_t)hashmap_get(modules_get_symbols(), key);
-
-				if (!a) continue;
-
-				size_t d;
-				if (a <= r->eip) {
-					d = r->eip - a;
-				} else {
-					d = a - r->eip;
-				}
-				if (d < distance) {
-					closest = key;
-					distance = d;
-					addr = a;
-				}
-			}
-			free(hash_keys);
-
 			debug_print(ERROR, "\033[1;31mClosest symbol to faulting address:\033[0m %s [0x%x]", closest, addr);
 
-			hash_keys = hashmap_keys(modules_get_list());
+			list_t * hash_keys = hashmap_keys(modules_get_list());
 			foreach(_key, hash_keys) {
 				char * key = (char *)_key->value;
 				module_data_t * m = (module_data_t *)hashmap_get(modules_get_list(), key);
@@ -0,0 +1,179 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ *
+ * File-backed memory mappings.
+ *
+ * mmap() reserves a stretch of the per-process mapping window and
+ * records which file backs it; nothing is mapped until a page is
+ * touched. The fault handler then points the user page directly at
+ * the page cache's frame for that part of the file - read-only for
+ * PROT_READ mappings, copy-on-write for writable MAP_PRIVATE ones -
+ * so scanning a mapped file involves no copying at all once the cache
+ * is warm.
+ */
+#include <system.h>
+#include <process.h>
+#include <logging.h>
+#include <fs.h>
+#include <pagecache.h>
+#include <mmap.h>
+
+static spin_lock_t mmap_lock = { 0 };
+
+void * mmap_map(fs_node_t * node, uint32_t offset, size_t length, int prot, int flags) {
+	process_t * proc = (process_t *)current_process;
+	if (proc->group != 0) {
+		proc = process_from_pid(proc->group);
+	}
+
+	if (!length) return NULL;
+	if (offset & 0xFFF) return NULL;
+
+	/* Round the region up to whole pages */
+	length = (length + 0xFFF) & ~0xFFF;
+
+	spin_lock(mmap_lock);
+	mmap_region_t * region = malloc(sizeof(mmap_region_t));
+	region->base   = proc->image.mmap_heap;
+	region->size   = length;
+	region->node   = node;
+	region->offset = offset;
+	region->file_limit = length;
+	region->prot   = prot;
+	region->flags  = flags;
+	proc->image.mmap_heap += length;
+
+	/* The mapping keeps the file alive after the descriptor closes */
+	open_fs(node, 0);
+
+	list_insert(proc->mmaps, region);
+	spin_unlock(mmap_lock);
+
+	debug_print(INFO, "mmap: %s [0x%x+0x%x] at 0x%x for process %d",
+			node->name, offset, length, region->base, proc->id);
+
+	return (void *)region->base;
+}
+
+/*
+ * Record a mapping at a caller-chosen address; exec uses this to put
+ * ELF segments where their program headers say, backed by the same
+ * fault path. file_limit caps how much of the region reads from the
+ * file - the rest (bss) reads as zeroes.
+ */
+void mmap_map_fixed(fs_node_t * node, uintptr_t base, uint32_t offset, size_t length, int prot, int flags, size_t file_limit) {
+	process_t * proc = (process_t *)current_process;
+	if (proc->group != 0) {
+		proc = process_from_pid(proc->group);
+	}
+
+	length = (length + 0xFFF) & ~0xFFF;
+
+	spin_lock(mmap_lock);
+	mmap_region_t * region = malloc(sizeof(mmap_region_t));
+	region->base   = base;
+	region->size   = length;
+	region->node   = node;
+	region->offset = offset;
+	region->file_limit = file_limit;
+	region->prot   = prot;
+	region->flags  = flags;
+
+	open_fs(node, 0);
+	list_insert(proc->mmaps, region);
+	spin_unlock(mmap_lock);
+
+	debug_print(INFO, "mmap fixed: %s [0x%x+0x%x] at 0x%x for process %d",
+			node->name, offset, length, base, proc->id);
+}
+
+/*
+ * Not-present fault inside the mapping window: find the region, pull
+ * the right page of the file from the page cache, and map its frame.
+ */
+int mmap_fault(uintptr_t address) {
+	process_t * proc = (process_t *)current_process;
+	if (!proc || !proc->mmaps) return 0;
+	if (proc->group != 0) {
+		proc = process_from_pid(proc->group);
+	}
+
+	if (!proc->mmaps->length) return 0;
+
+	spin_lock(mmap_lock);
+	mmap_region_t * region = NULL;
+	foreach(n, proc->mmaps) {
+		mmap_region_t * r = (mmap_region_t *)n->value;
+		if (address >= r->base && address < r->base + r->size) {
+			/* Page-rounded ELF segments can share a boundary page;
+			 * the higher (writable) segment owns it */
+			if (!region || r->base > region->base) {
+				region = r;
+			}
+		}
+	}
+	spin_unlock(mmap_lock);
+	if (!region) return 0;
+
+	uintptr_t vpage = address & 0xFFFFF000;
+	uintptr_t rel = vpage - region->base;
+	uint32_t file_offset = region->offset + rel;
+
+	page_t * page = get_page(vpage, 1, current_directory);
+
+	if (rel + 0x1000 <= region->file_limit) {
+		/* Fully file-backed: share the page cache's frame */
+		uintptr_t frame = pagecache_map_frame(region->node, file_offset);
+		if (frame) {
+			page->frame   = frame;
+			frame_ref(frame);
+			page->present = 1;
+			page->user    = 1;
+			page->rw      = 0;
+			/* Writable private mappings copy on first write */
+			page->cow     = ((region->prot & PROT_WRITE) && (region->flags & MAP_PRIVATE)) ? 1 : 0;
+			invalidate_tables_at(vpage);
+			return 1;
+		}
+		/* Uncacheable; fall through and copy instead */
+	}
+
+	/*
+	 * Zero page, possibly with a partial tail of file data - the page
+	 * that straddles a segment's filesz boundary can't share a cache
+	 * frame, since its tail must read as zeroes.
+	 */
+	alloc_frame(page, 0, 1);
+	invalidate_tables_at(vpage);
+	memset((void *)vpage, 0x00, 0x1000);
+	if (rel < region->file_limit) {
+		size_t bytes = region->file_limit - rel;
+		if (bytes > 0x1000) bytes = 0x1000;
+		read_fs(region->node, file_offset, bytes, (uint8_t *)vpage);
+	}
+	if (!(region->prot & PROT_WRITE)) {
+		page->rw = 0;
+		invalidate_tables_at(vpage);
+	}
+
+	return 1;
+}
+
+/*
+ * Tear down a process's mapping records - the page tables themselves
+ * go away with the address space.
+ */
+void mmap_release_all(process_t * proc) {
+	if (!proc->mmaps) return;
+	spin_lock(mmap_lock);
+	node_t * n;
+	while ((n = list_pop(proc->mmaps)) != NULL) {
+		mmap_region_t * region = (mmap_region_t *)n->value;
+		close_fs(region->node);
+		free(region);
+		free(n);
+	}
+	proc->image.mmap_heap = MMAP_START;
+	spin_unlock(mmap_lock);
+}
@@ -35,9 +35,7 @@ static shm_node_t * _get_node(char * shm_path, int create, tree_node_t * from) {
 	char *pch, *save;
 	pch = strtok_r(shm_path, SHM_PATH_SEPARATOR, &save);
 
-	tree_node_t * tnode = from;
-	foreach(node, tnode->children) {
-		tree_node_t * _node = (tree_node_t *)node->value;
+	foreach_child(_node, from) {
 		shm_node_t *  snode = (shm_node_t *)_node->value;
 
 		if (!strcmp(snode->name, pch)) {
@@ -102,15 +100,11 @@ static shm_chunk_t * create_chunk (shm_node_t * parent, size_t size) {
 		return NULL;
 	}
 
-	/* Now grab some frames for this guy. */
-	for (uint32_t i = 0; i < chunk->num_frames; i++) {
-		page_t tmp = {0,0,0,0,0,0,0};
-		alloc_frame(&tmp, 0, 0);
-		chunk->frames[i] = tmp.frame;
-#if 0
-		debug_print(WARNING, "Using frame 0x%x for chunk[%d] (name=%s)", tmp.frame * 0x1000, i, parent->name);
-#endif
-	}
+	/*
+	 * Frames are populated on first touch by shm_fault(); a zeroed
+	 * slot means no frame has been allocated for that page yet.
+	 */
+	memset(chunk->frames, 0x00, sizeof(uintptr_t) * chunk->num_frames);
 
 	return chunk;
 }
@@ -127,7 +121,9 @@ static int release_chunk (shm_chunk_t * chunk) {
 
 			/* First, free the frames used by this chunk */
 			for (uint32_t i = 0; i < chunk->num_frames; i++) {
-				clear_frame(chunk->frames[i] * 0x1000);
+				if (chunk->frames[i]) {
+					clear_frame(chunk->frames[i] * 0x1000);
+				}
 			}
 
 			/* Then, get rid of the damn thing */
@@ -159,6 +155,23 @@ static uintptr_t proc_sbrk(uint32_t num_pages, process_t * proc) {
 	return initial;
 }
 
+/*
+ * Point one page of a mapping at the chunk. Pages whose frame has not
+ * been populated yet stay unmapped; shm_fault() fills them in on
+ * first touch.
+ */
+static void map_page (shm_mapping_t * mapping, shm_chunk_t * chunk, unsigned int i, uintptr_t vaddr, process_t * proc) {
+	if (chunk->frames[i]) {
+		page_t * page = get_page(vaddr, 1, proc->thread.page_directory);
+		page->frame = chunk->frames[i];
+		alloc_frame(page, 0, 1);
+		invalidate_tables_at(vaddr);
+	} else {
+		get_page(vaddr, 1, proc->thread.page_directory);
+	}
+	mapping->vaddrs[i] = vaddr;
+}
+
 static void * map_in (shm_chunk_t * chunk, process_t * proc) {
 	if (!chunk) {
 		return NULL;
@@ -181,11 +194,7 @@ static void * map_in (shm_chunk_t * chunk, process_t * proc) {
 
 				/* Map the gap */
 				for (unsigned int i = 0; i < chunk->num_frames; ++i) {
-					page_t * page = get_page(last_address + i * 0x1000, 1, proc->thread.page_directory);
-					page->frame = chunk->frames[i];
-					alloc_frame(page, 0, 1);
-					invalidate_tables_at(last_address + i * 0x1000);
-					mapping->vaddrs[i] = last_address + i * 0x1000;
+					map_page(mapping, chunk, i, last_address + i * 0x1000, proc);
 				}
 
 				/* Insert us before this node */
@@ -204,11 +213,7 @@ static void * map_in (shm_chunk_t * chunk, process_t * proc) {
 			debug_print(INFO, "Gap is sufficient, we can insert here.");
 
 			for (unsigned int i = 0; i < chunk->num_frames; ++i) {
-				page_t * page = get_page(last_address + i * 0x1000, 1, proc->thread.page_directory);
-				page->frame = chunk->frames[i];
-				alloc_frame(page, 0, 1);
-				invalidate_tables_at(last_address + i * 0x1000);
-				mapping->vaddrs[i] = last_address + i * 0x1000;
+				map_page(mapping, chunk, i, last_address + i * 0x1000, proc);
 			}
 
 			list_insert(proc->shm_mappings, mapping);
@@ -224,17 +229,7 @@ static void * map_in (shm_chunk_t * chunk, process_t * proc) {
 		uintptr_t new_vpage = proc_sbrk(1, proc);
 		assert(new_vpage % 0x1000 == 0);
 
-		page_t * page = get_page(new_vpage, 1, proc->thread.page_directory);
-		assert(page && "Page not allocated by sys_sbrk?");
-
-		page->frame = chunk->frames[i];
-		alloc_frame(page, 0, 1);
-		invalidate_tables_at(new_vpage);
-		mapping->vaddrs[i] = new_vpage;
-
-#if 0
-			debug_print(INFO, "mapping vaddr 0x%x --> #%d", new_vpage, page->frame);
-#endif
+		map_page(mapping, chunk, i, new_vpage, proc);
 	}
 
 	list_insert(proc->shm_mappings, mapping);
@@ -294,6 +289,114 @@ void * shm_obtain (char * path, size_t * size) {
 	return vshm_start;
 }
 
+/*
+ * Handle a not-present fault in the shared memory window: if it lands
+ * inside one of the faulting process's mappings, populate the backing
+ * frame (first toucher allocates it; later sharers just map it) and
+ * resume.
+ */
+int shm_fault (uintptr_t address) {
+	if (address < SHM_START) {
+		return 0;
+	}
+
+	process_t * proc = (process_t *)current_process;
+	if (!proc) {
+		return 0;
+	}
+	if (proc->group != 0) {
+		proc = process_from_pid(proc->group);
+	}
+
+	spin_lock(bsl);
+	foreach (n, proc->shm_mappings) {
+		shm_mapping_t * m = (shm_mapping_t *)n->value;
+		if (address < m->vaddrs[0] || address >= m->vaddrs[0] + m->num_vaddrs * 0x1000) {
+			continue;
+		}
+		shm_chunk_t * chunk = m->chunk;
+		uint32_t i = (address - m->vaddrs[0]) / 0x1000;
+		if (!chunk->frames[i]) {
+			page_t tmp = {0,0,0,0,0,0,0};
+			alloc_frame(&tmp, 0, 0);
+			chunk->frames[i] = tmp.frame;
+		}
+		page_t * page = get_page(m->vaddrs[i], 1, proc->thread.page_directory);
+		page->frame = chunk->frames[i];
+		alloc_frame(page, 0, 1);
+		invalidate_tables_at(m->vaddrs[i]);
+		spin_unlock(bsl);
+		return 1;
+	}
+	spin_unlock(bsl);
+	return 0;
+}
+
+/*
+ * Resize an existing chunk in place and remap it for the caller.
+ * Frames shared with the old size are kept, so the contents survive;
+ * other processes holding the chunk must release and re-obtain it to
+ * see the new extent.
+ */
+void * shm_resize (char * path, size_t * size) {
+	spin_lock(bsl);
+	process_t * proc = (process_t *)current_process;
+
+	if (proc->group != 0) {
+		proc = process_from_pid(proc->group);
+	}
+
+	shm_node_t * _node = get_node(path, 0);
+	if (!_node || !_node->chunk || !size || !*size) {
+		spin_unlock(bsl);
+		return NULL;
+	}
+	shm_chunk_t * chunk = _node->chunk;
+
+	uint32_t num_frames = (*size / 0x1000) + ((*size % 0x1000) ? 1 : 0);
+	if (num_frames != chunk->num_frames) {
+		uintptr_t * frames = malloc(sizeof(uintptr_t) * num_frames);
+		for (uint32_t i = 0; i < num_frames; i++) {
+			frames[i] = (i < chunk->num_frames) ? chunk->frames[i] : 0;
+		}
+		/* If we shrank, give back the frames past the new end */
+		for (uint32_t i = num_frames; i < chunk->num_frames; i++) {
+			if (chunk->frames[i]) {
+				clear_frame(chunk->frames[i] * 0x1000);
+			}
+		}
+		free(chunk->frames);
+		chunk->frames = frames;
+		chunk->num_frames = num_frames;
+	}
+
+	/* Swap the caller's old mapping for one of the new size */
+	foreach (n, proc->shm_mappings) {
+		shm_mapping_t * m = (shm_mapping_t *)n->value;
+		if (m->chunk != chunk) {
+			continue;
+		}
+		for (uint32_t i = 0; i < m->num_vaddrs; i++) {
+			page_t * page = get_page(m->vaddrs[i], 0, proc->thread.page_directory);
+			assert(page && "Shared memory mapping was invalid!");
+			memset(page, 0, sizeof(page_t));
+		}
+		list_delete(proc->shm_mappings, n);
+		free(n);
+		free(m->vaddrs);
+		free(m);
+		break;
+	}
+
+	void * vshm_start = map_in(chunk, proc);
+	*size = chunk_size(chunk);
+
+	spin_unlock(bsl);
+	invalidate_page_tables();
+
+	return vshm_start;
+}
+
 int shm_release (char * path) {
 	spin_lock(bsl);
 	process_t * proc = (process_t *)current_process;
@@ -0,0 +1,37 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ *
+ * Boot milestone timestamps (see boottime.h).
+ *
+ * A fixed array rather than anything allocated, because the earliest
+ * marks land before the heap exists. Once the array is full further
+ * marks are dropped - the boot timeline is bounded by design.
+ */
+#include <system.h>
+#include <boottime.h>
+
+static boot_mark_t boot_marks[BOOT_MARKS_MAX];
+static size_t boot_mark_count = 0;
+
+void boot_mark(const char * name) {
+	if (boot_mark_count >= BOOT_MARKS_MAX) return;
+	boot_mark_t * mark = &boot_marks[boot_mark_count];
+
+	size_t i = 0;
+	while (name[i] && i < BOOT_MARK_NAME - 1) {
+		mark->name[i] = name[i];
+		i++;
+	}
+	mark->name[i] = '\0';
+	mark->ticks    = timer_ticks;
+	mark->subticks = timer_subticks;
+
+	boot_mark_count++;
+}
+
+boot_mark_t * boot_marks_get(size_t * count) {
+	*count = boot_mark_count;
+	return boot_marks;
+}
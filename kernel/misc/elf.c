@@ -12,6 +12,7 @@
 #include <elf.h>
 #include <process.h>
 #include <logging.h>
+#include <mmap.h>
 
 int exec_elf(char * path, fs_node_t * file, int argc, char ** argv, char ** env, int interp) {
 	Elf32_Header header;
@@ -63,6 +64,7 @@ int exec_elf(char * path, fs_node_t * file, int argc, char ** argv, char ** env,
 	uintptr_t entry = (uintptr_t)header.e_entry;
 	uintptr_t base_addr = 0xFFFFFFFF;
 	uintptr_t end_addr  = 0x0;
+	int can_demand = 1;
 
 	for (uintptr_t x = 0; x < (uint32_t)header.e_phentsize * header.e_phnum; x += header.e_phentsize) {
 		Elf32_Phdr phdr;
@@ -74,6 +76,12 @@ int exec_elf(char * path, fs_node_t * file, int argc, char ** argv, char ** env,
 			if (phdr.p_memsz + phdr.p_vaddr > end_addr) {
 				end_addr = phdr.p_memsz + phdr.p_vaddr;
 			}
+			/* Demand paging needs file and memory offsets congruent
+			 * modulo the page size; linkers always do this, but
+			 * don't trust a weird binary */
+			if ((phdr.p_vaddr ^ phdr.p_offset) & 0xFFF) {
+				can_demand = 0;
+			}
 		}
 	}
 
@@ -88,25 +96,47 @@ int exec_elf(char * path, fs_node_t * file, int argc, char ** argv, char ** env,
 		Elf32_Phdr phdr;
 		read_fs(file, header.e_phoff + x, sizeof(Elf32_Phdr), (uint8_t *)&phdr);
 		if (phdr.p_type == PT_LOAD) {
-			for (uintptr_t i = phdr.p_vaddr; i < phdr.p_vaddr + phdr.p_memsz; i += 0x1000) {
-				/* This doesn't care if we already allocated this page */
-				alloc_frame(get_page(i, 1, current_directory), 0, 1);
-				invalidate_tables_at(i);
-			}
-			IRQ_RES;
-			read_fs(file, phdr.p_offset, phdr.p_filesz, (uint8_t *)phdr.p_vaddr);
-			IRQ_OFF;
-			size_t r = phdr.p_filesz;
-			while (r < phdr.p_memsz) {
-				*(char *)(phdr.p_vaddr + r) = 0;
-				r++;
+			if (can_demand) {
+				/*
+				 * Record the segment as a private file mapping and let
+				 * the fault handler pull pages from the page cache as
+				 * they are touched; exec cost is then proportional to
+				 * the pages actually used, not the binary size.
+				 */
+				uintptr_t seg_base = phdr.p_vaddr & ~0xFFF;
+				uint32_t  seg_off  = phdr.p_offset & ~0xFFF;
+				size_t    seg_size = (phdr.p_vaddr + phdr.p_memsz) - seg_base;
+				size_t    file_limit = (phdr.p_vaddr & 0xFFF) + phdr.p_filesz;
+				int prot = PROT_READ | ((phdr.p_flags & PF_W) ? PROT_WRITE : 0);
+				mmap_map_fixed(file, seg_base, seg_off, seg_size, prot, MAP_PRIVATE, file_limit);
+			} else {
+				for (uintptr_t i = phdr.p_vaddr; i < phdr.p_vaddr + phdr.p_memsz; i += 0x1000) {
+					/* This doesn't care if we already allocated this page */
+					alloc_frame(get_page(i, 1, current_directory), 0, 1);
+					invalidate_tables_at(i);
+				}
+				IRQ_RES;
+				read_fs(file, phdr.p_offset, phdr.p_filesz, (uint8_t *)phdr.p_vaddr);
+				IRQ_OFF;
+				size_t r = phdr.p_filesz;
+				while (r < phdr.p_memsz) {
+					*(char *)(phdr.p_vaddr + r) = 0;
+					r++;
+				}
 			}
 		}
 	}
 
+	/* The segment mappings hold their own references */
 	close_fs(file);
 
-	for (uintptr_t stack_pointer = USER_STACK_BOTTOM; stack_pointer < USER_STACK_TOP; stack_pointer += 0x1000) {
+	/*
+	 * Only the top few pages of the stack are allocated up front; the
+	 * fault handler grows it on demand down to the guard page at
+	 * USER_STACK_BOTTOM, so idle processes stop carrying a full
+	 * megabyte of stack they never touch.
+	 */
+	for (uintptr_t stack_pointer = USER_STACK_TOP - USER_STACK_PREALLOC; stack_pointer < USER_STACK_TOP; stack_pointer += 0x1000) {
 		alloc_frame(get_page(stack_pointer, 1, current_directory), 0, 1);
 		invalidate_tables_at(stack_pointer);
 	}
@@ -125,7 +155,9 @@ int exec_elf(char * path, fs_node_t * file, int argc, char ** argv, char ** env,
 	auxvc++;
 
 	uintptr_t heap = current_process->image.entry + current_process->image.size;
-	while (heap & 0xFFF) heap++;
+	/* Start on a fresh page - the final segment page still belongs to
+	 * the demand mapping */
+	heap = (heap + 0xFFF) & ~0xFFF;
 	alloc_frame(get_page(heap, 1, current_directory), 0, 1);
 	invalidate_tables_at(heap);
 	char ** argv_ = (char **)heap;
@@ -164,7 +196,7 @@ int exec_elf(char * path, fs_node_t * file, int argc, char ** argv, char ** env,
 
 	current_process->image.heap        = heap; /* heap end */
 	current_process->image.heap_actual = heap + (0x1000 - heap % 0x1000);
-	alloc_frame(get_page(current_process->image.heap_actual, 1, current_directory), 0, 1);
+	lazy_zero_frame(get_page(current_process->image.heap_actual, 1, current_directory));
 	invalidate_tables_at(current_process->image.heap_actual);
 	current_process->image.user_stack  = USER_STACK_TOP;
 
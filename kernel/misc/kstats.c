@@ -0,0 +1,34 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ *
+ * Named kernel event counters (see kstats.h).
+ *
+ * A singly-linked list, prepend-only, published with a single store:
+ * readers walk it without locking and at worst miss a counter that
+ * was registered while they were iterating. Counters are never
+ * unregistered.
+ */
+#include <system.h>
+#include <kstats.h>
+
+static kstat_t * kstat_head = NULL;
+static spin_lock_t kstat_lock = { 0 };
+
+kstat_t * kstat_register(const char * name) {
+	kstat_t * stat = malloc(sizeof(kstat_t));
+	stat->name = name;
+	stat->value = 0;
+
+	spin_lock(kstat_lock);
+	stat->next = kstat_head;
+	kstat_head = stat;
+	spin_unlock(kstat_lock);
+
+	return stat;
+}
+
+kstat_t * kstat_first(void) {
+	return kstat_head;
+}
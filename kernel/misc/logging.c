@@ -11,6 +11,7 @@
 
 #include <system.h>
 #include <list.h>
+#include <process.h>
 #include <logging.h>
 #include <va_list.h>
 #include <printf.h>
@@ -31,6 +32,80 @@ static char * c_messages[] = {
 
 static char buffer[1024];
 
+/*
+ * Formatted lines are normally appended to a ring and written out by
+ * a low-priority flusher tasklet, so a debug_print at interrupt time
+ * does not sit on the UART ready bit for every character. Until the
+ * flusher is up - and again after logging_direct() on the panic path -
+ * lines go straight to debug_file as before.
+ */
+#define LOG_RING_SIZE 16384
+
+static char log_ring[LOG_RING_SIZE];
+static volatile uint32_t log_head = 0;  /* monotonic; bytes queued */
+static volatile uint32_t log_tail = 0;  /* monotonic; bytes flushed */
+static uint32_t log_dropped = 0;
+static list_t * log_flush_wait = NULL;
+static int log_direct = 1;
+
+static char line[1200];
+
+static void log_flush_some(void) {
+	static char chunk[513];
+	while (log_tail != log_head) {
+		IRQ_OFF;
+		uint32_t head = log_head;
+		size_t len = head - log_tail;
+		if (len > 512) len = 512;
+		for (size_t i = 0; i < len; ++i) {
+			chunk[i] = log_ring[(log_tail + i) & (LOG_RING_SIZE - 1)];
+		}
+		log_tail += len;
+		IRQ_RES;
+		chunk[len] = '\0';
+		if (debug_file) {
+			fprintf(debug_file, "%s", chunk);
+		}
+	}
+	if (log_dropped) {
+		uint32_t dropped = log_dropped;
+		log_dropped = 0;
+		if (debug_file) {
+			fprintf(debug_file, "[logging] %d lines dropped\n", dropped);
+		}
+	}
+}
+
+static void log_flusher_task(void * argp, char * name) {
+	(void)argp; (void)name;
+	while (1) {
+		if (log_tail == log_head && !log_dropped) {
+			sleep_on(log_flush_wait);
+			continue;
+		}
+		log_flush_some();
+	}
+}
+
+void logging_install_flusher(void) {
+	log_flush_wait = list_create();
+	int pid = create_kernel_tasklet(log_flusher_task, "[logflush]", NULL);
+	process_t * flusher = process_from_pid(pid);
+	if (flusher) {
+		flusher->priority = PRIORITY_BATCH;
+	}
+	log_direct = 0;
+}
+
+/*
+ * Panic path: flush whatever is queued and make every later line
+ * synchronous, since the flusher will never be scheduled again.
+ */
+void logging_direct(void) {
+	log_direct = 1;
+	log_flush_some();
+}
+
 void _debug_print(char * title, int line_no, log_type_t level, char *fmt, ...) {
 	if (level >= debug_level && debug_file) {
 		va_list args;
@@ -45,9 +120,24 @@ void _debug_print(char * title, int line_no, log_type_t level, char *fmt, ...) {
 			type = c_messages[level];
 		}
 
-		fprintf(debug_file, "[%10d.%3d:%s:%d]%s %s\n", timer_ticks, timer_subticks, title, line_no, type, buffer);
+		if (log_direct) {
+			fprintf(debug_file, "[%10d.%3d:%s:%d]%s %s\n", timer_ticks, timer_subticks, title, line_no, type, buffer);
+			return;
+		}
 
+		sprintf(line, "[%10d.%3d:%s:%d]%s %s\n", timer_ticks, timer_subticks, title, line_no, type, buffer);
+		size_t len = strlen(line);
+		IRQ_OFF;
+		if (LOG_RING_SIZE - (log_head - log_tail) < len) {
+			log_dropped++;
+		} else {
+			for (size_t i = 0; i < len; ++i) {
+				log_ring[(log_head + i) & (LOG_RING_SIZE - 1)] = line[i];
+			}
+			log_head += len;
+		}
+		IRQ_RES;
+		wakeup_queue_irq(log_flush_wait);
 	}
 	/* else ignore */
 }
-
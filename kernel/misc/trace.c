@@ -0,0 +1,107 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ *
+ * Kernel Tracepoints
+ *
+ * Fixed-size binary records written into per-CPU rings and drained
+ * through /proc/trace. Rings are allocated the first time tracing
+ * is enabled (sysfunc 13), so an untraced kernel pays nothing but
+ * the disabled-branch checks at the tracepoints themselves.
+ */
+
+#include <system.h>
+#include <logging.h>
+#include <process.h>
+#include <trace.h>
+#include <kstats.h>
+
+/* Entries per CPU; power of two so the ring index is a mask */
+#define TRACE_RING_SIZE 1024
+
+typedef struct {
+	trace_event_t * events;
+	volatile uint32_t head;  /* monotonic; next slot to write */
+	uint32_t tail;           /* monotonic; next slot to drain */
+} trace_ring_t;
+
+int trace_enabled = 0;
+int trace_sample_enabled = 0;
+
+static trace_ring_t trace_rings[MAX_CPUS];
+
+/* Registered when tracing is first enabled; trace_emit runs in
+ * interrupt context and must not allocate. */
+static kstat_t * stat_events = NULL;
+
+static void trace_alloc_rings(void) {
+	if (!stat_events) {
+		stat_events = kstat_register("trace.events");
+	}
+	for (int i = 0; i < scheduler_cpu_count; ++i) {
+		if (!trace_rings[i].events) {
+			trace_rings[i].events = malloc(TRACE_RING_SIZE * sizeof(trace_event_t));
+			trace_rings[i].head = 0;
+			trace_rings[i].tail = 0;
+		}
+	}
+}
+
+void trace_emit(uint16_t type, uint32_t data) {
+	trace_ring_t * ring = &trace_rings[cpu_current()->index];
+	if (!ring->events) return;
+
+	/* The only writers racing for a slot are this CPU and its own
+	 * nested interrupt handlers, so one atomic claim suffices;
+	 * there is no lock for an interrupted writer to be caught
+	 * holding. */
+	KSTAT_INC(stat_events);
+	uint32_t slot = __sync_fetch_and_add(&ring->head, 1);
+	trace_event_t * ev = &ring->events[slot & (TRACE_RING_SIZE - 1)];
+	ev->ticks    = timer_ticks;
+	ev->subticks = timer_subticks;
+	ev->type     = type;
+	ev->pid      = current_process ? current_process->id : 0;
+	ev->data     = data;
+}
+
+int trace_set_enabled(int enabled) {
+	if (enabled) {
+		trace_alloc_rings();
+	}
+	trace_enabled = !!enabled;
+	debug_print(NOTICE, "Tracepoints %s", enabled ? "enabled" : "disabled");
+	return 0;
+}
+
+int trace_sample_set_enabled(int enabled) {
+	if (enabled) {
+		trace_alloc_rings();
+	}
+	trace_sample_enabled = !!enabled;
+	debug_print(NOTICE, "Profiling samples %s", enabled ? "enabled" : "disabled");
+	return 0;
+}
+
+/*
+ * Copy pending records into `buffer`, oldest first within each ring.
+ * A producer that laps the reader overwrites the oldest records and
+ * the reader just skips ahead to what is still live.
+ */
+size_t trace_dequeue(uint8_t * buffer, size_t size) {
+	size_t out = 0;
+	for (int i = 0; i < MAX_CPUS; ++i) {
+		trace_ring_t * ring = &trace_rings[i];
+		if (!ring->events) continue;
+		uint32_t head = ring->head;
+		if (head - ring->tail > TRACE_RING_SIZE) {
+			ring->tail = head - TRACE_RING_SIZE;
+		}
+		while (ring->tail != head && out + sizeof(trace_event_t) <= size) {
+			memcpy(buffer + out, &ring->events[ring->tail & (TRACE_RING_SIZE - 1)], sizeof(trace_event_t));
+			out += sizeof(trace_event_t);
+			ring->tail++;
+		}
+	}
+	return out;
+}
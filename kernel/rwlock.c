@@ -0,0 +1,42 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ *
+ * Reader/writer locks.
+ *
+ * Built on the ordinary spin locks: a writer holds the spin lock for
+ * the whole critical section and additionally waits out any readers
+ * already inside; a reader only takes the spin lock long enough to
+ * register itself, so readers run in parallel with each other and
+ * writers get exclusive access.
+ */
+#include <system.h>
+#include <process.h>
+
+void rwlock_init(rwlock_t * lock) {
+	spin_init(lock->lock);
+	lock->readers = 0;
+}
+
+void rwlock_acquire_read(rwlock_t * lock) {
+	/* Taking the spin lock briefly keeps new readers from starving
+	 * a writer that is already waiting for the count to drain. */
+	spin_lock(lock->lock);
+	__sync_fetch_and_add(&lock->readers, 1);
+	spin_unlock(lock->lock);
+}
+
+void rwlock_release_read(rwlock_t * lock) {
+	__sync_fetch_and_sub(&lock->readers, 1);
+}
+
+void rwlock_acquire_write(rwlock_t * lock) {
+	spin_lock(lock->lock);
+	while (lock->readers) {
+		switch_task(1);
+	}
+}
+
+void rwlock_release_write(rwlock_t * lock) {
+	spin_unlock(lock->lock);
+}
@@ -3,55 +3,118 @@
  * of the NCSA / University of Illinois License - see LICENSE.md
  * Copyright (C) 2015 Dale Weiler
  *
- * Spin locks with waiters
+ * Ticket spin locks with waiters
  *
  */
 #include <system.h>
+#include <process.h>
 
-static inline int arch_atomic_swap(volatile int * x, int v) {
-	asm("xchg %0, %1" : "=r"(v), "=m"(*x) : "0"(v) : "memory");
-	return v;
-}
+/* Spin this many times before conceding the rest of our slice; long
+ * enough to ride out an interrupt handler touching the lock, short
+ * enough not to burn a slice when the holder is descheduled. */
+#define SPIN_BOUND 64
 
 static inline void arch_atomic_store(volatile int * p, int x) {
 	asm("movl %1, %0" : "=m"(*p) : "r"(x) : "memory");
 }
 
-static inline void arch_atomic_inc(volatile int * x) {
-	asm("lock; incl %0" : "=m"(*x) : "m"(*x) : "memory");
+static inline void arch_cpu_relax(void) {
+	asm volatile("pause" ::: "memory");
 }
 
-static inline void arch_atomic_dec(volatile int * x) {
-	asm("lock; decl %0" : "=m"(*x) : "m"(*x) : "memory");
+/*
+ * Registry of locks that have ever seen contention, so the debug
+ * shell can point at the hot ones. Slots are claimed on a lock's
+ * first contended acquisition and never given back; the live
+ * counters stay in the lock itself.
+ */
+#define SPIN_STATS_MAX 64
+static spin_stat_t spin_stats[SPIN_STATS_MAX];
+static int spin_stats_count = 0;
+
+spin_stat_t * spin_lock_stats(int * count) {
+	*count = spin_stats_count;
+	return spin_stats;
 }
 
-void spin_wait(volatile int * addr, volatile int * waiters) {
-	if (waiters) {
-		arch_atomic_inc(waiters);
+static void spin_stat_note(volatile int * lock) {
+	for (int i = 0; i < spin_stats_count; ++i) {
+		if (spin_stats[i].lock == lock) {
+			spin_stats[i].contentions++;
+			return;
+		}
 	}
-	while (*addr) {
-		switch_task(1);
+	if (spin_stats_count < SPIN_STATS_MAX) {
+		spin_stats[spin_stats_count].lock = lock;
+		spin_stats[spin_stats_count].contentions = 1;
+		spin_stats_count++;
 	}
-	if (waiters) {
-		arch_atomic_dec(waiters);
+}
+
+/* Wait until *addr reaches value: bounded spin first, then yield */
+static void spin_wait(volatile int * addr, int value) {
+	while (*addr != value) {
+		for (int i = 0; i < SPIN_BOUND; ++i) {
+			if (*addr == value) return;
+			arch_cpu_relax();
+		}
+		if (*addr != value) {
+			switch_task(1);
+		}
 	}
 }
 
 void spin_lock(spin_lock_t lock) {
-	while (arch_atomic_swap(lock, 1)) {
-		spin_wait(lock, lock+1);
+	/* Take a ticket; we own the lock when it comes up for serving.
+	 * The xadd makes the ordering strictly FIFO - a latecomer can
+	 * never slip in ahead of a waiter that drew an earlier ticket. */
+	int ticket = __sync_fetch_and_add(&lock[0], 1);
+
+	if (lock[1] != ticket) {
+		lock[5]++;
+		spin_stat_note(lock);
+		while (lock[1] != ticket) {
+			/* Priority inheritance: lend our priority to the holder so a
+			 * low-priority owner can't stall us indefinitely. The boost
+			 * takes effect the next time the owner is enqueued; the saved
+			 * priority is restored when the owner unlocks. */
+			process_t * owner = (process_t *)lock[2];
+			if (current_process && owner && owner->priority > current_process->priority) {
+				if (!lock[3]) {
+					lock[3] = owner->priority + 1;
+				}
+				owner->priority = current_process->priority;
+			}
+			spin_wait(lock+1, ticket);
+		}
 	}
+
+	lock[2] = (int)(uintptr_t)current_process;
+	lock[4]++;
 }
 
 void spin_init(spin_lock_t lock) {
 	lock[0] = 0;
 	lock[1] = 0;
+	lock[2] = 0;
+	lock[3] = 0;
+	lock[4] = 0;
+	lock[5] = 0;
 }
 
 void spin_unlock(spin_lock_t lock) {
-	if (lock[0]) {
-		arch_atomic_store(lock, 0);
-		if (lock[1])
+	if (lock[0] != lock[1]) {
+		if (lock[3] && (process_t *)lock[2] == (process_t *)current_process && current_process) {
+			/* Drop the inherited priority now that we are done */
+			((process_t *)current_process)->priority = lock[3] - 1;
+		}
+		lock[2] = 0;
+		lock[3] = 0;
+		/* Hand the lock to the next ticket holder, if any */
+		int waited = (lock[0] != lock[1] + 1);
+		arch_atomic_store(lock+1, lock[1] + 1);
+		if (waited) {
 			switch_task(1);
+		}
 	}
 }
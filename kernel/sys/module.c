@@ -6,9 +6,12 @@
 #include <system.h>
 #include <logging.h>
 #include <fs.h>
+#include <process.h>
 #include <hashmap.h>
 #include <elf.h>
 #include <module.h>
+#include <printf.h>
+#include <boottime.h>
 
 #define SYMBOLTABLE_HASHMAP_SIZE 10
 #define MODULE_HASHMAP_SIZE 10
@@ -24,10 +27,110 @@ typedef struct {
 	char name[];
 } kernel_symbol_t;
 
+/* Name-sorted index over the kernel export table, built once in
+ * modules_install so lookups are a binary search instead of a walk
+ * over the whole packed blob. */
+static kernel_symbol_t ** symbol_index = NULL;
+static size_t symbol_index_count = 0;
+
+/*
+ * Address-sorted symbol index for symbolization - panic backtraces,
+ * segfault reports, the debug shell. Seeded from the kernel export
+ * blob and extended with each module's globals as it loads, so
+ * addresses inside module code resolve too.
+ */
+typedef struct {
+	uintptr_t addr;
+	char * name;
+} ksym_t;
+
+static ksym_t * ksym_index = NULL;
+static size_t ksym_count = 0;
+static size_t ksym_space = 0;
+
+static void ksym_insert(uintptr_t addr, char * name) {
+	if (!addr) return;
+	if (ksym_count == ksym_space) {
+		ksym_space = ksym_space ? ksym_space * 2 : 1024;
+		ksym_index = realloc(ksym_index, ksym_space * sizeof(ksym_t));
+	}
+	size_t lo = 0;
+	size_t hi = ksym_count;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (ksym_index[mid].addr < addr) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	memmove(&ksym_index[lo + 1], &ksym_index[lo], (ksym_count - lo) * sizeof(ksym_t));
+	ksym_index[lo].addr = addr;
+	ksym_index[lo].name = name;
+	ksym_count++;
+}
+
+/*
+ * Resolve an address to the nearest symbol at or below it. Returns
+ * the symbol name and stores its address through out_addr (so the
+ * caller can print name+offset), or NULL if the address is below
+ * everything we know about.
+ */
+char * ksym_find(uintptr_t addr, uintptr_t * out_addr) {
+	if (!ksym_count || addr < ksym_index[0].addr) {
+		if (out_addr) *out_addr = 0;
+		return NULL;
+	}
+	size_t lo = 0;
+	size_t hi = ksym_count;
+	while (lo + 1 < hi) {
+		/* Invariant: ksym_index[lo].addr <= addr */
+		size_t mid = (lo + hi) / 2;
+		if (ksym_index[mid].addr <= addr) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	if (out_addr) *out_addr = ksym_index[lo].addr;
+	return ksym_index[lo].name;
+}
+
+/*
+ * Enumerate the index in address order, for /proc/ksyms.
+ */
+size_t ksym_total(void) {
+	return ksym_count;
+}
+
+char * ksym_get(size_t i, uintptr_t * out_addr) {
+	if (i >= ksym_count) return NULL;
+	if (out_addr) *out_addr = ksym_index[i].addr;
+	return ksym_index[i].name;
+}
+
 /* Cannot use symboltable here because symbol_find is used during initialization
  * of IRQs and ISRs.
  */
 void (* symbol_find(const char * name))(void) {
+	if (symbol_index) {
+		size_t lo = 0;
+		size_t hi = symbol_index_count;
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			int c = strcmp(symbol_index[mid]->name, name);
+			if (c == 0) {
+				return (void (*)(void))symbol_index[mid]->addr;
+			} else if (c < 0) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		return NULL;
+	}
+
+	/* Early boot: the index isn't built yet, walk the raw table */
 	kernel_symbol_t * k = (kernel_symbol_t *)&kernel_symbols_start;
 
 	while ((uintptr_t)k < (uintptr_t)&kernel_symbols_end) {
@@ -41,6 +144,69 @@ void (* symbol_find(const char * name))(void) {
 	return NULL;
 }
 
+/*
+ * Boot-time concurrent initialization. Loading and relocating stays
+ * sequential (it's fast, in-memory work), but initialize() routines
+ * spend most of boot sleeping on hardware - ATA probes, timeouts -
+ * so while module_init_async is set they run in per-module tasklets.
+ * Each tasklet waits for the module's declared dependencies to finish
+ * initializing first, which keeps moddeps ordering intact.
+ */
+int module_init_async = 0;
+static volatile int mods_pending = 0;
+static list_t * mods_barrier = NULL;
+
+static void module_init_task(void * data, char * name) {
+	module_data_t * mod = (module_data_t *)data;
+
+	if (mod->deps) {
+		unsigned int i = 0;
+		while (i < mod->deps_length) {
+			if (strlen(&mod->deps[i])) {
+				module_data_t * dep = hashmap_get(modules, &mod->deps[i]);
+				while (dep && !dep->initialized) {
+					unsigned long s, ss;
+					relative_time(0, 10, &s, &ss);
+					sleep_until((process_t *)current_process, s, ss);
+					switch_task(0);
+				}
+			}
+			i += strlen(&mod->deps[i]) + 1;
+		}
+	}
+
+	mod->mod_info->initialize();
+	mod->initialized = 1;
+	debug_print(NOTICE, "Finished loading module %s", mod->mod_info->name);
+	{
+		char mark[BOOT_MARK_NAME];
+		sprintf(mark, "module %s", mod->mod_info->name);
+		boot_mark(mark);
+	}
+
+	IRQ_OFF;
+	mods_pending--;
+	wakeup_queue(mods_barrier);
+	IRQ_RES;
+	kexit(0);
+}
+
+/*
+ * Wait for every deferred module init to finish before boot moves on
+ * to things that need the drivers (mounting root, starting init).
+ */
+void modules_init_barrier(void) {
+	while (1) {
+		IRQ_OFF;
+		if (mods_pending) {
+			sleep_on(mods_barrier);
+		} else {
+			IRQ_RES;
+			return;
+		}
+	}
+}
+
 int module_quickcheck(void * blob) {
 
 	Elf32_Header * target = (Elf32_Header *)blob;
@@ -214,6 +380,7 @@ void * module_load_direct(void * blob, size_t length) {
 							uintptr_t final = s->sh_addr + table->st_value;
 							hashmap_set(symboltable, name, (void *)final);
 							hashmap_set(local_symbols, name, (void *)final);
+							ksym_insert(final, name);
 						}
 					}
 				}
@@ -293,10 +460,6 @@ void * module_load_direct(void * blob, size_t length) {
 		goto mod_load_error;
 	}
 
-	mod_info->initialize();
-
-	debug_print(NOTICE, "Finished loading module %s", mod_info->name);
-
 	/* We don't do this anymore
 	 * TODO: Do this in the module unload function
 	hashmap_free(local_symbols);
@@ -310,9 +473,27 @@ void * module_load_direct(void * blob, size_t length) {
 	mod_data->end      = (uintptr_t)target + length;
 	mod_data->deps     = deps;
 	mod_data->deps_length = deps_length;
+	mod_data->initialized = 0;
 
+	/* Registered before init so dependents can find us */
 	hashmap_set(modules, mod_info->name, (void *)mod_data);
 
+	if (module_init_async) {
+		IRQ_OFF;
+		mods_pending++;
+		IRQ_RES;
+		create_kernel_tasklet(module_init_task, "[modinit]", mod_data);
+	} else {
+		mod_info->initialize();
+		mod_data->initialized = 1;
+		debug_print(NOTICE, "Finished loading module %s", mod_info->name);
+		{
+			char mark[BOOT_MARK_NAME];
+			sprintf(mark, "module %s", mod_info->name);
+			boot_mark(mark);
+		}
+	}
+
 	return mod_data;
 
 mod_load_error_unload:
@@ -364,20 +545,51 @@ void modules_install(void) {
 	/* Initialize the symboltable, we use a hashmap of symbols to addresses  */
 	symboltable = hashmap_create(SYMBOLTABLE_HASHMAP_SIZE);
 
-	/* Load all of the kernel symbols into the symboltable */
+	/* Count the kernel exports so the index can be sized up front */
+	size_t count = 0;
 	kernel_symbol_t * k = (kernel_symbol_t *)&kernel_symbols_start;
+	while ((uintptr_t)k < (uintptr_t)&kernel_symbols_end) {
+		count++;
+		k = (kernel_symbol_t *)((uintptr_t)k + sizeof(kernel_symbol_t) + strlen(k->name) + 1);
+	}
+
+	kernel_symbol_t ** index = malloc(sizeof(kernel_symbol_t *) * count);
+
+	/* Load all of the kernel symbols into the symboltable, and
+	 * insertion-sort them into the lookup index as we go */
+	k = (kernel_symbol_t *)&kernel_symbols_start;
 
 	while ((uintptr_t)k < (uintptr_t)&kernel_symbols_end) {
 		hashmap_set(symboltable, k->name, (void *)k->addr);
+		ksym_insert(k->addr, k->name);
+
+		size_t lo = 0;
+		size_t hi = symbol_index_count;
+		while (lo < hi) {
+			size_t mid = (lo + hi) / 2;
+			if (strcmp(index[mid]->name, k->name) < 0) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		memmove(&index[lo + 1], &index[lo], (symbol_index_count - lo) * sizeof(kernel_symbol_t *));
+		index[lo] = k;
+		symbol_index_count++;
+
 		k = (kernel_symbol_t *)((uintptr_t)k + sizeof(kernel_symbol_t) + strlen(k->name) + 1);
 	}
 
+	symbol_index = index;
+
 	/* Also add the kernel_symbol_start and kernel_symbol_end (these were excluded from the generator) */
 	hashmap_set(symboltable, "kernel_symbols_start", &kernel_symbols_start);
 	hashmap_set(symboltable, "kernel_symbols_end",   &kernel_symbols_end);
 
 	/* Initialize the module name -> object hashmap */
 	modules = hashmap_create(MODULE_HASHMAP_SIZE);
+
+	mods_barrier = list_create();
 }
 
 /* Accessors. */
@@ -17,17 +17,23 @@
 #include <bitset.h>
 #include <logging.h>
 #include <shm.h>
+#include <mmap.h>
 #include <printf.h>
+#include <hashmap.h>
+#include <kcache.h>
 
 tree_t * process_tree;  /* Parent->Children tree */
 list_t * process_list;  /* Flat storage */
-list_t * process_queue; /* Ready queue */
-list_t * sleep_queue;
+static hashmap_t * process_hash; /* PID -> process_t, for O(1) lookups */
+static kcache_t * process_cache;  /* Recycled process_t allocations */
+kcpu_t scheduler_cpus[MAX_CPUS]; /* Per-CPU run queues */
+int scheduler_cpu_count = 1;     /* Only the boot CPU for now */
+timerwheel_t * sleep_wheel; /* Timer wheel for sleeping processes */
 volatile process_t * current_process = NULL;
 process_t * kernel_idle_task = NULL;
 
 static spin_lock_t tree_lock = { 0 };
-static spin_lock_t process_queue_lock = { 0 };
+static spin_lock_t process_queue_locks[MAX_CPUS];
 static spin_lock_t wait_lock_tmp = { 0 };
 static spin_lock_t sleep_lock = { 0 };
 
@@ -42,14 +48,30 @@ char * default_name = "[unnamed]";
  */
 #define MAX_PID 32768
 
+/*
+ * Which CPU are we running on?
+ * Always the boot CPU until SMP bringup reads an APIC ID here.
+ */
+kcpu_t * cpu_current(void) {
+	return &scheduler_cpus[0];
+}
+
 /*
  * Initialize the process tree and ready queue.
  */
 void initialize_process_tree(void) {
 	process_tree = tree_create();
 	process_list = list_create();
-	process_queue = list_create();
-	sleep_queue = list_create();
+	process_hash = hashmap_create_int(64);
+	process_cache = kcache_create("process_t", sizeof(process_t), 32);
+	for (int c = 0; c < MAX_CPUS; ++c) {
+		scheduler_cpus[c].index = c;
+		scheduler_cpus[c].online = (c == 0);
+		for (int i = 0; i < PROCESS_PRIORITY_LEVELS; ++i) {
+			scheduler_cpus[c].queues[i] = list_create();
+		}
+	}
+	sleep_wheel = timerwheel_create(0);
 
 	/* Start off with enough bits for 64 processes */
 	bitset_init(&pid_set, MAX_PID / 8);
@@ -88,9 +110,9 @@ void debug_print_process_tree_node(tree_node_t * node, size_t height) {
 	/* Linefeed */
 	debug_print(NOTICE, "%s", tmp);
 	free(tmp);
-	foreach(child, node->children) {
+	foreach_child(child, node) {
 		/* Recursively print the children */
-		debug_print_process_tree_node(child->value, height + 1);
+		debug_print_process_tree_node(child, height + 1);
 	}
 }
 
@@ -107,21 +129,49 @@ void debug_print_process_tree(void) {
  *
  * @return A pointer to the next process in the queue.
  */
-process_t * next_ready_process(void) {
-	if (!process_available()) {
-		return kernel_idle_task;
+/*
+ * Pop the best process off of one CPU's run queues, or NULL.
+ */
+static process_t * dequeue_ready_process(kcpu_t * cpu) {
+	if (!cpu->ready_bitmap) {
+		return NULL;
 	}
-	if (process_queue->head->owner != process_queue) {
-		debug_print(ERROR, "Erroneous process located in process queue: node 0x%x has owner 0x%x, but process_queue is 0x%x", process_queue->head, process_queue->head->owner, process_queue);
+	spin_lock(process_queue_locks[cpu->index]);
+	/* Find the highest-priority non-empty level in O(1) */
+	int level = __builtin_ctz(cpu->ready_bitmap);
+	list_t * queue = cpu->queues[level];
+	if (queue->head->owner != queue) {
+		debug_print(ERROR, "Erroneous process located in process queue: node 0x%x has owner 0x%x, but ready queue %d is 0x%x", queue->head, queue->head->owner, level, queue);
 
-		process_t * proc = process_queue->head->value;
+		process_t * proc = queue->head->value;
 
 		debug_print(ERROR, "PID associated with this node is %d", proc->id);
 	}
-	node_t * np = list_dequeue(process_queue);
+	node_t * np = list_dequeue(queue);
 	assert(np && "Ready queue is empty.");
-	process_t * next = np->value;
-	return next;
+	if (!queue->head) {
+		cpu->ready_bitmap &= ~(1 << level);
+	}
+	spin_unlock(process_queue_locks[cpu->index]);
+	return np->value;
+}
+
+process_t * next_ready_process(void) {
+	kcpu_t * cpu = cpu_current();
+	process_t * next = dequeue_ready_process(cpu);
+	if (next) {
+		return next;
+	}
+	/* Nothing local; try to steal from another online CPU */
+	for (int c = 0; c < scheduler_cpu_count; ++c) {
+		if (c == cpu->index || !scheduler_cpus[c].online) continue;
+		next = dequeue_ready_process(&scheduler_cpus[c]);
+		if (next) {
+			next->cpu = cpu->index;
+			return next;
+		}
+	}
+	return cpu->idle ? cpu->idle : kernel_idle_task;
 }
 
 /*
@@ -131,16 +181,17 @@ process_t * next_ready_process(void) {
  */
 void make_process_ready(process_t * proc) {
 	if (proc->sleep_node.owner != NULL) {
-		if (proc->sleep_node.owner == sleep_queue) {
+		if (proc->sleep_node.owner == sleep_wheel) {
 			/* XXX can't wake from timed sleep */
 			if (proc->timed_sleep_node) {
 				IRQ_OFF;
 				spin_lock(sleep_lock);
-				list_delete(sleep_queue, proc->timed_sleep_node);
+				free(proc->timed_sleep_node->extra);
+				timerwheel_cancel(sleep_wheel, proc->timed_sleep_node);
 				spin_unlock(sleep_lock);
 				IRQ_RES;
 				proc->sleep_node.owner = NULL;
-				free(proc->timed_sleep_node->value);
+				proc->timed_sleep_node = NULL;
 			}
 			/* Else: I have no idea what happened. */
 		} else {
@@ -152,12 +203,20 @@ void make_process_ready(process_t * proc) {
 	}
 	if (proc->sched_node.owner) {
 		debug_print(WARNING, "Can't make process ready without removing from owner list: %d", proc->id);
-		debug_print(WARNING, "  (This is a bug) Current owner list is 0x%x (ready queue is 0x%x)", proc->sched_node.owner, process_queue);
+		debug_print(WARNING, "  (This is a bug) Current owner list is 0x%x", proc->sched_node.owner);
 		return;
 	}
-	spin_lock(process_queue_lock);
-	list_append(process_queue, &proc->sched_node);
-	spin_unlock(process_queue_lock);
+	if (proc->priority >= PROCESS_PRIORITY_LEVELS) {
+		proc->priority = PROCESS_PRIORITY_LEVELS - 1;
+	}
+	if (proc->cpu >= scheduler_cpu_count || !scheduler_cpus[proc->cpu].online) {
+		proc->cpu = 0;
+	}
+	kcpu_t * cpu = &scheduler_cpus[proc->cpu];
+	spin_lock(process_queue_locks[cpu->index]);
+	list_append(cpu->queues[proc->priority], &proc->sched_node);
+	cpu->ready_bitmap |= (1 << proc->priority);
+	spin_unlock(process_queue_locks[cpu->index]);
 }
 
 
@@ -187,18 +246,29 @@ void delete_process(process_t * proc) {
 	/* Reparent everyone below me to init */
 	tree_remove_reparent_root(process_tree, entry);
 	list_delete(process_list, list_find(process_list, proc));
+	hashmap_remove(process_hash, (void *)(uintptr_t)proc->id);
 	spin_unlock(tree_lock);
 
 	bitset_clear(&pid_set, proc->id);
 
 	/* Uh... */
-	free(proc);
+	kcache_free(process_cache, proc);
 }
 
 static void _kidle(void) {
 	while (1) {
+		IRQ_OFF;
+		if (!process_available()) {
+			/* Nothing to run; stretch the timer to the next deadline */
+			timer_idle_tickless();
+		}
 		IRQ_ON;
 		PAUSE;
+		/* If a device interrupt (not the timer) woke us, put the
+		 * regular tick back so the new work gets scheduled promptly. */
+		IRQ_OFF;
+		timer_tickless_cancel();
+		IRQ_ON;
 	}
 }
 
@@ -211,6 +281,8 @@ process_t * spawn_kidle(void) {
 	idle->id = -1;
 	idle->name = strdup("[kidle]");
 	idle->is_tasklet = 1;
+	idle->priority = PRIORITY_IDLE;
+	cpu_current()->idle = idle;
 
 	idle->image.stack = (uintptr_t)malloc(KERNEL_STACK_SIZE) + KERNEL_STACK_SIZE;
 	idle->thread.eip  = (uintptr_t)&_kidle;
@@ -269,15 +341,18 @@ process_t * spawn_init(void) {
 	init->image.user_stack  = 0;
 	init->image.size        = 0;
 	init->image.shm_heap    = SHM_START; /* Yeah, a bit of a hack. */
+	init->image.mmap_heap   = MMAP_START;
 
 	spin_init(init->image.lock);
 
 	/* Process is not finished */
 	init->finished = 0;
+	init->awaited  = 0;
 	init->started = 1;
 	init->running = 1;
 	init->wait_queue = list_create();
 	init->shm_mappings = list_create();
+	init->mmaps = list_create();
 	init->signal_queue = list_create();
 	init->signal_kstack = NULL; /* None yet initialized */
 
@@ -285,11 +360,19 @@ process_t * spawn_init(void) {
 	init->sched_node.next = NULL;
 	init->sched_node.value = init;
 
+	init->priority = PRIORITY_DEFAULT;
+	init->cpu = 0;
+	init->slice_remaining = 0;
+	init->cpu_total  = 0;
+	init->cpu_recent = 0;
+	init->sched_in   = 0;
+
 	init->sleep_node.prev = NULL;
 	init->sleep_node.next = NULL;
 	init->sleep_node.value = init;
 
 	init->timed_sleep_node = NULL;
+	init->node_waits = NULL;
 
 	init->is_tasklet = 0;
 
@@ -298,6 +381,7 @@ process_t * spawn_init(void) {
 	/* What the hey, let's also set the description on this one */
 	init->description = strdup("[init]");
 	list_insert(process_list, (void *)init);
+	hashmap_set(process_hash, (void *)(uintptr_t)init->id, (void *)init);
 
 	return init;
 }
@@ -310,20 +394,24 @@ process_t * spawn_init(void) {
 static int _next_pid = 2;
 pid_t get_next_pid(void) {
 	if (_next_pid > MAX_PID) {
-		int index = bitset_ffub(&pid_set);
-		/*
-		 * Honestly, we don't have the memory to really risk reaching
-		 * the point where we have MAX_PID processes running
-		 * concurrently, so this assertion should be "safe enough".
-		 */
-		assert(index != -1);
-		bitset_set(&pid_set, index);
+		/* Claim the bit atomically; if someone beat us to this PID,
+		 * just scan again from the next one. */
+		int index = 0;
+		do {
+			index = bitset_ffub_raw(pid_set.data, pid_set.size, index);
+			/*
+			 * Honestly, we don't have the memory to really risk reaching
+			 * the point where we have MAX_PID processes running
+			 * concurrently, so this assertion should be "safe enough".
+			 */
+			assert(index != -1);
+		} while (bitset_test_and_set(&pid_set, index));
 		return index;
 	}
 	int pid = _next_pid;
 	_next_pid++;
-	assert(!bitset_test(&pid_set, pid) && "Next PID already allocated?");
-	bitset_set(&pid_set, pid);
+	int was_set = bitset_test_and_set(&pid_set, pid);
+	assert(!was_set && "Next PID already allocated?");
 	return pid;
 }
 
@@ -354,7 +442,8 @@ process_t * spawn_process(volatile process_t * parent, int reuse_fds) {
 
 	/* Allocate a new process */
 	debug_print(INFO,"   process_t {");
-	process_t * proc = calloc(sizeof(process_t),1);
+	process_t * proc = kcache_alloc(process_cache);
+	memset(proc, 0x00, sizeof(process_t));
 	debug_print(INFO,"   }");
 	proc->id = get_next_pid(); /* Set its PID */
 	proc->group = proc->id;    /* Set the GID */
@@ -386,6 +475,7 @@ process_t * spawn_process(volatile process_t * parent, int reuse_fds) {
 	debug_print(INFO,"    }");
 	proc->image.user_stack  = parent->image.user_stack;
 	proc->image.shm_heap    = SHM_START; /* Yeah, a bit of a hack. */
+	proc->image.mmap_heap   = parent->image.mmap_heap;
 
 	spin_init(proc->image.lock);
 
@@ -422,6 +512,16 @@ process_t * spawn_process(volatile process_t * parent, int reuse_fds) {
 	memset(proc->signals.functions, 0x00, sizeof(uintptr_t) * NUMSIGNALS);
 	proc->wait_queue = list_create();
 	proc->shm_mappings = list_create();
+
+	/* File mappings carry over so the child can fault in unmapped pages */
+	proc->mmaps = list_create();
+	foreach(node, parent->mmaps) {
+		mmap_region_t * region = malloc(sizeof(mmap_region_t));
+		memcpy(region, node->value, sizeof(mmap_region_t));
+		open_fs(region->node, 0);
+		list_insert(proc->mmaps, region);
+	}
+
 	proc->signal_queue = list_create();
 	proc->signal_kstack = NULL; /* None yet initialized */
 
@@ -429,6 +529,10 @@ process_t * spawn_process(volatile process_t * parent, int reuse_fds) {
 	proc->sched_node.next = NULL;
 	proc->sched_node.value = proc;
 
+	/* Children inherit their parent's scheduling priority and home CPU */
+	proc->priority = parent->priority;
+	proc->cpu = parent->cpu;
+
 	proc->sleep_node.prev = NULL;
 	proc->sleep_node.next = NULL;
 	proc->sleep_node.value = proc;
@@ -445,6 +549,7 @@ process_t * spawn_process(volatile process_t * parent, int reuse_fds) {
 	spin_lock(tree_lock);
 	tree_node_insert_child_node(process_tree, parent->tree_entry, entry);
 	list_insert(process_list, (void *)proc);
+	hashmap_set(process_hash, (void *)(uintptr_t)proc->id, (void *)proc);
 	spin_unlock(tree_lock);
 
 	/* Return the new process */
@@ -462,12 +567,9 @@ process_t * process_from_pid(pid_t pid) {
 	if (pid < 0) return NULL;
 
 	spin_lock(tree_lock);
-	tree_node_t * entry = tree_find(process_tree,&pid,process_compare);
+	process_t * result = hashmap_get(process_hash, (void *)(uintptr_t)pid);
 	spin_unlock(tree_lock);
-	if (entry) {
-		return (process_t *)entry->value;
-	}
-	return NULL;
+	return result;
 }
 
 process_t * process_get_parent(process_t * process) {
@@ -539,7 +641,12 @@ void set_process_environment(process_t * proc, page_directory_t * directory) {
  * @return 1 if there are processes available, 0 otherwise
  */
 uint8_t process_available(void) {
-	return (process_queue->head != NULL);
+	for (int c = 0; c < scheduler_cpu_count; ++c) {
+		if (scheduler_cpus[c].online && scheduler_cpus[c].ready_bitmap) {
+			return 1;
+		}
+	}
+	return 0;
 }
 
 /*
@@ -591,6 +698,70 @@ uint32_t process_move_fd(process_t * proc, int src, int dest) {
 	return dest;
 }
 
+/*
+ * Deferred wakeup ring: a lock-free MPSC channel from interrupt
+ * handlers to the scheduler. IRQ context pushes the wait queue it
+ * wants woken (tagging the pointer's low bit for "interrupted"
+ * wakeups) with a single lock xadd; the scheduler drains the ring in
+ * task context where ordinary list surgery is safe.
+ */
+#define DEFERRED_WAKEUPS 64
+static list_t * volatile deferred_wakeups[DEFERRED_WAKEUPS];
+static volatile int deferred_head = 0;
+static int deferred_tail = 0;
+
+static inline int atomic_xadd(volatile int * ptr, int value) {
+	asm volatile ("lock; xaddl %0, %1" : "+r"(value), "+m"(*ptr) : : "memory");
+	return value;
+}
+
+static int wakeup_queue_deferred(list_t * queue, int interrupted) {
+	int slot = atomic_xadd((volatile int *)&deferred_head, 1) % DEFERRED_WAKEUPS;
+	if (deferred_wakeups[slot]) {
+		/* Ring wrapped before the scheduler could drain it; this
+		 * entry is lost. Warn so we know to grow the ring. */
+		debug_print(ERROR, "Deferred wakeup ring overflow, dropping wakeup for 0x%x", queue);
+		return -1;
+	}
+	deferred_wakeups[slot] = (list_t *)((uintptr_t)queue | (interrupted ? 1 : 0));
+	return 0;
+}
+
+/*
+ * Wake all waiters on a queue from interrupt context.
+ * The actual list manipulation is deferred to the scheduler.
+ */
+int wakeup_queue_irq(list_t * queue) {
+	return wakeup_queue_deferred(queue, 0);
+}
+
+int wakeup_queue_irq_interrupted(list_t * queue) {
+	return wakeup_queue_deferred(queue, 1);
+}
+
+/*
+ * Drain the deferred wakeup ring. Called by the scheduler in task
+ * context; this is the only consumer.
+ */
+void process_run_deferred_wakeups(void) {
+	while (deferred_tail != deferred_head) {
+		int slot = deferred_tail % DEFERRED_WAKEUPS;
+		list_t * tagged = deferred_wakeups[slot];
+		if (!tagged) {
+			/* Producer has claimed the slot but not published yet */
+			break;
+		}
+		deferred_wakeups[slot] = NULL;
+		deferred_tail++;
+		list_t * queue = (list_t *)((uintptr_t)tagged & ~1);
+		if ((uintptr_t)tagged & 1) {
+			wakeup_queue_interrupted(queue);
+		} else {
+			wakeup_queue(queue);
+		}
+	}
+}
+
 int wakeup_queue(list_t * queue) {
 	int awoken_processes = 0;
 	while (queue->length > 0) {
@@ -641,32 +812,41 @@ int process_is_ready(process_t * proc) {
 }
 
 
+/*
+ * Timer wheel callback for an expired sleeper.
+ */
+static void sleeper_expired(void * argp) {
+	sleeper_t * sleeper = argp;
+	if (sleeper->is_fswait) {
+		process_alert_node(sleeper->process, sleeper);
+	} else {
+		process_t * process = sleeper->process;
+		process->sleep_node.owner = NULL;
+		process->timed_sleep_node = NULL;
+		if (!process_is_ready(process)) {
+			make_process_ready(process);
+		}
+	}
+	free(sleeper);
+}
+
 void wakeup_sleepers(unsigned long seconds, unsigned long subseconds) {
 	IRQ_OFF;
 	spin_lock(sleep_lock);
-	if (sleep_queue->length) {
-		sleeper_t * proc = ((sleeper_t *)sleep_queue->head->value);
-		while (proc && (proc->end_tick < seconds || (proc->end_tick == seconds && proc->end_subtick <= subseconds))) {
-
-			if (proc->is_fswait) {
-				process_alert_node(proc->process,proc);
-			} else {
-				process_t * process = proc->process;
-				process->sleep_node.owner = NULL;
-				process->timed_sleep_node = NULL;
-				if (!process_is_ready(process)) {
-					make_process_ready(process);
-				}
-			}
-			free(proc);
-			free(list_dequeue(sleep_queue));
-			if (sleep_queue->length) {
-				proc = ((sleeper_t *)sleep_queue->head->value);
-			} else {
-				break;
-			}
-		}
-	}
+	timerwheel_advance(sleep_wheel, (unsigned long long)seconds * SUBTICKS_PER_TICK + subseconds);
+	spin_unlock(sleep_lock);
+	IRQ_RES;
+}
+
+/*
+ * Run a function with the sleep wheel locked. Timer descriptors use
+ * this to arm and cancel their wheel entries race-free against an
+ * in-flight expiry.
+ */
+void ktimer_locked(void (*func)(void *), void * extra) {
+	IRQ_OFF;
+	spin_lock(sleep_lock);
+	func(extra);
 	spin_unlock(sleep_lock);
 	IRQ_RES;
 }
@@ -676,24 +856,16 @@ void sleep_until(process_t * process, unsigned long seconds, unsigned long subse
 		/* Can't sleep, sleeping already */
 		return;
 	}
-	process->sleep_node.owner = sleep_queue;
+	process->sleep_node.owner = sleep_wheel;
 
 	IRQ_OFF;
 	spin_lock(sleep_lock);
-	node_t * before = NULL;
-	foreach(node, sleep_queue) {
-		sleeper_t * candidate = ((sleeper_t *)node->value);
-		if (candidate->end_tick > seconds || (candidate->end_tick == seconds && candidate->end_subtick > subseconds)) {
-			break;
-		}
-		before = node;
-	}
 	sleeper_t * proc = malloc(sizeof(sleeper_t));
 	proc->process     = process;
 	proc->end_tick    = seconds;
 	proc->end_subtick = subseconds;
 	proc->is_fswait = 0;
-	process->timed_sleep_node = list_insert_after(sleep_queue, before, proc);
+	process->timed_sleep_node = timerwheel_insert(sleep_wheel, (unsigned long long)seconds * SUBTICKS_PER_TICK + subseconds, sleeper_expired, proc);
 	spin_unlock(sleep_lock);
 	IRQ_RES;
 }
@@ -710,6 +882,8 @@ void cleanup_process(process_t * proc, int retval) {
 	debug_print(INFO, "Releasing shared memory for %d", proc->id);
 	shm_release_all(proc);
 	free(proc->shm_mappings);
+	mmap_release_all(proc);
+	free(proc->mmaps);
 	debug_print(INFO, "Freeing more mems %d", proc->id);
 	if (proc->signal_kstack) {
 		free(proc->signal_kstack);
@@ -736,6 +910,49 @@ void cleanup_process(process_t * proc, int retval) {
 	}
 }
 
+/*
+ * Deferred reaping: waitpid() only needs the exit status, so the
+ * actual teardown (tree surgery, freeing the process) is handed to a
+ * kernel worker that drains whole batches of zombies at once.
+ */
+static list_t * reap_queue = NULL;
+static list_t * reaper_wait = NULL;
+static spin_lock_t reap_lock = { 0 };
+
+static void reaper_task(void * argp, char * name) {
+	(void)argp; (void)name;
+	while (1) {
+		spin_lock(reap_lock);
+		node_t * node = list_dequeue(reap_queue);
+		spin_unlock(reap_lock);
+		if (node) {
+			process_t * proc = node->value;
+			free(node);
+			reap_process(proc);
+		} else {
+			sleep_on(reaper_wait);
+		}
+	}
+}
+
+void reaper_install(void) {
+	reap_queue  = list_create();
+	reaper_wait = list_create();
+	create_kernel_tasklet(reaper_task, "[reaper]", NULL);
+}
+
+void reap_process_later(process_t * proc) {
+	if (!reap_queue) {
+		/* Worker not up yet; reap synchronously */
+		reap_process(proc);
+		return;
+	}
+	spin_lock(reap_lock);
+	list_insert(reap_queue, proc);
+	spin_unlock(reap_lock);
+	wakeup_queue(reaper_wait);
+}
+
 void reap_process(process_t * proc) {
 	debug_print(INFO, "Reaping process %d; mem before = %d", proc->id, memory_use());
 	free(proc->name);
@@ -777,11 +994,16 @@ int waitpid(int pid, int * status, int options) {
 		int has_children = 0;
 
 		/* First, find out if there is anyone to reap */
-		foreach(node, proc->tree_entry->children) {
+		foreach_child(node, proc->tree_entry) {
 			if (!node->value) {
 				continue;
 			}
-			process_t * child = ((tree_node_t *)node->value)->value;
+			process_t * child = node->value;
+			if (child->awaited) {
+				/* Already collected; the reaper just hasn't gotten
+				 * around to tearing it down yet. */
+				continue;
+			}
 
 			if (wait_candidate(proc, pid, options, child)) {
 				has_children = 1;
@@ -804,7 +1026,8 @@ int waitpid(int pid, int * status, int options) {
 				*status = candidate->status;
 			}
 			int pid = candidate->id;
-			reap_process(candidate);
+			candidate->awaited = 1;
+			reap_process_later(candidate);
 			return pid;
 		} else {
 			if (options & 1) {
@@ -846,7 +1069,8 @@ int process_wait_nodes(process_t * process,fs_node_t * nodes[], int timeout) {
 
 	n = nodes;
 
-	process->node_waits = list_create();
+	list_init(&process->node_waits_list);
+	process->node_waits = &process->node_waits_list;
 	if (*n) {
 		do {
 			if (selectwait_fs(*n, process) < 0) {
@@ -863,21 +1087,13 @@ int process_wait_nodes(process_t * process,fs_node_t * nodes[], int timeout) {
 
 		IRQ_OFF;
 		spin_lock(sleep_lock);
-		node_t * before = NULL;
-		foreach(node, sleep_queue) {
-			sleeper_t * candidate = ((sleeper_t *)node->value);
-			if (candidate->end_tick > s || (candidate->end_tick == s && candidate->end_subtick > ss)) {
-				break;
-			}
-			before = node;
-		}
 		sleeper_t * proc = malloc(sizeof(sleeper_t));
 		proc->process     = process;
 		proc->end_tick    = s;
 		proc->end_subtick = ss;
 		proc->is_fswait = 1;
 		list_insert(((process_t *)process)->node_waits, proc);
-		list_insert_after(sleep_queue, before, proc);
+		timerwheel_insert(sleep_wheel, (unsigned long long)s * SUBTICKS_PER_TICK + ss, sleeper_expired, proc);
 		spin_unlock(sleep_lock);
 		IRQ_RES;
 	}
@@ -891,8 +1107,8 @@ int process_wait_nodes(process_t * process,fs_node_t * nodes[], int timeout) {
 
 int process_awaken_from_fswait(process_t * process, int index) {
 	process->awoken_index = index;
+	/* The header is embedded in the process; only the nodes go back */
 	list_free(process->node_waits);
-	free(process->node_waits);
 	process->node_waits = NULL;
 	make_process_ready(process);
 	return 0;
@@ -221,7 +221,33 @@ int send_signal(pid_t process, uint32_t signal) {
 	}
 
 	list_insert(receiver->signal_queue, sig);
+	receiver->signals_pending |= (1ULL << signal);
 
 	return 0;
 }
 
+/*
+ * Take the first deliverable (not blocked) signal off the queue and
+ * refresh the pending bitmap from whatever remains. The bitmap is what
+ * the context switch path branches on, so it must never claim a signal
+ * the queue doesn't hold.
+ */
+signal_t * process_pop_signal(process_t * proc) {
+	signal_t * out = NULL;
+	foreach(node, proc->signal_queue) {
+		signal_t * sig = node->value;
+		if (!(proc->signals_blocked & (1ULL << sig->signum))) {
+			list_delete(proc->signal_queue, node);
+			free(node);
+			out = sig;
+			break;
+		}
+	}
+	uint64_t pending = 0;
+	foreach(node, proc->signal_queue) {
+		pending |= (1ULL << ((signal_t *)node->value)->signum);
+	}
+	proc->signals_pending = pending;
+	return out;
+}
+
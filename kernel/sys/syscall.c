@@ -8,15 +8,26 @@
  *
  */
 #include <system.h>
+#include <mem.h>
 #include <process.h>
 #include <logging.h>
 #include <fs.h>
 #include <pipe.h>
 #include <version.h>
 #include <shm.h>
+#include <mmap.h>
+#include <pagecache.h>
+#include <aio.h>
+#include <watch.h>
+#include <eventfd.h>
+#include <pollset.h>
+#include <socket.h>
 #include <utsname.h>
 #include <printf.h>
 #include <module.h>
+#include <trace.h>
+#include <syscallstats.h>
+#include <boottime.h>
 #include <syscall_nums.h>
 
 static char   hostname[256];
@@ -91,6 +102,52 @@ static int sys_readdir(int fd, int index, struct dirent * entry) {
 	return -1;
 }
 
+/* Matches struct iovec from newlib's sys/uio.h */
+struct iovec {
+	void * iov_base;
+	size_t iov_len;
+};
+
+static int sys_readv(int fd, struct iovec * iov, int iovcnt) {
+	if (!FD_CHECK(fd)) return -EBADF;
+	if (iovcnt < 0) return -EINVAL;
+	PTR_VALIDATE(iov);
+
+	fs_node_t * node = FD_ENTRY(fd);
+	uint32_t total = 0;
+	for (int i = 0; i < iovcnt; ++i) {
+		PTR_VALIDATE(iov[i].iov_base);
+		if (!iov[i].iov_len) continue;
+		uint32_t out = read_fs(node, node->offset, iov[i].iov_len, (uint8_t *)iov[i].iov_base);
+		node->offset += out;
+		total += out;
+		if (out < iov[i].iov_len) break;
+	}
+	return (int)total;
+}
+
+static int sys_writev(int fd, struct iovec * iov, int iovcnt) {
+	if (!FD_CHECK(fd)) return -EBADF;
+	if (iovcnt < 0) return -EINVAL;
+	PTR_VALIDATE(iov);
+
+	fs_node_t * node = FD_ENTRY(fd);
+	if (!has_permission(node, 02)) {
+		debug_print(WARNING, "access denied (writev, fd=%d)", fd);
+		return -EACCES;
+	}
+	uint32_t total = 0;
+	for (int i = 0; i < iovcnt; ++i) {
+		PTR_VALIDATE(iov[i].iov_base);
+		if (!iov[i].iov_len) continue;
+		uint32_t out = write_fs(node, node->offset, iov[i].iov_len, (uint8_t *)iov[i].iov_base);
+		node->offset += out;
+		total += out;
+		if (out < iov[i].iov_len) break;
+	}
+	return (int)total;
+}
+
 static int sys_write(int fd, char * ptr, int len) {
 	if (FD_CHECK(fd)) {
 		PTR_VALIDATE(ptr);
@@ -183,7 +240,9 @@ static int sys_sbrk(int size) {
 	while (proc->image.heap > proc->image.heap_actual) {
 		proc->image.heap_actual += 0x1000;
 		assert(proc->image.heap_actual % 0x1000 == 0);
-		alloc_frame(get_page(proc->image.heap_actual, 1, current_directory), 0, 1);
+		/* Back the new page with the shared zero page; a real frame is
+		 * allocated by the fault handler on first write. */
+		lazy_zero_frame(get_page(proc->image.heap_actual, 1, current_directory));
 		invalidate_tables_at(proc->image.heap_actual);
 	}
 	spin_unlock(proc->image.lock);
@@ -247,6 +306,7 @@ static int sys_execve(const char * filename, char *const argv[], char *const env
 	}
 	debug_print(INFO,"Releasing all shmem regions...");
 	shm_release_all((process_t *)current_process);
+	mmap_release_all((process_t *)current_process);
 
 	current_process->cmdline = argv_;
 
@@ -317,6 +377,33 @@ static int stat_node(fs_node_t * fn, uintptr_t st) {
 	return 0;
 }
 
+/*
+ * Batched directory listing: fill up to count dirent_stat records
+ * starting at index, stat'ing each entry against the open directory
+ * node directly. One syscall replaces a readdir plus a full path
+ * resolution per entry. Returns the number of records filled.
+ */
+static int sys_readdirstat(int fd, int index, int count, struct dirent_stat * entries) {
+	if (!FD_CHECK(fd)) return -EBADF;
+	if (count < 0) return -EINVAL;
+	PTR_VALIDATE(entries);
+
+	fs_node_t * dir = FD_ENTRY(fd);
+	int out = 0;
+	while (out < count) {
+		struct dirent * kentry = readdir_fs(dir, (uint32_t)(index + out));
+		if (!kentry) break;
+		memcpy(&entries[out].d, kentry, sizeof(struct dirent));
+		free(kentry);
+
+		fs_node_t * child = finddir_fs(dir, entries[out].d.name);
+		stat_node(child, (uintptr_t)&entries[out].st);
+		if (child) free(child);
+		out++;
+	}
+	return out;
+}
+
 static int sys_statf(char * file, uintptr_t st) {
 	int result;
 	PTR_VALIDATE(file);
@@ -353,6 +440,9 @@ static int sys_stat(int fd, uintptr_t st) {
 
 static int sys_mkpipe(void) {
 	fs_node_t * node = make_pipe(4096 * 2);
+	/* Userspace pipes may grow under bursty writers; device pipes
+	 * (keyboard, mouse) keep their fixed sizes. */
+	((pipe_device_t *)node->device)->max_size = 0x40000;
 	open_fs(node, 0);
 	return process_append_fd((process_t *)current_process, node);
 }
@@ -417,6 +507,8 @@ static int sys_reboot(void) {
 		return -1;
 	} else {
 		debug_print(NOTICE, "[kernel] Good bye!");
+		/* Flush anything the page cache is still holding */
+		pagecache_sync();
 		/* Goodbye, cruel world */
 		IRQ_OFF;
 		uint8_t out = 0x02;
@@ -574,6 +666,21 @@ static int sys_sysfunc(int fn, char ** args) {
 					}
 					return 0;
 				}
+			case 13:
+				/* Toggle kernel tracepoints; records are drained from /proc/trace */
+				return trace_set_enabled((int)args);
+			case 14:
+				/* Toggle timer-driven profiling samples (same rings) */
+				return trace_sample_set_enabled((int)args);
+			case 15:
+				/* Toggle syscall accounting; read back from /proc/syscalls */
+				return syscall_stats_set_enabled((int)args);
+			case 16:
+				/* Record a named boot milestone; read back from /proc/boottime */
+				if (!args) return -1;
+				PTR_VALIDATE(args);
+				boot_mark((char *)args);
+				return 0;
 		}
 	}
 	switch (fn) {
@@ -673,6 +780,94 @@ static int sys_fork(void) {
 	return (int)fork();
 }
 
+/*
+ * spawn() - fork+exec without the fork.
+ *
+ * The child is created as a kernel thread that immediately builds a
+ * fresh address space and exec()s the requested binary, so we never
+ * duplicate (or even COW-share) the parent's image just to throw it
+ * away. File descriptors and the working directory are inherited as
+ * they would be across fork().
+ */
+struct spawn_request {
+	char *  path;
+	int     argc;
+	char ** argv;
+	char ** envp;
+};
+
+static void spawn_entry(void * argp, char * name) {
+	(void)name;
+	struct spawn_request * req = argp;
+	char *  path = req->path;
+	int     argc = req->argc;
+	char ** argv = req->argv;
+	char ** envp = req->envp;
+	free(req);
+
+	/* Give the child its own directory before exec populates it */
+	set_process_environment((process_t *)current_process, clone_directory(kernel_directory));
+	current_directory = current_process->thread.page_directory;
+	switch_page_directory(current_directory);
+
+	current_process->is_tasklet = 0;
+	current_process->cmdline = argv;
+
+	exec(path, argc, argv, envp);
+	debug_print(ERROR, "spawn: failed to execute %s", path);
+	kexit(-1);
+}
+
+static int sys_spawn(const char * filename, char *const argv[], char *const envp[]) {
+	PTR_VALIDATE(argv);
+	PTR_VALIDATE(filename);
+	PTR_VALIDATE(envp);
+
+	debug_print(NOTICE, "%d spawning %s", current_process->id, filename);
+
+	int argc = 0;
+	int envc = 0;
+	while (argv[argc]) {
+		PTR_VALIDATE(argv[argc]);
+		++argc;
+	}
+	if (envp) {
+		while (envp[envc]) {
+			PTR_VALIDATE(envp[envc]);
+			++envc;
+		}
+	}
+
+	/* Copy everything to kernel space; the child runs in its own
+	 * address space and can not see our userspace pointers. */
+	char ** argv_ = malloc(sizeof(char *) * (argc + 1));
+	for (int j = 0; j < argc; ++j) {
+		argv_[j] = malloc((strlen(argv[j]) + 1) * sizeof(char));
+		memcpy(argv_[j], argv[j], strlen(argv[j]) + 1);
+	}
+	argv_[argc] = 0;
+	char ** envp_;
+	if (envp && envc) {
+		envp_ = malloc(sizeof(char *) * (envc + 1));
+		for (int j = 0; j < envc; ++j) {
+			envp_[j] = malloc((strlen(envp[j]) + 1) * sizeof(char));
+			memcpy(envp_[j], envp[j], strlen(envp[j]) + 1);
+		}
+		envp_[envc] = 0;
+	} else {
+		envp_ = malloc(sizeof(char *));
+		envp_[0] = NULL;
+	}
+
+	struct spawn_request * req = malloc(sizeof(struct spawn_request));
+	req->path = strdup(filename);
+	req->argc = argc;
+	req->argv = argv_;
+	req->envp = envp_;
+
+	return create_kernel_tasklet(spawn_entry, req->path, req);
+}
+
 static int sys_clone(uintptr_t new_stack, uintptr_t thread_func, uintptr_t arg) {
 	if (!new_stack || !PTR_INRANGE(new_stack)) return -1;
 	if (!thread_func || !PTR_INRANGE(thread_func)) return -1;
@@ -686,6 +881,136 @@ static int sys_shm_obtain(char * path, size_t * size) {
 	return (int)shm_obtain(path, size);
 }
 
+static int sys_shm_resize(char * path, size_t * size) {
+	PTR_VALIDATE(path);
+	PTR_VALIDATE(size);
+
+	return (int)shm_resize(path, size);
+}
+
+static int sys_mmap(int fd, unsigned int offset, unsigned int length, int prot, int flags) {
+	if (!FD_CHECK(fd)) {
+		return -EBADF;
+	}
+	/* Writable shared mappings aren't supported yet */
+	if ((flags & MAP_SHARED) && (prot & PROT_WRITE)) {
+		return -EINVAL;
+	}
+	return (int)mmap_map(FD_ENTRY(fd), offset, length, prot, flags);
+}
+
+static int sys_aio(void) {
+	fs_node_t * node = aio_create_context();
+	if (!node) return -1;
+	open_fs(node, 0);
+	return process_append_fd((process_t *)current_process, node);
+}
+
+/* Durability point: push a file's buffered dirty pages to the driver. */
+static int sys_fsync(int fd) {
+	if (!FD_CHECK(fd)) return -EBADF;
+	fs_node_t * node = FD_ENTRY(fd);
+	/* Page cache first, then let the filesystem push its write-back
+	 * cache and the device drain its queue; durability means the data
+	 * made it through every deferred layer, not just the first one. */
+	pagecache_sync_node(node);
+	if (node->ioctl) {
+		ioctl_fs(node, IOCTL_SYNC, NULL);
+	}
+	return 0;
+}
+
+/**
+ * Move up to `len` bytes from one descriptor to another through a
+ * kernel-resident buffer, so file-to-pipe and file-to-socket loops
+ * don't round-trip every chunk through userspace. Both descriptors
+ * advance their offsets; returns the number of bytes moved, which is
+ * short on end of file or when the sink stops accepting data.
+ */
+static int sys_splice(int fd_in, int fd_out, int len) {
+	if (!FD_CHECK(fd_in) || !FD_CHECK(fd_out)) return -EBADF;
+	if (len < 0) return -EINVAL;
+
+	fs_node_t * in  = FD_ENTRY(fd_in);
+	fs_node_t * out = FD_ENTRY(fd_out);
+
+	size_t chunk = 0x4000;
+	uint8_t * buf = malloc(chunk);
+	size_t total = 0;
+
+	while (total < (size_t)len) {
+		size_t want = (size_t)len - total;
+		if (want > chunk) want = chunk;
+		uint32_t r = read_fs(in, in->offset, want, buf);
+		if (!r) break;
+		in->offset += r;
+		uint32_t done = 0;
+		while (done < r) {
+			uint32_t w = write_fs(out, out->offset, r - done, buf + done);
+			if (!w) break;
+			out->offset += w;
+			done += w;
+		}
+		total += done;
+		if (done < r || r < want) break;
+	}
+
+	free(buf);
+	return (int)total;
+}
+
+static int sys_watch(void) {
+	fs_node_t * node = watch_create_context();
+	if (!node) return -1;
+	open_fs(node, 0);
+	return process_append_fd((process_t *)current_process, node);
+}
+
+static int sys_eventfd(unsigned int initial) {
+	fs_node_t * node = eventfd_create(initial);
+	if (!node) return -1;
+	open_fs(node, 0);
+	return process_append_fd((process_t *)current_process, node);
+}
+
+static int sys_timerfd(void) {
+	fs_node_t * node = timerfd_create();
+	if (!node) return -1;
+	open_fs(node, 0);
+	return process_append_fd((process_t *)current_process, node);
+}
+
+static int sys_pollset(void) {
+	fs_node_t * node = pollset_create();
+	if (!node) return -1;
+	open_fs(node, 0);
+	return process_append_fd((process_t *)current_process, node);
+}
+
+static int sys_socket(uint32_t type) {
+	fs_node_t * node = socket_create(type);
+	if (!node) return -EINVAL;
+	open_fs(node, 0);
+	return process_append_fd((process_t *)current_process, node);
+}
+
+static int sys_connect(int fd, uint32_t ip, uint32_t port) {
+	if (!FD_CHECK(fd)) return -EBADF;
+	return socket_connect(FD_ENTRY(fd), ip, (uint16_t)port);
+}
+
+static int sys_send(int fd, uint8_t * buffer, size_t size, int flags) {
+	if (!FD_CHECK(fd)) return -EBADF;
+	PTR_VALIDATE(buffer);
+	return write_fs(FD_ENTRY(fd), 0, size, buffer);
+}
+
+static int sys_recv(int fd, uint8_t * buffer, size_t size, int flags) {
+	if (!FD_CHECK(fd)) return -EBADF;
+	PTR_VALIDATE(buffer);
+	return read_fs(FD_ENTRY(fd), 0, size, buffer);
+}
+
 static int sys_shm_release(char * path) {
 	PTR_VALIDATE(path);
 
@@ -805,6 +1130,69 @@ static int sys_fswait(int c, int fds[]) {
 	return result;
 }
 
+/*
+ * Futex-style address-keyed waiting, so userspace locks can block
+ * instead of burning slices in a spin/yield loop.
+ *
+ * Queues are keyed by the physical address behind the user pointer so
+ * threads (shared directory) and shm-sharing processes (different
+ * virtual, same frame) both resolve to the same queue.
+ */
+static hashmap_t * futex_queues = NULL;
+
+static int sys_futex_wait(int * addr, int value) {
+	PTR_VALIDATE(addr);
+	uintptr_t phys = map_to_physical((uintptr_t)addr);
+	if (!phys) return -EFAULT;
+	if (!futex_queues) {
+		futex_queues = hashmap_create_int(16);
+	}
+	list_t * queue = hashmap_get(futex_queues, (void *)phys);
+	if (!queue) {
+		queue = list_create();
+		hashmap_set(futex_queues, (void *)phys, queue);
+	}
+	if (current_process->sleep_node.owner) {
+		/* Marked ready by someone; try again */
+		switch_task(0);
+		return -EAGAIN;
+	}
+	current_process->sleep_interrupted = 0;
+	/* The value check and the enqueue must be atomic with respect to
+	 * wakers or we can miss a wake and sleep forever. */
+	IRQ_OFF;
+	if (*addr != value) {
+		IRQ_RES;
+		return -EAGAIN;
+	}
+	list_append(queue, (node_t *)&current_process->sleep_node);
+	IRQ_RES;
+	switch_task(0);
+	return current_process->sleep_interrupted ? -EINTR : 0;
+}
+
+static int sys_futex_wake(int * addr, int count) {
+	PTR_VALIDATE(addr);
+	uintptr_t phys = map_to_physical((uintptr_t)addr);
+	if (!phys) return -EFAULT;
+	if (!futex_queues) return 0;
+	list_t * queue = hashmap_get(futex_queues, (void *)phys);
+	if (!queue) return 0;
+	int woken = 0;
+	IRQ_OFF;
+	while (count > 0 && queue->length > 0) {
+		node_t * node = list_pop(queue);
+		process_t * proc = node->value;
+		if (!proc->finished) {
+			make_process_ready(proc);
+			woken++;
+		}
+		count--;
+	}
+	IRQ_RES;
+	return woken;
+}
+
 static int sys_fswait_timeout(int c, int fds[], int timeout) {
 	PTR_VALIDATE(fds);
 	for (int i = 0; i < c; ++i) {
@@ -821,6 +1209,45 @@ static int sys_fswait_timeout(int c, int fds[], int timeout) {
 	return result;
 }
 
+/*
+ * Per-syscall accounting (see syscallstats.h). The table is allocated
+ * on first enable and zeroed on every enable, so each capture window
+ * starts fresh; /proc/syscalls reads it back whole.
+ */
+extern uint32_t num_syscalls;
+
+static syscall_stat_t * syscall_stats = NULL;
+static volatile int syscall_stats_enabled = 0;
+
+int syscall_stats_set_enabled(int enable) {
+	if (enable) {
+		if (!syscall_stats) {
+			syscall_stats = malloc(num_syscalls * sizeof(syscall_stat_t));
+		}
+		memset(syscall_stats, 0, num_syscalls * sizeof(syscall_stat_t));
+		syscall_stats_enabled = 1;
+		debug_print(NOTICE, "Syscall accounting enabled");
+	} else {
+		syscall_stats_enabled = 0;
+		debug_print(NOTICE, "Syscall accounting disabled");
+	}
+	return 0;
+}
+
+syscall_stat_t * syscall_stats_get(uint32_t * count) {
+	*count = syscall_stats ? num_syscalls : 0;
+	return syscall_stats;
+}
+
+static void syscall_stats_account(uint32_t num, unsigned long long delta) {
+	int bucket = 0;
+	while (delta >>= 1) bucket++;
+	if (bucket >= SYSCALL_HIST_BUCKETS) bucket = SYSCALL_HIST_BUCKETS - 1;
+	syscall_stat_t * stat = &syscall_stats[num];
+	stat->count++;
+	stat->buckets[bucket]++;
+}
+
 /*
  * System Call Internals
  */
@@ -875,6 +1302,25 @@ static int (*syscalls[])() = {
 	[SYS_LSTAT]        = sys_lstat,
 	[SYS_FSWAIT]       = sys_fswait,
 	[SYS_FSWAIT2]      = sys_fswait_timeout,
+	[SYS_SPAWN]        = sys_spawn,
+	[SYS_FUTEX_WAIT]   = sys_futex_wait,
+	[SYS_FUTEX_WAKE]   = sys_futex_wake,
+	[SYS_SHM_RESIZE]   = sys_shm_resize,
+	[SYS_MMAP]         = sys_mmap,
+	[SYS_READV]        = sys_readv,
+	[SYS_WRITEV]       = sys_writev,
+	[SYS_AIO]          = sys_aio,
+	[SYS_WATCH]        = sys_watch,
+	[SYS_READDIRSTAT]  = sys_readdirstat,
+	[SYS_FSYNC]        = sys_fsync,
+	[SYS_SPLICE]       = sys_splice,
+	[SYS_EVENTFD]      = sys_eventfd,
+	[SYS_TIMERFD]      = sys_timerfd,
+	[SYS_POLLSET]      = sys_pollset,
+	[SYS_SOCKET]       = sys_socket,
+	[SYS_CONNECT]      = sys_connect,
+	[SYS_SEND]         = sys_send,
+	[SYS_RECV]         = sys_recv,
 };
 
 uint32_t num_syscalls = sizeof(syscalls) / sizeof(*syscalls);
@@ -900,10 +1346,24 @@ void syscall_handler(struct regs * r) {
 		debug_print(WARNING, "[syscall trace] %d (0x%x) 0x%x 0x%x 0x%x 0x%x 0x%x", r->eax, location, r->ebx, r->ecx, r->edx, r->esi, r->edi);
 	}
 
+	trace_event(TRACE_SYSCALL_ENTER, r->eax);
+
+	unsigned long long entry = 0;
+	if (__builtin_expect(syscall_stats_enabled, 0)) {
+		entry = (unsigned long long)timer_ticks * SUBTICKS_PER_TICK + timer_subticks;
+	}
+
 	/* Call the syscall function */
 	scall_func func = (scall_func)location;
 	uint32_t ret = func(r->ebx, r->ecx, r->edx, r->esi, r->edi);
 
+	if (__builtin_expect(syscall_stats_enabled, 0)) {
+		unsigned long long now = (unsigned long long)timer_ticks * SUBTICKS_PER_TICK + timer_subticks;
+		syscall_stats_account(r->eax, now - entry);
+	}
+
+	trace_event(TRACE_SYSCALL_EXIT, r->eax);
+
 	if ((current_process->syscall_registers == r) ||
 			(location != (uintptr_t)&fork && location != (uintptr_t)&clone)) {
 		r->eax = ret;
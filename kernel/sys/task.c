@@ -12,6 +12,8 @@
 #include <logging.h>
 #include <shm.h>
 #include <mem.h>
+#include <trace.h>
+#include <kstats.h>
 
 #define TASK_MAGIC 0xDEADBEEF
 
@@ -46,7 +48,13 @@ clone_directory(
 	uint32_t i;
 	for (i = 0; i < 1024; ++i) {
 		/* Copy each table */
-		if (!src->tables[i] || (uintptr_t)src->tables[i] == (uintptr_t)0xFFFFFFFF) {
+		if (!src->tables[i]) {
+			continue;
+		}
+		if ((uintptr_t)src->tables[i] == (uintptr_t)0xFFFFFFFF) {
+			/* 4MB kernel mappings are shared, like kernel tables */
+			dir->tables[i] = src->tables[i];
+			dir->physical_tables[i] = src->physical_tables[i];
 			continue;
 		}
 		if (kernel_directory->tables[i] == src->tables[i]) {
@@ -62,6 +70,9 @@ clone_directory(
 			}
 		}
 	}
+	/* The source's writable pages just became copy-on-write; drop any
+	 * stale writable translations for them. */
+	invalidate_page_tables();
 	return dir;
 }
 
@@ -137,16 +148,15 @@ clone_table(
 		if (!src->pages[i].frame) {
 			continue;
 		}
-		/* Allocate a new frame */
-		alloc_frame(&table->pages[i], 0, 0);
-		/* Set the correct access bit */
-		if (src->pages[i].present)	table->pages[i].present = 1;
-		if (src->pages[i].rw)		table->pages[i].rw = 1;
-		if (src->pages[i].user)		table->pages[i].user = 1;
-		if (src->pages[i].writethrough)	table->pages[i].writethrough = 1;
-		if (src->pages[i].cachedisable)	table->pages[i].cachedisable = 1;
-		/* Copy the contents of the page from the old table to the new one */
-		copy_page_physical(src->pages[i].frame * 0x1000, table->pages[i].frame * 0x1000);
+		/* Share the frame copy-on-write instead of duplicating it;
+		 * writable pages are write-protected in both mappings and
+		 * copied lazily by the page fault handler on first write. */
+		if (src->pages[i].rw) {
+			src->pages[i].rw  = 0;
+			src->pages[i].cow = 1;
+		}
+		table->pages[i] = src->pages[i];
+		frame_ref(src->pages[i].frame);
 	}
 	return table;
 }
@@ -156,6 +166,10 @@ uintptr_t frozen_stack = 0;
 /*
  * Install multitasking functionality.
  */
+/* Registered in tasking_install; switch_next can run from the timer
+ * IRQ, which is no place for a first-use allocation. */
+static kstat_t * stat_switches = NULL;
+
 void tasking_install(void) {
 	IRQ_OFF; /* Disable interrupts */
 
@@ -175,6 +189,11 @@ void tasking_install(void) {
 
 	frozen_stack = (uintptr_t)valloc(KERNEL_STACK_SIZE);
 
+	/* Start the deferred-reap worker */
+	reaper_install();
+
+	stat_switches = kstat_register("sched.switches");
+
 	/* Reenable interrupts */
 	IRQ_RES;
 }
@@ -374,6 +393,9 @@ void switch_task(uint8_t reschedule) {
 		/* Tasking is not yet installed. */
 		return;
 	}
+	/* Process wakeups queued from interrupt handlers */
+	process_run_deferred_wakeups();
+
 	if (!current_process->running) {
 		switch_next();
 	}
@@ -390,11 +412,13 @@ void switch_task(uint8_t reschedule) {
 
 		/* XXX: Signals */
 		if (!current_process->finished) {
-			if (current_process->signal_queue->length > 0) {
-				node_t * node = list_dequeue(current_process->signal_queue);
-				signal_t * sig = node->value;
-				free(node);
-				handle_signal((process_t *)current_process, sig);
+			/* One branch on the common path; the queue is only
+			 * touched when the bitmap says something is deliverable */
+			if (current_process->signals_pending & ~current_process->signals_blocked) {
+				signal_t * sig = process_pop_signal((process_t *)current_process);
+				if (sig) {
+					handle_signal((process_t *)current_process, sig);
+				}
 			}
 		}
 
@@ -407,6 +431,23 @@ void switch_task(uint8_t reschedule) {
 	current_process->thread.ebp = ebp;
 	current_process->running = 0;
 
+	/* Account the CPU time we just used and adjust our standing:
+	 * processes that burn whole slices drift toward the batch queues,
+	 * processes that block early drift back toward interactive. */
+	unsigned long long now = (unsigned long long)timer_ticks * SUBTICKS_PER_TICK + timer_subticks;
+	unsigned long used = (unsigned long)(now - current_process->sched_in);
+	current_process->cpu_total += used;
+	current_process->cpu_recent = (3 * current_process->cpu_recent + used) / 4;
+	if (current_process != kernel_idle_task && !current_process->is_tasklet) {
+		if (reschedule && current_process->slice_remaining == 0) {
+			if (current_process->priority < PRIORITY_BATCH) {
+				current_process->priority++;
+			}
+		} else if (!reschedule && current_process->priority > PRIORITY_INTERACTIVE) {
+			current_process->priority--;
+		}
+	}
+
 	/* Save floating point state */
 	switch_fpu();
 
@@ -426,8 +467,19 @@ void switch_task(uint8_t reschedule) {
  */
 void switch_next(void) {
 	uintptr_t esp, ebp, eip;
+	process_t * outgoing = (process_t *)current_process;
+	if (stat_switches) KSTAT_INC(stat_switches);
 	/* Get the next available process */
 	current_process = next_ready_process();
+	cpu_current()->current = current_process;
+	/* Record the switch: the record's pid is the incoming process,
+	 * data is the one we are switching away from. */
+	trace_event(TRACE_SWITCH_TASK, outgoing ? outgoing->id : 0);
+	/* Start a fresh slice, scaled by where this process sits: the
+	 * more batch-like it has been, the longer (but rarer) its turns. */
+	static const uint8_t slice_for_priority[PROCESS_PRIORITY_LEVELS] = { 2, 5, 10, 10 };
+	current_process->slice_remaining = slice_for_priority[current_process->priority];
+	current_process->sched_in = (unsigned long long)timer_ticks * SUBTICKS_PER_TICK + timer_subticks;
 	/* Retreive the ESP/EBP/EIP */
 	eip = current_process->thread.eip;
 	esp = current_process->thread.esp;
@@ -453,7 +505,7 @@ void switch_next(void) {
 
 	if (current_process->started) {
 		if (!current_process->signal_kstack) {
-			if (current_process->signal_queue->length > 0) {
+			if (current_process->signals_pending & ~current_process->signals_blocked) {
 				current_process->signal_kstack  = malloc(KERNEL_STACK_SIZE);
 				current_process->signal_state.esp = current_process->thread.esp;
 				current_process->signal_state.eip = current_process->thread.eip;
@@ -21,6 +21,47 @@ static int __trace_ld = 0;
 
 typedef int (*entry_point_t)(int, char *[], char**);
 
+/*
+ * Prelink-style library cache.
+ *
+ * Loading a shared object means dozens of little fseek/fread round
+ * trips for the headers plus a full segment read, repeated by every
+ * process that starts. The first process to load an object publishes
+ * the clean loaded image (segments in place, bss zeroed) and the
+ * parsed metadata in a shared memory chunk keyed by the file's mtime;
+ * subsequent processes memcpy the image into place and relocate it
+ * without touching the filesystem at all.
+ *
+ * The relocated image itself can't be shared: COPY relocations and
+ * GLOB_DAT redirection bind library data to the running executable's
+ * copies, and load addresses are assigned per process. Relocation is
+ * cheap next to the I/O, so that part stays per-process.
+ */
+#define LD_CACHE_MAGIC 0x31444C50 /* 'PLD1' */
+#define LD_CACHE_RELS  8
+
+typedef struct {
+	uint32_t magic;
+	uint32_t mtime;
+	Elf32_Header header;
+	uintptr_t image_start;       /* Lowest loaded vaddr */
+	size_t image_size;
+	uintptr_t dynamic_vaddr;     /* 0 if the object has no dynamic section */
+	size_t n_rels;
+	struct {
+		uintptr_t vaddr;
+		size_t size;
+	} rels[LD_CACHE_RELS];
+	uintptr_t ctors_vaddr;
+	size_t ctors_count;
+	uintptr_t init_array_vaddr;
+	size_t init_array_count;
+	volatile uint32_t ready;     /* Written last; guards partially-built entries */
+} ld_cache_t;
+
+static int __ld_cache = 1;
+static int __ld_lazy  = 1;
+
 extern char end[];
 
 static hashmap_t * dumb_symbol_table;
@@ -57,6 +98,18 @@ typedef struct elf_object {
 
 	int loaded;
 
+	/* Cache state: mtime and image bounds for publishing, or the
+	 * published entry this object is being loaded from. */
+	uint32_t mtime;
+	uintptr_t image_start;
+	size_t image_size;
+	ld_cache_t * cache;
+
+	/* Lazy PLT binding */
+	uintptr_t * got;
+	uintptr_t plt_rel;
+	int lazy;
+
 } elf_t;
 
 static elf_t * _main_obj = NULL;
@@ -93,6 +146,58 @@ static char * find_lib(const char * file) {
 	return NULL;
 }
 
+/*
+ * Lazy binding: unresolved PLT entries point back at their push stub,
+ * which funnels through PLT0 into this resolver with the object (from
+ * GOT[1]) and the offset of the relocation on the stack. Resolve the
+ * symbol against whatever is loaded by now, patch the slot so later
+ * calls go straight through, and tail off into the target.
+ */
+uintptr_t _ld_resolve(elf_t * object, uintptr_t reloff) {
+	Elf32_Rel * rel = (Elf32_Rel *)(object->plt_rel + reloff);
+	Elf32_Sym * sym = &object->dyn_symbol_table[ELF32_R_SYM(rel->r_info)];
+	char * symname = (char *)((uintptr_t)object->dyn_string_table + sym->st_name);
+
+	uintptr_t x;
+	if (hashmap_has(dumb_symbol_table, symname)) {
+		x = (uintptr_t)hashmap_get(dumb_symbol_table, symname);
+	} else if (sym->st_shndx) {
+		x = sym->st_value + object->base;
+	} else {
+		TRACE_LD("Symbol not found: %s", symname);
+		x = 0x0;
+	}
+
+	memcpy((void *)(rel->r_offset + object->base), &x, sizeof(uintptr_t));
+	return x;
+}
+
+extern void _ld_resolve_stub(void);
+__asm__ (
+	".global _ld_resolve_stub\n"
+	"_ld_resolve_stub:\n"
+	"	pusha\n"
+	"	mov 32(%esp), %eax\n"  /* GOT[1]: the object */
+	"	mov 36(%esp), %ecx\n"  /* Relocation offset pushed by the stub */
+	"	push %ecx\n"
+	"	push %eax\n"
+	"	call _ld_resolve\n"
+	"	add $8, %esp\n"
+	"	mov %eax, 36(%esp)\n"  /* Park the target where we can ret to it */
+	"	popa\n"
+	"	add $4, %esp\n"
+	"	ret\n"
+);
+
+static int object_cache_key(const char * path, char * key) {
+	if (strlen(path) > 80) return 0;
+	sprintf(key, "ld.%s", path);
+	for (char * c = key; *c; ++c) {
+		if (*c == '/') *c = '_';
+	}
+	return 1;
+}
+
 static elf_t * open_object(const char * path) {
 
 	if (!path) {
@@ -109,6 +214,31 @@ static elf_t * open_object(const char * path) {
 	char * file = find_lib(path);
 	if (!file) return NULL;
 
+	struct stat stat_buf;
+	stat_buf.st_mtime = 0;
+	stat(file, &stat_buf);
+
+	/* A previous process may have published this object already; a
+	 * size of zero makes shm_obtain a pure existence probe. */
+	char key[100];
+	if (__ld_cache && object_cache_key(path, key)) {
+		size_t size = 0;
+		ld_cache_t * cache = (ld_cache_t *)syscall_shm_obtain(key, &size);
+		if (cache && size >= sizeof(ld_cache_t) && cache->ready &&
+		    cache->magic == LD_CACHE_MAGIC && cache->mtime == (uint32_t)stat_buf.st_mtime) {
+			TRACE_LD("Using cached image for %s", path);
+			free(file);
+			elf_t * object = calloc(1, sizeof(elf_t));
+			hashmap_set(objects_map, (void*)path, object);
+			object->cache = cache;
+			memcpy(&object->header, &cache->header, sizeof(Elf32_Header));
+			object->image_start = cache->image_start;
+			object->image_size = cache->image_size;
+			object->dependencies = list_create();
+			return object;
+		}
+	}
+
 	FILE * f = fopen(file, "r");
 
 	free(file);
@@ -125,6 +255,7 @@ static elf_t * open_object(const char * path) {
 	}
 
 	object->file = f;
+	object->mtime = (uint32_t)stat_buf.st_mtime;
 
 	size_t r = fread(&object->header, sizeof(Elf32_Header), 1, object->file);
 
@@ -149,6 +280,10 @@ static elf_t * open_object(const char * path) {
 
 static size_t object_calculate_size(elf_t * object) {
 
+	if (object->cache) {
+		return object->image_size;
+	}
+
 	uintptr_t base_addr = 0xFFFFFFFF;
 	uintptr_t end_addr  = 0x0;
 
@@ -180,6 +315,8 @@ static size_t object_calculate_size(elf_t * object) {
 	}
 
 	if (base_addr == 0xFFFFFFFF) return 0;
+	object->image_start = base_addr;
+	object->image_size  = end_addr - base_addr;
 	return end_addr - base_addr;
 }
 
@@ -189,6 +326,17 @@ static uintptr_t object_load(elf_t * object, uintptr_t base) {
 
 	object->base = base;
 
+	if (object->cache) {
+		ld_cache_t * cache = object->cache;
+		char * args[] = {(char *)(base + cache->image_start), (char *)cache->image_size};
+		syscall_system_function(10, args);
+		memcpy((void *)(base + cache->image_start), (char *)(cache + 1), cache->image_size);
+		if (cache->dynamic_vaddr) {
+			object->dynamic = (Elf32_Dyn *)(base + cache->dynamic_vaddr);
+		}
+		return base + cache->image_start + cache->image_size;
+	}
+
 	/* Load object */
 	{
 		size_t headers = 0;
@@ -235,7 +383,7 @@ static uintptr_t object_load(elf_t * object, uintptr_t base) {
 static int object_postload(elf_t * object) {
 
 	/* Load section string table */
-	{
+	if (object->file) {
 		Elf32_Shdr shdr;
 		fseek(object->file, object->header.e_shoff + object->header.e_shentsize * object->header.e_shstrndx, SEEK_SET);
 		fread(&shdr, object->header.e_shentsize, 1, object->file);
@@ -267,6 +415,12 @@ static int object_postload(elf_t * object) {
 				case 12:
 					object->init = (void (*)(void))(table->d_un.d_ptr + object->base);
 					break;
+				case 3: /* PLT GOT */
+					object->got = (uintptr_t *)(object->base + table->d_un.d_ptr);
+					break;
+				case 23: /* PLT relocations */
+					object->plt_rel = object->base + table->d_un.d_ptr;
+					break;
 			}
 			table++;
 		}
@@ -280,6 +434,26 @@ static int object_postload(elf_t * object) {
 			}
 			table++;
 		}
+
+		if (__ld_lazy && object->got && object->plt_rel) {
+			/* Wire the PLT's reserved slots so calls bind on first use */
+			object->got[1] = (uintptr_t)object;
+			object->got[2] = (uintptr_t)&_ld_resolve_stub;
+			object->lazy = 1;
+		}
+	}
+
+	if (object->cache) {
+		/* Section-derived addresses come from the cache header */
+		if (object->cache->ctors_count) {
+			object->ctors = (void *)(object->cache->ctors_vaddr + object->base);
+			object->ctors_size = object->cache->ctors_count;
+		}
+		if (object->cache->init_array_count) {
+			object->init_array = (void *)(object->cache->init_array_vaddr + object->base);
+			object->init_array_size = object->cache->init_array_count;
+		}
+		return 0;
 	}
 
 	size_t i = 0;
@@ -302,6 +476,38 @@ static int object_postload(elf_t * object) {
 	return 0;
 }
 
+/*
+ * Collect the relocation (SHT_REL) sections of an object, from the
+ * cache header when loading a cached image, otherwise from the
+ * section headers on disk.
+ */
+static size_t object_rel_sections(elf_t * object, uintptr_t * addrs, size_t * sizes) {
+	size_t count = 0;
+
+	if (object->cache) {
+		for (size_t i = 0; i < object->cache->n_rels; ++i) {
+			addrs[count] = object->cache->rels[i].vaddr;
+			sizes[count] = object->cache->rels[i].size;
+			count++;
+		}
+		return count;
+	}
+
+	for (uintptr_t x = 0; x < object->header.e_shentsize * object->header.e_shnum; x += object->header.e_shentsize) {
+		Elf32_Shdr shdr;
+		fseek(object->file, object->header.e_shoff + x, SEEK_SET);
+		fread(&shdr, object->header.e_shentsize, 1, object->file);
+
+		if (shdr.sh_type == 9 && count < LD_CACHE_RELS) {
+			addrs[count] = shdr.sh_addr;
+			sizes[count] = shdr.sh_size;
+			count++;
+		}
+	}
+
+	return count;
+}
+
 static int need_symbol_for_type(unsigned char type) {
 	switch(type) {
 		case 1:
@@ -336,19 +542,28 @@ static int object_relocate(elf_t * object) {
 		}
 	}
 
-	size_t i = 0;
-	for (uintptr_t x = 0; x < object->header.e_shentsize * object->header.e_shnum; x += object->header.e_shentsize) {
-		Elf32_Shdr shdr;
-		fseek(object->file, object->header.e_shoff + x, SEEK_SET);
-		fread(&shdr, object->header.e_shentsize, 1, object->file);
+	uintptr_t rel_addrs[LD_CACHE_RELS];
+	size_t rel_sizes[LD_CACHE_RELS];
+	size_t n_rels = object_rel_sections(object, rel_addrs, rel_sizes);
 
-		if (shdr.sh_type == 9) {
-			Elf32_Rel * table = (Elf32_Rel *)(shdr.sh_addr + object->base);
-			while ((uintptr_t)table - ((uintptr_t)shdr.sh_addr + object->base) < shdr.sh_size) {
+	for (size_t r = 0; r < n_rels; ++r) {
+		{
+			Elf32_Rel * table = (Elf32_Rel *)(rel_addrs[r] + object->base);
+			while ((uintptr_t)table - (rel_addrs[r] + object->base) < rel_sizes[r]) {
 				unsigned int  symbol = ELF32_R_SYM(table->r_info);
 				unsigned char type = ELF32_R_TYPE(table->r_info);
 				Elf32_Sym * sym = &object->dyn_symbol_table[symbol];
 
+				if (type == 7 && object->lazy) {
+					/* Point the slot back at its own push stub (adjusted
+					 * for where we loaded this); the resolver patches in
+					 * the real target the first time it's called. */
+					uintptr_t x = *((uintptr_t *)(table->r_offset + object->base)) + object->base;
+					memcpy((void *)(table->r_offset + object->base), &x, sizeof(uintptr_t));
+					table++;
+					continue;
+				}
+
 				char * symname = NULL;
 				uintptr_t x = sym->st_value + object->base;
 				if (need_symbol_for_type(type) || (type == 5)) {
@@ -402,29 +617,82 @@ static int object_relocate(elf_t * object) {
 }
 
 static void object_find_copy_relocations(elf_t * object) {
-	size_t i = 0;
-	for (uintptr_t x = 0; x < object->header.e_shentsize * object->header.e_shnum; x += object->header.e_shentsize) {
-		Elf32_Shdr shdr;
-		fseek(object->file, object->header.e_shoff + x, SEEK_SET);
-		fread(&shdr, object->header.e_shentsize, 1, object->file);
-
-		if (shdr.sh_type == 9) {
-			Elf32_Rel * table = (Elf32_Rel *)(shdr.sh_addr + object->base);
-			while ((uintptr_t)table - ((uintptr_t)shdr.sh_addr + object->base) < shdr.sh_size) {
-				unsigned char type = ELF32_R_TYPE(table->r_info);
-				if (type == 5) {
-					unsigned int  symbol = ELF32_R_SYM(table->r_info);
-					Elf32_Sym * sym = &object->dyn_symbol_table[symbol];
-					char * symname = (char *)((uintptr_t)object->dyn_string_table + sym->st_name);
-					hashmap_set(glob_dat, symname, (void *)table->r_offset);
-				}
-				table++;
+	uintptr_t rel_addrs[LD_CACHE_RELS];
+	size_t rel_sizes[LD_CACHE_RELS];
+	size_t n_rels = object_rel_sections(object, rel_addrs, rel_sizes);
+
+	for (size_t r = 0; r < n_rels; ++r) {
+		Elf32_Rel * table = (Elf32_Rel *)(rel_addrs[r] + object->base);
+		while ((uintptr_t)table - (rel_addrs[r] + object->base) < rel_sizes[r]) {
+			unsigned char type = ELF32_R_TYPE(table->r_info);
+			if (type == 5) {
+				unsigned int  symbol = ELF32_R_SYM(table->r_info);
+				Elf32_Sym * sym = &object->dyn_symbol_table[symbol];
+				char * symname = (char *)((uintptr_t)object->dyn_string_table + sym->st_name);
+				hashmap_set(glob_dat, symname, (void *)table->r_offset);
 			}
+			table++;
 		}
 	}
 
 }
 
+/*
+ * Publish a freshly loaded (but not yet relocated) object so later
+ * processes can skip the filesystem entirely. Races are benign: two
+ * processes loading the same object write identical bytes, and the
+ * ready flag goes up only after everything else is in place.
+ */
+static void object_cache_store(elf_t * object, const char * path) {
+	if (!__ld_cache || !object->file || !object->image_size) return;
+
+	char key[100];
+	if (!object_cache_key(path, key)) return;
+
+	ld_cache_t hdr;
+	memset(&hdr, 0, sizeof(ld_cache_t));
+	hdr.magic = LD_CACHE_MAGIC;
+	hdr.mtime = object->mtime;
+	memcpy(&hdr.header, &object->header, sizeof(Elf32_Header));
+	hdr.image_start = object->image_start;
+	hdr.image_size  = object->image_size;
+	if (object->dynamic) {
+		hdr.dynamic_vaddr = (uintptr_t)object->dynamic - object->base;
+	}
+	uintptr_t rel_addrs[LD_CACHE_RELS];
+	size_t rel_sizes[LD_CACHE_RELS];
+	hdr.n_rels = object_rel_sections(object, rel_addrs, rel_sizes);
+	for (size_t i = 0; i < hdr.n_rels; ++i) {
+		hdr.rels[i].vaddr = rel_addrs[i];
+		hdr.rels[i].size  = rel_sizes[i];
+	}
+	if (object->ctors) {
+		hdr.ctors_vaddr = (uintptr_t)object->ctors - object->base;
+		hdr.ctors_count = object->ctors_size;
+	}
+	if (object->init_array) {
+		hdr.init_array_vaddr = (uintptr_t)object->init_array - object->base;
+		hdr.init_array_count = object->init_array_size;
+	}
+
+	size_t size = sizeof(ld_cache_t) + object->image_size;
+	ld_cache_t * cache = (ld_cache_t *)syscall_shm_obtain(key, &size);
+	if (!cache || size < sizeof(ld_cache_t) + object->image_size) return;
+	if (cache->ready) return; /* Somebody else published it first */
+
+	/* The image span can have unallocated holes between segments;
+	 * make sure the whole range is mapped before copying out of it
+	 * (already-mapped pages are left alone). */
+	char * args[] = {(char *)(object->base + object->image_start), (char *)object->image_size};
+	syscall_system_function(10, args);
+
+	memcpy((char *)(cache + 1), (void *)(object->base + object->image_start), object->image_size);
+	memcpy(cache, &hdr, sizeof(ld_cache_t));
+	cache->ready = 1;
+
+	TRACE_LD("Published cache entry for %s", path);
+}
+
 static char * last_error = NULL;
 
 static void * object_find_symbol(elf_t * object, const char * symbol_name) {
@@ -465,6 +733,7 @@ static void * do_actual_load(const char * filename, elf_t * lib, int flags) {
 	object_load(lib, load_addr);
 
 	object_postload(lib);
+	object_cache_store(lib, filename);
 
 	node_t * item;
 	while (item = list_pop(lib->dependencies)) {
@@ -487,7 +756,7 @@ static void * do_actual_load(const char * filename, elf_t * lib, int flags) {
 	TRACE_LD("Relocating %s", filename);
 	object_relocate(lib);
 
-	fclose(lib->file);
+	if (lib->file) fclose(lib->file);
 
 	if (lib->ctors) {
 		for (size_t i = 0; i < lib->ctors_size; i++) {
@@ -565,6 +834,17 @@ int main(int argc, char * argv[]) {
 		__trace_ld = 1;
 	}
 
+	char * ld_no_cache = getenv("LD_NO_CACHE");
+	if (ld_no_cache && (!strcmp(ld_no_cache,"1") || !strcmp(ld_no_cache,"yes"))) {
+		__ld_cache = 0;
+	}
+
+	/* Latency-critical daemons can ask for everything up front */
+	char * ld_bind_now = getenv("LD_BIND_NOW");
+	if (ld_bind_now && (!strcmp(ld_bind_now,"1") || !strcmp(ld_bind_now,"yes"))) {
+		__ld_lazy = 0;
+	}
+
 	dumb_symbol_table = hashmap_create(10);
 	glob_dat = hashmap_create(10);
 	objects_map = hashmap_create(10);
@@ -586,6 +866,7 @@ int main(int argc, char * argv[]) {
 	size_t main_size = object_calculate_size(main_obj);
 	uintptr_t end_addr = object_load(main_obj, 0x0);
 	object_postload(main_obj);
+	object_cache_store(main_obj, file);
 
 	object_find_copy_relocations(main_obj);
 
@@ -617,10 +898,11 @@ int main(int argc, char * argv[]) {
 		TRACE_LD("Loading %s at 0x%x", lib_name, end_addr);
 		end_addr = object_load(lib, end_addr);
 		object_postload(lib);
+		object_cache_store(lib, lib_name);
 		TRACE_LD("Relocating %s", lib_name);
 		object_relocate(lib);
 
-		fclose(lib->file);
+		if (lib->file) fclose(lib->file);
 
 		/* Execute constructors */
 		if (lib->ctors || lib->init_array) {
@@ -34,8 +34,10 @@
 
 /* Bus mastering misc */
 /* Buffer descriptor list constants */
-#define AC97_BDL_LEN              32                    /* Buffer descriptor list length */
+#define AC97_BDL_LEN              32                    /* Buffer descriptor list length; CIV/LVI are 5 bits, so this is the hardware maximum */
 #define AC97_BDL_BUFFER_LEN       0x1000                /* Length of buffer in BDL */
+#define AC97_BDL_IOC_PERIOD       2                     /* Interrupt on every Nth descriptor, not every one */
+#define AC97_BDL_FILL_AHEAD       4                     /* Descriptors kept filled past the hardware's position */
 #define AC97_CL_GET_LENGTH(cl)    ((cl) & 0xFFFF)       /* Decode length from cl */
 #define AC97_CL_SET_LENGTH(cl, v) ((cl) = (v) & 0xFFFF) /* Encode length to cl */
 #define AC97_CL_BUP               ((uint32_t)1 << 30)             /* Buffer underrun policy in cl */
@@ -130,19 +132,33 @@ static void find_ac97(uint32_t device, uint16_t vendorid, uint16_t deviceid, voi
 
 }
 
-#define DIVISION 128
+/*
+ * Top the descriptor ring back up: read where the controller is
+ * playing (CIV) and fill whole buffers from the mixer until we are
+ * AC97_BDL_FILL_AHEAD descriptors out in front of it. snd_request_buf
+ * never blocks - it mixes what the ring buffers hold and zero-fills
+ * the rest - so each refill is one large memcpy-sized request rather
+ * than a stream of tiny ones, and the queued runway rides out
+ * multi-millisecond scheduling gaps without a click.
+ */
+static void ac97_refill(void) {
+	uint8_t civ = inportb(_device.nabmbar + AC97_PO_CIV) % AC97_BDL_LEN;
+	while (((_device.lvi - civ + AC97_BDL_LEN) % AC97_BDL_LEN) < AC97_BDL_FILL_AHEAD) {
+		size_t f = (_device.lvi + 1) % AC97_BDL_LEN;
+		snd_request_buf(&_snd, AC97_BDL_BUFFER_LEN * sizeof(*_device.bufs[0]), (uint8_t *)_device.bufs[f]);
+		_device.lvi = f;
+	}
+	outportb(_device.nabmbar + AC97_PO_LVI, _device.lvi);
+}
+
 static int irq_handler(struct regs * regs) {
 	uint16_t sr = inports(_device.nabmbar + AC97_PO_SR);
 	if (sr & AC97_X_SR_LVBCI) {
+		/* Ran off the end of the list (underrun); refill and resume */
+		ac97_refill();
 		outports(_device.nabmbar + AC97_PO_SR, AC97_X_SR_LVBCI);
 	} else if (sr & AC97_X_SR_BCIS) {
-		size_t f = (_device.lvi + 2) % AC97_BDL_LEN;
-		for (size_t i = 0; i < AC97_BDL_BUFFER_LEN * sizeof(*_device.bufs[0]); i += DIVISION) {
-			snd_request_buf(&_snd, DIVISION, (uint8_t *)_device.bufs[f] + i);
-			switch_task(1);
-		}
-		_device.lvi = (_device.lvi + 1) % AC97_BDL_LEN;
-		outportb(_device.nabmbar + AC97_PO_LVI, _device.lvi);
+		ac97_refill();
 		outports(_device.nabmbar + AC97_PO_SR, AC97_X_SR_BCIS);
 	} else if (sr & AC97_X_SR_FIFOE) {
 		outports(_device.nabmbar + AC97_PO_SR, AC97_X_SR_FIFOE);
@@ -234,14 +250,16 @@ static int init(void) {
 												&_device.bdl[i].pointer);
 		memset(_device.bufs[i], 0, AC97_BDL_BUFFER_LEN * sizeof(*_device.bufs[0]));
 		AC97_CL_SET_LENGTH(_device.bdl[i].cl, AC97_BDL_BUFFER_LEN);
-		/* Set all buffers to interrupt */
-		_device.bdl[i].cl |= AC97_CL_IOC;
-
+		/* Interrupt every Nth descriptor instead of every one; the
+		 * refill catches up on the whole consumed span at once. */
+		if (i % AC97_BDL_IOC_PERIOD == AC97_BDL_IOC_PERIOD - 1) {
+			_device.bdl[i].cl |= AC97_CL_IOC;
+		}
 	}
 	/* Tell the ac97 where our BDL is */
 	outportl(_device.nabmbar + AC97_PO_BDBAR, _device.bdl_p);
-	/* Set the LVI to be the last index */
-	_device.lvi = 2;
+	/* Queue the initial runway of (silent) buffers */
+	_device.lvi = AC97_BDL_FILL_AHEAD;
 	outportb(_device.nabmbar + AC97_PO_LVI, _device.lvi);
 
 	snd_register(&_snd);
@@ -9,22 +9,28 @@
  */
 
 #include <system.h>
+#include <mem.h>
 #include <logging.h>
 #include <module.h>
 #include <fs.h>
 #include <printf.h>
 #include <list.h>
+#include <process.h>
 
 #include <pci.h>
 
 /* TODO: Move this to mod/ata.h */
 #include <ata.h>
 
+#include <mod/blockdev.h>
+
 static char ata_drive_char = 'a';
 static int  cdrom_number = 0;
 static uint32_t ata_pci = 0x00000000;
 static list_t * atapi_waiter;
 static int atapi_in_progress = 0;
+static list_t * ata_irq_waiter;
+static volatile int ata_in_progress = 0;
 
 typedef union {
 	uint8_t command_bytes[12];
@@ -57,6 +63,26 @@ struct ata_device {
 	uint32_t bar4;
 	uint32_t atapi_lba;
 	uint32_t atapi_sector_size;
+	list_t * queue;        /* Pending sector requests */
+	list_t * queue_wait;   /* Worker sleeps here when idle */
+	spin_lock_t queue_lock;
+	uint32_t head_pos;     /* LBA after the last serviced request */
+	list_t * flush_wait;   /* Waiters for pending writes to drain */
+	volatile int pending_writes;
+};
+
+/* A queued sector operation. Synchronous requests live on the
+ * requester's stack; deferred writes are heap-allocated and own a copy
+ * of their data, freed by the worker after completion. */
+struct ata_request {
+	node_t node;
+	uint32_t lba;
+	unsigned int count;
+	uint8_t * buf;
+	int write;
+	int async;
+	volatile int done;
+	list_t * wait;
 };
 
 static struct ata_device ata_primary_master   = {.io_base = 0x1F0, .control = 0x3F6, .slave = 0};
@@ -70,244 +96,69 @@ static spin_lock_t ata_lock = { 0 };
 /* TODO support other sector sizes */
 #define ATA_SECTOR_SIZE 512
 
-static void ata_device_read_sector(struct ata_device * dev, uint32_t lba, uint8_t * buf);
-static void ata_device_read_sector_atapi(struct ata_device * dev, uint32_t lba, uint8_t * buf);
-static void ata_device_write_sector_retry(struct ata_device * dev, uint32_t lba, uint8_t * buf);
-static uint32_t read_ata(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
-static uint32_t write_ata(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
-static void     open_ata(fs_node_t *node, unsigned int flags);
-static void     close_ata(fs_node_t *node);
-
-static uint64_t ata_max_offset(struct ata_device * dev) {
-	uint64_t sectors = dev->identity.sectors_48;
-	if (!sectors) {
-		/* Fall back to sectors_28 */
-		sectors = dev->identity.sectors_28;
-	}
-
-	return sectors * ATA_SECTOR_SIZE;
-}
-
-static uint64_t atapi_max_offset(struct ata_device * dev) {
-	uint64_t max_sector = dev->atapi_lba;
-
-	if (!max_sector) return 0;
-
-	return (max_sector + 1) * dev->atapi_sector_size;
+/* DMA buffer size, and the per-command transfer cap it implies. Heap
+ * pages are only physically contiguous within themselves, so each page
+ * of the buffer gets its own PRD entry. */
+#define ATA_DMA_PAGES   16
+#define ATA_MAX_SECTORS (ATA_DMA_PAGES * 0x1000 / ATA_SECTOR_SIZE)
+
+/* ATAPI transfers are PIO'd straight into the caller's buffer, so the
+ * only cap is how long we're willing to sit in one packet command. */
+#define ATAPI_MAX_SECTORS 32
+
+static void ata_device_read_sectors(struct ata_device * dev, uint32_t lba, unsigned int count, uint8_t * buf);
+static void ata_device_read_sectors_atapi(struct ata_device * dev, uint32_t lba, unsigned int count, uint8_t * buf);
+static void ata_device_write_sectors_retry(struct ata_device * dev, uint32_t lba, unsigned int count, uint8_t * buf);
+static void ata_queue_io(struct ata_device * dev, uint32_t lba, unsigned int count, uint8_t * buf, int write);
+static void ata_queue_worker(void * arg, char * name);
+static void ata_queue_flush(struct ata_device * dev);
+
+/* Block layer callbacks; the VFS-facing byte slicing and the sector
+ * cache live in the blockdev module, we just move sectors. */
+static int ata_blockdev_read(struct blockdev * bdev, uint32_t lba, unsigned int count, uint8_t * buf) {
+	ata_queue_io(bdev->driver, lba, count, buf, 0);
+	return 0;
 }
 
-static uint32_t read_ata(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
-
-	struct ata_device * dev = (struct ata_device *)node->device;
-
-	unsigned int start_block = offset / ATA_SECTOR_SIZE;
-	unsigned int end_block = (offset + size - 1) / ATA_SECTOR_SIZE;
-
-	unsigned int x_offset = 0;
-
-	if (offset > ata_max_offset(dev)) {
-		return 0;
-	}
-
-	if (offset + size > ata_max_offset(dev)) {
-		unsigned int i = ata_max_offset(dev) - offset;
-		size = i;
-	}
-
-	if (offset % ATA_SECTOR_SIZE) {
-		unsigned int prefix_size = (ATA_SECTOR_SIZE - (offset % ATA_SECTOR_SIZE));
-		char * tmp = malloc(ATA_SECTOR_SIZE);
-		ata_device_read_sector(dev, start_block, (uint8_t *)tmp);
-
-		memcpy(buffer, (void *)((uintptr_t)tmp + (offset % ATA_SECTOR_SIZE)), prefix_size);
-
-		free(tmp);
-
-		x_offset += prefix_size;
-		start_block++;
-	}
-
-	if ((offset + size)  % ATA_SECTOR_SIZE && start_block <= end_block) {
-		unsigned int postfix_size = (offset + size) % ATA_SECTOR_SIZE;
-		char * tmp = malloc(ATA_SECTOR_SIZE);
-		ata_device_read_sector(dev, end_block, (uint8_t *)tmp);
-
-		memcpy((void *)((uintptr_t)buffer + size - postfix_size), tmp, postfix_size);
-
-		free(tmp);
-
-		end_block--;
-	}
-
-	while (start_block <= end_block) {
-		ata_device_read_sector(dev, start_block, (uint8_t *)((uintptr_t)buffer + x_offset));
-		x_offset += ATA_SECTOR_SIZE;
-		start_block++;
-	}
-
-	return size;
+static int ata_blockdev_write(struct blockdev * bdev, uint32_t lba, unsigned int count, uint8_t * buf) {
+	ata_queue_io(bdev->driver, lba, count, buf, 1);
+	return 0;
 }
 
-static uint32_t read_atapi(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
-
-	struct ata_device * dev = (struct ata_device *)node->device;
-
-	unsigned int start_block = offset / dev->atapi_sector_size;
-	unsigned int end_block = (offset + size - 1) / dev->atapi_sector_size;
-
-	unsigned int x_offset = 0;
-
-	if (offset > atapi_max_offset(dev)) {
-		return 0;
-	}
-
-	if (offset + size > atapi_max_offset(dev)) {
-		unsigned int i = atapi_max_offset(dev) - offset;
-		size = i;
-	}
-
-	if (offset % dev->atapi_sector_size) {
-		unsigned int prefix_size = (dev->atapi_sector_size - (offset % dev->atapi_sector_size));
-		char * tmp = malloc(dev->atapi_sector_size);
-		ata_device_read_sector_atapi(dev, start_block, (uint8_t *)tmp);
-
-		memcpy(buffer, (void *)((uintptr_t)tmp + (offset % dev->atapi_sector_size)), prefix_size);
-
-		free(tmp);
-
-		x_offset += prefix_size;
-		start_block++;
-	}
-
-	if ((offset + size)  % dev->atapi_sector_size && start_block <= end_block) {
-		unsigned int postfix_size = (offset + size) % dev->atapi_sector_size;
-		char * tmp = malloc(dev->atapi_sector_size);
-		ata_device_read_sector_atapi(dev, end_block, (uint8_t *)tmp);
-
-		memcpy((void *)((uintptr_t)buffer + size - postfix_size), tmp, postfix_size);
-
-		free(tmp);
-
-		end_block--;
-	}
-
-	while (start_block <= end_block) {
-		ata_device_read_sector_atapi(dev, start_block, (uint8_t *)((uintptr_t)buffer + x_offset));
-		x_offset += dev->atapi_sector_size;
-		start_block++;
-	}
-
-	return size;
+static int ata_blockdev_flush(struct blockdev * bdev) {
+	ata_queue_flush(bdev->driver);
+	return 0;
 }
 
-
-static uint32_t write_ata(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
-	struct ata_device * dev = (struct ata_device *)node->device;
-
-	unsigned int start_block = offset / ATA_SECTOR_SIZE;
-	unsigned int end_block = (offset + size - 1) / ATA_SECTOR_SIZE;
-
-	unsigned int x_offset = 0;
-
-	if (offset > ata_max_offset(dev)) {
-		return 0;
-	}
-
-	if (offset + size > ata_max_offset(dev)) {
-		unsigned int i = ata_max_offset(dev) - offset;
-		size = i;
-	}
-
-	if (offset % ATA_SECTOR_SIZE) {
-		unsigned int prefix_size = (ATA_SECTOR_SIZE - (offset % ATA_SECTOR_SIZE));
-
-		char * tmp = malloc(ATA_SECTOR_SIZE);
-		ata_device_read_sector(dev, start_block, (uint8_t *)tmp);
-
-		debug_print(NOTICE, "Writing first block");
-
-		memcpy((void *)((uintptr_t)tmp + (offset % ATA_SECTOR_SIZE)), buffer, prefix_size);
-		ata_device_write_sector_retry(dev, start_block, (uint8_t *)tmp);
-
-		free(tmp);
-		x_offset += prefix_size;
-		start_block++;
-	}
-
-	if ((offset + size)  % ATA_SECTOR_SIZE && start_block <= end_block) {
-		unsigned int postfix_size = (offset + size) % ATA_SECTOR_SIZE;
-
-		char * tmp = malloc(ATA_SECTOR_SIZE);
-		ata_device_read_sector(dev, end_block, (uint8_t *)tmp);
-
-		debug_print(NOTICE, "Writing last block");
-
-		memcpy(tmp, (void *)((uintptr_t)buffer + size - postfix_size), postfix_size);
-
-		ata_device_write_sector_retry(dev, end_block, (uint8_t *)tmp);
-
-		free(tmp);
-		end_block--;
-	}
-
-	while (start_block <= end_block) {
-		ata_device_write_sector_retry(dev, start_block, (uint8_t *)((uintptr_t)buffer + x_offset));
-		x_offset += ATA_SECTOR_SIZE;
-		start_block++;
+static int atapi_blockdev_read(struct blockdev * bdev, uint32_t lba, unsigned int count, uint8_t * buf) {
+	struct ata_device * dev = bdev->driver;
+	while (count) {
+		unsigned int chunk = count > ATAPI_MAX_SECTORS ? ATAPI_MAX_SECTORS : count;
+		ata_device_read_sectors_atapi(dev, lba, chunk, buf);
+		lba += chunk;
+		buf += chunk * dev->atapi_sector_size;
+		count -= chunk;
 	}
-
-	return size;
-}
-
-static void open_ata(fs_node_t * node, unsigned int flags) {
-	return;
-}
-
-static void close_ata(fs_node_t * node) {
-	return;
+	return 0;
 }
 
 static fs_node_t * atapi_device_create(struct ata_device * device) {
-	fs_node_t * fnode = malloc(sizeof(fs_node_t));
-	memset(fnode, 0x00, sizeof(fs_node_t));
-	fnode->inode = 0;
-	sprintf(fnode->name, "cdrom%d", cdrom_number);
-	fnode->device  = device;
-	fnode->uid = 0;
-	fnode->gid = 0;
-	fnode->mask    = 0660;
-	fnode->length  = atapi_max_offset(device);
-	fnode->flags   = FS_BLOCKDEVICE;
-	fnode->read    = read_atapi;
-	fnode->write   = NULL; /* no write support */
-	fnode->open    = open_ata;
-	fnode->close   = close_ata;
-	fnode->readdir = NULL;
-	fnode->finddir = NULL;
-	fnode->ioctl   = NULL; /* TODO, identify, etc? */
-	return fnode;
+	char name[64];
+	sprintf(name, "cdrom%d", cdrom_number);
+	uint64_t sectors = device->atapi_lba ? device->atapi_lba + 1 : 0;
+	uint32_t ssize = device->atapi_sector_size ? device->atapi_sector_size : 2048;
+	return blockdev_create(name, device, ssize, sectors, atapi_blockdev_read, NULL, NULL);
 }
 
-
 static fs_node_t * ata_device_create(struct ata_device * device) {
-	fs_node_t * fnode = malloc(sizeof(fs_node_t));
-	memset(fnode, 0x00, sizeof(fs_node_t));
-	fnode->inode = 0;
-	sprintf(fnode->name, "atadev%d", ata_drive_char - 'a');
-	fnode->device  = device;
-	fnode->uid = 0;
-	fnode->gid = 0;
-	fnode->mask    = 0660;
-	fnode->length  = ata_max_offset(device); /* TODO */
-	fnode->flags   = FS_BLOCKDEVICE;
-	fnode->read    = read_ata;
-	fnode->write   = write_ata;
-	fnode->open    = open_ata;
-	fnode->close   = close_ata;
-	fnode->readdir = NULL;
-	fnode->finddir = NULL;
-	fnode->ioctl   = NULL; /* TODO, identify, etc? */
-	return fnode;
+	char name[64];
+	sprintf(name, "atadev%d", ata_drive_char - 'a');
+	uint64_t sectors = device->identity.sectors_48;
+	if (!sectors) {
+		/* Fall back to sectors_28 */
+		sectors = device->identity.sectors_28;
+	}
+	return blockdev_create(name, device, ATA_SECTOR_SIZE, sectors, ata_blockdev_read, ata_blockdev_write, ata_blockdev_flush);
 }
 
 static void ata_io_wait(struct ata_device * dev) {
@@ -354,7 +205,10 @@ static void ata_soft_reset(struct ata_device * dev) {
 static int ata_irq_handler(struct regs *r) {
 	inportb(ata_primary_master.io_base + ATA_REG_STATUS);
 	if (atapi_in_progress) {
-		wakeup_queue(atapi_waiter);
+		wakeup_queue_irq(atapi_waiter);
+	}
+	if (ata_in_progress) {
+		wakeup_queue_irq(ata_irq_waiter);
 	}
 	irq_ack(14);
 	return 1;
@@ -363,7 +217,10 @@ static int ata_irq_handler(struct regs *r) {
 static int ata_irq_handler_s(struct regs *r) {
 	inportb(ata_secondary_master.io_base + ATA_REG_STATUS);
 	if (atapi_in_progress) {
-		wakeup_queue(atapi_waiter);
+		wakeup_queue_irq(atapi_waiter);
+	}
+	if (ata_in_progress) {
+		wakeup_queue_irq(ata_irq_waiter);
 	}
 	irq_ack(15);
 	return 1;
@@ -407,15 +264,13 @@ static void ata_device_init(struct ata_device * dev) {
 	debug_print(NOTICE, "Sectors (24): %d", dev->identity.sectors_28);
 
 	debug_print(NOTICE, "Setting up DMA...");
-	dev->dma_prdt  = (void *)kvmalloc_p(sizeof(prdt_t) * 1, &dev->dma_prdt_phys);
-	dev->dma_start = (void *)kvmalloc_p(4096, &dev->dma_start_phys);
+	dev->dma_prdt  = (void *)kvmalloc_p(sizeof(prdt_t) * ATA_DMA_PAGES, &dev->dma_prdt_phys);
+	dev->dma_start = (void *)kvmalloc_p(ATA_DMA_PAGES * 0x1000, &dev->dma_start_phys);
 
 	debug_print(NOTICE, "Putting prdt    at 0x%x (0x%x phys)", dev->dma_prdt, dev->dma_prdt_phys);
-	debug_print(NOTICE, "Putting prdt[0] at 0x%x (0x%x phys)", dev->dma_start, dev->dma_start_phys);
+	debug_print(NOTICE, "Putting buffer  at 0x%x (0x%x phys)", dev->dma_start, dev->dma_start_phys);
 
-	dev->dma_prdt[0].offset = dev->dma_start_phys;
-	dev->dma_prdt[0].bytes = 512;
-	dev->dma_prdt[0].last = 0x8000;
+	/* Entries are programmed per command based on the transfer size */
 
 	debug_print(NOTICE, "ATA PCI device ID: 0x%x", ata_pci);
 
@@ -580,6 +435,14 @@ static int ata_device_detect(struct ata_device * dev) {
 
 		ata_device_init(dev);
 
+		dev->queue = list_create();
+		dev->queue_wait = list_create();
+		dev->flush_wait = list_create();
+		spin_init(dev->queue_lock);
+		dev->head_pos = 0;
+		dev->pending_writes = 0;
+		create_kernel_tasklet(ata_queue_worker, "[ataq]", dev);
+
 		return 1;
 	} else if ((cl == 0x14 && ch == 0xEB) ||
 	           (cl == 0x69 && ch == 0x96)) {
@@ -601,11 +464,12 @@ static int ata_device_detect(struct ata_device * dev) {
 	return 0;
 }
 
-static void ata_device_read_sector(struct ata_device * dev, uint32_t lba, uint8_t * buf) {
+static void ata_device_read_sectors(struct ata_device * dev, uint32_t lba, unsigned int count, uint8_t * buf) {
 	uint16_t bus = dev->io_base;
 	uint8_t slave = dev->slave;
 
 	if (dev->is_atapi) return;
+	if (!count || count > ATA_MAX_SECTORS) return;
 
 	spin_lock(ata_lock);
 
@@ -619,6 +483,15 @@ try_again:
 	/* Stop */
 	outportb(dev->bar4, 0x00);
 
+	/* Describe the transfer, one PRD entry per page of the buffer */
+	unsigned int bytes = count * ATA_SECTOR_SIZE;
+	unsigned int pages = (bytes + 0xFFF) / 0x1000;
+	for (unsigned int i = 0; i < pages; ++i) {
+		dev->dma_prdt[i].offset = map_to_physical((uintptr_t)dev->dma_start + i * 0x1000);
+		dev->dma_prdt[i].bytes  = (i == pages - 1) ? (bytes - i * 0x1000) : 0x1000;
+		dev->dma_prdt[i].last   = (i == pages - 1) ? 0x8000 : 0;
+	}
+
 	/* Set the PRDT */
 	outportl(dev->bar4 + 0x04, dev->dma_prdt_phys);
 
@@ -638,7 +511,7 @@ try_again:
 	outportb(bus + ATA_REG_HDDEVSEL, 0xe0 | slave << 4 | (lba & 0x0f000000) >> 24);
 	ata_io_wait(dev);
 	outportb(bus + ATA_REG_FEATURES, 0x00);
-	outportb(bus + ATA_REG_SECCOUNT0, 1);
+	outportb(bus + ATA_REG_SECCOUNT0, count);
 	outportb(bus + ATA_REG_LBA0, (lba & 0x000000ff) >>  0);
 	outportb(bus + ATA_REG_LBA1, (lba & 0x0000ff00) >>  8);
 	outportb(bus + ATA_REG_LBA2, (lba & 0x00ff0000) >> 16);
@@ -653,8 +526,19 @@ try_again:
 
 	ata_io_wait(dev);
 
+	ata_in_progress = 1;
 	outportb(dev->bar4, 0x08 | 0x01);
 
+	/* Sleep until the controller raises its IRQ; the interrupt bit
+	 * check under IRQ_OFF closes the completed-before-we-slept race. */
+	IRQ_OFF;
+	if (!(inportb(dev->bar4 + 0x02) & 0x04)) {
+		sleep_on(ata_irq_waiter);
+	} else {
+		IRQ_ON;
+	}
+	ata_in_progress = 0;
+
 	while (1) {
 		int status = inportb(dev->bar4 + 0x02);
 		int dstatus = inportb(dev->io_base + ATA_REG_STATUS);
@@ -665,7 +549,6 @@ try_again:
 			break;
 		}
 	}
-	IRQ_OFF;
 
 #if 0
 	if (ata_wait(dev, 1)) {
@@ -681,7 +564,7 @@ try_again:
 #endif
 
 	/* Copy from DMA buffer to output buffer. */
-	memcpy(buf, dev->dma_start, 512);
+	memcpy(buf, dev->dma_start, bytes);
 
 	/* Inform device we are done. */
 	outportb(dev->bar4 + 0x2, inportb(dev->bar4 + 0x02) | 0x04 | 0x02);
@@ -695,11 +578,13 @@ try_again:
 	spin_unlock(ata_lock);
 }
 
-static void ata_device_read_sector_atapi(struct ata_device * dev, uint32_t lba, uint8_t * buf) {
+static void ata_device_read_sectors_atapi(struct ata_device * dev, uint32_t lba, unsigned int count, uint8_t * buf) {
 
 	if (!dev->is_atapi) return;
+	if (!count || count > ATAPI_MAX_SECTORS) return;
 
 	uint16_t bus = dev->io_base;
+	uint32_t remaining = count * dev->atapi_sector_size;
 	spin_lock(ata_lock);
 
 	outportb(dev->io_base + ATA_REG_HDDEVSEL, 0xA0 | dev->slave << 4);
@@ -729,8 +614,8 @@ static void ata_device_read_sector_atapi(struct ata_device * dev, uint32_t lba,
 	command.command_bytes[5] = (lba >> 0x00) & 0xFF;
 	command.command_bytes[6] = 0;
 	command.command_bytes[7] = 0;
-	command.command_bytes[8] = 0; /* bit 0 = PMI (0, last sector) */
-	command.command_bytes[9] = 1; /* control */
+	command.command_bytes[8] = (count >> 0x08) & 0xFF; /* transfer length, in sectors */
+	command.command_bytes[9] = (count >> 0x00) & 0xFF;
 	command.command_bytes[10] = 0;
 	command.command_bytes[11] = 0;
 
@@ -738,22 +623,30 @@ static void ata_device_read_sector_atapi(struct ata_device * dev, uint32_t lba,
 		outports(bus, command.command_words[i]);
 	}
 
-	/* Wait */
+	/* Wait for the first data phase */
 	sleep_on(atapi_waiter);
 
 	atapi_in_progress = 0;
 
-	while (1) {
-		uint8_t status = inportb(dev->io_base + ATA_REG_STATUS);
-		if ((status & ATA_SR_ERR)) goto atapi_error_on_read_setup;
-		if (!(status & ATA_SR_BSY) && (status & ATA_SR_DRQ)) break;
-	}
-
-	uint16_t size_to_read = inportb(bus + ATA_REG_LBA2) << 8;
-	size_to_read = size_to_read | inportb(bus + ATA_REG_LBA1);
+	/* The byte count limit caps each data phase at one sector, so a
+	 * multi-sector command arrives as a series of DRQ phases; the drive
+	 * has the next sector buffered by the time we finish shoveling the
+	 * previous one, so we just poll between phases. */
+	while (remaining) {
+		while (1) {
+			uint8_t status = inportb(dev->io_base + ATA_REG_STATUS);
+			if ((status & ATA_SR_ERR)) goto atapi_error_on_read_setup;
+			if (!(status & ATA_SR_BSY) && (status & ATA_SR_DRQ)) break;
+		}
 
+		uint16_t size_to_read = inportb(bus + ATA_REG_LBA2) << 8;
+		size_to_read = size_to_read | inportb(bus + ATA_REG_LBA1);
+		if (size_to_read > remaining) size_to_read = remaining;
 
-	inportsm(bus,buf,size_to_read/2);
+		inportsm(bus,buf,size_to_read/2);
+		buf += size_to_read;
+		remaining -= size_to_read;
+	}
 
 	while (1) {
 		uint8_t status = inportb(dev->io_base + ATA_REG_STATUS);
@@ -762,33 +655,62 @@ static void ata_device_read_sector_atapi(struct ata_device * dev, uint32_t lba,
 	}
 
 atapi_error_on_read_setup:
+	atapi_in_progress = 0;
 	spin_unlock(ata_lock);
 
 }
 
-static void ata_device_write_sector(struct ata_device * dev, uint32_t lba, uint8_t * buf) {
+/* Park the caller until the drive raises its interrupt instead of
+ * spinning on BSY in ata_wait. The status read that acknowledges the
+ * IRQ happens in the handler; if the drive already finished by the
+ * time we check, there is nothing to sleep for. */
+static void ata_pio_wait_irq(struct ata_device * dev) {
+	ata_in_progress = 1;
+	IRQ_OFF;
+	if (inportb(dev->io_base + ATA_REG_ALTSTATUS) & ATA_SR_BSY) {
+		sleep_on(ata_irq_waiter);
+	} else {
+		IRQ_ON;
+	}
+	ata_in_progress = 0;
+	ata_wait(dev, 0);
+}
+
+static void ata_device_write_sectors(struct ata_device * dev, uint32_t lba, unsigned int count, uint8_t * buf) {
 	uint16_t bus = dev->io_base;
 	uint8_t slave = dev->slave;
 
+	if (!count || count > ATA_MAX_SECTORS) return;
+
 	spin_lock(ata_lock);
 
-	outportb(bus + ATA_REG_CONTROL, 0x02);
+	outportb(bus + ATA_REG_CONTROL, 0x00);
 
 	ata_wait(dev, 0);
 	outportb(bus + ATA_REG_HDDEVSEL, 0xe0 | slave << 4 | (lba & 0x0f000000) >> 24);
 	ata_wait(dev, 0);
 
 	outportb(bus + ATA_REG_FEATURES, 0x00);
-	outportb(bus + ATA_REG_SECCOUNT0, 0x01);
+	outportb(bus + ATA_REG_SECCOUNT0, count);
 	outportb(bus + ATA_REG_LBA0, (lba & 0x000000ff) >>  0);
 	outportb(bus + ATA_REG_LBA1, (lba & 0x0000ff00) >>  8);
 	outportb(bus + ATA_REG_LBA2, (lba & 0x00ff0000) >> 16);
 	outportb(bus + ATA_REG_COMMAND, ATA_CMD_WRITE_PIO);
-	ata_wait(dev, 0);
 	int size = ATA_SECTOR_SIZE / 2;
-	outportsm(bus,buf,size);
+	for (unsigned int i = 0; i < count; ++i) {
+		if (i == 0) {
+			/* The first data block is not preceded by an interrupt */
+			ata_wait(dev, 0);
+		} else {
+			ata_pio_wait_irq(dev);
+		}
+		outportsm(bus, buf + i * ATA_SECTOR_SIZE, size);
+	}
+	/* Completion interrupt for the last sector, then the flush, which
+	 * is where a drive with a write cache spends its time. */
+	ata_pio_wait_irq(dev);
 	outportb(bus + 0x07, ATA_CMD_CACHE_FLUSH);
-	ata_wait(dev, 0);
+	ata_pio_wait_irq(dev);
 	spin_unlock(ata_lock);
 }
 
@@ -804,15 +726,212 @@ static int buffer_compare(uint32_t * ptr1, uint32_t * ptr2, size_t size) {
 	return 0;
 }
 
-static void ata_device_write_sector_retry(struct ata_device * dev, uint32_t lba, uint8_t * buf) {
-	uint8_t * read_buf = malloc(ATA_SECTOR_SIZE);
+static void ata_device_write_sectors_retry(struct ata_device * dev, uint32_t lba, unsigned int count, uint8_t * buf) {
+	uint8_t * read_buf = malloc(count * ATA_SECTOR_SIZE);
 	do {
-		ata_device_write_sector(dev, lba, buf);
-		ata_device_read_sector(dev, lba, read_buf);
-	} while (buffer_compare((uint32_t *)buf, (uint32_t *)read_buf, ATA_SECTOR_SIZE));
+		ata_device_write_sectors(dev, lba, count, buf);
+		ata_device_read_sectors(dev, lba, count, read_buf);
+	} while (buffer_compare((uint32_t *)buf, (uint32_t *)read_buf, count * ATA_SECTOR_SIZE));
 	free(read_buf);
 }
 
+/*
+ * Per-device request queue worker. Pending requests are served in
+ * elevator (SCAN) order: the lowest LBA at or beyond the head's last
+ * position goes first, wrapping to the lowest outstanding LBA when the
+ * sweep runs out. Contiguous requests therefore hit the device back to
+ * back, so several processes reading at once still look sequential to
+ * the disk instead of interleaving seeks.
+ */
+static void ata_queue_worker(void * arg, char * name) {
+	struct ata_device * dev = arg;
+	while (1) {
+		spin_lock(dev->queue_lock);
+		node_t * best = NULL;
+		node_t * lowest = NULL;
+		foreach(n, dev->queue) {
+			struct ata_request * req = (struct ata_request *)n->value;
+			if (!lowest || req->lba < ((struct ata_request *)lowest->value)->lba) {
+				lowest = n;
+			}
+			if (req->lba >= dev->head_pos) {
+				if (!best || req->lba < ((struct ata_request *)best->value)->lba) {
+					best = n;
+				}
+			}
+		}
+		if (!best) best = lowest;
+		if (best) list_delete(dev->queue, best);
+		spin_unlock(dev->queue_lock);
+
+		if (!best) {
+			/* Check-and-sleep must be atomic or we miss the wakeup */
+			IRQ_OFF;
+			if (!dev->queue->length) {
+				sleep_on(dev->queue_wait);
+			} else {
+				IRQ_ON;
+			}
+			continue;
+		}
+
+		struct ata_request * req = (struct ata_request *)best->value;
+		if (req->write) {
+			ata_device_write_sectors_retry(dev, req->lba, req->count, req->buf);
+		} else {
+			ata_device_read_sectors(dev, req->lba, req->count, req->buf);
+		}
+		dev->head_pos = req->lba + req->count;
+		if (req->async) {
+			free(req->buf);
+			free(req);
+			spin_lock(dev->queue_lock);
+			dev->pending_writes--;
+			spin_unlock(dev->queue_lock);
+			wakeup_queue(dev->flush_wait);
+		} else {
+			req->done = 1;
+			wakeup_queue(req->wait);
+		}
+	}
+}
+
+/*
+ * Queue a write without waiting for it to reach the disk. Writes that
+ * land inside or directly behind a pending write are folded into it, so
+ * metadata-heavy workloads stop issuing one command per sector. The
+ * caller's data is copied; ata_queue_flush() is the durability barrier.
+ */
+static void ata_queue_write(struct ata_device * dev, uint32_t lba, unsigned int count, uint8_t * buf) {
+	spin_lock(dev->queue_lock);
+	foreach(n, dev->queue) {
+		struct ata_request * wreq = (struct ata_request *)n->value;
+		if (!wreq->write) continue;
+		if (wreq->lba <= lba && lba + count <= wreq->lba + wreq->count) {
+			/* Entirely inside a pending write; update it in place */
+			memcpy(wreq->buf + (lba - wreq->lba) * ATA_SECTOR_SIZE, buf, count * ATA_SECTOR_SIZE);
+			spin_unlock(dev->queue_lock);
+			return;
+		}
+		if (wreq->lba + wreq->count == lba && wreq->count + count <= ATA_MAX_SECTORS) {
+			/* Contiguous append; one command covers both */
+			wreq->buf = realloc(wreq->buf, (wreq->count + count) * ATA_SECTOR_SIZE);
+			memcpy(wreq->buf + wreq->count * ATA_SECTOR_SIZE, buf, count * ATA_SECTOR_SIZE);
+			wreq->count += count;
+			spin_unlock(dev->queue_lock);
+			return;
+		}
+	}
+
+	struct ata_request * req = malloc(sizeof(struct ata_request));
+	req->lba   = lba;
+	req->count = count;
+	req->buf   = malloc(count * ATA_SECTOR_SIZE);
+	memcpy(req->buf, buf, count * ATA_SECTOR_SIZE);
+	req->write = 1;
+	req->async = 1;
+	req->done  = 0;
+	req->wait  = NULL;
+	req->node.value = req;
+	req->node.prev  = NULL;
+	req->node.next  = NULL;
+	req->node.owner = NULL;
+	list_append(dev->queue, &req->node);
+	dev->pending_writes++;
+	spin_unlock(dev->queue_lock);
+	wakeup_queue(dev->queue_wait);
+}
+
+/*
+ * A read must not pass a queued write it overlaps, or it would see
+ * stale sectors; park until the overlapping writes have been picked up.
+ */
+static void ata_queue_wait_writes(struct ata_device * dev, uint32_t lba, unsigned int count) {
+	while (1) {
+		IRQ_OFF;
+		spin_lock(dev->queue_lock);
+		int overlap = 0;
+		foreach(n, dev->queue) {
+			struct ata_request * wreq = (struct ata_request *)n->value;
+			if (wreq->write && wreq->lba < lba + count && lba < wreq->lba + wreq->count) {
+				overlap = 1;
+				break;
+			}
+		}
+		spin_unlock(dev->queue_lock);
+		if (!overlap) {
+			IRQ_ON;
+			return;
+		}
+		sleep_on(dev->flush_wait);
+	}
+}
+
+/* Wait until every deferred write has reached the disk */
+static void ata_queue_flush(struct ata_device * dev) {
+	if (!dev->queue) return;
+	while (dev->pending_writes) {
+		IRQ_OFF;
+		if (dev->pending_writes) {
+			sleep_on(dev->flush_wait);
+		} else {
+			IRQ_ON;
+		}
+	}
+}
+
+static void ata_queue_io(struct ata_device * dev, uint32_t lba, unsigned int count, uint8_t * buf, int write) {
+	while (count) {
+		unsigned int chunk = count > ATA_MAX_SECTORS ? ATA_MAX_SECTORS : count;
+
+		if (!dev->queue) {
+			/* No worker for this device; do it synchronously */
+			if (write) {
+				ata_device_write_sectors_retry(dev, lba, chunk, buf);
+			} else {
+				ata_device_read_sectors(dev, lba, chunk, buf);
+			}
+		} else if (write) {
+			ata_queue_write(dev, lba, chunk, buf);
+		} else {
+			ata_queue_wait_writes(dev, lba, chunk);
+
+			struct ata_request req;
+			req.lba   = lba;
+			req.count = chunk;
+			req.buf   = buf;
+			req.write = write;
+			req.async = 0;
+			req.done  = 0;
+			req.wait  = list_create();
+			req.node.value = &req;
+			req.node.prev  = NULL;
+			req.node.next  = NULL;
+			req.node.owner = NULL;
+
+			spin_lock(dev->queue_lock);
+			list_append(dev->queue, &req.node);
+			spin_unlock(dev->queue_lock);
+			wakeup_queue(dev->queue_wait);
+
+			while (!req.done) {
+				IRQ_OFF;
+				if (req.done) {
+					IRQ_ON;
+					break;
+				}
+				sleep_on(req.wait);
+			}
+
+			free(req.wait);
+		}
+
+		lba   += chunk;
+		buf   += chunk * ATA_SECTOR_SIZE;
+		count -= chunk;
+	}
+}
+
 static int ata_initialize(void) {
 	/* Detect drives and mount them */
 
@@ -823,6 +942,7 @@ static int ata_initialize(void) {
 	irq_install_handler(15, ata_irq_handler_s);
 
 	atapi_waiter = list_create();
+	ata_irq_waiter = list_create();
 
 	ata_device_detect(&ata_primary_master);
 	ata_device_detect(&ata_primary_slave);
@@ -838,3 +958,4 @@ static int ata_finalize(void) {
 }
 
 MODULE_DEF(ata, ata_initialize, ata_finalize);
+MODULE_DEPENDS(blockdev);
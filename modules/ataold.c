@@ -17,6 +17,8 @@
 /* TODO: Move this to mod/ata.h */
 #include <ata.h>
 
+#include <mod/blockdev.h>
+
 static char ata_drive_char = 'a';
 
 struct ata_device {
@@ -34,158 +36,34 @@ static spin_lock_t ata_lock = { 0 };
 
 static void ata_device_read_sector(struct ata_device * dev, uint32_t lba, uint8_t * buf);
 static void ata_device_write_sector_retry(struct ata_device * dev, uint32_t lba, uint8_t * buf);
-static uint32_t read_ata(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
-static uint32_t write_ata(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
-static void     open_ata(fs_node_t *node, unsigned int flags);
-static void     close_ata(fs_node_t *node);
 
-static uint64_t ata_max_offset(struct ata_device * dev) {
-	uint64_t sectors = dev->identity.sectors_48;
-	if (!sectors) {
-		/* Fall back to sectors_28 */
-		sectors = dev->identity.sectors_28;
+/* Block layer callbacks; byte slicing and caching happen in the
+ * blockdev module, this driver only moves single sectors. */
+static int ata_blockdev_read(struct blockdev * bdev, uint32_t lba, unsigned int count, uint8_t * buf) {
+	struct ata_device * dev = bdev->driver;
+	for (unsigned int i = 0; i < count; ++i) {
+		ata_device_read_sector(dev, lba + i, buf + i * ATA_SECTOR_SIZE);
 	}
-
-	return sectors * ATA_SECTOR_SIZE;
-}
-
-static uint32_t read_ata(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
-
-	struct ata_device * dev = (struct ata_device *)node->device;
-
-	unsigned int start_block = offset / ATA_SECTOR_SIZE;
-	unsigned int end_block = (offset + size - 1) / ATA_SECTOR_SIZE;
-
-	unsigned int x_offset = 0;
-
-	if (offset > ata_max_offset(dev)) {
-		return 0;
-	}
-
-	if (offset + size > ata_max_offset(dev)) {
-		unsigned int i = ata_max_offset(dev) - offset;
-		size = i;
-	}
-
-	if (offset % ATA_SECTOR_SIZE) {
-		unsigned int prefix_size = (ATA_SECTOR_SIZE - (offset % ATA_SECTOR_SIZE));
-		char * tmp = malloc(ATA_SECTOR_SIZE);
-		ata_device_read_sector(dev, start_block, (uint8_t *)tmp);
-
-		memcpy(buffer, (void *)((uintptr_t)tmp + (offset % ATA_SECTOR_SIZE)), prefix_size);
-
-		free(tmp);
-
-		x_offset += prefix_size;
-		start_block++;
-	}
-
-	if ((offset + size)  % ATA_SECTOR_SIZE && start_block < end_block) {
-		unsigned int postfix_size = (offset + size) % ATA_SECTOR_SIZE;
-		char * tmp = malloc(ATA_SECTOR_SIZE);
-		ata_device_read_sector(dev, end_block, (uint8_t *)tmp);
-
-		memcpy((void *)((uintptr_t)buffer + size - postfix_size), tmp, postfix_size);
-
-		free(tmp);
-
-		end_block--;
-	}
-
-	while (start_block <= end_block) {
-		ata_device_read_sector(dev, start_block, (uint8_t *)((uintptr_t)buffer + x_offset));
-		x_offset += ATA_SECTOR_SIZE;
-		start_block++;
-	}
-
-	return size;
+	return 0;
 }
 
-static uint32_t write_ata(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
-	struct ata_device * dev = (struct ata_device *)node->device;
-
-	unsigned int start_block = offset / ATA_SECTOR_SIZE;
-	unsigned int end_block = (offset + size - 1) / ATA_SECTOR_SIZE;
-
-	unsigned int x_offset = 0;
-
-	if (offset > ata_max_offset(dev)) {
-		return 0;
-	}
-
-	if (offset + size > ata_max_offset(dev)) {
-		unsigned int i = ata_max_offset(dev) - offset;
-		size = i;
+static int ata_blockdev_write(struct blockdev * bdev, uint32_t lba, unsigned int count, uint8_t * buf) {
+	struct ata_device * dev = bdev->driver;
+	for (unsigned int i = 0; i < count; ++i) {
+		ata_device_write_sector_retry(dev, lba + i, buf + i * ATA_SECTOR_SIZE);
 	}
-
-	if (offset % ATA_SECTOR_SIZE) {
-		unsigned int prefix_size = (ATA_SECTOR_SIZE - (offset % ATA_SECTOR_SIZE));
-
-		char * tmp = malloc(ATA_SECTOR_SIZE);
-		ata_device_read_sector(dev, start_block, (uint8_t *)tmp);
-
-		debug_print(NOTICE, "Writing first block");
-
-		memcpy((void *)((uintptr_t)tmp + (offset % ATA_SECTOR_SIZE)), buffer, prefix_size);
-		ata_device_write_sector_retry(dev, start_block, (uint8_t *)tmp);
-
-		free(tmp);
-		x_offset += prefix_size;
-		start_block++;
-	}
-
-	if ((offset + size)  % ATA_SECTOR_SIZE && start_block < end_block) {
-		unsigned int postfix_size = (offset + size) % ATA_SECTOR_SIZE;
-
-		char * tmp = malloc(ATA_SECTOR_SIZE);
-		ata_device_read_sector(dev, end_block, (uint8_t *)tmp);
-
-		debug_print(NOTICE, "Writing last block");
-
-		memcpy(tmp, (void *)((uintptr_t)buffer + size - postfix_size), postfix_size);
-
-		ata_device_write_sector_retry(dev, end_block, (uint8_t *)tmp);
-
-		free(tmp);
-		end_block--;
-	}
-
-	while (start_block <= end_block) {
-		ata_device_write_sector_retry(dev, start_block, (uint8_t *)((uintptr_t)buffer + x_offset));
-		x_offset += ATA_SECTOR_SIZE;
-		start_block++;
-	}
-
-	return size;
-}
-
-static void open_ata(fs_node_t * node, unsigned int flags) {
-	return;
-}
-
-static void close_ata(fs_node_t * node) {
-	return;
+	return 0;
 }
 
 static fs_node_t * ata_device_create(struct ata_device * device) {
-	fs_node_t * fnode = malloc(sizeof(fs_node_t));
-	memset(fnode, 0x00, sizeof(fs_node_t));
-	fnode->inode = 0;
-	sprintf(fnode->name, "atadev%d", ata_drive_char - 'a');
-	fnode->device  = device;
-	fnode->uid = 0;
-	fnode->gid = 0;
-	fnode->mask    = 0660;
-	fnode->length  = ata_max_offset(device); /* TODO */
-	fnode->flags   = FS_BLOCKDEVICE;
-	fnode->read    = read_ata;
-	fnode->write   = write_ata;
-	fnode->open    = open_ata;
-	fnode->close   = close_ata;
-	fnode->readdir = NULL;
-	fnode->finddir = NULL;
-	fnode->ioctl   = NULL; /* TODO, identify, etc? */
-	return fnode;
+	char name[64];
+	sprintf(name, "atadev%d", ata_drive_char - 'a');
+	uint64_t sectors = device->identity.sectors_48;
+	if (!sectors) {
+		/* Fall back to sectors_28 */
+		sectors = device->identity.sectors_28;
+	}
+	return blockdev_create(name, device, ATA_SECTOR_SIZE, sectors, ata_blockdev_read, ata_blockdev_write, NULL);
 }
 
 static void ata_io_wait(struct ata_device * dev) {
@@ -410,3 +288,4 @@ static int ata_finalize(void) {
 }
 
 MODULE_DEF(ata_legacy, ata_initialize, ata_finalize);
+MODULE_DEPENDS(blockdev);
@@ -0,0 +1,401 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2016 Kevin Lange
+ *
+ * Generic block device layer.
+ *
+ * Sits between the VFS and the disk drivers: drivers register a set of
+ * sector-granular callbacks and get back an fs_node_t, and the layer
+ * provides the byte-level slicing and a per-device write-through sector
+ * cache that every filesystem on top benefits from.
+ */
+
+#include <system.h>
+#include <types.h>
+#include <fs.h>
+#include <logging.h>
+#include <module.h>
+#include <printf.h>
+#include <hashmap.h>
+#include <ata.h> /* IOCTL_ATA_FLUSH */
+#include <kstats.h>
+#include <mod/blockdev.h>
+
+/* Cached sectors per device before we dump and start over. */
+#define BLOCKDEV_CACHE_MAX 4096
+
+/* Requests longer than this bypass the cache; they're streaming reads
+ * and caching them would just evict the metadata we care about. The
+ * cache is write-through, so going straight to the driver is safe. */
+#define BLOCKDEV_CACHE_RUN 4
+
+/* Captured requests before the oldest get overwritten. */
+#define BLKTRACE_RING 4096
+
+static uint32_t read_block_fs(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer);
+static uint32_t write_block_fs(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer);
+
+static uint8_t next_dev_id = 0;
+
+/*
+ * Request tracing: while /dev/blktrace is held open, every request that
+ * passes through the layer - reads and writes, cached or not - is
+ * recorded, and reading the node drains the records oldest-first. The
+ * captured stream can then be replayed against a device when evaluating
+ * cache and queueing changes (bench-io -p).
+ */
+static blktrace_rec_t * blktrace_ring = NULL;
+static volatile uint32_t blktrace_head = 0;
+static uint32_t blktrace_tail = 0;
+static volatile int blktrace_enabled = 0;
+
+static void blktrace_record(struct blockdev * bdev, uint32_t lba, unsigned int count, int write) {
+	if (__builtin_expect(!blktrace_enabled, 1)) return;
+
+	uint32_t slot = __sync_fetch_and_add(&blktrace_head, 1);
+	blktrace_rec_t * rec = &blktrace_ring[slot % BLKTRACE_RING];
+	rec->ticks    = timer_ticks;
+	rec->subticks = timer_subticks;
+	rec->lba      = bdev->lba_offset + lba;
+	rec->count    = count;
+	rec->write    = write;
+	rec->dev      = bdev->phys->dev_id;
+}
+
+static uint64_t blockdev_max_offset(struct blockdev * bdev) {
+	return bdev->total_sectors * bdev->sector_size;
+}
+
+static void cache_drop(struct blockdev * phys) {
+	list_t * keys = hashmap_keys(phys->cache);
+	foreach(node, keys) {
+		free(hashmap_get(phys->cache, node->value));
+	}
+	list_free(keys);
+	free(keys);
+	hashmap_free(phys->cache);
+	free(phys->cache);
+	phys->cache = hashmap_create_int(BLOCKDEV_CACHE_MAX);
+	phys->cache_count = 0;
+}
+
+/* The cache belongs to the physical device and is keyed by absolute
+ * LBA, so a partition view and the whole-disk node stay coherent. */
+static kstat_t * stat_cache_hits = NULL;
+static kstat_t * stat_cache_misses = NULL;
+
+static int blockdev_do_read(struct blockdev * bdev, uint32_t lba, unsigned int count, uint8_t * buf) {
+	struct blockdev * phys = bdev->phys;
+
+	blktrace_record(bdev, lba, count, 0);
+
+	if (__builtin_expect(!stat_cache_hits, 0)) {
+		stat_cache_hits   = kstat_register("blockdev.cache_hits");
+		stat_cache_misses = kstat_register("blockdev.cache_misses");
+	}
+
+	if (count > BLOCKDEV_CACHE_RUN) {
+		return bdev->read(bdev, bdev->lba_offset + lba, count, buf);
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		uint32_t sector = bdev->lba_offset + lba + i;
+		uint8_t * out = buf + i * bdev->sector_size;
+
+		spin_lock(phys->lock);
+		uint8_t * cached = hashmap_get(phys->cache, (void *)sector);
+		if (cached) {
+			memcpy(out, cached, bdev->sector_size);
+			spin_unlock(phys->lock);
+			KSTAT_INC(stat_cache_hits);
+			continue;
+		}
+		spin_unlock(phys->lock);
+
+		KSTAT_INC(stat_cache_misses);
+		if (bdev->read(bdev, sector, 1, out)) {
+			return 1;
+		}
+
+		spin_lock(phys->lock);
+		if (!hashmap_has(phys->cache, (void *)sector)) {
+			if (phys->cache_count >= BLOCKDEV_CACHE_MAX) {
+				cache_drop(phys);
+			}
+			uint8_t * copy = malloc(bdev->sector_size);
+			memcpy(copy, out, bdev->sector_size);
+			hashmap_set(phys->cache, (void *)sector, copy);
+			phys->cache_count++;
+		}
+		spin_unlock(phys->lock);
+	}
+
+	return 0;
+}
+
+static int blockdev_do_write(struct blockdev * bdev, uint32_t lba, unsigned int count, uint8_t * buf) {
+	struct blockdev * phys = bdev->phys;
+
+	if (!bdev->write) return 1;
+
+	blktrace_record(bdev, lba, count, 1);
+
+	if (bdev->write(bdev, bdev->lba_offset + lba, count, buf)) {
+		return 1;
+	}
+
+	/* Keep any cached copies current so later reads don't go stale. */
+	spin_lock(phys->lock);
+	for (unsigned int i = 0; i < count; ++i) {
+		uint8_t * cached = hashmap_get(phys->cache, (void *)(bdev->lba_offset + lba + i));
+		if (cached) {
+			memcpy(cached, buf + i * bdev->sector_size, bdev->sector_size);
+		}
+	}
+	spin_unlock(phys->lock);
+
+	return 0;
+}
+
+static uint32_t read_block_fs(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	struct blockdev * bdev = (struct blockdev *)node->device;
+
+	unsigned int start_block = offset / bdev->sector_size;
+	unsigned int end_block = (offset + size - 1) / bdev->sector_size;
+
+	unsigned int x_offset = 0;
+
+	if (offset > blockdev_max_offset(bdev)) {
+		return 0;
+	}
+
+	if (offset + size > blockdev_max_offset(bdev)) {
+		unsigned int i = blockdev_max_offset(bdev) - offset;
+		size = i;
+	}
+
+	if (offset % bdev->sector_size) {
+		unsigned int prefix_size = (bdev->sector_size - (offset % bdev->sector_size));
+		char * tmp = malloc(bdev->sector_size);
+		blockdev_do_read(bdev, start_block, 1, (uint8_t *)tmp);
+
+		memcpy(buffer, (void *)((uintptr_t)tmp + (offset % bdev->sector_size)), prefix_size);
+
+		free(tmp);
+
+		x_offset += prefix_size;
+		start_block++;
+	}
+
+	if ((offset + size)  % bdev->sector_size && start_block <= end_block) {
+		unsigned int postfix_size = (offset + size) % bdev->sector_size;
+		char * tmp = malloc(bdev->sector_size);
+		blockdev_do_read(bdev, end_block, 1, (uint8_t *)tmp);
+
+		memcpy((void *)((uintptr_t)buffer + size - postfix_size), tmp, postfix_size);
+
+		free(tmp);
+
+		end_block--;
+	}
+
+	if (start_block <= end_block) {
+		blockdev_do_read(bdev, start_block, end_block - start_block + 1, (uint8_t *)((uintptr_t)buffer + x_offset));
+	}
+
+	return size;
+}
+
+static uint32_t write_block_fs(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	struct blockdev * bdev = (struct blockdev *)node->device;
+
+	unsigned int start_block = offset / bdev->sector_size;
+	unsigned int end_block = (offset + size - 1) / bdev->sector_size;
+
+	unsigned int x_offset = 0;
+
+	if (!bdev->write) {
+		return 0;
+	}
+
+	if (offset > blockdev_max_offset(bdev)) {
+		return 0;
+	}
+
+	if (offset + size > blockdev_max_offset(bdev)) {
+		unsigned int i = blockdev_max_offset(bdev) - offset;
+		size = i;
+	}
+
+	if (offset % bdev->sector_size) {
+		unsigned int prefix_size = (bdev->sector_size - (offset % bdev->sector_size));
+
+		char * tmp = malloc(bdev->sector_size);
+		blockdev_do_read(bdev, start_block, 1, (uint8_t *)tmp);
+
+		memcpy((void *)((uintptr_t)tmp + (offset % bdev->sector_size)), buffer, prefix_size);
+		blockdev_do_write(bdev, start_block, 1, (uint8_t *)tmp);
+
+		free(tmp);
+		x_offset += prefix_size;
+		start_block++;
+	}
+
+	if ((offset + size)  % bdev->sector_size && start_block <= end_block) {
+		unsigned int postfix_size = (offset + size) % bdev->sector_size;
+
+		char * tmp = malloc(bdev->sector_size);
+		blockdev_do_read(bdev, end_block, 1, (uint8_t *)tmp);
+
+		memcpy(tmp, (void *)((uintptr_t)buffer + size - postfix_size), postfix_size);
+
+		blockdev_do_write(bdev, end_block, 1, (uint8_t *)tmp);
+
+		free(tmp);
+		end_block--;
+	}
+
+	if (start_block <= end_block) {
+		blockdev_do_write(bdev, start_block, end_block - start_block + 1, (uint8_t *)((uintptr_t)buffer + x_offset));
+	}
+
+	return size;
+}
+
+static void open_block_fs(fs_node_t * node, unsigned int flags) {
+	return;
+}
+
+static void close_block_fs(fs_node_t * node) {
+	return;
+}
+
+static int ioctl_block_fs(fs_node_t * node, int request, void * argp) {
+	struct blockdev * bdev = (struct blockdev *)node->device;
+	switch (request) {
+		case IOCTL_ATA_FLUSH:
+			if (bdev->flush) {
+				return bdev->flush(bdev);
+			}
+			return 0; /* Synchronous driver; nothing pending */
+		default:
+			return -1;
+	}
+}
+
+/* Build the fs_node_t for a blockdev; shared by devices and views. */
+static fs_node_t * blockdev_node_create(char * name, struct blockdev * bdev) {
+	fs_node_t * fnode = malloc(sizeof(fs_node_t));
+	memset(fnode, 0x00, sizeof(fs_node_t));
+	fnode->inode = 0;
+	sprintf(fnode->name, "%s", name);
+	fnode->device  = bdev;
+	fnode->uid = 0;
+	fnode->gid = 0;
+	fnode->mask    = 0660;
+	fnode->length  = blockdev_max_offset(bdev); /* TODO: lengths over 4GB */
+	fnode->flags   = FS_BLOCKDEVICE;
+	fnode->read    = read_block_fs;
+	fnode->write   = bdev->write ? write_block_fs : NULL;
+	fnode->open    = open_block_fs;
+	fnode->close   = close_block_fs;
+	fnode->readdir = NULL;
+	fnode->finddir = NULL;
+	fnode->ioctl   = ioctl_block_fs;
+	return fnode;
+}
+
+fs_node_t * blockdev_create(char * name, void * driver, uint32_t sector_size, uint64_t total_sectors, blockdev_io_fn read, blockdev_io_fn write, blockdev_flush_fn flush) {
+	struct blockdev * bdev = malloc(sizeof(struct blockdev));
+	bdev->driver = driver;
+	bdev->sector_size = sector_size;
+	bdev->total_sectors = total_sectors;
+	bdev->lba_offset = 0;
+	bdev->phys = bdev;
+	bdev->read = read;
+	bdev->write = write;
+	bdev->flush = flush;
+	bdev->cache = hashmap_create_int(BLOCKDEV_CACHE_MAX);
+	bdev->cache_count = 0;
+	spin_init(bdev->lock);
+	bdev->dev_id = next_dev_id++;
+
+	return blockdev_node_create(name, bdev);
+}
+
+fs_node_t * blockdev_create_view(fs_node_t * master, char * name, uint32_t lba_offset, uint64_t total_sectors) {
+	struct blockdev * parent = blockdev_from_node(master);
+	if (!parent) return NULL;
+
+	struct blockdev * bdev = malloc(sizeof(struct blockdev));
+	memcpy(bdev, parent, sizeof(struct blockdev));
+	bdev->lba_offset = parent->lba_offset + lba_offset;
+	bdev->total_sectors = total_sectors;
+	bdev->phys = parent->phys;
+	/* Cache lives with the physical device. */
+	bdev->cache = NULL;
+	bdev->cache_count = 0;
+
+	return blockdev_node_create(name, bdev);
+}
+
+struct blockdev * blockdev_from_node(fs_node_t * node) {
+	if (node->read != read_block_fs) return NULL;
+	return (struct blockdev *)node->device;
+}
+
+static void open_blktrace(fs_node_t * node, unsigned int flags) {
+	if (!blktrace_ring) {
+		blktrace_ring = malloc(BLKTRACE_RING * sizeof(blktrace_rec_t));
+	}
+	blktrace_head = 0;
+	blktrace_tail = 0;
+	blktrace_enabled = 1;
+}
+
+static void close_blktrace(fs_node_t * node) {
+	blktrace_enabled = 0;
+}
+
+/* Drain whole records, oldest first; offset is ignored. A reader that
+ * fell more than a full ring behind skips ahead to what survives. */
+static uint32_t read_blktrace(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	uint32_t head = blktrace_head;
+	if (head - blktrace_tail > BLKTRACE_RING) {
+		blktrace_tail = head - BLKTRACE_RING;
+	}
+
+	uint32_t out = 0;
+	while (blktrace_tail != head && out + sizeof(blktrace_rec_t) <= size) {
+		memcpy(buffer + out, &blktrace_ring[blktrace_tail % BLKTRACE_RING], sizeof(blktrace_rec_t));
+		blktrace_tail++;
+		out += sizeof(blktrace_rec_t);
+	}
+	return out;
+}
+
+static fs_node_t * blktrace_node_create(void) {
+	fs_node_t * fnode = malloc(sizeof(fs_node_t));
+	memset(fnode, 0x00, sizeof(fs_node_t));
+	sprintf(fnode->name, "blktrace");
+	fnode->uid   = 0;
+	fnode->gid   = 0;
+	fnode->mask  = 0600;
+	fnode->flags = FS_CHARDEVICE;
+	fnode->open  = open_blktrace;
+	fnode->close = close_blktrace;
+	fnode->read  = read_blktrace;
+	return fnode;
+}
+
+static int blockdev_initialize(void) {
+	vfs_mount("/dev/blktrace", blktrace_node_create());
+	return 0;
+}
+
+static int blockdev_finalize(void) {
+	return 0;
+}
+
+MODULE_DEF(blockdev, blockdev_initialize, blockdev_finalize);
@@ -342,6 +342,87 @@ static int shell_symbols(fs_node_t * tty, int argc, char * argv[]) {
 	return 0;
 }
 
+static int shell_sym(fs_node_t * tty, int argc, char * argv[]) {
+	if (argc < 2) {
+		fprintf(tty, "sym address\n");
+		return 1;
+	}
+
+	/* Accept 0x-prefixed or bare hex */
+	char * s = argv[1];
+	if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+		s += 2;
+	}
+	uintptr_t addr = 0;
+	while (*s) {
+		char c = *s;
+		if (c >= '0' && c <= '9') addr = (addr << 4) | (c - '0');
+		else if (c >= 'a' && c <= 'f') addr = (addr << 4) | (c - 'a' + 10);
+		else if (c >= 'A' && c <= 'F') addr = (addr << 4) | (c - 'A' + 10);
+		else {
+			fprintf(tty, "Not a hex address: %s\n", argv[1]);
+			return 1;
+		}
+		s++;
+	}
+
+	uintptr_t base = 0;
+	char * name = ksym_find(addr, &base);
+	if (!name) {
+		fprintf(tty, "0x%x: no symbol\n", addr);
+		return 1;
+	}
+	fprintf(tty, "0x%x: %s+0x%x\n", addr, name, addr - base);
+	return 0;
+}
+
+static int shell_locks(fs_node_t * tty, int argc, char * argv[]) {
+	int count = 0;
+	spin_stat_t * stats = spin_lock_stats(&count);
+
+	if (!count) {
+		fprintf(tty, "No lock has seen contention yet.\n");
+		return 0;
+	}
+
+	fprintf(tty, "%-10s %-10s %-12s %-12s %s\n", "lock", "owner", "acquires", "contended", "symbol");
+	for (int i = 0; i < count; ++i) {
+		volatile int * lock = stats[i].lock;
+		process_t * owner = (process_t *)lock[2];
+		uintptr_t base = 0;
+		char * name = ksym_find((uintptr_t)lock, &base);
+		fprintf(tty, "0x%-8x %-10d %-12d %-12d %s+0x%x\n",
+				(uintptr_t)lock,
+				owner ? owner->id : -1,
+				lock[4], lock[5],
+				name ? name : "?", name ? ((uintptr_t)lock - base) : 0);
+	}
+	return 0;
+}
+
+#ifdef KMALLOC_TRACK
+static void leaks_print_site(uintptr_t site, uint32_t live, uint32_t total, uint32_t live_bytes, void * extra) {
+	fs_node_t * tty = extra;
+	uintptr_t base = 0;
+	char * name = site ? ksym_find(site, &base) : NULL;
+	if (name) {
+		fprintf(tty, "%-10d %-10d %-12d %s+0x%x\n", live, total, live_bytes, name, site - base);
+	} else {
+		fprintf(tty, "%-10d %-10d %-12d %s\n", live, total, live_bytes, site ? "?" : "(overflow)");
+	}
+}
+#endif
+
+static int shell_leaks(fs_node_t * tty, int argc, char * argv[]) {
+#ifdef KMALLOC_TRACK
+	fprintf(tty, "%-10s %-10s %-12s %s\n", "live", "total", "live bytes", "allocation site");
+	kmalloc_track_dump(leaks_print_site, tty);
+#else
+	fprintf(tty, "Allocation tracking is off; rebuild with KMALLOC_TRACK=1.\n");
+#endif
+	return 0;
+}
+
 static int shell_print(fs_node_t * tty, int argc, char * argv[]) {
 
 	if (argc < 3) {
@@ -558,6 +639,56 @@ static int shell_debug_pid(fs_node_t * tty, int argc, char * argv[]) {
 	return 0;
 }
 
+/*
+ * Live performance state, for diagnosing a saturated box from the
+ * serial console. Kernel subsystems are called directly; stats that
+ * live in modules (ext2, packetfs) are resolved through the symbol
+ * table so we don't grow a dependency on filesystems being loaded.
+ */
+static int shell_stats(fs_node_t * tty, int argc, char * argv[]) {
+	if (argc < 2) {
+		fprintf(tty, "Usage: %s pipes|ready|ext2|pex\n", argv[0]);
+		return 1;
+	}
+
+	if (!strcmp(argv[1], "pipes")) {
+		pipe_debug_stats(tty);
+	} else if (!strcmp(argv[1], "ready")) {
+		fprintf(tty, "%-5s %-10s %-10s %-10s %s\n", "cpu", "interact", "default", "batch", "idle");
+		for (int c = 0; c < scheduler_cpu_count; ++c) {
+			fprintf(tty, "%-5d", c);
+			for (int level = 0; level < PROCESS_PRIORITY_LEVELS; ++level) {
+				fprintf(tty, " %-10d", scheduler_cpus[c].queues[level]->length);
+			}
+			fprintf(tty, "\n");
+		}
+	} else if (!strcmp(argv[1], "ext2")) {
+		void (*stats)(uint32_t *, uint32_t *) = (void *)hashmap_get(modules_get_symbols(), "ext2_cache_stats");
+		if (!stats) {
+			fprintf(tty, "ext2 module is not loaded.\n");
+			return 1;
+		}
+		uint32_t hits = 0, misses = 0;
+		stats(&hits, &misses);
+		fprintf(tty, "block cache: %d hits, %d misses", hits, misses);
+		if (hits + misses) {
+			fprintf(tty, " (%d%% hit rate)", hits * 100 / (hits + misses));
+		}
+		fprintf(tty, "\n");
+	} else if (!strcmp(argv[1], "pex")) {
+		void (*stats)(fs_node_t *) = (void *)hashmap_get(modules_get_symbols(), "pex_debug_stats");
+		if (!stats) {
+			fprintf(tty, "packetfs module is not loaded.\n");
+			return 1;
+		}
+		stats(tty);
+	} else {
+		fprintf(tty, "%s: unknown subsystem '%s'\n", argv[0], argv[1]);
+		return 1;
+	}
+	return 0;
+}
+
 static struct shell_command shell_commands[] = {
 	{"shell", &shell_create_userspace_shell,
 		"Runs a userspace shell on this tty."},
@@ -581,8 +712,14 @@ static struct shell_command shell_commands[] = {
 		"[testing] Module loading."},
 	{"symbols", &shell_symbols,
 		"Dump symbol table."},
+	{"sym", &shell_sym,
+		"Resolve an address to symbol+offset."},
+	{"locks", &shell_locks,
+		"Show acquisition and contention counts for contended spin locks."},
 	{"debug_pid", &shell_debug_pid,
 		"Set pid to trace syscalls for."},
+	{"stats", &shell_stats,
+		"Live cache, pipe, pex, and run-queue statistics."},
 	{"print", &shell_print,
 		"[dangerous] Print the value of a symbol using a format string."},
 	{"modules", &shell_modules,
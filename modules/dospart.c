@@ -9,6 +9,8 @@
 #include <printf.h>
 #include <ata.h>
 
+#include <mod/blockdev.h>
+
 #define SECTORSIZE      512
 
 static mbr_t mbr;
@@ -60,6 +62,17 @@ static fs_node_t * dospart_device_create(int i, fs_node_t * dev, partition_t * p
 
 	vfs_lock(dev);
 
+	char name[64];
+	sprintf(name, "dospart%d", i);
+
+	/* If the disk registered with the block layer, fold the partition
+	 * offset in as an LBA remap at request submission instead of
+	 * stacking another read-through fs_node_t on top of it. */
+	fs_node_t * view = blockdev_create_view(dev, name, part->lba_first_sector, part->sector_count);
+	if (view) {
+		return view;
+	}
+
 	struct dos_partition_entry * device = malloc(sizeof(struct dos_partition_entry));
 	memcpy(&device->partition, part, sizeof(partition_t));
 	device->device = dev;
@@ -128,3 +141,4 @@ static int dospart_finalize(void) {
 }
 
 MODULE_DEF(dospart, dospart_initialize, dospart_finalize);
+MODULE_DEPENDS(blockdev);
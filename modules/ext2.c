@@ -7,10 +7,14 @@
 #include <types.h>
 #include <fs.h>
 #include <ext2.h>
+#include <ata.h> /* IOCTL_ATA_FLUSH */
 #include <logging.h>
 #include <module.h>
 #include <args.h>
 #include <printf.h>
+#include <hashmap.h>
+#include <list.h>
+#include <bitset.h>
 
 #define EXT2_BGD_BLOCK 2
 
@@ -37,9 +41,30 @@ typedef struct {
 	unsigned int              inodes_per_group;    /* Number of inodes in a "group" */
 	unsigned int              block_group_count;   /* Number of blocks groups */
 
+	uint8_t                 * memory_base;         /* Backing region for memory devices (ramdisk), else NULL */
+
 	ext2_disk_cache_entry_t * disk_cache;          /* Dynamically allocated array of cache entries */
 	unsigned int              cache_entries;       /* Size of ->disk_cache */
-	unsigned int              cache_time;          /* "timer" that increments with each cache read/write */
+	hashmap_t               * cache_index;         /* block_no -> cache entry, O(1) lookup */
+	list_t                  * cache_lru;           /* Cache entries, least recently used first */
+	node_t                  * cache_nodes;         /* Per-entry list nodes for ->cache_lru */
+	unsigned int              cache_dirty;         /* How many entries are waiting for writeback */
+
+	hashmap_t               * block_maps;          /* inode_no -> cached logical->physical map */
+	unsigned int              bmap_count;          /* How many inodes have cached maps */
+	spin_lock_t               bmap_lock;
+
+	hashmap_t               * dir_indexes;         /* directory inode_no -> (name -> inode_no) */
+	unsigned int              diridx_count;        /* How many directories have cached indexes */
+	spin_lock_t               diridx_lock;
+
+	unsigned int              prealloc_inode;      /* Inode owning the preallocation window */
+	unsigned int              prealloc_next;       /* First unused block in the window */
+	unsigned int              prealloc_count;      /* Blocks remaining in the window */
+
+	hashmap_t               * inode_cache;         /* inode_no -> in-core inode */
+	unsigned int              icache_count;        /* How many inodes are in core */
+	spin_lock_t               icache_lock;
 
 	spin_lock_t               lock;                /* Synchronization lock point */
 
@@ -67,33 +92,304 @@ typedef struct {
 #define BLOCKBYTE(n) (bg_buffer[((n) >> 3)])
 #define SETBIT(n)    (1 << (((n) % 8)))
 
+/*
+ * In-core inode cache entries; the on-disk inode structure immediately
+ * follows the header, so holders can be handed the inode pointer itself.
+ */
+#define EXT2_ICACHE_MAX 128 /* In-core inodes before zero-reference entries are dropped */
+
+typedef struct ext2_icache_entry {
+	unsigned int inode_no;
+	unsigned int refcount;
+} ext2_icache_entry_t;
+
+#define ICACHE_INODE(e) ((ext2_inodetable_t *)((uintptr_t)(e) + sizeof(ext2_icache_entry_t)))
+#define ICACHE_ENTRY(i) ((ext2_icache_entry_t *)((uintptr_t)(i) - sizeof(ext2_icache_entry_t)))
+
 static uint32_t node_from_file(ext2_fs_t * this, ext2_inodetable_t *inode, ext2_dir_t *direntry,  fs_node_t *fnode);
 static uint32_t ext2_root(ext2_fs_t * this, ext2_inodetable_t *inode, fs_node_t *fnode);
 static ext2_inodetable_t * read_inode(ext2_fs_t * this, uint32_t inode);
+static void release_inode(ext2_fs_t * this, ext2_inodetable_t * inode);
 static void refresh_inode(ext2_fs_t * this, ext2_inodetable_t * inodet,  uint32_t inode);
 static int write_inode(ext2_fs_t * this, ext2_inodetable_t *inode, uint32_t index);
 static fs_node_t * finddir_ext2(fs_node_t *node, char *name);
-static unsigned int allocate_block(ext2_fs_t * this);
+static unsigned int allocate_block(ext2_fs_t * this, unsigned int inode_no, unsigned int goal);
 
 /**
- * ext2->get_cache_time Increment and return the current cache time
+ * ext2->cache_flush_dirty Flush dirty cache entry to the disk.
  *
- * @returns Current cache time
+ * @param ent_no Cache entry to dump
+ * @returns Error code or E_SUCCESS
+ */
+static int cache_flush_dirty(ext2_fs_t * this, unsigned int ent_no) {
+	write_fs(this->block_device, (DC[ent_no].block_no) * this->block_size, this->block_size, (uint8_t *)(DC[ent_no].block));
+	if (DC[ent_no].dirty) {
+		DC[ent_no].dirty = 0;
+		this->cache_dirty--;
+	}
+
+	return E_SUCCESS;
+}
+
+/**
+ * ext2->cache_touch Move a cache entry to the recently-used end of the LRU.
  */
-static unsigned int get_cache_time(ext2_fs_t * this) {
-	return this->cache_time++;
+static void cache_touch(ext2_fs_t * this, ext2_disk_cache_entry_t * entry) {
+	node_t * node = &this->cache_nodes[entry - DC];
+	list_delete(this->cache_lru, node);
+	list_append(this->cache_lru, node);
 }
 
 /**
- * ext2->cache_flush_dirty Flush dirty cache entry to the disk.
+ * ext2->cache_take_oldest Claim the least recently used cache entry for reuse.
  *
- * @param ent_no Cache entry to dump
+ * The entry is flushed if dirty, dropped from the index, and moved to
+ * the recently-used end of the LRU on the caller's behalf.
+ *
+ * @returns A cache entry ready to hold a new block
+ */
+static ext2_disk_cache_entry_t * cache_take_oldest(ext2_fs_t * this) {
+	node_t * node = this->cache_lru->head;
+	ext2_disk_cache_entry_t * entry = node->value;
+
+	if (entry->dirty) {
+		cache_flush_dirty(this, entry - DC);
+	}
+	if (entry->block_no) {
+		hashmap_remove(this->cache_index, (void *)(uintptr_t)entry->block_no);
+	}
+
+	list_delete(this->cache_lru, node);
+	list_append(this->cache_lru, node);
+
+	return entry;
+}
+
+/*
+ * Per-inode logical->physical block map cache.
+ *
+ * Resolving a block past the direct set means re-reading the same
+ * indirect blocks over and over as a file streams by. Whenever an
+ * indirect walk pulls in a block of pointers, we remember the whole
+ * run it covers, so sequential reads resolve every later block with
+ * one array index. Maps are dropped when an inode's layout changes.
+ */
+#define EXT2_BMAP_MAX 64 /* Inodes with cached maps before we dump them all */
+
+typedef struct ext2_bmap {
+	unsigned int count;        /* Entries allocated */
+	uint32_t * blocks;         /* Logical -> physical; 0 = not yet resolved */
+} ext2_bmap_t;
+
+static unsigned int bmap_lookup(ext2_fs_t * this, unsigned int inode_no, unsigned int iblock) {
+	if (!this->block_maps || !inode_no) return 0;
+	spin_lock(this->bmap_lock);
+	ext2_bmap_t * map = hashmap_get(this->block_maps, (void *)(uintptr_t)inode_no);
+	unsigned int out = (map && iblock < map->count) ? map->blocks[iblock] : 0;
+	spin_unlock(this->bmap_lock);
+	return out;
+}
+
+/* Remember a run of mappings starting at logical block `base`. */
+static void bmap_store(ext2_fs_t * this, unsigned int inode_no, unsigned int base, uint32_t * blocks, unsigned int count) {
+	if (!this->block_maps || !inode_no) return;
+	spin_lock(this->bmap_lock);
+	ext2_bmap_t * map = hashmap_get(this->block_maps, (void *)(uintptr_t)inode_no);
+	if (!map) {
+		if (this->bmap_count >= EXT2_BMAP_MAX) {
+			/* Crude but effective: dump everything and start over */
+			list_t * values = hashmap_values(this->block_maps);
+			foreach(n, values) {
+				ext2_bmap_t * m = n->value;
+				free(m->blocks);
+				free(m);
+			}
+			list_free(values);
+			free(values);
+			hashmap_free(this->block_maps);
+			free(this->block_maps);
+			this->block_maps = hashmap_create_int(EXT2_BMAP_MAX);
+			this->bmap_count = 0;
+		}
+		map = malloc(sizeof(ext2_bmap_t));
+		map->count = 0;
+		map->blocks = NULL;
+		hashmap_set(this->block_maps, (void *)(uintptr_t)inode_no, map);
+		this->bmap_count++;
+	}
+	if (base + count > map->count) {
+		uint32_t * grown = malloc((base + count) * sizeof(uint32_t));
+		memset(grown, 0x00, (base + count) * sizeof(uint32_t));
+		if (map->blocks) {
+			memcpy(grown, map->blocks, map->count * sizeof(uint32_t));
+			free(map->blocks);
+		}
+		map->blocks = grown;
+		map->count = base + count;
+	}
+	memcpy(&map->blocks[base], blocks, count * sizeof(uint32_t));
+	spin_unlock(this->bmap_lock);
+}
+
+/* The inode's block layout changed; forget what we knew about it. */
+static void bmap_invalidate(ext2_fs_t * this, unsigned int inode_no) {
+	if (!this->block_maps || !inode_no) return;
+	spin_lock(this->bmap_lock);
+	ext2_bmap_t * map = hashmap_remove(this->block_maps, (void *)(uintptr_t)inode_no);
+	if (map) this->bmap_count--;
+	spin_unlock(this->bmap_lock);
+	if (map) {
+		free(map->blocks);
+		free(map);
+	}
+}
+
+/*
+ * Per-directory name index.
+ *
+ * finddir used to scan every directory block comparing names, making
+ * each open O(directory size) - painful on spool directories with
+ * thousands of entries. The first lookup in a directory builds a name
+ * hash with a single scan; after that, lookups are O(1). The index is
+ * dropped whenever an entry is created or unlinked, with no change to
+ * the on-disk format.
+ */
+#define EXT2_DIRIDX_MAX 16 /* Directories with cached indexes before we dump them all */
+
+static unsigned int inode_read_block(ext2_fs_t * this, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int block, uint8_t * buf);
+
+static hashmap_t * diridx_get(ext2_fs_t * this, fs_node_t * node) {
+	spin_lock(this->diridx_lock);
+	hashmap_t * names = hashmap_get(this->dir_indexes, (void *)(uintptr_t)node->inode);
+	spin_unlock(this->diridx_lock);
+	if (names) return names;
+
+	/* Build the index with one scan of the directory */
+	ext2_inodetable_t * inode = read_inode(this, node->inode);
+	assert(inode->mode & EXT2_S_IFDIR);
+	names = hashmap_create(16);
+	uint8_t * block = malloc(this->block_size);
+	uint8_t block_nr = 0;
+	inode_read_block(this, inode, node->inode, block_nr, block);
+	uint32_t dir_offset = 0;
+	uint32_t total_offset = 0;
+
+	while (total_offset < inode->size) {
+		if (dir_offset >= this->block_size) {
+			block_nr++;
+			dir_offset -= this->block_size;
+			inode_read_block(this, inode, node->inode, block_nr, block);
+		}
+		ext2_dir_t * d_ent = (ext2_dir_t *)((uintptr_t)block + dir_offset);
+
+		if (d_ent->inode) {
+			char dname[256];
+			memcpy(dname, &(d_ent->name), d_ent->name_len);
+			dname[d_ent->name_len] = '\0';
+			hashmap_set(names, dname, (void *)(uintptr_t)d_ent->inode);
+		}
+
+		dir_offset += d_ent->rec_len;
+		total_offset += d_ent->rec_len;
+	}
+	free(block);
+	release_inode(this, inode);
+
+	spin_lock(this->diridx_lock);
+	hashmap_t * existing = hashmap_get(this->dir_indexes, (void *)(uintptr_t)node->inode);
+	if (existing) {
+		/* Someone raced us to it; theirs is as good as ours */
+		hashmap_free(names);
+		free(names);
+		names = existing;
+	} else {
+		if (this->diridx_count >= EXT2_DIRIDX_MAX) {
+			/* Crude but effective: dump everything and start over */
+			list_t * values = hashmap_values(this->dir_indexes);
+			foreach(n, values) {
+				hashmap_free((hashmap_t *)n->value);
+				free(n->value);
+			}
+			list_free(values);
+			free(values);
+			hashmap_free(this->dir_indexes);
+			free(this->dir_indexes);
+			this->dir_indexes = hashmap_create_int(EXT2_DIRIDX_MAX);
+			this->diridx_count = 0;
+		}
+		hashmap_set(this->dir_indexes, (void *)(uintptr_t)node->inode, names);
+		this->diridx_count++;
+	}
+	spin_unlock(this->diridx_lock);
+
+	return names;
+}
+
+/* The directory changed; forget its index. */
+static void diridx_invalidate(ext2_fs_t * this, unsigned int inode_no) {
+	if (!this->dir_indexes || !inode_no) return;
+	spin_lock(this->diridx_lock);
+	hashmap_t * names = hashmap_remove(this->dir_indexes, (void *)(uintptr_t)inode_no);
+	if (names) this->diridx_count--;
+	spin_unlock(this->diridx_lock);
+	if (names) {
+		hashmap_free(names);
+		free(names);
+	}
+}
+
+/**
+ * ext2->read_block_run Read physically contiguous blocks in one transfer.
+ *
+ * The whole run goes to the device as a single request - which the DMA
+ * path can move in one operation - and any blocks we hold in the cache
+ * are patched over the result afterwards, so write-back dirt is still
+ * honored. The run is deliberately not inserted into the cache: a
+ * streaming read would otherwise evict everything else.
+ *
+ * @param block_no First block of the run
+ * @param count    How many contiguous blocks to read
+ * @param buf      Destination, count * block_size bytes
  * @returns Error code or E_SUCCESS
  */
-static int cache_flush_dirty(ext2_fs_t * this, unsigned int ent_no) {
-	write_fs(this->block_device, (DC[ent_no].block_no) * this->block_size, this->block_size, (uint8_t *)(DC[ent_no].block));
-	DC[ent_no].dirty = 0;
+/* Aggregate cache counters across all mounted instances, for the
+ * debug shell's `stats ext2`. Approximate - not under any lock. */
+static uint32_t ext2_cache_hits = 0;
+static uint32_t ext2_cache_misses = 0;
+
+void ext2_cache_stats(uint32_t * hits, uint32_t * misses) {
+	*hits = ext2_cache_hits;
+	*misses = ext2_cache_misses;
+}
+
+static int read_block_run(ext2_fs_t * this, unsigned int block_no, unsigned int count, uint8_t * buf) {
+	if (!block_no) {
+		return E_BADBLOCK;
+	}
 
+	if (this->memory_base) {
+		memcpy(buf, this->memory_base + block_no * this->block_size, count * this->block_size);
+		return E_SUCCESS;
+	}
+
+	spin_lock(this->lock);
+
+	read_fs(this->block_device, block_no * this->block_size, count * this->block_size, buf);
+
+	if (DC) {
+		for (unsigned int i = 0; i < count; ++i) {
+			ext2_disk_cache_entry_t * entry = hashmap_get(this->cache_index, (void *)(uintptr_t)(block_no + i));
+			if (entry) {
+				memcpy(buf + i * this->block_size, entry->block, this->block_size);
+				cache_touch(this, entry);
+				ext2_cache_hits++;
+			} else {
+				ext2_cache_misses++;
+			}
+		}
+	}
+
+	spin_unlock(this->lock);
 	return E_SUCCESS;
 }
 
@@ -105,6 +401,10 @@ static int cache_flush_dirty(ext2_fs_t * this, unsigned int ent_no) {
  * so we need to special-case it.
  */
 static int rewrite_superblock(ext2_fs_t * this) {
+	if (this->memory_base) {
+		memcpy(this->memory_base + 1024, (uint8_t *)SB, sizeof(ext2_superblock_t));
+		return E_SUCCESS;
+	}
 	write_fs(this->block_device, 1024, sizeof(ext2_superblock_t), (uint8_t *)SB);
 	return E_SUCCESS;
 }
@@ -124,6 +424,13 @@ static int read_block(ext2_fs_t * this, unsigned int block_no, uint8_t * buf) {
 		return E_BADBLOCK;
 	}
 
+	/* Memory-backed devices are their own cache; copy straight out of
+	 * the backing region rather than bouncing through read_fs. */
+	if (this->memory_base) {
+		memcpy(buf, this->memory_base + block_no * this->block_size, this->block_size);
+		return E_SUCCESS;
+	}
+
 	/* This operation requires the filesystem lock to be obtained */
 	spin_lock(this->lock);
 
@@ -137,50 +444,37 @@ static int read_block(ext2_fs_t * this, unsigned int block_no, uint8_t * buf) {
 		return E_SUCCESS;
 	}
 
-	/*
-	 * Search the cache for this entry
-	 * We'll look for the oldest entry, too.
-	 */
-	int oldest = -1;
-	unsigned int oldest_age = UINT32_MAX;
-	for (unsigned int i = 0; i < this->cache_entries; ++i) {
-		if (DC[i].block_no == block_no) {
-			/* We found it! Update usage times */
-			DC[i].last_use = get_cache_time(this);
-			/* Read the block */
-			memcpy(buf, DC[i].block, this->block_size);
-			/* Release the lock */
-			spin_unlock(this->lock);
-			/* Success! */
-			return E_SUCCESS;
-		}
-		if (DC[i].last_use < oldest_age) {
-			/* We found an older block, remember this. */
-			oldest = i;
-			oldest_age = DC[i].last_use;
-		}
+	/* Look the block up in the cache index */
+	ext2_disk_cache_entry_t * entry = hashmap_get(this->cache_index, (void *)(uintptr_t)block_no);
+	if (entry) {
+		/* We found it! Mark it recently used */
+		cache_touch(this, entry);
+		ext2_cache_hits++;
+		/* Read the block */
+		memcpy(buf, entry->block, this->block_size);
+		/* Release the lock */
+		spin_unlock(this->lock);
+		/* Success! */
+		return E_SUCCESS;
 	}
+	ext2_cache_misses++;
 
 	/*
 	 * At this point, we did not find this block in the cache.
 	 * We are going to replace the oldest entry with this new one.
 	 */
+	entry = cache_take_oldest(this);
 
-	/* We'll start by flushing the block if it was dirty. */
-	if (DC[oldest].dirty) {
-		cache_flush_dirty(this, oldest);
-	}
-
-	/* Then we'll read the new one */
-	read_fs(this->block_device, block_no * this->block_size, this->block_size, (uint8_t *)DC[oldest].block);
+	/* Read the new block into it */
+	read_fs(this->block_device, block_no * this->block_size, this->block_size, (uint8_t *)entry->block);
 
 	/* And copy the results to the output buffer */
-	memcpy(buf, DC[oldest].block, this->block_size);
+	memcpy(buf, entry->block, this->block_size);
 
-	/* And update the cache entry to point to the new block */
-	DC[oldest].block_no = block_no;
-	DC[oldest].last_use = get_cache_time(this);
-	DC[oldest].dirty = 0;
+	/* And index the cache entry under the new block */
+	entry->block_no = block_no;
+	entry->dirty = 0;
+	hashmap_set(this->cache_index, (void *)(uintptr_t)block_no, entry);
 
 	/* Release the lock */
 	spin_unlock(this->lock);
@@ -203,6 +497,12 @@ static int write_block(ext2_fs_t * this, unsigned int block_no, uint8_t *buf) {
 		return E_BADBLOCK;
 	}
 
+	/* Memory-backed devices are written in place. */
+	if (this->memory_base) {
+		memcpy(this->memory_base + block_no * this->block_size, buf, this->block_size);
+		return E_SUCCESS;
+	}
+
 	/* This operation requires the filesystem lock */
 	spin_lock(this->lock);
 
@@ -212,36 +512,29 @@ static int write_block(ext2_fs_t * this, unsigned int block_no, uint8_t *buf) {
 		return E_SUCCESS;
 	}
 
-	/* Find the entry in the cache */
-	int oldest = -1;
-	unsigned int oldest_age = UINT32_MAX;
-	for (unsigned int i = 0; i < this->cache_entries; ++i) {
-		if (DC[i].block_no == block_no) {
-			/* We found it. Update the cache entry */
-			DC[i].last_use = get_cache_time(this);
-			DC[i].dirty = 1;
-			memcpy(DC[i].block, buf, this->block_size);
-			spin_unlock(this->lock);
-			return E_SUCCESS;
-		}
-		if (DC[i].last_use < oldest_age) {
-			/* Keep track of the oldest entry */
-			oldest = i;
-			oldest_age = DC[i].last_use;
+	/* Find the entry in the cache index */
+	ext2_disk_cache_entry_t * entry = hashmap_get(this->cache_index, (void *)(uintptr_t)block_no);
+	if (entry) {
+		/* We found it. Update the cache entry */
+		cache_touch(this, entry);
+		if (!entry->dirty) {
+			entry->dirty = 1;
+			this->cache_dirty++;
 		}
+		memcpy(entry->block, buf, this->block_size);
+		spin_unlock(this->lock);
+		return E_SUCCESS;
 	}
 
 	/* We did not find this element in the cache, so make room. */
-	if (DC[oldest].dirty) {
-		/* Flush the oldest entry */
-		cache_flush_dirty(this, oldest);
-	}
+	entry = cache_take_oldest(this);
 
 	/* Update the entry */
-	memcpy(DC[oldest].block, buf, this->block_size);
-	DC[oldest].block_no = block_no;
-	DC[oldest].last_use = get_cache_time(this);
-	DC[oldest].dirty = 1;
+	memcpy(entry->block, buf, this->block_size);
+	entry->block_no = block_no;
+	entry->dirty = 1;
+	this->cache_dirty++;
+	hashmap_set(this->cache_index, (void *)(uintptr_t)block_no, entry);
 
 	/* Release the lock */
 	spin_unlock(this->lock);
@@ -250,21 +543,70 @@ static int write_block(ext2_fs_t * this, unsigned int block_no, uint8_t *buf) {
 	return E_SUCCESS;
 }
 
-static unsigned int ext2_sync(ext2_fs_t * this) {
-	/* This operation requires the filesystem lock */
-	spin_lock(this->lock);
+#define EXT2_FLUSH_INTERVAL 2 /* Seconds between writeback passes */
 
-	/* Flush each cache entry. */
-	for (unsigned int i = 0; i < this->cache_entries; ++i) {
-		if (DC[i].dirty) {
-			cache_flush_dirty(this, i);
+/**
+ * ext2->ext2_flush_task Background writeback for dirty cache blocks.
+ *
+ * Write paths just mark cache entries dirty and return; this tasklet
+ * wakes up periodically and pushes the dirty set to the device in
+ * block-number order, so bursts of writes finish at memory speed and
+ * the disk sees one sorted sweep instead of a random scatter.
+ */
+static void ext2_flush_task(void * data, char * name) {
+	ext2_fs_t * this = data;
+	while (1) {
+		unsigned long s, ss;
+		relative_time(EXT2_FLUSH_INTERVAL, 0, &s, &ss);
+		sleep_until((process_t *)current_process, s, ss);
+		switch_task(0);
+
+		if (!this->cache_dirty) continue;
+
+		spin_lock(this->lock);
+		ext2_disk_cache_entry_t ** dirty = malloc(sizeof(ext2_disk_cache_entry_t *) * this->cache_dirty);
+		unsigned int count = 0;
+		for (unsigned int i = 0; i < this->cache_entries && count < this->cache_dirty; ++i) {
+			if (DC[i].dirty) {
+				dirty[count++] = &DC[i];
+			}
+		}
+		/* Insertion sort by block number; the dirty set is small
+		 * next to the cache itself */
+		for (unsigned int i = 1; i < count; ++i) {
+			ext2_disk_cache_entry_t * e = dirty[i];
+			unsigned int j = i;
+			while (j && dirty[j-1]->block_no > e->block_no) {
+				dirty[j] = dirty[j-1];
+				j--;
+			}
+			dirty[j] = e;
 		}
+		/* Merge physically contiguous entries into single transfers */
+		unsigned int i = 0;
+		while (i < count) {
+			unsigned int run = 1;
+			while (i + run < count && run < 64 &&
+					dirty[i + run]->block_no == dirty[i]->block_no + run) {
+				run++;
+			}
+			if (run > 1) {
+				uint8_t * chunk = malloc(run * this->block_size);
+				for (unsigned int j = 0; j < run; ++j) {
+					memcpy(chunk + j * this->block_size, dirty[i + j]->block, this->block_size);
+					dirty[i + j]->dirty = 0;
+					this->cache_dirty--;
+				}
+				write_fs(this->block_device, dirty[i]->block_no * this->block_size, run * this->block_size, chunk);
+				free(chunk);
+			} else {
+				cache_flush_dirty(this, dirty[i] - DC);
+			}
+			i += run;
+		}
+		free(dirty);
+		spin_unlock(this->lock);
 	}
-
-	/* Release the lock */
-	spin_unlock(this->lock);
-
-	return 0;
 }
 
 /**
@@ -277,6 +619,9 @@ static unsigned int ext2_sync(ext2_fs_t * this) {
  */
 static unsigned int set_block_number(ext2_fs_t * this, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int iblock, unsigned int rblock) {
 
+	/* The cached map is stale the moment the layout changes */
+	bmap_invalidate(this, inode_no);
+
 	unsigned int p = this->pointers_per_block;
 
 	/* We're going to do some crazy math in a bit... */
@@ -290,7 +635,7 @@ static unsigned int set_block_number(ext2_fs_t * this, ext2_inodetable_t * inode
 	} else if (iblock < EXT2_DIRECT_BLOCKS + p) {
 		/* XXX what if inode->block[EXT2_DIRECT_BLOCKS] isn't set? */
 		if (!inode->block[EXT2_DIRECT_BLOCKS]) {
-			unsigned int block_no = allocate_block(this);
+			unsigned int block_no = allocate_block(this, 0, rblock);
 			if (!block_no) return E_NOSPACE;
 			inode->block[EXT2_DIRECT_BLOCKS] = block_no;
 			write_inode(this, inode, inode_no);
@@ -310,7 +655,7 @@ static unsigned int set_block_number(ext2_fs_t * this, ext2_inodetable_t * inode
 		d = b - c * p;
 
 		if (!inode->block[EXT2_DIRECT_BLOCKS+1]) {
-			unsigned int block_no = allocate_block(this);
+			unsigned int block_no = allocate_block(this, 0, rblock);
 			if (!block_no) return E_NOSPACE;
 			inode->block[EXT2_DIRECT_BLOCKS+1] = block_no;
 			write_inode(this, inode, inode_no);
@@ -320,7 +665,7 @@ static unsigned int set_block_number(ext2_fs_t * this, ext2_inodetable_t * inode
 		read_block(this, inode->block[EXT2_DIRECT_BLOCKS + 1], (uint8_t *)tmp);
 
 		if (!((uint32_t *)tmp)[c]) {
-			unsigned int block_no = allocate_block(this);
+			unsigned int block_no = allocate_block(this, 0, rblock);
 			if (!block_no) goto no_space_free;
 			((uint32_t *)tmp)[c] = block_no;
 			write_block(this, inode->block[EXT2_DIRECT_BLOCKS + 1], (uint8_t *)tmp);
@@ -344,7 +689,7 @@ static unsigned int set_block_number(ext2_fs_t * this, ext2_inodetable_t * inode
 		g = e - f * p;
 
 		if (!inode->block[EXT2_DIRECT_BLOCKS+2]) {
-			unsigned int block_no = allocate_block(this);
+			unsigned int block_no = allocate_block(this, 0, rblock);
 			if (!block_no) return E_NOSPACE;
 			inode->block[EXT2_DIRECT_BLOCKS+2] = block_no;
 			write_inode(this, inode, inode_no);
@@ -354,7 +699,7 @@ static unsigned int set_block_number(ext2_fs_t * this, ext2_inodetable_t * inode
 		read_block(this, inode->block[EXT2_DIRECT_BLOCKS + 2], (uint8_t *)tmp);
 
 		if (!((uint32_t *)tmp)[d]) {
-			unsigned int block_no = allocate_block(this);
+			unsigned int block_no = allocate_block(this, 0, rblock);
 			if (!block_no) goto no_space_free;
 			((uint32_t *)tmp)[d] = block_no;
 			write_block(this, inode->block[EXT2_DIRECT_BLOCKS + 2], (uint8_t *)tmp);
@@ -364,7 +709,7 @@ static unsigned int set_block_number(ext2_fs_t * this, ext2_inodetable_t * inode
 		read_block(this, nblock, (uint8_t *)tmp);
 
 		if (!((uint32_t *)tmp)[f]) {
-			unsigned int block_no = allocate_block(this);
+			unsigned int block_no = allocate_block(this, 0, rblock);
 			if (!block_no) goto no_space_free;
 			((uint32_t *)tmp)[f] = block_no;
 			write_block(this, nblock, (uint8_t *)tmp);
@@ -394,7 +739,7 @@ no_space_free:
  * @param iblock  Block offset within the inode
  * @returns Real block number
  */
-static unsigned int get_block_number(ext2_fs_t * this, ext2_inodetable_t * inode, unsigned int iblock) {
+static unsigned int get_block_number(ext2_fs_t * this, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int iblock) {
 
 	unsigned int p = this->pointers_per_block;
 
@@ -405,11 +750,22 @@ static unsigned int get_block_number(ext2_fs_t * this, ext2_inodetable_t * inode
 
 	if (iblock < EXT2_DIRECT_BLOCKS) {
 		return inode->block[iblock];
-	} else if (iblock < EXT2_DIRECT_BLOCKS + p) {
+	}
+
+	/* Maybe we've resolved this one before */
+	unsigned int cached = bmap_lookup(this, inode_no, iblock);
+	if (cached) {
+		return cached;
+	}
+
+	if (iblock < EXT2_DIRECT_BLOCKS + p) {
 		/* XXX what if inode->block[EXT2_DIRECT_BLOCKS] isn't set? */
 		tmp = malloc(this->block_size);
 		read_block(this, inode->block[EXT2_DIRECT_BLOCKS], (uint8_t *)tmp);
 
+		/* This pointer block covers a whole run; remember all of it */
+		bmap_store(this, inode_no, EXT2_DIRECT_BLOCKS, (uint32_t *)tmp, p);
+
 		unsigned int out = ((uint32_t *)tmp)[iblock - EXT2_DIRECT_BLOCKS];
 		free(tmp);
 		return out;
@@ -425,6 +781,8 @@ static unsigned int get_block_number(ext2_fs_t * this, ext2_inodetable_t * inode
 		uint32_t nblock = ((uint32_t *)tmp)[c];
 		read_block(this, nblock, (uint8_t *)tmp);
 
+		bmap_store(this, inode_no, EXT2_DIRECT_BLOCKS + p + c * p, (uint32_t *)tmp, p);
+
 		unsigned int out = ((uint32_t  *)tmp)[d];
 		free(tmp);
 		return out;
@@ -446,6 +804,8 @@ static unsigned int get_block_number(ext2_fs_t * this, ext2_inodetable_t * inode
 		nblock = ((uint32_t *)tmp)[f];
 		read_block(this, nblock, (uint8_t *)tmp);
 
+		bmap_store(this, inode_no, EXT2_DIRECT_BLOCKS + p + p * p + d * p * p + f * p, (uint32_t *)tmp, p);
+
 		unsigned int out = ((uint32_t  *)tmp)[g];
 		free(tmp);
 		return out;
@@ -462,6 +822,14 @@ static int write_inode(ext2_fs_t * this, ext2_inodetable_t *inode, uint32_t inde
 		return E_BADBLOCK;
 	}
 
+	/* Keep the in-core copy coherent if the caller wrote a private one */
+	spin_lock(this->icache_lock);
+	ext2_icache_entry_t * entry = hashmap_get(this->inode_cache, (void *)index);
+	if (entry && ICACHE_INODE(entry) != inode) {
+		memcpy(ICACHE_INODE(entry), inode, this->inode_size);
+	}
+	spin_unlock(this->icache_lock);
+
 	uint32_t inode_table_block = BGD[group].inode_table;
 	index -= group * this->inodes_per_group;
 	uint32_t block_offset = ((index - 1) * this->inode_size) / this->block_size;
@@ -477,21 +845,89 @@ static int write_inode(ext2_fs_t * this, ext2_inodetable_t *inode, uint32_t inde
 	return E_SUCCESS;
 }
 
-static unsigned int allocate_block(ext2_fs_t * this) {
+#define EXT2_PREALLOC_BLOCKS 8 /* Window grabbed ahead of an appending file */
+
+/**
+ * ext2->prealloc_release Return the unused preallocation window to the bitmap.
+ *
+ * Called before the window moves to another inode so that at most one
+ * window is ever outstanding. The window never spans a block group.
+ */
+static void prealloc_release(ext2_fs_t * this) {
+	if (!this->prealloc_count) return;
+
+	uint8_t * bg_buffer = malloc(this->block_size);
+	unsigned int group = this->prealloc_next / SB->blocks_per_group;
+	read_block(this, BGD[group].block_bitmap, (uint8_t *)bg_buffer);
+	while (this->prealloc_count) {
+		unsigned int block_offset = this->prealloc_next % SB->blocks_per_group;
+		BLOCKBYTE(block_offset) &= ~SETBIT(block_offset);
+		BGD[group].free_blocks_count++;
+		SB->free_blocks_count++;
+		this->prealloc_next++;
+		this->prealloc_count--;
+	}
+	write_block(this, BGD[group].block_bitmap, (uint8_t *)bg_buffer);
+	for (int i = 0; i < this->bgd_block_span; ++i) {
+		write_block(this, this->bgd_offset + i, (uint8_t *)((uint32_t)BGD + this->block_size * i));
+	}
+	rewrite_superblock(this);
+	free(bg_buffer);
+}
+
+/**
+ * ext2->allocate_block Allocate a free block, preferably near `goal`.
+ *
+ * @param inode_no Inode the block is for (0 if it's filesystem metadata)
+ * @param goal     Preferred block number, or 0 for no preference
+ * @returns Block number, or 0 if the disk is full
+ */
+static unsigned int allocate_block(ext2_fs_t * this, unsigned int inode_no, unsigned int goal) {
 	unsigned int block_no     = 0;
 	unsigned int block_offset = 0;
 	unsigned int group        = 0;
 	uint8_t * bg_buffer = malloc(this->block_size);
 
-	for (unsigned int i = 0; i < BGDS; ++i) {
-		if (BGD[i].free_blocks_count > 0) {
-			read_block(this, BGD[i].block_bitmap, (uint8_t *)bg_buffer);
-			while (BLOCKBIT(block_offset)) {
-				++block_offset;
+	/* Appends are served straight from the preallocation window */
+	if (inode_no && this->prealloc_count &&
+	    this->prealloc_inode == inode_no && this->prealloc_next == goal) {
+		block_no = this->prealloc_next++;
+		this->prealloc_count--;
+		memset(bg_buffer, 0x00, this->block_size);
+		write_block(this, block_no, bg_buffer);
+		free(bg_buffer);
+		return block_no;
+	}
+
+	prealloc_release(this);
+
+	/* Try the goal first so files grow contiguously and stay in their
+	 * inode's own group. */
+	if (goal) {
+		group = goal / SB->blocks_per_group;
+		if (group < BGDS && BGD[group].free_blocks_count > 0) {
+			read_block(this, BGD[group].block_bitmap, (uint8_t *)bg_buffer);
+			int first_free = bitset_ffub_raw(bg_buffer, SB->blocks_per_group / 8, goal % SB->blocks_per_group);
+			if (first_free >= 0 && (unsigned int)first_free < SB->blocks_per_group) {
+				block_offset = first_free;
+				block_no = block_offset + SB->blocks_per_group * group;
+			}
+			if (!block_no) block_offset = 0;
+		}
+	}
+
+	/* Fall back to the first free block anywhere */
+	if (!block_no) {
+		for (unsigned int i = 0; i < BGDS; ++i) {
+			if (BGD[i].free_blocks_count > 0) {
+				read_block(this, BGD[i].block_bitmap, (uint8_t *)bg_buffer);
+				int first_free = bitset_ffub_raw(bg_buffer, SB->blocks_per_group / 8, 0);
+				if (first_free < 0) continue;
+				block_offset = first_free;
+				block_no = block_offset + SB->blocks_per_group * i;
+				group = i;
+				break;
 			}
-			block_no = block_offset + SB->blocks_per_group * i;
-			group = i;
-			break;
 		}
 	}
 
@@ -504,14 +940,32 @@ static unsigned int allocate_block(ext2_fs_t * this) {
 	debug_print(WARNING, "allocating block #%d (group %d)", block_no, group);
 
 	BLOCKBYTE(block_offset) |= SETBIT(block_offset);
+	unsigned int taken = 1;
+
+	/* Reserve the free bits right behind us so the next appends to this
+	 * file land contiguously. */
+	if (inode_no && goal) {
+		this->prealloc_inode = inode_no;
+		this->prealloc_next  = block_no + 1;
+		this->prealloc_count = 0;
+		for (unsigned int i = block_offset + 1;
+		     i < SB->blocks_per_group && this->prealloc_count < EXT2_PREALLOC_BLOCKS - 1;
+		     ++i) {
+			if (BLOCKBIT(i)) break;
+			BLOCKBYTE(i) |= SETBIT(i);
+			this->prealloc_count++;
+			taken++;
+		}
+	}
+
 	write_block(this, BGD[group].block_bitmap, (uint8_t *)bg_buffer);
 
-	BGD[group].free_blocks_count--;
+	BGD[group].free_blocks_count -= taken;
 	for (int i = 0; i < this->bgd_block_span; ++i) {
 		write_block(this, this->bgd_offset + i, (uint8_t *)((uint32_t)BGD + this->block_size * i));
 	}
 
-	SB->free_blocks_count--;
+	SB->free_blocks_count -= taken;
 	rewrite_superblock(this);
 
 	memset(bg_buffer, 0x00, this->block_size);
@@ -534,7 +988,20 @@ static unsigned int allocate_block(ext2_fs_t * this) {
  */
 static int allocate_inode_block(ext2_fs_t * this, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int block) {
 	debug_print(NOTICE, "Allocating block #%d for inode #%d", block, inode_no);
-	unsigned int block_no = allocate_block(this);
+
+	/* Aim for the block right after the file's last one; failing that,
+	 * start in the inode's own group so data stays near its metadata. */
+	unsigned int goal = 0;
+	if (block > 0) {
+		unsigned int prev = get_block_number(this, inode, inode_no, block - 1);
+		if (prev) goal = prev + 1;
+	}
+	if (!goal) {
+		goal = ((inode_no - 1) / this->inodes_per_group) * SB->blocks_per_group;
+		if (!goal) goal = 1;
+	}
+
+	unsigned int block_no = allocate_block(this, inode_no, goal);
 
 	if (!block_no) return E_NOSPACE;
 
@@ -559,7 +1026,7 @@ static int allocate_inode_block(ext2_fs_t * this, ext2_inodetable_t * inode, uns
  * @parma buf
  * @returns Real block number for reference.
  */
-static unsigned int inode_read_block(ext2_fs_t * this, ext2_inodetable_t * inode, unsigned int block, uint8_t * buf) {
+static unsigned int inode_read_block(ext2_fs_t * this, ext2_inodetable_t * inode, unsigned int inode_no, unsigned int block, uint8_t * buf) {
 
 	if (block >= inode->blocks / (this->block_size / 512)) {
 		memset(buf, 0x00, this->block_size);
@@ -567,7 +1034,7 @@ static unsigned int inode_read_block(ext2_fs_t * this, ext2_inodetable_t * inode
 		return 0;
 	}
 
-	unsigned int real_block = get_block_number(this, inode, block);
+	unsigned int real_block = get_block_number(this, inode, inode_no, block);
 	read_block(this, real_block, buf);
 
 	return real_block;
@@ -591,7 +1058,7 @@ static unsigned int inode_write_block(ext2_fs_t * this, ext2_inodetable_t * inod
 	if (empty) free(empty);
 	debug_print(WARNING, "... done");
 
-	unsigned int real_block = get_block_number(this, inode, block);
+	unsigned int real_block = get_block_number(this, inode, inode_no, block);
 	debug_print(WARNING, "Writing virtual block %d for inode %d maps to real block %d", block, inode_no, real_block);
 
 	write_block(this, real_block, buf);
@@ -638,12 +1105,12 @@ static int create_entry(fs_node_t * parent, char * name, uint32_t inode) {
 	int modify_or_replace = 0;
 	ext2_dir_t *previous;
 
-	inode_read_block(this, pinode, block_nr, block);
+	inode_read_block(this, pinode, parent->inode, block_nr, block);
 	while (total_offset < pinode->size) {
 		if (dir_offset >= this->block_size) {
 			block_nr++;
 			dir_offset -= this->block_size;
-			inode_read_block(this, pinode, block_nr, block);
+			inode_read_block(this, pinode, parent->inode, block_nr, block);
 		}
 		ext2_dir_t *d_ent = (ext2_dir_t *)((uintptr_t)block + dir_offset);
 
@@ -717,8 +1184,9 @@ static int create_entry(fs_node_t * parent, char * name, uint32_t inode) {
 	inode_write_block(this, pinode, parent->inode, block_nr, block);
 
 	free(block);
-	free(pinode);
+	release_inode(this, pinode);
 
+	diridx_invalidate(this, parent->inode);
 
 	return E_NOSPACE;
 }
@@ -733,9 +1201,9 @@ static unsigned int allocate_inode(ext2_fs_t * this) {
 		if (BGD[i].free_inodes_count > 0) {
 			debug_print(NOTICE, "Group %d has %d free inodes.", i, BGD[i].free_inodes_count);
 			read_block(this, BGD[i].inode_bitmap, (uint8_t *)bg_buffer);
-			while (BLOCKBIT(node_offset)) {
-				node_offset++;
-			}
+			int first_free = bitset_ffub_raw(bg_buffer, this->inodes_per_group / 8, 0);
+			if (first_free < 0) continue;
+			node_offset = first_free;
 			node_no = node_offset + i * this->inodes_per_group + 1;
 			group = i;
 			break;
@@ -835,14 +1303,14 @@ static void mkdir_ext2(fs_node_t * parent, char * name, uint16_t permission) {
 
 	inode_write_block(this, inode, inode_no, 0, tmp);
 
-	free(inode);
+	release_inode(this, inode);
 	free(tmp);
 
 	/* Update parent link count */
 	ext2_inodetable_t * pinode = read_inode(this, parent->inode);
 	pinode->links_count++;
 	write_inode(this, pinode, parent->inode);
-	free(pinode);
+	release_inode(this, pinode);
 
 	/* Update directory count in block group descriptor */
 	uint32_t group = inode_no / this->inodes_per_group;
@@ -851,8 +1319,6 @@ static void mkdir_ext2(fs_node_t * parent, char * name, uint16_t permission) {
 		write_block(this, this->bgd_offset + i, (uint8_t *)((uint32_t)BGD + this->block_size * i));
 	}
 
-	ext2_sync(this);
-
 }
 
 static void create_ext2(fs_node_t * parent, char * name, uint16_t permission) {
@@ -910,9 +1376,7 @@ static void create_ext2(fs_node_t * parent, char * name, uint16_t permission) {
 	/* Now append the entry to the parent */
 	create_entry(parent, name, inode_no);
 
-	free(inode);
-
-	ext2_sync(this);
+	release_inode(this, inode);
 
 }
 
@@ -924,8 +1388,7 @@ static int chmod_ext2(fs_node_t * node, int mode) {
 	inode->mode = (inode->mode & 0xFFFFF000) | mode;
 
 	write_inode(this, inode, node->inode);
-
-	ext2_sync(this);
+	release_inode(this, inode);
 
 	return 0;
 }
@@ -936,7 +1399,7 @@ static int chmod_ext2(fs_node_t * node, int mode) {
 static ext2_dir_t * direntry_ext2(ext2_fs_t * this, ext2_inodetable_t * inode, uint32_t no, uint32_t index) {
 	uint8_t *block = malloc(this->block_size);
 	uint8_t block_nr = 0;
-	inode_read_block(this, inode, block_nr, block);
+	inode_read_block(this, inode, no, block_nr, block);
 	uint32_t dir_offset = 0;
 	uint32_t total_offset = 0;
 	uint32_t dir_index = 0;
@@ -961,7 +1424,7 @@ static ext2_dir_t * direntry_ext2(ext2_fs_t * this, ext2_inodetable_t * inode, u
 		if (dir_offset >= this->block_size) {
 			block_nr++;
 			dir_offset -= this->block_size;
-			inode_read_block(this, inode, block_nr, block);
+			inode_read_block(this, inode, no, block_nr, block);
 		}
 	}
 
@@ -976,61 +1439,29 @@ static fs_node_t * finddir_ext2(fs_node_t *node, char *name) {
 
 	ext2_fs_t * this = (ext2_fs_t *)node->device;
 
-	ext2_inodetable_t *inode = read_inode(this,node->inode);
-	assert(inode->mode & EXT2_S_IFDIR);
-	uint8_t * block = malloc(this->block_size);
-	ext2_dir_t *direntry = NULL;
-	uint8_t block_nr = 0;
-	inode_read_block(this, inode, block_nr, block);
-	uint32_t dir_offset = 0;
-	uint32_t total_offset = 0;
+	hashmap_t * names = diridx_get(this, node);
+	unsigned int ino = (unsigned int)(uintptr_t)hashmap_get(names, name);
+	if (!ino) return NULL;
 
-	while (total_offset < inode->size) {
-		if (dir_offset >= this->block_size) {
-			block_nr++;
-			dir_offset -= this->block_size;
-			inode_read_block(this, inode, block_nr, block);
-		}
-		ext2_dir_t *d_ent = (ext2_dir_t *)((uintptr_t)block + dir_offset);
+	/* Fabricate a directory entry from the index hit */
+	ext2_dir_t * direntry = malloc(sizeof(ext2_dir_t) + strlen(name));
+	direntry->inode = ino;
+	direntry->rec_len = sizeof(ext2_dir_t) + strlen(name);
+	direntry->name_len = strlen(name);
+	direntry->file_type = 0;
+	memcpy(direntry->name, name, strlen(name));
 
-		if (d_ent->inode == 0 || strlen(name) != d_ent->name_len) {
-			dir_offset += d_ent->rec_len;
-			total_offset += d_ent->rec_len;
-
-			continue;
-		}
-
-		char *dname = malloc(sizeof(char) * (d_ent->name_len + 1));
-		memcpy(dname, &(d_ent->name), d_ent->name_len);
-		dname[d_ent->name_len] = '\0';
-		if (!strcmp(dname, name)) {
-			free(dname);
-			direntry = malloc(d_ent->rec_len);
-			memcpy(direntry, d_ent, d_ent->rec_len);
-			break;
-		}
-		free(dname);
-
-		dir_offset += d_ent->rec_len;
-		total_offset += d_ent->rec_len;
-	}
-	free(inode);
-	if (!direntry) {
-		free(block);
-		return NULL;
-	}
 	fs_node_t *outnode = malloc(sizeof(fs_node_t));
 	memset(outnode, 0, sizeof(fs_node_t));
 
-	inode = read_inode(this, direntry->inode);
+	ext2_inodetable_t * inode = read_inode(this, direntry->inode);
 
 	if (!node_from_file(this, inode, direntry, outnode)) {
 		debug_print(CRITICAL, "Oh dear. Couldn't allocate the outnode?");
 	}
 
 	free(direntry);
-	free(inode);
-	free(block);
+	release_inode(this, inode);
 	return outnode;
 }
 
@@ -1043,7 +1474,7 @@ static void unlink_ext2(fs_node_t * node, char * name) {
 	uint8_t * block = malloc(this->block_size);
 	ext2_dir_t *direntry = NULL;
 	uint8_t block_nr = 0;
-	inode_read_block(this, inode, block_nr, block);
+	inode_read_block(this, inode, node->inode, block_nr, block);
 	uint32_t dir_offset = 0;
 	uint32_t total_offset = 0;
 
@@ -1051,7 +1482,7 @@ static void unlink_ext2(fs_node_t * node, char * name) {
 		if (dir_offset >= this->block_size) {
 			block_nr++;
 			dir_offset -= this->block_size;
-			inode_read_block(this, inode, block_nr, block);
+			inode_read_block(this, inode, node->inode, block_nr, block);
 		}
 		ext2_dir_t *d_ent = (ext2_dir_t *)((uintptr_t)block + dir_offset);
 
@@ -1075,8 +1506,8 @@ static void unlink_ext2(fs_node_t * node, char * name) {
 		dir_offset += d_ent->rec_len;
 		total_offset += d_ent->rec_len;
 	}
-	free(inode);
 	if (!direntry) {
+		release_inode(this, inode);
 		free(block);
 		return;
 	}
@@ -1084,9 +1515,10 @@ static void unlink_ext2(fs_node_t * node, char * name) {
 	direntry->inode = 0;
 
 	inode_write_block(this, inode, node->inode, block_nr, block);
+	release_inode(this, inode);
 	free(block);
 
-	ext2_sync(this);
+	diridx_invalidate(this, node->inode);
 }
 
 
@@ -1114,17 +1546,68 @@ static void refresh_inode(ext2_fs_t * this, ext2_inodetable_t * inodet,  uint32_
 /**
  * read_inode
  */
+/*
+ * In-core inode cache.
+ *
+ * read_inode used to malloc a fresh copy and re-read the containing
+ * table block on every call, with callers freeing it immediately -
+ * stat-heavy workloads spent their time in the allocator. Inodes now
+ * live in a reference-counted cache keyed by inode number; repeat
+ * lookups share the same in-core structure and mutations write back
+ * through write_inode(). Entries linger at zero references until the
+ * cache is over budget, so hot inodes survive between opens.
+ */
 static ext2_inodetable_t * read_inode(ext2_fs_t * this, uint32_t inode) {
-	ext2_inodetable_t *inodet   = malloc(this->inode_size);
-	refresh_inode(this, inodet, inode);
-	return inodet;
+	spin_lock(this->icache_lock);
+	ext2_icache_entry_t * entry = hashmap_get(this->inode_cache, (void *)inode);
+	if (entry) {
+		entry->refcount++;
+		spin_unlock(this->icache_lock);
+		return ICACHE_INODE(entry);
+	}
+
+	if (this->icache_count >= EXT2_ICACHE_MAX) {
+		/* Drop every inode nobody is holding a reference to */
+		list_t * keys = hashmap_keys(this->inode_cache);
+		foreach(n, keys) {
+			ext2_icache_entry_t * e = hashmap_get(this->inode_cache, n->value);
+			if (e->refcount == 0) {
+				hashmap_remove(this->inode_cache, n->value);
+				free(e);
+				this->icache_count--;
+			}
+		}
+		list_free(keys);
+		free(keys);
+	}
+
+	entry = malloc(sizeof(ext2_icache_entry_t) + this->inode_size);
+	entry->inode_no = inode;
+	entry->refcount = 1;
+	refresh_inode(this, ICACHE_INODE(entry), inode);
+	hashmap_set(this->inode_cache, (void *)inode, entry);
+	this->icache_count++;
+	spin_unlock(this->icache_lock);
+
+	return ICACHE_INODE(entry);
+}
+
+static void release_inode(ext2_fs_t * this, ext2_inodetable_t * inode) {
+	if (!inode) return;
+	ext2_icache_entry_t * entry = ICACHE_ENTRY(inode);
+	spin_lock(this->icache_lock);
+	if (entry->refcount) entry->refcount--;
+	spin_unlock(this->icache_lock);
 }
 
 static uint32_t read_ext2(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
 	ext2_fs_t * this = (ext2_fs_t *)node->device;
 	ext2_inodetable_t * inode = read_inode(this, node->inode);
 	uint32_t end;
-	if (inode->size == 0) return 0;
+	if (inode->size == 0) {
+		release_inode(this, inode);
+		return 0;
+	}
 	if (offset + size > inode->size) {
 		end = inode->size;
 	} else {
@@ -1137,26 +1620,46 @@ static uint32_t read_ext2(fs_node_t *node, uint32_t offset, uint32_t size, uint8
 
 	uint8_t * buf = malloc(this->block_size);
 	if (start_block == end_block) {
-		inode_read_block(this, inode, start_block, buf);
+		inode_read_block(this, inode, node->inode, start_block, buf);
 		memcpy(buffer, (uint8_t *)(((uint32_t)buf) + (offset % this->block_size)), size_to_read);
 	} else {
-		uint32_t block_offset;
+		uint32_t block_offset = start_block;
 		uint32_t blocks_read = 0;
-		for (block_offset = start_block; block_offset < end_block; block_offset++, blocks_read++) {
-			if (block_offset == start_block) {
-				inode_read_block(this, inode, block_offset, buf);
-				memcpy(buffer, (uint8_t *)(((uint32_t)buf) + (offset % this->block_size)), this->block_size - (offset % this->block_size));
+		/* A partial first block comes through the cache */
+		if (offset % this->block_size) {
+			inode_read_block(this, inode, node->inode, block_offset, buf);
+			memcpy(buffer, (uint8_t *)(((uint32_t)buf) + (offset % this->block_size)), this->block_size - (offset % this->block_size));
+			block_offset++;
+			blocks_read++;
+		}
+		/*
+		 * Full blocks: walk the mapping looking for physically
+		 * contiguous runs and move each run in a single transfer
+		 * instead of one request per filesystem block.
+		 */
+		while (block_offset < end_block) {
+			uint32_t run_start = get_block_number(this, inode, node->inode, block_offset);
+			uint32_t run = 1;
+			while (block_offset + run < end_block &&
+					get_block_number(this, inode, node->inode, block_offset + run) == run_start + run) {
+				run++;
+			}
+			uint8_t * out = buffer + this->block_size * blocks_read - (offset % this->block_size);
+			if (run > 1) {
+				read_block_run(this, run_start, run, out);
 			} else {
-				inode_read_block(this, inode, block_offset, buf);
-				memcpy(buffer + this->block_size * blocks_read - (offset % this->block_size), buf, this->block_size);
+				inode_read_block(this, inode, node->inode, block_offset, buf);
+				memcpy(out, buf, this->block_size);
 			}
+			block_offset += run;
+			blocks_read += run;
 		}
 		if (end_size) {
-			inode_read_block(this, inode, end_block, buf);
+			inode_read_block(this, inode, node->inode, end_block, buf);
 			memcpy(buffer + this->block_size * blocks_read - (offset % this->block_size), buf, end_size);
 		}
 	}
-	free(inode);
+	release_inode(this, inode);
 	free(buf);
 	return size_to_read;
 }
@@ -1174,7 +1677,7 @@ static uint32_t write_inode_buffer(ext2_fs_t * this, ext2_inodetable_t * inode,
 	uint32_t size_to_read = end - offset;
 	uint8_t * buf = malloc(this->block_size);
 	if (start_block == end_block) {
-		inode_read_block(this, inode, start_block, buf);
+		inode_read_block(this, inode, inode_number, start_block, buf);
 		memcpy((uint8_t *)(((uint32_t)buf) + (offset % this->block_size)), buffer, size_to_read);
 		inode_write_block(this, inode, inode_number, start_block, buf);
 	} else {
@@ -1182,14 +1685,14 @@ static uint32_t write_inode_buffer(ext2_fs_t * this, ext2_inodetable_t * inode,
 		uint32_t blocks_read = 0;
 		for (block_offset = start_block; block_offset < end_block; block_offset++, blocks_read++) {
 			if (block_offset == start_block) {
-				int b = inode_read_block(this, inode, block_offset, buf);
+				int b = inode_read_block(this, inode, inode_number, block_offset, buf);
 				memcpy((uint8_t *)(((uint32_t)buf) + (offset % this->block_size)), buffer, this->block_size - (offset % this->block_size));
 				inode_write_block(this, inode, inode_number, block_offset, buf);
 				if (!b) {
 					refresh_inode(this, inode, inode_number);
 				}
 			} else {
-				int b = inode_read_block(this, inode, block_offset, buf);
+				int b = inode_read_block(this, inode, inode_number, block_offset, buf);
 				memcpy(buf, buffer + this->block_size * blocks_read - (offset % this->block_size), this->block_size);
 				inode_write_block(this, inode, inode_number, block_offset, buf);
 				if (!b) {
@@ -1198,7 +1701,7 @@ static uint32_t write_inode_buffer(ext2_fs_t * this, ext2_inodetable_t * inode,
 			}
 		}
 		if (end_size) {
-			inode_read_block(this, inode, end_block, buf);
+			inode_read_block(this, inode, inode_number, end_block, buf);
 			memcpy(buf, buffer + this->block_size * blocks_read - (offset % this->block_size), end_size);
 			inode_write_block(this, inode, inode_number, end_block, buf);
 		}
@@ -1212,7 +1715,7 @@ static uint32_t write_ext2(fs_node_t *node, uint32_t offset, uint32_t size, uint
 	ext2_inodetable_t * inode = read_inode(this, node->inode);
 
 	uint32_t rv = write_inode_buffer(this, inode, node->inode, offset, size, buffer);
-	free(inode);
+	release_inode(this, inode);
 	return rv;
 }
 
@@ -1224,6 +1727,7 @@ static void open_ext2(fs_node_t *node, unsigned int flags) {
 		ext2_inodetable_t * inode = read_inode(this,node->inode);
 		inode->size = 0;
 		write_inode(this, inode, node->inode);
+		release_inode(this, inode);
 	}
 }
 
@@ -1231,6 +1735,34 @@ static void close_ext2(fs_node_t *node) {
 	/* Nothing to do here */
 }
 
+/**
+ * ext2->ioctl_ext2 Node ioctls.
+ *
+ * IOCTL_SYNC pushes everything the write-back cache is still holding
+ * out to the block device and then asks the device to flush its own
+ * queue, so fsync means the data actually reached the disk rather
+ * than the next layer of caching.
+ */
+static int ioctl_ext2(fs_node_t * node, int request, void * argp) {
+	ext2_fs_t * this = node->device;
+	switch (request) {
+		case IOCTL_SYNC:
+			if (DC) {
+				spin_lock(this->lock);
+				for (unsigned int i = 0; i < this->cache_entries && this->cache_dirty; ++i) {
+					if (DC[i].dirty) {
+						cache_flush_dirty(this, i);
+					}
+				}
+				spin_unlock(this->lock);
+			}
+			ioctl_fs(this->block_device, IOCTL_ATA_FLUSH, NULL);
+			return 0;
+		default:
+			return -1;
+	}
+}
+
 
 /**
  * readdir_ext2
@@ -1243,7 +1775,7 @@ static struct dirent * readdir_ext2(fs_node_t *node, uint32_t index) {
 	assert(inode->mode & EXT2_S_IFDIR);
 	ext2_dir_t *direntry = direntry_ext2(this, inode, node->inode, index);
 	if (!direntry) {
-		free(inode);
+		release_inode(this, inode);
 		return NULL;
 	}
 	struct dirent *dirent = malloc(sizeof(struct dirent));
@@ -1251,7 +1783,7 @@ static struct dirent * readdir_ext2(fs_node_t *node, uint32_t index) {
 	dirent->name[direntry->name_len] = '\0';
 	dirent->ino = direntry->inode;
 	free(direntry);
-	free(inode);
+	release_inode(this, inode);
 	return dirent;
 }
 
@@ -1322,9 +1854,7 @@ static void symlink_ext2(fs_node_t * parent, char * target, char * name) {
 	if (!embedded) {
 		write_inode_buffer(parent->device, inode, inode_no, 0, target_len, (uint8_t *)target);
 	}
-	free(inode);
-
-	ext2_sync(this);
+	release_inode(this, inode);
 }
 
 static int readlink_ext2(fs_node_t * node, char * buf, size_t size) {
@@ -1342,7 +1872,7 @@ static int readlink_ext2(fs_node_t * node, char * buf, size_t size) {
 		buf[read_size] = '\0';
 	}
 
-	free(inode);
+	release_inode(this, inode);
 	return read_size;
 }
 
@@ -1416,7 +1946,7 @@ static uint32_t node_from_file(ext2_fs_t * this, ext2_inodetable_t *inode, ext2_
 	fnode->chmod   = chmod_ext2;
 	fnode->open    = open_ext2;
 	fnode->close   = close_ext2;
-	fnode->ioctl   = NULL;
+	fnode->ioctl   = ioctl_ext2;
 	return 1;
 }
 
@@ -1481,7 +2011,7 @@ static uint32_t ext2_root(ext2_fs_t * this, ext2_inodetable_t *inode, fs_node_t
 	fnode->close   = close_ext2;
 	fnode->readdir = readdir_ext2;
 	fnode->finddir = finddir_ext2;
-	fnode->ioctl   = NULL;
+	fnode->ioctl   = ioctl_ext2;
 	fnode->create  = create_ext2;
 	fnode->mkdir   = mkdir_ext2;
 	fnode->unlink  = unlink_ext2;
@@ -1499,6 +2029,14 @@ static fs_node_t * mount_ext2(fs_node_t * block_device) {
 	this->block_size = 1024;
 	vfs_lock(this->block_device);
 
+	/* If this is a ramdisk, serve blocks directly out of the module
+	 * region instead of copying them through a cache; the image is
+	 * already sitting in memory. */
+	this->memory_base = ramdisk_fetch(block_device);
+	if (this->memory_base) {
+		debug_print(NOTICE, "ext2: %s is memory-backed; skipping the block cache", block_device->name);
+	}
+
 	SB = malloc(this->block_size);
 
 	debug_print(INFO, "Reading superblock...");
@@ -1525,25 +2063,47 @@ static fs_node_t * mount_ext2(fs_node_t * block_device) {
 	}
 	this->inodes_per_group = SB->inodes_count / BGDS;
 
-	if (!args_present("noext2cache")) {
+	if (!args_present("noext2cache") && !this->memory_base) {
 		debug_print(INFO, "Allocating cache...");
 		DC = malloc(sizeof(ext2_disk_cache_entry_t) * this->cache_entries);
 		this->cache_data = calloc(this->block_size, this->cache_entries);
+		this->cache_index = hashmap_create_int(1024);
+		this->cache_lru = list_create();
+		this->cache_nodes = calloc(sizeof(node_t), this->cache_entries);
 		for (uint32_t i = 0; i < this->cache_entries; ++i) {
 			DC[i].block_no = 0;
 			DC[i].dirty = 0;
 			DC[i].last_use = 0;
 			DC[i].block = this->cache_data + i * this->block_size;
+			this->cache_nodes[i].value = &DC[i];
+			list_append(this->cache_lru, &this->cache_nodes[i]);
 			if (i % 128 == 0) {
 				debug_print(INFO, "Allocated cache block #%d", i+1);
 			}
 		}
 		debug_print(INFO, "Allocated cache.");
+		create_kernel_tasklet(ext2_flush_task, "[ext2flush]", this);
 	} else {
 		DC = NULL;
 		debug_print(NOTICE, "ext2 cache is disabled (noext2cache)");
 	}
 
+	this->block_maps = hashmap_create_int(EXT2_BMAP_MAX);
+	this->bmap_count = 0;
+	spin_init(this->bmap_lock);
+
+	this->dir_indexes = hashmap_create_int(EXT2_DIRIDX_MAX);
+	this->diridx_count = 0;
+	spin_init(this->diridx_lock);
+
+	this->prealloc_inode = 0;
+	this->prealloc_next  = 0;
+	this->prealloc_count = 0;
+
+	this->inode_cache = hashmap_create_int(EXT2_ICACHE_MAX);
+	this->icache_count = 0;
+	spin_init(this->icache_lock);
+
 	// load the block group descriptors
 	this->bgd_block_span = sizeof(ext2_bgdescriptor_t) * BGDS / this->block_size + 1;
 	BGD = malloc(this->block_size * this->bgd_block_span);
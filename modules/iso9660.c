@@ -15,6 +15,11 @@
 
 #define ISO_SECTOR_SIZE 2048
 
+/* How many sectors to pull in per device read; directory scans and
+ * sequential file loads walk the disc one sector at a time, and CD
+ * seeks are expensive enough that grabbing a run is nearly free. */
+#define ISO_READAHEAD   16
+
 #define FLAG_HIDDEN      0x01
 #define FLAG_DIRECTORY   0x02
 #define FLAG_ASSOCIATED  0x04
@@ -25,6 +30,10 @@
 typedef struct {
 	fs_node_t * block_device;
 	uint32_t block_size;
+	char * ra_buffer;    /* Readahead window */
+	uint32_t ra_start;
+	uint32_t ra_count;
+	spin_lock_t ra_lock;
 } iso_9660_fs_t;
 
 typedef struct {
@@ -132,7 +141,24 @@ typedef struct {
 static void file_from_dir_entry(iso_9660_fs_t * this, size_t sector, iso_9660_directory_entry_t * dir, size_t offset, fs_node_t * fs);
 
 static void read_sector(iso_9660_fs_t * this, uint32_t sector_id, char * buffer) {
-	read_fs(this->block_device, sector_id * this->block_size, this->block_size, (uint8_t *)buffer);
+	spin_lock(this->ra_lock);
+	if (sector_id >= this->ra_start && sector_id < this->ra_start + this->ra_count) {
+		memcpy(buffer, this->ra_buffer + (sector_id - this->ra_start) * this->block_size, this->block_size);
+		spin_unlock(this->ra_lock);
+		return;
+	}
+	/* Miss; refill the window starting here. The device read may come
+	 * up short at the end of the disc, so track how much we got. */
+	this->ra_count = 0;
+	uint32_t bytes = read_fs(this->block_device, sector_id * this->block_size, ISO_READAHEAD * this->block_size, (uint8_t *)this->ra_buffer);
+	this->ra_start = sector_id;
+	this->ra_count = bytes / this->block_size;
+	if (this->ra_count) {
+		memcpy(buffer, this->ra_buffer, this->block_size);
+	} else {
+		memset(buffer, 0, this->block_size);
+	}
+	spin_unlock(this->ra_lock);
 }
 
 static void inplace_lower(char * string) {
@@ -362,8 +388,10 @@ static fs_node_t * iso_fs_mount(char * device, char * mount_path) {
 	iso_9660_fs_t * this = malloc(sizeof(iso_9660_fs_t));
 	this->block_device = dev;
 	this->block_size = ISO_SECTOR_SIZE;
-
-	/* Probably want to put a block cache on this like EXT2 driver does; or do that in the ATAPI layer... */
+	this->ra_buffer = malloc(ISO_READAHEAD * ISO_SECTOR_SIZE);
+	this->ra_start = 0;
+	this->ra_count = 0;
+	spin_init(this->ra_lock);
 
 	debug_print(WARNING, "ISO 9660 file system driver mounting %s to %s", device, mount_path);
 
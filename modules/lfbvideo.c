@@ -34,7 +34,11 @@ static void graphics_install_bochs(uint16_t, uint16_t);
 static void bochs_set_y_offset(uint16_t y);
 static uint16_t bochs_current_scroll(void);
 
+/* Backend mode-set hook; NULL for preset framebuffers */
+static void (*lfb_resolution_impl)(uint16_t,uint16_t);
+
 static pid_t display_change_recipient = 0;
+static fs_node_t * lfb_device = NULL;
 
 /*
  * Address of the linear frame buffer.
@@ -43,6 +47,13 @@ static pid_t display_change_recipient = 0;
  */
 uint8_t * lfb_vid_memory = (uint8_t *)0xE0000000;
 
+/*
+ * Hardware cursor hook, filled in by a backend that can draw the
+ * cursor on its own plane (see vboxguest). The plain Bochs/QEMU
+ * adapter has no cursor plane, so this stays NULL there.
+ */
+int (*lfb_set_cursor)(vid_cursor_t * cursor) = NULL;
+
 static int ioctl_vid(fs_node_t * node, int request, void * argp) {
 	/* TODO: Make this actually support multiple video devices */
 
@@ -67,6 +78,46 @@ static int ioctl_vid(fs_node_t * node, int request, void * argp) {
 			/* ioctl to register for a signal (vid device change? idk) on display change */
 			display_change_recipient = getpid();
 			return 0;
+		case IO_VID_VSYNC: {
+			/*
+			 * Wait for the start of the next vertical retrace.
+			 *
+			 * The VGA input status register still reports retrace on the
+			 * Bochs/QEMU adapters. We poll it with yields, bounded by a
+			 * deadline slightly over a 60Hz frame so callers aren't stuck
+			 * if the bit never toggles (headless, odd hardware).
+			 */
+			unsigned long s, ss;
+			relative_time(0, 20, &s, &ss);
+			/* If we're mid-retrace, let it finish first so we catch an edge */
+			while (inportb(0x3DA) & 0x08) {
+				if (timer_ticks > s || (timer_ticks == s && timer_subticks >= ss)) return 0;
+				switch_task(1);
+			}
+			while (!(inportb(0x3DA) & 0x08)) {
+				if (timer_ticks > s || (timer_ticks == s && timer_subticks >= ss)) return 0;
+				switch_task(1);
+			}
+			return 0;
+		}
+		case IO_VID_CURSOR:
+			/* Hand the cursor image to the backend, if one can draw it */
+			if (!lfb_set_cursor) return -1;
+			validate(argp);
+			return lfb_set_cursor((vid_cursor_t *)argp);
+		case IO_VID_SET: {
+			validate(argp);
+			vid_mode_t * mode = argp;
+			if (mode->width < 320 || mode->width > 4096 ||
+			    mode->height < 240 || mode->height > 4096) {
+				return -1;
+			}
+			if (!lfb_resolution_impl) {
+				return -1; /* Preset framebuffer; no way to change modes */
+			}
+			lfb_set_resolution(mode->width, mode->height);
+			return 0;
+		}
 		default:
 			return -1; /* TODO EINV... something or other */
 	}
@@ -169,8 +220,8 @@ static void finalize_graphics(uint16_t x, uint16_t y, uint16_t b) {
 	lfb_resolution_x = x;
 	lfb_resolution_y = y;
 	lfb_resolution_b = b;
-	fs_node_t * fb_device = lfb_video_device_create();
-	vfs_mount("/dev/fb0", fb_device);
+	lfb_device = lfb_video_device_create();
+	vfs_mount("/dev/fb0", lfb_device);
 	debug_video_crash = lfb_video_panic;
 }
 
@@ -197,12 +248,22 @@ static void bochs_scan_pci(uint32_t device, uint16_t v, uint16_t d, void * extra
 	}
 }
 
-static void (*lfb_resolution_impl)(uint16_t,uint16_t) = NULL;
-
 void lfb_set_resolution(uint16_t x, uint16_t y) {
 
 	if (lfb_resolution_impl) {
 		lfb_resolution_impl(x,y);
+
+		/* Make sure the mapping covers the new geometry; install time
+		 * mapped the original size. Large pages, same as install. */
+		uintptr_t fb_size = lfb_resolution_x * lfb_resolution_y * (lfb_resolution_b / 8);
+		for (uintptr_t i = (uintptr_t)lfb_vid_memory; i <= (uintptr_t)lfb_vid_memory + fb_size; i += 0x400000) {
+			dma_large_frame(i, 0, 1, i);
+		}
+
+		if (lfb_device) {
+			lfb_device->length = fb_size;
+		}
+
 		if (display_change_recipient) {
 			send_signal(display_change_recipient, SIGWINEVENT);
 			debug_print(WARNING, "Telling %d to SIGWINEVENT", display_change_recipient);
@@ -300,8 +361,10 @@ mem_found:
 		vid_memsize = inportl(0x1CF);
 	}
 	debug_print(WARNING, "Video memory size is 0x%x", vid_memsize);
-	for (uintptr_t i = (uintptr_t)lfb_vid_memory; i <= (uintptr_t)lfb_vid_memory + vid_memsize; i += 0x1000) {
-		dma_frame(get_page(i, 1, kernel_directory), 0, 1, i);
+	/* Map the whole aperture with 4MB pages so the compositor's redraw
+	 * doesn't chew through a TLB entry per 4KB of framebuffer. */
+	for (uintptr_t i = (uintptr_t)lfb_vid_memory; i <= (uintptr_t)lfb_vid_memory + vid_memsize; i += 0x400000) {
+		dma_large_frame(i, 0, 1, i);
 	}
 	finalize_graphics(resolution_x, resolution_y, PREFERRED_B);
 }
@@ -435,8 +498,8 @@ static void graphics_install_vmware(uint16_t w, uint16_t h) {
 	lfb_vid_memory = (uint8_t *)fb_addr;
 
 	uintptr_t fb_offset = (uintptr_t)lfb_vid_memory;
-	for (uintptr_t i = fb_offset; i <= fb_offset + fb_size; i += 0x1000) {
-		dma_frame(get_page(i, 1, kernel_directory), 0, 1, i);
+	for (uintptr_t i = fb_offset; i <= fb_offset + fb_size; i += 0x400000) {
+		dma_large_frame(i, 0, 1, i);
 	}
 
 	finalize_graphics(w,h,32);
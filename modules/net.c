@@ -10,16 +10,102 @@
 #include <printf.h>
 #include <tokenize.h>
 #include <mod/net.h>
+#include <socket.h>
 
 static hashmap_t * dns_cache;
-static list_t * dns_waiters = NULL;
+static hashmap_t * dns_inflight = NULL;
 static uint32_t _dns_server;
 
 static hashmap_t *_tcp_sockets = NULL;
 static hashmap_t *_udp_sockets = NULL;
+static hashmap_t *_arp_cache = NULL;
+static list_t * _lo_queue = NULL;
+static list_t * _lo_wait = NULL;
+static spin_lock_t _lo_lock = { 0 };
+
+/* DHCP client state machine, driven by the [dhcp] tasklet */
+#define DHCP_STATE_INIT       0
+#define DHCP_STATE_SELECTING  1
+#define DHCP_STATE_REQUESTING 2
+#define DHCP_STATE_BOUND      3
+#define DHCP_STATE_RENEWING   4
+
+static volatile int _dhcp_state = DHCP_STATE_INIT;
+static uint32_t _dhcp_xid = 0x1337;
+static uint32_t _dhcp_server = 0;
+static uint32_t _dhcp_offer = 0;
+static unsigned long _dhcp_lease = 86400;
+static list_t * _dhcp_alert = NULL;  /* fswait()ers on /proc/net */
+static uint32_t _gateway = 0;
+static uint32_t _netmask = 0xFFFFFF00;
 
 static void parse_dns_response(fs_node_t * tty, void * last_packet);
-static size_t write_dns_packet(uint8_t * buffer, size_t queries_len, uint8_t * queries);
+static void net_handle_ipv4(struct ipv4_packet * ipv4);
+static void net_handle_dhcp(struct udp_packet * udp);
+static size_t write_dns_packet(uint8_t * buffer, uint16_t qid, size_t queries_len, uint8_t * queries);
+
+/* Per-socket receive buffer; its free space is the advertised window */
+#define TCP_RECV_BUF_SIZE 0x8000
+
+/* Caps on a UDP socket's receive queue; excess datagrams are dropped
+ * and counted rather than eating the heap */
+#define UDP_QUEUE_MAX_PACKETS 64
+#define UDP_QUEUE_MAX_BYTES   0x10000
+
+/* Neighbor table tuning */
+#define ARP_CACHE_TTL     600  /* Seconds before a neighbor must re-prove itself */
+#define ARP_MAX_PENDING   16   /* Frames parked per unresolved neighbor */
+
+/* Transmit tuning */
+#define TCP_MSS           1460
+#define TCP_RTO_MIN       200     /* Milliseconds */
+#define TCP_RTO_MAX       30000
+#define TCP_RETRANSMIT_INTERVAL 50
+
+/* Sequence comparisons that survive wraparound */
+#define SEQ_AFTER(a,b)  ((int32_t)((a) - (b)) > 0)
+#define SEQ_AFTER_EQ(a,b) ((int32_t)((a) - (b)) >= 0)
+
+/* A segment sitting on the retransmission queue */
+typedef struct tcp_unacked {
+	uint32_t seq;                /* First sequence number covered */
+	uint32_t end;                /* seq + size */
+	uint16_t flags;
+	uint32_t size;
+	unsigned long long sent_at;  /* Millisecond timestamp of last (re)send */
+	int retransmits;
+	uint8_t data[];
+} tcp_unacked_t;
+
+static unsigned long long now_ms(void) {
+	return (unsigned long long)timer_ticks * SUBTICKS_PER_TICK + timer_subticks;
+}
+
+/*
+ * Packet buffer with headroom. The payload is written once, at the
+ * deepest offset, and each layer prepends its header in place with
+ * pbuf_push instead of allocating and copying a grown frame.
+ */
+#define PBUF_HEADROOM (sizeof(struct ethernet_packet) + sizeof(struct ipv4_packet) + sizeof(struct tcp_header))
+
+typedef struct pbuf {
+	uint8_t * data;    /* Start of the current outermost layer */
+	size_t length;     /* Bytes from data to the end of the payload */
+	uint8_t buffer[];
+} pbuf_t;
+
+static pbuf_t * pbuf_alloc(size_t payload_size) {
+	pbuf_t * p = malloc(sizeof(pbuf_t) + PBUF_HEADROOM + payload_size);
+	p->data = p->buffer + PBUF_HEADROOM;
+	p->length = payload_size;
+	return p;
+}
+
+static void * pbuf_push(pbuf_t * p, size_t size) {
+	p->data -= size;
+	p->length += size;
+	return p->data;
+}
 
 static struct netif _netif;
 
@@ -66,67 +152,51 @@ void ip_ntoa(uint32_t src_addr, char * out) {
 		(src_addr & 0xFF));
 }
 
-uint16_t calculate_ipv4_checksum(struct ipv4_packet * p) {
-	uint32_t sum = 0;
-	uint16_t * s = (uint16_t *)p;
+/*
+ * One's-complement sum over a byte range, accumulated in 32 bits and
+ * folded once at the end instead of after every word. Words are summed
+ * in network order - the ones'-complement sum commutes with byte
+ * swapping - and the fold swaps back, so callers still get a
+ * host-order result. Unrolled eight words per pass; this runs over
+ * every payload byte on both send and receive.
+ */
+static uint32_t checksum_partial(const void * ptr, size_t length, uint32_t sum) {
+	const uint16_t * s = ptr;
 
-	/* TODO: Checksums for options? */
-	for (int i = 0; i < 10; ++i) {
-		sum += ntohs(s[i]);
+	while (length >= 16) {
+		sum += s[0] + s[1] + s[2] + s[3] + s[4] + s[5] + s[6] + s[7];
+		s += 8;
+		length -= 16;
 	}
-
-	if (sum > 0xFFFF) {
-		sum = (sum >> 16) + (sum & 0xFFFF);
+	while (length >= 2) {
+		sum += *s++;
+		length -= 2;
 	}
-
-	return ~(sum & 0xFFFF) & 0xFFFF;
+	if (length) {
+		/* Trailing odd byte is padded with a zero */
+		sum += *(const uint8_t *)s;
+	}
+	return sum;
 }
 
-uint16_t calculate_tcp_checksum(struct tcp_check_header * p, struct tcp_header * h, void * d, size_t payload_size) {
-	uint32_t sum = 0;
-	uint16_t * s = (uint16_t *)p;
+static uint16_t checksum_fold(uint32_t sum) {
+	sum = (sum >> 16) + (sum & 0xFFFF);
+	sum += sum >> 16;
+	uint16_t net_order = ~sum & 0xFFFF;
+	return ntohs(net_order);
+}
 
+uint16_t calculate_ipv4_checksum(struct ipv4_packet * p) {
 	/* TODO: Checksums for options? */
-	for (int i = 0; i < 6; ++i) {
-		sum += ntohs(s[i]);
-		if (sum > 0xFFFF) {
-			sum = (sum >> 16) + (sum & 0xFFFF);
-		}
-	}
-
-	s = (uint16_t *)h;
-	for (int i = 0; i < 10; ++i) {
-		sum += ntohs(s[i]);
-		if (sum > 0xFFFF) {
-			sum = (sum >> 16) + (sum & 0xFFFF);
-		}
-	}
-
-	uint16_t d_words = payload_size / 2;
-
-	s = (uint16_t *)d;
-	for (unsigned int i = 0; i < d_words; ++i) {
-		sum += ntohs(s[i]);
-		if (sum > 0xFFFF) {
-			sum = (sum >> 16) + (sum & 0xFFFF);
-		}
-	}
-
-	if (d_words * 2 != payload_size) {
-		uint8_t * t = (uint8_t *)d;
-		uint8_t tmp[2];
-		tmp[0] = t[d_words * sizeof(uint16_t)];
-		tmp[1] = 0;
-
-		uint16_t * f = (uint16_t *)tmp;
-
-		sum += ntohs(f[0]);
-		if (sum > 0xFFFF) {
-			sum = (sum >> 16) + (sum & 0xFFFF);
-		}
-	}
+	return checksum_fold(checksum_partial(p, sizeof(struct ipv4_packet), 0));
+}
 
-	return ~(sum & 0xFFFF) & 0xFFFF;
+uint16_t calculate_tcp_checksum(struct tcp_check_header * p, struct tcp_header * h, void * d, size_t payload_size) {
+	/* TODO: Checksums for options? */
+	uint32_t sum = checksum_partial(p, sizeof(struct tcp_check_header), 0);
+	sum = checksum_partial(h, sizeof(struct tcp_header), sum);
+	sum = checksum_partial(d, payload_size, sum);
+	return checksum_fold(sum);
 }
 
 static struct dirent * readdir_netfs(fs_node_t *node, uint32_t index) {
@@ -317,48 +387,124 @@ fs_node_t * socket_ipv4_tcp_create(uint32_t dest, uint16_t target_port, uint16_t
 
 }
 
+/* A resolved name; ip is NULL for a cached NXDOMAIN */
+typedef struct dns_entry {
+	char * ip;
+	unsigned long expires;  /* In timer_ticks (seconds); 0 = never */
+} dns_entry_t;
+
+/* An in-flight query, keyed by qid; resolvers for the same name pile
+ * onto the waiters list instead of sending their own query */
+typedef struct dns_query {
+	char name[256];
+	list_t * waiters;
+} dns_query_t;
+
+#define DNS_NEGATIVE_TTL 60
+#define DNS_MINIMUM_TTL  30
+
+static void dns_cache_set(char * name, char * ip, unsigned long ttl) {
+	dns_entry_t * old = hashmap_get(dns_cache, name);
+	if (old) {
+		if (old->ip) free(old->ip);
+		free(old);
+	}
+	dns_entry_t * entry = malloc(sizeof(dns_entry_t));
+	entry->ip = ip ? strdup(ip) : NULL;
+	entry->expires = ttl ? (timer_ticks + ttl) : 0;
+	hashmap_set(dns_cache, name, entry);
+}
+
+/* 1 = positive hit, -1 = cached NXDOMAIN, 0 = miss */
+static int dns_cache_lookup(char * name, uint32_t * ip) {
+	dns_entry_t * entry = hashmap_get(dns_cache, name);
+	if (!entry) return 0;
+	if (entry->expires && timer_ticks > entry->expires) {
+		hashmap_remove(dns_cache, name);
+		if (entry->ip) free(entry->ip);
+		free(entry);
+		return 0;
+	}
+	if (!entry->ip) return -1;
+	*ip = ip_aton(entry->ip);
+	return 1;
+}
+
 static int gethost(char * name, uint32_t * ip) {
 	if (is_ip(name)) {
 		debug_print(WARNING, "   IP: %x", ip_aton(name));
 		*ip = ip_aton(name);
 		return 0;
 	} else {
-		if (hashmap_has(dns_cache, name)) {
-			*ip = ip_aton(hashmap_get(dns_cache, name));
-			debug_print(WARNING, "   In Cache: %s → %x", name, ip);
+		int hit = dns_cache_lookup(name, ip);
+		if (hit > 0) {
+			debug_print(WARNING, "   In Cache: %s → %x", name, *ip);
 			return 0;
+		} else if (hit < 0) {
+			debug_print(WARNING, "   Cached NXDOMAIN: %s", name);
+			return 1;
 		} else {
 			debug_print(WARNING, "   Still needs look up.");
-			char * xname = strdup(name);
-			char * queries = malloc(1024);
-			queries[0] = '\0';
-			char * subs[10]; /* 10 is probably not the best number. */
-			int argc = tokenize(xname, ".", subs);
-			int n = 0;
-			for (int i = 0; i < argc; ++i) {
-				debug_print(WARNING, "dns [%d]%s", strlen(subs[i]), subs[i]);
-				sprintf(&queries[n], "%c%s", strlen(subs[i]), subs[i]);
-				n += strlen(&queries[n]);
+
+			/* If somebody already asked, wait on their query */
+			dns_query_t * query = NULL;
+			IRQ_OFF;
+			list_t * inflight = hashmap_values(dns_inflight);
+			foreach(qnode, inflight) {
+				dns_query_t * q = qnode->value;
+				if (!strcmp(q->name, name)) {
+					query = q;
+					break;
+				}
 			}
-			int c = strlen(queries) + 1;
-			queries[c+0] = 0x00;
-			queries[c+1] = 0x01; /* A */
-			queries[c+2] = 0x00;
-			queries[c+3] = 0x01; /* IN */
-			free(xname);
-
-			void * tmp = malloc(1024);
-			size_t packet_size = write_dns_packet(tmp, c + 4, (uint8_t *)queries);
-			free(queries);
-
-			_netif.send_packet(tmp, packet_size);
-			free(tmp);
-
-			/* wait for response */
-			sleep_on(dns_waiters);
-			if (hashmap_has(dns_cache, name)) {
-				*ip = ip_aton(hashmap_get(dns_cache, name));
-				debug_print(WARNING, "   Now in cache: %s → %x", name, ip);
+			list_free(inflight);
+			free(inflight);
+
+			if (query) {
+				sleep_on(query->waiters);
+			} else {
+				static uint16_t next_qid = 1;
+				uint16_t qid = next_qid++;
+
+				query = malloc(sizeof(dns_query_t));
+				memcpy(query->name, name, strlen(name) + 1);
+				query->waiters = list_create();
+				hashmap_set(dns_inflight, (void *)(uintptr_t)qid, query);
+
+				/* Interrupts stay closed until sleep_on so the
+				 * response can't slip in before we're waiting */
+				char * xname = strdup(name);
+				char * queries = malloc(1024);
+				queries[0] = '\0';
+				char * subs[10]; /* 10 is probably not the best number. */
+				int argc = tokenize(xname, ".", subs);
+				int n = 0;
+				for (int i = 0; i < argc; ++i) {
+					debug_print(WARNING, "dns [%d]%s", strlen(subs[i]), subs[i]);
+					sprintf(&queries[n], "%c%s", strlen(subs[i]), subs[i]);
+					n += strlen(&queries[n]);
+				}
+				int c = strlen(queries) + 1;
+				queries[c+0] = 0x00;
+				queries[c+1] = 0x01; /* A */
+				queries[c+2] = 0x00;
+				queries[c+3] = 0x01; /* IN */
+				free(xname);
+
+				void * tmp = malloc(1024);
+				size_t packet_size = write_dns_packet(tmp, qid, c + 4, (uint8_t *)queries);
+				free(queries);
+
+				_netif.send_packet(tmp, packet_size);
+				free(tmp);
+
+				/* wait for response */
+				sleep_on(query->waiters);
+			}
+
+			hit = dns_cache_lookup(name, ip);
+			if (hit > 0) {
+				debug_print(WARNING, "   Now in cache: %s → %x", name, *ip);
 				return 0;
 			} else {
 				return 1;
@@ -368,8 +514,46 @@ static int gethost(char * name, uint32_t * ip) {
 }
 
 
-/* TODO: socket_close - TCP close; UDP... just clean us up */
-/* TODO: socket_open - idk, whatever */
+static void socket_close(fs_node_t * node) {
+	net_close((struct socket *)node->device);
+}
+
+/*
+ * Syscall-facing socket interface: hand out unconnected socket nodes
+ * and connect them by address, skipping the /dev/net path machinery.
+ */
+static fs_node_t * socket_netfs_create(uint32_t type) {
+	if (type != SOCK_STREAM) return NULL;
+
+	struct socket * sock = net_open(type);
+	if (!sock) return NULL;
+
+	fs_node_t * fnode = malloc(sizeof(fs_node_t));
+	memset(fnode, 0x00, sizeof(fs_node_t));
+	fnode->inode = 0;
+	sprintf(fnode->name, "[socket]");
+	fnode->mask  = 0666;
+	fnode->flags = FS_CHARDEVICE;
+	fnode->read  = socket_read;
+	fnode->write = socket_write;
+	fnode->close = socket_close;
+	fnode->device = (void *)sock;
+
+	return fnode;
+}
+
+static int socket_netfs_connect(fs_node_t * node, uint32_t ip, uint16_t port) {
+	/* Refuse anything that didn't come from this stack */
+	if (node->read != socket_read || node->write != socket_write) {
+		return -EINVAL;
+	}
+	return net_connect((struct socket *)node->device, ip, port);
+}
+
+static socket_interface_t netfs_socket_interface = {
+	.socket  = socket_netfs_create,
+	.connect = socket_netfs_connect,
+};
 
 static fs_node_t * finddir_netfs(fs_node_t * node, char * name) {
 	/* Should essentially find anything. */
@@ -418,7 +602,7 @@ static int ioctl_netfs(fs_node_t * node, int request, void * argp) {
 	return 0;
 }
 
-static size_t write_dns_packet(uint8_t * buffer, size_t queries_len, uint8_t * queries) {
+static size_t write_dns_packet(uint8_t * buffer, uint16_t qid, size_t queries_len, uint8_t * queries) {
 	size_t offset = 0;
 	size_t payload_size = sizeof(struct dns_packet) + queries_len;
 
@@ -474,8 +658,9 @@ static size_t write_dns_packet(uint8_t * buffer, size_t queries_len, uint8_t * q
 	offset += sizeof(struct udp_packet);
 
 	/* DNS header */
+	uint16_t _qid = htons(qid);
 	struct dns_packet dns_out = {
-		.qid = htons(0),
+		.qid = _qid,
 		.flags = htons(0x0100), /* Standard query */
 		.questions = htons(1), /* 1 question */
 		.answers = htons(0),
@@ -492,25 +677,162 @@ static size_t write_dns_packet(uint8_t * buffer, size_t queries_len, uint8_t * q
 	return offset;
 }
 
-static int net_send_ether(struct socket *socket, struct netif* netif, uint16_t ether_type, void* payload, uint32_t payload_size) {
-	struct ethernet_packet *eth = malloc(sizeof(struct ethernet_packet) + payload_size);
+/* A neighbor we've heard from (or are waiting to hear from) */
+typedef struct arp_entry {
+	uint8_t mac[6];
+	uint8_t valid;
+	unsigned long expires;  /* In timer_ticks (seconds) */
+	list_t * pending;       /* Built frames (pbuf_t) parked until resolution */
+} arp_entry_t;
+
+static void arp_send(uint32_t target_ip, uint16_t oper, uint8_t * target_ha, uint8_t * dest_mac) {
+	pbuf_t * p = pbuf_alloc(sizeof(struct arp_packet));
+
+	struct arp_packet * arp = (struct arp_packet *)p->data;
+	uint16_t _htype = htons(1); /* Ethernet */
+	uint16_t _ptype = htons(ETHERNET_TYPE_IPV4);
+	uint16_t _oper  = htons(oper);
+	uint32_t _saddr = htonl(_netif.source);
+	uint32_t _taddr = htonl(target_ip);
+	arp->htype = _htype;
+	arp->ptype = _ptype;
+	arp->hlen  = 6;
+	arp->plen  = 4;
+	arp->oper  = _oper;
+	memcpy(arp->sender_ha, _netif.hwaddr, 6);
+	arp->sender_ip = _saddr;
+	if (target_ha) {
+		memcpy(arp->target_ha, target_ha, 6);
+	} else {
+		memset(arp->target_ha, 0, 6);
+	}
+	arp->target_ip = _taddr;
+
+	struct ethernet_packet * eth = pbuf_push(p, sizeof(struct ethernet_packet));
+	memcpy(eth->source, _netif.hwaddr, sizeof(eth->source));
+	if (dest_mac) {
+		memcpy(eth->destination, dest_mac, sizeof(eth->destination));
+	} else {
+		memset(eth->destination, 0xFF, sizeof(eth->destination));
+	}
+	eth->type = htons(ETHERNET_TYPE_ARP);
+
+	_netif.send_packet(p->data, p->length);
+	free(p);
+}
+
+/*
+ * Record what we learned about a neighbor and flush anything that was
+ * parked waiting on it.
+ */
+static void arp_learn(uint32_t ip, uint8_t * mac) {
+	arp_entry_t * entry = hashmap_get(_arp_cache, (void *)ip);
+	if (!entry) {
+		entry = malloc(sizeof(arp_entry_t));
+		entry->pending = list_create();
+		hashmap_set(_arp_cache, (void *)ip, entry);
+	}
+	memcpy(entry->mac, mac, 6);
+	entry->valid = 1;
+	entry->expires = timer_ticks + ARP_CACHE_TTL;
+
+	while (entry->pending->length) {
+		node_t * n = list_dequeue(entry->pending);
+		pbuf_t * frame = n->value;
+		free(n);
+		struct ethernet_packet * eth = (struct ethernet_packet *)frame->data;
+		memcpy(eth->destination, entry->mac, sizeof(eth->destination));
+		_netif.send_packet(frame->data, frame->length);
+		free(frame);
+	}
+}
+
+static void net_handle_arp(struct ethernet_packet * eth) {
+	struct arp_packet * arp = (struct arp_packet *)eth->payload;
+
+	if (ntohs(arp->oper) == ARP_OPER_REQUEST && ntohl(arp->target_ip) == _netif.source) {
+		arp_send(ntohl(arp->sender_ip), ARP_OPER_REPLY, arp->sender_ha, arp->sender_ha);
+	}
+
+	/* Learn from requests and replies alike */
+	uint32_t sender = ntohl(arp->sender_ip);
+	if (sender) {
+		arp_learn(sender, arp->sender_ha);
+	}
+}
+
+static int net_send_ether(struct socket *socket, struct netif* netif, uint16_t ether_type, pbuf_t * p) {
+	struct ethernet_packet *eth = pbuf_push(p, sizeof(struct ethernet_packet));
 	memcpy(eth->source, netif->hwaddr, sizeof(eth->source));
-	memset(eth->destination, 0xFF, sizeof(eth->destination));
 	eth->type = htons(ether_type);
 
-	if (payload_size) {
-		memcpy(eth->payload, payload, payload_size);
+	/* Local destinations never touch a driver: park the frame on the
+	 * loopback queue and the lo tasklet feeds it straight back into
+	 * the receive dispatch */
+	if (ether_type == ETHERNET_TYPE_IPV4 && socket &&
+	    ((socket->ip >> 24) == 127 || socket->ip == netif->source)) {
+		memcpy(eth->destination, netif->hwaddr, sizeof(eth->destination));
+		spin_lock(_lo_lock);
+		list_insert(_lo_queue, p);
+		spin_unlock(_lo_lock);
+		wakeup_queue(_lo_wait);
+		return 1;
 	}
 
-	netif->send_packet((uint8_t*)eth, sizeof(struct ethernet_packet) + payload_size);
+	/* Figure out who actually gets this frame */
+	uint32_t next_hop = 0;
+	if (ether_type == ETHERNET_TYPE_IPV4 && socket && _arp_cache) {
+		next_hop = socket->ip;
+		if (_gateway && ((next_hop ^ netif->source) & _netmask)) {
+			next_hop = _gateway; /* Off-subnet; hand it to the router */
+		}
+		if (next_hop == 0xFFFFFFFF || (next_hop >> 24) == 127) {
+			next_hop = 0; /* Broadcast and loopback don't resolve */
+		}
+	}
+
+	if (!next_hop) {
+		memset(eth->destination, 0xFF, sizeof(eth->destination));
+		netif->send_packet(p->data, p->length);
+		free(p);
+		return 1;
+	}
 
-	free(eth);
+	arp_entry_t * entry = hashmap_get(_arp_cache, (void *)next_hop);
+	if (entry && entry->valid && timer_ticks > entry->expires) {
+		entry->valid = 0; /* Stale; re-prove before we trust it */
+	}
 
-	return 1; // yolo
+	if (entry && entry->valid) {
+		memcpy(eth->destination, entry->mac, sizeof(eth->destination));
+		netif->send_packet(p->data, p->length);
+		free(p);
+		return 1;
+	}
+
+	/* Unresolved: park the frame and ask the network */
+	if (!entry) {
+		entry = malloc(sizeof(arp_entry_t));
+		entry->valid = 0;
+		entry->expires = 0;
+		entry->pending = list_create();
+		hashmap_set(_arp_cache, (void *)next_hop, entry);
+	}
+	if (entry->pending->length >= ARP_MAX_PENDING) {
+		debug_print(WARNING, "net_send_ether: neighbor queue full, dropping frame");
+		free(p);
+		return 0;
+	}
+	memset(eth->destination, 0, sizeof(eth->destination));
+	list_insert(entry->pending, p);
+	arp_send(next_hop, ARP_OPER_REQUEST, NULL, NULL);
+
+	return 1;
 }
 
-static int net_send_ip(struct socket *socket, int proto, void* payload, uint32_t payload_size) {
-	struct ipv4_packet *ipv4 = malloc(sizeof(struct ipv4_packet) + payload_size);
+static int net_send_ip(struct socket *socket, int proto, pbuf_t * p) {
+	size_t payload_size = p->length;
+	struct ipv4_packet *ipv4 = pbuf_push(p, sizeof(struct ipv4_packet));
 
 	uint16_t _length = htons(sizeof(struct ipv4_packet) + payload_size);
 	uint16_t _ident  = htons(1);
@@ -530,7 +852,7 @@ static int net_send_ip(struct socket *socket, int proto, void* payload, uint32_t
 	ipv4->checksum = htons(checksum);
 
 	if (proto == IPV4_PROT_TCP) {
-		// Need to calculate TCP checksum
+		// Need to calculate TCP checksum, in place
 		struct tcp_check_header check_hd = {
 			.source = ipv4->source,
 			.destination = ipv4->destination,
@@ -539,50 +861,203 @@ static int net_send_ip(struct socket *socket, int proto, void* payload, uint32_t
 			.tcp_len = htons(payload_size),
 		};
 
-		// debug_print(WARNING, "net_send_ip: Payload size: %d\n", payload_size);
-		struct tcp_header* tcp_hdr = (struct tcp_header*)payload;
-		// debug_print(WARNING, "net_send_ip: Header len htons: %d\n", TCP_HEADER_LENGTH_FLIPPED(tcp_hdr));
+		struct tcp_header* tcp_hdr = (struct tcp_header*)ipv4->payload;
 		size_t orig_payload_size = payload_size - TCP_HEADER_LENGTH_FLIPPED(tcp_hdr);
 
 		uint16_t chk = calculate_tcp_checksum(&check_hd, tcp_hdr, tcp_hdr->payload, orig_payload_size);
 		tcp_hdr->checksum = htons(chk);
 	}
 
-	if (payload) {
-		memcpy(ipv4->payload, payload, payload_size);
-		free(payload);
-	}
-
 	// TODO: netif should not be a global thing. But the route should be looked up here and a netif object created/returned
-	int out = net_send_ether(socket, &_netif, ETHERNET_TYPE_IPV4, ipv4, sizeof(struct ipv4_packet) + payload_size);
-	free(ipv4);
-	return out;
+	return net_send_ether(socket, &_netif, ETHERNET_TYPE_IPV4, p);
 }
 
-static int net_send_tcp(struct socket *socket, uint16_t flags, uint8_t * payload, uint32_t payload_size) {
-	struct tcp_header *tcp = malloc(sizeof(struct tcp_header) + payload_size);
+/*
+ * Emit one segment with an explicit sequence number. Used both for
+ * first transmission and for retransmission; does not touch seq_no.
+ */
+static int tcp_output(struct socket *socket, uint32_t seq, uint16_t flags, uint8_t * payload, uint32_t payload_size) {
+	pbuf_t * p = pbuf_alloc(payload_size);
+	if (payload) {
+		memcpy(p->data, payload, payload_size);
+	}
+	struct tcp_header *tcp = pbuf_push(p, sizeof(struct tcp_header));
 
 	tcp->source_port = htons(socket->port_recv);
 	tcp->destination_port = htons(socket->port_dest);
-	tcp->seq_number = htonl(socket->proto_sock.tcp_socket.seq_no);
+	tcp->seq_number = htonl(seq);
 	tcp->ack_number = flags & (TCP_FLAGS_ACK) ? htonl(socket->proto_sock.tcp_socket.ack_no) : 0;
 	tcp->flags = htons(0x5000 ^ (flags & 0xFF));
-	tcp->window_size = htons(1548-54);
+
+	/* Advertise however much of the receive buffer is still free */
+	uint16_t window = 1548 - 54;
+	if (socket->recv_buf) {
+		size_t avail = ring_buffer_available(socket->recv_buf);
+		window = (avail > 0xFFFF) ? 0xFFFF : avail;
+	}
+	tcp->window_size = htons(window);
 	tcp->checksum = 0; // Fill in later
 	tcp->urgent = 0;
 
+	return net_send_ip(socket, IPV4_PROT_TCP, p);
+}
+
+static int net_send_tcp(struct socket *socket, uint16_t flags, uint8_t * payload, uint32_t payload_size) {
+	struct tcp_socket * t = &socket->proto_sock.tcp_socket;
+	uint32_t seq = t->seq_no;
+
 	if ((flags & 0xff) == TCP_FLAGS_SYN) {
 		// If only SYN set, expected ACK will be 1 despite no payload
-		socket->proto_sock.tcp_socket.seq_no += 1;
+		t->seq_no += 1;
 	} else {
-		socket->proto_sock.tcp_socket.seq_no += payload_size;
+		t->seq_no += payload_size;
 	}
 
-	if (payload) {
-		memcpy(tcp->payload, payload, payload_size);
+	if (payload_size && t->unacked) {
+		/* Keep a copy around until the peer acknowledges it */
+		tcp_unacked_t * u = malloc(sizeof(tcp_unacked_t) + payload_size);
+		u->seq = seq;
+		u->end = seq + payload_size;
+		u->flags = flags;
+		u->size = payload_size;
+		u->sent_at = now_ms();
+		u->retransmits = 0;
+		memcpy(u->data, payload, payload_size);
+		spin_lock(t->tx_lock);
+		list_insert(t->unacked, u);
+		spin_unlock(t->tx_lock);
+	}
+
+	return tcp_output(socket, seq, flags, payload, payload_size);
+}
+
+/* Caller holds tx_lock. Resend the oldest unacknowledged segment. */
+static void tcp_retransmit_head(struct socket * socket) {
+	struct tcp_socket * t = &socket->proto_sock.tcp_socket;
+	if (!t->unacked->head) return;
+	tcp_unacked_t * u = t->unacked->head->value;
+	u->sent_at = now_ms();
+	u->retransmits++;
+	tcp_output(socket, u->seq, u->flags, u->data, u->size);
+}
+
+/*
+ * ACK bookkeeping: release acknowledged segments, sample the RTT,
+ * grow the congestion window, and catch duplicate-ACK runs for fast
+ * retransmit.
+ */
+static void tcp_handle_ack(struct socket * socket, uint32_t ack, size_t data_length) {
+	struct tcp_socket * t = &socket->proto_sock.tcp_socket;
+	if (!t->unacked) return;
+
+	spin_lock(t->tx_lock);
+
+	if (ack == t->snd_una && data_length == 0 && t->unacked->head) {
+		t->dup_acks++;
+		if (t->dup_acks == 3) {
+			/* Three duplicates: the head segment is presumed lost */
+			uint32_t inflight = t->seq_no - t->snd_una;
+			t->ssthresh = MAX(inflight / 2, 2 * TCP_MSS);
+			t->cwnd = t->ssthresh;
+			tcp_retransmit_head(socket);
+		}
+	} else if (SEQ_AFTER(ack, t->snd_una)) {
+		uint32_t acked = ack - t->snd_una;
+		t->dup_acks = 0;
+
+		while (t->unacked->head) {
+			tcp_unacked_t * u = t->unacked->head->value;
+			if (!SEQ_AFTER_EQ(ack, u->end)) break;
+			if (!u->retransmits) {
+				/* Karn: only un-retransmitted segments give clean samples */
+				uint32_t sample = (uint32_t)(now_ms() - u->sent_at);
+				if (!t->srtt) {
+					t->srtt = sample;
+					t->rttvar = sample / 2;
+				} else {
+					uint32_t delta = (sample > t->srtt) ? sample - t->srtt : t->srtt - sample;
+					t->rttvar = (3 * t->rttvar + delta) / 4;
+					t->srtt = (7 * t->srtt + sample) / 8;
+				}
+				t->rto = t->srtt + 4 * t->rttvar;
+				if (t->rto < TCP_RTO_MIN) t->rto = TCP_RTO_MIN;
+				if (t->rto > TCP_RTO_MAX) t->rto = TCP_RTO_MAX;
+			}
+			node_t * n = list_dequeue(t->unacked);
+			free(u);
+			free(n);
+		}
+		t->snd_una = ack;
+
+		/* Reno: exponential growth below ssthresh, linear above */
+		if (t->cwnd < t->ssthresh) {
+			t->cwnd += MIN(acked, TCP_MSS);
+		} else {
+			t->cwnd += MAX((TCP_MSS * TCP_MSS) / t->cwnd, 1);
+		}
+
+		wakeup_queue(t->send_wait);
 	}
 
-	return net_send_ip(socket, IPV4_PROT_TCP, tcp, sizeof(struct tcp_header) + payload_size);
+	spin_unlock(t->tx_lock);
+}
+
+/*
+ * Block the sender while a chunk would exceed what the congestion
+ * window and the peer's advertised window allow in flight.
+ */
+static void tcp_wait_for_window(struct socket * socket, size_t chunk) {
+	struct tcp_socket * t = &socket->proto_sock.tcp_socket;
+	while (socket->status != 1) {
+		uint32_t limit = MIN(t->cwnd, (uint32_t)MAX(t->peer_window, TCP_MSS));
+		IRQ_OFF;
+		uint32_t inflight = t->seq_no - t->snd_una;
+		if (inflight + chunk <= limit || !t->unacked->head) {
+			IRQ_RES;
+			break;
+		}
+		sleep_on(t->send_wait);
+	}
+}
+
+/*
+ * Periodic retransmission sweep; runs as its own tasklet. A segment
+ * that outlives the RTO is resent with the timeout doubled and the
+ * congestion window dropped back to one segment (slow start restart).
+ */
+static void net_retransmit_task(void * data, char * name) {
+	while (1) {
+		unsigned long s, ss;
+		relative_time(0, TCP_RETRANSMIT_INTERVAL, &s, &ss);
+		sleep_until((process_t *)current_process, s, ss);
+		switch_task(0);
+
+		if (!_tcp_sockets) continue;
+
+		list_t * sockets = hashmap_values(_tcp_sockets);
+		foreach(node, sockets) {
+			struct socket * socket = node->value;
+			if (!socket || socket->status == 1) continue;
+			struct tcp_socket * t = &socket->proto_sock.tcp_socket;
+			if (!t->unacked) continue;
+			spin_lock(t->tx_lock);
+			if (t->unacked->head) {
+				tcp_unacked_t * u = t->unacked->head->value;
+				if (now_ms() - u->sent_at >= t->rto) {
+					uint32_t inflight = t->seq_no - t->snd_una;
+					t->ssthresh = MAX(inflight / 2, 2 * TCP_MSS);
+					t->cwnd = TCP_MSS;
+					t->rto = MIN(t->rto * 2, TCP_RTO_MAX);
+					t->dup_acks = 0;
+					tcp_retransmit_head(socket);
+				}
+			}
+			spin_unlock(t->tx_lock);
+			wakeup_queue(t->send_wait);
+		}
+		list_free(sockets);
+		free(sockets);
+	}
 }
 
 struct socket* net_open(uint32_t type) {
@@ -597,76 +1072,107 @@ struct socket* net_open(uint32_t type) {
 int net_close(struct socket* socket) {
 	// socket->is_connected;
 	socket->status = 1; /* Disconnected */
+	if (socket->sock_type == SOCK_DGRAM) {
+		list_t * bucket = hashmap_get(_udp_sockets, (void *)(uintptr_t)socket->port_recv);
+		if (bucket) {
+			node_t * mine = list_find(bucket, socket);
+			if (mine) {
+				list_delete(bucket, mine);
+				free(mine);
+			}
+		}
+		while (socket->proto_sock.udp_socket.packets->length) {
+			node_t * n = list_dequeue(socket->proto_sock.udp_socket.packets);
+			free(n->value);
+			free(n);
+		}
+	}
+	if (socket->recv_buf) {
+		ring_buffer_interrupt(socket->recv_buf);
+	}
+	if (socket->proto_sock.tcp_socket.send_wait) {
+		wakeup_queue(socket->proto_sock.tcp_socket.send_wait);
+	}
 	wakeup_queue(socket->packet_wait);
 	return 1;
 }
 
 int net_send(struct socket* socket, uint8_t* payload, size_t payload_size, int flags) {
-	return net_send_tcp(socket, TCP_FLAGS_ACK | TCP_FLAGS_PSH, payload, payload_size);
+	if (socket->sock_type == SOCK_DGRAM) {
+		pbuf_t * p = pbuf_alloc(payload_size);
+		memcpy(p->data, payload, payload_size);
+
+		struct udp_packet * udp = pbuf_push(p, sizeof(struct udp_packet));
+		uint16_t _source = htons(socket->port_recv);
+		uint16_t _dest   = htons(socket->port_dest);
+		uint16_t _len    = htons(sizeof(struct udp_packet) + payload_size);
+		udp->source_port = _source;
+		udp->destination_port = _dest;
+		udp->length = _len;
+		udp->checksum = 0; /* XXX as with DNS/DHCP */
+
+		net_send_ip(socket, IPV4_PROT_UDP, p);
+		return payload_size;
+	}
+
+	size_t offset = 0;
+	while (offset < payload_size) {
+		size_t chunk = MIN(TCP_MSS, payload_size - offset);
+		tcp_wait_for_window(socket, chunk);
+		if (socket->status == 1) break;
+		net_send_tcp(socket, TCP_FLAGS_ACK | TCP_FLAGS_PSH, payload + offset, chunk);
+		offset += chunk;
+	}
+	return offset;
 }
 
 size_t net_recv(struct socket* socket, uint8_t* buffer, size_t len) {
-	tcpdata_t *tcpdata = NULL;
-	node_t *node = NULL;
-
 	debug_print(INFO, "0x%x [socket]", socket);
 
-	size_t offset = 0;
-	size_t size_to_read = 0;
-
-	do {
+	if (socket->sock_type == SOCK_DGRAM) {
+		struct udp_socket * udpsock = &socket->proto_sock.udp_socket;
+		node_t * n;
 
-	if (socket->bytes_available) {
-		tcpdata = socket->current_packet;
-	} else {
-		spin_lock(socket->packet_queue_lock);
-		do {
-			if (socket->packet_queue->length > 0) {
-				node = list_dequeue(socket->packet_queue);
-				spin_unlock(socket->packet_queue_lock);
+		while (1) {
+			IRQ_OFF;
+			if (socket->status == 1) {
+				IRQ_RES;
+				return 0;
+			}
+			if (udpsock->packets->length) {
+				n = list_dequeue(udpsock->packets);
+				udpsock->queue_bytes -= ((struct sized_blob *)n->value)->size;
+				IRQ_RES;
 				break;
-			} else {
-				if (socket->status == 1) {
-					spin_unlock(socket->packet_queue_lock);
-					debug_print(WARNING, "Socket closed, done reading.");
-					return 0;
-				}
-				spin_unlock(socket->packet_queue_lock);
-				sleep_on(socket->packet_wait);
-				spin_lock(socket->packet_queue_lock);
 			}
-		} while (1);
+			if (sleep_on(socket->packet_wait)) {
+				return 0;
+			}
+		}
 
-		tcpdata = node->value;
-		socket->bytes_available = tcpdata->payload_size;
-		socket->bytes_read = 0;
-		free(node);
+		struct sized_blob * blob = n->value;
+		free(n);
+		size_t out = MIN(len, blob->size);
+		memcpy(buffer, blob->blob, out);
+		free(blob);
+		return out;
 	}
 
-	size_to_read = MIN(len, offset + socket->bytes_available);
-
-	if (tcpdata->payload != 0) {
-		memcpy(buffer + offset, tcpdata->payload + socket->bytes_read, size_to_read);
+	if (socket->status == 1 && !ring_buffer_unread(socket->recv_buf)) {
+		debug_print(WARNING, "Socket closed, done reading.");
+		return 0;
 	}
 
-	offset += size_to_read;
+	size_t out = ring_buffer_read(socket->recv_buf, len, buffer);
 
-	if (size_to_read < socket->bytes_available) {
-		socket->bytes_available = socket->bytes_available - size_to_read;
-		socket->bytes_read = size_to_read;
-		socket->current_packet = tcpdata;
-	} else {
-		socket->bytes_available = 0;
-		socket->current_packet = NULL;
-		free(tcpdata->payload);
-		free(tcpdata);
+	if (socket->window_stalled && socket->status != 1) {
+		/* The sender stalled against a closed window; now that space
+		 * has opened up, send a window update so it resumes. */
+		socket->window_stalled = 0;
+		net_send_tcp(socket, TCP_FLAGS_ACK, NULL, 0);
 	}
 
-
-	} while (!size_to_read);
-
-
-	return size_to_read;
+	return out;
 }
 
 static void net_handle_tcp(struct tcp_header * tcp, size_t length) {
@@ -682,10 +1188,15 @@ static void net_handle_tcp(struct tcp_header * tcp, size_t length) {
 			return;
 		}
 
-		if (socket->proto_sock.tcp_socket.seq_no != ntohl(tcp->ack_number)) {
-			// Drop packet
-			debug_print(WARNING, "Dropping packet. Expected ack: %d | Got ack: %d",
-					socket->proto_sock.tcp_socket.seq_no, ntohl(tcp->ack_number));
+		socket->proto_sock.tcp_socket.peer_window = ntohs(tcp->window_size);
+		if (htons(tcp->flags) & TCP_FLAGS_ACK) {
+			tcp_handle_ack(socket, ntohl(tcp->ack_number), data_length);
+		}
+
+		if (SEQ_AFTER(socket->proto_sock.tcp_socket.snd_una, ntohl(tcp->ack_number))) {
+			// Stale ACK from before our current window; drop it
+			debug_print(WARNING, "Dropping packet. Expected ack >= %d | Got ack: %d",
+					socket->proto_sock.tcp_socket.snd_una, ntohl(tcp->ack_number));
 			return;
 		}
 
@@ -699,11 +1210,7 @@ static void net_handle_tcp(struct tcp_header * tcp, size_t length) {
 			net_close(socket);
 			return;
 		} else {
-			// Store a copy of the layer 5 data for a userspace recv() call
-			tcpdata_t *tcpdata = malloc(sizeof(tcpdata_t));
-			tcpdata->payload_size = length - TCP_HEADER_LENGTH_FLIPPED(tcp);
-
-			if (tcpdata->payload_size == 0) {
+			if (data_length == 0) {
 				if (htons(tcp->flags) & TCP_FLAGS_FIN) {
 					/* We should make sure we finish sending before closing. */
 					debug_print(WARNING, "net_handle_tcp: Received FIN - socket closing with SYNACK");
@@ -712,38 +1219,35 @@ static void net_handle_tcp(struct tcp_header * tcp, size_t length) {
 					wakeup_queue(socket->proto_sock.tcp_socket.is_connected);
 					net_close(socket);
 				}
-				free(tcpdata);
 				return;
 			}
 
-			// debug_print(WARNING, "net_handle_tcp: payload length: %d\n",  length);
-			// debug_print(WARNING, "net_handle_tcp: flipped tcp flags hdr len: %d\n",  TCP_HEADER_LENGTH_FLIPPED(tcp));
-			// debug_print(WARNING, "net_handle_tcp: tcpdata->payload_size: %d\n", tcpdata->payload_size);
-
-			if (tcpdata->payload_size > 0) {
-				tcpdata->payload = malloc(tcpdata->payload_size);
-				memcpy(tcpdata->payload, tcp->payload, tcpdata->payload_size);
-			} else {
-				tcpdata->payload = NULL;
+			if (ntohl(tcp->seq_number) != socket->proto_sock.tcp_socket.ack_no) {
+				/* Out of order or a duplicate retransmission; re-ACK
+				 * what we actually have so the peer resynchronizes */
+				net_send_tcp(socket, TCP_FLAGS_ACK, NULL, 0);
+				return;
 			}
 
-			socket->proto_sock.tcp_socket.ack_no = ntohl(tcp->seq_number) + data_length;
-
-			if ((htons(tcp->flags) & TCP_FLAGS_SYN) && (htons(tcp->flags) & TCP_FLAGS_ACK) && data_length == 0) {
-				socket->proto_sock.tcp_socket.ack_no += 1;
+			if (data_length > ring_buffer_available(socket->recv_buf)) {
+				/* The sender overran the advertised window. Drop the
+				 * segment without ACKing it; the retransmission will
+				 * land once the reader has made room. */
+				debug_print(WARNING, "net_handle_tcp: Dropping %d bytes; receive buffer is full", data_length);
+				socket->window_stalled = 1;
+				return;
 			}
 
-			socket->proto_sock.tcp_socket.ack_no = ntohl(tcp->seq_number) + tcpdata->payload_size;
+			socket->proto_sock.tcp_socket.ack_no = ntohl(tcp->seq_number) + data_length;
 
-			spin_lock(socket->packet_queue_lock);
-			list_insert(socket->packet_queue, tcpdata);
-			spin_unlock(socket->packet_queue_lock);
+			/* The layer 5 data goes straight into the receive buffer
+			 * for a userspace recv() call; no allocation, and the
+			 * window check above means this never blocks. */
+			ring_buffer_write(socket->recv_buf, data_length, tcp->payload);
 
 			// Send acknowledgement of receiving data
 			net_send_tcp(socket, TCP_FLAGS_ACK, NULL, 0);
 
-			wakeup_queue(socket->packet_wait);
-
 			if (htons(tcp->flags) & TCP_FLAGS_FIN) {
 				/* We should make sure we finish sending before closing. */
 				debug_print(WARNING, "net_handle_tcp: Received FIN - socket closing with SYNACK");
@@ -758,36 +1262,90 @@ static void net_handle_tcp(struct tcp_header * tcp, size_t length) {
 	}
 }
 
-static void net_handle_udp(struct udp_packet * udp, size_t length) {
+static void net_handle_udp(struct udp_packet * udp, size_t length, uint32_t source) {
+
+	debug_print(INFO, "UDP response!");
 
-	// size_t data_length = length - sizeof(struct tcp_header);
-	debug_print(WARNING, "UDP response!");
+	/* DHCP replies drive the client state machine */
+	if (ntohs(udp->destination_port) == 68) {
+		net_handle_dhcp(udp);
+		return;
+	}
 
 	/* Short-circuit DNS */
 	if (ntohs(udp->source_port) == 53) {
-		debug_print(WARNING, "UDP response to DNS query!");
+		debug_print(INFO, "UDP response to DNS query!");
 		parse_dns_response(debug_file, udp);
 		return;
 	}
 
-	/* Find socket */
-	if (hashmap_has(_udp_sockets, (void *)ntohs(udp->source_port))) {
-		/* Do the thing */
+	/* Dispatch table is a bucket per local port; within the bucket a
+	 * socket bound to this remote beats the wildcard, so consumers
+	 * don't re-filter by sender in userspace */
+	uint16_t dest_port = ntohs(udp->destination_port);
+	list_t * bucket = hashmap_get(_udp_sockets, (void *)(uintptr_t)dest_port);
+	if (!bucket) return;
+
+	struct socket * target = NULL;
+	foreach(n, bucket) {
+		struct socket * sock = n->value;
+		if (sock->proto_sock.udp_socket.remote == source) {
+			target = sock;
+			break;
+		}
+		if (!sock->proto_sock.udp_socket.remote && !target) {
+			target = sock;
+		}
+	}
+	if (!target) return;
 
-	} else {
-		/* ??? */
+	struct udp_socket * udpsock = &target->proto_sock.udp_socket;
+	size_t data_len = ntohs(udp->length) - sizeof(struct udp_packet);
+
+	if (udpsock->packets->length >= UDP_QUEUE_MAX_PACKETS ||
+	    udpsock->queue_bytes + data_len > UDP_QUEUE_MAX_BYTES) {
+		udpsock->drops++;
+		debug_print(WARNING, "net_handle_udp: port %d queue full, dropped (%d total)",
+				dest_port, udpsock->drops);
+		return;
 	}
 
+	struct sized_blob * blob = malloc(sizeof(struct sized_blob) + data_len);
+	blob->size = data_len;
+	memcpy(blob->blob, udp->payload, data_len);
+
+	list_insert(udpsock->packets, blob);
+	udpsock->queue_bytes += data_len;
+	wakeup_queue(target->packet_wait);
 }
 
 static void net_handle_ipv4(struct ipv4_packet * ipv4) {
 	debug_print(INFO, "net_handle_ipv4: ENTER");
 	switch (ipv4->protocol) {
-		case IPV4_PROT_TCP:
-			net_handle_tcp((struct tcp_header *)ipv4->payload, ntohs(ipv4->length) - sizeof(struct ipv4_packet));
+		case IPV4_PROT_TCP: {
+			size_t tcp_len = ntohs(ipv4->length) - sizeof(struct ipv4_packet);
+			/* Verify the checksum - except from loopback, which can't corrupt */
+			if ((ntohl(ipv4->source) >> 24) != 127) {
+				uint16_t _len = htons(tcp_len);
+				struct tcp_check_header check_hd = {
+					.source = ipv4->source,
+					.destination = ipv4->destination,
+					.zeros = 0,
+					.protocol = 6,
+					.tcp_len = _len,
+				};
+				uint32_t sum = checksum_partial(&check_hd, sizeof(struct tcp_check_header), 0);
+				sum = checksum_partial(ipv4->payload, tcp_len, sum);
+				if (checksum_fold(sum) != 0) {
+					debug_print(WARNING, "net_handle_ipv4: dropping TCP segment with bad checksum");
+					break;
+				}
+			}
+			net_handle_tcp((struct tcp_header *)ipv4->payload, tcp_len);
 			break;
+		}
 		case IPV4_PROT_UDP:
-			net_handle_udp((struct udp_packet *)ipv4->payload, ntohs(ipv4->length) - sizeof(struct ipv4_packet));
+			net_handle_udp((struct udp_packet *)ipv4->payload, ntohs(ipv4->length) - sizeof(struct ipv4_packet), ntohl(ipv4->source));
 			break;
 		default:
 			/* XXX */
@@ -801,10 +1359,32 @@ static struct ethernet_packet* net_receive(void) {
 	return eth;
 }
 
+int net_bind(struct socket* socket, uint16_t port, uint32_t remote) {
+	if (socket->sock_type != SOCK_DGRAM) return -1;
+
+	socket->port_recv = port ? port : next_ephemeral_port();
+	socket->packet_wait = list_create();
+	socket->proto_sock.udp_socket.packets = list_create();
+	socket->proto_sock.udp_socket.queue_bytes = 0;
+	socket->proto_sock.udp_socket.drops = 0;
+	socket->proto_sock.udp_socket.remote = remote;
+
+	list_t * bucket = hashmap_get(_udp_sockets, (void *)(uintptr_t)socket->port_recv);
+	if (!bucket) {
+		bucket = list_create();
+		hashmap_set(_udp_sockets, (void *)(uintptr_t)socket->port_recv, bucket);
+	}
+	list_insert(bucket, socket);
+
+	return socket->port_recv;
+}
+
 int net_connect(struct socket* socket, uint32_t dest_ip, uint16_t dest_port) {
 	if (socket->sock_type == SOCK_DGRAM) {
-		// Can't connect UDP
-		return -1;
+		/* "Connecting" UDP just fixes the peer */
+		socket->ip = dest_ip;
+		socket->port_dest = dest_port;
+		return net_bind(socket, 0, dest_ip) > 0 ? 0 : -1;
 	}
 
 	memset(socket->mac, 0, sizeof(socket->mac)); // idk
@@ -813,8 +1393,20 @@ int net_connect(struct socket* socket, uint32_t dest_ip, uint16_t dest_port) {
 	socket->proto_sock.tcp_socket.seq_no = 0;
 	socket->proto_sock.tcp_socket.ack_no = 0;
 	socket->proto_sock.tcp_socket.status = 0;
-
-	socket->packet_queue = list_create();
+	socket->proto_sock.tcp_socket.unacked = list_create();
+	socket->proto_sock.tcp_socket.send_wait = list_create();
+	spin_init(socket->proto_sock.tcp_socket.tx_lock);
+	socket->proto_sock.tcp_socket.snd_una = 0;
+	socket->proto_sock.tcp_socket.cwnd = 4 * TCP_MSS;
+	socket->proto_sock.tcp_socket.ssthresh = 0xFFFF;
+	socket->proto_sock.tcp_socket.srtt = 0;
+	socket->proto_sock.tcp_socket.rttvar = 0;
+	socket->proto_sock.tcp_socket.rto = 1000;
+	socket->proto_sock.tcp_socket.peer_window = TCP_MSS;
+	socket->proto_sock.tcp_socket.dup_acks = 0;
+
+	socket->recv_buf = ring_buffer_create(TCP_RECV_BUF_SIZE);
+	socket->window_stalled = 0;
 	socket->packet_wait = list_create();
 
 	socket->ip = dest_ip; //ip_aton("10.255.50.206");
@@ -833,85 +1425,224 @@ int net_connect(struct socket* socket, uint32_t dest_ip, uint16_t dest_port) {
 	return 1;
 }
 
-static void placeholder_dhcp(void) {
-	debug_print(NOTICE, "Sending DHCP discover\n");
+static void dhcp_send(uint8_t msg_type, uint32_t requested, uint32_t server) {
 	void * tmp = malloc(1024);
-	size_t packet_size = write_dhcp_packet(tmp);
+	size_t packet_size = write_dhcp_packet(tmp, _dhcp_xid, msg_type, requested, server);
 	_netif.send_packet(tmp, packet_size);
 	free(tmp);
+}
 
-	{
-		struct ethernet_packet * eth = (struct ethernet_packet *)_netif.get_packet();
-		uint16_t eth_type = ntohs(eth->type);
-
-		debug_print(NOTICE, "Ethernet II, Src: (%2x:%2x:%2x:%2x:%2x:%2x), Dst: (%2x:%2x:%2x:%2x:%2x:%2x) [type=%4x)\n",
-				eth->source[0], eth->source[1], eth->source[2],
-				eth->source[3], eth->source[4], eth->source[5],
-				eth->destination[0], eth->destination[1], eth->destination[2],
-				eth->destination[3], eth->destination[4], eth->destination[5],
-				eth_type);
-
+static void dhcp_alert_waiters(void) {
+	if (!_dhcp_alert) return;
+	while (_dhcp_alert->head) {
+		node_t * node = list_dequeue(_dhcp_alert);
+		process_t * p = node->value;
+		process_alert_node(p, _dhcp_alert);
+		free(node);
+	}
+}
 
-		struct ipv4_packet * ipv4 = (struct ipv4_packet *)eth->payload;
-		uint32_t src_addr = ntohl(ipv4->source);
-		uint32_t dst_addr = ntohl(ipv4->destination);
-		uint16_t length   = ntohs(ipv4->length);
+static void net_handle_dhcp(struct udp_packet * udp) {
+	struct dhcp_packet * dhcp = (struct dhcp_packet *)udp->payload;
+	if (ntohl(dhcp->xid) != _dhcp_xid) return;
+
+	uint16_t length = ntohs(udp->length) - sizeof(struct udp_packet);
+
+	/* Walk the options for everything we care about */
+	uint8_t msg_type = 0;
+	uint32_t server = 0;
+	uint32_t lease = 0;
+	uint32_t netmask = 0;
+	uint32_t router = 0;
+	uint32_t dns = 0;
+
+	size_t i = sizeof(struct dhcp_packet);
+	size_t j = 0;
+	while (i < length) {
+		uint8_t type = dhcp->options[j];
+		uint8_t len  = dhcp->options[j+1];
+		uint8_t * data = &dhcp->options[j+2];
+		if (type == 255) break;
+		switch (type) {
+			case 53: msg_type = data[0]; break;
+			case 54: server  = ntohl(*(uint32_t *)data); break;
+			case 51: lease   = ntohl(*(uint32_t *)data); break;
+			case 1:  netmask = ntohl(*(uint32_t *)data); break;
+			case 3:  router  = ntohl(*(uint32_t *)data); break;
+			case 6:  dns     = ntohl(*(uint32_t *)data); break;
+		}
+		j += 2 + len;
+		i += 2 + len;
+	}
 
-		char src_ip[16];
-		char dst_ip[16];
+	switch (msg_type) {
+		case 2: /* OFFER */
+			if (_dhcp_state == DHCP_STATE_SELECTING) {
+				_dhcp_offer = ntohl(dhcp->yiaddr);
+				_dhcp_server = server;
+				_dhcp_state = DHCP_STATE_REQUESTING;
+				dhcp_send(3, _dhcp_offer, _dhcp_server);
+			}
+			break;
+		case 5: /* ACK */
+			if (_dhcp_state == DHCP_STATE_REQUESTING || _dhcp_state == DHCP_STATE_RENEWING) {
+				_netif.source = ntohl(dhcp->yiaddr);
+				if (netmask) _netmask = netmask;
+				if (router) _gateway = router;
+				if (dns) _dns_server = dns;
+				if (lease) _dhcp_lease = lease;
+				_dhcp_state = DHCP_STATE_BOUND;
+				char ip[16];
+				ip_ntoa(_netif.source, ip);
+				debug_print(NOTICE, "DHCP bound: %s (lease %ds)", ip, _dhcp_lease);
+				dhcp_alert_waiters();
+			}
+			break;
+		case 6: /* NAK */
+			debug_print(WARNING, "DHCP NAK; reacquiring");
+			_dhcp_state = DHCP_STATE_INIT;
+			break;
+	}
+}
 
-		ip_ntoa(src_addr, src_ip);
-		ip_ntoa(dst_addr, dst_ip);
+static void dhcp_sleep(unsigned long seconds, unsigned long subseconds) {
+	unsigned long s, ss;
+	relative_time(seconds, subseconds, &s, &ss);
+	sleep_until((process_t *)current_process, s, ss);
+	switch_task(0);
+}
 
-		debug_print(NOTICE, "IP packet [%s → %s] length=%d bytes\n",
-				src_ip, dst_ip, length);
+/*
+ * Drives acquisition and renewal. Discover/request rounds that go
+ * unanswered start over with exponentially longer waits; once bound we
+ * sleep out half the lease and renew in place.
+ */
+static void net_dhcp_task(void * data, char * name) {
+	unsigned long backoff = 1;
+	while (1) {
+		switch (_dhcp_state) {
+			case DHCP_STATE_INIT:
+				_dhcp_xid++;
+				_dhcp_state = DHCP_STATE_SELECTING;
+				dhcp_send(1, 0, 0);
+				break;
+			case DHCP_STATE_SELECTING:
+			case DHCP_STATE_REQUESTING: {
+				int state = _dhcp_state;
+				unsigned long waited = 0;
+				while (_dhcp_state == state && waited < backoff * 2) {
+					dhcp_sleep(0, 500);
+					waited++;
+				}
+				if (_dhcp_state == state) {
+					_dhcp_state = DHCP_STATE_INIT;
+					backoff = MIN(backoff * 2, 64);
+				}
+				break;
+			}
+			case DHCP_STATE_BOUND: {
+				backoff = 1;
+				unsigned long renew_at = timer_ticks + _dhcp_lease / 2;
+				while (_dhcp_state == DHCP_STATE_BOUND && timer_ticks < renew_at) {
+					dhcp_sleep(1, 0);
+				}
+				if (_dhcp_state == DHCP_STATE_BOUND) {
+					_dhcp_state = DHCP_STATE_RENEWING;
+					dhcp_send(3, _dhcp_offer, _dhcp_server);
+				}
+				break;
+			}
+			case DHCP_STATE_RENEWING: {
+				unsigned long waited = 0;
+				while (_dhcp_state == DHCP_STATE_RENEWING && waited < 20) {
+					dhcp_sleep(0, 500);
+					waited++;
+				}
+				if (_dhcp_state == DHCP_STATE_RENEWING) {
+					/* Renewal went unanswered; reacquire from scratch */
+					_dhcp_state = DHCP_STATE_INIT;
+				}
+				break;
+			}
+		}
+	}
+}
 
-		struct udp_packet * udp = (struct udp_packet *)ipv4->payload;;
-		uint16_t src_port = ntohs(udp->source_port);
-		uint16_t dst_port = ntohs(udp->destination_port);
-		uint16_t udp_len  = ntohs(udp->length);
+/* /proc/net: human-readable config, pollable for interface readiness */
+static uint32_t netstat_read(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	char buf[512];
+	if (_dhcp_state == DHCP_STATE_BOUND || _dhcp_state == DHCP_STATE_RENEWING) {
+		char ip[16], mask[16], gw[16], dns[16];
+		ip_ntoa(_netif.source, ip);
+		ip_ntoa(_netmask, mask);
+		ip_ntoa(_gateway, gw);
+		ip_ntoa(_dns_server, dns);
+		sprintf(buf, "state: bound\nip: %s\nnetmask: %s\ngateway: %s\ndns: %s\n", ip, mask, gw, dns);
+	} else {
+		sprintf(buf, "state: configuring\n");
+	}
+	size_t _bsize = strlen(buf);
+	if (offset > _bsize) return 0;
+	if (size > _bsize - offset) size = _bsize - offset;
+	memcpy(buffer, buf + offset, size);
+	return size;
+}
 
-		debug_print(NOTICE, "UDP [%d → %d] length=%d bytes\n",
-				src_port, dst_port, udp_len);
+static int netstat_check(fs_node_t * node) {
+	return (_dhcp_state == DHCP_STATE_BOUND || _dhcp_state == DHCP_STATE_RENEWING) ? 0 : 1;
+}
 
-		struct dhcp_packet * dhcp = (struct dhcp_packet *)udp->payload;
-		uint32_t yiaddr = ntohl(dhcp->yiaddr);
+static int netstat_wait(fs_node_t * node, void * process) {
+	if (!_dhcp_alert) {
+		_dhcp_alert = list_create();
+	}
+	list_insert(_dhcp_alert, process);
+	list_insert(((process_t *)process)->node_waits, _dhcp_alert);
+	return 0;
+}
 
-		char yiaddr_ip[16];
-		ip_ntoa(yiaddr, yiaddr_ip);
-		debug_print(NOTICE,  "DHCP Offer: %s\n", yiaddr_ip);
+static fs_node_t * netstat_create(void) {
+	fs_node_t * fnode = malloc(sizeof(fs_node_t));
+	memset(fnode, 0x00, sizeof(fs_node_t));
+	strcpy(fnode->name, "net");
+	fnode->mask  = 0444;
+	fnode->flags = FS_FILE;
+	fnode->read  = netstat_read;
+	fnode->selectcheck = netstat_check;
+	fnode->selectwait  = netstat_wait;
+	return fnode;
+}
 
-		_netif.source = yiaddr;
+/*
+ * Loopback delivery. Frames queued by net_send_ether for local
+ * destinations are re-dispatched here at memory bandwidth, without a
+ * driver or wire format round-trip beyond the headers already built.
+ */
+static void net_loopback_task(void * data, char * name) {
+	while (1) {
+		IRQ_OFF;
+		if (!_lo_queue->length) {
+			sleep_on(_lo_wait);
+		} else {
+			IRQ_RES;
+		}
 
-		debug_print(NOTICE,"  Scanning offer for DNS servers...");
+		while (1) {
+			spin_lock(_lo_lock);
+			node_t * n = _lo_queue->length ? list_dequeue(_lo_queue) : NULL;
+			spin_unlock(_lo_lock);
+			if (!n) break;
 
-		size_t i = sizeof(struct dhcp_packet);
-		size_t j = 0;
-		while (i < length) {
-			uint8_t type = dhcp->options[j];
-			uint8_t len  = dhcp->options[j+1];
-			uint8_t * data = &dhcp->options[j+2];
+			pbuf_t * frame = n->value;
+			free(n);
 
-			debug_print(NOTICE,"    type=%d, len=%d", type, len);
-			if (type == 255) {
-				break;
-			} else if (type == 6) {
-				/* DNS Server! */
-				uint32_t dnsaddr = ntohl(*(uint32_t *)data);
-				char ip[16];
-				ip_ntoa(dnsaddr, ip);
-				debug_print(NOTICE, "Found one: %s", ip);
-				_dns_server = dnsaddr;
+			struct ethernet_packet * eth = (struct ethernet_packet *)frame->data;
+			if (ntohs(eth->type) == ETHERNET_TYPE_IPV4 && _tcp_sockets) {
+				net_handle_ipv4((struct ipv4_packet *)eth->payload);
 			}
-
-			j += 2 + len;
-			i += 2 + len;
+			free(frame);
 		}
-
-
-		free(eth);
 	}
-
 }
 
 void net_handler(void * data, char * name) {
@@ -920,13 +1651,13 @@ void net_handler(void * data, char * name) {
 
 	_dns_server = ip_aton("10.0.2.3");
 
-	placeholder_dhcp();
-
-	dns_waiters = list_create();
+	create_kernel_tasklet(net_dhcp_task, "[dhcp]", NULL);
 
 	_tcp_sockets = hashmap_create_int(0xFF);
 	_udp_sockets = hashmap_create_int(0xFF);
 
+	create_kernel_tasklet(net_retransmit_task, "[netrt]", NULL);
+
 	while (1) {
 		struct ethernet_packet * eth = net_receive();
 
@@ -937,7 +1668,7 @@ void net_handler(void * data, char * name) {
 				net_handle_ipv4((struct ipv4_packet *)eth->payload);
 				break;
 			case ETHERNET_TYPE_ARP:
-				// net_handle_arp(eth);
+				net_handle_arp(eth);
 				break;
 		}
 
@@ -945,20 +1676,34 @@ void net_handler(void * data, char * name) {
 	}
 }
 
-size_t write_dhcp_packet(uint8_t * buffer) {
+size_t write_dhcp_packet(uint8_t * buffer, uint32_t xid, uint8_t msg_type, uint32_t requested, uint32_t server) {
 	size_t offset = 0;
 	size_t payload_size = sizeof(struct dhcp_packet);
 
 	/* First, let's figure out how big this is supposed to be... */
 
-	uint8_t dhcp_options[] = {
-		53, /* Message type */
-		1,  /* Length: 1 */
-		1,  /* Discover */
-		255, /* END */
-	};
+	uint8_t dhcp_options[32];
+	size_t opts = 0;
+	dhcp_options[opts++] = 53; /* Message type */
+	dhcp_options[opts++] = 1;
+	dhcp_options[opts++] = msg_type;
+	if (requested) {
+		uint32_t _requested = htonl(requested);
+		dhcp_options[opts++] = 50; /* Requested address */
+		dhcp_options[opts++] = 4;
+		memcpy(&dhcp_options[opts], &_requested, 4);
+		opts += 4;
+	}
+	if (server) {
+		uint32_t _server = htonl(server);
+		dhcp_options[opts++] = 54; /* Server identifier */
+		dhcp_options[opts++] = 4;
+		memcpy(&dhcp_options[opts], &_server, 4);
+		opts += 4;
+	}
+	dhcp_options[opts++] = 255; /* END */
 
-	payload_size += sizeof(dhcp_options);
+	payload_size += opts;
 
 	/* Then, let's write an ethernet frame */
 	struct ethernet_packet eth_out = {
@@ -1012,12 +1757,13 @@ size_t write_dhcp_packet(uint8_t * buffer) {
 	offset += sizeof(struct udp_packet);
 
 	/* BOOTP headers */
+	uint32_t _xid = htonl(xid);
 	struct dhcp_packet bootp_out = {
 		.op = 1,
 		.htype = 1,
 		.hlen = 6, /* mac address... */
 		.hops = 0,
-		.xid = htonl(0x1337), /* transaction id */
+		.xid = _xid, /* transaction id */
 		.secs = 0,
 		.flags = 0,
 
@@ -1036,8 +1782,8 @@ size_t write_dhcp_packet(uint8_t * buffer) {
 	memcpy(&buffer[offset], &bootp_out, sizeof(struct dhcp_packet));
 	offset += sizeof(struct dhcp_packet);
 
-	memcpy(&buffer[offset], &dhcp_options, sizeof(dhcp_options));
-	offset += sizeof(dhcp_options);
+	memcpy(&buffer[offset], &dhcp_options, opts);
+	offset += opts;
 
 	return offset;
 }
@@ -1080,7 +1826,8 @@ static void parse_dns_response(fs_node_t * tty, void * last_packet) {
 		fprintf(tty, " - Type: %4x %4x; ", ntohs(d[0]), ntohs(d[1]));
 		offset += 4;
 		uint32_t * t = (uint32_t *)&bytes[offset];
-		fprintf(tty, "TTL: %d; ", ntohl(t[0]));
+		uint32_t ttl = ntohl(t[0]);
+		fprintf(tty, "TTL: %d; ", ttl);
 		offset += 4;
 		uint16_t * l = (uint16_t *)&bytes[offset];
 		int _l = ntohs(l[0]);
@@ -1091,10 +1838,8 @@ static void parse_dns_response(fs_node_t * tty, void * last_packet) {
 			char ip[16];
 			ip_ntoa(ntohl(i[0]), ip);
 			fprintf(tty, " Address: %s\n", ip);
-			debug_print(NOTICE, "Domain [%s] maps to [%s]", buf, ip);
-			if (!hashmap_has(dns_cache, buf)) {
-				hashmap_set(dns_cache, buf, strdup(ip));
-			}
+			debug_print(NOTICE, "Domain [%s] maps to [%s] for %ds", buf, ip, ttl);
+			dns_cache_set(buf, ip, ttl < DNS_MINIMUM_TTL ? DNS_MINIMUM_TTL : ttl);
 		} else {
 			if (ntohs(d[0]) == 5) {
 				fprintf(tty, "CNAME: ");
@@ -1108,7 +1853,22 @@ static void parse_dns_response(fs_node_t * tty, void * last_packet) {
 		answers++;
 	}
 
-	wakeup_queue(dns_waiters);
+	/* Settle whoever was waiting on this query */
+	uint16_t qid = ntohs(dns->qid);
+	dns_query_t * query = hashmap_get(dns_inflight, (void *)(uintptr_t)qid);
+	if (query) {
+		hashmap_remove(dns_inflight, (void *)(uintptr_t)qid);
+		uint32_t ip;
+		if (!dns_cache_lookup(query->name, &ip)) {
+			/* NXDOMAIN (or no usable answer): cache the failure so
+			 * we don't hammer the server with repeats */
+			debug_print(WARNING, "Negative cache for [%s]", query->name);
+			dns_cache_set(query->name, NULL, DNS_NEGATIVE_TTL);
+		}
+		wakeup_queue(query->waiters);
+		free(query->waiters);
+		free(query);
+	}
 }
 
 static fs_node_t * netfs_create(void) {
@@ -1127,19 +1887,28 @@ static fs_node_t * netfs_create(void) {
 
 static int init(void) {
 	dns_cache = hashmap_create(10);
-
-	hashmap_set(dns_cache, "dakko.us", strdup("104.131.140.26"));
-	hashmap_set(dns_cache, "toaruos.org", strdup("104.131.140.26"));
-	hashmap_set(dns_cache, "www.toaruos.org", strdup("104.131.140.26"));
-	hashmap_set(dns_cache, "www.yelp.com", strdup("104.16.57.23"));
-	hashmap_set(dns_cache, "s3-media2.fl.yelpcdn.com", strdup("199.27.79.175"));
-	hashmap_set(dns_cache, "forum.osdev.org", strdup("173.255.206.39"));
-	hashmap_set(dns_cache, "wolfgun.puckipedia.com", strdup("104.47.147.203"));
-	hashmap_set(dns_cache, "irc.freenode.net", strdup("91.217.189.42"));
-	hashmap_set(dns_cache, "i.imgur.com", strdup("23.235.47.193"));
+	dns_inflight = hashmap_create_int(10);
+	_arp_cache = hashmap_create_int(10);
+	_lo_queue = list_create();
+	_lo_wait = list_create();
+	create_kernel_tasklet(net_loopback_task, "[lo]", NULL);
+
+	/* Static seeds never expire */
+	dns_cache_set("dakko.us", "104.131.140.26", 0);
+	dns_cache_set("toaruos.org", "104.131.140.26", 0);
+	dns_cache_set("www.toaruos.org", "104.131.140.26", 0);
+	dns_cache_set("www.yelp.com", "104.16.57.23", 0);
+	dns_cache_set("s3-media2.fl.yelpcdn.com", "199.27.79.175", 0);
+	dns_cache_set("forum.osdev.org", "173.255.206.39", 0);
+	dns_cache_set("wolfgun.puckipedia.com", "104.47.147.203", 0);
+	dns_cache_set("irc.freenode.net", "91.217.189.42", 0);
+	dns_cache_set("i.imgur.com", "23.235.47.193", 0);
 
 	/* /dev/net/{domain|ip}/{protocol}/{port} */
 	vfs_mount("/dev/net", netfs_create());
+	vfs_mount("/proc/net", netstat_create());
+
+	socket_install_interface(&netfs_socket_interface);
 
 	return 0;
 }
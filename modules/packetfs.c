@@ -8,9 +8,11 @@
 #include <pipe.h>
 #include <module.h>
 #include <logging.h>
+#include <printf.h>
 #include <ioctl.h>
 
 #define MAX_PACKET_SIZE 1024
+#define MAX_PACKET_BYTES (sizeof(struct packet) + MAX_PACKET_SIZE)
 
 typedef struct packet_manager {
 	/* uh, nothing, lol */
@@ -115,6 +117,16 @@ static uint32_t read_server(fs_node_t * node, uint32_t offset, uint32_t size, ui
 	uint32_t out = packet->size + sizeof(packet_t);
 
 	free(packet);
+
+	/* While the caller has room for another full-sized packet, keep
+	 * draining the queue; a burst of input then costs one syscall. */
+	while (size - out >= MAX_PACKET_BYTES && pipe_size(p->server_pipe) > 0) {
+		receive_packet(p->server_pipe, &packet);
+		memcpy(buffer + out, packet, packet->size + sizeof(packet_t));
+		out += packet->size + sizeof(packet_t);
+		free(packet);
+	}
+
 	return out;
 }
 
@@ -170,6 +182,25 @@ static uint32_t read_client(fs_node_t * node, uint32_t offset, uint32_t size, ui
 
 	receive_packet(c->pipe, &packet);
 
+	if (size > MAX_PACKET_BYTES) {
+		/* A buffer big enough to hold more than one maximum-sized
+		 * packet opts into batched reads: the caller gets whole
+		 * packet records (headers included, so they self-frame) and
+		 * we drain everything queued that fits. */
+		memcpy(buffer, packet, packet->size + sizeof(packet_t));
+		uint32_t out = packet->size + sizeof(packet_t);
+		free(packet);
+
+		while (size - out >= MAX_PACKET_BYTES && pipe_size(c->pipe) > 0) {
+			receive_packet(c->pipe, &packet);
+			memcpy(buffer + out, packet, packet->size + sizeof(packet_t));
+			out += packet->size + sizeof(packet_t);
+			free(packet);
+		}
+
+		return out;
+	}
+
 	if (packet->size > size) {
 		debug_print(WARNING, "[pex] Client is not reading enough bytes to hold packet of size %d", packet->size);
 		return -1;
@@ -446,9 +477,35 @@ static void unlink_packetfs(fs_node_t *parent, char *name) {
 	spin_unlock(p->lock);
 }
 
+/* The one manager mounted at /dev/pex, kept for the debug shell. */
+static pex_t * pex_instance = NULL;
+
+/*
+ * Queue depths for every exchange, for the debug shell's `stats pex`:
+ * client count, bytes pending in the server's pipe, and bytes pending
+ * across client reply pipes. Unlocked - diagnostic eyeballing only.
+ */
+void pex_debug_stats(fs_node_t * tty) {
+	if (!pex_instance || !pex_instance->exchanges->length) {
+		fprintf(tty, "No packet exchanges.\n");
+		return;
+	}
+	fprintf(tty, "%-20s %-8s %-14s %s\n", "exchange", "clients", "server-queue", "client-queues");
+	foreach(f, pex_instance->exchanges) {
+		pex_ex_t * p = f->value;
+		int client_bytes = 0;
+		foreach(c, p->clients) {
+			client_bytes += pipe_size(((pex_client_t *)c->value)->pipe);
+		}
+		fprintf(tty, "%-20s %-8d %-14d %d\n",
+				p->name, p->clients->length, pipe_size(p->server_pipe), client_bytes);
+	}
+}
+
 static fs_node_t * packetfs_manager(void) {
 	pex_t * pex = malloc(sizeof(pex_t));
 	pex->exchanges = list_create();
+	pex_instance = pex;
 
 	spin_init(pex->lock);
 
@@ -10,6 +10,11 @@
 #include <process.h>
 #include <printf.h>
 #include <module.h>
+#include <procfs.h>
+#include <trace.h>
+#include <syscallstats.h>
+#include <boottime.h>
+#include <kstats.h>
 
 #define PROCFS_STANDARD_ENTRIES (sizeof(std_entries) / sizeof(struct procfs_entry))
 #define PROCFS_PROCDIR_ENTRIES  (sizeof(procdir_entries) / sizeof(struct procfs_entry))
@@ -110,6 +115,8 @@ static uint32_t proc_status_func(fs_node_t *node, uint32_t offset, uint32_t size
 			"Pid:\t%d\n" /* pid */
 			"PPid:\t%d\n" /* parent pid */
 			"Uid:\t%d\n"
+			"CpuTime:\t%d\n" /* accumulated CPU time, msec */
+			"Priority:\t%d\n"
 			"Ueip:\t0x%x\n"
 			"SCid:\t%d\n"
 			"SC0:\t0x%x\n"
@@ -124,6 +131,8 @@ static uint32_t proc_status_func(fs_node_t *node, uint32_t offset, uint32_t size
 			proc->id,
 			parent ? parent->id : 0,
 			proc->user,
+			(int)proc->cpu_total,
+			proc->priority,
 			proc->syscall_registers ? proc->syscall_registers->eip : 0,
 			proc->syscall_registers ? proc->syscall_registers->eax : 0,
 			proc->syscall_registers ? proc->syscall_registers->ebx : 0,
@@ -217,7 +226,19 @@ static uint32_t meminfo_func(fs_node_t *node, uint32_t offset, uint32_t size, ui
 	char buf[1024];
 	unsigned int total = memory_total();
 	unsigned int free  = total - memory_use();
-	sprintf(buf, "MemTotal: %d kB\nMemFree: %d kB\n", total, free);
+	sprintf(buf, "MemTotal: %d kB\nMemFree: %d kB\nMemUsed: %d kB\n", total, free, total - free);
+
+	/* Kernel heap occupancy, per allocator bin */
+	uint32_t object_size, pages, live;
+	for (int bin = 0; klmalloc_bin_usage(bin, &object_size, &pages, &live); ++bin) {
+		if (!pages && !live) continue;
+		if (object_size) {
+			sprintf(buf + strlen(buf), "KmallocBin%d: %d kB (%d byte objects, %d live)\n",
+					bin, pages * 4, object_size, live);
+		} else {
+			sprintf(buf + strlen(buf), "KmallocBig: %d kB (%d live)\n", pages * 4, live);
+		}
+	}
 
 	size_t _bsize = strlen(buf);
 	if (offset > _bsize) return 0;
@@ -288,6 +309,161 @@ static uint32_t compiler_func(fs_node_t *node, uint32_t offset, uint32_t size, u
 	return size;
 }
 
+static uint32_t processes_func(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+	size_t count = process_list->length;
+	struct proc_info * records = malloc(sizeof(struct proc_info) * count);
+	size_t entries = 0;
+
+	foreach(lnode, process_list) {
+		if (entries >= count) break;
+		process_t * proc = (process_t *)lnode->value;
+		process_t * parent = process_get_parent(proc);
+		struct proc_info * r = &records[entries];
+		memset(r, 0x00, sizeof(struct proc_info));
+
+		r->pid       = proc->id;
+		r->ppid      = parent ? parent->id : 0;
+		r->tgid      = proc->group ? proc->group : proc->id;
+		r->uid       = proc->user;
+		r->cpu_total = proc->cpu_total;
+		r->state     = process_is_ready(proc) ? 'R' : 'S';
+
+		char * name = proc->name + strlen(proc->name) - 1;
+		while (1) {
+			if (*name == '/') {
+				name++;
+				break;
+			}
+			if (name == proc->name) break;
+			name--;
+		}
+		size_t len = strlen(name);
+		if (len > sizeof(r->name) - 1) len = sizeof(r->name) - 1;
+		memcpy(r->name, name, len);
+
+		if (proc->cmdline) {
+			char *  _buf = r->cmdline;
+			char *  _end = r->cmdline + sizeof(r->cmdline) - 1;
+			char ** args = proc->cmdline;
+			while (*args && _buf < _end) {
+				len = strlen(*args);
+				if (len > (size_t)(_end - _buf)) len = _end - _buf;
+				memcpy(_buf, *args, len);
+				_buf += len;
+				args++;
+				if (*args && _buf < _end) {
+					*_buf++ = ' ';
+				}
+			}
+		} else {
+			memcpy(r->cmdline, r->name, strlen(r->name));
+		}
+
+		entries++;
+	}
+
+	size_t _bsize = entries * sizeof(struct proc_info);
+	if (offset > _bsize) {
+		free(records);
+		return 0;
+	}
+	if (size > _bsize - offset) size = _bsize - offset;
+
+	memcpy(buffer, (uint8_t *)records + offset, size);
+	free(records);
+	return size;
+}
+
+static uint32_t ksyms_func(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+	size_t count = ksym_total();
+	size_t alloc = count * 96 + 1;
+	char * buf = malloc(alloc);
+	size_t len = 0;
+
+	for (size_t i = 0; i < count; ++i) {
+		uintptr_t addr;
+		char * name = ksym_get(i, &addr);
+		if (!name) break;
+		if (len + strlen(name) + 16 > alloc) break;
+		len += sprintf(buf + len, "0x%x %s\n", addr, name);
+	}
+
+	if (offset > len) {
+		free(buf);
+		return 0;
+	}
+	if (size > len - offset) size = len - offset;
+
+	memcpy(buffer, buf + offset, size);
+	free(buf);
+	return size;
+}
+
+static uint32_t trace_func(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+	/* Draining read: each read returns whatever trace records are
+	 * pending, regardless of offset, like a character device. */
+	return trace_dequeue(buffer, size);
+}
+
+static uint32_t syscalls_func(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+	/* Binary node: an array of syscall_stat_t indexed by syscall
+	 * number. Empty until accounting is enabled with sysfunc 15. */
+	uint32_t count = 0;
+	syscall_stat_t * stats = syscall_stats_get(&count);
+	if (!stats) return 0;
+
+	uint32_t total = count * sizeof(syscall_stat_t);
+	if (offset > total) return 0;
+	if (size > total - offset) size = total - offset;
+
+	memcpy(buffer, (uint8_t *)stats + offset, size);
+	return size;
+}
+
+static uint32_t boottime_func(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+	size_t count = 0;
+	boot_mark_t * marks = boot_marks_get(&count);
+
+	size_t alloc = count * (BOOT_MARK_NAME + 16) + 1;
+	char * buf = malloc(alloc);
+	unsigned int len = 0;
+
+	for (size_t i = 0; i < count; ++i) {
+		len += sprintf(buf + len, "%d.%03d %s\n", marks[i].ticks, marks[i].subticks, marks[i].name);
+	}
+
+	if (offset > len) {
+		free(buf);
+		return 0;
+	}
+	if (size > len - offset) size = len - offset;
+
+	memcpy(buffer, buf + offset, size);
+	free(buf);
+	return size;
+}
+
+static uint32_t kstats_func(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+	size_t alloc = 4096;
+	char * buf = malloc(alloc);
+	unsigned int len = 0;
+
+	for (kstat_t * stat = kstat_first(); stat; stat = stat->next) {
+		if (len + strlen(stat->name) + 16 > alloc) break;
+		len += sprintf(buf + len, "%s %d\n", stat->name, stat->value);
+	}
+
+	if (offset > len) {
+		free(buf);
+		return 0;
+	}
+	if (size > len - offset) size = len - offset;
+
+	memcpy(buffer, buf + offset, size);
+	free(buf);
+	return size;
+}
+
 static struct procfs_entry std_entries[] = {
 	{-1, "cpuinfo",  cpuinfo_func},
 	{-2, "meminfo",  meminfo_func},
@@ -295,6 +471,12 @@ static struct procfs_entry std_entries[] = {
 	{-4, "cmdline",  cmdline_func},
 	{-5, "version",  version_func},
 	{-6, "compiler", compiler_func},
+	{-7, "processes", processes_func},
+	{-8, "trace",    trace_func},
+	{-9, "ksyms",    ksyms_func},
+	{-10, "syscalls", syscalls_func},
+	{-11, "boottime", boottime_func},
+	{-12, "kstats",   kstats_func},
 };
 
 static struct dirent * readdir_procfs_root(fs_node_t *node, uint32_t index) {
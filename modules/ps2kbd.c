@@ -22,25 +22,36 @@
 #define KEY_PENDING 0x64
 #define KEY_IRQ     1
 
-static fs_node_t * keyboard_pipe;
+#define KEY_F_BIT   0x20 /* data in the output buffer belongs to the mouse */
 
-/*
- * Wait on the keyboard.
- */
-static void keyboard_wait(void) {
-	while(inportb(KEY_PENDING) & 2);
-}
+/* More scancodes than one interrupt will realistically deliver; the
+ * point is that everything pending goes out in one write_fs, so an
+ * E0-prefixed sequence costs the reader one wakeup, not one per byte. */
+#define SCANCODES_PER_IRQ 16
+
+static fs_node_t * keyboard_pipe;
 
 /*
  * Keyboard interrupt callback
  */
 static int keyboard_handler(struct regs *r) {
-	unsigned char scancode;
-	keyboard_wait();
-	scancode = inportb(KEY_DEVICE);
+	uint8_t buf[SCANCODES_PER_IRQ];
+	int count = 0;
+
+	uint8_t status = inportb(KEY_PENDING);
+	while ((status & 0x01) && count < SCANCODES_PER_IRQ) {
+		if (status & KEY_F_BIT) {
+			/* Mouse data; leave it for the aux interrupt handler. */
+			break;
+		}
+		buf[count++] = inportb(KEY_DEVICE);
+		status = inportb(KEY_PENDING);
+	}
 	irq_ack(KEY_IRQ);
 
-	write_fs(keyboard_pipe, 0, 1, (uint8_t []){scancode});
+	if (count) {
+		write_fs(keyboard_pipe, 0, count, buf);
+	}
 	return 1;
 }
 
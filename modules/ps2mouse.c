@@ -71,7 +71,22 @@ static uint8_t mouse_read(void) {
 	return t;
 }
 
+/* Completed packets accumulated within one interrupt; they are
+ * written to the pipe in a single write_fs so a burst of motion
+ * costs readers one wakeup, not one per packet. */
+#define PACKETS_PER_IRQ 8
+
+static void mouse_flush(mouse_device_packet_t * batch, int count) {
+	mouse_device_packet_t bitbucket;
+	while (pipe_size(mouse_pipe) > (int)((DISCARD_POINT - count) * sizeof(bitbucket))) {
+		read_fs(mouse_pipe, 0, sizeof(bitbucket), (uint8_t *)&bitbucket);
+	}
+	write_fs(mouse_pipe, 0, count * sizeof(mouse_device_packet_t), (uint8_t *)batch);
+}
+
 static int mouse_handler(struct regs *r) {
+	mouse_device_packet_t batch[PACKETS_PER_IRQ];
+	int batched = 0;
 	uint8_t status = inportb(MOUSE_STATUS);
 	while (status & MOUSE_BBIT) {
 		int8_t mouse_in = inportb(MOUSE_PORT);
@@ -105,39 +120,46 @@ finish_packet:
 				goto read_next;
 			}
 			/* We now have a full mouse packet ready to use */
-			mouse_device_packet_t packet;
-			packet.magic = MOUSE_MAGIC;
-			packet.x_difference = mouse_byte[1];
-			packet.y_difference = mouse_byte[2];
-			packet.buttons = 0;
+			mouse_device_packet_t * packet = &batch[batched];
+			packet->magic = MOUSE_MAGIC;
+			packet->x_difference = mouse_byte[1];
+			packet->y_difference = mouse_byte[2];
+			packet->buttons = 0;
+			packet->ticks = timer_ticks;
+			packet->subticks = timer_subticks;
 			if (mouse_byte[0] & 0x01) {
-				packet.buttons |= LEFT_CLICK;
+				packet->buttons |= LEFT_CLICK;
 			}
 			if (mouse_byte[0] & 0x02) {
-				packet.buttons |= RIGHT_CLICK;
+				packet->buttons |= RIGHT_CLICK;
 			}
 			if (mouse_byte[0] & 0x04) {
-				packet.buttons |= MIDDLE_CLICK;
+				packet->buttons |= MIDDLE_CLICK;
 			}
 
 			if (mouse_mode == MOUSE_SCROLLWHEEL && mouse_byte[3]) {
 				if (mouse_byte[3] > 0) {
-					packet.buttons |= MOUSE_SCROLL_DOWN;
+					packet->buttons |= MOUSE_SCROLL_DOWN;
 				} else if (mouse_byte[3] < 0) {
-					packet.buttons |= MOUSE_SCROLL_UP;
+					packet->buttons |= MOUSE_SCROLL_UP;
 				}
 			}
 
-			mouse_device_packet_t bitbucket;
-			while (pipe_size(mouse_pipe) > (int)(DISCARD_POINT * sizeof(packet))) {
-				read_fs(mouse_pipe, 0, sizeof(packet), (uint8_t *)&bitbucket);
+			if (++batched == PACKETS_PER_IRQ) {
+				/* Flush rather than stop draining: an edge-triggered
+				 * IRQ will not re-fire for bytes we leave behind. */
+				mouse_flush(batch, batched);
+				batched = 0;
 			}
-			write_fs(mouse_pipe, 0, sizeof(packet), (uint8_t *)&packet);
 		}
 read_next:
 		status = inportb(MOUSE_STATUS);
 	}
 	irq_ack(MOUSE_IRQ);
+
+	if (batched) {
+		mouse_flush(batch, batched);
+	}
 	return 1;
 }
 
@@ -5,6 +5,10 @@
  *
  * Provides access to the kernel RNG
  *
+ * Interrupt timing jitter (cycle counter sampled on every IRQ via
+ * irq_entropy_hook) feeds a small mixing pool; a ChaCha20 core keyed
+ * from the pool generates output a page at a time, so reads are
+ * memcpy-speed rather than a generator call per byte.
  */
 
 #include <system.h>
@@ -13,22 +17,123 @@
 
 #include <module.h>
 
-static uint32_t read_random(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
-static uint32_t write_random(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
-static void open_random(fs_node_t *node, unsigned int flags);
-static void close_random(fs_node_t *node);
+#define POOL_WORDS    8
+#define OUT_BUF_SIZE  4096
+#define RESEED_BYTES  (1024 * 1024) /* Fold the pool back in every 1MB */
+
+static volatile uint32_t pool[POOL_WORDS];
+static volatile uint32_t pool_index = 0;
+
+static uint32_t chacha_state[16];
+static uint8_t  out_buf[OUT_BUF_SIZE];
+static uint32_t out_avail = 0;
+static uint32_t since_reseed = 0;
+
+static spin_lock_t random_lock = { 0 };
+
+static uint64_t rdtsc(void) {
+	uint64_t x;
+	asm volatile (".byte 0x0f, 0x31" : "=A" (x));
+	return x;
+}
+
+#define ROTL(v,n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+/*
+ * Called from the interrupt dispatcher for every IRQ. The low cycle
+ * counter bits carry the jitter; the IRQ number and tick clock keep
+ * identical deltas from folding to zero.
+ */
+static void entropy_feed(unsigned int irq) {
+	uint32_t sample = (uint32_t)rdtsc() ^ (irq << 16) ^ timer_subticks;
+	uint32_t i = pool_index++ & (POOL_WORDS - 1);
+	pool[i] = ROTL(pool[i], 7) ^ sample;
+}
+
+#define QR(a,b,c,d) \
+	a += b; d ^= a; d = ROTL(d,16); \
+	c += d; b ^= c; b = ROTL(b,12); \
+	a += b; d ^= a; d = ROTL(d, 8); \
+	c += d; b ^= c; b = ROTL(b, 7)
+
+static void chacha_block(uint32_t out[16]) {
+	uint32_t x[16];
+	memcpy(x, chacha_state, sizeof(x));
+	for (int i = 0; i < 10; ++i) {
+		QR(x[0], x[4], x[ 8], x[12]);
+		QR(x[1], x[5], x[ 9], x[13]);
+		QR(x[2], x[6], x[10], x[14]);
+		QR(x[3], x[7], x[11], x[15]);
+		QR(x[0], x[5], x[10], x[15]);
+		QR(x[1], x[6], x[11], x[12]);
+		QR(x[2], x[7], x[ 8], x[13]);
+		QR(x[3], x[4], x[ 9], x[14]);
+	}
+	for (int i = 0; i < 16; ++i) {
+		out[i] = x[i] + chacha_state[i];
+	}
+	chacha_state[12]++; /* Block counter */
+}
+
+/* Fold the current pool into the key words. */
+static void chacha_reseed(void) {
+	for (int i = 0; i < POOL_WORDS; ++i) {
+		chacha_state[4 + i] ^= pool[i] ^ (uint32_t)rdtsc();
+	}
+	since_reseed = 0;
+}
+
+static void chacha_init(void) {
+	/* "expand 32-byte k" */
+	chacha_state[0] = 0x61707865;
+	chacha_state[1] = 0x3320646e;
+	chacha_state[2] = 0x79622d32;
+	chacha_state[3] = 0x6b206574;
+	for (int i = 4; i < 12; ++i) {
+		chacha_state[i] = krand();
+	}
+	chacha_state[12] = 0;
+	chacha_state[13] = (uint32_t)rdtsc();
+	chacha_state[14] = timer_ticks;
+	chacha_state[15] = timer_subticks;
+	chacha_reseed();
+}
+
+/* Refill the whole output buffer; caller holds random_lock. */
+static void refill_out_buf(void) {
+	if (since_reseed >= RESEED_BYTES) {
+		chacha_reseed();
+	}
+	for (uint32_t off = 0; off < OUT_BUF_SIZE; off += 64) {
+		chacha_block((uint32_t *)(out_buf + off));
+	}
+	out_avail = OUT_BUF_SIZE;
+	since_reseed += OUT_BUF_SIZE;
+}
 
 static uint32_t read_random(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
 	uint32_t s = 0;
+	spin_lock(random_lock);
 	while (s < size) {
-		buffer[s] = krand() % 0xFF;
-		offset++;
-		s++;
+		if (!out_avail) {
+			refill_out_buf();
+		}
+		uint32_t chunk = size - s;
+		if (chunk > out_avail) chunk = out_avail;
+		memcpy(buffer + s, out_buf + (OUT_BUF_SIZE - out_avail), chunk);
+		out_avail -= chunk;
+		s += chunk;
 	}
+	spin_unlock(random_lock);
 	return size;
 }
 
 static uint32_t write_random(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
+	/* Writes stir the pool; no credit is tracked. */
+	for (uint32_t i = 0; i < size; ++i) {
+		uint32_t w = pool_index++ & (POOL_WORDS - 1);
+		pool[w] = ROTL(pool[w], 5) ^ buffer[i] ^ (uint32_t)rdtsc();
+	}
 	return size;
 }
 
@@ -61,12 +166,15 @@ static fs_node_t * random_device_create(void) {
 }
 
 static int random_initialize(void) {
+	chacha_init();
+	irq_entropy_hook = entropy_feed;
 	vfs_mount("/dev/random", random_device_create());
 	vfs_mount("/dev/urandom", random_device_create());
 	return 0;
 }
 
 static int random_finalize(void) {
+	irq_entropy_hook = NULL;
 	return 0;
 }
 
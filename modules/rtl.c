@@ -60,6 +60,16 @@ static int next_tx = 0;
 
 static list_t * rx_wait;
 
+/* NAPI-style receive: the IRQ handler masks receive interrupts and
+ * kicks this tasklet, which drains the RX ring in batches and only
+ * unmasks once the ring is empty. A packet flood then costs one
+ * interrupt per batch instead of one per frame. */
+static list_t * rtl_poll_wait;
+static volatile int rtl_rx_pending = 0;
+
+#define RTL_IMR_ALL   (0x8000 | 0x4000 | 0x40 | 0x20 | 0x10 | 0x08 | 0x04 | 0x02 | 0x01)
+#define RTL_IMR_NO_RX (0x8000 | 0x4000 | 0x08 | 0x04)
+
 static spin_lock_t _lock;
 static int next_tx_buf(void) {
 	int out;
@@ -110,53 +120,77 @@ struct ethernet_packet* rtl_get_packet(void) {
 	return (struct ethernet_packet*)rtl_dequeue();
 }
 
-static int rtl_irq_handler(struct regs *r) {
-	uint16_t status = inports(rtl_iobase + RTL_PORT_ISR);
-	if (!status) {
-		return 0;
-	}
-	outports(rtl_iobase + RTL_PORT_ISR, status);
-
-	irq_ack(rtl_irq);
+/* Pull everything the card has buffered off the RX ring. */
+static void rtl_rx_drain(void) {
+	while((inportb(rtl_iobase + RTL_PORT_CMD) & 0x01) == 0) {
+		int offset = cur_rx % 0x2000;
 
-	if (status & 0x01 || status & 0x02) {
-		/* Receive */
-		while((inportb(rtl_iobase + RTL_PORT_CMD) & 0x01) == 0) {
-			int offset = cur_rx % 0x2000;
+		uint32_t * buf_start = (uint32_t *)((uintptr_t)rtl_rx_buffer + offset);
+		uint32_t rx_status = buf_start[0];
+		int rx_size = rx_status >> 16;
 
-#if 0
-			uint16_t buf_addr = inports(rtl_iobase + RTL_PORT_RXADDR);
-			uint16_t buf_ptr  = inports(rtl_iobase + RTL_PORT_RXPTR);
-			uint8_t  cmd      = inportb(rtl_iobase + RTL_PORT_CMD);
-#endif
+		if (rx_status & (0x0020 | 0x0010 | 0x0004 | 0x0002)) {
+			debug_print(WARNING, "rx error :(");
+		} else {
+			uint8_t * buf_8 = (uint8_t *)&(buf_start[1]);
 
-			uint32_t * buf_start = (uint32_t *)((uintptr_t)rtl_rx_buffer + offset);
-			uint32_t rx_status = buf_start[0];
-			int rx_size = rx_status >> 16;
+			last_packet = malloc(rx_size);
 
-			if (rx_status & (0x0020 | 0x0010 | 0x0004 | 0x0002)) {
-				debug_print(WARNING, "rx error :(");
+			uintptr_t packet_end = (uintptr_t)buf_8 + rx_size;
+			if (packet_end > (uintptr_t)rtl_rx_buffer + 0x2000) {
+				size_t s = ((uintptr_t)rtl_rx_buffer + 0x2000) - (uintptr_t)buf_8;
+				memcpy(last_packet, buf_8, s);
+				memcpy((void *)((uintptr_t)last_packet + s), rtl_rx_buffer, rx_size - s);
 			} else {
-				uint8_t * buf_8 = (uint8_t *)&(buf_start[1]);
+				memcpy(last_packet, buf_8, rx_size);
+			}
 
-				last_packet = malloc(rx_size);
+			rtl_enqueue(last_packet);
+		}
 
-				uintptr_t packet_end = (uintptr_t)buf_8 + rx_size;
-				if (packet_end > (uintptr_t)rtl_rx_buffer + 0x2000) {
-					size_t s = ((uintptr_t)rtl_rx_buffer + 0x2000) - (uintptr_t)buf_8;
-					memcpy(last_packet, buf_8, s);
-					memcpy((void *)((uintptr_t)last_packet + s), rtl_rx_buffer, rx_size - s);
-				} else {
-					memcpy(last_packet, buf_8, rx_size);
-				}
+		cur_rx = (cur_rx + rx_size + 4 + 3) & ~3;
+		outports(rtl_iobase + RTL_PORT_RXPTR, cur_rx - 16);
+	}
+	wakeup_queue(rx_wait);
+}
 
-				rtl_enqueue(last_packet);
-			}
+static void rtl_poll_task(void * data, char * name) {
+	while (1) {
+		IRQ_OFF;
+		if (!rtl_rx_pending) {
+			sleep_on(rtl_poll_wait);
+		} else {
+			IRQ_RES;
+		}
+		rtl_rx_pending = 0;
 
-			cur_rx = (cur_rx + rx_size + 4 + 3) & ~3;
-			outports(rtl_iobase + RTL_PORT_RXPTR, cur_rx - 16);
+		rtl_rx_drain();
+
+		/* Ring is empty; let the card interrupt us again. Anything
+		 * that arrived in the window before the unmask re-asserts
+		 * the (still pending) ISR bit, so nothing is lost. */
+		outports(rtl_iobase + RTL_PORT_IMR, RTL_IMR_ALL);
+		if ((inportb(rtl_iobase + RTL_PORT_CMD) & 0x01) == 0) {
+			rtl_rx_pending = 1;
 		}
-		wakeup_queue(rx_wait);
+	}
+}
+
+static int rtl_irq_handler(struct regs *r) {
+	uint16_t status = inports(rtl_iobase + RTL_PORT_ISR);
+	if (!status) {
+		return 0;
+	}
+	outports(rtl_iobase + RTL_PORT_ISR, status);
+
+	irq_ack(rtl_irq);
+
+	if (status & 0x01 || status & 0x02) {
+		/* Receive: mask receive interrupts and let the poll tasklet
+		 * drain the ring outside of interrupt context */
+		outports(rtl_iobase + RTL_PORT_IMR, RTL_IMR_NO_RX);
+		rtl_rx_pending = 1;
+		wakeup_queue(rtl_poll_wait);
 	}
 
 	if (status & 0x08 || status & 0x04) {
@@ -322,6 +356,8 @@ int init_rtl(void) {
 		debug_print(NOTICE, "RTL iobase: 0x%x\n", rtl_iobase);
 
 		rx_wait = list_create();
+		rtl_poll_wait = list_create();
+		create_kernel_tasklet(rtl_poll_task, "[rtlpoll]", NULL);
 
 		debug_print(NOTICE, "Determining mac address...\n");
 		for (int i = 0; i < 6; ++i) {
@@ -360,17 +396,7 @@ int init_rtl(void) {
 		outportl(rtl_iobase + RTL_PORT_RBSTART, rtl_rx_phys);
 
 		debug_print(NOTICE, "Enabling IRQs.\n");
-		outports(rtl_iobase + RTL_PORT_IMR,
-			0x8000 | /* PCI error */
-			0x4000 | /* PCS timeout */
-			0x40   | /* Rx FIFO over */
-			0x20   | /* Rx underrun */
-			0x10   | /* Rx overflow */
-			0x08   | /* Tx error */
-			0x04   | /* Tx okay */
-			0x02   | /* Rx error */
-			0x01     /* Rx okay */
-		); /* TOK, ROK */
+		outports(rtl_iobase + RTL_PORT_IMR, RTL_IMR_ALL); /* TOK, ROK */
 
 		debug_print(NOTICE, "Configuring transmit\n");
 		outportl(rtl_iobase + RTL_PORT_TCR,
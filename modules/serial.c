@@ -22,13 +22,28 @@
 #define SERIAL_IRQ_AC 4
 #define SERIAL_IRQ_BD 3
 
-static char serial_recv(int device);
+/* Transmit ring per port; power of two so the index is a mask.
+ * Writers enqueue and enable the THR-empty interrupt, and the
+ * interrupt handler feeds the 16550 FIFO a burst at a time. */
+#define SERIAL_TX_RING  1024
+#define SERIAL_TX_BURST 16
+
+typedef struct {
+	uint8_t buf[SERIAL_TX_RING];
+	volatile uint32_t head;  /* monotonic; next slot to fill */
+	volatile uint32_t tail;  /* monotonic; next byte to transmit */
+} serial_tx_t;
 
 static fs_node_t * _serial_port_a = NULL;
 static fs_node_t * _serial_port_b = NULL;
 static fs_node_t * _serial_port_c = NULL;
 static fs_node_t * _serial_port_d = NULL;
 
+static serial_tx_t _serial_tx_a;
+static serial_tx_t _serial_tx_b;
+static serial_tx_t _serial_tx_c;
+static serial_tx_t _serial_tx_d;
+
 static uint8_t convert(uint8_t in) {
 	switch (in) {
 		case 0x7F:
@@ -50,34 +65,64 @@ static fs_node_t ** pipe_for_port(int port) {
 	__builtin_unreachable();
 }
 
-static int serial_handler_ac(struct regs *r) {
-	char serial;
-	int  port = 0;
-	if (inportb(SERIAL_PORT_A+1) & 0x01) {
-		port = SERIAL_PORT_A;
-	} else {
-		port = SERIAL_PORT_C;
+static serial_tx_t * tx_for_port(int port) {
+	switch (port) {
+		case SERIAL_PORT_A: return &_serial_tx_a;
+		case SERIAL_PORT_B: return &_serial_tx_b;
+		case SERIAL_PORT_C: return &_serial_tx_c;
+		case SERIAL_PORT_D: return &_serial_tx_d;
+	}
+	__builtin_unreachable();
+}
+
+/*
+ * Hand the transmit FIFO its next burst from the ring, or drop back
+ * to receive-only interrupts once the ring is drained.
+ */
+static void serial_tx_fill(int port) {
+	serial_tx_t * tx = tx_for_port(port);
+	if (tx->tail == tx->head) {
+		outportb(port + 1, 0x01); /* Nothing queued; receive interrupts only */
+		return;
+	}
+	for (int i = 0; i < SERIAL_TX_BURST && tx->tail != tx->head; ++i) {
+		outportb(port, tx->buf[tx->tail & (SERIAL_TX_RING - 1)]);
+		tx->tail++;
+	}
+}
+
+static void serial_handle_port(int port) {
+	if (inportb(port + 2) & 0x01) {
+		return; /* No interrupt pending on this port */
+	}
+
+	/* Drain everything received into the pipe in one write. */
+	uint8_t buf[SERIAL_TX_BURST];
+	int count = 0;
+	while ((inportb(port + 5) & 0x01) && count < SERIAL_TX_BURST) {
+		buf[count++] = convert(inportb(port));
+	}
+	if (count) {
+		write_fs(*pipe_for_port(port), 0, count, buf);
+	}
+
+	/* Transmit holding register empty? Feed it the next burst. */
+	if (inportb(port + 5) & 0x20) {
+		serial_tx_fill(port);
 	}
-	serial = serial_recv(port);
+}
+
+static int serial_handler_ac(struct regs *r) {
+	serial_handle_port(SERIAL_PORT_A);
+	serial_handle_port(SERIAL_PORT_C);
 	irq_ack(SERIAL_IRQ_AC);
-	uint8_t buf[] = {convert(serial), 0};
-	write_fs(*pipe_for_port(port), 0, 1, buf);
 	return 1;
 }
 
 static int serial_handler_bd(struct regs *r) {
-	char serial;
-	int  port = 0;
-	debug_print(NOTICE, "Received something on secondary port");
-	if (inportb(SERIAL_PORT_B+1) & 0x01) {
-		port = SERIAL_PORT_B;
-	} else {
-		port = SERIAL_PORT_D;
-	}
-	serial = serial_recv(port);
+	serial_handle_port(SERIAL_PORT_B);
+	serial_handle_port(SERIAL_PORT_D);
 	irq_ack(SERIAL_IRQ_BD);
-	uint8_t buf[] = {convert(serial), 0};
-	write_fs(*pipe_for_port(port), 0, 1, buf);
 	return 1;
 }
 
@@ -92,30 +137,10 @@ static void serial_enable(int port) {
 	outportb(port + 1, 0x01); /* Enable interrupts */
 }
 
-static int serial_rcvd(int device) {
-	return inportb(device + 5) & 1;
-}
-
-static char serial_recv(int device) {
-	while (serial_rcvd(device) == 0) ;
-	return inportb(device);
-}
-
 static int serial_transmit_empty(int device) {
 	return inportb(device + 5) & 0x20;
 }
 
-static void serial_send(int device, char out) {
-	while (serial_transmit_empty(device) == 0);
-	outportb(device, out);
-}
-
-static void serial_string(char * out) {
-	for (uint32_t i = 0; i < strlen(out); ++i) {
-		serial_send(SERIAL_PORT_A, out[i]);
-	}
-}
-
 static uint32_t read_serial(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
 static uint32_t write_serial(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer);
 static void open_serial(fs_node_t *node, unsigned int flags);
@@ -126,11 +151,31 @@ static uint32_t read_serial(fs_node_t *node, uint32_t offset, uint32_t size, uin
 }
 
 static uint32_t write_serial(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
-	uint32_t sent = 0;
-	while (sent < size) {
-		serial_send((int)node->device, buffer[sent]);
-		sent++;
+	int port = (int)node->device;
+	serial_tx_t * tx = tx_for_port(port);
+
+	/* Enqueue with interrupts off so concurrent writers cannot
+	 * interleave within a message; the old polled path held the
+	 * writer for the full transmission instead. */
+	IRQ_OFF;
+	for (uint32_t sent = 0; sent < size; sent++) {
+		while (tx->head - tx->tail == SERIAL_TX_RING) {
+			/* Ring full, and the handler cannot run while we hold
+			 * interrupts off: push a byte out the old way. */
+			while (!serial_transmit_empty(port));
+			outportb(port, tx->buf[tx->tail & (SERIAL_TX_RING - 1)]);
+			tx->tail++;
+		}
+		tx->buf[tx->head & (SERIAL_TX_RING - 1)] = buffer[sent];
+		tx->head++;
 	}
+
+	/* Enable the THR-empty interrupt; if the transmitter is already
+	 * idle the 16550 raises it at once and the handler starts the
+	 * first burst. */
+	outportb(port + 1, 0x03);
+	IRQ_RES;
+
 	return size;
 }
 
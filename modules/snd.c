@@ -5,10 +5,15 @@
  *
  * Sound subsystem.
  *
- * Currently has the ability to mix several sound sources together. Could use
- * a /dev/mixer device to allow changing of audio settings. Also could use
- * the ability to change frequency and format for audio samples. Also doesn't
- * really support multiple devices despite the interface suggesting it might...
+ * Mixes several sound sources into the playback device's buffer. Each
+ * open of /dev/dsp gets a single-producer single-consumer sample ring:
+ * the writing process is the only producer and the device interrupt is
+ * the only consumer, so the hot path needs no locks - the producer
+ * publishes by advancing `head`, the mixer consumes by advancing
+ * `tail`, and each side only ever stores to its own index. Streams may
+ * carry any sample rate (SND_DSP_SET_RATE); the mixer resamples with
+ * fixed-point linear interpolation as it drains, accumulates in 32
+ * bits, and saturates once per sample on the way out.
  */
 
 #include <mod/snd.h>
@@ -16,13 +21,34 @@
 #include <errno_defs.h>
 #include <list.h>
 #include <module.h>
-#include <ringbuffer.h>
+#include <process.h>
 #include <system.h>
 
 /* Utility macros */
 #define N_ELEMENTS(arr) (sizeof(arr) / sizeof((arr)[0]))
 
-#define SND_BUF_SIZE 0x1000
+#define SND_STREAM_SAMPLES 4096  /* Per-client ring, in int16 samples; power of two */
+#define SND_MAX_STREAMS    16
+#define SND_DEFAULT_RATE   48000
+
+#define SND_RATE_MIN 8000
+#define SND_RATE_MAX 96000
+
+/* Mixing happens in chunks of this many samples so the 32-bit
+ * accumulator can live on the stack. */
+#define SND_MIX_CHUNK 512
+
+typedef struct snd_stream {
+	int16_t samples[SND_STREAM_SAMPLES];
+	volatile uint32_t head;    /* Owned by the writing process */
+	volatile uint32_t tail;    /* Owned by the device interrupt */
+	uint32_t rate;             /* Source sample rate in Hz */
+	uint32_t pos_frac;         /* 16.16 position between prev and cur frames */
+	int16_t prev_l, prev_r;    /* Interpolation endpoints */
+	int16_t cur_l, cur_r;
+	volatile int closed;       /* Producer gone; slot reclaimed on next open */
+	list_t * wait;             /* Writers blocked on a full ring */
+} snd_stream_t;
 
 static uint32_t snd_dsp_write(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t *buffer);
 static int snd_dsp_ioctl(fs_node_t * node, int request, void * argp);
@@ -54,8 +80,14 @@ static fs_node_t _mixer_fnode = {
 	.open  = snd_mixer_open,
 	.close = snd_mixer_close,
 };
-static spin_lock_t _buffers_lock;
-static list_t _buffers;
+
+/* Slots are claimed with a compare-and-swap and the mixer walks the
+ * array with no lock: a slot is either NULL, a live stream, or a
+ * closed stream awaiting reclamation (done in open, never at IRQ
+ * time, so the mixer can't be yanked out from under itself). */
+static snd_stream_t * volatile _streams[SND_MAX_STREAMS];
+static spin_lock_t _streams_lock;  /* Serializes open/close bookkeeping only */
+
 static uint32_t _next_device_id = SND_DEVICE_MAIN;
 
 int snd_register(snd_device_t * device) {
@@ -96,12 +128,48 @@ snd_unregister_cleanup:
 }
 
 static uint32_t snd_dsp_write(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t *buffer) {
-	return ring_buffer_write(node->device, size, buffer);
+	snd_stream_t * s = node->device;
+	if (!s) return 0;
+
+	/* Whole stereo frames only */
+	size &= ~0x3;
+	uint32_t total = size / sizeof(int16_t);
+	uint32_t written = 0;
+	int16_t * in = (int16_t *)buffer;
+
+	while (written < total) {
+		uint32_t space = SND_STREAM_SAMPLES - (s->head - s->tail);
+		if (!space) {
+			if (sleep_on(s->wait)) break; /* Interrupted by a signal */
+			continue;
+		}
+		uint32_t n = MIN(space, total - written);
+		for (uint32_t i = 0; i < n; ++i) {
+			s->samples[(s->head + i) & (SND_STREAM_SAMPLES - 1)] = in[written + i];
+		}
+		/* Data before index: make the samples visible first */
+		__sync_synchronize();
+		s->head += n;
+		written += n;
+	}
+
+	return written * sizeof(int16_t);
 }
 
 static int snd_dsp_ioctl(fs_node_t * node, int request, void * argp) {
-	/* Potentially use this to set sample rates in the future */
-	return -1;
+	snd_stream_t * s = node->device;
+	switch (request) {
+		case SND_DSP_SET_RATE: {
+			uint32_t rate = *(uint32_t *)argp;
+			if (rate < SND_RATE_MIN || rate > SND_RATE_MAX) {
+				return -EINVAL;
+			}
+			s->rate = rate;
+			return 0;
+		}
+		default:
+			return -EINVAL;
+	}
 }
 
 static void snd_dsp_open(fs_node_t * node, unsigned int flags) {
@@ -109,17 +177,42 @@ static void snd_dsp_open(fs_node_t * node, unsigned int flags) {
 	 * XXX(gerow): A process could take the memory of the entire system by opening
 	 * too many of these...
 	 */
-	/* Allocate a buffer for the node and keep a reference for ourselves */
-	node->device = ring_buffer_create(SND_BUF_SIZE);
-	spin_lock(_buffers_lock);
-	list_insert(&_buffers, node->device);
-	spin_unlock(_buffers_lock);
+	snd_stream_t * s = malloc(sizeof(snd_stream_t));
+	memset(s, 0, sizeof(snd_stream_t));
+	s->rate = SND_DEFAULT_RATE;
+	s->wait = list_create();
+
+	spin_lock(_streams_lock);
+	for (int i = 0; i < SND_MAX_STREAMS; ++i) {
+		snd_stream_t * old = _streams[i];
+		if (old && old->closed) {
+			/* Reclaim in process context; the mixer skips closed
+			 * streams, so once the slot is republished the old one
+			 * can't be reached again. */
+			_streams[i] = NULL;
+			free(old->wait);
+			free(old);
+		}
+		if (!_streams[i]) {
+			_streams[i] = s;
+			spin_unlock(_streams_lock);
+			node->device = s;
+			return;
+		}
+	}
+	spin_unlock(_streams_lock);
+
+	debug_print(WARNING, "[snd] out of stream slots");
+	free(s->wait);
+	free(s);
+	node->device = NULL;
 }
 
 static void snd_dsp_close(fs_node_t * node) {
-	spin_lock(_buffers_lock);
-	list_delete(&_buffers, list_find(&_buffers, node->device));
-	spin_unlock(_buffers_lock);
+	snd_stream_t * s = node->device;
+	if (!s) return;
+	/* The slot is reclaimed by a later open */
+	s->closed = 1;
 }
 
 static snd_device_t * snd_device_by_id(uint32_t device_id) {
@@ -196,81 +289,90 @@ static void snd_mixer_close(fs_node_t * node) {
 	return;
 }
 
-int snd_request_buf(snd_device_t * device, uint32_t size, uint8_t *buffer) {
-	static int16_t tmp_buf[0x100];
-
-	memset(buffer, 0, size);
-
-	spin_lock(_buffers_lock);
-	foreach(buf_node, &_buffers) {
-		ring_buffer_t * buf = buf_node->value;
-		/* ~0x3 is to ensure we don't read partial samples or just a single channel */
-		size_t bytes_left = MIN(ring_buffer_unread(buf) & ~0x3, size);
-		int16_t * adding_ptr = (int16_t *) buffer;
-		while (bytes_left) {
-			size_t this_read_size = MIN(bytes_left, sizeof(tmp_buf));
-			ring_buffer_read(buf, this_read_size, (uint8_t *)tmp_buf);
-			/*
-			 * Reduce the sample by a half so that multiple sources won't immediately
-			 * cause awful clipping. This is kind of a hack since it would probably be
-			 * better to just use some kind of compressor.
-			 */
-			for (size_t i = 0; i < N_ELEMENTS(tmp_buf); i++) {
-				tmp_buf[i] /= 2;
-			}
-			for (size_t i = 0; i < this_read_size / sizeof(*adding_ptr); i++) {
-				adding_ptr[i] += tmp_buf[i];
-			}
-			adding_ptr += this_read_size / sizeof(*adding_ptr);
-			bytes_left -= this_read_size;
-		}
+/* Pull the next source frame out of the ring, or silence if it ran
+ * dry. Only the mixer calls this, so plain stores to tail suffice. */
+static inline void stream_advance(snd_stream_t * s, uint32_t head) {
+	s->prev_l = s->cur_l;
+	s->prev_r = s->cur_r;
+	if (head - s->tail >= 2) {
+		s->cur_l = s->samples[s->tail & (SND_STREAM_SAMPLES - 1)];
+		s->cur_r = s->samples[(s->tail + 1) & (SND_STREAM_SAMPLES - 1)];
+		s->tail += 2;
+	} else {
+		s->cur_l = 0;
+		s->cur_r = 0;
 	}
-	spin_unlock(_buffers_lock);
-
-	return size;
 }
 
-static snd_device_t * snd_main_device() {
-	spin_lock(_devices_lock);
-	foreach(node, &_devices) {
-		spin_unlock(_devices_lock);
-		return node->value;
+/*
+ * Mix one stream into the 32-bit accumulator, resampling from the
+ * stream's rate to the device's with 16.16 fixed-point linear
+ * interpolation. Returns nonzero if any samples were consumed so the
+ * caller knows to wake blocked writers.
+ */
+static int stream_mix(snd_stream_t * s, int32_t * accum, size_t out_frames, uint32_t out_rate) {
+	uint32_t step = (uint32_t)(((uint64_t)s->rate << 16) / out_rate);
+	uint32_t head = s->head;
+	uint32_t tail_before = s->tail;
+
+	for (size_t f = 0; f < out_frames; ++f) {
+		s->pos_frac += step;
+		while (s->pos_frac >= 0x10000) {
+			s->pos_frac -= 0x10000;
+			stream_advance(s, head);
+		}
+		uint32_t fr = s->pos_frac;
+		uint32_t inv = 0x10000 - fr;
+		/* Halve each source as before, so a few streams don't clip instantly */
+		accum[f * 2]     += (s->prev_l * (int32_t)inv + s->cur_l * (int32_t)fr) >> 17;
+		accum[f * 2 + 1] += (s->prev_r * (int32_t)inv + s->cur_r * (int32_t)fr) >> 17;
 	}
 
-	spin_unlock(_devices_lock);
-	return NULL;
+	return s->tail != tail_before;
 }
 
-#if 0
-#include <mod/shell.h>
-DEFINE_SHELL_FUNCTION(snd_full, "[debug] turn snd master to full") {
-	snd_main_device()->mixer_write(SND_KNOB_MASTER, UINT32_MAX);
-
-	return 0;
-}
-
-DEFINE_SHELL_FUNCTION(snd_half, "[debug] turn snd master to half") {
-	snd_main_device()->mixer_write(SND_KNOB_MASTER, UINT32_MAX / 2);
+int snd_request_buf(snd_device_t * device, uint32_t size, uint8_t *buffer) {
+	int32_t accum[SND_MIX_CHUNK];
+	int16_t * out = (int16_t *)buffer;
+	uint32_t out_rate = device->playback_speed ? device->playback_speed : SND_DEFAULT_RATE;
+	size_t samples_left = (size & ~0x3) / sizeof(int16_t);
+
+	while (samples_left) {
+		size_t chunk = MIN(samples_left, (size_t)SND_MIX_CHUNK);
+		memset(accum, 0, chunk * sizeof(int32_t));
+
+		for (int i = 0; i < SND_MAX_STREAMS; ++i) {
+			snd_stream_t * s = _streams[i];
+			if (!s || s->closed) continue;
+			if (stream_mix(s, accum, chunk / 2, out_rate)) {
+				wakeup_queue_irq(s->wait);
+			}
+		}
 
-	return 0;
-}
+		/* Saturate down to 16 bits, four samples per turn */
+		size_t j = 0;
+		for (; j + 4 <= chunk; j += 4) {
+			int32_t a = accum[j], b = accum[j+1], c = accum[j+2], d = accum[j+3];
+			out[j]   = a > 32767 ? 32767 : (a < -32768 ? -32768 : a);
+			out[j+1] = b > 32767 ? 32767 : (b < -32768 ? -32768 : b);
+			out[j+2] = c > 32767 ? 32767 : (c < -32768 ? -32768 : c);
+			out[j+3] = d > 32767 ? 32767 : (d < -32768 ? -32768 : d);
+		}
+		for (; j < chunk; ++j) {
+			int32_t a = accum[j];
+			out[j] = a > 32767 ? 32767 : (a < -32768 ? -32768 : a);
+		}
 
-DEFINE_SHELL_FUNCTION(snd_off, "[debug] turn snd master to lowest volume") {
-	snd_main_device()->mixer_write(SND_KNOB_MASTER, 0);
+		out += chunk;
+		samples_left -= chunk;
+	}
 
-	return 0;
+	return size;
 }
-#endif
 
 static int init(void) {
 	vfs_mount("/dev/dsp", &_dsp_fnode);
 	vfs_mount("/dev/mixer", &_mixer_fnode);
-
-#if 0
-	BIND_SHELL_FUNCTION(snd_full);
-	BIND_SHELL_FUNCTION(snd_half);
-	BIND_SHELL_FUNCTION(snd_off);
-#endif
 	return 0;
 }
 
@@ -280,6 +382,3 @@ static int fini(void) {
 }
 
 MODULE_DEF(snd, init, fini);
-#if 0
-MODULE_DEPENDS(debugshell);
-#endif
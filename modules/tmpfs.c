@@ -12,14 +12,25 @@
 #include <module.h>
 #include <mod/tmpfs.h>
 
-/* 1KB */
-#define BLOCKSIZE 1024
+/* One page; blocks come straight from the frame allocator */
+#define BLOCKSIZE 0x1000
 
 #define TMPFS_TYPE_FILE 1
 #define TMPFS_TYPE_DIR  2
 #define TMPFS_TYPE_LINK 3
 
 static spin_lock_t tmpfs_lock = { 0 };
+static spin_lock_t tmpfs_page_lock = { 0 };
+
+/*
+ * File blocks are physical frames, not heap allocations, so build
+ * scratch directories full of temporary files without fragmenting the
+ * kernel heap. Frames are accessed by repointing this scratch page
+ * mapping; it lives in the boot-mapped heap region so the table is
+ * shared with every process directory.
+ */
+static char * tmpfs_scratch = NULL;
+static page_t * tmpfs_scratch_page = NULL;
 
 struct tmpfs_dir * tmpfs_root = NULL;
 
@@ -41,9 +52,9 @@ static struct tmpfs_file * tmpfs_file_new(char * name) {
 	t->atime = now();
 	t->mtime = t->atime;
 	t->ctime = t->atime;
-	t->blocks = malloc(t->pointers * sizeof(char *));
+	t->blocks = malloc(t->pointers * sizeof(uintptr_t));
 	for (size_t i = 0; i < t->pointers; ++i) {
-		t->blocks[i] = NULL;
+		t->blocks[i] = 0;
 	}
 
 	spin_unlock(tmpfs_lock);
@@ -119,37 +130,68 @@ static void tmpfs_file_free(struct tmpfs_file * t) {
 		free(t->target);
 	}
 	for (size_t i = 0; i < t->block_count; ++i) {
-		free(t->blocks[i]);
+		if (t->blocks[i]) {
+			free_frames(t->blocks[i], 0);
+		}
 	}
+	free(t->blocks);
+	free(t->name);
 }
 
 static void tmpfs_file_blocks_embiggen(struct tmpfs_file * t) {
+	size_t old = t->pointers;
 	t->pointers *= 2;
 	debug_print(INFO, "Embiggening file %s to %d blocks", t->name, t->pointers);
-	t->blocks = realloc(t->blocks, sizeof(char *) * t->pointers);
+	t->blocks = realloc(t->blocks, sizeof(uintptr_t) * t->pointers);
+	for (size_t i = old; i < t->pointers; ++i) {
+		t->blocks[i] = 0;
+	}
 }
 
+/*
+ * Map the frame backing `blockid` at the scratch address and return it.
+ * Returns NULL for holes (reads of blocks nothing ever wrote). Frames
+ * are allocated on first write and zeroed then, not before.
+ *
+ * The caller must hold tmpfs_page_lock across the call and whatever it
+ * does with the returned pointer - there is only one scratch mapping.
+ */
 static char * tmpfs_file_getset_block(struct tmpfs_file * t, size_t blockid, int create) {
 	debug_print(INFO, "Reading block %d from file %s", blockid, t->name);
+	int fresh = 0;
 	if (create) {
 		spin_lock(tmpfs_lock);
 		while (blockid >= t->pointers) {
 			tmpfs_file_blocks_embiggen(t);
 		}
 		while (blockid >= t->block_count) {
-			debug_print(INFO, "Allocating block %d for file %s", blockid, t->name);
-			t->blocks[t->block_count] = malloc(BLOCKSIZE);
+			t->blocks[t->block_count] = 0; /* hole until written */
 			t->block_count += 1;
 		}
+		if (!t->blocks[blockid]) {
+			debug_print(INFO, "Allocating block %d for file %s", blockid, t->name);
+			uint32_t frame = alloc_frames(0);
+			if (frame == 0xFFFFFFFF) {
+				spin_unlock(tmpfs_lock);
+				debug_print(CRITICAL, "Out of memory allocating tmpfs block.");
+				return NULL;
+			}
+			t->blocks[blockid] = frame;
+			fresh = 1;
+		}
 		spin_unlock(tmpfs_lock);
 	} else {
-		if (blockid >= t->block_count) {
-			debug_print(CRITICAL, "This will probably end badly.");
+		if (blockid >= t->block_count || !t->blocks[blockid]) {
 			return NULL;
 		}
 	}
 	debug_print(INFO, "Using block %d->0x%x (of %d) on file %s", blockid, t->blocks[blockid], t->block_count, t->name);
-	return t->blocks[blockid];
+	tmpfs_scratch_page->frame = t->blocks[blockid];
+	invalidate_tables_at((uintptr_t)tmpfs_scratch);
+	if (fresh) {
+		memset(tmpfs_scratch, 0x00, BLOCKSIZE);
+	}
+	return tmpfs_scratch;
 }
 
 
@@ -170,9 +212,15 @@ static uint32_t read_tmpfs(fs_node_t *node, uint32_t offset, uint32_t size, uint
 	uint32_t end_size     = end - end_block * BLOCKSIZE;
 	uint32_t size_to_read = end - offset;
 	if (start_block == end_block && offset == end) return 0;
+	spin_lock(tmpfs_page_lock);
 	if (start_block == end_block) {
 		void *buf = tmpfs_file_getset_block(t, start_block, 0);
-		memcpy(buffer, (uint8_t *)(((uint32_t)buf) + (offset % BLOCKSIZE)), size_to_read);
+		if (buf) {
+			memcpy(buffer, (uint8_t *)(((uint32_t)buf) + (offset % BLOCKSIZE)), size_to_read);
+		} else {
+			memset(buffer, 0x00, size_to_read);
+		}
+		spin_unlock(tmpfs_page_lock);
 		return size_to_read;
 	} else {
 		uint32_t block_offset;
@@ -180,17 +228,30 @@ static uint32_t read_tmpfs(fs_node_t *node, uint32_t offset, uint32_t size, uint
 		for (block_offset = start_block; block_offset < end_block; block_offset++, blocks_read++) {
 			if (block_offset == start_block) {
 				void *buf = tmpfs_file_getset_block(t, block_offset, 0);
-				memcpy(buffer, (uint8_t *)(((uint32_t)buf) + (offset % BLOCKSIZE)), BLOCKSIZE - (offset % BLOCKSIZE));
+				if (buf) {
+					memcpy(buffer, (uint8_t *)(((uint32_t)buf) + (offset % BLOCKSIZE)), BLOCKSIZE - (offset % BLOCKSIZE));
+				} else {
+					memset(buffer, 0x00, BLOCKSIZE - (offset % BLOCKSIZE));
+				}
 			} else {
 				void *buf = tmpfs_file_getset_block(t, block_offset, 0);
-				memcpy(buffer + BLOCKSIZE * blocks_read - (offset % BLOCKSIZE), buf, BLOCKSIZE);
+				if (buf) {
+					memcpy(buffer + BLOCKSIZE * blocks_read - (offset % BLOCKSIZE), buf, BLOCKSIZE);
+				} else {
+					memset(buffer + BLOCKSIZE * blocks_read - (offset % BLOCKSIZE), 0x00, BLOCKSIZE);
+				}
 			}
 		}
 		if (end_size) {
 			void *buf = tmpfs_file_getset_block(t, end_block, 0);
-			memcpy(buffer + BLOCKSIZE * blocks_read - (offset % BLOCKSIZE), buf, end_size);
+			if (buf) {
+				memcpy(buffer + BLOCKSIZE * blocks_read - (offset % BLOCKSIZE), buf, end_size);
+			} else {
+				memset(buffer + BLOCKSIZE * blocks_read - (offset % BLOCKSIZE), 0x00, end_size);
+			}
 		}
 	}
+	spin_unlock(tmpfs_page_lock);
 	return size_to_read;
 }
 
@@ -209,9 +270,12 @@ static uint32_t write_tmpfs(fs_node_t *node, uint32_t offset, uint32_t size, uin
 	uint32_t end_block    = end / BLOCKSIZE;
 	uint32_t end_size     = end - end_block * BLOCKSIZE;
 	uint32_t size_to_read = end - offset;
+	spin_lock(tmpfs_page_lock);
 	if (start_block == end_block) {
 		void *buf = tmpfs_file_getset_block(t, start_block, 1);
+		if (!buf) goto bail;
 		memcpy((uint8_t *)(((uint32_t)buf) + (offset % BLOCKSIZE)), buffer, size_to_read);
+		spin_unlock(tmpfs_page_lock);
 		return size_to_read;
 	} else {
 		uint32_t block_offset;
@@ -219,18 +283,26 @@ static uint32_t write_tmpfs(fs_node_t *node, uint32_t offset, uint32_t size, uin
 		for (block_offset = start_block; block_offset < end_block; block_offset++, blocks_read++) {
 			if (block_offset == start_block) {
 				void *buf = tmpfs_file_getset_block(t, block_offset, 1);
+				if (!buf) goto bail;
 				memcpy((uint8_t *)(((uint32_t)buf) + (offset % BLOCKSIZE)), buffer, BLOCKSIZE - (offset % BLOCKSIZE));
 			} else {
 				void *buf = tmpfs_file_getset_block(t, block_offset, 1);
+				if (!buf) goto bail;
 				memcpy(buf, buffer + BLOCKSIZE * blocks_read - (offset % BLOCKSIZE), BLOCKSIZE);
 			}
 		}
 		if (end_size) {
 			void *buf = tmpfs_file_getset_block(t, end_block, 1);
+			if (!buf) goto bail;
 			memcpy(buf, buffer + BLOCKSIZE * blocks_read - (offset % BLOCKSIZE), end_size);
 		}
 	}
+	spin_unlock(tmpfs_page_lock);
 	return size_to_read;
+
+bail:
+	spin_unlock(tmpfs_page_lock);
+	return 0;
 }
 
 static int chmod_tmpfs(fs_node_t * node, int mode) {
@@ -249,12 +321,16 @@ static void open_tmpfs(fs_node_t * node, unsigned int flags) {
 
 	if (flags & O_TRUNC) {
 		debug_print(WARNING, "Truncating file %s", t->name);
+		spin_lock(tmpfs_lock);
 		for (size_t i = 0; i < t->block_count; ++i) {
-			free(t->blocks[i]);
-			t->blocks[i] = 0;
+			if (t->blocks[i]) {
+				free_frames(t->blocks[i], 0);
+				t->blocks[i] = 0;
+			}
 		}
 		t->block_count = 0;
 		t->length = 0;
+		spin_unlock(tmpfs_lock);
 	}
 
 	return;
@@ -491,6 +567,11 @@ fs_node_t * tmpfs_mount(char * device, char * mount_path) {
 
 static int tmpfs_initialize(void) {
 
+	/* Sacrifice one heap page for the scratch mapping; its page table
+	 * entry gets repointed at whichever block frame is being accessed. */
+	tmpfs_scratch = (char *)kvmalloc(BLOCKSIZE);
+	tmpfs_scratch_page = get_page((uintptr_t)tmpfs_scratch, 0, kernel_directory);
+
 	vfs_mount("/tmp", tmpfs_create("tmp"));
 	vfs_mount("/var", tmpfs_create("var"));
 
@@ -2,14 +2,117 @@
  * This file is part of ToaruOS and is released under the terms
  * of the NCSA / University of Illinois License - see LICENSE.md
  * Copyright (C) 2014 Kevin Lange
+ *
+ * UHCI host controller driver.
+ *
+ * The controller walks a frame list entirely in hardware: every
+ * frame entry points at a persistent queue-head chain (control QH,
+ * then bulk QH), so queued transfers stream without per-frame
+ * software intervention. Transfer descriptors come from a fixed
+ * pool and only the last descriptor of a transfer carries an
+ * interrupt-on-completion bit, so a 4KB bulk transfer costs one
+ * interrupt rather than one per 64-byte packet.
  */
+#include <system.h>
+#include <fs.h>
+#include <mem.h>
+#include <process.h>
 #include <module.h>
 #include <pci.h>
 #include <printf.h>
 #include <logging.h>
 #include <mod/shell.h>
 
-static uint32_t hub_device = 0;
+/* I/O registers, offsets from BAR4 */
+#define UHCI_USBCMD    0x00
+#define UHCI_USBSTS    0x02
+#define UHCI_USBINTR   0x04
+#define UHCI_FRNUM     0x06
+#define UHCI_FRBASEADD 0x08
+#define UHCI_SOFMOD    0x0C
+#define UHCI_PORTSC1   0x10
+#define UHCI_PORTSC2   0x12
+
+#define UHCI_CMD_RS      0x0001
+#define UHCI_CMD_HCRESET 0x0002
+#define UHCI_CMD_GRESET  0x0004
+#define UHCI_CMD_MAXP    0x0080
+
+#define UHCI_STS_USBINT  0x0001
+#define UHCI_STS_ERRINT  0x0002
+#define UHCI_STS_HALTED  0x0020
+
+#define UHCI_PORT_CONNECT 0x0001
+#define UHCI_PORT_CSC     0x0002
+#define UHCI_PORT_ENABLE  0x0004
+#define UHCI_PORT_LOWSPD  0x0100
+#define UHCI_PORT_RESET   0x0200
+
+/* Link pointer bits */
+#define LINK_TERMINATE 0x01
+#define LINK_QH        0x02
+
+/* TD control/status */
+#define TD_CTRL_ACTIVE  (1 << 23)
+#define TD_CTRL_STALLED (1 << 22)
+#define TD_CTRL_IOC     (1 << 24)
+#define TD_CTRL_LS      (1 << 26)
+#define TD_CTRL_3ERR    (3 << 27)
+#define TD_CTRL_ANYERR  (0x7E << 17)
+#define TD_ACTLEN(c)    (((c) + 1) & 0x7FF)
+
+/* TD token PIDs */
+#define TD_PID_IN    0x69
+#define TD_PID_OUT   0xE1
+#define TD_PID_SETUP 0x2D
+
+#define TD_TOKEN(pid, addr, endp, toggle, len) \
+	((pid) | ((addr) << 8) | ((endp) << 15) | ((toggle) << 19) | ((((len) - 1) & 0x7FF) << 21))
+
+/* Hardware TD: first four dwords are the controller's; the tail is
+ * ours. Sixteen-byte alignment is a hardware requirement and a
+ * 32-byte stride keeps the pool math simple. */
+typedef struct uhci_td {
+	uint32_t link;
+	uint32_t ctrl;
+	uint32_t token;
+	uint32_t buffer;
+	uint32_t phys;     /* physical address of this TD */
+	uint32_t next;     /* pool index of next TD in this transfer, or -1 */
+	uint32_t reserved[2];
+} __attribute__((packed)) uhci_td_t;
+
+typedef struct uhci_qh {
+	uint32_t head;     /* next QH in the schedule */
+	uint32_t element;  /* first TD of the current transfer */
+	uint32_t phys;
+	uint32_t reserved;
+} __attribute__((packed)) uhci_qh_t;
+
+#define TD_POOL_SIZE 128 /* one page worth */
+#define MAX_PACKET   64
+
+static uint32_t uhci_device = 0;
+static uint32_t uhci_io = 0;
+static int uhci_irq = 0;
+
+static uint32_t * frame_list = NULL;
+
+static uhci_td_t * td_pool = NULL;
+static uint32_t td_pool_phys = 0;
+static uint32_t td_free_map[TD_POOL_SIZE / 32];
+
+static uhci_qh_t * qh_control = NULL;
+static uhci_qh_t * qh_bulk = NULL;
+
+/* One transfer in flight per queue head; simple and sufficient for
+ * a single mass-storage stream. */
+static spin_lock_t control_lock = { 0 };
+static spin_lock_t bulk_lock = { 0 };
+static list_t * uhci_wait = NULL;
+
+/* Bulk data toggles, one per (address, endpoint) */
+static uint8_t bulk_toggle[128][16];
 
 static void find_usb_device(uint32_t device, uint16_t vendorid, uint16_t deviceid, void * extra) {
 	if (pci_find_type(device) == 0xc03) {
@@ -20,29 +123,344 @@ static void find_usb_device(uint32_t device, uint16_t vendorid, uint16_t devicei
 	}
 }
 
-DEFINE_SHELL_FUNCTION(usb, "Enumerate USB devices (UHCI)") {
+static int td_alloc(void) {
+	for (int i = 0; i < TD_POOL_SIZE; ++i) {
+		if (!(td_free_map[i / 32] & (1 << (i % 32)))) {
+			td_free_map[i / 32] |= (1 << (i % 32));
+			return i;
+		}
+	}
+	return -1;
+}
+
+static void td_free(int i) {
+	td_free_map[i / 32] &= ~(1 << (i % 32));
+}
+
+/*
+ * Build a TD chain for `size` bytes of `pid` traffic and hang it off
+ * `qh`. Only the final descriptor interrupts. Returns the index of
+ * the first TD, or -1 if the pool is exhausted.
+ */
+static int chain_build(uhci_qh_t * qh, uint8_t pid, uint8_t addr, uint8_t endp,
+                       uint8_t * toggle, uint32_t buf_phys, uint32_t size, int max_packet) {
+	int first = -1;
+	int prev = -1;
+	uint32_t off = 0;
+
+	do {
+		uint32_t chunk = size - off;
+		if (chunk > (uint32_t)max_packet) chunk = max_packet;
+
+		int i = td_alloc();
+		if (i < 0) {
+			while (first >= 0) {
+				int n = td_pool[first].next;
+				td_free(first);
+				first = n;
+			}
+			return -1;
+		}
+
+		uhci_td_t * td = &td_pool[i];
+		td->link   = LINK_TERMINATE;
+		td->ctrl   = TD_CTRL_ACTIVE | TD_CTRL_3ERR;
+		td->token  = TD_TOKEN(pid, addr, endp, *toggle, chunk);
+		td->buffer = buf_phys + off;
+		td->next   = (uint32_t)-1;
+		*toggle ^= 1;
+
+		if (prev >= 0) {
+			td_pool[prev].link = td->phys | 0x04; /* depth first */
+			td_pool[prev].next = i;
+		} else {
+			first = i;
+		}
+		prev = i;
+		off += chunk;
+	} while (off < size);
+
+	td_pool[prev].ctrl |= TD_CTRL_IOC;
+	qh->element = td_pool[first].phys;
+	return first;
+}
+
+/*
+ * Wait for the chain on `qh` to retire, then collect the transferred
+ * length and release the descriptors. Returns bytes moved or -1.
+ */
+static int chain_finish(uhci_qh_t * qh, int first) {
+	while (1) {
+		/* Element advances as the controller retires TDs and reads
+		 * TERMINATE once the chain is done; errors leave the failed
+		 * TD inactive but still linked. */
+		uint32_t elem = qh->element;
+		if (elem & LINK_TERMINATE) break;
+		int active = 0;
+		for (int i = first; i >= 0; i = td_pool[i].next) {
+			if (td_pool[i].ctrl & TD_CTRL_ACTIVE) { active = 1; break; }
+		}
+		if (!active) break;
+		sleep_on(uhci_wait);
+	}
+
+	int total = 0;
+	int failed = 0;
+	for (int i = first; i >= 0; ) {
+		if (td_pool[i].ctrl & (TD_CTRL_STALLED | TD_CTRL_ACTIVE)) {
+			failed = 1;
+		} else {
+			total += TD_ACTLEN(td_pool[i].ctrl);
+		}
+		int n = td_pool[i].next;
+		td_free(i);
+		i = n;
+	}
+	qh->element = LINK_TERMINATE;
+	return failed ? -1 : total;
+}
+
+/*
+ * Bulk transfer: the interface the mass-storage / block layer side
+ * drives. `buffer` must be physically contiguous (kernel heap is).
+ * Returns bytes transferred or -1 on stall/error.
+ */
+int uhci_bulk(uint8_t addr, uint8_t endp, int out, void * buffer, uint32_t size) {
+	if (!uhci_io) return -1;
+	uint32_t phys = map_to_physical((uintptr_t)buffer);
+	if (!phys) return -1;
+
+	spin_lock(bulk_lock);
+	int first = chain_build(qh_bulk, out ? TD_PID_OUT : TD_PID_IN, addr, endp,
+	                        &bulk_toggle[addr][endp], phys, size, MAX_PACKET);
+	if (first < 0) {
+		spin_unlock(bulk_lock);
+		return -1;
+	}
+	int r = chain_finish(qh_bulk, first);
+	spin_unlock(bulk_lock);
+	return r;
+}
 
-	pci_scan(&find_usb_device, -1, &hub_device);
+/*
+ * Control transfer: SETUP stage, optional data stage, and a status
+ * stage in the opposite direction. Used for enumeration.
+ */
+int uhci_control(uint8_t addr, uint8_t * setup, void * data, uint32_t size, int out) {
+	if (!uhci_io) return -1;
+
+	spin_lock(control_lock);
+
+	uint8_t toggle = 0;
+	int first = td_alloc();
+	if (first < 0) {
+		spin_unlock(control_lock);
+		return -1;
+	}
+
+	uhci_td_t * td = &td_pool[first];
+	td->link   = LINK_TERMINATE;
+	td->ctrl   = TD_CTRL_ACTIVE | TD_CTRL_3ERR;
+	td->token  = TD_TOKEN(TD_PID_SETUP, addr, 0, 0, 8);
+	td->buffer = map_to_physical((uintptr_t)setup);
+	td->next   = (uint32_t)-1;
+	int prev = first;
+	toggle = 1;
+
+	if (size) {
+		uint32_t phys = map_to_physical((uintptr_t)data);
+		uint32_t off = 0;
+		while (off < size) {
+			uint32_t chunk = size - off;
+			if (chunk > 8) chunk = 8; /* default pipe before descriptors are read */
+			int i = td_alloc();
+			if (i < 0) goto fail;
+			uhci_td_t * d = &td_pool[i];
+			d->link   = LINK_TERMINATE;
+			d->ctrl   = TD_CTRL_ACTIVE | TD_CTRL_3ERR;
+			d->token  = TD_TOKEN(out ? TD_PID_OUT : TD_PID_IN, addr, 0, toggle, chunk);
+			d->buffer = phys + off;
+			d->next   = (uint32_t)-1;
+			td_pool[prev].link = d->phys | 0x04;
+			td_pool[prev].next = i;
+			prev = i;
+			toggle ^= 1;
+			off += chunk;
+		}
+	}
+
+	/* Status stage: zero-length, opposite direction, DT1, IOC */
+	{
+		int i = td_alloc();
+		if (i < 0) goto fail;
+		uhci_td_t * s = &td_pool[i];
+		s->link   = LINK_TERMINATE;
+		s->ctrl   = TD_CTRL_ACTIVE | TD_CTRL_3ERR | TD_CTRL_IOC;
+		s->token  = TD_TOKEN((size && !out) ? TD_PID_OUT : TD_PID_IN, addr, 0, 1, 0);
+		s->buffer = 0;
+		s->next   = (uint32_t)-1;
+		td_pool[prev].link = s->phys | 0x04;
+		td_pool[prev].next = i;
+	}
+
+	qh_control->element = td_pool[first].phys;
+	{
+		int r = chain_finish(qh_control, first);
+		spin_unlock(control_lock);
+		return r;
+	}
+
+fail:
+	while (first >= 0) {
+		int n = td_pool[first].next;
+		td_free(first);
+		first = n;
+	}
+	spin_unlock(control_lock);
+	return -1;
+}
+
+static int uhci_irq_handler(struct regs * r) {
+	uint16_t sts = inports(uhci_io + UHCI_USBSTS);
+	if (!(sts & (UHCI_STS_USBINT | UHCI_STS_ERRINT))) {
+		return 0; /* shared line; not ours */
+	}
+	outports(uhci_io + UHCI_USBSTS, sts & (UHCI_STS_USBINT | UHCI_STS_ERRINT));
+	irq_ack(uhci_irq);
+	wakeup_queue_irq(uhci_wait);
+	return 1;
+}
+
+static int uhci_port_reset(int port) {
+	uint32_t reg = uhci_io + (port ? UHCI_PORTSC2 : UHCI_PORTSC1);
+	outports(reg, UHCI_PORT_RESET);
+	unsigned long s, ss;
+	relative_time(0, 60, &s, &ss);
+	sleep_until((process_t *)current_process, s, ss);
+	switch_task(0);
+	outports(reg, 0);
+	relative_time(0, 20, &s, &ss);
+	sleep_until((process_t *)current_process, s, ss);
+	switch_task(0);
+	outports(reg, UHCI_PORT_ENABLE | UHCI_PORT_CSC);
+	return (inports(reg) & UHCI_PORT_ENABLE) ? 0 : -1;
+}
+
+static void uhci_controller_init(void) {
+	uhci_io = pci_get_bar(uhci_device, 4) & 0xFFFFFFFC;
+	uhci_irq = pci_get_interrupt(uhci_device);
+
+	uhci_wait = list_create();
+
+	/* Frame list: 1024 dwords, page aligned */
+	uint32_t frame_phys = 0;
+	frame_list = (uint32_t *)kvmalloc_p(0x1000, &frame_phys);
 
-	if (!hub_device) {
+	/* TD pool and the two persistent queue heads */
+	td_pool = (uhci_td_t *)kvmalloc_p(TD_POOL_SIZE * sizeof(uhci_td_t), &td_pool_phys);
+	memset(td_pool, 0, TD_POOL_SIZE * sizeof(uhci_td_t));
+	for (int i = 0; i < TD_POOL_SIZE; ++i) {
+		td_pool[i].phys = td_pool_phys + i * sizeof(uhci_td_t);
+	}
+
+	uint32_t qh_phys = 0;
+	uhci_qh_t * qhs = (uhci_qh_t *)kvmalloc_p(2 * sizeof(uhci_qh_t), &qh_phys);
+	qh_control = &qhs[0];
+	qh_bulk    = &qhs[1];
+	qh_control->phys    = qh_phys;
+	qh_bulk->phys       = qh_phys + sizeof(uhci_qh_t);
+	qh_control->head    = qh_bulk->phys | LINK_QH;
+	qh_control->element = LINK_TERMINATE;
+	qh_bulk->head       = LINK_TERMINATE;
+	qh_bulk->element    = LINK_TERMINATE;
+
+	/* Every frame enters the same QH chain; the controller does the
+	 * rest without software touching the schedule per frame. */
+	for (int i = 0; i < 1024; ++i) {
+		frame_list[i] = qh_control->phys | LINK_QH;
+	}
+
+	/* Reset the controller and point it at the schedule */
+	outports(uhci_io + UHCI_USBCMD, UHCI_CMD_GRESET);
+	unsigned long s, ss;
+	relative_time(0, 20, &s, &ss);
+	sleep_until((process_t *)current_process, s, ss);
+	switch_task(0);
+	outports(uhci_io + UHCI_USBCMD, 0);
+	outports(uhci_io + UHCI_USBCMD, UHCI_CMD_HCRESET);
+	while (inports(uhci_io + UHCI_USBCMD) & UHCI_CMD_HCRESET);
+
+	outportl(uhci_io + UHCI_FRBASEADD, frame_phys);
+	outports(uhci_io + UHCI_FRNUM, 0);
+	outportb(uhci_io + UHCI_SOFMOD, 0x40);
+	outports(uhci_io + UHCI_USBINTR, 0x000F);
+
+	irq_install_handler(uhci_irq, uhci_irq_handler);
+
+	outports(uhci_io + UHCI_USBCMD, UHCI_CMD_RS | UHCI_CMD_MAXP);
+
+	debug_print(NOTICE, "UHCI controller at I/O 0x%x, IRQ %d", uhci_io, uhci_irq);
+}
+
+DEFINE_SHELL_FUNCTION(usb, "Enumerate USB devices (UHCI)") {
+
+	if (!uhci_device) {
 		fprintf(tty, "Failed to locate a UHCI controller.\n");
 		return 1;
 	}
 
-	fprintf(tty, "Located UHCI controller: %2x:%2x.%d\n",
-			(int)pci_extract_bus (hub_device),
-			(int)pci_extract_slot(hub_device),
-			(int)pci_extract_func(hub_device));
+	fprintf(tty, "UHCI controller: %2x:%2x.%d at I/O 0x%x\n",
+			(int)pci_extract_bus (uhci_device),
+			(int)pci_extract_slot(uhci_device),
+			(int)pci_extract_func(uhci_device),
+			uhci_io);
+
+	for (int port = 0; port < 2; ++port) {
+		uint16_t sc = inports(uhci_io + (port ? UHCI_PORTSC2 : UHCI_PORTSC1));
+		if (!(sc & UHCI_PORT_CONNECT)) {
+			fprintf(tty, "  port %d: no device\n", port + 1);
+			continue;
+		}
+		fprintf(tty, "  port %d: device present (%s speed)%s\n", port + 1,
+				(sc & UHCI_PORT_LOWSPD) ? "low" : "full",
+				(sc & UHCI_PORT_ENABLE) ? ", enabled" : "");
+
+		if (!(sc & UHCI_PORT_ENABLE)) {
+			if (uhci_port_reset(port)) {
+				fprintf(tty, "  port %d: reset failed\n", port + 1);
+				continue;
+			}
+		}
+
+		/* GET_DESCRIPTOR(device), first 8 bytes over the default pipe */
+		uint8_t setup[8] = { 0x80, 0x06, 0x00, 0x01, 0x00, 0x00, 0x08, 0x00 };
+		uint8_t desc[8] = { 0 };
+		int r = uhci_control(0, setup, desc, 8, 0);
+		if (r < 0) {
+			fprintf(tty, "  port %d: no response to GET_DESCRIPTOR\n", port + 1);
+			continue;
+		}
+		fprintf(tty, "  port %d: descriptor type %d, USB %d.%d, max packet %d\n",
+				port + 1, desc[1], desc[3], desc[2], desc[7]);
+	}
 
 	return 0;
 }
 
 static int install(void) {
+	pci_scan(&find_usb_device, -1, &uhci_device);
+	if (uhci_device) {
+		uhci_controller_init();
+	}
 	BIND_SHELL_FUNCTION(usb);
 	return 0;
 }
 
 static int uninstall(void) {
+	if (uhci_io) {
+		outports(uhci_io + UHCI_USBCMD, 0);
+		outports(uhci_io + UHCI_USBINTR, 0);
+	}
 	return 0;
 }
 
@@ -16,6 +16,9 @@
 #include <video.h>
 #include <pipe.h>
 #include <mouse.h>
+#include <args.h>
+#include <process.h>
+#include <tokenize.h>
 
 #define VBOX_VENDOR_ID 0x80EE
 #define VBOX_DEVICE_ID 0xCAFE
@@ -68,6 +71,24 @@ struct vbox_mouse {
 	int32_t y;
 };
 
+#define VBOX_POINTER_VISIBLE 0x01
+#define VBOX_POINTER_ALPHA   0x02
+#define VBOX_POINTER_SHAPE   0x04
+
+struct vbox_pointer_shape {
+	struct vbox_header header;
+	uint32_t flags;
+	uint32_t x_hot;
+	uint32_t y_hot;
+	uint32_t width;
+	uint32_t height;
+	unsigned char data[];
+};
+
+/* Enough for a 64x64 ARGB shape plus its AND mask */
+#define VBOX_POINTER_MAX 64
+#define VBOX_POINTER_BUFFER_SIZE 0x5000
+
 
 #define EARLY_LOG_DEVICE 0x504
 static uint32_t _vbox_write(fs_node_t *node, uint32_t offset, uint32_t size, uint8_t *buffer) {
@@ -90,8 +111,53 @@ static struct vbox_mouse * vbox_m;
 static uint32_t vbox_phys_mouse;
 static uint32_t * vbox_vmmdev = 0;
 
+static struct vbox_pointer_shape * vbox_pointer;
+static uint32_t vbox_phys_pointer;
+
 static fs_node_t * mouse_pipe;
 
+/*
+ * Hand the host a cursor image to draw itself.
+ *
+ * With mouse integration active the host pointer is the guest pointer,
+ * so once the host draws the shape the guest never has to composite
+ * one. An alpha shape still carries a (ignored) monochrome AND mask;
+ * we send it zeroed.
+ */
+static int vbox_set_pointer_shape(vid_cursor_t * cursor) {
+	if (!vbox_pointer) return -1;
+
+	if (cursor->width == 0 || cursor->height == 0) {
+		/* Hide the pointer: no VISIBLE flag, no shape data */
+		vbox_pointer->header.size = sizeof(struct vbox_pointer_shape);
+		vbox_pointer->flags = 0;
+		vbox_pointer->x_hot = 0;
+		vbox_pointer->y_hot = 0;
+		vbox_pointer->width = 0;
+		vbox_pointer->height = 0;
+		outportl(vbox_port, vbox_phys_pointer);
+		return 0;
+	}
+
+	if (cursor->width > VBOX_POINTER_MAX || cursor->height > VBOX_POINTER_MAX) return -1;
+	validate(cursor->data);
+
+	size_t and_size = (((cursor->width + 7) / 8) * cursor->height + 3) & ~3;
+	size_t xor_size = cursor->width * cursor->height * 4;
+
+	vbox_pointer->header.size = sizeof(struct vbox_pointer_shape) + and_size + xor_size;
+	vbox_pointer->flags = VBOX_POINTER_VISIBLE | VBOX_POINTER_ALPHA | VBOX_POINTER_SHAPE;
+	vbox_pointer->x_hot = cursor->hot_x;
+	vbox_pointer->y_hot = cursor->hot_y;
+	vbox_pointer->width = cursor->width;
+	vbox_pointer->height = cursor->height;
+	memset(vbox_pointer->data, 0, and_size);
+	memcpy(vbox_pointer->data + and_size, cursor->data, xor_size);
+
+	outportl(vbox_port, vbox_phys_pointer);
+	return 0;
+}
+
 #define PACKETS_IN_PIPE 1024
 #define DISCARD_POINT 32
 
@@ -110,6 +176,8 @@ static int vbox_irq_handler(struct regs *r) {
 		packet.x_difference = x;
 		packet.y_difference = y;
 		packet.buttons = 0;
+		packet.ticks = timer_ticks;
+		packet.subticks = timer_subticks;
 
 		mouse_device_packet_t bitbucket;
 		while (pipe_size(mouse_pipe) > (int)(DISCARD_POINT * sizeof(packet))) {
@@ -126,6 +194,524 @@ static int vbox_irq_handler(struct regs *r) {
 	return 1;
 }
 
+/* Host time synchronization {{{
+ *
+ * VMMDevReq_GetHostTime returns host wall time in milliseconds since
+ * the epoch. We fold it into boot_time so gettimeofday agrees with
+ * the host, and resync every minute from a tasklet; between syncs
+ * the PIT carries the clock as usual.
+ */
+#define VBOX_REQUEST_GET_HOST_TIME 10
+
+struct vbox_host_time {
+	struct vbox_header header;
+	uint64_t time;
+};
+
+static struct vbox_host_time * vbox_time;
+static uint32_t vbox_phys_time;
+
+static void vbox_sync_time(void) {
+	vbox_time->header.size = sizeof(struct vbox_host_time);
+	vbox_time->header.version = VBOX_REQUEST_HEADER_VERSION;
+	vbox_time->header.requestType = VBOX_REQUEST_GET_HOST_TIME;
+	vbox_time->header.rc = -1;
+	vbox_time->time = 0;
+	outportl(vbox_port, vbox_phys_time);
+	if (vbox_time->header.rc >= 0 && vbox_time->time) {
+		uint32_t host_sec = vbox_time->time / 1000;
+		boot_time = host_sec - timer_ticks - timer_drift;
+	}
+}
+
+static void vbox_time_tasklet(void * data, char * name) {
+	while (1) {
+		unsigned long s, ss;
+		relative_time(60, 0, &s, &ss);
+		sleep_until((process_t *)current_process, s, ss);
+		switch_task(0);
+		vbox_sync_time();
+	}
+}
+/* }}} */
+
+/* Shared folders {{{
+ *
+ * Shared folder requests ride the HGCM channel of the same VMMDev:
+ * we connect to the VBoxSharedFolders service once, map a folder to
+ * a root handle, and expose it as a mountable filesystem. All data
+ * moves through kernel bounce pages handed to the host by address,
+ * so transfers run at host I/O speed with no emulated NIC anywhere
+ * in the path.
+ */
+#define VBOX_REQUEST_HGCM_CONNECT    60
+#define VBOX_REQUEST_HGCM_DISCONNECT 61
+#define VBOX_REQUEST_HGCM_CALL       62
+
+#define HGCM_FLAG_DONE 0x1
+
+#define HGCM_PARAM_32BIT   1
+#define HGCM_PARAM_64BIT   2
+#define HGCM_PARAM_LINADDR 4
+
+struct hgcm_header {
+	struct vbox_header header;
+	uint32_t flags;
+	int32_t  result;
+};
+
+struct hgcm_connect {
+	struct hgcm_header hgcm;
+	uint32_t loc_type; /* 2: existing service on the host */
+	char     name[128];
+	uint32_t client_id;
+};
+
+struct hgcm_param {
+	uint32_t type;
+	union {
+		uint64_t value64;
+		struct {
+			uint32_t size;
+			uint32_t addr;
+		} ptr;
+	} u;
+} __attribute__((packed));
+
+struct hgcm_call {
+	struct hgcm_header hgcm;
+	uint32_t client_id;
+	uint32_t function;
+	uint32_t param_count;
+	struct hgcm_param params[];
+};
+
+/* Shared folder service functions */
+#define SHFL_FN_CREATE       3
+#define SHFL_FN_CLOSE        4
+#define SHFL_FN_READ         5
+#define SHFL_FN_WRITE        6
+#define SHFL_FN_LIST         8
+#define SHFL_FN_MAP_FOLDER   17
+#define SHFL_FN_UNMAP_FOLDER 18
+
+/* Create flags */
+#define SHFL_CF_LOOKUP            0x00000001
+#define SHFL_CF_DIRECTORY         0x00000004
+#define SHFL_CF_ACT_FAIL_IF_NEW   0x00000010
+#define SHFL_CF_ACCESS_READ       0x00001000
+#define SHFL_CF_ACCESS_WRITE      0x00002000
+
+#define SHFL_HANDLE_NIL 0xFFFFFFFFFFFFFFFFULL
+
+typedef struct {
+	uint16_t size;   /* buffer size including nul */
+	uint16_t length; /* string length excluding nul */
+	char     data[];
+} __attribute__((packed)) shfl_string;
+
+typedef struct {
+	uint64_t size;
+	uint64_t allocated;
+	uint64_t atime;
+	uint64_t mtime;
+	uint64_t ctime;
+	uint64_t btime;
+	uint32_t mode;
+	uint32_t additional;
+	uint8_t  attr[40];
+} __attribute__((packed)) shfl_fsobjinfo;
+
+#define SHFL_MODE_DIRECTORY(m) (((m) & 0xF000) == 0x4000)
+
+typedef struct {
+	uint64_t handle;
+	uint32_t result;
+	uint32_t create_flags;
+	shfl_fsobjinfo info;
+} __attribute__((packed)) shfl_createparms;
+
+typedef struct {
+	shfl_fsobjinfo info;
+	uint16_t short_len;
+	uint16_t short_name[14];
+	shfl_string name;
+} __attribute__((packed)) shfl_dirinfo;
+
+static uint32_t sf_client = 0;
+static uint32_t sf_root = 0;
+static int sf_ready = 0;
+
+static struct hgcm_call * hgcm_req;
+static uint32_t hgcm_req_phys;
+
+#define SF_DATA_SIZE 0x2000
+static uint8_t * sf_data; /* bounce buffer for strings and payloads */
+
+static spin_lock_t sf_lock = { 0 };
+
+/*
+ * Issue an HGCM request and wait for the host to flag completion.
+ * HGCM completes asynchronously; we poll with yields, bounded so a
+ * wedged service fails the call instead of the kernel.
+ */
+static int hgcm_wait(struct hgcm_header * h, uint32_t phys) {
+	outportl(vbox_port, phys);
+	unsigned long s, ss;
+	relative_time(5, 0, &s, &ss);
+	while (!(h->flags & HGCM_FLAG_DONE)) {
+		if (timer_ticks > s || (timer_ticks == s && timer_subticks >= ss)) {
+			return -1;
+		}
+		switch_task(1);
+	}
+	return h->result;
+}
+
+static int hgcm_call(uint32_t function, struct hgcm_param * params, int count) {
+	hgcm_req->hgcm.header.size = sizeof(struct hgcm_call) + count * sizeof(struct hgcm_param);
+	hgcm_req->hgcm.header.version = VBOX_REQUEST_HEADER_VERSION;
+	hgcm_req->hgcm.header.requestType = VBOX_REQUEST_HGCM_CALL;
+	hgcm_req->hgcm.header.rc = 0;
+	hgcm_req->hgcm.header.reserved1 = 0;
+	hgcm_req->hgcm.header.reserved2 = 0;
+	hgcm_req->hgcm.flags = 0;
+	hgcm_req->hgcm.result = 0;
+	hgcm_req->client_id = sf_client;
+	hgcm_req->function = function;
+	hgcm_req->param_count = count;
+	memcpy(hgcm_req->params, params, count * sizeof(struct hgcm_param));
+	int r = hgcm_wait(&hgcm_req->hgcm, hgcm_req_phys);
+	if (r >= 0) {
+		/* Copy back outputs (counts, handles) */
+		memcpy(params, hgcm_req->params, count * sizeof(struct hgcm_param));
+	}
+	return r;
+}
+
+static void param_32(struct hgcm_param * p, uint32_t v) {
+	p->type = HGCM_PARAM_32BIT;
+	p->u.value64 = v;
+}
+
+static void param_64(struct hgcm_param * p, uint64_t v) {
+	p->type = HGCM_PARAM_64BIT;
+	p->u.value64 = v;
+}
+
+static void param_ptr(struct hgcm_param * p, void * buf, uint32_t size) {
+	p->type = HGCM_PARAM_LINADDR;
+	p->u.ptr.size = size;
+	p->u.ptr.addr = (uint32_t)buf;
+}
+
+/* Build a SHFLSTRING in the bounce page; returns its total size. */
+static uint32_t sf_string(uint8_t * at, char * text) {
+	shfl_string * str = (shfl_string *)at;
+	uint32_t len = strlen(text);
+	str->size = len + 1;
+	str->length = len;
+	memcpy(str->data, text, len + 1);
+	return sizeof(shfl_string) + len + 1;
+}
+
+/*
+ * Open or look up `path` (relative to the mapped root). With
+ * SHFL_CF_LOOKUP no handle is created and only `info` comes back.
+ */
+static int sf_create(char * path, uint32_t flags, shfl_createparms * parms) {
+	struct hgcm_param params[3];
+	uint32_t str_size = sf_string(sf_data, path);
+	shfl_createparms * rp = (shfl_createparms *)(sf_data + str_size);
+	memset(rp, 0, sizeof(shfl_createparms));
+	rp->handle = SHFL_HANDLE_NIL;
+	rp->create_flags = flags;
+
+	param_32(&params[0], sf_root);
+	param_ptr(&params[1], sf_data, str_size);
+	param_ptr(&params[2], rp, sizeof(shfl_createparms));
+
+	int r = hgcm_call(SHFL_FN_CREATE, params, 3);
+	if (r < 0) return -1;
+	memcpy(parms, rp, sizeof(shfl_createparms));
+	return 0;
+}
+
+static void sf_close_handle(uint64_t handle) {
+	struct hgcm_param params[2];
+	param_32(&params[0], sf_root);
+	param_64(&params[1], handle);
+	hgcm_call(SHFL_FN_CLOSE, params, 2);
+}
+
+/* Move file data through the bounce page, a page per call. */
+static int sf_io(int write, uint64_t handle, uint64_t offset, uint32_t size, uint8_t * buffer) {
+	uint32_t done = 0;
+	while (done < size) {
+		uint32_t chunk = size - done;
+		if (chunk > SF_DATA_SIZE) chunk = SF_DATA_SIZE;
+
+		if (write) {
+			memcpy(sf_data, buffer + done, chunk);
+		}
+
+		struct hgcm_param params[5];
+		param_32(&params[0], sf_root);
+		param_64(&params[1], handle);
+		param_64(&params[2], offset + done);
+		param_32(&params[3], chunk);
+		param_ptr(&params[4], sf_data, chunk);
+
+		int r = hgcm_call(write ? SHFL_FN_WRITE : SHFL_FN_READ, params, 5);
+		if (r < 0) return done ? (int)done : -1;
+
+		uint32_t moved = (uint32_t)params[3].u.value64;
+		if (!write && moved) {
+			memcpy(buffer + done, sf_data, moved);
+		}
+		done += moved;
+		if (moved < chunk) break; /* short read/write: EOF or full */
+	}
+	return done;
+}
+
+/* VFS glue: each node's `device` is its path relative to the root. */
+
+static uint32_t read_sf(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer);
+static uint32_t write_sf(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer);
+static void open_sf(fs_node_t * node, unsigned int flags);
+static void close_sf(fs_node_t * node);
+static struct dirent * readdir_sf(fs_node_t * node, uint32_t index);
+static fs_node_t * finddir_sf(fs_node_t * node, char * name);
+
+static uint64_t sf_node_handle(fs_node_t * node) {
+	return ((uint64_t)node->inode << 32) | node->impl;
+}
+
+static void open_sf(fs_node_t * node, unsigned int flags) {
+	spin_lock(sf_lock);
+	shfl_createparms parms;
+	uint32_t cf = SHFL_CF_ACCESS_READ | SHFL_CF_ACCESS_WRITE;
+	if (!(flags & O_CREAT)) cf |= SHFL_CF_ACT_FAIL_IF_NEW;
+	if (node->flags & FS_DIRECTORY) cf |= SHFL_CF_DIRECTORY;
+	if (!sf_create((char *)node->device, cf, &parms) && parms.handle != SHFL_HANDLE_NIL) {
+		node->inode = (uint32_t)(parms.handle >> 32);
+		node->impl  = (uint32_t)parms.handle;
+		node->length = parms.info.size;
+	}
+	spin_unlock(sf_lock);
+}
+
+static void close_sf(fs_node_t * node) {
+	spin_lock(sf_lock);
+	if (sf_node_handle(node) != SHFL_HANDLE_NIL) {
+		sf_close_handle(sf_node_handle(node));
+	}
+	spin_unlock(sf_lock);
+	free(node->device);
+	node->device = NULL;
+}
+
+static uint32_t read_sf(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	if (offset > node->length) return 0;
+	if (offset + size > node->length) size = node->length - offset;
+	spin_lock(sf_lock);
+	int r = sf_io(0, sf_node_handle(node), offset, size, buffer);
+	spin_unlock(sf_lock);
+	return r < 0 ? 0 : r;
+}
+
+static uint32_t write_sf(fs_node_t * node, uint32_t offset, uint32_t size, uint8_t * buffer) {
+	spin_lock(sf_lock);
+	int r = sf_io(1, sf_node_handle(node), offset, size, buffer);
+	if (r > 0 && offset + r > node->length) node->length = offset + r;
+	spin_unlock(sf_lock);
+	return r < 0 ? 0 : r;
+}
+
+static fs_node_t * sf_node_create(char * path, char * name, shfl_fsobjinfo * info) {
+	fs_node_t * fnode = malloc(sizeof(fs_node_t));
+	memset(fnode, 0x00, sizeof(fs_node_t));
+	strcpy(fnode->name, name);
+	fnode->device = path;
+	fnode->mask = 0660;
+	fnode->length = info->size;
+	fnode->inode = 0xFFFFFFFF;
+	fnode->impl = 0xFFFFFFFF;
+	fnode->open = open_sf;
+	fnode->close = close_sf;
+	if (SHFL_MODE_DIRECTORY(info->mode)) {
+		fnode->flags = FS_DIRECTORY;
+		fnode->readdir = readdir_sf;
+		fnode->finddir = finddir_sf;
+	} else {
+		fnode->flags = FS_FILE;
+		fnode->read = read_sf;
+		fnode->write = write_sf;
+	}
+	return fnode;
+}
+
+static fs_node_t * finddir_sf(fs_node_t * node, char * name) {
+	char * parent = (char *)node->device;
+	char * path = malloc(strlen(parent) + strlen(name) + 2);
+	if (*parent) {
+		sprintf(path, "%s/%s", parent, name);
+	} else {
+		sprintf(path, "%s", name);
+	}
+
+	spin_lock(sf_lock);
+	shfl_createparms parms;
+	int r = sf_create(path, SHFL_CF_LOOKUP, &parms);
+	spin_unlock(sf_lock);
+
+	if (r < 0 || parms.result == 0) {
+		free(path);
+		return NULL;
+	}
+	return sf_node_create(path, name, &parms.info);
+}
+
+static struct dirent * readdir_sf(fs_node_t * node, uint32_t index) {
+	if (index == 0) {
+		struct dirent * out = malloc(sizeof(struct dirent));
+		memset(out, 0x00, sizeof(struct dirent));
+		out->ino = 0;
+		strcpy(out->name, ".");
+		return out;
+	}
+	if (index == 1) {
+		struct dirent * out = malloc(sizeof(struct dirent));
+		memset(out, 0x00, sizeof(struct dirent));
+		out->ino = 0;
+		strcpy(out->name, "..");
+		return out;
+	}
+	index -= 2;
+
+	spin_lock(sf_lock);
+
+	/* Open the directory, list everything into the bounce page, and
+	 * walk to the requested entry. Stateless but rescans; directory
+	 * listing is not the hot path here. */
+	shfl_createparms parms;
+	uint32_t cf = SHFL_CF_DIRECTORY | SHFL_CF_ACT_FAIL_IF_NEW | SHFL_CF_ACCESS_READ;
+	if (sf_create((char *)node->device, cf, &parms) || parms.handle == SHFL_HANDLE_NIL) {
+		spin_unlock(sf_lock);
+		return NULL;
+	}
+	uint64_t handle = parms.handle;
+
+	uint32_t str_size = sf_string(sf_data, "*");
+	uint8_t * list_buf = sf_data + ((str_size + 7) & ~7);
+	uint32_t list_size = SF_DATA_SIZE - ((str_size + 7) & ~7);
+
+	struct hgcm_param params[8];
+	param_32(&params[0], sf_root);
+	param_64(&params[1], handle);
+	param_32(&params[2], 0); /* flags: return as many as fit */
+	param_32(&params[3], list_size);
+	param_ptr(&params[4], sf_data, str_size); /* pattern */
+	param_ptr(&params[5], list_buf, list_size);
+	param_32(&params[6], 0); /* resume point */
+	param_32(&params[7], 0); /* out: entry count */
+
+	int r = hgcm_call(SHFL_FN_LIST, params, 8);
+	sf_close_handle(handle);
+
+	if (r < 0) {
+		spin_unlock(sf_lock);
+		return NULL;
+	}
+
+	uint32_t count = (uint32_t)params[7].u.value64;
+	uint8_t * at = list_buf;
+	struct dirent * out = NULL;
+	for (uint32_t i = 0; i < count; ++i) {
+		shfl_dirinfo * entry = (shfl_dirinfo *)at;
+		if (i == index) {
+			out = malloc(sizeof(struct dirent));
+			memset(out, 0x00, sizeof(struct dirent));
+			out->ino = i;
+			strcpy(out->name, entry->name.data);
+			break;
+		}
+		at += sizeof(shfl_dirinfo) + entry->name.size - sizeof(shfl_string) - 1;
+	}
+
+	spin_unlock(sf_lock);
+	return out;
+}
+
+static fs_node_t * sf_root_node(void) {
+	fs_node_t * fnode = malloc(sizeof(fs_node_t));
+	memset(fnode, 0x00, sizeof(fs_node_t));
+	strcpy(fnode->name, "vboxsf");
+	fnode->device = strdup("");
+	fnode->mask = 0660;
+	fnode->flags = FS_DIRECTORY;
+	fnode->readdir = readdir_sf;
+	fnode->finddir = finddir_sf;
+	fnode->open = open_sf;
+	fnode->close = close_sf;
+	return fnode;
+}
+
+static int sf_map_folder(char * name) {
+	struct hgcm_param params[4];
+	uint32_t str_size = sf_string(sf_data, name);
+	param_ptr(&params[0], sf_data, str_size);
+	param_32(&params[1], 0);   /* out: root handle */
+	param_32(&params[2], '/'); /* path delimiter */
+	param_32(&params[3], 1);   /* case sensitive */
+
+	int r = hgcm_call(SHFL_FN_MAP_FOLDER, params, 4);
+	if (r < 0) return -1;
+	sf_root = (uint32_t)params[1].u.value64;
+	return 0;
+}
+
+static fs_node_t * vboxsf_mount(char * arg, char * mount_point) {
+	if (!sf_client) return NULL;
+
+	spin_lock(sf_lock);
+	if (sf_ready || !sf_map_folder(arg)) {
+		sf_ready = 1;
+		spin_unlock(sf_lock);
+		return sf_root_node();
+	}
+	spin_unlock(sf_lock);
+	debug_print(ERROR, "(vbox) failed to map shared folder '%s'", arg);
+	return NULL;
+}
+
+static int vbox_hgcm_connect(void) {
+	uint32_t phys = 0;
+	struct hgcm_connect * connect = (void*)kvmalloc_p(0x1000, &phys);
+	memset(connect, 0, sizeof(struct hgcm_connect));
+	connect->hgcm.header.size = sizeof(struct hgcm_connect);
+	connect->hgcm.header.version = VBOX_REQUEST_HEADER_VERSION;
+	connect->hgcm.header.requestType = VBOX_REQUEST_HGCM_CONNECT;
+	connect->loc_type = 2;
+	strcpy(connect->name, "VBoxSharedFolders");
+
+	if (hgcm_wait(&connect->hgcm, phys) < 0 || !connect->client_id) {
+		debug_print(WARNING, "(vbox) shared folder service unavailable");
+		return -1;
+	}
+
+	sf_client = connect->client_id;
+
+	hgcm_req = (void*)kvmalloc_p(0x1000, &hgcm_req_phys);
+	sf_data = (void*)kvmalloc(SF_DATA_SIZE);
+
+	vfs_register("vboxsf", vboxsf_mount);
+	debug_print(NOTICE, "(vbox) shared folders available (client %d)", sf_client);
+	return 0;
+}
+/* }}} */
+
 static int vbox_check(void) {
 	pci_scan(vbox_scan_pci, -1, &vbox_device);
 
@@ -205,6 +791,17 @@ static int vbox_check(void) {
 
 		vbox_m->header.requestType = 1;
 
+		vbox_pointer = (void*)kvmalloc_p(VBOX_POINTER_BUFFER_SIZE, &vbox_phys_pointer);
+		vbox_pointer->header.size = sizeof(struct vbox_pointer_shape);
+		vbox_pointer->header.version = VBOX_REQUEST_HEADER_VERSION;
+		vbox_pointer->header.requestType = 3;
+		vbox_pointer->header.rc = 0;
+		vbox_pointer->header.reserved1 = 0;
+		vbox_pointer->header.reserved2 = 0;
+
+		/* We can draw the cursor; let the framebuffer advertise that */
+		lfb_set_cursor = vbox_set_pointer_shape;
+
 		/* device memory region mapping? */
 		{
 			uintptr_t t = pci_read_field(vbox_device, PCI_BAR1, 4);
@@ -218,6 +815,24 @@ static int vbox_check(void) {
 		}
 
 		vbox_vmmdev[3] = 0xFFFFFFFF; /* Enable all for now */
+
+		/* Pull host wall time now and keep resyncing every minute */
+		vbox_time = (void*)kvmalloc_p(0x1000, &vbox_phys_time);
+		vbox_sync_time();
+		create_kernel_tasklet(vbox_time_tasklet, "[vbox-time]", NULL);
+
+		/* Shared folders, if the service is available; mount with
+		 * `mount vboxsf <FolderName> /path` or the vboxsf= argument */
+		if (!vbox_hgcm_connect()) {
+			char * c;
+			if ((c = args_value("vboxsf"))) {
+				char * arg = strdup(c);
+				char * argv[3];
+				int argc = tokenize(arg, ",", argv);
+				vfs_mount_type("vboxsf", argv[0], argc > 1 ? argv[1] : "/shared");
+				free(arg);
+			}
+		}
 	}
 
 	return 0;
@@ -0,0 +1,26 @@
+#ifndef _AIO_H
+#define _AIO_H
+
+#include <stdint.h>
+
+/* Userspace view of the kernel's asynchronous I/O interface. Must
+ * match kernel/include/aio.h. syscall_aio() returns an fd: write()
+ * an array of aio_op_t to submit, read() back aio_event_t completion
+ * records, and fswait() on the fd to poll alongside other sources. */
+
+/* Submission descriptor: write() an array of these to an aio fd */
+typedef struct aio_op {
+	int      fd;       /* Descriptor to read or write */
+	int      write;    /* 0 = read, 1 = write */
+	uint32_t offset;   /* Absolute file offset */
+	uint32_t size;     /* Bytes to transfer */
+	void *   buffer;   /* Caller's buffer */
+} aio_op_t;
+
+/* Completion record: read() an array of these back */
+typedef struct aio_event {
+	int id;            /* Submission id, in submission order per fd */
+	int result;        /* Bytes transferred, or negative error */
+} aio_event_t;
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _BLKTRACE_H
+#define _BLKTRACE_H
+
+#include <stdint.h>
+
+/* Binary record drained from /dev/blktrace. Must match blktrace_rec_t
+ * in kernel/include/mod/blockdev.h. Capture runs while the node is
+ * held open; the ring keeps the most recent 4096 requests. */
+
+typedef struct {
+	uint32_t ticks;     /* Submission time */
+	uint32_t subticks;
+	uint32_t lba;       /* Absolute starting sector */
+	uint16_t count;     /* Sectors transferred */
+	uint8_t  write;     /* 0 = read, 1 = write */
+	uint8_t  dev;       /* Physical device ordinal */
+} blktrace_rec_t;
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef _PROCFS_H
+#define _PROCFS_H
+
+#include <stdint.h>
+
+/* Fixed-size process record served by /proc/processes: one read
+ * returns an array of these. Must match struct proc_info in
+ * kernel/include/procfs.h. */
+struct proc_info {
+	uint32_t pid;
+	uint32_t ppid;
+	uint32_t tgid;
+	uint32_t uid;
+	uint32_t cpu_total;      /* accumulated CPU time, msec */
+	uint8_t  state;          /* 'R' or 'S' */
+	char     name[35];       /* basename of the command */
+	char     cmdline[200];   /* full command line, space separated */
+};
+
+#endif
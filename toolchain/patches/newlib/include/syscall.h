@@ -94,6 +94,22 @@ DECL_SYSCALL1(gethostname, char *);
 DECL_SYSCALL0(mousedevice);
 DECL_SYSCALL2(mkdir, char *, unsigned int);
 DECL_SYSCALL2(shm_obtain, char *, size_t *);
+DECL_SYSCALL2(shm_resize, char *, size_t *);
+DECL_SYSCALL5(mmap, int, unsigned int, unsigned int, int, int);
+DECL_SYSCALL3(readv, int, void *, int);
+DECL_SYSCALL3(writev, int, void *, int);
+DECL_SYSCALL0(aio);
+DECL_SYSCALL0(watch);
+DECL_SYSCALL4(readdirstat, int, int, int, void *);
+DECL_SYSCALL1(fsync, int);
+DECL_SYSCALL3(splice, int, int, int);
+DECL_SYSCALL1(eventfd, unsigned int);
+DECL_SYSCALL0(timerfd);
+DECL_SYSCALL0(pollset);
+DECL_SYSCALL1(socket, int);
+DECL_SYSCALL3(connect, int, uint32_t, int);
+DECL_SYSCALL4(send, int, const void *, size_t, int);
+DECL_SYSCALL4(recv, int, void *, size_t, int);
 DECL_SYSCALL1(shm_release, char *);
 DECL_SYSCALL2(send_signal, uint32_t, uint32_t);
 DECL_SYSCALL2(signal, uint32_t, void *);
@@ -108,6 +124,9 @@ DECL_SYSCALL2(nanosleep, unsigned long, unsigned long);
 DECL_SYSCALL3(ioctl, int, int, void *);
 DECL_SYSCALL2(access, char *, int);
 DECL_SYSCALL2(stat, char *, void *);
+DECL_SYSCALL3(spawn, char *, char **, char **);
+DECL_SYSCALL2(futex_wait, int *, int);
+DECL_SYSCALL2(futex_wake, int *, int);
 
 #endif
 /*
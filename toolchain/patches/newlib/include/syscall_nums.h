@@ -47,3 +47,22 @@
 #define SYS_LSTAT 58
 #define SYS_FSWAIT 59
 #define SYS_FSWAIT2 60
+#define SYS_SPAWN 61
+#define SYS_FUTEX_WAIT 62
+#define SYS_FUTEX_WAKE 63
+#define SYS_SHM_RESIZE 64
+#define SYS_MMAP 65
+#define SYS_READV 66
+#define SYS_WRITEV 67
+#define SYS_AIO 68
+#define SYS_WATCH 69
+#define SYS_READDIRSTAT 70
+#define SYS_FSYNC 71
+#define SYS_SPLICE 72
+#define SYS_EVENTFD 73
+#define SYS_TIMERFD 74
+#define SYS_POLLSET 75
+#define SYS_SOCKET 76
+#define SYS_CONNECT 77
+#define SYS_SEND 78
+#define SYS_RECV 79
@@ -0,0 +1,18 @@
+#ifndef _SYSCALLSTATS_H
+#define _SYSCALLSTATS_H
+
+#include <stdint.h>
+
+/* Binary records read from /proc/syscalls: an array of these, indexed
+ * by syscall number. Must match syscall_stat_t in
+ * kernel/include/syscallstats.h. Accounting is toggled with
+ * sysfunc 15 (root only); buckets are log2 of latency in subticks. */
+
+#define SYSCALL_HIST_BUCKETS 16
+
+typedef struct {
+	uint32_t count;                          /* Invocations since enable */
+	uint32_t buckets[SYSCALL_HIST_BUCKETS];  /* [i] holds latencies of ~2^i subticks */
+} syscall_stat_t;
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _TIMEPAGE_H
+#define _TIMEPAGE_H
+
+#include <stdint.h>
+
+/*
+ * Kernel-maintained time page, mapped read-only into every process at
+ * a fixed address (faulted in on first use), so gettimeofday-style
+ * queries don't need to trap. The sequence counter is odd while the
+ * timer interrupt is mid-update; readers retry until they see the
+ * same even value on both sides of their reads.
+ */
+#define USER_TIME_PAGE 0xAFC00000
+
+typedef struct time_page {
+	volatile uint32_t seq;
+	uint32_t ticks;      /* Seconds since boot */
+	uint32_t subticks;   /* Milliseconds within the current second */
+	uint32_t boot_time;  /* Unix time at boot */
+	int32_t  drift;      /* CMOS resync correction, in seconds */
+} time_page_t;
+
+#endif
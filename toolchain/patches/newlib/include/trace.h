@@ -0,0 +1,24 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+/* Binary record drained from /proc/trace. Must match trace_event_t
+ * in kernel/include/trace.h. Tracepoints are toggled with sysfunc 13,
+ * timer-driven profiling samples with sysfunc 14 (both root only). */
+
+#define TRACE_SYSCALL_ENTER 1
+#define TRACE_SYSCALL_EXIT  2
+#define TRACE_SWITCH_TASK   3
+#define TRACE_IRQ_ENTER     4
+#define TRACE_SAMPLE        5
+
+typedef struct {
+	uint32_t ticks;     /* timer_ticks when the record was written */
+	uint32_t subticks;
+	uint16_t type;      /* TRACE_* */
+	uint16_t pid;       /* process running when the event fired */
+	uint32_t data;      /* syscall number, IRQ line, EIP, or outgoing pid */
+} trace_event_t;
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef DIRENT_H
 
 #include <stdint.h>
+#include <sys/stat.h>
 
 typedef struct dirent {
 	uint32_t d_ino;
@@ -12,6 +13,13 @@ typedef struct DIR {
 	int cur_entry;
 } DIR;
 
+/* Record returned by syscall_readdirstat: a directory entry with
+ * its stat data, collected in one pass */
+struct dirent_stat {
+	struct dirent d;
+	struct stat st;
+};
+
 DIR * opendir (const char * dirname);
 int closedir (DIR * dir);
 struct dirent * readdir (DIR * dirp);
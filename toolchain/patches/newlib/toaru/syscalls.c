@@ -42,6 +42,9 @@ DEFN_SYSCALL1(close, 5, int);
 DEFN_SYSCALL2(gettimeofday, 6, void *, void *);
 DEFN_SYSCALL3(execve, 7, char *, char **, char **);
 DEFN_SYSCALL0(fork, 8);
+DEFN_SYSCALL3(spawn, 61, char *, char **, char **);
+DEFN_SYSCALL2(futex_wait, 62, int *, int);
+DEFN_SYSCALL2(futex_wake, 63, int *, int);
 DEFN_SYSCALL0(getpid, 9);
 DEFN_SYSCALL1(sbrk, 10, int);
 DEFN_SYSCALL0(getgraphicsaddress, 11);
@@ -69,6 +72,22 @@ DEFN_SYSCALL1(gethostname, 32, char *);
 DEFN_SYSCALL0(mousedevice, 33);
 DEFN_SYSCALL2(mkdir, 34, char *, unsigned int);
 DEFN_SYSCALL2(shm_obtain, 35, char *, size_t *);
+DEFN_SYSCALL2(shm_resize, 64, char *, size_t *);
+DEFN_SYSCALL5(mmap, 65, int, unsigned int, unsigned int, int, int);
+DEFN_SYSCALL3(readv, 66, int, void *, int);
+DEFN_SYSCALL3(writev, 67, int, void *, int);
+DEFN_SYSCALL0(aio, 68);
+DEFN_SYSCALL0(watch, 69);
+DEFN_SYSCALL4(readdirstat, 70, int, int, int, void *);
+DEFN_SYSCALL1(fsync, 71, int);
+DEFN_SYSCALL3(splice, 72, int, int, int);
+DEFN_SYSCALL1(eventfd, 73, unsigned int);
+DEFN_SYSCALL0(timerfd, 74);
+DEFN_SYSCALL0(pollset, 75);
+DEFN_SYSCALL1(socket, 76, int);
+DEFN_SYSCALL3(connect, 77, int, uint32_t, int);
+DEFN_SYSCALL4(send, 78, int, const void *, size_t, int);
+DEFN_SYSCALL4(recv, 79, int, void *, size_t, int);
 DEFN_SYSCALL1(shm_release, 36, char *);
 DEFN_SYSCALL2(send_signal, 37, uint32_t, uint32_t);
 DEFN_SYSCALL2(signal, 38, uint32_t, void *);
@@ -302,8 +321,23 @@ caddr_t sbrk(int nbytes){
 }
 
 // --- Other ---
+
+/*
+ * Time queries read the kernel-maintained shared page instead of
+ * trapping; the kernel maps it in on the first access. The sequence
+ * counter is odd while the timer interrupt is mid-update, so retry
+ * until both reads of it agree on an even value.
+ */
+#include <timepage.h>
 int gettimeofday(struct timeval *p, void *z){
-	return syscall_gettimeofday(p,z);
+	volatile time_page_t * tp = (volatile time_page_t *)USER_TIME_PAGE;
+	uint32_t seq;
+	do {
+		seq = tp->seq;
+		p->tv_sec  = tp->boot_time + tp->ticks + tp->drift;
+		p->tv_usec = tp->subticks * 1000;
+	} while ((seq & 1) || seq != tp->seq);
+	return 0;
 }
 
 int pipe(int fildes[2]) {
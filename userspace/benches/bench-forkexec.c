@@ -0,0 +1,46 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ *
+ * bench-forkexec
+ *
+ * Process creation costs: fork+exit+wait, and fork+exec of a trivial
+ * binary (sysfunc with no arguments does nothing and exits).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "benches/bench.h"
+
+#define FORK_ITERS 300UL
+#define EXEC_ITERS 200UL
+
+int main(int argc, char * argv[]) {
+	bench_start();
+	for (unsigned long i = 0; i < FORK_ITERS; ++i) {
+		int pid = fork();
+		if (!pid) {
+			exit(0);
+		}
+		waitpid(pid, NULL, 0);
+	}
+	bench_report("fork_exit", FORK_ITERS, bench_elapsed_usec());
+
+	char * args[] = {"sysfunc", NULL};
+	bench_start();
+	for (unsigned long i = 0; i < EXEC_ITERS; ++i) {
+		int pid = fork();
+		if (!pid) {
+			execvp("sysfunc", args);
+			exit(42);
+		}
+		waitpid(pid, NULL, 0);
+	}
+	bench_report("fork_exec", EXEC_ITERS, bench_elapsed_usec());
+
+	return 0;
+}
@@ -0,0 +1,76 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ *
+ * bench-gfx
+ *
+ * Standalone graphics kernels over fixed inputs: per-pixel blending,
+ * sprite blits, and box blur, with no compositor involved. Inputs are
+ * deterministic so numbers compare across runs and releases.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "lib/graphics.h"
+
+#include "benches/bench.h"
+
+#define BLEND_ITERS  2000000UL
+#define SPRITE_ITERS 2000UL
+#define BLUR_ITERS   50UL
+
+/* Keep results observable so the loops cannot be optimized away */
+static volatile uint32_t sink;
+
+int main(int argc, char * argv[]) {
+	/* alpha_blend_rgba over a fixed set of pixel pairs */
+	uint32_t acc = 0;
+	bench_start();
+	for (unsigned long i = 0; i < BLEND_ITERS; ++i) {
+		uint32_t bottom = rgba(i & 0xFF, (i >> 8) & 0xFF, 0x7F, 0xFF);
+		uint32_t top    = rgba(0x40, i & 0xFF, 0xC0, (i * 7) & 0xFF);
+		acc += alpha_blend_rgba(bottom, top);
+	}
+	bench_report("gfx_alpha_blend_rgba", BLEND_ITERS, bench_elapsed_usec());
+	sink = acc;
+
+	/* draw_sprite of a translucent 256x256 sprite onto a 640x480 target */
+	sprite_t * target_back = create_sprite(640, 480, ALPHA_OPAQUE);
+	gfx_context_t * ctx = init_graphics_sprite(target_back);
+	draw_fill(ctx, rgb(20, 40, 60));
+
+	sprite_t * sprite = create_sprite(256, 256, ALPHA_EMBEDDED);
+	for (int y = 0; y < 256; ++y) {
+		for (int x = 0; x < 256; ++x) {
+			SPRITE(sprite, x, y) = rgba(x, y, (x ^ y) & 0xFF, 200);
+		}
+	}
+
+	bench_start();
+	for (unsigned long i = 0; i < SPRITE_ITERS; ++i) {
+		draw_sprite(ctx, sprite, (i * 13) % 384, (i * 7) % 224);
+	}
+	bench_report("gfx_draw_sprite", SPRITE_ITERS, bench_elapsed_usec());
+	sink = GFX(ctx, 320, 240);
+
+	/* blur_context_box, radius 8, over a 512x512 context */
+	sprite_t * blur_back = create_sprite(512, 512, ALPHA_OPAQUE);
+	gfx_context_t * blur_ctx = init_graphics_sprite(blur_back);
+	for (int y = 0; y < 512; ++y) {
+		for (int x = 0; x < 512; ++x) {
+			GFX(blur_ctx, x, y) = rgb(x & 0xFF, y & 0xFF, (x * y) & 0xFF);
+		}
+	}
+
+	bench_start();
+	for (unsigned long i = 0; i < BLUR_ITERS; ++i) {
+		blur_context_box(blur_ctx, 8);
+	}
+	bench_report("gfx_blur_context_box", BLUR_ITERS, bench_elapsed_usec());
+	sink = GFX(blur_ctx, 256, 256);
+
+	return 0;
+}
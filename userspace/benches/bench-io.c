@@ -0,0 +1,224 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ *
+ * bench-io
+ *
+ * Disk and filesystem I/O generator in the spirit of fio: sequential
+ * or random, read or write, with configurable block size and queue
+ * depth, against regular files or raw /dev/hd* nodes. Queue depths
+ * above one go through the kernel's aio fd. Can also replay a request
+ * stream captured from /dev/blktrace so production access patterns
+ * are repeatable when evaluating cache and elevator changes.
+ *
+ * bench-io [-w] [-R] [-b bytes] [-q depth] [-n mbytes] [-i ops]
+ *          [-p tracefile] target
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <syscall.h>
+#include <aio.h>
+#include <blktrace.h>
+
+#include "benches/bench.h"
+
+#define SECTOR_SIZE 512
+#define MAX_DEPTH   32
+
+static int      do_write   = 0;
+static int      do_random  = 0;
+static unsigned long block  = 4096;
+static int      depth      = 1;
+static unsigned long extent = 0;          /* Bytes; 0 = size of target */
+static unsigned long ops    = 0;          /* 0 = one pass over the extent */
+
+/* Fixed-seed LCG so "random" means the same offsets every run */
+static uint32_t rand_state = 0x12345678;
+static uint32_t next_rand(void) {
+	rand_state = rand_state * 1103515245 + 12345;
+	return rand_state >> 8;
+}
+
+static unsigned long pick_offset(unsigned long i) {
+	unsigned long blocks = extent / block;
+	if (!blocks) return 0;
+	if (do_random) {
+		return (next_rand() % blocks) * block;
+	}
+	return (i % blocks) * block;
+}
+
+static void run_sync(int fd, const char * name) {
+	uint8_t * buf = malloc(block);
+	memset(buf, 0xA5, block);
+
+	bench_start();
+	for (unsigned long i = 0; i < ops; ++i) {
+		lseek(fd, pick_offset(i), SEEK_SET);
+		if (do_write) {
+			write(fd, buf, block);
+		} else {
+			read(fd, buf, block);
+		}
+	}
+	bench_report(name, ops, bench_elapsed_usec());
+	free(buf);
+}
+
+static void run_queued(int fd, const char * name) {
+	int afd = syscall_aio();
+	if (afd < 0) {
+		fprintf(stderr, "bench-io: no aio support\n");
+		exit(1);
+	}
+
+	uint8_t * bufs[MAX_DEPTH];
+	aio_op_t batch[MAX_DEPTH];
+	aio_event_t events[MAX_DEPTH];
+	for (int i = 0; i < depth; ++i) {
+		bufs[i] = malloc(block);
+		memset(bufs[i], 0xA5, block);
+	}
+
+	unsigned long done = 0;
+	bench_start();
+	while (done < ops) {
+		int n = (ops - done < (unsigned long)depth) ? (int)(ops - done) : depth;
+		for (int i = 0; i < n; ++i) {
+			batch[i].fd     = fd;
+			batch[i].write  = do_write;
+			batch[i].offset = pick_offset(done + i);
+			batch[i].size   = block;
+			batch[i].buffer = bufs[i];
+		}
+		write(afd, batch, n * sizeof(aio_op_t));
+		int got = 0;
+		while (got < n) {
+			int r = read(afd, events, n * sizeof(aio_event_t));
+			if (r <= 0) break;
+			got += r / sizeof(aio_event_t);
+		}
+		done += n;
+	}
+	bench_report(name, ops, bench_elapsed_usec());
+
+	close(afd);
+	for (int i = 0; i < depth; ++i) {
+		free(bufs[i]);
+	}
+}
+
+/* Reissue a captured /dev/blktrace stream against the target, as fast
+ * as the device takes it. Writes are skipped unless -w is given - a
+ * replayed write lands on whatever the target holds now. */
+static void run_replay(int fd, const char * tracefile) {
+	FILE * f = fopen(tracefile, "r");
+	if (!f) {
+		fprintf(stderr, "bench-io: %s: could not open trace\n", tracefile);
+		exit(1);
+	}
+
+	unsigned long buf_size = 64 * 1024;
+	uint8_t * buf = malloc(buf_size);
+	blktrace_rec_t rec;
+	unsigned long replayed = 0;
+
+	bench_start();
+	while (fread(&rec, sizeof(blktrace_rec_t), 1, f) == 1) {
+		if (rec.write && !do_write) continue;
+		unsigned long size = (unsigned long)rec.count * SECTOR_SIZE;
+		if (size > buf_size) {
+			buf = realloc(buf, size);
+			buf_size = size;
+		}
+		lseek(fd, rec.lba * SECTOR_SIZE, SEEK_SET);
+		if (rec.write) {
+			write(fd, buf, size);
+		} else {
+			read(fd, buf, size);
+		}
+		replayed++;
+	}
+	if (replayed) {
+		bench_report("io_replay", replayed, bench_elapsed_usec());
+	} else {
+		fprintf(stderr, "bench-io: %s: no records to replay\n", tracefile);
+	}
+
+	free(buf);
+	fclose(f);
+}
+
+int main(int argc, char * argv[]) {
+	char * tracefile = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "wRb:q:n:i:p:")) != -1) {
+		switch (opt) {
+			case 'w': do_write = 1; break;
+			case 'R': do_random = 1; break;
+			case 'b': block = atoi(optarg); break;
+			case 'q': depth = atoi(optarg); break;
+			case 'n': extent = (unsigned long)atoi(optarg) * 1024 * 1024; break;
+			case 'i': ops = atoi(optarg); break;
+			case 'p': tracefile = optarg; break;
+			default:
+				fprintf(stderr, "usage: %s [-w] [-R] [-b bytes] [-q depth] [-n mbytes] [-i ops] [-p tracefile] target\n", argv[0]);
+				return 1;
+		}
+	}
+	if (optind >= argc || !block || depth < 1 || depth > MAX_DEPTH) {
+		fprintf(stderr, "usage: %s [-w] [-R] [-b bytes] [-q depth] [-n mbytes] [-i ops] [-p tracefile] target\n", argv[0]);
+		return 1;
+	}
+
+	int flags = do_write ? (O_RDWR | O_CREAT) : O_RDONLY;
+	int fd = open(argv[optind], flags, 0644);
+	if (fd < 0) {
+		fprintf(stderr, "%s: %s: could not open\n", argv[0], argv[optind]);
+		return 1;
+	}
+
+	if (tracefile) {
+		run_replay(fd, tracefile);
+		close(fd);
+		return 0;
+	}
+
+	if (!extent) {
+		struct stat st;
+		if (!fstat(fd, &st)) {
+			extent = st.st_size;
+		}
+	}
+	if (!extent) {
+		extent = 16 * 1024 * 1024; /* Fresh file for a write test */
+	}
+	if (extent < block) extent = block;
+	if (!ops) {
+		ops = extent / block;
+	}
+
+	char name[64];
+	snprintf(name, 64, "io_%s%s_b%lu_q%d",
+			do_random ? "rand" : "seq",
+			do_write ? "write" : "read",
+			block, depth);
+
+	if (depth > 1) {
+		run_queued(fd, name);
+	} else {
+		run_sync(fd, name);
+	}
+
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,51 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ *
+ * bench-pex
+ *
+ * Small-message echo through a packet exchange: client to server and
+ * back again per lap, both endpoints in this process so the lap
+ * measures the message path rather than the scheduler.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "lib/pex.h"
+
+#include "benches/bench.h"
+
+#define ITERS 5000UL
+
+int main(int argc, char * argv[]) {
+	FILE * server = pex_bind("bench");
+	FILE * client = pex_connect("bench");
+	if (!server || !client) {
+		fprintf(stderr, "%s: could not set up exchange\n", argv[0]);
+		return 1;
+	}
+
+	pex_packet_t * p = calloc(PACKET_SIZE, 1);
+	char * msg = "ping";
+
+	/* Learn the client's handle */
+	pex_reply(client, 5, msg);
+	pex_listen(server, p);
+	unsigned int client_id = p->source;
+
+	bench_start();
+	for (unsigned long i = 0; i < ITERS; ++i) {
+		pex_reply(client, 5, msg);
+		pex_listen(server, p);
+		pex_send(server, client_id, 5, msg);
+		pex_recv(client, (char *)p);
+	}
+	bench_report("pex_echo_rtt", ITERS, bench_elapsed_usec());
+
+	free(p);
+	return 0;
+}
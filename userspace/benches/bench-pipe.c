@@ -0,0 +1,57 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ *
+ * bench-pipe
+ *
+ * One-byte round trip between parent and child through a pair of
+ * pipes: two context switches and four pipe operations per lap.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "benches/bench.h"
+
+#define ITERS 20000UL
+
+int main(int argc, char * argv[]) {
+	int down[2], up[2];
+	if (pipe(down) || pipe(up)) {
+		fprintf(stderr, "%s: could not create pipes\n", argv[0]);
+		return 1;
+	}
+
+	int pid = fork();
+	if (!pid) {
+		char c;
+		while (read(down[0], &c, 1) == 1) {
+			if (c == 'q') break;
+			write(up[1], &c, 1);
+		}
+		exit(0);
+	}
+
+	char c = 'p';
+	/* Warm up */
+	for (int i = 0; i < 100; ++i) {
+		write(down[1], &c, 1);
+		read(up[0], &c, 1);
+	}
+
+	bench_start();
+	for (unsigned long i = 0; i < ITERS; ++i) {
+		write(down[1], &c, 1);
+		read(up[0], &c, 1);
+	}
+	bench_report("pipe_rtt", ITERS, bench_elapsed_usec());
+
+	c = 'q';
+	write(down[1], &c, 1);
+	waitpid(pid, NULL, 0);
+
+	return 0;
+}
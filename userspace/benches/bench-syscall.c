@@ -0,0 +1,31 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ *
+ * bench-syscall
+ *
+ * Null syscall cost: getpid in a tight loop, lmbench style.
+ */
+#include <unistd.h>
+#include <syscall.h>
+
+#include "benches/bench.h"
+
+#define ITERS 200000UL
+
+int main(int argc, char * argv[]) {
+	/* Warm up */
+	for (int i = 0; i < 1000; ++i) {
+		syscall_getpid();
+	}
+
+	bench_start();
+	for (unsigned long i = 0; i < ITERS; ++i) {
+		syscall_getpid();
+	}
+	bench_report("null_syscall", ITERS, bench_elapsed_usec());
+
+	return 0;
+}
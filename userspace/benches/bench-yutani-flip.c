@@ -0,0 +1,47 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ *
+ * bench-yutani-flip
+ *
+ * Flip-to-acknowledged latency: flip, then ask the server a question
+ * it always answers. The server handles messages in order, so the
+ * reply arriving means the flip ahead of it was processed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "lib/yutani.h"
+
+#include "benches/bench.h"
+
+#define ITERS 500UL
+
+int main(int argc, char * argv[]) {
+	yutani_t * y = yutani_init();
+	if (!y) {
+		fprintf(stderr, "%s: no compositor\n", argv[0]);
+		return 1;
+	}
+
+	yutani_window_t * w = yutani_window_create(y, 100, 100);
+
+	bench_start();
+	for (unsigned long i = 0; i < ITERS; ++i) {
+		yutani_flip(y, w);
+		yutani_query_windows(y);
+		/* The advertisement burst always ends with an empty record,
+		 * so there is at least one reply to wait for. */
+		yutani_msg_t * m = yutani_wait_for(y, YUTANI_MSG_WINDOW_ADVERTISE);
+		free(m);
+		while ((m = yutani_poll_async(y))) {
+			free(m);
+		}
+	}
+	bench_report("yutani_flip_sync", ITERS, bench_elapsed_usec());
+
+	yutani_close(y, w);
+	return 0;
+}
@@ -0,0 +1,181 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ *
+ * bench-yutani-scenes
+ *
+ * Synthetic compositor workloads over the real protocol: moving
+ * translucent windows, a full-screen scroller, and client-side blur.
+ * Wall time per frame comes from this side; compositing time per
+ * frame comes from the compositor's shared performance block, so a
+ * rendering change shows up in both numbers or gets caught lying.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+
+#include "lib/yutani.h"
+#include "lib/graphics.h"
+#include "gui/compositor/yutani_perf.h"
+
+#include "benches/bench.h"
+
+#define SCENE_WINDOWS   8
+#define WINDOW_FRAMES   300UL
+#define SCROLL_FRAMES   200UL
+#define BLUR_FRAMES     100UL
+
+static yutani_t * y = NULL;
+static yutani_perf_t * perf = NULL;
+
+static yutani_perf_t * obtain_perf_block(void) {
+	char * display = getenv("DISPLAY");
+	if (!display) return NULL;
+
+	char key[64];
+	YUTANI_PERF_KEY(display, key, 64);
+
+	size_t size = 0;
+	yutani_perf_t * p = (yutani_perf_t *)syscall_shm_obtain(key, &size);
+	if (!p || size < sizeof(yutani_perf_t) || p->magic != YUTANI_PERF_MAGIC) {
+		return NULL;
+	}
+	return p;
+}
+
+/* Wait until the server has handled everything sent so far: it
+ * answers queries in order, and the advertisement burst always ends
+ * with an empty record. */
+static void sync_server(void) {
+	yutani_query_windows(y);
+	yutani_msg_t * m = yutani_wait_for(y, YUTANI_MSG_WINDOW_ADVERTISE);
+	free(m);
+	while ((m = yutani_poll_async(y))) {
+		free(m);
+	}
+}
+
+static void report_scene(const char * name, uint32_t seq_before, unsigned long frames, unsigned long usec) {
+	bench_report(name, frames, usec);
+
+	if (!perf) return;
+	uint32_t count = perf->sequence - seq_before;
+	if (!count) return;
+	if (count > YUTANI_PERF_FRAMES) count = YUTANI_PERF_FRAMES;
+
+	uint64_t composite_usec = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		composite_usec += perf->frames[(perf->sequence - count + i) % YUTANI_PERF_FRAMES].frame_time;
+	}
+	char cname[64];
+	snprintf(cname, 64, "%s_composite", name);
+	bench_report(cname, count, (unsigned long)composite_usec);
+}
+
+static void scene_windows(void) {
+	yutani_window_t * wins[SCENE_WINDOWS];
+	gfx_context_t * ctxs[SCENE_WINDOWS];
+	int px[SCENE_WINDOWS], py[SCENE_WINDOWS], vx[SCENE_WINDOWS], vy[SCENE_WINDOWS];
+
+	for (int i = 0; i < SCENE_WINDOWS; ++i) {
+		wins[i] = yutani_window_create(y, 200, 200);
+		ctxs[i] = init_graphics_yutani(wins[i]);
+		draw_fill(ctxs[i], rgba(40 + i * 25, 80, 200 - i * 20, 180));
+		px[i] = (i * 97) % (y->display_width - 200);
+		py[i] = (i * 61) % (y->display_height - 200);
+		vx[i] = (i & 1) ? 7 : -7;
+		vy[i] = (i & 2) ? 5 : -5;
+		yutani_window_move(y, wins[i], px[i], py[i]);
+		yutani_flip(y, wins[i]);
+	}
+	sync_server();
+
+	uint32_t seq = perf ? perf->sequence : 0;
+	bench_start();
+	for (unsigned long f = 0; f < WINDOW_FRAMES; ++f) {
+		for (int i = 0; i < SCENE_WINDOWS; ++i) {
+			px[i] += vx[i];
+			py[i] += vy[i];
+			if (px[i] < 0 || px[i] > (int)y->display_width - 200)  { vx[i] = -vx[i]; px[i] += vx[i]; }
+			if (py[i] < 0 || py[i] > (int)y->display_height - 200) { vy[i] = -vy[i]; py[i] += vy[i]; }
+			yutani_window_move(y, wins[i], px[i], py[i]);
+		}
+		sync_server();
+	}
+	report_scene("scene_windows", seq, WINDOW_FRAMES, bench_elapsed_usec());
+
+	for (int i = 0; i < SCENE_WINDOWS; ++i) {
+		yutani_close(y, wins[i]);
+	}
+	sync_server();
+}
+
+static void scene_scroll(void) {
+	yutani_window_t * w = yutani_window_create(y, y->display_width, y->display_height);
+	gfx_context_t * ctx = init_graphics_yutani(w);
+	draw_fill(ctx, rgb(30, 30, 30));
+	yutani_window_move(y, w, 0, 0);
+
+	size_t row = GFX_W(ctx) * GFX_B(ctx);
+	uint32_t seq = perf ? perf->sequence : 0;
+	bench_start();
+	for (unsigned long f = 0; f < SCROLL_FRAMES; ++f) {
+		/* Scroll up four rows and paint a fresh strip at the bottom */
+		memmove(ctx->backbuffer, ctx->backbuffer + row * 4, row * (GFX_H(ctx) - 4));
+		for (int yy = GFX_H(ctx) - 4; yy < GFX_H(ctx); ++yy) {
+			for (int xx = 0; xx < GFX_W(ctx); ++xx) {
+				GFX(ctx, xx, yy) = rgb((f * 3) & 0xFF, xx & 0xFF, 0x40);
+			}
+		}
+		yutani_flip(y, w);
+		sync_server();
+	}
+	report_scene("scene_scroll", seq, SCROLL_FRAMES, bench_elapsed_usec());
+
+	yutani_close(y, w);
+	sync_server();
+}
+
+static void scene_blur(void) {
+	yutani_window_t * w = yutani_window_create(y, 400, 400);
+	gfx_context_t * ctx = init_graphics_yutani(w);
+
+	uint32_t seq = perf ? perf->sequence : 0;
+	bench_start();
+	for (unsigned long f = 0; f < BLUR_FRAMES; ++f) {
+		for (int yy = 0; yy < GFX_H(ctx); ++yy) {
+			for (int xx = 0; xx < GFX_W(ctx); ++xx) {
+				GFX(ctx, xx, yy) = rgb((xx + f * 5) & 0xFF, yy & 0xFF, (xx ^ yy) & 0xFF);
+			}
+		}
+		blur_context_box(ctx, 8);
+		yutani_flip(y, w);
+		sync_server();
+	}
+	report_scene("scene_blur", seq, BLUR_FRAMES, bench_elapsed_usec());
+
+	yutani_close(y, w);
+	sync_server();
+}
+
+int main(int argc, char * argv[]) {
+	y = yutani_init();
+	if (!y) {
+		fprintf(stderr, "%s: no compositor\n", argv[0]);
+		return 1;
+	}
+
+	perf = obtain_perf_block();
+	if (!perf) {
+		fprintf(stderr, "%s: no perf block; reporting wall time only\n", argv[0]);
+	}
+
+	scene_windows();
+	scene_scroll();
+	scene_blur();
+
+	return 0;
+}
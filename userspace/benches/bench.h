@@ -0,0 +1,39 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ *
+ * Shared helpers for the microbenchmarks (make benchmarks).
+ *
+ * Each result is one machine-readable line:
+ *   bench <name> <ns/op> ns/op <iters> iters <usec> usec
+ * so a harness can diff runs release to release with grep and awk.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <sys/time.h>
+
+static struct timeval _bench_start;
+
+static void bench_start(void) {
+	gettimeofday(&_bench_start, NULL);
+}
+
+static unsigned long bench_elapsed_usec(void) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - _bench_start.tv_sec) * 1000000UL
+	     + (now.tv_usec - _bench_start.tv_usec);
+}
+
+static void bench_report(const char * name, unsigned long iters, unsigned long usec) {
+	unsigned long long ns = (unsigned long long)usec * 1000ULL;
+	printf("bench %s %llu ns/op %lu iters %lu usec\n",
+	       name, ns / (iters ? iters : 1), iters, usec);
+	fflush(stdout);
+}
+
+#endif
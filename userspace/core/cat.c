@@ -11,20 +11,33 @@
  * things like that.
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #define CHUNK_SIZE 4096
+#define FILE_CHUNK_SIZE (1 << 20)
 
 void doit(int fd) {
+	/* Regular files get large block-aligned reads; pipes and
+	 * terminals keep the small chunk so output stays responsive. */
+	size_t chunk = CHUNK_SIZE;
+	struct stat _stat;
+	if (!fstat(fd, &_stat) && S_ISREG(_stat.st_mode)) {
+		chunk = FILE_CHUNK_SIZE;
+		if (_stat.st_blksize > 0 && chunk % _stat.st_blksize) {
+			chunk += _stat.st_blksize - chunk % _stat.st_blksize;
+		}
+	}
+	char * buf = malloc(chunk);
 	while (1) {
-		char buf[CHUNK_SIZE];
-		memset(buf, 0, CHUNK_SIZE);
-		ssize_t r = read(fd, buf, CHUNK_SIZE);
-		if (!r) return;
+		ssize_t r = read(fd, buf, chunk);
+		if (r <= 0) break;
 		write(STDOUT_FILENO, buf, r);
 	}
+	free(buf);
 }
 
 int main(int argc, char ** argv) {
@@ -10,19 +10,21 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
 
-#define CHUNK_SIZE 4096
+#define CHUNK_SIZE (1 << 20)
 
 int main(int argc, char ** argv) {
 
-	FILE * fd;
-	FILE * fout;
+	int fd;
+	int fout;
 	if (argc < 3) {
 		fprintf(stderr, "usage: %s [source] [destination]\n", argv[0]);
 		return 1;
 	}
-	fd = fopen(argv[1], "r");
-	if (!fd) {
+	fd = open(argv[1], O_RDONLY);
+	if (fd < 0) {
 		fprintf(stderr, "%s: %s: no such file or directory\n", argv[0], argv[1]);
 		return 1;
 	}
@@ -37,32 +39,43 @@ int main(int argc, char ** argv) {
 
 		char *target_path = malloc((strlen(argv[2]) + strlen(filename) + 2) * sizeof(char));
 		sprintf(target_path, "%s/%s", argv[2], filename );
-		fout = fopen( target_path, "w" );
+		fout = open( target_path, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
 
 		free(target_path);
 	} else {
-		fout = fopen( argv[2], "w" );
+		fout = open( argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+	}
+	if (fout < 0) {
+		fprintf(stderr, "%s: %s: could not open for writing\n", argv[0], argv[2]);
+		return 1;
 	}
 
-	size_t length;
-
-	fseek(fd, 0, SEEK_END);
-	length = ftell(fd);
-	fseek(fd, 0, SEEK_SET);
-
-	char buf[CHUNK_SIZE];
-	while (length > CHUNK_SIZE) {
-		fread( buf, 1, CHUNK_SIZE, fd);
-		fwrite(buf, 1, CHUNK_SIZE, fout);
-		length -= CHUNK_SIZE;
+	/* Move data in large chunks, rounded up to the source's block
+	 * size hint so each read is a whole number of device blocks. */
+	size_t chunk = CHUNK_SIZE;
+	fstat(fd, &statbuf);
+	if (statbuf.st_blksize > 0 && chunk % statbuf.st_blksize) {
+		chunk += statbuf.st_blksize - chunk % statbuf.st_blksize;
 	}
-	if (length > 0) {
-		fread( buf, 1, length, fd);
-		fwrite(buf, 1, length, fout);
+
+	char * buf = malloc(chunk);
+	ssize_t r;
+	while ((r = read(fd, buf, chunk)) > 0) {
+		char * p = buf;
+		while (r > 0) {
+			ssize_t w = write(fout, p, r);
+			if (w < 0) {
+				fprintf(stderr, "%s: %s: write failed\n", argv[0], argv[2]);
+				return 1;
+			}
+			p += w;
+			r -= w;
+		}
 	}
+	free(buf);
 
-	fclose(fd);
-	fclose(fout);
+	close(fd);
+	close(fout);
 
 	return 0;
 }
@@ -4,13 +4,43 @@
  */
 /*
  * Dump grep
+ *
+ * Scans large read chunks with Boyer-Moore-Horspool rather than
+ * splitting the input into lines first; line boundaries are only
+ * located around actual matches, so non-matching data is skipped
+ * at the full stride of the search.
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
 
-#define LINE_SIZE 4096
+#define CHUNK_SIZE (1 << 20)
+
+static size_t bmh_skip[256];
+
+static void bmh_init(unsigned char * needle, size_t len) {
+	for (int i = 0; i < 256; ++i) {
+		bmh_skip[i] = len;
+	}
+	for (size_t i = 0; i + 1 < len; ++i) {
+		bmh_skip[needle[i]] = len - 1 - i;
+	}
+}
+
+static char * bmh_search(char * hay, size_t hay_len, char * needle, size_t len) {
+	size_t i = 0;
+	while (i + len <= hay_len) {
+		size_t j = len - 1;
+		while (hay[i + j] == needle[j]) {
+			if (j == 0) return &hay[i];
+			j--;
+		}
+		i += bmh_skip[(unsigned char)hay[i + len - 1]];
+	}
+	return NULL;
+}
 
 int main(int argc, char ** argv) {
 	if (argc < 2) {
@@ -19,19 +49,75 @@ int main(int argc, char ** argv) {
 	}
 
 	char * needle = argv[1];
-	char buf[LINE_SIZE];
+	size_t needle_len = strlen(needle);
 	int ret = 1;
 
-	while (fgets(buf, LINE_SIZE, stdin)) {
-		char * found = strstr(buf, needle);
-		if (found) {
-			*found = '\0';
-			found += strlen(needle);
-			fprintf(stdout, "%s\033[1;31m%s\033[0m%s", buf, needle, found);
+	if (!needle_len) {
+		return 1;
+	}
+
+	bmh_init((unsigned char *)needle, needle_len);
+
+	size_t buf_size = CHUNK_SIZE;
+	char * buf = malloc(buf_size);
+	size_t held = 0;
+	int eof = 0;
+
+	while (!eof) {
+		ssize_t r = read(STDIN_FILENO, buf + held, buf_size - held);
+		if (r <= 0) {
+			eof = 1;
+			r = 0;
+		}
+		size_t have = held + (size_t)r;
+
+		/* Only scan whole lines; the partial tail carries over so a
+		 * match can not be split across two reads. */
+		size_t scan = have;
+		if (!eof) {
+			while (scan > 0 && buf[scan - 1] != '\n') scan--;
+			if (scan == 0) {
+				/* A single line bigger than the buffer; grow it */
+				if (have == buf_size) {
+					buf_size *= 2;
+					buf = realloc(buf, buf_size);
+				}
+				held = have;
+				continue;
+			}
+		}
+
+		char * p = buf;
+		size_t remaining = scan;
+		while (remaining >= needle_len) {
+			char * found = bmh_search(p, remaining, needle, needle_len);
+			if (!found) break;
+
+			/* Walk out to the enclosing line */
+			char * line = found;
+			while (line > buf && line[-1] != '\n') line--;
+			char * rest = found + needle_len;
+			char * end = memchr(rest, '\n', (buf + scan) - rest);
+			end = end ? end + 1 : buf + scan;
+
+			fwrite(line, 1, found - line, stdout);
+			fwrite("\033[1;31m", 1, 7, stdout);
+			fwrite(needle, 1, needle_len, stdout);
+			fwrite("\033[0m", 1, 4, stdout);
+			fwrite(rest, 1, end - rest, stdout);
 			ret = 0;
+
+			p = end;
+			remaining = (buf + scan) - end;
+		}
+
+		held = have - scan;
+		if (held) {
+			memmove(buf, buf + scan, held);
 		}
 	}
 
+	free(buf);
 	return ret;
 }
 
@@ -16,11 +16,173 @@
 #include <string.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <dirent.h>
 #include <syscall.h>
+#include <sys/time.h>
 #include <sys/wait.h>
 
 #define DEFAULT_HOSTNAME "toaru-test"
 
+#define STARTUP_DIR "/etc/startup.d"
+#define MAX_JOBS  32
+#define MAX_NEEDS 8
+
+/*
+ * Startup jobs. Each file in /etc/startup.d is one job: `needs x`
+ * lines name other jobs (by file name) that must finish first, and
+ * the first other non-comment line is the command to run. Everything
+ * whose needs are met runs at once; we reap with waitpid on
+ * any-child and launch more as dependencies complete, so one slow
+ * job (a network script blocked on DHCP, say) only holds up the jobs
+ * that actually asked to wait for it.
+ */
+typedef struct {
+	char name[64];
+	char * needs[MAX_NEEDS];
+	int n_needs;
+	char * command;
+	pid_t pid;
+	int state; /* 0 = waiting, 1 = running, 2 = done */
+	struct timeval started;
+} startup_job_t;
+
+static startup_job_t jobs[MAX_JOBS];
+static int n_jobs = 0;
+
+static startup_job_t * job_by_name(const char * name) {
+	for (int i = 0; i < n_jobs; ++i) {
+		if (!strcmp(jobs[i].name, name)) return &jobs[i];
+	}
+	return NULL;
+}
+
+static int job_ready(startup_job_t * job) {
+	for (int i = 0; i < job->n_needs; ++i) {
+		startup_job_t * dep = job_by_name(job->needs[i]);
+		/* A need nothing provides is treated as met */
+		if (dep && dep->state != 2) return 0;
+	}
+	return 1;
+}
+
+/* Drop a named milestone into the kernel's boot timeline (sysfunc 16,
+ * root only); shows up in /proc/boottime alongside the kmain stages. */
+static void boot_mark(const char * fmt, const char * arg) {
+	char mark[48];
+	snprintf(mark, 48, fmt, arg);
+	syscall_system_function(16, (char **)mark);
+}
+
+static void job_finish(startup_job_t * job) {
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	int msec = (now.tv_sec - job->started.tv_sec) * 1000 +
+	           (now.tv_usec - job->started.tv_usec) / 1000;
+	fprintf(stderr, "init: %s finished in %d.%03ds\n", job->name, msec / 1000, msec % 1000);
+	boot_mark("init: %s", job->name);
+	job->state = 2;
+}
+
+static void job_start(startup_job_t * job) {
+	job->state = 1;
+	gettimeofday(&job->started, NULL);
+	job->pid = fork();
+	if (!job->pid) {
+		char * args[32];
+		int i = 0;
+		char * save = NULL;
+		char * tok = strtok_r(job->command, " ", &save);
+		while (tok && i < 31) {
+			args[i++] = tok;
+			tok = strtok_r(NULL, " ", &save);
+		}
+		args[i] = NULL;
+		execvp(args[0], args);
+		exit(127);
+	}
+}
+
+static void load_job(const char * name) {
+	if (n_jobs >= MAX_JOBS) return;
+
+	char path[256];
+	snprintf(path, 256, "%s/%s", STARTUP_DIR, name);
+	FILE * f = fopen(path, "r");
+	if (!f) return;
+
+	startup_job_t * job = &jobs[n_jobs];
+	memset(job, 0, sizeof(startup_job_t));
+	strncpy(job->name, name, 63);
+
+	char line[256];
+	while (fgets(line, 256, f)) {
+		if (line[strlen(line)-1] == '\n') {
+			line[strlen(line)-1] = '\0';
+		}
+		if (!line[0] || line[0] == '#') continue;
+		if (!strncmp(line, "needs ", 6)) {
+			if (job->n_needs < MAX_NEEDS) {
+				job->needs[job->n_needs++] = strdup(line + 6);
+			}
+		} else if (!job->command) {
+			job->command = strdup(line);
+		}
+	}
+	fclose(f);
+
+	/* A file with no command (a README, say) isn't a job */
+	if (job->command) n_jobs++;
+}
+
+static void run_startup_jobs(void) {
+	DIR * dirp = opendir(STARTUP_DIR);
+	if (!dirp) return;
+
+	struct dirent * ent;
+	while ((ent = readdir(dirp))) {
+		if (ent->d_name[0] == '.') continue;
+		load_job(ent->d_name);
+	}
+	closedir(dirp);
+
+	int done = 0;
+	int running = 0;
+	while (done < n_jobs) {
+		for (int i = 0; i < n_jobs; ++i) {
+			if (jobs[i].state == 0 && job_ready(&jobs[i])) {
+				job_start(&jobs[i]);
+				running++;
+			}
+		}
+		if (!running) {
+			/* Nothing runnable and nothing running: the annotations
+			 * form a cycle. Break it at the first waiter. */
+			for (int i = 0; i < n_jobs; ++i) {
+				if (jobs[i].state == 0) {
+					fprintf(stderr, "init: dependency cycle in %s; starting %s anyway\n", STARTUP_DIR, jobs[i].name);
+					job_start(&jobs[i]);
+					running++;
+					break;
+				}
+			}
+			if (!running) break;
+		}
+		pid_t pid = waitpid(-1, NULL, 0);
+		if (pid < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		for (int i = 0; i < n_jobs; ++i) {
+			if (jobs[i].state == 1 && jobs[i].pid == pid) {
+				job_finish(&jobs[i]);
+				running--;
+				done++;
+				break;
+			}
+		}
+	}
+}
+
 void set_console() {
 	int _stdin  = open("/dev/null", O_RDONLY);
 	int _stdout = open("/dev/ttyS0", O_WRONLY);
@@ -68,6 +230,8 @@ int main(int argc, char * argv[]) {
 	set_console();
 	/* Hostname */
 	set_hostname();
+	/* Boot jobs, as parallel as their annotations allow */
+	run_startup_jobs();
 	if (argc > 1) {
 		char * args = NULL;
 		if (argc > 2) {
@@ -61,6 +61,9 @@ struct tfile {
 	struct stat statbuf;
 	char * link;
 	struct stat statbufl;
+	/* Sort and layout keys, computed once at collection time */
+	size_t name_len;
+	int    is_dir;
 };
 
 static const char * color_str(struct stat * sb) {
@@ -89,8 +92,8 @@ static int filecmp(const void * c1, const void * c2) {
 	const struct tfile * d1 = *(const struct tfile **)c1;
 	const struct tfile * d2 = *(const struct tfile **)c2;
 
-	int a = S_ISDIR(d1->statbuf.st_mode);
-	int b = S_ISDIR(d2->statbuf.st_mode);
+	int a = d1->is_dir;
+	int b = d2->is_dir;
 
 	if (a == b) return strcmp(d1->name, d2->name);
 	else if (a < b) return -1;
@@ -115,13 +118,25 @@ static void print_entry(struct tfile * file, int colwidth) {
 	}
 
 	/* Pad the rest of the column */
-	for (int rem = colwidth - strlen(file->name); rem > 0; rem--) {
+	for (int rem = colwidth - file->name_len; rem > 0; rem--) {
 		printf(" ");
 	}
 }
 
+/* getpwuid re-reads the passwd file every time, and long mode asks
+ * for the same handful of ids over and over; remember what we saw. */
+#define UID_CACHE_SIZE 16
+static struct { int uid; char name[64]; } uid_cache[UID_CACHE_SIZE];
+static int uid_cache_len = 0;
+
 static int print_username(char * _out, int uid) {
 
+	for (int i = 0; i < uid_cache_len; ++i) {
+		if (uid_cache[i].uid == uid) {
+			return sprintf(_out, "%s", uid_cache[i].name);
+		}
+	}
+
 	struct passwd * p = getpwuid(uid);
 	int out = 0;
 
@@ -133,6 +148,12 @@ static int print_username(char * _out, int uid) {
 
 	endpwent();
 
+	if (uid_cache_len < UID_CACHE_SIZE && strlen(_out) < 64) {
+		uid_cache[uid_cache_len].uid = uid;
+		strcpy(uid_cache[uid_cache_len].name, _out);
+		uid_cache_len++;
+	}
+
 	return out;
 }
 
@@ -250,7 +271,7 @@ static void show_usage(int argc, char * argv[]) {
 			"\n", argv[0]);
 }
 
-static void display_tfiles(struct tfile ** ents_array, int numents) {
+static void display_tfiles(struct tfile ** ents_array, int numents, int ent_max_len) {
 	if (long_mode) {
 		int widths[4] = {0,0,0,0};
 		for (int i = 0; i < numents; i++) {
@@ -260,12 +281,8 @@ static void display_tfiles(struct tfile ** ents_array, int numents) {
 			print_entry_long(widths, ents_array[i]);
 		}
 	} else {
-		/* Determine the gridding dimensions */
-		int ent_max_len = 0;
-		for (int i = 0; i < numents; i++) {
-			ent_max_len = MAX(ent_max_len, strlen(ents_array[i]->name));
-		}
-
+		/* Gridding dimensions come from the longest name, which the
+		 * caller already knows from the collection pass */
 		int col_ext = ent_max_len + MIN_COL_SPACING;
 		int cols = ((term_width - ent_max_len) / col_ext) + 1;
 
@@ -286,10 +303,12 @@ static void display_tfiles(struct tfile ** ents_array, int numents) {
 	}
 }
 
+#define READDIR_BATCH 64
+
 static int display_dir(char * p) {
 	/* Open the directory */
-	DIR * dirp = opendir(p);
-	if (dirp == NULL) {
+	int fd = open(p, O_RDONLY);
+	if (fd < 0) {
 		return 2;
 	}
 
@@ -297,30 +316,42 @@ static int display_dir(char * p) {
 		printf("%s:\n", p);
 	}
 
-	/* Read the entries in the directory */
+	/* Read the entries in the directory, a batch of stat'd
+	 * records at a time rather than a path resolution per file */
 	list_t * ents_list = list_create();
 
-	struct dirent * ent = readdir(dirp);
-	while (ent != NULL) {
-		if (show_hidden || (ent->d_name[0] != '.')) {
-			struct tfile * f = malloc(sizeof(struct tfile));
-
-			f->name = strdup(ent->d_name);
-
-			char tmp[strlen(p)+strlen(ent->d_name)+1];
-			sprintf(tmp, "%s/%s", p, ent->d_name);
-			int t = lstat(tmp, &f->statbuf);
-			if (S_ISLNK(f->statbuf.st_mode)) {
-				stat(tmp, &f->statbufl);
-				f->link = malloc(4096);
-				readlink(tmp, f->link, 4096);
+	struct dirent_stat * batch = malloc(sizeof(struct dirent_stat) * READDIR_BATCH);
+	int offset = 0;
+	int ent_max_len = 0;
+	while (1) {
+		int count = syscall_readdirstat(fd, offset, READDIR_BATCH, batch);
+		if (count <= 0) break;
+		for (int i = 0; i < count; ++i) {
+			if (show_hidden || (batch[i].d.d_name[0] != '.')) {
+				struct tfile * f = malloc(sizeof(struct tfile));
+
+				f->name = strdup(batch[i].d.d_name);
+				memcpy(&f->statbuf, &batch[i].st, sizeof(struct stat));
+				f->name_len = strlen(f->name);
+				f->is_dir = S_ISDIR(f->statbuf.st_mode);
+				ent_max_len = MAX(ent_max_len, (int)f->name_len);
+
+				if (S_ISLNK(f->statbuf.st_mode)) {
+					char tmp[strlen(p)+strlen(f->name)+2];
+					sprintf(tmp, "%s/%s", p, f->name);
+					stat(tmp, &f->statbufl);
+					f->link = malloc(4096);
+					readlink(tmp, f->link, 4096);
+				}
+
+				list_insert(ents_list, (void *)f);
 			}
-
-			list_insert(ents_list, (void *)f);
 		}
-		ent = readdir(dirp);
+		offset += count;
+		if (count < READDIR_BATCH) break;
 	}
-	closedir(dirp);
+	free(batch);
+	close(fd);
 
 	/* Now, copy those entries into an array (for sorting) */
 
@@ -334,7 +365,7 @@ static int display_dir(char * p) {
 
 	qsort(file_arr, index, sizeof(struct tfile *), filecmp_notypesort);
 
-	display_tfiles(file_arr, index);
+	display_tfiles(file_arr, index, ent_max_len);
 
 	free(file_arr);
 
@@ -397,6 +428,7 @@ int main (int argc, char * argv[]) {
 		display_dir(p);
 	} else {
 		list_t * files = list_create();
+		int ent_max_len = 0;
 		while (p) {
 			struct tfile * f = malloc(sizeof(struct tfile));
 
@@ -408,6 +440,9 @@ int main (int argc, char * argv[]) {
 				free(f);
 				out = 2;
 			} else {
+				f->name_len = strlen(f->name);
+				f->is_dir = S_ISDIR(f->statbuf.st_mode);
+				ent_max_len = MAX(ent_max_len, (int)f->name_len);
 				list_insert(files, f);
 			}
 
@@ -429,14 +464,14 @@ int main (int argc, char * argv[]) {
 		int first_directory = index;
 
 		for (int i = 0; i < index; ++i) {
-			if (S_ISDIR(file_arr[i]->statbuf.st_mode)) {
+			if (file_arr[i]->is_dir) {
 				first_directory = i;
 				break;
 			}
 		}
 
 		if (first_directory) {
-			display_tfiles(file_arr, first_directory);
+			display_tfiles(file_arr, first_directory, ent_max_len);
 		}
 
 		for (int i = first_directory; i < index; ++i) {
@@ -17,13 +17,9 @@
 #include <string.h>
 #include <syscall.h>
 #include <unistd.h>
-#include <dirent.h>
+#include <procfs.h>
 #include <pwd.h>
 
-#include "lib/list.h"
-
-#define LINE_LEN 4096
-
 static int show_all = 0;
 
 void print_username(int uid) {
@@ -38,63 +34,25 @@ void print_username(int uid) {
 	endpwent();
 }
 
-void print_entry(struct dirent * dent) {
-	char tmp[256], buf[4096];
-	FILE * f;
-	int read = 1;
-	char line[LINE_LEN];
-
-	int pid, uid, tgid;
-	char name[100];
-
-	snprintf(tmp, 256, "/proc/%s/status", dent->d_name);
-	f = fopen(tmp, "r");
-
-	while (fgets(line, LINE_LEN, f) != NULL) {
-		if (strstr(line, "Pid:") == line) {
-			sscanf(line, "%s %d", &buf, &pid);
-		} else if (strstr(line, "Uid:") == line) {
-			sscanf(line, "%s %d", &buf, &uid);
-		} else if (strstr(line, "Tgid:") == line) {
-			sscanf(line, "%s %d", &buf, &tgid);
-		} else if (strstr(line, "Name:") == line) {
-			sscanf(line, "%s %s", &buf, &name);
-		}
-	}
-
-	fclose(f);
-
-	if ((tgid != pid) && !show_all) {
+void print_entry(struct proc_info * r) {
+	if ((r->tgid != r->pid) && !show_all) {
 		/* Skip threads */
 		return;
 	}
 
-	print_username(uid);
+	print_username(r->uid);
 	if (show_all) {
-		printf("%5d.%-5d", tgid, pid);
+		printf("%5d.%-5d", r->tgid, r->pid);
 	} else {
-		printf(" %5d", pid);
+		printf(" %5d", r->pid);
 	}
 
 	printf(" ");
 
-	snprintf(tmp, 256, "/proc/%s/cmdline", dent->d_name);
-	f = fopen(tmp, "r");
-	memset(buf, 0x00, 4096);
-	read = fread(buf, 1, 4096, f);
-	fclose(f);
-
-	buf[read] = '\0';
-	for (int i = 0; i < read; ++i) {
-		if (buf[i] == '\036') {
-			buf[i] = ' ';
-		}
-	}
-
-	if (tgid != pid) {
-		printf("{%s}\n", buf);
+	if (r->tgid != r->pid) {
+		printf("{%s}\n", r->cmdline);
 	} else {
-		printf("%s\n", buf);
+		printf("%s\n", r->cmdline);
 	}
 }
 
@@ -127,28 +85,34 @@ int main (int argc, char * argv[]) {
 		}
 	}
 
-	/* Open the directory */
-	DIR * dirp = opendir("/proc");
-
-	/* Read the entries in the directory */
-	list_t * ents_list = list_create();
+	/* One read of the bulk node returns the whole process table */
+	int fd = open("/proc/processes", O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: no /proc/processes\n", argv[0]);
+		return 1;
+	}
 
-	struct dirent * ent = readdir(dirp);
-	while (ent != NULL) {
-		if (ent->d_name[0] >= '0' && ent->d_name[0] <= '9') {
-			struct dirent * entcpy = malloc(sizeof(struct dirent));
-			memcpy(entcpy, ent, sizeof(struct dirent));
-			list_insert(ents_list, (void *)entcpy);
+	size_t cap = 32 * sizeof(struct proc_info);
+	size_t len = 0;
+	char * buf = malloc(cap);
+	ssize_t r;
+	while ((r = read(fd, buf + len, cap - len)) > 0) {
+		len += r;
+		if (len == cap) {
+			cap *= 2;
+			buf = realloc(buf, cap);
 		}
-
-		ent = readdir(dirp);
 	}
-	closedir(dirp);
+	close(fd);
+
+	struct proc_info * records = (struct proc_info *)buf;
+	int count = len / sizeof(struct proc_info);
 
-	foreach(entry, ents_list) {
-		print_entry(entry->value);
+	for (int i = 0; i < count; ++i) {
+		print_entry(&records[i]);
 	}
 
+	free(buf);
 
 	return 0;
 }
@@ -17,7 +17,7 @@
 #include <string.h>
 #include <syscall.h>
 #include <unistd.h>
-#include <dirent.h>
+#include <procfs.h>
 
 #include "lib/list.h"
 #include "lib/tree.h"
@@ -29,41 +29,19 @@ typedef struct process {
 	char name[100];
 } p_t;
 
-#define LINE_LEN 4096
-
-p_t * build_entry(struct dirent * dent) {
-	char tmp[256], buf[4096];
-	FILE * f;
-	int read = 1;
-	char line[LINE_LEN];
-
-	int pid, uid;
-
-	snprintf(tmp, 256, "/proc/%s/status", dent->d_name);
-	f = fopen(tmp, "r");
-
+p_t * build_entry(struct proc_info * r) {
 	p_t * proc = malloc(sizeof(p_t));
 
-	while (fgets(line, LINE_LEN, f) != NULL) {
-		if (strstr(line, "Pid:") == line) {
-			sscanf(line, "%s %d", &buf, &proc->pid);
-		} else if (strstr(line, "PPid:") == line) {
-			sscanf(line, "%s %d", &buf, &proc->ppid);
-		} else if (strstr(line, "Tgid:") == line) {
-			sscanf(line, "%s %d", &buf, &proc->tgid);
-		} else if (strstr(line, "Name:") == line) {
-			sscanf(line, "%s %s", &buf, &proc->name);
-		}
-	}
+	proc->pid  = r->pid;
+	proc->ppid = r->ppid;
+	proc->tgid = r->tgid;
 
 	if (proc->tgid != proc->pid) {
-		char tmp[100] = {0};
-		sprintf(tmp, "{%s}", proc->name);
-		memcpy(proc->name, tmp, strlen(tmp)+1);
+		sprintf(proc->name, "{%s}", r->name);
+	} else {
+		sprintf(proc->name, "%s", r->name);
 	}
 
-	fclose(f);
-
 	return proc;
 }
 
@@ -109,15 +87,16 @@ void print_process_tree_node(tree_node_t * node, size_t depth, int indented, int
 
 	printf(proc->name);
 
-	if (!node->children->length) {
+	size_t n_children = tree_node_child_count(node);
+	if (!n_children) {
 		printf("\n");
 	} else {
 		depth += strlen(proc->name);
 
 		int t = 0;
-		foreach(child, node->children) {
+		foreach_child(child, node) {
 			/* Recursively print the children */
-			print_process_tree_node(child->value, depth, !!(t++), ((t+1)!=node->children->length), lines);
+			print_process_tree_node(child, depth, !!(t++), ((t+1)!=n_children), lines);
 		}
 	}
 
@@ -128,29 +107,45 @@ void print_process_tree_node(tree_node_t * node, size_t depth, int indented, int
 
 int main (int argc, char * argv[]) {
 
-	/* Open the directory */
-	DIR * dirp = opendir("/proc");
+	/* One read of the bulk node returns the whole process table */
+	int fd = open("/proc/processes", O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s: no /proc/processes\n", argv[0]);
+		return 1;
+	}
+
+	size_t cap = 32 * sizeof(struct proc_info);
+	size_t len = 0;
+	char * buf = malloc(cap);
+	ssize_t r;
+	while ((r = read(fd, buf + len, cap - len)) > 0) {
+		len += r;
+		if (len == cap) {
+			cap *= 2;
+			buf = realloc(buf, cap);
+		}
+	}
+	close(fd);
+
+	struct proc_info * records = (struct proc_info *)buf;
+	int count = len / sizeof(struct proc_info);
 
-	/* Read the entries in the directory */
 	tree_t * procs = tree_create();
 
-	struct dirent * ent = readdir(dirp);
-	while (ent != NULL) {
-		if (ent->d_name[0] >= '0' && ent->d_name[0] <= '9') {
-			p_t * proc = build_entry(ent);
+	for (int i = 0; i < count; ++i) {
+		p_t * proc = build_entry(&records[i]);
 
-			if (proc->ppid == 0 && proc->pid == 1) {
-				tree_set_root(procs, proc);
-			} else {
-				tree_node_t * parent = tree_find(procs,(void *)proc->ppid,find_pid);
-				if (parent) {
-					tree_node_insert_child(procs, parent, proc);
-				}
+		if (proc->ppid == 0 && proc->pid == 1) {
+			tree_set_root(procs, proc);
+		} else {
+			tree_node_t * parent = tree_find(procs,(void *)proc->ppid,find_pid);
+			if (parent) {
+				tree_node_insert_child(procs, parent, proc);
 			}
 		}
-		ent = readdir(dirp);
 	}
-	closedir(dirp);
+
+	free(buf);
 
 	char lines[500] = {0};
 	print_process_tree_node(procs->root, 0, 0, 0, lines);
@@ -25,6 +25,7 @@
 #include <getopt.h>
 #include <termios.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include <sys/time.h>
 #include <sys/wait.h>
@@ -32,6 +33,7 @@
 #include <sys/stat.h>
 
 #include "lib/list.h"
+#include "lib/hashmap.h"
 #include "lib/kbd.h"
 #include "lib/rline.h"
 
@@ -74,6 +76,15 @@ shell_command_t shell_find(char * str) {
 	return NULL;
 }
 
+int shell_has_command(char * str) {
+	for (uint32_t i = 0; i < shell_commands_len; ++i) {
+		if (!strcmp(str, shell_commands[i])) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
 void install_commands();
 
 /* Maximum command length */
@@ -364,8 +375,75 @@ int variable_char(uint8_t c) {
 	return 0;
 }
 
+/*
+ * Command location cache. execvp probes every $PATH directory with a
+ * separate exec attempt for each command, so scripts pay several failed
+ * path walks per line. We scan $PATH once into a name -> full path
+ * hashmap and exec the cached location directly; `rehash` throws the
+ * cache away if the contents of $PATH have changed.
+ */
+hashmap_t * path_cache = NULL;
+
+void path_cache_scan(char * dir) {
+	DIR * dirp = opendir(dir);
+	if (!dirp) return;
+
+	struct dirent * ent = readdir(dirp);
+	while (ent != NULL) {
+		if (ent->d_name[0] != '.' && !hashmap_has(path_cache, ent->d_name)) {
+			char * s = malloc(strlen(dir) + 1 + strlen(ent->d_name) + 1);
+			sprintf(s, "%s/%s", dir, ent->d_name);
+			hashmap_set(path_cache, ent->d_name, s);
+		}
+		ent = readdir(dirp);
+	}
+	closedir(dirp);
+}
+
+void path_cache_build(void) {
+	path_cache = hashmap_create(100);
+
+	char * path = getenv("PATH");
+	if (!path) path = "/bin:/usr/bin";
+
+	/* Earlier directories win, as they would for execvp */
+	char * tmp = strdup(path);
+	char * save;
+	char * p = strtok_r(tmp, ":", &save);
+	while (p) {
+		path_cache_scan(p);
+		p = strtok_r(NULL, ":", &save);
+	}
+	free(tmp);
+}
+
+void path_cache_flush(void) {
+	if (!path_cache) return;
+	list_t * values = hashmap_values(path_cache);
+	foreach(node, values) {
+		free(node->value);
+	}
+	list_free(values);
+	free(values);
+	hashmap_free(path_cache);
+	free(path_cache);
+	path_cache = NULL;
+}
+
+char * path_cache_lookup(char * name) {
+	if (strchr(name, '/')) return NULL;
+	if (!path_cache) path_cache_build();
+	return hashmap_get(path_cache, name);
+}
+
 void run_cmd(char ** args) {
-	int i = execvp(*args, args);
+	int i = -1;
+	char * location = path_cache_lookup(*args);
+	if (location) {
+		i = execv(location, args);
+	}
+	/* Cache miss (or stale entry): let execvp walk $PATH itself */
+	i = execvp(*args, args);
 	shell_command_t func = shell_find(*args);
 	if (func) {
 		int argc = 0;
@@ -749,7 +827,8 @@ void add_path_contents(char * path) {
 
 	struct dirent * ent = readdir(dirp);
 	while (ent != NULL) {
-		if (ent->d_name[0] != '.') {
+		/* Skip anything shadowed by a builtin of the same name */
+		if (ent->d_name[0] != '.' && !shell_has_command(ent->d_name)) {
 			char * s = malloc(sizeof(char) * (strlen(ent->d_name) + 1));
 			memcpy(s, ent->d_name, strlen(ent->d_name) + 1);
 			shell_install_command(s, NULL, NULL);
@@ -967,6 +1046,219 @@ uint32_t shell_cmd_set(int argc, char * argv[]) {
 	return 1;
 }
 
+/*
+ * Fork and wait on an external command from inside a builtin,
+ * with the same process group handling as shell_exec.
+ */
+uint32_t shell_run_external(int argc, char * argv[]) {
+	unsigned int child_pid = fork();
+	if (!child_pid) {
+		run_cmd(argv);
+	}
+	tcsetpgrp(STDIN_FILENO, child_pid);
+	child = child_pid;
+	int ret_code = 0;
+	int pid;
+	do {
+		pid = waitpid(-1, &ret_code, 0);
+	} while (pid != -1 || (pid == -1 && errno != ECHILD));
+	child = 0;
+	tcsetpgrp(STDIN_FILENO, getpid());
+	return ret_code;
+}
+
+/*
+ * echo [-n] [-e] [STRING]...
+ *
+ * Builtin so scripts that echo in a loop don't fork for every line.
+ */
+uint32_t shell_cmd_echo(int argc, char * argv[]) {
+	int start           = 1;
+	int use_newline     = 1;
+	int process_escapes = 0;
+
+	for (int i = 1; i < argc; ++i) {
+		if (argv[i][0] != '-') {
+			start = i;
+			break;
+		}
+		if (argv[i][1] == 'n') {
+			use_newline = 0;
+		} else if (argv[i][1] == 'e') {
+			process_escapes = 1;
+		}
+		start = i + 1;
+	}
+
+	for (int i = start; i < argc; ++i) {
+		if (process_escapes) {
+			for (char * c = argv[i]; *c; ++c) {
+				if (*c == '\\' && c[1] == 'e') {
+					putchar('\033');
+					c++;
+				} else if (*c == '\\' && c[1] == 'n') {
+					putchar('\n');
+					c++;
+				} else {
+					putchar(*c);
+				}
+			}
+		} else {
+			printf("%s", argv[i]);
+		}
+		if (i != argc - 1) {
+			printf(" ");
+		}
+	}
+	if (use_newline) {
+		printf("\n");
+	}
+	fflush(stdout);
+	return 0;
+}
+
+/*
+ * cat [file]...
+ *
+ * Files are read in-process; with no arguments we still hand off
+ * to the real cat, as reading the terminal wants its own process.
+ */
+uint32_t shell_cmd_cat(int argc, char * argv[]) {
+	if (argc == 1) {
+		return shell_run_external(argc, argv);
+	}
+
+	uint32_t ret = 0;
+	fflush(stdout);
+	for (int i = 1; i < argc; ++i) {
+		int fd = open(argv[i], O_RDONLY);
+		if (fd == -1) {
+			fprintf(stderr, "%s: %s: no such file or directory\n", argv[0], argv[i]);
+			ret = 1;
+			continue;
+		}
+
+		struct stat _stat;
+		fstat(fd, &_stat);
+
+		if (S_ISDIR(_stat.st_mode)) {
+			fprintf(stderr, "%s: %s: Is a directory\n", argv[0], argv[i]);
+			close(fd);
+			ret = 1;
+			continue;
+		}
+
+		char buf[4096];
+		ssize_t r;
+		while ((r = read(fd, buf, 4096)) > 0) {
+			write(STDOUT_FILENO, buf, r);
+		}
+
+		close(fd);
+	}
+
+	return ret;
+}
+
+/*
+ * test / [
+ *
+ * Evaluates a (small subset of the usual) expression language.
+ * Returns 0 for true, 1 for false, 2 on error.
+ */
+uint32_t shell_cmd_test(int argc, char * argv[]) {
+	if (!strcmp(argv[0], "[")) {
+		if (argc == 1 || strcmp(argv[argc-1], "]")) {
+			fprintf(stderr, "%s: missing ']'\n", argv[0]);
+			return 2;
+		}
+		argc--;
+	}
+
+	if (argc == 1) return 1;
+	if (argc == 2) return strlen(argv[1]) ? 0 : 1;
+
+	if (argc == 3) {
+		struct stat statbuf;
+		if (!strcmp(argv[1], "-n")) return strlen(argv[2]) ? 0 : 1;
+		if (!strcmp(argv[1], "-z")) return strlen(argv[2]) ? 1 : 0;
+		if (!strcmp(argv[1], "-e")) return stat(argv[2], &statbuf) ? 1 : 0;
+		if (!strcmp(argv[1], "-f")) return (!stat(argv[2], &statbuf) && S_ISREG(statbuf.st_mode)) ? 0 : 1;
+		if (!strcmp(argv[1], "-d")) return (!stat(argv[2], &statbuf) && S_ISDIR(statbuf.st_mode)) ? 0 : 1;
+		if (!strcmp(argv[1], "-x")) return (!stat(argv[2], &statbuf) && (statbuf.st_mode & 0111)) ? 0 : 1;
+	}
+
+	if (argc == 4) {
+		if (!strcmp(argv[2], "="))  return strcmp(argv[1], argv[3]) ? 1 : 0;
+		if (!strcmp(argv[2], "!=")) return strcmp(argv[1], argv[3]) ? 0 : 1;
+		int a = atoi(argv[1]);
+		int b = atoi(argv[3]);
+		if (!strcmp(argv[2], "-eq")) return (a == b) ? 0 : 1;
+		if (!strcmp(argv[2], "-ne")) return (a != b) ? 0 : 1;
+		if (!strcmp(argv[2], "-lt")) return (a <  b) ? 0 : 1;
+		if (!strcmp(argv[2], "-le")) return (a <= b) ? 0 : 1;
+		if (!strcmp(argv[2], "-gt")) return (a >  b) ? 0 : 1;
+		if (!strcmp(argv[2], "-ge")) return (a >= b) ? 0 : 1;
+	}
+
+	fprintf(stderr, "%s: unsupported expression\n", argv[0]);
+	return 2;
+}
+
+/*
+ * which command
+ *
+ * Answers straight out of the command location cache.
+ */
+uint32_t shell_cmd_which(int argc, char * argv[]) {
+	if (argc < 2) {
+		return 1;
+	}
+
+	if (strstr(argv[1], "/")) {
+		struct stat t;
+		if (!stat(argv[1], &t) && (t.st_mode & 0111)) {
+			printf("%s\n", argv[1]);
+			return 0;
+		}
+	} else {
+		char * location = path_cache_lookup(argv[1]);
+		if (location) {
+			printf("%s\n", location);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * rehash
+ *
+ * Rebuild the command location cache, picking up binaries
+ * installed since the shell started.
+ */
+uint32_t shell_cmd_rehash(int argc, char * argv[]) {
+	path_cache_flush();
+	path_cache_build();
+
+	/* Add anything new to the tab completion list */
+	list_t * names = hashmap_keys(path_cache);
+	int added = 0;
+	foreach(node, names) {
+		char * name = node->value;
+		if (!shell_has_command(name)) {
+			shell_install_command(strdup(name), NULL, NULL);
+			added = 1;
+		}
+	}
+	list_free(names);
+	free(names);
+	if (added) sort_commands();
+
+	return 0;
+}
+
 uint32_t shell_cmd_help(int argc, char * argv[]) {
 	show_version();
 
@@ -982,10 +1274,16 @@ uint32_t shell_cmd_help(int argc, char * argv[]) {
 }
 
 void install_commands() {
+	shell_install_command("cat",     shell_cmd_cat, "concatenate files to standard output");
 	shell_install_command("cd",      shell_cmd_cd, "change directory");
+	shell_install_command("echo",    shell_cmd_echo, "print arguments");
 	shell_install_command("exit",    shell_cmd_exit, "exit the shell");
 	shell_install_command("export",  shell_cmd_export, "set environment variables");
 	shell_install_command("help",    shell_cmd_help, "display this help text");
 	shell_install_command("history", shell_cmd_history, "list command history");
+	shell_install_command("rehash",  shell_cmd_rehash, "rebuild the command location cache");
 	shell_install_command("set",     shell_cmd_set, "enable special terminal options");
+	shell_install_command("test",    shell_cmd_test, "evaluate an expression");
+	shell_install_command("[",       shell_cmd_test, NULL);
+	shell_install_command("which",   shell_cmd_which, "locate a command");
 }
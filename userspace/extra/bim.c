@@ -274,45 +274,38 @@ int codepoint_width(uint16_t codepoint) {
 }
 
 
+/* Escape helpers queue into stdio; redraw functions flush once at the end */
 void place_cursor(int x, int y) {
 	printf("\033[%d;%dH", y, x);
-	fflush(stdout);
 }
 
 void place_cursor_h(int h) {
 	printf("\033[%dG", h);
-	fflush(stdout);
 }
 
 void set_colors(int fg, int bg) {
 	printf("\033[48;5;%dm", bg);
 	printf("\033[38;5;%dm", fg);
-	fflush(stdout);
 }
 
 void clear_to_end() {
 	printf("\033[K");
-	fflush(stdout);
 }
 
 void set_bold() {
 	printf("\033[1m");
-	fflush(stdout);
 }
 
 void set_underline() {
 	printf("\033[4m");
-	fflush(stdout);
 }
 
 void reset() {
 	printf("\033[0m");
-	fflush(stdout);
 }
 
 void clear_screen() {
 	printf("\033[H\033[2J");
-	fflush(stdout);
 }
 
 void redraw_tabbar() {
@@ -340,6 +333,7 @@ void redraw_tabbar() {
 	reset();
 	set_colors(COLOR_FG, COLOR_TABBAR_BG);
 	clear_to_end();
+	fflush(stdout);
 }
 
 int log_base_10(unsigned int v) {
@@ -408,24 +402,30 @@ void realign_cursor() {
 	}
 }
 
+/* Redraw a single file line (zero-based) if it is in the viewport */
+void redraw_line(int x) {
+	if (x < env->offset || x >= env->offset + term_height - env->bottom_size - 1) return;
+	int num_size = log_base_10(env->line_count) + 2;
+	place_cursor(1, 2 + x - env->offset);
+	/* draw line number */
+	set_colors(COLOR_NUMBER_FG, COLOR_ALT_FG);
+	printf(" ");
+	set_colors(COLOR_NUMBER_FG, COLOR_NUMBER_BG);
+	for (int y = 0; y < num_size - log_base_10(x + 1); ++y) {
+		printf(" ");
+	}
+	printf("%d ", x + 1);
+	set_colors(COLOR_FG, COLOR_BG);
+	clear_to_end();
+	render_line(env->lines[x], term_width - 3 - num_size, env->coffset);
+}
+
 void redraw_text() {
 	int l = term_height - env->bottom_size - 1;
 	int j = 0;
 
-	int num_size = log_base_10(env->line_count) + 2;
 	for (int x = env->offset; j < l && x < env->line_count; x++) {
-		place_cursor(1,2 + j);
-		/* draw line number */
-		set_colors(COLOR_NUMBER_FG, COLOR_ALT_FG);
-		printf(" ");
-		set_colors(COLOR_NUMBER_FG, COLOR_NUMBER_BG);
-		for (int y = 0; y < num_size - log_base_10(x + 1); ++y) {
-			printf(" ");
-		}
-		printf("%d ", x + 1);
-		set_colors(COLOR_FG, COLOR_BG);
-		clear_to_end();
-		render_line(env->lines[x], term_width - 3 - num_size, env->coffset);
+		redraw_line(x);
 		j++;
 	}
 	for (; j < l; ++j) {
@@ -434,6 +434,7 @@ void redraw_text() {
 		printf("~");
 		clear_to_end();
 	}
+	fflush(stdout);
 }
 
 void redraw_statusbar() {
@@ -459,6 +460,7 @@ void redraw_commandline() {
 	place_cursor(1, term_height);
 	set_colors(COLOR_FG, COLOR_BG);
 	clear_to_end();
+	fflush(stdout);
 }
 
 void redraw_all() {
@@ -507,6 +509,7 @@ void place_cursor_actual() {
 	place_cursor(x,y);
 	csr_x_actual = x;
 	csr_y_actual = y;
+	fflush(stdout);
 
 #ifndef __linux__
 	render_cursor();
@@ -534,8 +537,34 @@ void goto_line(int line) {
 	redraw_all();
 }
 
+/* Append a run of printable ASCII to a line with one capacity check */
+line_t * line_append_run(line_t * line, uint8_t * buf, int count) {
+	if (line->actual + count > line->available) {
+		while (line->actual + count > line->available) {
+			line->available *= 2;
+		}
+		line = realloc(line, sizeof(line_t) + sizeof(char_t) * line->available);
+	}
+	for (int i = 0; i < count; ++i) {
+		line->text[line->actual + i].codepoint = buf[i];
+		line->text[line->actual + i].display_width = 1;
+	}
+	line->actual += count;
+	return line;
+}
+
 void add_buffer(uint8_t * buf, int size) {
 	for (int i = 0; i < size; ++i) {
+		/* Fast path: a printable ASCII run appended at the end of the line */
+		if (state == 0 && buf[i] >= 0x20 && buf[i] <= 0x7E &&
+		    env->col_no - 1 == env->lines[env->line_no - 1]->actual) {
+			int run = i + 1;
+			while (run < size && buf[run] >= 0x20 && buf[run] <= 0x7E) run++;
+			env->lines[env->line_no - 1] = line_append_run(env->lines[env->line_no - 1], &buf[i], run - i);
+			env->col_no += run - i;
+			i = run - 1;
+			continue;
+		}
 		if (!decode(&state, &codepoint_r, buf[i])) {
 			uint32_t c = codepoint_r;
 			if (c == '\n') {
@@ -824,7 +853,7 @@ void insert_mode() {
 					if (env->col_no > 1) {
 						line_delete(env->lines[env->line_no - 1], env->col_no - 1);
 						env->col_no -= 1;
-						redraw_text();
+						redraw_line(env->line_no - 1);
 						set_modified();
 						redraw_statusbar();
 						place_cursor_actual();
@@ -857,7 +886,7 @@ void insert_mode() {
 						if (line != nline) {
 							env->lines[env->line_no - 1] = nline;
 						}
-						redraw_text(); /* XXX */
+						redraw_line(env->line_no - 1);
 						env->col_no += 1;
 						set_modified();
 						redraw_statusbar();
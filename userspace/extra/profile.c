@@ -0,0 +1,195 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ *
+ * profile
+ *
+ * Timer-driven sampling profiler. Turns on the kernel's profiling
+ * samples (sysfunc 14) for a while, then drains /proc/trace and
+ * prints a flat profile: kernel samples are symbolized against
+ * /proc/ksyms, userspace samples are attributed to the interrupted
+ * process.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <syscall.h>
+#include <trace.h>
+#include <procfs.h>
+
+typedef struct {
+	uint32_t addr;
+	char name[64];
+} ksym_t;
+
+static ksym_t * ksyms = NULL;
+static size_t ksym_count = 0;
+
+/* Kernel symbols are sorted by address; anything more than this far
+ * past the nearest one is not kernel text. */
+#define KSYM_SLACK 0x10000
+
+static void load_ksyms(void) {
+	FILE * f = fopen("/proc/ksyms", "r");
+	if (!f) return;
+
+	size_t space = 0;
+	uint32_t addr;
+	char name[64];
+	while (fscanf(f, "%x %63s", &addr, name) == 2) {
+		if (ksym_count == space) {
+			space = space ? space * 2 : 1024;
+			ksyms = realloc(ksyms, space * sizeof(ksym_t));
+		}
+		ksyms[ksym_count].addr = addr;
+		strcpy(ksyms[ksym_count].name, name);
+		ksym_count++;
+	}
+	fclose(f);
+}
+
+static char * ksym_lookup(uint32_t eip) {
+	if (!ksym_count || eip < ksyms[0].addr) return NULL;
+	size_t lo = 0;
+	size_t hi = ksym_count;
+	while (lo + 1 < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (ksyms[mid].addr <= eip) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	if (eip - ksyms[lo].addr > KSYM_SLACK) return NULL;
+	return ksyms[lo].name;
+}
+
+static char * read_all(char * path, size_t * out_len) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return NULL;
+
+	size_t cap = 64 * 1024;
+	size_t len = 0;
+	char * buf = malloc(cap);
+	ssize_t r;
+	while ((r = read(fd, buf + len, cap - len)) > 0) {
+		len += r;
+		if (len == cap) {
+			cap *= 2;
+			buf = realloc(buf, cap);
+		}
+	}
+	close(fd);
+
+	*out_len = len;
+	return buf;
+}
+
+static struct proc_info * procs = NULL;
+static int proc_count = 0;
+
+static char * proc_name(int pid) {
+	for (int i = 0; i < proc_count; ++i) {
+		if ((int)procs[i].pid == pid) return procs[i].name;
+	}
+	return "?";
+}
+
+typedef struct {
+	char label[96];
+	int count;
+} bucket_t;
+
+static bucket_t * buckets = NULL;
+static size_t bucket_count = 0;
+static size_t bucket_space = 0;
+
+static void add_sample(char * label) {
+	for (size_t i = 0; i < bucket_count; ++i) {
+		if (!strcmp(buckets[i].label, label)) {
+			buckets[i].count++;
+			return;
+		}
+	}
+	if (bucket_count == bucket_space) {
+		bucket_space = bucket_space ? bucket_space * 2 : 64;
+		buckets = realloc(buckets, bucket_space * sizeof(bucket_t));
+	}
+	strcpy(buckets[bucket_count].label, label);
+	buckets[bucket_count].count = 1;
+	bucket_count++;
+}
+
+static int bucket_cmp(const void * a, const void * b) {
+	return ((bucket_t *)b)->count - ((bucket_t *)a)->count;
+}
+
+int main(int argc, char * argv[]) {
+	int seconds = (argc > 1) ? atoi(argv[1]) : 5;
+	if (seconds <= 0) {
+		fprintf(stderr, "Usage: %s [seconds]\n", argv[0]);
+		return 1;
+	}
+
+	load_ksyms();
+
+	/* Throw away anything already sitting in the rings */
+	size_t stale;
+	free(read_all("/proc/trace", &stale));
+
+	if (syscall_system_function(14, (char **)1) < 0) {
+		fprintf(stderr, "%s: could not enable sampling (are you root?)\n", argv[0]);
+		return 1;
+	}
+	usleep(seconds * 1000000);
+	syscall_system_function(14, (char **)0);
+
+	size_t len = 0;
+	char * buf = read_all("/proc/trace", &len);
+	if (!buf) {
+		fprintf(stderr, "%s: no /proc/trace\n", argv[0]);
+		return 1;
+	}
+
+	size_t plen = 0;
+	procs = (struct proc_info *)read_all("/proc/processes", &plen);
+	proc_count = plen / sizeof(struct proc_info);
+
+	trace_event_t * events = (trace_event_t *)buf;
+	int count = len / sizeof(trace_event_t);
+	int total = 0;
+
+	for (int i = 0; i < count; ++i) {
+		trace_event_t * ev = &events[i];
+		if (ev->type != TRACE_SAMPLE) continue;
+
+		char label[96];
+		char * sym = ksym_lookup(ev->data);
+		if (sym) {
+			snprintf(label, sizeof(label), "[kernel] %s", sym);
+		} else {
+			snprintf(label, sizeof(label), "%s (%d)", proc_name(ev->pid), ev->pid);
+		}
+		add_sample(label);
+		total++;
+	}
+
+	if (!total) {
+		fprintf(stderr, "%s: no samples collected\n", argv[0]);
+		return 1;
+	}
+
+	qsort(buckets, bucket_count, sizeof(bucket_t), bucket_cmp);
+
+	printf("%d samples over %d second%s:\n", total, seconds, seconds == 1 ? "" : "s");
+	for (size_t i = 0; i < bucket_count; ++i) {
+		int permille = buckets[i].count * 1000 / total;
+		printf("%6d  %3d.%d%%  %s\n", buckets[i].count, permille / 10, permille % 10, buckets[i].label);
+	}
+
+	return 0;
+}
@@ -0,0 +1,49 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2015 Kevin Lange
+ *
+ * vidset
+ *
+ * Change the display resolution live. The driver reprograms the
+ * adapter and signals the compositor, which reinitializes and
+ * broadcasts the new geometry to its clients.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include "../../kernel/include/video.h"
+
+int main(int argc, char * argv[]) {
+	if (argc < 3) {
+		fprintf(stderr, "Usage: %s WIDTH HEIGHT\n", argv[0]);
+		return 1;
+	}
+
+	int fd = open("/dev/fb0", O_RDONLY);
+	if (fd < 0) {
+		perror("open /dev/fb0");
+		return 1;
+	}
+
+	vid_mode_t mode;
+	mode.width  = atoi(argv[1]);
+	mode.height = atoi(argv[2]);
+
+	if (ioctl(fd, IO_VID_SET, &mode) < 0) {
+		fprintf(stderr, "%s: this display can not change modes\n", argv[0]);
+		return 1;
+	}
+
+	size_t w, h;
+	ioctl(fd, IO_VID_WIDTH, &w);
+	ioctl(fd, IO_VID_HEIGHT, &h);
+	fprintf(stdout, "%dx%d\n", (int)w, (int)h);
+
+	close(fd);
+	return 0;
+}
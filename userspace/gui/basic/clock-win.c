@@ -148,7 +148,7 @@ int main (int argc, char ** argv) {
 				default:
 					break;
 			}
-			free(m);
+			yutani_msg_free(yctx, m);
 		}
 		struct timeval now;
 		int last = 0;
@@ -140,6 +140,7 @@ ttk_raw_surface * ttk_raw_surface_new(int width, int height) {
 	out->surface->depth  = 32;
 	out->surface->buffer = malloc(sizeof(uint32_t) * width * height);
 	out->surface->backbuffer = out->surface->buffer;
+	out->surface->dirty = NULL;
 
 	draw_fill(out->surface, rgb(255,255,255));
 
@@ -309,7 +310,7 @@ static void resize_button(void * button, struct yutani_msg_window_mouse_event *
 	yutani_msg_t * m = yutani_wait_for(yctx, YUTANI_MSG_RESIZE_OFFER);
 	struct yutani_msg_window_resize * wr = (void*)m->data;
 	resize_finish(wr->width, wr->height);
-	free(m);
+	yutani_msg_free(yctx, m);
 }
 
 void keep_drawing(struct yutani_msg_window_mouse_event * mouse) { 
@@ -473,7 +474,7 @@ int main (int argc, char ** argv) {
 				default:
 					break;
 			}
-			free(m);
+			yutani_msg_free(yctx, m);
 		}
 	}
 
@@ -86,7 +86,7 @@ int main (int argc, char ** argv) {
 					break;
 			}
 		}
-		free(m);
+		yutani_msg_free(yctx, m);
 	}
 
 	yutani_close(yctx, wina);
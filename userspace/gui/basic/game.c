@@ -250,7 +250,7 @@ char handle_event(yutani_msg_t * m) {
 			default:
 				break;
 		}
-		free(m);
+		yutani_msg_free(yctx, m);
 	}
 	return 0;
 }
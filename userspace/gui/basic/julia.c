@@ -299,7 +299,7 @@ int main(int argc, char * argv[]) {
 					break;
 			}
 		}
-		free(m);
+		yutani_msg_free(yctx, m);
 	}
 
 	yutani_close(yctx, window);
@@ -356,7 +356,7 @@ int main(int argc, char * argv[]) {
 				default:
 					break;
 			}
-			free(m);
+			yutani_msg_free(yctx, m);
 		}
 	}
 
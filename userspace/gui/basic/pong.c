@@ -282,7 +282,7 @@ int main (int argc, char ** argv) {
 				default:
 					break;
 			}
-			free(m);
+			yutani_msg_free(yctx, m);
 		} else {
 			syscall_yield();
 		}
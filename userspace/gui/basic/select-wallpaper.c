@@ -135,9 +135,8 @@ static int find_wallpaper_pid(void) {
 sprite_t * load_wallpaper(char * file) {
 	sprite_t * o_wallpaper = NULL;
 
-	sprite_t * wallpaper_tmp = calloc(1,sizeof(sprite_t));
-
-	load_sprite_png(wallpaper_tmp, file);
+	sprite_t * wallpaper_tmp = sprite_cache_get(file);
+	if (!wallpaper_tmp) return NULL;
 
 	int width = 500;
 	int height = 300;
@@ -160,7 +159,7 @@ sprite_t * load_wallpaper(char * file) {
 
 	free(tmp);
 
-	sprite_free(wallpaper_tmp);
+	sprite_cache_release(wallpaper_tmp);
 
 	return o_wallpaper;
 }
@@ -416,7 +415,7 @@ int main(int argc, char * argv[]) {
 				default:
 					break;
 			}
-			free(m);
+			yutani_msg_free(yctx, m);
 		}
 	}
 
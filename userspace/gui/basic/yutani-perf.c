@@ -0,0 +1,107 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2018 Kevin Lange
+ *
+ * yutani-perf - dump the compositor's performance counters
+ *
+ * The compositor publishes per-frame timing in a shared memory
+ * block (see gui/compositor/yutani_perf.h); this reads it out so
+ * rendering changes can be compared with numbers instead of feel.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+#include <syscall.h>
+
+#include "gui/compositor/yutani_perf.h"
+
+void show_usage(int argc, char * argv[]) {
+	printf(
+			"yutani-perf - show compositor frame timing\n"
+			"\n"
+			"usage: %s [-f?]\n"
+			"\n"
+			" -f     \033[3mdump the recent per-frame records\033[0m\n"
+			" -?     \033[3mshow this help text\033[0m\n"
+			"\n", argv[0]);
+}
+
+static yutani_perf_t * obtain_perf_block(void) {
+	char * display = getenv("DISPLAY");
+	if (!display) {
+		fprintf(stderr, "DISPLAY is not set.\n");
+		return NULL;
+	}
+
+	char key[64];
+	YUTANI_PERF_KEY(display, key, 64);
+
+	size_t size = 0;
+	yutani_perf_t * perf = (yutani_perf_t *)syscall_shm_obtain(key, &size);
+	if (!perf || size < sizeof(yutani_perf_t) || perf->magic != YUTANI_PERF_MAGIC) {
+		fprintf(stderr, "No performance block published by `%s`.\n", display);
+		return NULL;
+	}
+	return perf;
+}
+
+static int show_frames(yutani_perf_t * perf) {
+	uint32_t seq = perf->sequence;
+	uint32_t count = seq < YUTANI_PERF_FRAMES ? seq : YUTANI_PERF_FRAMES;
+
+	printf("%8s %10s %10s %8s %8s %10s %8s\n",
+			"frame", "time(us)", "blit(us)", "windows", "rects", "area(px)", "queued");
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t n = seq - count + i;
+		yutani_perf_frame_t * f = &perf->frames[n % YUTANI_PERF_FRAMES];
+		printf("%8d %10d %10d %8d %8d %10d %8d\n",
+				n, f->frame_time, f->blit_time, f->windows_blitted,
+				f->damage_rects, f->damage_area, f->queue_depth);
+	}
+	return 0;
+}
+
+static int show_summary(yutani_perf_t * perf) {
+	uint32_t seq = perf->sequence;
+	uint32_t count = seq < YUTANI_PERF_FRAMES ? seq : YUTANI_PERF_FRAMES;
+
+	if (!count) {
+		printf("No frames composited yet.\n");
+		return 0;
+	}
+
+	uint64_t time_total = 0, blit_total = 0, area_total = 0;
+	uint32_t time_worst = 0, over_budget = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		yutani_perf_frame_t * f = &perf->frames[(seq - count + i) % YUTANI_PERF_FRAMES];
+		time_total += f->frame_time;
+		blit_total += f->blit_time;
+		area_total += f->damage_area;
+		if (f->frame_time > time_worst) time_worst = f->frame_time;
+		if (f->frame_time > 16667) over_budget++;
+	}
+
+	printf("%d frames composited, %d wakeups skipped\n", seq, perf->frames_skipped);
+	printf("last %d frames: avg %d usec (%d in blits), worst %d usec, %d over 60Hz budget\n",
+			count, (int)(time_total / count), (int)(blit_total / count), time_worst, over_budget);
+	printf("avg damage: %d px/frame\n", (int)(area_total / count));
+	return 0;
+}
+
+int main(int argc, char * argv[]) {
+	yutani_perf_t * perf = obtain_perf_block();
+	if (!perf) return 1;
+
+	int c;
+	while ((c = getopt(argc, argv, "f?")) != -1) {
+		switch (c) {
+			case 'f':
+				return show_frames(perf);
+			case '?':
+				show_usage(argc, argv);
+				return 0;
+		}
+	}
+
+	return show_summary(perf);
+}
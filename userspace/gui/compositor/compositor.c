@@ -41,6 +41,7 @@
 #include "lib/hashmap.h"
 #include "lib/list.h"
 #include "lib/spinlock.h"
+#include "lib/shmemsprites.h"
 
 #include "lib/trace.h"
 #define TRACE_APP_NAME "yutani"
@@ -346,6 +347,20 @@ static yutani_server_window_t * get_focused(yutani_globals_t * yg) {
 	return yg->bottom_z;
 }
 
+/**
+ * How much backing memory to reserve for a window of this size.
+ *
+ * Window buffers are reserved at the next power of two over what the
+ * window needs, so most interactive resizes fit in the region we
+ * already have and skip the allocate/remap round trip entirely.
+ */
+static size_t window_buffer_reserve(int width, int height, int double_buffered) {
+	size_t need = (width * height * 4) * (double_buffered ? 2 : 1);
+	size_t size = 0x1000;
+	while (size < need) size <<= 1;
+	return size;
+}
+
 /**
  * Create a server window object.
  *
@@ -381,6 +396,8 @@ static yutani_server_window_t * server_window_create(yutani_globals_t * yg, int
 	win->anim_mode = YUTANI_EFFECT_FADE_IN;
 	win->anim_start = yutani_current_time(yg);
 	win->alpha_threshold = 0;
+	win->shape_spans = NULL;
+	win->shape_dirty = 0;
 	win->show_mouse = 1;
 	win->tiled = 0;
 	win->untiled_width = 0;
@@ -388,13 +405,16 @@ static yutani_server_window_t * server_window_create(yutani_globals_t * yg, int
 	win->default_mouse = 1;
 	win->server_flags = flags;
 	win->opacity = 255;
+	win->double_buffered = !!(flags & YUTANI_WINDOW_FLAG_DOUBLE_BUFFER);
+	win->front_buffer = 0;
 
 	char key[1024];
 	YUTANI_SHMKEY(yg->server_ident, key, 1024, win);
 
-	size_t size = (width * height * 4);
+	size_t size = window_buffer_reserve(width, height, win->double_buffered);
 
 	win->buffer = (uint8_t *)syscall_shm_obtain(key, &size);
+	win->buffer_capacity = size;
 	memset(win->buffer, 0, size);
 
 	list_insert(yg->mid_zs, win);
@@ -416,6 +436,7 @@ static yutani_server_window_t * server_window_create(yutani_globals_t * yg, int
  */
 static void server_window_update_shape(yutani_globals_t * yg, yutani_server_window_t * window, int set) {
 	window->alpha_threshold = set;
+	window->shape_dirty = 1;
 }
 
 /**
@@ -433,13 +454,23 @@ static uint32_t server_window_resize(yutani_globals_t * yg, yutani_server_window
 		/* Already in the middle of an accept/done, bail */
 		return win->newbufid;
 	}
+
+	size_t need = (width * height * 4) * (win->double_buffered ? 2 : 1);
+	if (need <= win->buffer_capacity) {
+		/* The new size fits in the reserved region. Answering with
+		 * the same bufid tells the client to keep its mapping. */
+		win->newbufid = win->bufid;
+		win->newbuffer = win->buffer;
+		return win->newbufid;
+	}
+
 	win->newbufid = next_buf_id();
 
 	{
 		char key[1024];
 		YUTANI_SHMKEY_EXP(yg->server_ident, key, 1024, win->newbufid);
 
-		size_t size = (width * height * 4);
+		size_t size = window_buffer_reserve(width, height, win->double_buffered);
 		win->newbuffer = (uint8_t *)syscall_shm_obtain(key, &size);
 	}
 
@@ -468,11 +499,20 @@ static void server_window_resize_finish(yutani_globals_t * yg, yutani_server_win
 
 	win->bufid = win->newbufid;
 	win->buffer = win->newbuffer;
+	win->front_buffer = 0; /* Both sides restart on the first half */
+
+	if (win->shape_spans) {
+		/* Wrong size now; rebuilt on the first shaped blit */
+		free(win->shape_spans);
+		win->shape_spans = NULL;
+	}
+	win->shape_dirty = 1;
 
 	win->newbuffer = NULL;
 	win->newbufid = 0;
 
-	{
+	if (oldbufid != win->bufid) {
+		win->buffer_capacity = window_buffer_reserve(width, height, win->double_buffered);
 		char key[1024];
 		YUTANI_SHMKEY_EXP(yg->server_ident, key, 1024, oldbufid);
 		syscall_shm_release(key);
@@ -560,12 +600,51 @@ static void load_fonts(yutani_globals_t * yg) {
 	}
 }
 
+/*
+ * Sprites published to the shared cache at startup: the decoration
+ * themes' pieces and the cursor set. Decorated clients map the one
+ * system-wide copy of these instead of each decoding its own.
+ */
+static char * cached_sprites[] = {
+	"/usr/share/ttk/active/ul.png",
+	"/usr/share/ttk/active/um.png",
+	"/usr/share/ttk/active/ur.png",
+	"/usr/share/ttk/active/ml.png",
+	"/usr/share/ttk/active/mr.png",
+	"/usr/share/ttk/active/ll.png",
+	"/usr/share/ttk/active/lm.png",
+	"/usr/share/ttk/active/lr.png",
+	"/usr/share/ttk/active/button-close.png",
+	"/usr/share/ttk/inactive/ul.png",
+	"/usr/share/ttk/inactive/um.png",
+	"/usr/share/ttk/inactive/ur.png",
+	"/usr/share/ttk/inactive/ml.png",
+	"/usr/share/ttk/inactive/mr.png",
+	"/usr/share/ttk/inactive/ll.png",
+	"/usr/share/ttk/inactive/lm.png",
+	"/usr/share/ttk/inactive/lr.png",
+	"/usr/share/ttk/inactive/button-close.png",
+	"/usr/share/cursor/normal.png",
+	"/usr/share/cursor/drag.png",
+	"/usr/share/cursor/resize-vertical.png",
+	"/usr/share/cursor/resize-horizontal.png",
+	"/usr/share/cursor/resize-uldr.png",
+	"/usr/share/cursor/resize-dlur.png",
+	NULL
+};
+
 /**
- * Add a clip region from a rectangle.
+ * Load the common sprites and publish them to the shared cache.
  */
-static void yutani_add_clip(yutani_globals_t * yg, double x, double y, double w, double h) {
-	cairo_rectangle(yg->framebuffer_ctx, x, y, w, h);
-	cairo_rectangle(yg->real_ctx, x, y, w, h);
+static void load_sprite_cache(yutani_globals_t * yg) {
+	int count = 0;
+	for (char ** path = cached_sprites; *path; ++path) {
+		sprite_t tmp = {0};
+		if (load_sprite_png(&tmp, *path)) continue;
+		if (!shm_sprite_publish(yg->server_ident, *path, &tmp)) count++;
+		if (tmp.bitmap) free(tmp.bitmap);
+	}
+	TRACE("Published %d sprites to the shared cache.", count);
 }
 
 /**
@@ -584,14 +663,6 @@ static void restore_cairo_states(yutani_globals_t * yg) {
 	cairo_restore(yg->real_ctx);
 }
 
-/**
- * Apply the clips we built earlier.
- */
-static void yutani_set_clip(yutani_globals_t * yg) {
-	cairo_clip(yg->framebuffer_ctx);
-	cairo_clip(yg->real_ctx);
-}
-
 /**
  * Mark a screen region as damaged.
  */
@@ -609,14 +680,13 @@ static void mark_screen(yutani_globals_t * yg, int32_t x, int32_t y, int32_t wid
 }
 
 /**
- * Draw the cursor sprite.
+ * Pick the cursor sprite for the current mouse state.
  *
- * TODO This should probably use Cairo's PNG functionality, or something
- *      else other than our own rendering tools...
+ * `cursor` is the show_mouse value of the window under the cursor,
+ * which may request an alternate sprite.
  */
-static void draw_cursor(yutani_globals_t * yg, int x, int y, int cursor) {
+static sprite_t * cursor_sprite(yutani_globals_t * yg, int cursor) {
 	sprite_t * sprite = &yg->mouse_sprite;
-	static sprite_t * previous = NULL;
 	if (yg->resizing_window) {
 		switch (yg->resizing_direction) {
 			case SCALE_UP:
@@ -647,6 +717,18 @@ static void draw_cursor(yutani_globals_t * yg, int x, int y, int cursor) {
 			case YUTANI_CURSOR_TYPE_RESIZE_DOWN_UP:    sprite = &yg->mouse_sprite_resize_db; break;
 		}
 	}
+	return sprite;
+}
+
+/**
+ * Draw the cursor sprite.
+ *
+ * TODO This should probably use Cairo's PNG functionality, or something
+ *      else other than our own rendering tools...
+ */
+static void draw_cursor(yutani_globals_t * yg, int x, int y, int cursor) {
+	static sprite_t * previous = NULL;
+	sprite_t * sprite = cursor_sprite(yg, cursor);
 	if (sprite != previous) {
 		mark_screen(yg, x / MOUSE_SCALE - MOUSE_OFFSET_X, y / MOUSE_SCALE - MOUSE_OFFSET_Y, MOUSE_WIDTH, MOUSE_HEIGHT);
 		previous = sprite;
@@ -654,6 +736,17 @@ static void draw_cursor(yutani_globals_t * yg, int x, int y, int cursor) {
 	draw_sprite(yg->backend_ctx, sprite, x / MOUSE_SCALE - MOUSE_OFFSET_X, y / MOUSE_SCALE - MOUSE_OFFSET_Y);
 }
 
+/**
+ * The half of a window's shm region we should be displaying.
+ *
+ * Single-buffered windows only have the one; double-buffered windows
+ * show the half the client most recently flipped.
+ */
+static uint8_t * window_front_buffer(yutani_server_window_t * window) {
+	if (!window->double_buffered || !window->front_buffer) return window->buffer;
+	return window->buffer + window->width * window->height * 4;
+}
+
 /**
  * Determine if a window has a solid pixel at a given screen-space coordinate.
  *
@@ -668,7 +761,7 @@ yutani_server_window_t * check_top_at(yutani_globals_t * yg, yutani_server_windo
 	int32_t _x = -1, _y = -1;
 	device_to_window(w, x, y, &_x, &_y);
 	if (_x < 0 || _x >= w->width || _y < 0 || _y >= w->height) return NULL;
-	uint32_t c = ((uint32_t *)w->buffer)[(w->width * _y + _x)];
+	uint32_t c = ((uint32_t *)window_front_buffer(w))[(w->width * _y + _x)];
 	uint8_t a = _ALP(c);
 	if (a >= w->alpha_threshold) {
 		return w;
@@ -694,6 +787,28 @@ yutani_server_window_t * top_at(yutani_globals_t * yg, uint16_t x, uint16_t y) {
 	return NULL;
 }
 
+/**
+ * Keep the backend's cursor plane in sync.
+ *
+ * Only talks to the kernel when the effective sprite changes; plain
+ * motion is free, since the host moves the plane itself.
+ */
+static void update_hardware_cursor(yutani_globals_t * yg) {
+	static sprite_t * previous = (sprite_t *)-1;
+	sprite_t * sprite = NULL;
+	yutani_server_window_t * window = top_at(yg, yg->mouse_x / MOUSE_SCALE, yg->mouse_y / MOUSE_SCALE);
+	if (!window || window->show_mouse) {
+		sprite = cursor_sprite(yg, window ? window->show_mouse : 1);
+	}
+	if (sprite == previous) return;
+	previous = sprite;
+	if (sprite) {
+		framebuffer_set_cursor(sprite->width, sprite->height, MOUSE_OFFSET_X, MOUSE_OFFSET_Y, sprite->bitmap);
+	} else {
+		framebuffer_set_cursor(0, 0, 0, 0, NULL);
+	}
+}
+
 /**
  * Get the window at a coordinate and focus it.
  *
@@ -748,6 +863,116 @@ static uint32_t color_for_wid(yutani_wid_t wid) {
 	return colors[i];
 }
 
+/**
+ * Can this window hide the windows beneath it?
+ *
+ * The shaping threshold doubles as the client's declaration of solidity:
+ * the default of 0 means every pixel is solid (see check_top_at), so a
+ * window that hasn't asked for shaping and isn't faded, rotated, or
+ * being resized covers everything behind it.
+ */
+static int window_is_occluding(yutani_globals_t * yg, yutani_server_window_t * window) {
+	if (window->opacity != 255) return 0;
+	if (window->alpha_threshold != 0) return 0;
+	if (window->rotation != 0) return 0;
+	if (window->anim_mode) return 0;
+	if (window == yg->resizing_window) return 0;
+	return 1;
+}
+
+/**
+ * Rebuild the cached opaque spans for a shaped window.
+ *
+ * Each row records its contiguous run of fully opaque pixels, so the
+ * blit loop can copy that middle and only blend the edges - decorated
+ * windows are solid everywhere but their rounded corners. A row with
+ * translucency inside the run gets an empty span and blends whole.
+ */
+static void window_rebuild_shape_spans(yutani_server_window_t * window) {
+	if (!window->shape_spans) {
+		window->shape_spans = malloc(sizeof(uint16_t) * 2 * window->height);
+	}
+	uint32_t * px = (uint32_t *)window_front_buffer(window);
+	for (int32_t row = 0; row < window->height; ++row, px += window->width) {
+		int32_t f = 0;
+		int32_t l = window->width - 1;
+		while (f <= l && _ALP(px[f]) != 255) f++;
+		while (l > f && _ALP(px[l]) != 255) l--;
+		for (int32_t i = f; i <= l; ++i) {
+			if (_ALP(px[i]) != 255) {
+				f = 0;
+				l = -1;
+				break;
+			}
+		}
+		window->shape_spans[row * 2]     = f;
+		window->shape_spans[row * 2 + 1] = l + 1;
+	}
+	window->shape_dirty = 0;
+}
+
+/**
+ * Blit an unrotated, unscaled window directly, without Cairo.
+ *
+ * The context's clip is always a screen-aligned rectangle here (see
+ * yutani_blit_rect), so we can intersect it with the window bounds
+ * and copy or blend the scanlines ourselves. Returns 0 if the window
+ * needs the full Cairo path after all.
+ */
+static int yutani_blit_window_fast(yutani_globals_t * yg, cairo_t * cr, yutani_server_window_t * window, int x, int y) {
+	cairo_surface_t * target = cairo_get_target(cr);
+	if (cairo_surface_get_type(target) != CAIRO_SURFACE_TYPE_IMAGE) return 0;
+
+	/* Only with an untransformed context do device and user space agree */
+	cairo_matrix_t m;
+	cairo_get_matrix(cr, &m);
+	if (m.xx != 1.0 || m.yy != 1.0 || m.xy != 0.0 || m.yx != 0.0 || m.x0 != 0.0 || m.y0 != 0.0) return 0;
+
+	double cx0, cy0, cx1, cy1;
+	cairo_clip_extents(cr, &cx0, &cy0, &cx1, &cy1);
+
+	int32_t left   = max(max((int32_t)cx0, x), 0);
+	int32_t top    = max(max((int32_t)cy0, y), 0);
+	int32_t right  = min(min((int32_t)cx1, x + (int32_t)window->width), cairo_image_surface_get_width(target));
+	int32_t bottom = min(min((int32_t)cy1, y + (int32_t)window->height), cairo_image_surface_get_height(target));
+
+	if (left >= right || top >= bottom) return 1; /* Nothing visible */
+
+	cairo_surface_flush(target);
+	uint8_t * dst = cairo_image_surface_get_data(target);
+	int dst_stride = cairo_image_surface_get_stride(target);
+	uint8_t * src = window_front_buffer(window);
+	int src_stride = window->width * 4;
+
+	/* Solid windows are a straight copy; shaped ones blend only the
+	 * translucent edges recorded in their cached spans */
+	int solid = (window->alpha_threshold == 0);
+	size_t w = right - left;
+
+	if (!solid && (window->shape_dirty || !window->shape_spans)) {
+		window_rebuild_shape_spans(window);
+	}
+
+	for (int32_t row = top; row < bottom; ++row) {
+		uint8_t * d = dst + row * dst_stride + left * 4;
+		uint8_t * s = src + (row - y) * src_stride + (left - x) * 4;
+		if (solid) {
+			blit_row_copy(d, s, w);
+		} else {
+			/* Clamp the opaque run to the clipped extent */
+			uint16_t * span = &window->shape_spans[(row - y) * 2];
+			int32_t c0 = min(max(x + span[0], left), right);
+			int32_t c1 = min(max(x + span[1], c0), right);
+			if (c0 > left)  blit_row_blend(d, s, c0 - left);
+			if (c1 > c0)    blit_row_copy(d + (c0 - left) * 4, s + (c0 - left) * 4, c1 - c0);
+			if (right > c1) blit_row_blend(d + (c1 - left) * 4, s + (c1 - left) * 4, right - c1);
+		}
+	}
+
+	cairo_surface_mark_dirty_rectangle(target, left, top, right - left, bottom - top);
+	return 1;
+}
+
 /**
  * Blit a window to the framebuffer.
  *
@@ -759,12 +984,21 @@ static int yutani_blit_window(yutani_globals_t * yg, cairo_t * ctx, yutani_serve
 	/* Obtain the previously initialized cairo contexts */
 	cairo_t * cr = ctx;
 
+	/*
+	 * The dominant case - an unrotated, unscaled window at full opacity -
+	 * doesn't need any Cairo state; copy or blend the scanlines directly.
+	 */
+	if (window->rotation == 0 && !window->anim_mode &&
+	    window != yg->resizing_window && window->opacity == 255) {
+		if (yutani_blit_window_fast(yg, cr, window, x, y)) return 0;
+	}
+
 	/* Window stride is always 4 bytes per pixel... */
 	int stride = window->width * 4;
 
 	/* Initialize a cairo surface object for this window */
 	cairo_surface_t * surf = cairo_image_surface_create_for_data(
-			window->buffer, CAIRO_FORMAT_ARGB32, window->width, window->height, stride);
+			window_front_buffer(window), CAIRO_FORMAT_ARGB32, window->width, window->height, stride);
 
 	/* Save cairo context */
 	cairo_save(cr);
@@ -811,7 +1045,10 @@ static int yutani_blit_window(yutani_globals_t * yg, cairo_t * ctx, yutani_serve
 		if (frame >= yutani_animation_lengths[window->anim_mode]) {
 			/* XXX handle animation-end things like cleanup of closing windows */
 			if (window->anim_mode == YUTANI_EFFECT_FADE_OUT) {
-				list_insert(yg->windows_to_remove, window);
+				/* We may be called once per damage rectangle; only queue the close once. */
+				if (!list_find(yg->windows_to_remove, window)) {
+					list_insert(yg->windows_to_remove, window);
+				}
 				goto draw_finish;
 			}
 			window->anim_mode = 0;
@@ -907,22 +1144,179 @@ draw_finish:
 }
 
 /**
- * Blit all windows into the given context.
+ * Compute the device-space bounding box for a window.
  *
- * This is called for rendering and for screenshots.
+ * Rotated windows get the bounding box of their rotated quad and the
+ * window being interactively resized gets its scaled extent, matching
+ * the damage that mark_window_relative reports for them.
  */
-static void yutani_blit_windows(yutani_globals_t * yg, cairo_t * ctx) {
-	if (yg->bottom_z) yutani_blit_window(yg, ctx, yg->bottom_z, yg->bottom_z->x, yg->bottom_z->y);
-	foreach (node, yg->mid_zs) {
+static void window_bounds(yutani_globals_t * yg, yutani_server_window_t * window, yutani_damage_rect_t * out) {
+	if (window == yg->resizing_window) {
+		out->x = window->x + yg->resizing_offset_x - 1;
+		out->y = window->y + yg->resizing_offset_y - 1;
+		out->width = yg->resizing_w + 2;
+		out->height = yg->resizing_h + 2;
+	} else if (window->rotation == 0) {
+		out->x = window->x;
+		out->y = window->y;
+		out->width = window->width;
+		out->height = window->height;
+	} else {
+		int32_t ul_x, ul_y;
+		int32_t ll_x, ll_y;
+		int32_t ur_x, ur_y;
+		int32_t lr_x, lr_y;
+
+		window_to_device(window, 0, 0, &ul_x, &ul_y);
+		window_to_device(window, 0, window->height, &ll_x, &ll_y);
+		window_to_device(window, window->width, 0, &ur_x, &ur_y);
+		window_to_device(window, window->width, window->height, &lr_x, &lr_y);
+
+		out->x = min(min(ul_x, ll_x), min(ur_x, lr_x));
+		out->y = min(min(ul_y, ll_y), min(ur_y, lr_y));
+		out->width  = max(max(ul_x, ll_x), max(ur_x, lr_x)) - out->x;
+		out->height = max(max(ul_y, ll_y), max(ur_y, lr_y)) - out->y;
+	}
+}
+
+/* Widths are unsigned, so do the edge math in signed space; windows
+ * can hang off the left and top of the screen. */
+static int rects_overlap(yutani_damage_rect_t * a, yutani_damage_rect_t * b) {
+	int32_t a_r = a->x + (int32_t)a->width, a_b = a->y + (int32_t)a->height;
+	int32_t b_r = b->x + (int32_t)b->width, b_b = b->y + (int32_t)b->height;
+	return !(b->x >= a_r || b_r <= a->x || b->y >= a_b || b_b <= a->y);
+}
+
+static int rect_covers(yutani_damage_rect_t * outer, yutani_damage_rect_t * inner) {
+	return (outer->x <= inner->x && outer->y <= inner->y &&
+	        outer->x + (int32_t)outer->width  >= inner->x + (int32_t)inner->width &&
+	        outer->y + (int32_t)outer->height >= inner->y + (int32_t)inner->height);
+}
+
+/**
+ * Composite one damage rectangle.
+ *
+ * Walks the stack from the top down collecting the windows that
+ * intersect the rectangle, stopping at the first one that covers it
+ * completely with solid pixels - nothing below that can show through -
+ * and then paints the survivors bottom-up with the context clipped to
+ * the rectangle, so only the visible portions are recomposited.
+ */
+static void yutani_blit_rect(yutani_globals_t * yg, cairo_t * ctx, yutani_damage_rect_t * rect) {
+	yutani_server_window_t * stack[yg->mid_zs->length + 2];
+	yutani_damage_rect_t bounds;
+	int depth = 0;
+
+	if (yg->top_z) {
+		window_bounds(yg, yg->top_z, &bounds);
+		if (rects_overlap(&bounds, rect)) {
+			stack[depth++] = yg->top_z;
+			if (window_is_occluding(yg, yg->top_z) && rect_covers(&bounds, rect)) goto paint;
+		}
+	}
+	foreachr (node, yg->mid_zs) {
 		yutani_server_window_t * w = node->value;
-		if (w) yutani_blit_window(yg, ctx, w, w->x, w->y);
+		if (!w) continue;
+		window_bounds(yg, w, &bounds);
+		if (!rects_overlap(&bounds, rect)) continue;
+		stack[depth++] = w;
+		if (window_is_occluding(yg, w) && rect_covers(&bounds, rect)) goto paint;
+	}
+	if (yg->bottom_z) {
+		window_bounds(yg, yg->bottom_z, &bounds);
+		if (rects_overlap(&bounds, rect)) {
+			stack[depth++] = yg->bottom_z;
+		}
+	}
+
+paint:
+	cairo_save(ctx);
+	cairo_rectangle(ctx, rect->x, rect->y, rect->width, rect->height);
+	cairo_clip(ctx);
+	while (depth--) {
+		yutani_server_window_t * w = stack[depth];
+		struct timeval blit_start, blit_end;
+		gettimeofday(&blit_start, NULL);
+		yutani_blit_window(yg, ctx, w, w->x, w->y);
+		gettimeofday(&blit_end, NULL);
+		yg->perf_frame.blit_time += (blit_end.tv_sec - blit_start.tv_sec) * 1000000L
+		                          + (blit_end.tv_usec - blit_start.tv_usec);
+		yg->perf_frame.windows_blitted++;
+	}
+	cairo_restore(ctx);
+}
+
+/**
+ * Draw the performance HUD: one bar per recent frame, oldest on the
+ * left, height proportional to composite time. The middle guide line
+ * is the 60Hz budget; frames that blow it turn red. No text - the
+ * compositor doesn't render any - the numbers are in the shared block
+ * for yutani-perf.
+ */
+#define HUD_BAR_W 3
+#define HUD_HEIGHT 64
+static void draw_perf_hud(yutani_globals_t * yg) {
+	yutani_perf_t * perf = yg->perf;
+	uint32_t seq = perf->sequence;
+	for (int i = 0; i < YUTANI_PERF_FRAMES; ++i) {
+		yutani_perf_frame_t * f = &perf->frames[(seq + i) % YUTANI_PERF_FRAMES];
+		/* Half height at the 16.6ms budget */
+		int h = f->frame_time * (HUD_HEIGHT / 2) / 16667;
+		if (h > HUD_HEIGHT) h = HUD_HEIGHT;
+		uint32_t color = f->frame_time > 16667 ? rgb(240,60,60) : rgb(100,220,100);
+		for (int y = 0; y < HUD_HEIGHT; ++y) {
+			uint32_t c = (y >= HUD_HEIGHT - h) ? color :
+				(y == HUD_HEIGHT / 2 ? rgb(140,140,140) : rgb(20,20,20));
+			for (int x = 0; x < HUD_BAR_W - 1; ++x) {
+				int px = i * HUD_BAR_W + x;
+				int py = y;
+				if (px < (int)yg->width && py < (int)yg->height) {
+					GFX(yg->backend_ctx, px, py) = c;
+				}
+			}
+		}
 	}
-	if (yg->top_z) yutani_blit_window(yg, ctx, yg->top_z, yg->top_z->x, yg->top_z->y);
 }
 
 /**
  * Take a screenshot
+ *
+ * PNG encoding a large display takes long enough to drop frames, so the
+ * render thread only memcpys the pixels into a snapshot buffer and a
+ * persistent worker thread does the compression and file write.
  */
+typedef struct {
+	int width;
+	int height;
+	void * data;
+} screenshot_job_t;
+
+static screenshot_job_t * volatile screenshot_pending = NULL;
+static pthread_mutex_t screenshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t screenshot_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t screenshot_thread;
+static int screenshot_thread_started = 0;
+
+static void * screenshot_worker(void * garbage) {
+	while (1) {
+		pthread_mutex_lock(&screenshot_lock);
+		while (!screenshot_pending) {
+			pthread_cond_wait(&screenshot_cond, &screenshot_lock);
+		}
+		screenshot_job_t * job = (screenshot_job_t *)screenshot_pending;
+		screenshot_pending = NULL;
+		pthread_mutex_unlock(&screenshot_lock);
+
+		cairo_surface_t * s = cairo_image_surface_create_for_data(job->data, CAIRO_FORMAT_ARGB32, job->width, job->height, job->width * 4);
+		cairo_surface_write_to_png(s, "/tmp/screenshot.png");
+		cairo_surface_destroy(s);
+
+		free(job->data);
+		free(job);
+	}
+	return NULL;
+}
+
 static void yutani_screenshot(yutani_globals_t * yg) {
 	int target_width;
 	int target_height;
@@ -938,42 +1332,115 @@ static void yutani_screenshot(yutani_globals_t * yg) {
 			if (!yg->focused_window) goto screenshot_done;
 			target_width = yg->focused_window->width;
 			target_height = yg->focused_window->height;
-			target_data = yg->focused_window->buffer;
+			target_data = window_front_buffer(yg->focused_window);
 			break;
 		default:
 			/* ??? */
 			goto screenshot_done;
 	}
 
-	cairo_surface_t * s = cairo_image_surface_create_for_data(target_data, CAIRO_FORMAT_ARGB32, target_width, target_height, target_width * 4);
+	screenshot_job_t * job = malloc(sizeof(screenshot_job_t));
+	job->width = target_width;
+	job->height = target_height;
+	job->data = malloc(target_width * target_height * 4);
+	memcpy(job->data, target_data, target_width * target_height * 4);
 
-	cairo_surface_write_to_png(s, "/tmp/screenshot.png");
+	if (!screenshot_thread_started) {
+		pthread_create(&screenshot_thread, NULL, screenshot_worker, NULL);
+		screenshot_thread_started = 1;
+	}
 
-	cairo_surface_destroy(s);
+	pthread_mutex_lock(&screenshot_lock);
+	if (screenshot_pending) {
+		/* The worker hasn't picked up the last one yet; replace it. */
+		screenshot_job_t * old = (screenshot_job_t *)screenshot_pending;
+		free(old->data);
+		free(old);
+	}
+	screenshot_pending = job;
+	pthread_cond_signal(&screenshot_cond);
+	pthread_mutex_unlock(&screenshot_lock);
 
 screenshot_done:
 	yg->screenshot_frame = 0;
 }
 
+/**
+ * Is anything on screen animating this frame?
+ */
+static int windows_are_animating(yutani_globals_t * yg) {
+	if (yg->bottom_z && yg->bottom_z->anim_mode) return 1;
+	if (yg->top_z && yg->top_z->anim_mode) return 1;
+	foreach (node, yg->mid_zs) {
+		yutani_server_window_t * w = node->value;
+		if (w && w->anim_mode) return 1;
+	}
+	return 0;
+}
+
 /**
  * Redraw all windows, as well as the mouse cursor.
  *
- * This is the main redraw function.
+ * This is the main redraw function. Returns nonzero if any
+ * compositing work was actually done.
  */
-static void redraw_windows(yutani_globals_t * yg) {
-	/* Save the cairo contexts so we can apply clipping */
-	save_cairo_states(yg);
-	int has_updates = 0;
-
+static int redraw_windows(yutani_globals_t * yg) {
 	/* We keep our own temporary mouse coordinates as they may change while we're drawing. */
 	int tmp_mouse_x = yg->mouse_x;
 	int tmp_mouse_y = yg->mouse_y;
 
+	/* Stage this frame's counters; redraw() publishes them */
+	memset(&yg->perf_frame, 0, sizeof(yg->perf_frame));
+	yg->perf_frame.queue_depth = yg->update_list->length;
+
+	if (yg->debug_hud) {
+		/* The HUD strip repaints every frame while it is up */
+		mark_screen(yg, 0, 0, YUTANI_PERF_FRAMES * HUD_BAR_W, HUD_HEIGHT);
+	}
+
+	if (yg->hardware_cursor &&
+	    (tmp_mouse_x != yg->last_mouse_x || tmp_mouse_y != yg->last_mouse_y)) {
+		/* The host moves the cursor plane itself; all we owe it is a
+		 * sprite check, and no damage is generated. */
+		update_hardware_cursor(yg);
+		yg->last_mouse_x = tmp_mouse_x;
+		yg->last_mouse_y = tmp_mouse_y;
+	}
+
+	/*
+	 * Skip the frame entirely when nothing can have changed. The
+	 * unlocked length read is just a hint - damage queued while we
+	 * check is picked up next frame, a frame's delay at worst.
+	 */
+	if (tmp_mouse_x == yg->last_mouse_x && tmp_mouse_y == yg->last_mouse_y &&
+	    !yg->update_list->length && !windows_are_animating(yg) &&
+	    !yg->screenshot_frame && !yg->resize_on_next) {
+		return 0;
+	}
+
+	/* Save the cairo contexts so we can apply clipping */
+	save_cairo_states(yg);
+
+	/* This frame's damage rectangles */
+	list_t * damage = list_create();
+
 	/* If the mouse has moved, that counts as two damage regions */
 	if ((yg->last_mouse_x != tmp_mouse_x) || (yg->last_mouse_y != tmp_mouse_y)) {
-		has_updates = 2;
-		yutani_add_clip(yg, yg->last_mouse_x / MOUSE_SCALE - MOUSE_OFFSET_X, yg->last_mouse_y / MOUSE_SCALE - MOUSE_OFFSET_Y, MOUSE_WIDTH, MOUSE_HEIGHT);
-		yutani_add_clip(yg, tmp_mouse_x / MOUSE_SCALE - MOUSE_OFFSET_X, tmp_mouse_y / MOUSE_SCALE - MOUSE_OFFSET_Y, MOUSE_WIDTH, MOUSE_HEIGHT);
+		yutani_damage_rect_t * rect;
+
+		rect = malloc(sizeof(yutani_damage_rect_t));
+		rect->x = yg->last_mouse_x / MOUSE_SCALE - MOUSE_OFFSET_X;
+		rect->y = yg->last_mouse_y / MOUSE_SCALE - MOUSE_OFFSET_Y;
+		rect->width = MOUSE_WIDTH;
+		rect->height = MOUSE_HEIGHT;
+		list_insert(damage, rect);
+
+		rect = malloc(sizeof(yutani_damage_rect_t));
+		rect->x = tmp_mouse_x / MOUSE_SCALE - MOUSE_OFFSET_X;
+		rect->y = tmp_mouse_y / MOUSE_SCALE - MOUSE_OFFSET_Y;
+		rect->width = MOUSE_WIDTH;
+		rect->height = MOUSE_HEIGHT;
+		list_insert(damage, rect);
 	}
 
 	yg->last_mouse_x = tmp_mouse_x;
@@ -986,34 +1453,52 @@ static void redraw_windows(yutani_globals_t * yg) {
 		if (w && w->anim_mode) mark_window(yg, w);
 	}
 
-	/* Calculate damage regions from currently queued updates */
+	/* Collect damage regions queued since the last frame */
 	spin_lock(&yg->update_list_lock);
 	while (yg->update_list->length) {
 		node_t * win = list_dequeue(yg->update_list);
-		yutani_damage_rect_t * rect = (void *)win->value;
-
-		/* We add a clip region for each window in the update queue */
-		has_updates = 1;
-		yutani_add_clip(yg, rect->x, rect->y, rect->width, rect->height);
-		free(rect);
+		list_insert(damage, win->value);
 		free(win);
 	}
 	spin_unlock(&yg->update_list_lock);
 
 	/* Render */
-	if (has_updates) {
-
-		yutani_set_clip(yg);
+	if (damage->length) {
 
 		yg->windows_to_remove = list_create();
 
+		spin_lock(&yg->redraw_lock);
+
 		/*
-		 * In theory, we should restrict this to windows within the clip region,
-		 * but calculating that may be more trouble than it's worth;
-		 * we also need to render windows in stacking order...
+		 * Composite each damaged rectangle separately: only the windows
+		 * actually visible within it get redrawn, so a cursor blip over
+		 * a full-screen window recomposites two small rectangles of that
+		 * window rather than everything the frame's damage touches.
 		 */
-		spin_lock(&yg->redraw_lock);
-		yutani_blit_windows(yg, yg->framebuffer_ctx);
+		foreach (dnode, damage) {
+			yutani_damage_rect_t * rect = dnode->value;
+
+			/* Clamp to the screen; drop rectangles entirely outside it */
+			int32_t x0 = max(rect->x, 0);
+			int32_t y0 = max(rect->y, 0);
+			int32_t x1 = min(rect->x + rect->width, yg->width);
+			int32_t y1 = min(rect->y + rect->height, yg->height);
+			if (x0 >= x1 || y0 >= y1) continue;
+
+			rect->x = x0;
+			rect->y = y0;
+			rect->width = x1 - x0;
+			rect->height = y1 - y0;
+
+			/* The final flip needs to cover the same area */
+			cairo_rectangle(yg->real_ctx, rect->x, rect->y, rect->width, rect->height);
+
+			yg->perf_frame.damage_rects++;
+			yg->perf_frame.damage_area += rect->width * rect->height;
+
+			yutani_blit_rect(yg, yg->framebuffer_ctx, rect);
+		}
+		cairo_clip(yg->real_ctx);
 
 #if YUTANI_DEBUG_WINDOW_SHAPES
 #define WINDOW_SHAPE_VIEWER_SIZE 20
@@ -1035,6 +1520,10 @@ static void redraw_windows(yutani_globals_t * yg) {
 		}
 #endif
 
+		if (yg->debug_hud && yg->perf) {
+			draw_perf_hud(yg);
+		}
+
 		if (yutani_options.nested) {
 			flip(yg->backend_ctx);
 			/*
@@ -1051,9 +1540,13 @@ static void redraw_windows(yutani_globals_t * yg) {
 			 * We may also want to draw other compositor elements, like effects, but those
 			 * can also go in the stack order of the windows.
 			 */
-			yutani_server_window_t * tmp_window = top_at(yg, yg->mouse_x / MOUSE_SCALE, yg->mouse_y / MOUSE_SCALE);
-			if (!tmp_window || tmp_window->show_mouse) {
-				draw_cursor(yg, tmp_mouse_x, tmp_mouse_y, tmp_window ? tmp_window->show_mouse : 1);
+			if (yg->hardware_cursor) {
+				update_hardware_cursor(yg);
+			} else {
+				yutani_server_window_t * tmp_window = top_at(yg, yg->mouse_x / MOUSE_SCALE, yg->mouse_y / MOUSE_SCALE);
+				if (!tmp_window || tmp_window->show_mouse) {
+					draw_cursor(yg, tmp_mouse_x, tmp_mouse_y, tmp_window ? tmp_window->show_mouse : 1);
+				}
 			}
 
 			/*
@@ -1082,6 +1575,10 @@ static void redraw_windows(yutani_globals_t * yg) {
 
 	}
 
+	list_destroy(damage);
+	list_free(damage);
+	free(damage);
+
 	if (yg->screenshot_frame) {
 		yutani_screenshot(yg);
 	}
@@ -1126,6 +1623,7 @@ static void redraw_windows(yutani_globals_t * yg) {
 		spin_unlock(&yg->redraw_lock);
 	}
 
+	return 1;
 }
 
 /**
@@ -1154,21 +1652,74 @@ void yutani_cairo_init(yutani_globals_t * yg) {
  */
 void * redraw(void * in) {
 	yutani_globals_t * yg = in;
+
+	/* Nested sessions are paced by the host compositor instead */
+	int use_vsync = !yutani_options.nested;
+
+	/* Rolling per-frame timing stats, reported every ~10 seconds */
+	long composited = 0, skipped = 0;
+	long frame_time_total = 0, frame_time_worst = 0;
+	struct timeval report_last;
+	gettimeofday(&report_last, NULL);
+
 	while (1) {
+		struct timeval frame_start;
+		gettimeofday(&frame_start, NULL);
+
 		/*
-		 * Perform whatever redraw work is required.
+		 * Perform whatever redraw work is required; frames with no
+		 * pending damage are skipped entirely.
 		 */
-		redraw_windows(yg);
+		int did_work = redraw_windows(yg);
+
+		struct timeval frame_end;
+		gettimeofday(&frame_end, NULL);
+		long elapsed = (frame_end.tv_sec - frame_start.tv_sec) * 1000000L
+		             + (frame_end.tv_usec - frame_start.tv_usec);
+		if (elapsed < 0) elapsed = 0;
+
+		if (did_work) {
+			composited++;
+			frame_time_total += elapsed;
+			if (elapsed > frame_time_worst) frame_time_worst = elapsed;
+			if (yg->perf) {
+				/* Publish the staged frame; bump sequence last so
+				 * readers never see a half-written slot */
+				yg->perf_frame.frame_time = elapsed;
+				yg->perf->frames[yg->perf->sequence % YUTANI_PERF_FRAMES] = yg->perf_frame;
+				yg->perf->sequence++;
+			}
+		} else {
+			skipped++;
+			if (yg->perf) yg->perf->frames_skipped++;
+		}
+
+		if (frame_end.tv_sec - report_last.tv_sec >= 10) {
+			if (composited) {
+				TRACE("frames: %d composited (avg %d usec, worst %d usec), %d skipped",
+						composited, frame_time_total / composited, frame_time_worst, skipped);
+			}
+			composited = skipped = 0;
+			frame_time_total = frame_time_worst = 0;
+			report_last = frame_end;
+		}
 
 		/*
-		 * Attempt to run at about 60fps...
-		 * we should actually see how long it took to render so
-		 * we can sleep *less* if it took a long time to render
-		 * this particular frame. We are definitely not
-		 * going to run at 60fps unless there's nothing to do
-		 * (and even then we've wasted cycles checking).
+		 * Pace against the display's vertical retrace when the video
+		 * driver reports one; otherwise aim for 60fps by sleeping off
+		 * what remains of the frame budget after compositing.
 		 */
-		usleep(16666);
+		if (use_vsync && framebuffer_wait_vsync() != 0) {
+			use_vsync = 0;
+		}
+		if (!use_vsync) {
+			if (elapsed < 16666) {
+				usleep(16666 - elapsed);
+			} else {
+				/* Over budget; let input and clients run before the next frame */
+				syscall_yield();
+			}
+		}
 	}
 }
 
@@ -1291,6 +1842,11 @@ static void window_actually_close(yutani_globals_t * yg, yutani_server_window_t
 		}
 	}
 
+	if (w->shape_spans) {
+		free(w->shape_spans);
+		w->shape_spans = NULL;
+	}
+
 	{
 		char key[1024];
 		YUTANI_SHMKEY_EXP(yg->server_ident, key, 1024, w->bufid);
@@ -1483,6 +2039,15 @@ static void handle_key_event(yutani_globals_t * yg, struct yutani_msg_key_event
 			return;
 		}
 #endif
+		if ((ke->event.action == KEY_ACTION_DOWN) &&
+			(ke->event.modifiers & KEY_MOD_LEFT_CTRL) &&
+			(ke->event.modifiers & KEY_MOD_LEFT_SHIFT) &&
+			(ke->event.keycode == 'g')) {
+			yg->debug_hud = (1-yg->debug_hud);
+			/* Repaint the strip to draw or erase it */
+			mark_screen(yg, 0, 0, YUTANI_PERF_FRAMES * HUD_BAR_W, HUD_HEIGHT);
+			return;
+		}
 		/*
 		 * Tiling hooks.
 		 * These are based on the compiz grid plugin.
@@ -2001,59 +2566,462 @@ static void yutani_display_resize_handle(int signum) {
 	_static_yg->resize_on_next = 1;
 }
 
-/**
- * main
- */
-int main(int argc, char * argv[]) {
-
-	int argx = 0;
-	int results = parse_args(argc, argv, &argx);
-	if (results) return results;
+/* How much client traffic we accept in one pass: 16 maximum-sized packets. */
+#define PEX_DRAIN_SIZE (PACKET_SIZE * 16)
 
-	yutani_globals_t * yg = malloc(sizeof(yutani_globals_t));
-	memset(yg, 0x00, sizeof(yutani_globals_t));
-
-	if (yutani_options.nested) {
-		yg->host_context = yutani_init();
-		yg->host_window = yutani_window_create(yg->host_context, yutani_options.nest_width, yutani_options.nest_height);
-		yutani_window_move(yg->host_context, yg->host_window, 50, 50);
-		yutani_window_advertise_icon(yg->host_context, yg->host_window, "Compositor", "compositor");
-		yg->backend_ctx = init_graphics_yutani_double_buffer(yg->host_window);
-	} else {
-		_static_yg = yg;
-		signal(SIGWINEVENT, yutani_display_resize_handle);
-		yg->backend_ctx = init_graphics_fullscreen_double_buffer();
+/*
+ * A window move is stale if a later message in the same burst moves the
+ * same window again; only the final position needs damage painted.
+ */
+static int yutani_msg_move_superseded(pex_packet_t * p, char * end) {
+	if (p->size == 0) return 0;
+	yutani_msg_t * m = (yutani_msg_t *)p->data;
+	if (m->magic != YUTANI_MSG__MAGIC || m->type != YUTANI_MSG_WINDOW_MOVE) return 0;
+	struct yutani_msg_window_move * wm = (void *)m->data;
+	for (pex_packet_t * q = pex_packet_next(p); (char *)q < end; q = pex_packet_next(q)) {
+		if (q->size == 0) continue;
+		yutani_msg_t * n = (yutani_msg_t *)q->data;
+		if (n->magic != YUTANI_MSG__MAGIC || n->type != YUTANI_MSG_WINDOW_MOVE) continue;
+		struct yutani_msg_window_move * qm = (void *)n->data;
+		if (qm->wid == wm->wid) return 1;
 	}
+	return 0;
+}
 
-	if (!yg->backend_ctx) {
-		free(yg);
-		TRACE("Failed to open framebuffer, bailing.");
-		return 1;
-	}
+/*
+ * Process one message from a client, already read off the wire.
+ */
+static void yutani_msg_handle(yutani_globals_t * yg, pex_packet_t * p) {
+	yutani_msg_t * m = (yutani_msg_t *)p->data;
+
+	if (p->size == 0) {
+		/* Connection closed for client */
+		TRACE("Connection closed for client  %x", p->source);
+
+		list_t * client_list = hashmap_get(yg->clients_to_windows, (void *)p->source);
+		if (client_list) {
+			foreach(node, client_list) {
+				yutani_server_window_t * win = node->value;
+				TRACE("Killing window %d", win->wid);
+				window_mark_for_close(yg, win);
+			}
+			hashmap_remove(yg->clients_to_windows, (void *)p->source);
+			list_free(client_list);
+			free(client_list);
+		}
 
-	{
-		struct timeval t;
-		gettimeofday(&t, NULL);
-		yg->start_time = t.tv_sec;
-		yg->start_subtime = t.tv_usec;
+		return;
 	}
 
-	yg->width = yg->backend_ctx->width;
-	yg->height = yg->backend_ctx->height;
+	if (m->magic != YUTANI_MSG__MAGIC) {
+		TRACE("Message has bad magic. (Should eject client, but will instead skip this message.) 0x%x", m->magic);
+		return;
+	}
 
-	draw_fill(yg->backend_ctx, rgb(0,0,0));
-	flip(yg->backend_ctx);
+	switch(m->type) {
+		case YUTANI_MSG_HELLO:
+			{
+				TRACE("And hello to you, %08x!", p->source);
+				list_t * client_list = hashmap_get(yg->clients_to_windows, (void *)p->source);
+				if (!client_list) {
+					TRACE("Client is new: %x", p->source);
+					client_list = list_create();
+					hashmap_set(yg->clients_to_windows, (void *)p->source, client_list);
+				}
+				yutani_msg_t * response = yutani_msg_build_welcome(yg->width, yg->height);
+				pex_send(yg->server, p->source, response->size, (char *)response);
+				free(response);
+			}
+			break;
+		case YUTANI_MSG_WINDOW_NEW:
+		case YUTANI_MSG_WINDOW_NEW_FLAGS:
+			{
+				struct yutani_msg_window_new_flags * wn = (void *)m->data;
+				TRACE("Client %08x requested a new window (%dx%d).", p->source, wn->width, wn->height);
+				yutani_server_window_t * w = server_window_create(yg, wn->width, wn->height, p->source, m->type != YUTANI_MSG_WINDOW_NEW ? wn->flags : 0);
+				yutani_msg_t * response = yutani_msg_build_window_init(w->wid, w->width, w->height, w->bufid);
+				pex_send(yg->server, p->source, response->size, (char *)response);
+				free(response);
 
-	yg->backend_framebuffer = yg->backend_ctx->backbuffer;
+				if (!(w->server_flags & YUTANI_WINDOW_FLAG_NO_STEAL_FOCUS)) {
+					set_focused_window(yg, w);
+				}
 
-	if (yutani_options.nested) {
-		char * name = malloc(sizeof(char) * 64);
-		snprintf(name, 64, "compositor-nest-%d", getpid());
-		yg->server_ident = name;
-	} else {
-		/* XXX check if this already exists? */
-		yg->server_ident = "compositor";
-	}
+				notify_subscribers(yg);
+			}
+			break;
+		case YUTANI_MSG_FLIP:
+			{
+				struct yutani_msg_flip * wf = (void *)m->data;
+				yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wf->wid);
+				if (w) {
+					/* The client just finished the other half; show it */
+					if (w->double_buffered) w->front_buffer ^= 1;
+					w->shape_dirty = 1;
+					mark_window(yg, w);
+				}
+			}
+			break;
+		case YUTANI_MSG_FLIP_REGION:
+			{
+				struct yutani_msg_flip_region * wf = (void *)m->data;
+				yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wf->wid);
+				if (w) {
+					/* Every flip is a swap, even a partial one */
+					if (w->double_buffered) w->front_buffer ^= 1;
+					w->shape_dirty = 1;
+					mark_window_relative(yg, w, wf->x, wf->y, wf->width, wf->height);
+				}
+			}
+			break;
+		case YUTANI_MSG_KEY_EVENT:
+			{
+				/* XXX Verify this is from a valid device client */
+				struct yutani_msg_key_event * ke = (void *)m->data;
+				handle_key_event(yg, ke);
+			}
+			break;
+		case YUTANI_MSG_MOUSE_EVENT:
+			{
+				/* XXX Verify this is from a valid device client */
+				struct yutani_msg_mouse_event * me = (void *)m->data;
+				handle_mouse_event(yg, me);
+			}
+			break;
+		case YUTANI_MSG_WINDOW_MOVE:
+			{
+				struct yutani_msg_window_move * wm = (void *)m->data;
+				TRACE("%08x wanted to move window %d to %d, %d", p->source, wm->wid, (int)wm->x, (int)wm->y);
+				if (wm->x > (int)yg->width + 100 || wm->x < -(int)yg->width || wm->y > (int)yg->height + 100 || wm->y < -(int)yg->height) {
+					TRACE("Refusing to move window to these coordinates.");
+					break;
+				}
+				yutani_server_window_t * win = hashmap_get(yg->wids_to_windows, (void*)wm->wid);
+				if (win) {
+					window_move(yg, win, wm->x, wm->y);
+				} else {
+					TRACE("%08x wanted to move window %d, but I can't find it?", p->source, wm->wid);
+				}
+			}
+			break;
+		case YUTANI_MSG_WINDOW_CLOSE:
+			{
+				struct yutani_msg_window_close * wc = (void *)m->data;
+				yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wc->wid);
+				if (w) {
+					window_mark_for_close(yg, w);
+					window_remove_from_client(yg, w);
+				}
+			}
+			break;
+		case YUTANI_MSG_WINDOW_STACK:
+			{
+				struct yutani_msg_window_stack * ws = (void *)m->data;
+				yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)ws->wid);
+				if (w) {
+					reorder_window(yg, w, ws->z);
+				}
+			}
+			break;
+		case YUTANI_MSG_RESIZE_REQUEST:
+			{
+				struct yutani_msg_window_resize * wr = (void *)m->data;
+				yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wr->wid);
+				if (w) {
+					yutani_msg_t * response = yutani_msg_build_window_resize(YUTANI_MSG_RESIZE_OFFER, w->wid, wr->width, wr->height, 0);
+					pex_send(yg->server, p->source, response->size, (char *)response);
+					free(response);
+				}
+			}
+			break;
+		case YUTANI_MSG_RESIZE_OFFER:
+			{
+				struct yutani_msg_window_resize * wr = (void *)m->data;
+				yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wr->wid);
+				if (w) {
+					yutani_msg_t * response = yutani_msg_build_window_resize(YUTANI_MSG_RESIZE_OFFER, w->wid, wr->width, wr->height, 0);
+					pex_send(yg->server, p->source, response->size, (char *)response);
+					free(response);
+				}
+			}
+			break;
+		case YUTANI_MSG_RESIZE_ACCEPT:
+			{
+				struct yutani_msg_window_resize * wr = (void *)m->data;
+				yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wr->wid);
+				if (w) {
+					uint32_t newbufid = server_window_resize(yg, w, wr->width, wr->height);
+					yutani_msg_t * response = yutani_msg_build_window_resize(YUTANI_MSG_RESIZE_BUFID, w->wid, wr->width, wr->height, newbufid);
+					pex_send(yg->server, p->source, response->size, (char *)response);
+					free(response);
+				}
+			}
+			break;
+		case YUTANI_MSG_RESIZE_DONE:
+			{
+				struct yutani_msg_window_resize * wr = (void *)m->data;
+				yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wr->wid);
+				if (w) {
+					server_window_resize_finish(yg, w, wr->width, wr->height);
+				}
+			}
+			break;
+		case YUTANI_MSG_QUERY_WINDOWS:
+			{
+				yutani_query_result(yg, p->source, yg->bottom_z);
+				foreach (node, yg->mid_zs) {
+					yutani_query_result(yg, p->source, node->value);
+				}
+				yutani_query_result(yg, p->source, yg->top_z);
+				yutani_msg_t * response = yutani_msg_build_window_advertise(0, 0, NULL, 0, NULL);
+				pex_send(yg->server, p->source, response->size, (char *)response);
+				free(response);
+			}
+			break;
+		case YUTANI_MSG_SUBSCRIBE:
+			{
+				foreach(node, yg->window_subscribers) {
+					if ((uint32_t)node->value == p->source) {
+						break;
+					}
+				}
+				list_insert(yg->window_subscribers, (void*)p->source);
+			}
+			break;
+		case YUTANI_MSG_UNSUBSCRIBE:
+			{
+				node_t * node = list_find(yg->window_subscribers, (void*)p->source);
+				if (node) {
+					list_delete(yg->window_subscribers, node);
+				}
+			}
+			break;
+		case YUTANI_MSG_WINDOW_ADVERTISE:
+			{
+				struct yutani_msg_window_advertise * wa = (void *)m->data;
+				yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wa->wid);
+				if (w) {
+					if (w->client_strings) free(w->client_strings);
+
+					for (int i = 0; i < 5; ++i) {
+						w->client_offsets[i] = wa->offsets[i];
+					}
+
+					w->client_flags   = wa->flags;
+					w->client_length  = wa->size;
+					w->client_strings = malloc(wa->size);
+					memcpy(w->client_strings, wa->strings, wa->size);
+
+					notify_subscribers(yg);
+				}
+			}
+			break;
+		case YUTANI_MSG_SESSION_END:
+			{
+				yutani_msg_t * response = yutani_msg_build_session_end();
+				pex_broadcast(yg->server, response->size, (char *)response);
+				free(response);
+			}
+			break;
+		case YUTANI_MSG_WINDOW_FOCUS:
+			{
+				struct yutani_msg_window_focus * wa = (void *)m->data;
+				yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wa->wid);
+				if (w) {
+					set_focused_window(yg, w);
+				}
+			}
+			break;
+		case YUTANI_MSG_KEY_BIND:
+			{
+				struct yutani_msg_key_bind * wa = (void *)m->data;
+				add_key_bind(yg, wa, p->source);
+			}
+			break;
+		case YUTANI_MSG_WINDOW_DRAG_START:
+			{
+				struct yutani_msg_window_drag_start * wa = (void *)m->data;
+				yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wa->wid);
+				if (w) {
+					/* Start dragging */
+					mouse_start_drag(yg, w);
+				}
+			}
+			break;
+		case YUTANI_MSG_WINDOW_UPDATE_SHAPE:
+			{
+				struct yutani_msg_window_update_shape * wa = (void *)m->data;
+				yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wa->wid);
+				if (w) {
+					/* Set shape parameter */
+					server_window_update_shape(yg, w, wa->set_shape);
+				}
+			}
+			break;
+		case YUTANI_MSG_WINDOW_WARP_MOUSE:
+			{
+				struct yutani_msg_window_warp_mouse * wa = (void *)m->data;
+				yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wa->wid);
+				if (w) {
+					if (yg->focused_window == w) {
+						int32_t x, y;
+						window_to_device(w, wa->x, wa->y, &x, &y);
+
+						struct yutani_msg_mouse_event me;
+						me.event.x_difference = x;
+						me.event.y_difference = y;
+						me.event.buttons = 0;
+						me.type = YUTANI_MOUSE_EVENT_TYPE_ABSOLUTE;
+						me.wid = wa->wid;
+
+						handle_mouse_event(yg, &me);
+					}
+				}
+			}
+			break;
+		case YUTANI_MSG_WINDOW_SHOW_MOUSE:
+			{
+				struct yutani_msg_window_show_mouse * wa = (void *)m->data;
+				yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wa->wid);
+				if (w) {
+					if (wa->show_mouse == -1) {
+						w->show_mouse = w->default_mouse;
+					} else if (wa->show_mouse < 2) {
+						w->default_mouse = wa->show_mouse;
+						w->show_mouse = wa->show_mouse;
+					} else {
+						w->show_mouse = wa->show_mouse;
+					}
+					if (yg->focused_window == w) {
+						mark_screen(yg, yg->mouse_x / MOUSE_SCALE - MOUSE_OFFSET_X, yg->mouse_y / MOUSE_SCALE - MOUSE_OFFSET_Y, MOUSE_WIDTH, MOUSE_HEIGHT);
+					}
+				}
+			}
+			break;
+		case YUTANI_MSG_WINDOW_RESIZE_START:
+			{
+				struct yutani_msg_window_resize_start * wa = (void *)m->data;
+				yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wa->wid);
+				if (w) {
+					if (yg->focused_window == w && !yg->resizing_window) {
+						yg->resizing_window = w;
+						yg->resizing_button = YUTANI_MOUSE_BUTTON_LEFT; /* XXX Uh, what if we used something else */
+						mouse_start_resize(yg, wa->direction);
+					}
+				}
+			}
+			break;
+		case YUTANI_MSG_TIMER_REQUEST:
+			{
+				struct yutani_msg_timer_request * tr = (void *)m->data;
+
+				/* TODO: precision */
+				if (tr->flags & 1) {
+					/* Unsubscribe */
+					node_t * node = list_find(yg->timer_subscribers, (void*)p->source);
+					if (node) {
+						list_delete(yg->timer_subscribers, node);
+					}
+				} else {
+					/* Subscribe */
+					foreach(node, yg->timer_subscribers) {
+						if ((uint32_t)node->value == p->source) {
+							break;
+						}
+					}
+					list_insert(yg->timer_subscribers, (void*)p->source);
+				}
+			}
+			break;
+		case YUTANI_MSG_TIMER_TICK:
+			{
+				/* Send timer ticks to requesters */
+				yutani_msg_t * response = yutani_msg_build_timer_tick();
+				list_t * remove = NULL;
+				foreach(node, yg->timer_subscribers) {
+					uint32_t subscriber = (uint32_t)node->value;
+
+					if (!hashmap_has(yg->clients_to_windows, (void *)subscriber)) {
+						if (!remove) {
+							remove = list_create();
+						}
+						list_insert(remove, node);
+					} else {
+						pex_send(yg->server, subscriber, response->size, (char *)response);
+					}
+				}
+				if (remove) {
+					while (remove->length) {
+						node_t * n = list_pop(remove);
+						list_delete(yg->timer_subscribers, n->value);
+						free(n);
+					}
+					free(remove);
+				}
+				free(response);
+			}
+			break;
+		default:
+			{
+				TRACE("Unknown type: 0x%8x", m->type);
+			}
+			break;
+	}
+}
+
+/**
+ * main
+ */
+int main(int argc, char * argv[]) {
+
+	int argx = 0;
+	int results = parse_args(argc, argv, &argx);
+	if (results) return results;
+
+	yutani_globals_t * yg = malloc(sizeof(yutani_globals_t));
+	memset(yg, 0x00, sizeof(yutani_globals_t));
+
+	if (yutani_options.nested) {
+		yg->host_context = yutani_init();
+		yg->host_window = yutani_window_create(yg->host_context, yutani_options.nest_width, yutani_options.nest_height);
+		yutani_window_move(yg->host_context, yg->host_window, 50, 50);
+		yutani_window_advertise_icon(yg->host_context, yg->host_window, "Compositor", "compositor");
+		yg->backend_ctx = init_graphics_yutani_double_buffer(yg->host_window);
+	} else {
+		_static_yg = yg;
+		signal(SIGWINEVENT, yutani_display_resize_handle);
+		yg->backend_ctx = init_graphics_fullscreen_double_buffer();
+	}
+
+	if (!yg->backend_ctx) {
+		free(yg);
+		TRACE("Failed to open framebuffer, bailing.");
+		return 1;
+	}
+
+	{
+		struct timeval t;
+		gettimeofday(&t, NULL);
+		yg->start_time = t.tv_sec;
+		yg->start_subtime = t.tv_usec;
+	}
+
+	yg->width = yg->backend_ctx->width;
+	yg->height = yg->backend_ctx->height;
+
+	draw_fill(yg->backend_ctx, rgb(0,0,0));
+	flip(yg->backend_ctx);
+
+	yg->backend_framebuffer = yg->backend_ctx->backbuffer;
+
+	if (yutani_options.nested) {
+		char * name = malloc(sizeof(char) * 64);
+		snprintf(name, 64, "compositor-nest-%d", getpid());
+		yg->server_ident = name;
+	} else {
+		/* XXX check if this already exists? */
+		yg->server_ident = "compositor";
+	}
 	setenv("DISPLAY", yg->server_ident, 1);
 
 	FILE * server = pex_bind(yg->server_ident);
@@ -2063,6 +3031,20 @@ int main(int argc, char * argv[]) {
 	load_fonts(yg);
 	TRACE("Done.");
 
+	load_sprite_cache(yg);
+
+	{
+		/* Publish the performance counter block */
+		char key[64];
+		YUTANI_PERF_KEY(yg->server_ident, key, 64);
+		size_t size = sizeof(yutani_perf_t);
+		yg->perf = (yutani_perf_t *)syscall_shm_obtain(key, &size);
+		if (yg->perf) {
+			memset(yg->perf, 0, sizeof(yutani_perf_t));
+			yg->perf->magic = YUTANI_PERF_MAGIC;
+		}
+	}
+
 	load_sprite_png(&yg->mouse_sprite, "/usr/share/cursor/normal.png");
 
 	load_sprite_png(&yg->mouse_sprite_drag, "/usr/share/cursor/drag.png");
@@ -2071,6 +3053,15 @@ int main(int argc, char * argv[]) {
 	load_sprite_png(&yg->mouse_sprite_resize_da, "/usr/share/cursor/resize-uldr.png");
 	load_sprite_png(&yg->mouse_sprite_resize_db, "/usr/share/cursor/resize-dlur.png");
 
+	/* If the video backend can draw the cursor itself, let it */
+	if (!yutani_options.nested) {
+		yg->hardware_cursor = (framebuffer_set_cursor(yg->mouse_sprite.width, yg->mouse_sprite.height,
+				MOUSE_OFFSET_X, MOUSE_OFFSET_Y, yg->mouse_sprite.bitmap) == 0);
+		if (yg->hardware_cursor) {
+			TRACE("Display backend accepted a hardware cursor.");
+		}
+	}
+
 	yg->last_mouse_x = 0;
 	yg->last_mouse_y = 0;
 	yg->mouse_x = yg->width * MOUSE_SCALE / 2;
@@ -2095,6 +3086,10 @@ int main(int argc, char * argv[]) {
 	pthread_create(&render_thread, NULL, redraw, yg);
 	pthread_create(&timer_thread, NULL, timer_tick, yg);
 
+	/* Boot timeline milestone (sysfunc 16): the server is accepting
+	 * clients and rendering from here on. */
+	syscall_system_function(16, (char **)"compositor ready");
+
 	if (!fork()) {
 		if (argx < argc) {
 			TRACE("Starting alternate startup app: %s", argv[argx]);
@@ -2106,10 +3101,11 @@ int main(int argc, char * argv[]) {
 	}
 
 	int fds[4], mfd, kfd, amfd;
-	mouse_device_packet_t packet;
 	key_event_t event;
 	key_event_state_t state = {0};
 
+	char * pex_buffer = malloc(PEX_DRAIN_SIZE);
+
 	fds[0] = fileno(server);
 
 	if (yutani_options.nested) {
@@ -2169,36 +3165,61 @@ int main(int argc, char * argv[]) {
 							break;
 					}
 				}
-				free(m);
+				yutani_msg_free(yg->host_context, m);
 				continue;
 			}
 		} else {
 			int index = syscall_fswait(amfd == -1 ? 3 : 4, fds);
 
 			if (index == 2) {
-				char buf[1];
-				int r = read(kfd, buf, 1);
-				if (r > 0) {
-					kbd_scancode(&state, buf[0], &event);
+				/* The driver batches everything a single interrupt
+				 * delivered, so take it all in one read and run each
+				 * byte through the scancode state machine. */
+				char buf[64];
+				int r = read(kfd, buf, sizeof(buf));
+				for (int j = 0; j < r; ++j) {
+					kbd_scancode(&state, buf[j], &event);
 					yutani_msg_t * m = yutani_msg_build_key_event(0, &event, &state);
 					handle_key_event(yg, (struct yutani_msg_key_event *)m->data);
 					free(m);
 				}
 				continue;
 			} else if (index == 1) {
-				int r = read(mfd, (char *)&packet, sizeof(mouse_device_packet_t));
-				if (r > 0) {
-					yg->last_mouse_buttons = packet.buttons;
-					yutani_msg_t * m = yutani_msg_build_mouse_event(0, &packet, YUTANI_MOUSE_EVENT_TYPE_RELATIVE);
+				/* Take everything the driver has queued in one read and
+				 * merge runs of motion with the same button state; a fast
+				 * mouse costs one damage pass, not one per packet. */
+				mouse_device_packet_t packets[32];
+				int r = read(mfd, (char *)packets, sizeof(packets));
+				int count = r > 0 ? r / (int)sizeof(mouse_device_packet_t) : 0;
+				int i = 0;
+				while (i < count) {
+					mouse_device_packet_t merged = packets[i++];
+					/* Scroll packets are each one tick; never merge those. */
+					while (i < count && packets[i].buttons == merged.buttons &&
+							!(merged.buttons & (MOUSE_SCROLL_UP | MOUSE_SCROLL_DOWN))) {
+						merged.x_difference += packets[i].x_difference;
+						merged.y_difference += packets[i].y_difference;
+						i++;
+					}
+					yg->last_mouse_buttons = merged.buttons;
+					yutani_msg_t * m = yutani_msg_build_mouse_event(0, &merged, YUTANI_MOUSE_EVENT_TYPE_RELATIVE);
 					handle_mouse_event(yg, (struct yutani_msg_mouse_event *)m->data);
 					free(m);
 				}
 				continue;
 			} else if (index == 3) {
-				int r = read(amfd, (char *)&packet, sizeof(mouse_device_packet_t));
-				if (r > 0) {
-					packet.buttons = yg->last_mouse_buttons & 0xF;
-					yutani_msg_t * m = yutani_msg_build_mouse_event(0, &packet, YUTANI_MOUSE_EVENT_TYPE_ABSOLUTE);
+				mouse_device_packet_t packets[32];
+				int r = read(amfd, (char *)packets, sizeof(packets));
+				int count = r > 0 ? r / (int)sizeof(mouse_device_packet_t) : 0;
+				int i = 0;
+				while (i < count) {
+					mouse_device_packet_t last = packets[i++];
+					/* Absolute positions: only the final one matters. */
+					while (i < count && packets[i].buttons == last.buttons) {
+						last = packets[i++];
+					}
+					last.buttons = yg->last_mouse_buttons & 0xF;
+					yutani_msg_t * m = yutani_msg_build_mouse_event(0, &last, YUTANI_MOUSE_EVENT_TYPE_ABSOLUTE);
 					handle_mouse_event(yg, (struct yutani_msg_mouse_event *)m->data);
 					free(m);
 				}
@@ -2206,381 +3227,17 @@ int main(int argc, char * argv[]) {
 			}
 		}
 
-		pex_packet_t * p = calloc(PACKET_SIZE, 1);
-		pex_listen(server, p);
-
-		yutani_msg_t * m = (yutani_msg_t *)p->data;
-
-		if (p->size == 0) {
-			/* Connection closed for client */
-			TRACE("Connection closed for client  %x", p->source);
-
-			list_t * client_list = hashmap_get(yg->clients_to_windows, (void *)p->source);
-			if (client_list) {
-				foreach(node, client_list) {
-					yutani_server_window_t * win = node->value;
-					TRACE("Killing window %d", win->wid);
-					window_mark_for_close(yg, win);
-				}
-				hashmap_remove(yg->clients_to_windows, (void *)p->source);
-				list_free(client_list);
-				free(client_list);
+		/* Drain everything queued on the socket in one syscall; a burst
+		 * of client traffic should cost one pass, not one wakeup each. */
+		size_t r = pex_drain(server, pex_buffer, PEX_DRAIN_SIZE);
+		char * end = pex_buffer + r;
+		pex_packet_t * p = (pex_packet_t *)pex_buffer;
+		while ((char *)p < end) {
+			if (!yutani_msg_move_superseded(p, end)) {
+				yutani_msg_handle(yg, p);
 			}
-
-			free(p);
-			continue;
-		}
-
-		if (m->magic != YUTANI_MSG__MAGIC) {
-			TRACE("Message has bad magic. (Should eject client, but will instead skip this message.) 0x%x", m->magic);
-			free(p);
-			continue;
-		}
-
-		switch(m->type) {
-			case YUTANI_MSG_HELLO:
-				{
-					TRACE("And hello to you, %08x!", p->source);
-					list_t * client_list = hashmap_get(yg->clients_to_windows, (void *)p->source);
-					if (!client_list) {
-						TRACE("Client is new: %x", p->source);
-						client_list = list_create();
-						hashmap_set(yg->clients_to_windows, (void *)p->source, client_list);
-					}
-					yutani_msg_t * response = yutani_msg_build_welcome(yg->width, yg->height);
-					pex_send(server, p->source, response->size, (char *)response);
-					free(response);
-				}
-				break;
-			case YUTANI_MSG_WINDOW_NEW:
-			case YUTANI_MSG_WINDOW_NEW_FLAGS:
-				{
-					struct yutani_msg_window_new_flags * wn = (void *)m->data;
-					TRACE("Client %08x requested a new window (%dx%d).", p->source, wn->width, wn->height);
-					yutani_server_window_t * w = server_window_create(yg, wn->width, wn->height, p->source, m->type != YUTANI_MSG_WINDOW_NEW ? wn->flags : 0);
-					yutani_msg_t * response = yutani_msg_build_window_init(w->wid, w->width, w->height, w->bufid);
-					pex_send(server, p->source, response->size, (char *)response);
-					free(response);
-
-					if (!(w->server_flags & YUTANI_WINDOW_FLAG_NO_STEAL_FOCUS)) {
-						set_focused_window(yg, w);
-					}
-
-					notify_subscribers(yg);
-				}
-				break;
-			case YUTANI_MSG_FLIP:
-				{
-					struct yutani_msg_flip * wf = (void *)m->data;
-					yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wf->wid);
-					if (w) {
-						mark_window(yg, w);
-					}
-				}
-				break;
-			case YUTANI_MSG_FLIP_REGION:
-				{
-					struct yutani_msg_flip_region * wf = (void *)m->data;
-					yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wf->wid);
-					if (w) {
-						mark_window_relative(yg, w, wf->x, wf->y, wf->width, wf->height);
-					}
-				}
-				break;
-			case YUTANI_MSG_KEY_EVENT:
-				{
-					/* XXX Verify this is from a valid device client */
-					struct yutani_msg_key_event * ke = (void *)m->data;
-					handle_key_event(yg, ke);
-				}
-				break;
-			case YUTANI_MSG_MOUSE_EVENT:
-				{
-					/* XXX Verify this is from a valid device client */
-					struct yutani_msg_mouse_event * me = (void *)m->data;
-					handle_mouse_event(yg, me);
-				}
-				break;
-			case YUTANI_MSG_WINDOW_MOVE:
-				{
-					struct yutani_msg_window_move * wm = (void *)m->data;
-					TRACE("%08x wanted to move window %d to %d, %d", p->source, wm->wid, (int)wm->x, (int)wm->y);
-					if (wm->x > (int)yg->width + 100 || wm->x < -(int)yg->width || wm->y > (int)yg->height + 100 || wm->y < -(int)yg->height) {
-						TRACE("Refusing to move window to these coordinates.");
-						break;
-					}
-					yutani_server_window_t * win = hashmap_get(yg->wids_to_windows, (void*)wm->wid);
-					if (win) {
-						window_move(yg, win, wm->x, wm->y);
-					} else {
-						TRACE("%08x wanted to move window %d, but I can't find it?", p->source, wm->wid);
-					}
-				}
-				break;
-			case YUTANI_MSG_WINDOW_CLOSE:
-				{
-					struct yutani_msg_window_close * wc = (void *)m->data;
-					yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wc->wid);
-					if (w) {
-						window_mark_for_close(yg, w);
-						window_remove_from_client(yg, w);
-					}
-				}
-				break;
-			case YUTANI_MSG_WINDOW_STACK:
-				{
-					struct yutani_msg_window_stack * ws = (void *)m->data;
-					yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)ws->wid);
-					if (w) {
-						reorder_window(yg, w, ws->z);
-					}
-				}
-				break;
-			case YUTANI_MSG_RESIZE_REQUEST:
-				{
-					struct yutani_msg_window_resize * wr = (void *)m->data;
-					yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wr->wid);
-					if (w) {
-						yutani_msg_t * response = yutani_msg_build_window_resize(YUTANI_MSG_RESIZE_OFFER, w->wid, wr->width, wr->height, 0);
-						pex_send(server, p->source, response->size, (char *)response);
-						free(response);
-					}
-				}
-				break;
-			case YUTANI_MSG_RESIZE_OFFER:
-				{
-					struct yutani_msg_window_resize * wr = (void *)m->data;
-					yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wr->wid);
-					if (w) {
-						yutani_msg_t * response = yutani_msg_build_window_resize(YUTANI_MSG_RESIZE_OFFER, w->wid, wr->width, wr->height, 0);
-						pex_send(server, p->source, response->size, (char *)response);
-						free(response);
-					}
-				}
-				break;
-			case YUTANI_MSG_RESIZE_ACCEPT:
-				{
-					struct yutani_msg_window_resize * wr = (void *)m->data;
-					yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wr->wid);
-					if (w) {
-						uint32_t newbufid = server_window_resize(yg, w, wr->width, wr->height);
-						yutani_msg_t * response = yutani_msg_build_window_resize(YUTANI_MSG_RESIZE_BUFID, w->wid, wr->width, wr->height, newbufid);
-						pex_send(server, p->source, response->size, (char *)response);
-						free(response);
-					}
-				}
-				break;
-			case YUTANI_MSG_RESIZE_DONE:
-				{
-					struct yutani_msg_window_resize * wr = (void *)m->data;
-					yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wr->wid);
-					if (w) {
-						server_window_resize_finish(yg, w, wr->width, wr->height);
-					}
-				}
-				break;
-			case YUTANI_MSG_QUERY_WINDOWS:
-				{
-					yutani_query_result(yg, p->source, yg->bottom_z);
-					foreach (node, yg->mid_zs) {
-						yutani_query_result(yg, p->source, node->value);
-					}
-					yutani_query_result(yg, p->source, yg->top_z);
-					yutani_msg_t * response = yutani_msg_build_window_advertise(0, 0, NULL, 0, NULL);
-					pex_send(server, p->source, response->size, (char *)response);
-					free(response);
-				}
-				break;
-			case YUTANI_MSG_SUBSCRIBE:
-				{
-					foreach(node, yg->window_subscribers) {
-						if ((uint32_t)node->value == p->source) {
-							break;
-						}
-					}
-					list_insert(yg->window_subscribers, (void*)p->source);
-				}
-				break;
-			case YUTANI_MSG_UNSUBSCRIBE:
-				{
-					node_t * node = list_find(yg->window_subscribers, (void*)p->source);
-					if (node) {
-						list_delete(yg->window_subscribers, node);
-					}
-				}
-				break;
-			case YUTANI_MSG_WINDOW_ADVERTISE:
-				{
-					struct yutani_msg_window_advertise * wa = (void *)m->data;
-					yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wa->wid);
-					if (w) {
-						if (w->client_strings) free(w->client_strings);
-
-						for (int i = 0; i < 5; ++i) {
-							w->client_offsets[i] = wa->offsets[i];
-						}
-
-						w->client_flags   = wa->flags;
-						w->client_length  = wa->size;
-						w->client_strings = malloc(wa->size);
-						memcpy(w->client_strings, wa->strings, wa->size);
-
-						notify_subscribers(yg);
-					}
-				}
-				break;
-			case YUTANI_MSG_SESSION_END:
-				{
-					yutani_msg_t * response = yutani_msg_build_session_end();
-					pex_broadcast(server, response->size, (char *)response);
-					free(response);
-				}
-				break;
-			case YUTANI_MSG_WINDOW_FOCUS:
-				{
-					struct yutani_msg_window_focus * wa = (void *)m->data;
-					yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wa->wid);
-					if (w) {
-						set_focused_window(yg, w);
-					}
-				}
-				break;
-			case YUTANI_MSG_KEY_BIND:
-				{
-					struct yutani_msg_key_bind * wa = (void *)m->data;
-					add_key_bind(yg, wa, p->source);
-				}
-				break;
-			case YUTANI_MSG_WINDOW_DRAG_START:
-				{
-					struct yutani_msg_window_drag_start * wa = (void *)m->data;
-					yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wa->wid);
-					if (w) {
-						/* Start dragging */
-						mouse_start_drag(yg, w);
-					}
-				}
-				break;
-			case YUTANI_MSG_WINDOW_UPDATE_SHAPE:
-				{
-					struct yutani_msg_window_update_shape * wa = (void *)m->data;
-					yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wa->wid);
-					if (w) {
-						/* Set shape parameter */
-						server_window_update_shape(yg, w, wa->set_shape);
-					}
-				}
-				break;
-			case YUTANI_MSG_WINDOW_WARP_MOUSE:
-				{
-					struct yutani_msg_window_warp_mouse * wa = (void *)m->data;
-					yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wa->wid);
-					if (w) {
-						if (yg->focused_window == w) {
-							int32_t x, y;
-							window_to_device(w, wa->x, wa->y, &x, &y);
-
-							struct yutani_msg_mouse_event me;
-							me.event.x_difference = x;
-							me.event.y_difference = y;
-							me.event.buttons = 0;
-							me.type = YUTANI_MOUSE_EVENT_TYPE_ABSOLUTE;
-							me.wid = wa->wid;
-
-							handle_mouse_event(yg, &me);
-						}
-					}
-				}
-				break;
-			case YUTANI_MSG_WINDOW_SHOW_MOUSE:
-				{
-					struct yutani_msg_window_show_mouse * wa = (void *)m->data;
-					yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wa->wid);
-					if (w) {
-						if (wa->show_mouse == -1) {
-							w->show_mouse = w->default_mouse;
-						} else if (wa->show_mouse < 2) {
-							w->default_mouse = wa->show_mouse;
-							w->show_mouse = wa->show_mouse;
-						} else {
-							w->show_mouse = wa->show_mouse;
-						}
-						if (yg->focused_window == w) {
-							mark_screen(yg, yg->mouse_x / MOUSE_SCALE - MOUSE_OFFSET_X, yg->mouse_y / MOUSE_SCALE - MOUSE_OFFSET_Y, MOUSE_WIDTH, MOUSE_HEIGHT);
-						}
-					}
-				}
-				break;
-			case YUTANI_MSG_WINDOW_RESIZE_START:
-				{
-					struct yutani_msg_window_resize_start * wa = (void *)m->data;
-					yutani_server_window_t * w = hashmap_get(yg->wids_to_windows, (void *)wa->wid);
-					if (w) {
-						if (yg->focused_window == w && !yg->resizing_window) {
-							yg->resizing_window = w;
-							yg->resizing_button = YUTANI_MOUSE_BUTTON_LEFT; /* XXX Uh, what if we used something else */
-							mouse_start_resize(yg, wa->direction);
-						}
-					}
-				}
-				break;
-			case YUTANI_MSG_TIMER_REQUEST:
-				{
-					struct yutani_msg_timer_request * tr = (void *)m->data;
-
-					/* TODO: precision */
-					if (tr->flags & 1) {
-						/* Unsubscribe */
-						node_t * node = list_find(yg->timer_subscribers, (void*)p->source);
-						if (node) {
-							list_delete(yg->timer_subscribers, node);
-						}
-					} else {
-						/* Subscribe */
-						foreach(node, yg->timer_subscribers) {
-							if ((uint32_t)node->value == p->source) {
-								break;
-							}
-						}
-						list_insert(yg->timer_subscribers, (void*)p->source);
-					}
-				}
-				break;
-			case YUTANI_MSG_TIMER_TICK:
-				{
-					/* Send timer ticks to requesters */
-					yutani_msg_t * response = yutani_msg_build_timer_tick();
-					list_t * remove = NULL;
-					foreach(node, yg->timer_subscribers) {
-						uint32_t subscriber = (uint32_t)node->value;
-
-						if (!hashmap_has(yg->clients_to_windows, (void *)subscriber)) {
-							if (!remove) {
-								remove = list_create();
-							}
-							list_insert(remove, node);
-						} else {
-							pex_send(yg->server, subscriber, response->size, (char *)response);
-						}
-					}
-					if (remove) {
-						while (remove->length) {
-							node_t * n = list_pop(remove);
-							list_delete(yg->timer_subscribers, n->value);
-							free(n);
-						}
-						free(remove);
-					}
-					free(response);
-				}
-				break;
-			default:
-				{
-					TRACE("Unknown type: 0x%8x", m->type);
-				}
-				break;
+			p = pex_packet_next(p);
 		}
-		free(p);
 	}
 
 	return 0;
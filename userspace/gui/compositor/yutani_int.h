@@ -3,6 +3,7 @@
 
 #include <cairo.h>
 #include "lib/yutani.h"
+#include "yutani_perf.h"
 #include "lib/list.h"
 #include "lib/hashmap.h"
 #include "lib/graphics.h"
@@ -46,6 +47,15 @@ typedef struct {
 	uint8_t * buffer;
 	uint32_t bufid;
 
+	/* Bytes actually reserved for `buffer`; resizes that fit reuse
+	 * the region in place instead of negotiating a new one. */
+	size_t buffer_capacity;
+
+	/* Double-buffered windows: the shm region holds two halves and
+	 * each flip swaps which one we display. */
+	int double_buffered;
+	int front_buffer;
+
 	uint32_t owner;
 
 	int16_t  rotation;
@@ -62,6 +72,13 @@ typedef struct {
 	uint32_t anim_start;
 
 	int alpha_threshold;
+
+	/* Shaped windows: cached per-row run of fully opaque pixels, so
+	 * blits copy the middle and only blend the translucent edges.
+	 * Rebuilt lazily after each flip. */
+	uint16_t * shape_spans;
+	int shape_dirty;
+
 	int show_mouse;
 
 	int tiled;
@@ -169,6 +186,16 @@ typedef struct {
 	int current_cursor;
 	int resize_on_next;
 
+	/* The video backend draws the cursor on its own plane, so motion
+	 * costs no composition work (see update_hardware_cursor). */
+	int hardware_cursor;
+
+	/* Shared performance counters and the frame currently being
+	 * staged for them; toggle the HUD with ctrl-shift-g. */
+	yutani_perf_t * perf;
+	yutani_perf_frame_t perf_frame;
+	int debug_hud;
+
 	uint32_t timer_precison;
 	list_t * timer_subscribers;
 
@@ -0,0 +1,38 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ */
+#ifndef _YUTANI_PERF_H
+#define _YUTANI_PERF_H
+
+#include <stdint.h>
+
+/*
+ * Compositor performance counters, published in shared memory as
+ * sys.<server>.perf so external tools can watch them (see the
+ * yutani-perf dumper). The compositor is the only writer. `sequence`
+ * counts composited frames; the slot for frame n is
+ * n % YUTANI_PERF_FRAMES, so readers take `sequence` first and walk
+ * backwards from the latest slot.
+ */
+
+#define YUTANI_PERF_MAGIC  0x9EF0CA4E
+#define YUTANI_PERF_FRAMES 64
+
+typedef struct {
+	uint32_t frame_time;      /* usec spent compositing the frame */
+	uint32_t blit_time;       /* usec of that inside window blits */
+	uint32_t windows_blitted; /* window blits performed */
+	uint32_t damage_rects;    /* damage rectangles painted */
+	uint32_t damage_area;     /* total pixels those rectangles cover */
+	uint32_t queue_depth;     /* damage queue length when the frame began */
+} yutani_perf_frame_t;
+
+typedef struct {
+	uint32_t magic;
+	volatile uint32_t sequence; /* frames composited since startup */
+	uint32_t frames_skipped;    /* render wakeups with nothing to do */
+	yutani_perf_frame_t frames[YUTANI_PERF_FRAMES];
+} yutani_perf_t;
+
+#define YUTANI_PERF_KEY(server_ident,buf,sz) snprintf(buf, sz, "sys.%s.perf", server_ident)
+
+#endif /* _YUTANI_PERF_H */
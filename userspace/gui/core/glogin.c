@@ -509,7 +509,7 @@ collect_events:
 							}
 							break;
 					}
-					free(msg);
+					yutani_msg_free(y, msg);
 				} while (!msg_type);
 
 				if (msg_type == 1) {
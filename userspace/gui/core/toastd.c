@@ -222,7 +222,7 @@ int main (int argc, char ** argv) {
 						}
 						break;
 				}
-				free(m);
+				yutani_msg_free(yctx, m);
 			}
 		}
 	}
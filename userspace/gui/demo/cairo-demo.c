@@ -68,7 +68,7 @@ int main(int argc, char * argv[]) {
 					{
 						struct yutani_msg_key_event * ke = (void*)m->data;
 						if (ke->event.action == KEY_ACTION_DOWN && ke->event.keycode == 'q') {
-							free(m);
+							yutani_msg_free(yctx, m);
 							goto done;
 						}
 					}
@@ -79,7 +79,7 @@ int main(int argc, char * argv[]) {
 					break;
 			}
 		}
-		free(m);
+		yutani_msg_free(yctx, m);
 	}
 
 done:
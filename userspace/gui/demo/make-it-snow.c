@@ -208,7 +208,7 @@ int main(int argc, char * argv[]) {
 							switch (ke->event.keycode) {
 								case 'q':
 									should_exit = 1;
-									free(m);
+									yutani_msg_free(yctx, m);
 									goto finish;
 							}
 						}
@@ -220,7 +220,7 @@ int main(int argc, char * argv[]) {
 				default:
 					break;
 			}
-			free(m);
+			yutani_msg_free(yctx, m);
 		}
 	}
 
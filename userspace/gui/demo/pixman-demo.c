@@ -96,7 +96,7 @@ int main(int argc, char * argv[]) {
 					{
 						struct yutani_msg_key_event * ke = (void*)m->data;
 						if (ke->event.action == KEY_ACTION_DOWN && ke->event.keycode == 'q') {
-							free(m);
+							yutani_msg_free(yctx, m);
 							goto done;
 						}
 					}
@@ -115,7 +115,7 @@ int main(int argc, char * argv[]) {
 					break;
 			}
 		}
-		free(m);
+		yutani_msg_free(yctx, m);
 	}
 
 done:
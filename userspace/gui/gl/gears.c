@@ -298,7 +298,7 @@ int main (int argc, char ** argv) {
 							switch (ke->event.keycode) {
 								case 'q':
 									should_exit = 1;
-									free(m);
+									yutani_msg_free(yctx, m);
 									goto finish;
 								case 'b':
 									blur = (1-blur);
@@ -353,7 +353,7 @@ int main (int argc, char ** argv) {
 				default:
 					break;
 			}
-			free(m);
+			yutani_msg_free(yctx, m);
 		}
 		fps();
 		if (!stopped) {
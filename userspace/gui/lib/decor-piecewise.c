@@ -3,6 +3,7 @@
 #include "lib/yutani.h"
 #include "lib/graphics.h"
 #include "lib/shmemfonts.h"
+#include "lib/shmemsprites.h"
 #include "lib/decorations.h"
 #include "lib/confreader.h"
 
@@ -27,6 +28,8 @@ static sprite_t * sprites[4];
 
 static void init_sprite_png(int id, char * path) {
 	sprites[id] = malloc(sizeof(sprite_t));
+	/* Prefer the compositor's shared copy; decode only when absent */
+	if (!shm_sprite_obtain(sprites[id], path)) return;
 	load_sprite_png(sprites[id], path);
 }
 
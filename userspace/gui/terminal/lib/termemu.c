@@ -147,7 +147,7 @@ static void _ansi_put(term_state_t * s, char c) {
 			}
 			break;
 		case 2:
-			if (c >= ANSI_LOW && c <= ANSI_HIGH) {
+			if ((c >= ANSI_LOW && c <= ANSI_HIGH) || c == '@') {
 				/* Woah, woah, let's see here. */
 				char * pch;  /* tokenizer pointer */
 				char * save; /* strtok_r pointer */
@@ -452,6 +452,28 @@ static void _ansi_put(term_state_t * s, char c) {
 							}
 						}
 						break;
+					case '@': /* ICH: make room at the cursor */
+						{
+							int how_many = 1;
+							if (argc > 0) {
+								how_many = atoi(argv[0]);
+							}
+							if (callbacks->shift_line) {
+								callbacks->shift_line(how_many);
+							}
+						}
+						break;
+					case 'P': /* DCH: delete at the cursor */
+						{
+							int how_many = 1;
+							if (argc > 0) {
+								how_many = atoi(argv[0]);
+							}
+							if (callbacks->shift_line) {
+								callbacks->shift_line(-how_many);
+							}
+						}
+						break;
 					case 'd':
 						if (argc < 1) {
 							callbacks->set_csr(callbacks->get_csr_x(), 0);
@@ -571,6 +593,34 @@ void ansi_put(term_state_t * s, char c) {
 	_spin_unlock(&s->lock);
 }
 
+/*
+ * Buffer-oriented entry point: plain text runs are scanned with memchr
+ * and handed whole to the set_cell_run callback, so pages of printable
+ * output skip the per-byte state machine (and take the lock once).
+ * Anything the callback declines falls back to the per-byte parser.
+ */
+void ansi_put_buf(term_state_t * s, char * buf, size_t size) {
+	term_callbacks_t * callbacks = s->callbacks;
+	_spin_lock(&s->lock);
+	size_t i = 0;
+	while (i < size) {
+		if (s->escape == 0 && !s->box && callbacks->set_cell_run) {
+			char * esc = memchr(&buf[i], ANSI_ESCAPE, size - i);
+			size_t run = esc ? (size_t)(esc - &buf[i]) : size - i;
+			if (run) {
+				size_t eaten = callbacks->set_cell_run(&buf[i], run);
+				i += eaten;
+				if (i == size) break;
+				if (eaten == run) continue;
+				/* The callback stopped at a byte it does not handle */
+			}
+		}
+		_ansi_put(s, buf[i]);
+		i++;
+	}
+	_spin_unlock(&s->lock);
+}
+
 term_state_t * ansi_init(term_state_t * s, int w, int y, term_callbacks_t * callbacks_in) {
 
 	if (!s) {
@@ -5,6 +5,7 @@
 # include <types.h>
 #else
 #include <stdint.h>
+#include <stddef.h>
 #endif
 
 #define TERM_BUF_LEN 128
@@ -34,6 +35,10 @@ typedef struct {
 	int  (*get_cell_width)(void);
 	int  (*get_cell_height)(void);
 	void (*set_csr_on)(int);
+	/* Optional: consume a run of plain text, returns bytes handled */
+	size_t (*set_cell_run)(char *, size_t);
+	/* Optional: insert (n > 0) or delete (n < 0) cells at the cursor (ICH/DCH) */
+	void (*shift_line)(int);
 } term_callbacks_t;
 
 typedef struct {
@@ -108,5 +113,6 @@ typedef struct {
 
 term_state_t * ansi_init(term_state_t * s, int w, int y, term_callbacks_t * callbacks_in);
 void ansi_put(term_state_t * s, char c);
+void ansi_put_buf(term_state_t * s, char * buf, size_t size);
 
 #endif /* _TERMEMU_H__ */
@@ -57,9 +57,6 @@ term_state_t * ansi_state = NULL;
 void reinit(); /* Defined way further down */
 void term_redraw_cursor();
 
-/* Cursor bink timer */
-static unsigned int timer_tick = 0;
-
 void term_clear();
 
 void dump_buffer();
@@ -152,11 +149,31 @@ void input_buffer_stuff(char * str) {
 }
 
 unsigned short * textmemptr = (unsigned short *)0xB8000;
-void placech(unsigned char c, int x, int y, int attr) {
-	unsigned short *where;
-	unsigned att = attr << 8;
-	where = textmemptr + (y * 80 + x);
-	*where = c | att;
+
+static void outb(unsigned char _data, unsigned short _port) {
+	__asm__ __volatile__ ("outb %1, %0" : : "dN" (_port), "a" (_data));
+}
+
+/* CRTC hardware cursor; beats redrawing cells inverted on a timer */
+static void vga_csr_move(int x, int y) {
+	unsigned short pos = y * 80 + x;
+	outb(14, 0x3D4);
+	outb(pos >> 8, 0x3D5);
+	outb(15, 0x3D4);
+	outb(pos & 0xFF, 0x3D5);
+}
+
+static void vga_csr_show(void) {
+	/* Underline cursor on scanlines 14-15 */
+	outb(10, 0x3D4);
+	outb(14, 0x3D5);
+	outb(11, 0x3D4);
+	outb(15, 0x3D5);
+}
+
+static void vga_csr_hide(void) {
+	outb(10, 0x3D4);
+	outb(0x20, 0x3D5);
 }
 
 /* ANSI-to-VGA */
@@ -180,15 +197,8 @@ uint32_t ununicode(uint32_t c) {
 	return 4;
 }
 
-void
-term_write_char(
-		uint32_t val,
-		uint16_t x,
-		uint16_t y,
-		uint32_t fg,
-		uint32_t bg,
-		uint8_t flags
-		) {
+/* Translate a cell to its character/attribute word */
+static unsigned short vga_pair(uint32_t val, uint32_t fg, uint32_t bg) {
 	if (val > 128) val = ununicode(val);
 	if (fg > 256) {
 		fg = best_match(fg);
@@ -204,7 +214,26 @@ term_write_char(
 	}
 	if (fg == 16) fg = 0;
 	if (bg == 16) bg = 0;
-	placech(val, x, y, (vga_to_ansi[fg] & 0xF) | (vga_to_ansi[bg] << 4));
+	return val | (((vga_to_ansi[fg] & 0xF) | (vga_to_ansi[bg] << 4)) << 8);
+}
+
+void
+term_write_char(
+		uint32_t val,
+		uint16_t x,
+		uint16_t y,
+		uint32_t fg,
+		uint32_t bg,
+		uint8_t flags
+		) {
+	textmemptr[y * 80 + x] = vga_pair(val, fg, bg);
+}
+
+static unsigned short cell_word(term_cell_t * cell) {
+	if (((uint32_t *)cell)[0] == 0x00000000) {
+		return vga_pair(' ', TERM_DEFAULT_FG, TERM_DEFAULT_BG);
+	}
+	return vga_pair(cell->c, cell->fg, cell->bg);
 }
 
 static void cell_set(uint16_t x, uint16_t y, uint32_t c, uint32_t fg, uint32_t bg, uint8_t flags) {
@@ -247,20 +276,23 @@ static void cell_redraw_box(uint16_t x, uint16_t y) {
 }
 
 void render_cursor() {
-	cell_redraw_inverted(csr_x, csr_y);
+	vga_csr_move(csr_x, csr_y);
 }
 
 void draw_cursor() {
 	if (!cursor_on) return;
-	timer_tick = 0;
 	render_cursor();
 }
 
 void term_redraw_all() { 
+	/* Translate whole rows, then write them out in one go */
 	for (uint16_t y = 0; y < term_height; ++y) {
+		unsigned short row[80];
 		for (uint16_t x = 0; x < term_width; ++x) {
-			cell_redraw(x,y);
+			term_cell_t * cell = (term_cell_t *)((uintptr_t)term_buffer + (y * term_width + x) * sizeof(term_cell_t));
+			row[x] = cell_word(cell);
 		}
+		memcpy(&textmemptr[y * 80], row, sizeof(unsigned short) * term_width);
 	}
 }
 
@@ -273,23 +305,34 @@ void term_scroll(int how_much) {
 		return;
 	}
 	if (how_much > 0) {
-		/* Shift terminal cells one row up */
-		memmove(term_buffer, (void *)((uintptr_t)term_buffer + sizeof(term_cell_t) * term_width), sizeof(term_cell_t) * term_width * (term_height - how_much));
-		/* Reset the "new" row to clean cells */
+		/* Shift terminal cells up */
+		memmove(term_buffer, (void *)((uintptr_t)term_buffer + sizeof(term_cell_t) * term_width * how_much), sizeof(term_cell_t) * term_width * (term_height - how_much));
+		/* Reset the "new" rows to clean cells */
 		memset((void *)((uintptr_t)term_buffer + sizeof(term_cell_t) * term_width * (term_height - how_much)), 0x0, sizeof(term_cell_t) * term_width * how_much);
 		for (int i = 0; i < how_much; ++i) {
 			for (uint16_t x = 0; x < term_width; ++x) {
-				cell_set(x,term_height - how_much,' ', current_fg, current_bg, ansi_state->flags);
+				cell_set(x,term_height - how_much + i,' ', current_fg, current_bg, ansi_state->flags);
+			}
+		}
+		/* Scroll the text buffer with one move; only the new rows need a repaint */
+		memmove(textmemptr, &textmemptr[80 * how_much], sizeof(unsigned short) * 80 * (term_height - how_much));
+		for (int y = term_height - how_much; y < term_height; ++y) {
+			for (uint16_t x = 0; x < term_width; ++x) {
+				cell_redraw(x, y);
 			}
 		}
-		term_redraw_all();
 	} else {
 		how_much = -how_much;
-		/* Shift terminal cells one row up */
-		memmove((void *)((uintptr_t)term_buffer + sizeof(term_cell_t) * term_width), term_buffer, sizeof(term_cell_t) * term_width * (term_height - how_much));
-		/* Reset the "new" row to clean cells */
+		/* Shift terminal cells down */
+		memmove((void *)((uintptr_t)term_buffer + sizeof(term_cell_t) * term_width * how_much), term_buffer, sizeof(term_cell_t) * term_width * (term_height - how_much));
+		/* Reset the "new" rows to clean cells */
 		memset(term_buffer, 0x0, sizeof(term_cell_t) * term_width * how_much);
-		term_redraw_all();
+		memmove(&textmemptr[80 * how_much], textmemptr, sizeof(unsigned short) * 80 * (term_height - how_much));
+		for (int y = 0; y < how_much; ++y) {
+			for (uint16_t x = 0; x < term_width; ++x) {
+				cell_redraw(x, y);
+			}
+		}
 	}
 }
 
@@ -373,6 +416,24 @@ void term_write(char c) {
 	draw_cursor();
 }
 
+void term_shift_line(int how_much) {
+	int remaining = term_width - csr_x;
+	if (how_much == 0 || remaining <= 0) return;
+	if (how_much > remaining) how_much = remaining;
+	if (how_much < -remaining) how_much = -remaining;
+	term_cell_t * row = (term_cell_t *)((uintptr_t)term_buffer + (csr_y * term_width) * sizeof(term_cell_t));
+	if (how_much > 0) {
+		memmove(&row[csr_x + how_much], &row[csr_x], sizeof(term_cell_t) * (remaining - how_much));
+		memset(&row[csr_x], 0x00, sizeof(term_cell_t) * how_much);
+	} else {
+		memmove(&row[csr_x], &row[csr_x - how_much], sizeof(term_cell_t) * (remaining + how_much));
+		memset(&row[term_width + how_much], 0x00, sizeof(term_cell_t) * (-how_much));
+	}
+	for (int x = csr_x; x < term_width; ++x) {
+		cell_redraw(x, csr_y);
+	}
+}
+
 void term_set_csr(int x, int y) {
 	cell_redraw(csr_x,csr_y);
 	csr_x = x;
@@ -390,6 +451,12 @@ int term_get_csr_y() {
 
 void term_set_csr_show(int on) {
 	cursor_on = on;
+	if (on) {
+		vga_csr_show();
+		vga_csr_move(csr_x, csr_y);
+	} else {
+		vga_csr_hide();
+	}
 }
 
 void term_set_colors(uint32_t fg, uint32_t bg) {
@@ -403,16 +470,6 @@ void term_redraw_cursor() {
 	}
 }
 
-void flip_cursor() {
-	static uint8_t cursor_flipped = 0;
-	if (cursor_flipped) {
-		cell_redraw(csr_x, csr_y);
-	} else {
-		render_cursor();
-	}
-	cursor_flipped = 1 - cursor_flipped;
-}
-
 void term_set_cell(int x, int y, uint32_t c) {
 	cell_set(x, y, c, current_fg, current_bg, ansi_state->flags);
 	cell_redraw(x, y);
@@ -429,7 +486,13 @@ void term_clear(int i) {
 		csr_x = 0;
 		csr_y = 0;
 		memset((void *)term_buffer, 0x00, term_width * term_height * sizeof(term_cell_t));
-		term_redraw_all();
+		/* Blank cells all translate the same; fill two at a time */
+		uint32_t pair = cell_word((term_cell_t *)term_buffer);
+		pair |= pair << 16;
+		uint32_t * where = (uint32_t *)textmemptr;
+		for (int j = 0; j < 80 * term_height / 2; ++j) {
+			where[j] = pair;
+		}
 	} else if (i == 0) {
 		for (int x = csr_x; x < term_width; ++x) {
 			term_set_cell(x, csr_y, ' ');
@@ -596,6 +659,8 @@ term_callbacks_t term_callbacks = {
 	unsupported_int,
 	unsupported_int,
 	term_set_csr_show,
+	NULL, /* set_cell_run */
+	term_shift_line,
 };
 
 void reinit(int send_sig) {
@@ -615,7 +680,6 @@ void reinit(int send_sig) {
 void * handle_incoming(void * garbage) {
 	int kfd = open("/dev/kbd", O_RDONLY);
 	key_event_t event;
-	char c;
 
 	key_event_state_t kbd_state = {0};
 
@@ -628,27 +692,16 @@ void * handle_incoming(void * garbage) {
 	}
 
 	while (!exit_application) {
-		int r = read(kfd, &c, 1);
-		if (r > 0) {
-			int ret = kbd_scancode(&kbd_state, c, &event);
+		char buf[64];
+		int r = read(kfd, buf, sizeof(buf));
+		for (int i = 0; i < r; i++) {
+			int ret = kbd_scancode(&kbd_state, buf[i], &event);
 			key_event(ret, &event);
 		}
 	}
 	pthread_exit(0);
 }
 
-void * blink_cursor(void * garbage) {
-	while (!exit_application) {
-		timer_tick++;
-		if (timer_tick == 3) {
-			timer_tick = 0;
-			flip_cursor();
-		}
-		usleep(90000);
-	}
-	pthread_exit(0);
-}
-
 int main(int argc, char ** argv) {
 
 	_login_shell = 0;
@@ -692,7 +745,9 @@ int main(int argc, char ** argv) {
 
 	fflush(stdin);
 
-	system("cursor-off"); /* Might GPF */
+	/* Take over the hardware cursor */
+	vga_csr_show();
+	vga_csr_move(csr_x, csr_y);
 
 	int pid = getpid();
 	uint32_t f = fork();
@@ -731,9 +786,6 @@ int main(int argc, char ** argv) {
 		pthread_t handle_incoming_thread;
 		pthread_create(&handle_incoming_thread, NULL, handle_incoming, NULL);
 
-		pthread_t cursor_blink_thread;
-		pthread_create(&cursor_blink_thread, NULL, blink_cursor, NULL);
-
 		unsigned char buf[1024];
 		while (!exit_application) {
 			int r = read(fd_master, buf, 1024);
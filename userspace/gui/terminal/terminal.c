@@ -65,6 +65,8 @@ uint16_t char_offset    = 0;    /* Offset of the font within the cell */
 int      csr_x          = 0;    /* Cursor X */
 int      csr_y          = 0;    /* Cursor Y */
 term_cell_t * term_buffer    = NULL; /* The terminal cell buffer */
+term_cell_t * term_display   = NULL; /* Mirror of what each cell last rendered as */
+uint8_t * term_display_style = NULL; /* 0 = plain, 1 = inverted, 2 = boxed, 0xFF = unknown */
 uint32_t current_fg     = 7;    /* Current foreground color */
 uint32_t current_bg     = 0;    /* Current background color */
 uint8_t  cursor_on      = 1;    /* Whether or not the cursor should be rendered */
@@ -199,15 +201,122 @@ FT_Face      face_variable;
 
 FT_Face * fallbacks[] = {&face_variable, &face_symbol, &face_extra, &face_symbol, NULL};
 
+/*
+ * Cache of rendered glyph coverage bitmaps, keyed by (face, codepoint).
+ * A full refresh redraws hundreds of identical glyphs, so only hit
+ * FreeType for glyphs we have not rendered at the current size.
+ */
+typedef struct glyph_cache_entry {
+	int width;
+	int rows;
+	int left;
+	int top;
+	uint8_t coverage[];
+} glyph_cache_entry_t;
+
+static hashmap_t * glyph_cache = NULL;
+
+static void glyph_cache_flush(void) {
+	if (!glyph_cache) return;
+	list_t * entries = hashmap_values(glyph_cache);
+	foreach(node, entries) {
+		free(node->value);
+	}
+	list_free(entries);
+	free(entries);
+	hashmap_free(glyph_cache);
+	free(glyph_cache);
+	glyph_cache = NULL;
+}
+
+static glyph_cache_entry_t * glyph_load_cached(uint32_t val, uint8_t flags) {
+	FT_Face * _font = NULL;
+	int font_idx;
+
+	if (flags & ANSI_ALTFONT) {
+		_font = &face_extra;
+		font_idx = 4;
+	} else if (flags & ANSI_BOLD && flags & ANSI_ITALIC) {
+		_font = &face_bold_italic;
+		font_idx = 3;
+	} else if (flags & ANSI_ITALIC) {
+		_font = &face_italic;
+		font_idx = 2;
+	} else if (flags & ANSI_BOLD) {
+		_font = &face_bold;
+		font_idx = 1;
+	} else {
+		_font = &face;
+		font_idx = 0;
+	}
+
+	int cacheable = (val <= 0x1FFFFF);
+	uintptr_t key = ((uintptr_t)(font_idx & 0x7) << 21) | val;
+
+	if (cacheable) {
+		if (!glyph_cache) {
+			glyph_cache = hashmap_create_int(10);
+		}
+		glyph_cache_entry_t * cached = hashmap_get(glyph_cache, (void *)key);
+		if (cached) return cached;
+	}
+
+	FT_UInt glyph_index = FT_Get_Char_Index(*_font, val);
+
+	if (!glyph_index) {
+		int i = 0;
+		while (!glyph_index && fallbacks[i]) {
+			_font = fallbacks[i];
+			glyph_index = FT_Get_Char_Index(*_font, val);
+			i++;
+		}
+	}
+	int error = FT_Load_Glyph(*_font, glyph_index,  FT_LOAD_DEFAULT);
+	if (error) {
+		fprintf(terminal, "Error loading glyph: %d\n", val);
+		fprintf(stderr, "Error loading glyph: %d\n", val);
+	};
+	FT_GlyphSlot slot = (*_font)->glyph;
+	if (slot->format == FT_GLYPH_FORMAT_OUTLINE) {
+		error = FT_Render_Glyph((*_font)->glyph, FT_RENDER_MODE_NORMAL);
+		if (error) {
+			fprintf(stderr, "Error rendering glyph: %d\n", val);
+			return NULL;
+		}
+	}
+
+	glyph_cache_entry_t * entry;
+	if (cacheable) {
+		entry = malloc(sizeof(glyph_cache_entry_t) + slot->bitmap.width * slot->bitmap.rows);
+	} else {
+		/* Out-of-range codepoints get a reusable scratch entry */
+		static glyph_cache_entry_t * scratch = NULL;
+		scratch = realloc(scratch, sizeof(glyph_cache_entry_t) + slot->bitmap.width * slot->bitmap.rows);
+		entry = scratch;
+	}
+	entry->width = slot->bitmap.width;
+	entry->rows  = slot->bitmap.rows;
+	entry->left  = slot->bitmap_left;
+	entry->top   = slot->bitmap_top;
+	for (int row = 0; row < entry->rows; ++row) {
+		memcpy(&entry->coverage[row * entry->width], &slot->bitmap.buffer[row * slot->bitmap.pitch], entry->width);
+	}
+
+	if (cacheable) {
+		hashmap_set(glyph_cache, (void *)key, entry);
+	}
+
+	return entry;
+}
 
-void drawChar(FT_Bitmap * bitmap, int x, int y, uint32_t fg, uint32_t bg) {
+void drawChar(glyph_cache_entry_t * glyph, int x, int y, uint32_t fg, uint32_t bg) {
 	int i, j, p, q;
-	int x_max = x + bitmap->width;
-	int y_max = y + bitmap->rows;
+	int x_max = x + glyph->width;
+	int y_max = y + glyph->rows;
 	for (j = y, q = 0; j < y_max; j++, q++) {
 		for ( i = x, p = 0; i < x_max; i++, p++) {
 			uint32_t a = _ALP(fg);
-			a = (a * bitmap->buffer[q * bitmap->width + p]) / 255;
+			a = (a * glyph->coverage[q * glyph->width + p]) / 255;
 			uint32_t tmp = rgba(_RED(fg),_GRE(fg),_BLU(fg),a);
 			term_set_point(i,j, alpha_blend_rgba(premultiply(bg), premultiply(tmp)));
 		}
@@ -295,47 +404,12 @@ term_write_char(
 
 		int pen_x = x;
 		int pen_y = y + char_offset;
-		int error;
 
-		FT_Face * _font = NULL;
-		FT_GlyphSlot slot;
-		FT_UInt      glyph_index;
-
-		if (flags & ANSI_ALTFONT) {
-			_font = &face_extra;
-		} else if (flags & ANSI_BOLD && flags & ANSI_ITALIC) {
-			_font = &face_bold_italic;
-		} else if (flags & ANSI_ITALIC) {
-			_font = &face_italic;
-		} else if (flags & ANSI_BOLD) {
-			_font = &face_bold;
-		} else {
-			_font = &face;
-		}
-		glyph_index = FT_Get_Char_Index(*_font, val);
-
-		if (!glyph_index) {
-			int i = 0;
-			while (!glyph_index && fallbacks[i]) {
-				_font = fallbacks[i];
-				glyph_index = FT_Get_Char_Index(*_font, val);
-				i++;
-			}
-		}
-		error = FT_Load_Glyph(*_font, glyph_index,  FT_LOAD_DEFAULT);
-		if (error) {
-			fprintf(terminal, "Error loading glyph: %d\n", val);
-			fprintf(stderr, "Error loading glyph: %d\n", val);
-		};
-		slot = (*_font)->glyph;
-		if (slot->format == FT_GLYPH_FORMAT_OUTLINE) {
-			error = FT_Render_Glyph((*_font)->glyph, FT_RENDER_MODE_NORMAL);
-			if (error) {
-				fprintf(stderr, "Error rendering glyph: %d\n", val);
-				goto _extra_stuff;
-			}
+		glyph_cache_entry_t * glyph = glyph_load_cached(val, flags);
+		if (!glyph) {
+			goto _extra_stuff;
 		}
-		drawChar(&slot->bitmap, pen_x + slot->bitmap_left, pen_y - slot->bitmap_top, _fg, _bg);
+		drawChar(glyph, pen_x + glyph->left, pen_y - glyph->top, _fg, _bg);
 
 	} else {
 		if (val > 128) {
@@ -423,10 +497,37 @@ static void redraw_cell_image(uint16_t x, uint16_t y, term_cell_t * cell) {
 	r_y = max(r_y, decor_top_height + y + char_height);
 }
 
+/*
+ * Check the display mirror before re-rendering a cell: when the cell is
+ * already on screen in the same style the glyph render can be skipped
+ * entirely. Records the new state whenever it doesn't match.
+ */
+static int cell_is_displayed(uint16_t x, uint16_t y, term_cell_t * cell, uint8_t style) {
+	if (!term_display) return 0;
+	size_t i = (size_t)y * term_width + x;
+	if (term_display_style[i] == style && !memcmp(&term_display[i], cell, sizeof(term_cell_t))) {
+		return 1;
+	}
+	term_display[i] = *cell;
+	term_display_style[i] = style;
+	return 0;
+}
+
+static void cell_invalidate(uint16_t x, uint16_t y) {
+	if (!term_display) return;
+	term_display_style[(size_t)y * term_width + x] = 0xFF;
+}
+
+static void term_display_invalidate(void) {
+	if (!term_display) return;
+	memset(term_display_style, 0xFF, term_width * term_height);
+}
+
 static void cell_redraw(uint16_t x, uint16_t y) {
 	if (x >= term_width || y >= term_height) return;
 	term_cell_t * cell = (term_cell_t *)((uintptr_t)term_buffer + (y * term_width + x) * sizeof(term_cell_t));
-	if (cell->flags & ANSI_EXT_IMG) { redraw_cell_image(x,y,cell); return; }
+	if (cell->flags & ANSI_EXT_IMG) { cell_invalidate(x,y); redraw_cell_image(x,y,cell); return; }
+	if (cell_is_displayed(x, y, cell, 0)) return;
 	if (((uint32_t *)cell)[0] == 0x00000000) {
 		term_write_char(' ', x * char_width, y * char_height, TERM_DEFAULT_FG, TERM_DEFAULT_BG, TERM_DEFAULT_FLAGS);
 	} else {
@@ -437,7 +538,8 @@ static void cell_redraw(uint16_t x, uint16_t y) {
 static void cell_redraw_inverted(uint16_t x, uint16_t y) {
 	if (x >= term_width || y >= term_height) return;
 	term_cell_t * cell = (term_cell_t *)((uintptr_t)term_buffer + (y * term_width + x) * sizeof(term_cell_t));
-	if (cell->flags & ANSI_EXT_IMG) { redraw_cell_image(x,y,cell); return; }
+	if (cell->flags & ANSI_EXT_IMG) { cell_invalidate(x,y); redraw_cell_image(x,y,cell); return; }
+	if (cell_is_displayed(x, y, cell, 1)) return;
 	if (((uint32_t *)cell)[0] == 0x00000000) {
 		term_write_char(' ', x * char_width, y * char_height, TERM_DEFAULT_BG, TERM_DEFAULT_FG, TERM_DEFAULT_FLAGS | ANSI_SPECBG);
 	} else {
@@ -448,7 +550,8 @@ static void cell_redraw_inverted(uint16_t x, uint16_t y) {
 static void cell_redraw_box(uint16_t x, uint16_t y) {
 	if (x >= term_width || y >= term_height) return;
 	term_cell_t * cell = (term_cell_t *)((uintptr_t)term_buffer + (y * term_width + x) * sizeof(term_cell_t));
-	if (cell->flags & ANSI_EXT_IMG) { redraw_cell_image(x,y,cell); return; }
+	if (cell->flags & ANSI_EXT_IMG) { cell_invalidate(x,y); redraw_cell_image(x,y,cell); return; }
+	if (cell_is_displayed(x, y, cell, 2)) return;
 	if (((uint32_t *)cell)[0] == 0x00000000) {
 		term_write_char(' ', x * char_width, y * char_height, TERM_DEFAULT_FG, TERM_DEFAULT_BG, TERM_DEFAULT_FLAGS | ANSI_BORDER);
 	} else {
@@ -505,6 +608,11 @@ void term_scroll(int how_much) {
 		}
 		/* Perform the shift */
 		memmove((void *)dst, (void *)src, siz);
+		/* Shift the display mirror with the pixels it describes */
+		if (term_display) {
+			memmove(term_display, &term_display[term_width * how_much], sizeof(term_cell_t) * term_width * (term_height - how_much));
+			memmove(term_display_style, &term_display_style[term_width * how_much], term_width * (term_height - how_much));
+		}
 		/* And redraw the new rows */
 		for (int i = 0; i < how_much; ++i) {
 			for (uint16_t x = 0; x < term_width; ++x) {
@@ -529,6 +637,11 @@ void term_scroll(int how_much) {
 		}
 		/* Perform the shift */
 		memmove((void *)dst, (void *)src, siz);
+		/* Shift the display mirror with the pixels it describes */
+		if (term_display) {
+			memmove(&term_display[term_width * how_much], term_display, sizeof(term_cell_t) * term_width * (term_height - how_much));
+			memmove(&term_display_style[term_width * how_much], term_display_style, term_width * (term_height - how_much));
+		}
 		/* And redraw the new rows */
 		for (int i = 0; i < how_much; ++i) {
 			for (uint16_t x = 0; x < term_width; ++x) {
@@ -550,29 +663,50 @@ struct scrollback_row {
 	term_cell_t cells[];
 };
 
-#define MAX_SCROLLBACK 10240
+#define MAX_SCROLLBACK 102400
 
-list_t * scrollback_list = NULL;
+/*
+ * Scrollback is a fixed ring of packed rows: each saved line stores only
+ * its used columns, so deep history stays small and appending a line is
+ * a single allocation. Rows are re-expanded to full width on redraw.
+ */
+struct scrollback_row ** scrollback_ring = NULL;
+unsigned int scrollback_head  = 0; /* Next slot to overwrite */
+unsigned int scrollback_count = 0; /* Populated slots */
 
 uint32_t scrollback_offset = 0;
 
+static struct scrollback_row * scrollback_fetch(unsigned int age) {
+	/* age 0 is the most recently saved row */
+	return scrollback_ring[(scrollback_head + MAX_SCROLLBACK - 1 - age) % MAX_SCROLLBACK];
+}
+
 void save_scrollback() {
 	/* Save the current top row for scrollback */
-	if (!scrollback_list) {
-		scrollback_list = list_create();
-	}
-	if (scrollback_list->length == MAX_SCROLLBACK) {
-		free(list_dequeue(scrollback_list));
+	if (!scrollback_ring) {
+		scrollback_ring = calloc(MAX_SCROLLBACK, sizeof(struct scrollback_row *));
 	}
 
-	struct scrollback_row * row = malloc(sizeof(struct scrollback_row) + sizeof(term_cell_t) * term_width + 20);
-	row->width = term_width;
-	for (int i = 0; i < term_width; ++i) {
-		term_cell_t * cell = (term_cell_t *)((uintptr_t)term_buffer + (i) * sizeof(term_cell_t));
-		memcpy(&row->cells[i], cell, sizeof(term_cell_t));
+	/* Trailing empty cells render as default spaces anyway; drop them */
+	int width = term_width;
+	while (width > 0) {
+		term_cell_t * cell = (term_cell_t *)((uintptr_t)term_buffer + (width - 1) * sizeof(term_cell_t));
+		if (cell->c || cell->fg || cell->bg || cell->flags) break;
+		width--;
 	}
 
-	list_insert(scrollback_list, row);
+	struct scrollback_row * row = malloc(sizeof(struct scrollback_row) + sizeof(term_cell_t) * width);
+	row->width = width;
+	memcpy(row->cells, term_buffer, sizeof(term_cell_t) * width);
+
+	if (scrollback_ring[scrollback_head]) {
+		free(scrollback_ring[scrollback_head]);
+	}
+	scrollback_ring[scrollback_head] = row;
+	scrollback_head = (scrollback_head + 1) % MAX_SCROLLBACK;
+	if (scrollback_count < MAX_SCROLLBACK) {
+		scrollback_count++;
+	}
 }
 
 void redraw_scrollback() {
@@ -580,6 +714,8 @@ void redraw_scrollback() {
 		term_redraw_all();
 		return;
 	}
+	/* Scrollback drawing below bypasses the cell mirror */
+	term_display_invalidate();
 	if (scrollback_offset < term_height) {
 		for (int i = scrollback_offset; i < term_height; i++) {
 			int y = i - scrollback_offset;
@@ -594,9 +730,8 @@ void redraw_scrollback() {
 			}
 		}
 
-		node_t * node = scrollback_list->tail;
 		for (int i = 0; i < scrollback_offset; ++i) {
-			struct scrollback_row * row = (struct scrollback_row *)node->value;
+			struct scrollback_row * row = scrollback_fetch(i);
 
 			int y = scrollback_offset - 1 - i;
 			int width = row->width;
@@ -615,16 +750,10 @@ void redraw_scrollback() {
 					term_write_char(cell->c, x * char_width, y * char_height, cell->fg, cell->bg, cell->flags);
 				}
 			}
-
-			node = node->prev;
 		}
 	} else {
-		node_t * node = scrollback_list->tail;
-		for (int i = 0; i < scrollback_offset - term_height; ++i) {
-			node = node->prev;
-		}
 		for (int i = scrollback_offset - term_height; i < scrollback_offset; ++i) {
-			struct scrollback_row * row = (struct scrollback_row *)node->value;
+			struct scrollback_row * row = scrollback_fetch(i);
 
 			int y = scrollback_offset - 1 - i;
 			int width = row->width;
@@ -643,16 +772,15 @@ void redraw_scrollback() {
 					term_write_char(cell->c, x * char_width, y * char_height, cell->fg, cell->bg, cell->flags);
 				}
 			}
-
-			node = node->prev;
 		}
 	}
 	display_flip();
 }
 
+static uint32_t unicode_state = 0;
+static uint32_t codepoint = 0;
+
 void term_write(char c) {
-	static uint32_t unicode_state = 0;
-	static uint32_t codepoint = 0;
 
 	cell_redraw(csr_x, csr_y);
 
@@ -733,6 +861,61 @@ void term_write(char c) {
 	draw_cursor();
 }
 
+/*
+ * Bulk writer for runs of printable ASCII. Equivalent to calling
+ * term_write() per byte for this subset, but removes and redraws the
+ * cursor once per run instead of once per character. Anything else
+ * (control bytes, UTF-8, a pending decode) is left for term_write().
+ */
+size_t term_write_run(char * buf, size_t size) {
+	if (unicode_state != 0) return 0;
+
+	size_t i = 0;
+
+	cell_redraw(csr_x, csr_y);
+
+	for (; i < size; ++i) {
+		unsigned char c = buf[i];
+		if (c < ' ' || c > '~') break;
+		if (csr_x < 0) csr_x = 0;
+		if (csr_y < 0) csr_y = 0;
+		if (csr_x == term_width) {
+			csr_x = 0;
+			++csr_y;
+		}
+		if (csr_y == term_height) {
+			save_scrollback();
+			term_scroll(1);
+			csr_y = term_height - 1;
+		}
+		cell_set(csr_x, csr_y, c, current_fg, current_bg, ansi_state->flags);
+		cell_redraw(csr_x, csr_y);
+		csr_x++;
+	}
+
+	draw_cursor();
+	return i;
+}
+
+void term_shift_line(int how_much) {
+	int remaining = term_width - csr_x;
+	if (how_much == 0 || remaining <= 0) return;
+	if (how_much > remaining) how_much = remaining;
+	if (how_much < -remaining) how_much = -remaining;
+	term_cell_t * row = (term_cell_t *)((uintptr_t)term_buffer + (csr_y * term_width) * sizeof(term_cell_t));
+	if (how_much > 0) {
+		memmove(&row[csr_x + how_much], &row[csr_x], sizeof(term_cell_t) * (remaining - how_much));
+		memset(&row[csr_x], 0x00, sizeof(term_cell_t) * how_much);
+	} else {
+		memmove(&row[csr_x], &row[csr_x - how_much], sizeof(term_cell_t) * (remaining + how_much));
+		memset(&row[term_width + how_much], 0x00, sizeof(term_cell_t) * (-how_much));
+	}
+	for (int x = csr_x; x < term_width; ++x) {
+		cell_redraw(x, csr_y);
+	}
+	draw_cursor();
+}
+
 void term_set_csr(int x, int y) {
 	cell_redraw(csr_x,csr_y);
 	csr_x = x;
@@ -900,7 +1083,7 @@ void handle_input_s(char * c) {
 
 void scroll_up(int amount) {
 	int i = 0;
-	while (i < amount && scrollback_list && scrollback_offset < scrollback_list->length) {
+	while (i < amount && scrollback_offset < scrollback_count) {
 		scrollback_offset ++;
 		i++;
 	}
@@ -909,7 +1092,7 @@ void scroll_up(int amount) {
 
 void scroll_down(int amount) {
 	int i = 0;
-	while (i < amount && scrollback_list && scrollback_offset != 0) {
+	while (i < amount && scrollback_offset != 0) {
 		scrollback_offset -= 1;
 		i++;
 	}
@@ -1050,7 +1233,7 @@ void key_event(int ret, key_event_t * event) {
 				break;
 			case KEY_HOME:
 				if (event->modifiers & KEY_MOD_LEFT_SHIFT) {
-					scrollback_offset = scrollback_list->length;
+					scrollback_offset = scrollback_count;
 					redraw_scrollback();
 				} else {
 					handle_input_s("\033OH");
@@ -1123,6 +1306,8 @@ term_callbacks_t term_callbacks = {
 	term_get_cell_width,
 	term_get_cell_height,
 	term_set_csr_show,
+	term_write_run,
+	term_shift_line,
 };
 
 void reinit(int send_sig) {
@@ -1150,6 +1335,9 @@ void reinit(int send_sig) {
 		FT_Set_Pixel_Sizes(face_extra, font_size, font_size);
 		FT_Set_Pixel_Sizes(face_symbol, font_size, font_size);
 		FT_Set_Pixel_Sizes(face_variable, font_size, font_size);
+
+		/* Cached glyphs were rendered at the old size */
+		glyph_cache_flush();
 	}
 	int i = 0;
 
@@ -1183,6 +1371,10 @@ void reinit(int send_sig) {
 		memset(term_buffer, 0x0, sizeof(term_cell_t) * term_width * term_height);
 	}
 
+	term_display = realloc(term_display, sizeof(term_cell_t) * term_width * term_height);
+	term_display_style = realloc(term_display_style, term_width * term_height);
+	term_display_invalidate();
+
 	int old_mouse_state = 0;
 	if (ansi_state) old_mouse_state = ansi_state->mouse_on;
 	ansi_state = ansi_init(ansi_state, term_width, term_height, &term_callbacks);
@@ -1362,7 +1554,7 @@ void * handle_incoming(void) {
 			default:
 				break;
 		}
-		free(m);
+		yutani_msg_free(yctx, m);
 	}
 }
 
@@ -1371,6 +1563,13 @@ void * handle_incoming(void) {
 DEFN_SYSCALL2(fswait,59,int,int*);
 #endif
 
+#ifndef syscall_fswait2
+DEFN_SYSCALL3(fswait2,60,int,int*,int);
+#endif
+
+/* Coalesce render notifications to roughly one per display frame */
+#define FRAME_INTERVAL 16666LL /* microseconds */
+
 
 int main(int argc, char ** argv) {
 
@@ -1555,24 +1754,46 @@ int main(int argc, char ** argv) {
 
 		int fds[2] = {fd_master, fileno(yctx->sock)};
 
-		unsigned char buf[1024];
+		unsigned char buf[4096];
+		uint64_t last_flip = 0;
+		int flip_pending = 0;
 		while (!exit_application) {
 
-			int index = syscall_fswait(2,fds);
+			/* If output is waiting on screen, wake up in time for the next frame */
+			int index = syscall_fswait2(2, fds, flip_pending ? (FRAME_INTERVAL / 1000) : -1);
 
 			check_for_exit();
 
 			if (index == 0) {
-				int r = read(fd_master, buf, 1024);
 				spin_lock(&display_lock);
-				for (uint32_t i = 0; i < r; ++i) {
-					ansi_put(ansi_state, buf[i]);
-				}
-				display_flip();
+				do {
+					int r = read(fd_master, buf, sizeof(buf));
+					if (r <= 0) break;
+					ansi_put_buf(ansi_state, (char *)buf, r);
+					flip_pending = 1;
+					uint64_t ticks = get_ticks();
+					if (ticks - last_flip >= FRAME_INTERVAL) {
+						last_flip = ticks;
+						display_flip();
+						flip_pending = 0;
+					}
+					/* Keep parsing whatever is already buffered */
+				} while (syscall_fswait2(1, fds, 0) == 0);
 				spin_unlock(&display_lock);
-			} else {
+			} else if (index == 1) {
 				handle_incoming();
 			}
+
+			if (flip_pending) {
+				uint64_t ticks = get_ticks();
+				if (index < 0 || ticks - last_flip >= FRAME_INTERVAL) {
+					last_flip = ticks;
+					spin_lock(&display_lock);
+					display_flip();
+					spin_unlock(&display_lock);
+					flip_pending = 0;
+				}
+			}
 		}
 
 	}
@@ -274,41 +274,112 @@ void _ttk_draw_menu(cairo_t * cr, int x, int y, int width) {
 	cairo_restore(cr);
 }
 
+/* Display list recording for the current frame */
+static ttk_command_t ttk_pending[TTK_COMMANDS_MAX];
+static int ttk_pending_count = 0;
+
+static void ttk_record(ttk_command_type_t type, int x, int y, int width, int height, char * title) {
+	if (ttk_pending_count >= TTK_COMMANDS_MAX) return;
+	ttk_command_t * c = &ttk_pending[ttk_pending_count++];
+	c->type = type;
+	c->x = x;
+	c->y = y;
+	c->width = width;
+	c->height = height;
+	snprintf(c->title, sizeof(c->title), "%s", title ? title : "");
+}
+
+/* Clear a command's area of the retained surface back to transparent. */
+static void ttk_clear_command(cairo_t * cr, ttk_command_t * c) {
+	cairo_save(cr);
+	cairo_rectangle(cr, c->x, c->y, c->width, c->height);
+	cairo_clip(cr);
+	cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+	cairo_paint(cr);
+	cairo_restore(cr);
+}
+
+static void ttk_render_command(cairo_t * cr, ttk_command_t * c) {
+	ttk_clear_command(cr, c);
+	switch (c->type) {
+		case TTK_COMMAND_MENU:
+			_ttk_draw_menu(cr, c->x, c->y, c->width);
+			break;
+		case TTK_COMMAND_BUTTON:
+			_ttk_draw_button(cr, c->x, c->y, c->width, c->height, c->title);
+			break;
+		case TTK_COMMAND_BUTTON_HOVER:
+			_ttk_draw_button_hover(cr, c->x, c->y, c->width, c->height, c->title);
+			break;
+		case TTK_COMMAND_BUTTON_SELECT:
+			_ttk_draw_button_select(cr, c->x, c->y, c->width, c->height, c->title);
+			break;
+		case TTK_COMMAND_BUTTON_DISABLED:
+			_ttk_draw_button_disabled(cr, c->x, c->y, c->width, c->height, c->title);
+			break;
+	}
+}
+
 void ttk_window_draw(ttk_window_t * window) {
-	draw_fill(window->core_context, rgb(TTK_BACKGROUND_DEFAULT));
-	ttk_redraw_borders(window);
+	/* Record this frame's widgets. */
+	ttk_pending_count = 0;
+	ttk_record(TTK_COMMAND_MENU, 0, 0, window->width, TTK_MENU_HEIGHT, NULL);
 
-	/* TODO actual drawing */
-	{
-		/* TODO move these surfaces into the ttk_window_t object */
-		int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, window->core_window->width);
-		cairo_surface_t * core_surface = cairo_image_surface_create_for_data(window->core_context->backbuffer, CAIRO_FORMAT_ARGB32, window->core_window->width, window->core_window->height, stride);
-		cairo_t * cr_main = cairo_create(core_surface);
+	ttk_record(TTK_COMMAND_BUTTON, 4, TTK_MENU_HEIGHT + 4, window->width - 8, 40, "Regular Button");
 
-		/* TODO move this surface to a ttk_frame_t or something; GUIs man, go look at some Qt or GTK APIs! */
-		cairo_surface_t * internal_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, window->width, window->height);
-		cairo_t * cr = cairo_create(internal_surface);
+	ttk_record(TTK_COMMAND_BUTTON, 4, TTK_MENU_HEIGHT + 48 + 4, (window->width / 2) - 8, 40, "Regular Button");
+	ttk_record(TTK_COMMAND_BUTTON_HOVER, 4 + (window->width / 2), TTK_MENU_HEIGHT + 48 + 4, (window->width / 2) - 8, 40, "Hover Button");
 
-		_ttk_draw_menu(cr, 0, 0, window->width);
+	ttk_record(TTK_COMMAND_BUTTON_SELECT, 4, TTK_MENU_HEIGHT + 2 * 48 + 4, (window->width / 2) - 8, 40, "Selected");
+	ttk_record(TTK_COMMAND_BUTTON_DISABLED, 4 + (window->width / 2), TTK_MENU_HEIGHT + 2 * 48 + 4, (window->width / 2) - 8, 40, "Disabled Button");
 
-		_ttk_draw_button(cr, 4, TTK_MENU_HEIGHT + 4, window->width - 8, 40, "Regular Button");
+	ttk_record(TTK_COMMAND_BUTTON, 4, TTK_MENU_HEIGHT + 3 * 48 + 4, window->width - 8, window->height - (3 * 48) - TTK_MENU_HEIGHT - 8, "Regular Button");
 
-		_ttk_draw_button(cr, 4, TTK_MENU_HEIGHT + 48 + 4, (window->width / 2) - 8, 40, "Regular Button");
-		_ttk_draw_button_hover(cr, 4 + (window->width / 2), TTK_MENU_HEIGHT + 48 + 4, (window->width / 2) - 8, 40, "Hover Button");
+	/* (Re)build the retained surface when the internal size changes. */
+	int full_redraw = 0;
+	if (!window->cairo_surface ||
+	    cairo_image_surface_get_width(window->cairo_surface) != window->width ||
+	    cairo_image_surface_get_height(window->cairo_surface) != window->height) {
+		if (window->cairo_surface) {
+			cairo_surface_destroy(window->cairo_surface);
+		}
+		window->cairo_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, window->width, window->height);
+		window->command_count = 0;
+		full_redraw = 1;
+	}
+
+	/* Re-rasterize only the widgets whose recorded commands changed
+	 * since the previous frame, and clear any that went away. */
+	cairo_t * cr = cairo_create(window->cairo_surface);
+	for (int i = 0; i < ttk_pending_count; ++i) {
+		if (!full_redraw && i < window->command_count &&
+		    !memcmp(&ttk_pending[i], &window->commands[i], sizeof(ttk_command_t))) {
+			continue;
+		}
+		ttk_render_command(cr, &ttk_pending[i]);
+	}
+	for (int i = ttk_pending_count; i < window->command_count; ++i) {
+		ttk_clear_command(cr, &window->commands[i]);
+	}
+	cairo_destroy(cr);
+	cairo_surface_flush(window->cairo_surface);
+
+	memcpy(window->commands, ttk_pending, sizeof(ttk_command_t) * ttk_pending_count);
+	window->command_count = ttk_pending_count;
 
-		_ttk_draw_button_select(cr, 4, TTK_MENU_HEIGHT + 2 * 48 + 4, (window->width / 2) - 8, 40, "Selected");
-		_ttk_draw_button_disabled(cr, 4 + (window->width / 2), TTK_MENU_HEIGHT + 2 * 48 + 4, (window->width / 2) - 8, 40, "Disabled Button");
+	/* Recomposite: background, decorations, then the retained widget
+	 * surface onto the backbuffer. */
+	draw_fill(window->core_context, rgb(TTK_BACKGROUND_DEFAULT));
+	ttk_redraw_borders(window);
 
-		_ttk_draw_button(cr, 4, TTK_MENU_HEIGHT + 3 * 48 + 4, window->width - 8, window->height - (3 * 48) - TTK_MENU_HEIGHT - 8, "Regular Button");
+	{
+		int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, window->core_window->width);
+		cairo_surface_t * core_surface = cairo_image_surface_create_for_data(window->core_context->backbuffer, CAIRO_FORMAT_ARGB32, window->core_window->width, window->core_window->height, stride);
+		cairo_t * cr_main = cairo_create(core_surface);
 
-		/* Paint the window's internal surface onto the backbuffer */
-		cairo_set_source_surface(cr_main, internal_surface, (double)window->off_x, (double)window->off_y);
+		cairo_set_source_surface(cr_main, window->cairo_surface, (double)window->off_x, (double)window->off_y);
 		cairo_paint(cr_main);
-		cairo_surface_flush(internal_surface);
-		cairo_destroy(cr);
-		cairo_surface_destroy(internal_surface);
 
-		/* In theory, we don't actually want to destroy much of any of this; maybe the cairo_t */
 		cairo_surface_flush(core_surface);
 		cairo_destroy(cr_main);
 		cairo_surface_destroy(core_surface);
@@ -379,6 +450,8 @@ ttk_window_t * ttk_window_new(char * title, uint16_t width, uint16_t height) {
 	new_win->height = height;
 	new_win->off_x  = decor_left_width;
 	new_win->off_y  = decor_top_height;
+	new_win->cairo_surface = NULL;
+	new_win->command_count = 0;
 
 	new_win->core_window = yutani_window_create(yctx, new_win->width + decor_width(), new_win->height + decor_height());
 	yutani_window_move(yctx, new_win->core_window, TTK_DEFAULT_X, TTK_DEFAULT_Y);
@@ -400,6 +473,9 @@ void ttk_quit() {
 
 	foreach(node, windows) {
 		ttk_window_t * win = node->value;
+		if (win->cairo_surface) {
+			cairo_surface_destroy(win->cairo_surface);
+		}
 		yutani_close(yctx, win->core_window);
 	}
 
@@ -459,7 +535,7 @@ int ttk_run(ttk_window_t * window) {
 				default:
 					break;
 			}
-			free(m);
+			yutani_msg_free(yctx, m);
 		}
 	}
 
@@ -15,11 +15,33 @@
 #include "lib/shmemfonts.h"
 #include "lib/hashmap.h"
 
+/* A recorded widget primitive. ttk_window_draw() diffs the current
+ * frame's commands against the previous one and only re-rasterizes the
+ * widgets that actually changed. */
+typedef enum {
+	TTK_COMMAND_MENU,
+	TTK_COMMAND_BUTTON,
+	TTK_COMMAND_BUTTON_HOVER,
+	TTK_COMMAND_BUTTON_SELECT,
+	TTK_COMMAND_BUTTON_DISABLED,
+} ttk_command_type_t;
+
+typedef struct {
+	ttk_command_type_t type;
+	int x;
+	int y;
+	int width;
+	int height;
+	char title[64];
+} ttk_command_t;
+
+#define TTK_COMMANDS_MAX 32
+
 typedef struct ttk_window {
 	yutani_window_t        * core_window;
 	gfx_context_t   * core_context;
 	char            * title;
-	cairo_surface_t * cairo_surface;
+	cairo_surface_t * cairo_surface; /* retained widget rasterization */
 	uint16_t          width; /* internal space */
 	uint16_t          height;
 	uint16_t          off_x; /* decor_left_width */
@@ -27,6 +49,10 @@ typedef struct ttk_window {
 
 	int32_t           x;
 	int32_t           y;
+
+	/* Display list from the last rendered frame */
+	ttk_command_t     commands[TTK_COMMANDS_MAX];
+	int               command_count;
 } ttk_window_t;
 
 #define TTK_BACKGROUND_DEFAULT 204,204,204
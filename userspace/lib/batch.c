@@ -0,0 +1,99 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ *
+ * Batched rendering operations.
+ *
+ * Coarse-grained drawing entry points for callers that pay heavily
+ * per native call - interpreted language bindings foremost. A frame
+ * is described as an array of batch_op_t commands and handed over in
+ * one call; the loop below dispatches to the ordinary graphics and
+ * font routines.
+ */
+
+#include <stdint.h>
+
+#include "lib/shmemfonts.h"
+
+#include "batch.h"
+
+static void batch_fill(gfx_context_t * ctx, batch_op_t * op) {
+	int32_t left   = op->x;
+	int32_t top    = op->y;
+	int32_t right  = op->x + op->width;
+	int32_t bottom = op->y + op->height;
+
+	if (left < 0) left = 0;
+	if (top < 0) top = 0;
+	if (right > GFX_W(ctx)) right = GFX_W(ctx);
+	if (bottom > GFX_H(ctx)) bottom = GFX_H(ctx);
+
+	for (int32_t y = top; y < bottom; ++y) {
+		for (int32_t x = left; x < right; ++x) {
+			GFX(ctx, x, y) = op->color;
+		}
+	}
+}
+
+static void batch_string(gfx_context_t * ctx, int32_t x, int32_t y, batch_op_t * op) {
+	set_font_face(op->font);
+	set_font_size(op->size);
+	draw_string(ctx, x, y, op->color, op->string);
+}
+
+/*
+ * Execute a list of drawing commands against a context.
+ * Returns the number of commands executed; unrecognized
+ * opcodes are skipped.
+ */
+size_t batch_render(gfx_context_t * ctx, batch_op_t * ops, size_t count) {
+	size_t done = 0;
+	for (size_t i = 0; i < count; ++i) {
+		batch_op_t * op = &ops[i];
+		switch (op->op) {
+			case BATCH_OP_FILL:
+				batch_fill(ctx, op);
+				break;
+			case BATCH_OP_SPRITE:
+				draw_sprite(ctx, op->sprite, op->x, op->y);
+				break;
+			case BATCH_OP_SPRITE_SCALED:
+				draw_sprite_scaled(ctx, op->sprite, op->x, op->y, op->width, op->height);
+				break;
+			case BATCH_OP_TEXT:
+				batch_string(ctx, op->x, op->y, op);
+				break;
+			default:
+				continue;
+		}
+		done++;
+	}
+	return done;
+}
+
+/*
+ * Draw a sequence of text runs as one line starting at x,y, advancing
+ * the pen by each run's measured width; font, size, and color may
+ * change between runs. Returns the final pen position.
+ */
+int32_t batch_text(gfx_context_t * ctx, int32_t x, int32_t y, batch_op_t * runs, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		batch_string(ctx, x, y, &runs[i]);
+		x += draw_string_width(runs[i].string);
+	}
+	return x;
+}
+
+/*
+ * Measure a sequence of text runs without drawing them.
+ */
+int32_t batch_text_width(batch_op_t * runs, size_t count) {
+	int32_t width = 0;
+	for (size_t i = 0; i < count; ++i) {
+		set_font_face(runs[i].font);
+		set_font_size(runs[i].size);
+		width += draw_string_width(runs[i].string);
+	}
+	return width;
+}
@@ -0,0 +1,39 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ */
+#ifndef LIB_BATCH_H
+#define LIB_BATCH_H
+
+#include "graphics.h"
+
+/*
+ * Batched rendering operations.
+ *
+ * These entry points take whole lists of drawing commands per call so
+ * that callers with expensive per-call overhead (the Python bindings
+ * in particular) can describe a frame up front and render it with a
+ * handful of native calls instead of one call per rectangle or glyph.
+ */
+
+#define BATCH_OP_FILL          1	/* Fill x,y,width,height with color */
+#define BATCH_OP_SPRITE        2	/* Draw sprite at x,y */
+#define BATCH_OP_SPRITE_SCALED 3	/* Draw sprite scaled to width,height at x,y */
+#define BATCH_OP_TEXT          4	/* Draw string at x,y in font/size/color */
+
+typedef struct batch_op {
+	int32_t op;
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+	int32_t font;			/* BATCH_OP_TEXT: font face */
+	int32_t size;			/* BATCH_OP_TEXT: font size */
+	uint32_t color;
+	sprite_t * sprite;
+	char * string;
+} batch_op_t;
+
+extern size_t batch_render(gfx_context_t * ctx, batch_op_t * ops, size_t count);
+extern int32_t batch_text(gfx_context_t * ctx, int32_t x, int32_t y, batch_op_t * runs, size_t count);
+extern int32_t batch_text_width(batch_op_t * runs, size_t count);
+
+#endif
@@ -11,7 +11,10 @@
  * - foo=bar keyword assignment
  * - [sections]
  */
+#include <stdint.h>
 #include <stdio.h>
+#include <syscall.h>
+#include <sys/stat.h>
 
 #include "confreader.h"
 
@@ -22,19 +25,119 @@ static void free_hashmap(void * h) {
 	free(h);
 }
 
+/*
+ * Parsed files are also published in a shared memory segment stamped
+ * with the file's mtime, as (section, key, value) string triples.
+ * The compositor, glogin and the menu bar all read the same theme
+ * files at startup; whoever parses first spares the others the
+ * tokenizing pass.
+ */
+#define CONF_CACHE_SIZE 8192
+
+typedef struct {
+	uint32_t mtime;
+	uint32_t count;
+	char data[];
+} conf_cache_t;
+
+static void conf_cache_key(const char * path, char * out, size_t size) {
+	snprintf(out, size, "sys.conf.%s", path[0] == '/' ? path + 1 : path);
+	for (char * c = out; *c; ++c) {
+		if (*c == '/') *c = '.';
+	}
+}
+
+static int conf_cache_read(conf_cache_t * cache, confreader_t * conf) {
+	char * p = cache->data;
+	char * end = (char *)cache + CONF_CACHE_SIZE;
+
+	for (uint32_t i = 0; i < cache->count; ++i) {
+		char * strs[3];
+		for (int j = 0; j < 3; ++j) {
+			strs[j] = p;
+			while (p < end && *p) p++;
+			if (p >= end) return 1;
+			p++;
+		}
+		hashmap_t * section = hashmap_get(conf->sections, strs[0]);
+		if (!section) {
+			section = hashmap_create(10);
+			hashmap_set(conf->sections, strs[0], section);
+		}
+		hashmap_set(section, strs[1], strdup(strs[2]));
+	}
+
+	return 0;
+}
+
+static void conf_cache_publish(conf_cache_t * cache, confreader_t * conf, uint32_t mtime) {
+	char * p = cache->data;
+	char * end = (char *)cache + CONF_CACHE_SIZE;
+	uint32_t count = 0;
+
+	cache->mtime = 0;
+
+	list_t * sections = hashmap_keys(conf->sections);
+	foreach(snode, sections) {
+		char * sname = snode->value;
+		hashmap_t * section = hashmap_get(conf->sections, sname);
+		list_t * keys = hashmap_keys(section);
+		foreach(knode, keys) {
+			char * key   = knode->value;
+			char * value = hashmap_get(section, key);
+			if (p + strlen(sname) + strlen(key) + strlen(value) + 3 > end) {
+				/* Too big to share; leave the cache unpublished */
+				list_free(keys);
+				free(keys);
+				list_free(sections);
+				free(sections);
+				return;
+			}
+			strcpy(p, sname); p += strlen(sname) + 1;
+			strcpy(p, key);   p += strlen(key) + 1;
+			strcpy(p, value); p += strlen(value) + 1;
+			count++;
+		}
+		list_free(keys);
+		free(keys);
+	}
+	list_free(sections);
+	free(sections);
+
+	cache->count = count;
+	cache->mtime = mtime;
+}
+
 confreader_t * confreader_load(const char * file) {
 
 	confreader_t * out = malloc(sizeof(confreader_t));
 
 	out->sections = hashmap_create(10);
 
-	FILE * f = fopen(file, "r");
-
 	hashmap_t * current_section = hashmap_create(10);
 	current_section->hash_val_free = free_hashmap;
 
 	hashmap_set(out->sections, "", current_section);
 
+	/* See if someone else already parsed this version of the file */
+	struct stat statbuf;
+	conf_cache_t * cache = NULL;
+	if (!stat(file, &statbuf)) {
+		char key[256];
+		conf_cache_key(file, key, 256);
+		size_t size = CONF_CACHE_SIZE;
+		cache = (conf_cache_t *)syscall_shm_obtain(key, &size);
+		if (cache && size >= CONF_CACHE_SIZE) {
+			if (cache->mtime == (uint32_t)statbuf.st_mtime && !conf_cache_read(cache, out)) {
+				return out;
+			}
+		} else {
+			cache = NULL;
+		}
+	}
+
+	FILE * f = fopen(file, "r");
+
 	if (!f) {
 		/* File does not exist, no configuration values, but continue normally. */
 		return out;
@@ -73,6 +176,10 @@ confreader_t * confreader_load(const char * file) {
 
 	fclose(f);
 
+	if (cache) {
+		conf_cache_publish(cache, out, (uint32_t)statbuf.st_mtime);
+	}
+
 	return out;
 }
 
@@ -14,6 +14,8 @@
 #include <math.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <emmintrin.h>
 #include "graphics.h"
 #include "../../kernel/include/video.h"
 
@@ -38,13 +40,75 @@ static inline uint16_t max16(uint16_t a, uint16_t b) {
 
 
 
+/*
+ * Dirty row tracking. Off by default - contexts behave exactly as they
+ * always have. An application that renders through the draw_* primitives
+ * can call gfx_track_dirty() once and flip() will then only copy the
+ * rows that were actually touched since the last flip. Code that writes
+ * to the backbuffer directly (the GFX macro) should report the rows it
+ * changed with gfx_mark_dirty().
+ */
+static inline void mark_rows(gfx_context_t * ctx, int32_t top, int32_t bottom) {
+	if (!ctx->dirty) return;
+	if (top < 0) top = 0;
+	if (bottom > ctx->height - 1) bottom = ctx->height - 1;
+	for (int32_t y = top; y <= bottom; ++y) {
+		ctx->dirty[y] = 1;
+	}
+}
+
+void gfx_track_dirty(gfx_context_t * ctx) {
+	ctx->dirty = realloc(ctx->dirty, ctx->height);
+	memset(ctx->dirty, 1, ctx->height);
+}
+
+void gfx_mark_dirty(gfx_context_t * ctx, int32_t y, int32_t height) {
+	mark_rows(ctx, y, y + height - 1);
+}
+
 /* Pointer to graphics memory */
 void flip(gfx_context_t * ctx) {
-	memcpy(ctx->buffer, ctx->backbuffer, ctx->size);
+	if (!ctx->dirty) {
+		memcpy(ctx->buffer, ctx->backbuffer, ctx->size);
+		return;
+	}
+	size_t stride = GFX_W(ctx) * GFX_B(ctx);
+	for (int32_t y = 0; y < ctx->height; ) {
+		if (!ctx->dirty[y]) {
+			y++;
+			continue;
+		}
+		int32_t run = y;
+		while (run < ctx->height && ctx->dirty[run]) {
+			ctx->dirty[run] = 0;
+			run++;
+		}
+		memcpy(ctx->buffer + y * stride, ctx->backbuffer + y * stride, (run - y) * stride);
+		y = run;
+	}
+}
+
+/* Copy just the given backbuffer regions to the front buffer. Does not
+ * consult or clear the dirty row flags. */
+void flip_rects(gfx_context_t * ctx, gfx_rect_t * rects, size_t count) {
+	size_t stride = GFX_W(ctx) * GFX_B(ctx);
+	for (size_t i = 0; i < count; ++i) {
+		int32_t left   = max(rects[i].x, 0);
+		int32_t top    = max(rects[i].y, 0);
+		int32_t right  = min(rects[i].x + rects[i].width,  ctx->width);
+		int32_t bottom = min(rects[i].y + rects[i].height, ctx->height);
+		if (right <= left || bottom <= top) continue;
+		size_t offset = top * stride + left * GFX_B(ctx);
+		size_t length = (right - left) * GFX_B(ctx);
+		for (int32_t y = top; y < bottom; ++y, offset += stride) {
+			memcpy(ctx->buffer + offset, ctx->backbuffer + offset, length);
+		}
+	}
 }
 
 void clearbuffer(gfx_context_t * ctx) {
 	memset(ctx->backbuffer, 0, ctx->size);
+	mark_rows(ctx, 0, ctx->height - 1);
 }
 
 /* Deprecated */
@@ -69,6 +133,7 @@ gfx_context_t * init_graphics_fullscreen() {
 
 	out->size   = GFX_H(out) * GFX_W(out) * GFX_B(out);
 	out->backbuffer = out->buffer;
+	out->dirty  = NULL;
 	return out;
 }
 
@@ -79,6 +144,28 @@ gfx_context_t * init_graphics_fullscreen_double_buffer() {
 	return out;
 }
 
+/*
+ * Block until the display's next vertical retrace, or a frame's worth
+ * of time on hardware that doesn't report one. Only meaningful after
+ * init_graphics_fullscreen; returns nonzero otherwise.
+ */
+int framebuffer_wait_vsync(void) {
+	if (framebuffer_fd <= 0) return -1;
+	return ioctl(framebuffer_fd, IO_VID_VSYNC, NULL);
+}
+
+/*
+ * Hand the display backend an ARGB cursor image to draw on its own
+ * cursor plane. A width of 0 hides the cursor. Returns 0 when the
+ * backend accepted it; nonzero means there is no hardware cursor and
+ * the caller must composite one itself.
+ */
+int framebuffer_set_cursor(uint32_t width, uint32_t height, uint32_t hot_x, uint32_t hot_y, uint32_t * data) {
+	if (framebuffer_fd <= 0) return -1;
+	vid_cursor_t cursor = {width, height, hot_x, hot_y, data};
+	return ioctl(framebuffer_fd, IO_VID_CURSOR, &cursor);
+}
+
 void reinit_graphics_fullscreen(gfx_context_t * out) {
 
 	ioctl(framebuffer_fd, IO_VID_WIDTH,  &out->width);
@@ -95,6 +182,10 @@ void reinit_graphics_fullscreen(gfx_context_t * out) {
 		out->backbuffer = out->buffer;
 	}
 
+	if (out->dirty) {
+		gfx_track_dirty(out);
+	}
+
 }
 
 gfx_context_t * init_graphics_sprite(sprite_t * sprite) {
@@ -106,6 +197,7 @@ gfx_context_t * init_graphics_sprite(sprite_t * sprite) {
 	out->size   = GFX_H(out) * GFX_W(out) * GFX_B(out);
 	out->buffer = (char *)sprite->bitmap;
 	out->backbuffer = out->buffer;
+	out->dirty  = NULL;
 
 	return out;
 }
@@ -185,6 +277,106 @@ uint32_t alpha_blend_rgba(uint32_t bottom, uint32_t top) {
 }
 
 
+/*
+ * Whole-scanline blits. Everything is compiled with SSE2 available
+ * (see USER_CFLAGS), so these process four pixels per iteration with
+ * a scalar head and tail; the per-pixel functions above remain for
+ * callers that genuinely want one pixel.
+ */
+
+/*
+ * Copy one scanline of pixels, 16 bytes at a time.
+ */
+void blit_row_copy(uint8_t * dst, uint8_t * src, size_t w) {
+	uint32_t * d32 = (uint32_t *)dst;
+	uint32_t * s32 = (uint32_t *)src;
+	size_t i = 0;
+	if ((((uintptr_t)dst | (uintptr_t)src) & 15) == 0) {
+		for (; i + 4 <= w; i += 4) {
+			_mm_store_si128((__m128i *)&d32[i], _mm_load_si128((__m128i *)&s32[i]));
+		}
+	} else {
+		for (; i + 4 <= w; i += 4) {
+			_mm_storeu_si128((__m128i *)&d32[i], _mm_loadu_si128((__m128i *)&s32[i]));
+		}
+	}
+	for (; i < w; ++i) {
+		d32[i] = s32[i];
+	}
+}
+
+/*
+ * Premultiplied src-over for one pixel; the scalar tail of blit_row_blend.
+ */
+uint32_t blit_pixel_blend(uint32_t d, uint32_t s) {
+	uint32_t a = _ALP(s);
+	if (a == 255) return s;
+	if (a == 0) return d;
+	uint32_t ia = 255 - a;
+	uint32_t out = 0;
+	for (int shift = 0; shift < 32; shift += 8) {
+		uint32_t t = ((s >> shift) & 0xFF) + (((d >> shift) & 0xFF) * ia + 127) / 255;
+		if (t > 255) t = 255;
+		out |= t << shift;
+	}
+	return out;
+}
+
+/*
+ * Blend one scanline of premultiplied pixels over the destination,
+ * four at a time: out = src + dst * (255 - srcA) / 255.
+ */
+void blit_row_blend(uint8_t * dst, uint8_t * src, size_t w) {
+	uint32_t * d32 = (uint32_t *)dst;
+	uint32_t * s32 = (uint32_t *)src;
+	size_t i = 0;
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i x255 = _mm_set1_epi16(255);
+	const __m128i x128 = _mm_set1_epi16(128);
+	for (; i + 4 <= w; i += 4) {
+		__m128i s = _mm_loadu_si128((__m128i *)&s32[i]);
+		__m128i d = _mm_loadu_si128((__m128i *)&d32[i]);
+
+		/* Unpack to one 16-bit lane per channel */
+		__m128i s_lo = _mm_unpacklo_epi8(s, zero);
+		__m128i s_hi = _mm_unpackhi_epi8(s, zero);
+		__m128i d_lo = _mm_unpacklo_epi8(d, zero);
+		__m128i d_hi = _mm_unpackhi_epi8(d, zero);
+
+		/* Broadcast 255 - alpha of each source pixel across its channels */
+		__m128i ia_lo = _mm_sub_epi16(x255, _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, 0xFF), 0xFF));
+		__m128i ia_hi = _mm_sub_epi16(x255, _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, 0xFF), 0xFF));
+
+		/* dst * (255 - srcA) / 255, dividing with the usual >> 8 trick */
+		d_lo = _mm_add_epi16(_mm_mullo_epi16(d_lo, ia_lo), x128);
+		d_hi = _mm_add_epi16(_mm_mullo_epi16(d_hi, ia_hi), x128);
+		d_lo = _mm_srli_epi16(_mm_add_epi16(d_lo, _mm_srli_epi16(d_lo, 8)), 8);
+		d_hi = _mm_srli_epi16(_mm_add_epi16(d_hi, _mm_srli_epi16(d_hi, 8)), 8);
+
+		__m128i out = _mm_adds_epu8(s, _mm_packus_epi16(d_lo, d_hi));
+		_mm_storeu_si128((__m128i *)&d32[i], out);
+	}
+	for (; i < w; ++i) {
+		d32[i] = blit_pixel_blend(d32[i], s32[i]);
+	}
+}
+
+/*
+ * Copy one scanline of pixels, forcing them opaque on the way.
+ */
+static void blit_row_opaque(uint8_t * dst, uint8_t * src, size_t w) {
+	uint32_t * d32 = (uint32_t *)dst;
+	uint32_t * s32 = (uint32_t *)src;
+	size_t i = 0;
+	const __m128i full = _mm_set1_epi32(0xFF000000);
+	for (; i + 4 <= w; i += 4) {
+		_mm_storeu_si128((__m128i *)&d32[i], _mm_or_si128(_mm_loadu_si128((__m128i *)&s32[i]), full));
+	}
+	for (; i < w; ++i) {
+		d32[i] = s32[i] | 0xFF000000;
+	}
+}
+
 uint32_t premultiply(uint32_t color) {
 	uint16_t a = _ALP(color);
 	uint16_t r = _RED(color);
@@ -199,68 +391,24 @@ uint32_t premultiply(uint32_t color) {
 
 #define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
 
+/*
+ * Approximate a Gaussian of the given `amount` (the old kernel was
+ * exp(-f^2 / amount), so sigma^2 = amount / 2) with three box passes
+ * of the matching width. Three boxes are visually indistinguishable
+ * from the true kernel and cost O(1) per pixel regardless of radius.
+ */
 void blur_context(gfx_context_t * _dst, gfx_context_t * _src, double amount) {
-	int width, height;
-	int x, y, z, w, i, j, k;
-	uint32_t *s, *d, a, p;
-	uint8_t * src, * dst;
-	uint8_t kernel[17];
-	const int size = ARRAY_LENGTH(kernel);
-	const int half = size / 2;
+	double sigma = sqrt(amount / 2.0);
+	int box = (int)(sqrt(4.0 * sigma * sigma + 1.0) + 0.5);
+	if (box < 2) box = 2;
 
-	width  = _src->width;
-	height = _src->height;
-
-	src = _src->backbuffer;
-	dst = _dst->backbuffer;
-
-	a = 0;
-	for (i = 0; i < size; ++i) {
-		double f = i - half;
-		a += kernel[i] = exp (- f * f / amount) * 80;
+	if (_dst->backbuffer != _src->backbuffer) {
+		memcpy(_dst->backbuffer, _src->backbuffer, _src->width * _src->height * 4);
 	}
 
-	for (i = 0; i < height; ++i) {
-		s = (uint32_t *) (src + i * (_src->width * 4));
-		d = (uint32_t *) (dst + i * (_dst->width * 4));
-		for (j = 0; j < width; ++j) {
-			x = y = z = w = 0;
-			for (k = 0; k < size; ++k) {
-				if (j - half + k < 0 || j - half + k >= width)
-					continue;
-				p = s[j - half + k];
-
-				x += ((p >> 24) & 0xFF) * kernel[k];
-				y += ((p >> 16) & 0xFF) * kernel[k];
-				z += ((p >>  8) & 0xFF) * kernel[k];
-				w += ((p >>  0) & 0xFF) * kernel[k];
-			}
-
-			d[j] = (x / a << 24) | (y / a << 16) | (z / a << 8) | w / a;
-		}
-	}
-
-	for (i = 0; i < height; ++i) {
-		s = (uint32_t *) (src + i * (_src->width * 4));
-		d = (uint32_t *) (dst + i * (_dst->width * 4));
-		for (j = 0; j < width; ++j) {
-			x = y = z = w = 0;
-			for (k = 0; k < size; ++k) {
-				if (i - half + k < 0 || i - half + k >= height)
-					continue;
-
-				s = (uint32_t *) (dst + (i - half + k) * (_dst->width * 4));
-				p = s[j];
-
-				x += ((p >> 24) & 0xFF) * kernel[k];
-				y += ((p >> 16) & 0xFF) * kernel[k];
-				z += ((p >>  8) & 0xFF) * kernel[k];
-				w += ((p >>  0) & 0xFF) * kernel[k];
-			}
-
-			d[j] = (x / a << 24) | (y / a << 16) | (z / a << 8) | w / a;
-		}
-	}
+	blur_context_box(_dst, box);
+	blur_context_box(_dst, box);
+	blur_context_box(_dst, box);
 }
 
 void blur_context_no_vignette(gfx_context_t * _dst, gfx_context_t * _src, double amount) {
@@ -339,6 +487,38 @@ static int clamp(int a, int l, int h) {
 	return a < l ? l : (a > h ? h : a);
 }
 
+/*
+ * The box blurs keep one running sum per channel in the four 32-bit
+ * lanes of an SSE register, so a pixel entering or leaving the window
+ * is a single vector add or subtract instead of four extractions.
+ */
+static inline __m128i box_expand(uint32_t col) {
+	const __m128i zero = _mm_setzero_si128();
+	return _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(col), zero), zero);
+}
+
+/*
+ * Divide all four running sums by the window size at once. `recip` is
+ * 2^32 / hits rounded up; the multiply-high is then exact integer
+ * division for any window narrower than ~4000 pixels.
+ */
+static inline uint32_t box_average(__m128i sum, int hits, __m128i recip) {
+	__m128i q;
+	if (hits > 1) {
+		__m128i even = _mm_srli_epi64(_mm_mul_epu32(sum, recip), 32);
+		__m128i odd  = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(sum, 32), recip), 32);
+		q = _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+	} else {
+		q = sum;
+	}
+	q = _mm_packus_epi16(_mm_packs_epi32(q, q), q);
+	return (uint32_t)_mm_cvtsi128_si32(q);
+}
+
+static inline __m128i box_reciprocal(int hits) {
+	return _mm_set1_epi32((int)(0xFFFFFFFFu / (uint32_t)hits + 1));
+}
+
 static void _box_blur_horizontal(gfx_context_t * _src, int radius) {
 	uint32_t * p = (uint32_t *)_src->backbuffer;
 	int w = _src->width;
@@ -349,38 +529,33 @@ static void _box_blur_horizontal(gfx_context_t * _src, int radius) {
 
 	for (int y = 0; y < h; y++) {
 		int hits = 0;
-		int r = 0;
-		int g = 0;
-		int b = 0;
-		int a = 0;
+		int last_hits = 0;
+		__m128i sum = _mm_setzero_si128();
+		__m128i recip = _mm_setzero_si128();
 		for (int x = -half_radius; x < w; x++) {
 			int old_p = x - half_radius - 1;
 			if (old_p >= 0)
 			{
 				uint32_t col = p[clamp(index + old_p, 0, w*h-1)];
-				if (col) {
-					r -= _RED(col);
-					g -= _GRE(col);
-					b -= _BLU(col);
-					a -= _ALP(col);
-				}
+				sum = _mm_sub_epi32(sum, box_expand(col));
 				hits--;
 			}
 
 			int newPixel = x + half_radius;
 			if (newPixel < w) {
-				int col = p[clamp(index + newPixel, 0, w*h-1)];
-				if (col != 0) {
-					r += _RED(col);
-					g += _GRE(col);
-					b += _BLU(col);
-					a += _ALP(col);
-				}
+				uint32_t col = p[clamp(index + newPixel, 0, w*h-1)];
+				sum = _mm_add_epi32(sum, box_expand(col));
 				hits++;
 			}
 
 			if (x >= 0) {
-				out_color[x] = rgba(r / hits, g / hits, b / hits, a / hits);
+				/* The window only changes size near the edges, so the
+				 * reciprocal rarely needs recomputing. */
+				if (hits != last_hits && hits > 1) {
+					recip = box_reciprocal(hits);
+				}
+				last_hits = hits;
+				out_color[x] = box_average(sum, hits, recip);
 			}
 		}
 
@@ -406,39 +581,31 @@ static void _box_blur_vertical(gfx_context_t * _src, int radius) {
 
 	for (int x = 0; x < w; x++) {
 		int hits = 0;
-		int r = 0;
-		int g = 0;
-		int b = 0;
-		int a = 0;
+		int last_hits = 0;
+		__m128i sum = _mm_setzero_si128();
+		__m128i recip = _mm_setzero_si128();
 		int index = -half_radius * w + x;
 		for (int y = -half_radius; y < h; y++) {
 			int old_p = y - half_radius - 1;
 			if (old_p >= 0) {
 				uint32_t col = p[clamp(index + old_offset, 0, w*h-1)];
-				if (col != 0) {
-					r -= _RED(col);
-					g -= _GRE(col);
-					b -= _BLU(col);
-					a -= _ALP(col);
-				}
+				sum = _mm_sub_epi32(sum, box_expand(col));
 				hits--;
 			}
 
 			int newPixel = y + half_radius;
 			if (newPixel < h) {
 				uint32_t col = p[clamp(index + new_offset, 0, w*h-1)];
-				if (col != 0)
-				{
-					r += _RED(col);
-					g += _GRE(col);
-					b += _BLU(col);
-					a += _ALP(col);
-				}
+				sum = _mm_add_epi32(sum, box_expand(col));
 				hits++;
 			}
 
 			if (y >= 0) {
-				out_color[y] = rgba(r / hits, g / hits, b / hits, a / hits);
+				if (hits != last_hits && hits > 1) {
+					recip = box_reciprocal(hits);
+				}
+				last_hits = hits;
+				out_color[y] = box_average(sum, hits, recip);
 			}
 
 			index += w;
@@ -510,12 +677,25 @@ _cleanup_sprite:
 	free(bufferb);
 }
 
+/* Convert one decoded PNG scanline into sprite pixels. */
+static void png_convert_row(int color_type, png_bytep row, uint32_t * out, size_t width) {
+	if (color_type == 2) {
+		for (size_t x = 0; x < width; ++x) {
+			png_byte * ptr = &(row[x*3]);
+			out[x] = rgb(ptr[0], ptr[1], ptr[2]);
+		}
+	} else {
+		for (size_t x = 0; x < width; ++x) {
+			png_byte * ptr = &(row[x*4]);
+			out[x] = premultiply(rgba(ptr[0], ptr[1], ptr[2], ptr[3]));
+		}
+	}
+}
+
 int load_sprite_png(sprite_t * sprite, char * file) {
 	png_structp png_ptr;
 	png_infop info_ptr;
-	int number_of_passes;
-	png_bytep * row_pointers;
-	int x, y;
+	int y;
 	png_uint_32 width, height;
 	int color_type;
 	int bit_depth;
@@ -545,61 +725,146 @@ int load_sprite_png(sprite_t * sprite, char * file) {
 
 	png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type, NULL, NULL, NULL);
 
-	row_pointers = (png_bytep*) malloc(sizeof(png_bytep) * height);
-	for (y = 0; y < height; ++y) {
-		row_pointers[y] = (png_byte *) malloc(png_get_rowbytes(png_ptr, info_ptr));
+	if (color_type != 2 && color_type != 6) {
+		printf("XXX: UNKNOWN COLOR TYPE: %d!\n", color_type);
+		png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+		fclose(fp);
+		return 1;
 	}
-	png_read_image(png_ptr, row_pointers);
-	fclose(fp);
+
+	if (bit_depth == 16) {
+		png_set_strip_16(png_ptr);
+	}
+	int passes = png_set_interlace_handling(png_ptr);
+	png_read_update_info(png_ptr, info_ptr);
+	size_t rowbytes = png_get_rowbytes(png_ptr, info_ptr);
 
 	sprite->width = width;
 	sprite->height = height;
 	sprite->bitmap = malloc(sizeof(uint32_t) * width * height);
-	sprite->alpha = 0;
+	sprite->alpha = (color_type == 6) ? ALPHA_EMBEDDED : ALPHA_OPAQUE;
 	sprite->blank = 0;
 
-	if (color_type == 2) {
-		sprite->alpha = ALPHA_OPAQUE;
+	if (passes == 1) {
+		/* Decode one scanline at a time and convert it straight into the
+		 * sprite, rather than buffering the whole decoded image first. */
+		png_bytep row = malloc(rowbytes);
 		for (y = 0; y < height; ++y) {
-			png_byte* row = row_pointers[y];
-			for (x = 0; x < width; ++x) {
-				png_byte * ptr = &(row[x*3]);
-				sprite->bitmap[(y) * width + x] = rgb(ptr[0], ptr[1], ptr[2]);
-			}
+			png_read_row(png_ptr, row, NULL);
+			png_convert_row(color_type, row, &sprite->bitmap[y * width], width);
+		}
+		free(row);
+	} else {
+		/* Interlaced images need every pass over the full frame. */
+		png_bytep rows = malloc(rowbytes * height);
+		png_bytep * row_pointers = malloc(sizeof(png_bytep) * height);
+		for (y = 0; y < height; ++y) {
+			row_pointers[y] = rows + y * rowbytes;
 		}
-	} else if (color_type == 6) {
-		sprite->alpha = ALPHA_EMBEDDED;
+		png_read_image(png_ptr, row_pointers);
 		for (y = 0; y < height; ++y) {
-			png_byte* row = row_pointers[y];
-			for (x = 0; x < width; ++x) {
-				png_byte * ptr = &(row[x*4]);
-				sprite->bitmap[(y) * width + x] = premultiply(rgba(ptr[0], ptr[1], ptr[2], ptr[3]));
+			png_convert_row(color_type, row_pointers[y], &sprite->bitmap[y * width], width);
+		}
+		free(row_pointers);
+		free(rows);
+	}
+
+	fclose(fp);
+	png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+
+	return 0;
+}
+
+
+/*
+ * Path-keyed sprite cache.
+ *
+ * Shared artwork - icons, cursors, decoration pieces - used to be
+ * loaded and decoded once per call site. sprite_cache_get() hands out a
+ * refcounted shared copy keyed on the path, so the Nth load of an image
+ * is a list walk instead of disk I/O plus a PNG decode. Entries are
+ * validated against the file's mtime: a changed file is reloaded for
+ * new callers while existing holders keep the old pixels until they
+ * release them. Entries with no holders stay cached.
+ *
+ * Only hand sprite_cache_release() pointers that came from
+ * sprite_cache_get(); do not sprite_free() them.
+ */
+typedef struct sprite_cache_entry {
+	sprite_t sprite; /* must stay first; release() casts back from it */
+	struct sprite_cache_entry * next;
+	char * path;
+	time_t mtime;
+	int refs;
+	int linked;
+} sprite_cache_entry_t;
+
+static sprite_cache_entry_t * sprite_cache = NULL;
+
+static void sprite_cache_entry_free(sprite_cache_entry_t * e) {
+	free(e->path);
+	if (e->sprite.masks) free(e->sprite.masks);
+	free(e->sprite.bitmap);
+	free(e);
+}
+
+sprite_t * sprite_cache_get(char * path) {
+	struct stat st;
+	if (stat(path, &st)) return NULL;
+
+	sprite_cache_entry_t ** prev = &sprite_cache;
+	for (sprite_cache_entry_t * e = sprite_cache; e; prev = &e->next, e = e->next) {
+		if (!strcmp(e->path, path)) {
+			if (e->mtime == st.st_mtime) {
+				e->refs++;
+				return &e->sprite;
 			}
+			/* Stale; unlink it so new callers get a fresh copy. Holders
+			 * of the old one free it on their last release. */
+			*prev = e->next;
+			e->linked = 0;
+			if (!e->refs) {
+				sprite_cache_entry_free(e);
+			}
+			break;
 		}
+	}
 
+	sprite_cache_entry_t * e = calloc(1, sizeof(sprite_cache_entry_t));
+	size_t len = strlen(path);
+	if (len > 4 && !strcmp(&path[len-4], ".png")) {
+		if (load_sprite_png(&e->sprite, path)) {
+			free(e);
+			return NULL;
+		}
 	} else {
-		printf("XXX: UNKNOWN COLOR TYPE: %d!\n", color_type);
+		load_sprite(&e->sprite, path);
 	}
+	e->path = strdup(path);
+	e->mtime = st.st_mtime;
+	e->refs = 1;
+	e->linked = 1;
+	e->next = sprite_cache;
+	sprite_cache = e;
+	return &e->sprite;
+}
 
-	for (y = 0; y < height; ++y) {
-		free(row_pointers[y]);
+void sprite_cache_release(sprite_t * sprite) {
+	if (!sprite) return;
+	sprite_cache_entry_t * e = (sprite_cache_entry_t *)sprite;
+	e->refs--;
+	if (!e->refs && !e->linked) {
+		sprite_cache_entry_free(e);
 	}
-	free(row_pointers);
-
-	png_destroy_read_struct(&png_ptr,&info_ptr,NULL);
-
-	return 0;
 }
 
-
 void context_to_png(FILE * file, gfx_context_t * ctx) {
 	png_structp png_ptr  = NULL;
 	png_infop   info_ptr = NULL;
 	int32_t x, y;
 
-	png_byte ** row_pointers = NULL;
+	png_byte * row = NULL;
 
-	int status = -1;
 	int depth  = 8;
 
 	png_ptr  = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
@@ -614,32 +879,34 @@ void context_to_png(FILE * file, gfx_context_t * ctx) {
 			PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
 			PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
-	row_pointers = png_malloc(png_ptr, ctx->height * sizeof(png_byte *));
+	png_init_io(png_ptr, file);
+	png_write_info(png_ptr, info_ptr);
+
+	/* Convert and deflate one scanline at a time rather than staging
+	 * the whole frame as a second copy first. */
+	row = malloc(sizeof(uint8_t) * ctx->width * sizeof(uint32_t));
 	for (y = 0; y < ctx->height; ++y) {
-		png_byte * row = png_malloc(png_ptr, sizeof(uint8_t) * ctx->width * sizeof(uint32_t));
-		row_pointers[y] = row;
+		png_byte * out = row;
 		for (x = 0; x < ctx->width; ++x) {
 			uint32_t pixel = GFX(ctx, x, y);
-			*row++ = _RED(pixel);
-			*row++ = _GRE(pixel);
-			*row++ = _BLU(pixel);
-			*row++ = _ALP(pixel);
+			*out++ = _RED(pixel);
+			*out++ = _GRE(pixel);
+			*out++ = _BLU(pixel);
+			*out++ = _ALP(pixel);
 		}
+		png_write_row(png_ptr, row);
 	}
+	png_write_end(png_ptr, info_ptr);
 
-	png_init_io(png_ptr, file);
-	png_set_rows(png_ptr, info_ptr, row_pointers);
-	png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
-
-	for (y = 0; y < ctx->height; y++) {
-		png_free(png_ptr, row_pointers[y]);
-	}
-	png_free(png_ptr, row_pointers);
+	free(row);
+	png_destroy_write_struct(&png_ptr, &info_ptr);
 
 	fprintf(stderr, "Done writing PNG.\n");
 	return;
 
 	png_write_failure:
+	if (row) free(row);
+	png_destroy_write_struct(&png_ptr, &info_ptr);
 	fprintf(stderr, "There was an exception while trying to write out a PNG file :(\n");
 	return;
 }
@@ -650,14 +917,35 @@ void draw_sprite(gfx_context_t * ctx, sprite_t * sprite, int32_t x, int32_t y) {
 	int32_t _top    = max(y, 0);
 	int32_t _right  = min(x + sprite->width,  ctx->width - 1);
 	int32_t _bottom = min(y + sprite->height, ctx->height - 1);
+	mark_rows(ctx, _top, _bottom);
+
+	/* The two common formats go a scanline at a time; masked and
+	 * indexed sprites keep the per-pixel walk. */
+	if (sprite->alpha == ALPHA_EMBEDDED || sprite->alpha == ALPHA_OPAQUE) {
+		int32_t sx0 = _left - x;
+		int32_t sy0 = _top - y;
+		int32_t sx1 = min(sprite->width - 1, _right - x);
+		int32_t sy1 = min(sprite->height - 1, _bottom - y);
+		if (sx1 < sx0 || sy1 < sy0) return;
+		size_t w = sx1 - sx0 + 1;
+		for (int32_t _y = sy0; _y <= sy1; ++_y) {
+			uint8_t * d = (uint8_t *)&GFX(ctx, x + sx0, y + _y);
+			uint8_t * s = (uint8_t *)&SPRITE(sprite, sx0, _y);
+			if (sprite->alpha == ALPHA_EMBEDDED) {
+				blit_row_blend(d, s, w);
+			} else {
+				blit_row_opaque(d, s, w);
+			}
+		}
+		return;
+	}
+
 	for (uint16_t _y = 0; _y < sprite->height; ++_y) {
 		for (uint16_t _x = 0; _x < sprite->width; ++_x) {
 			if (x + _x < _left || x + _x > _right || y + _y < _top || y + _y > _bottom)
 				continue;
 			if (sprite->alpha == ALPHA_MASK) {
 				GFX(ctx, x + _x, y + _y) = alpha_blend(GFX(ctx, x + _x, y + _y), SPRITE(sprite, _x, _y), SMASKS(sprite, _x, _y));
-			} else if (sprite->alpha == ALPHA_EMBEDDED) {
-				GFX(ctx, x + _x, y + _y) = alpha_blend_rgba(GFX(ctx, x + _x, y + _y), SPRITE(sprite, _x, _y));
 			} else if (sprite->alpha == ALPHA_INDEXED) {
 				if (SPRITE(sprite, _x, _y) != sprite->blank) {
 					GFX(ctx, x + _x, y + _y) = SPRITE(sprite, _x, _y) | 0xFF000000;
@@ -669,7 +957,31 @@ void draw_sprite(gfx_context_t * ctx, sprite_t * sprite, int32_t x, int32_t y) {
 	}
 }
 
+/* Fill one clamped horizontal span with 32-bit stores. */
+static void fill_span(gfx_context_t * ctx, int32_t y, int32_t x0, int32_t x1, uint32_t color) {
+	if (y < 0 || y >= ctx->height) return;
+	if (x0 < 0) x0 = 0;
+	if (x1 > ctx->width - 1) x1 = ctx->width - 1;
+	if (x1 < x0) return;
+	uint32_t * p = &GFX(ctx, x0, y);
+	for (int32_t i = 0; i <= x1 - x0; ++i) {
+		p[i] = color;
+	}
+}
+
 void draw_line(gfx_context_t * ctx, int32_t x0, int32_t x1, int32_t y0, int32_t y1, uint32_t color) {
+	mark_rows(ctx, min(y0, y1), max(y0, y1));
+	if (y0 == y1) {
+		fill_span(ctx, y0, min(x0, x1), max(x0, x1), color);
+		return;
+	}
+	if (x0 == x1) {
+		if (x0 < 0 || x0 >= ctx->width) return;
+		for (int32_t y = max(min(y0, y1), 0); y <= min(max(y0, y1), ctx->height - 1); ++y) {
+			GFX(ctx, x0, y) = color;
+		}
+		return;
+	}
 	int deltax = abs(x1 - x0);
 	int deltay = abs(y1 - y0);
 	int sx = (x0 < x1) ? 1 : -1;
@@ -693,18 +1005,35 @@ void draw_line(gfx_context_t * ctx, int32_t x0, int32_t x1, int32_t y0, int32_t
 }
 
 void draw_line_thick(gfx_context_t * ctx, int32_t x0, int32_t x1, int32_t y0, int32_t y1, uint32_t color, char thickness) {
+	mark_rows(ctx, min(y0, y1) - thickness, max(y0, y1) + thickness);
+
+	/*
+	 * The stroke is the union of (2t+1)-wide squares centered on the
+	 * points of the Bresenham walk. Per scanline that union is a single
+	 * contiguous span, so instead of stamping a square per point we
+	 * track the horizontal extent of the walk per row and fill each
+	 * scanline once.
+	 */
+	int32_t win_lo = -(int32_t)thickness;
+	int32_t win_hi = ctx->height - 1 + thickness;
+	int32_t rows = win_hi - win_lo + 1;
+	int32_t * row_min = malloc(sizeof(int32_t) * rows);
+	int32_t * row_max = malloc(sizeof(int32_t) * rows);
+	for (int32_t i = 0; i < rows; ++i) {
+		row_min[i] = INT32_MAX;
+		row_max[i] = INT32_MIN;
+	}
+
 	int deltax = abs(x1 - x0);
 	int deltay = abs(y1 - y0);
 	int sx = (x0 < x1) ? 1 : -1;
 	int sy = (y0 < y1) ? 1 : -1;
 	int error = deltax - deltay;
 	while (1) {
-		for (char j = -thickness; j <= thickness; ++j) {
-			for (char i = -thickness; i <= thickness; ++i) {
-				if (x0 + i >= 0 && x0 + i < ctx->width && y0 + j >= 0 && y0 + j < ctx->height) {
-					GFX(ctx, x0 + i, y0 + j) = color;
-				}
-			}
+		if (y0 >= win_lo && y0 <= win_hi) {
+			int32_t idx = y0 - win_lo;
+			if (x0 < row_min[idx]) row_min[idx] = x0;
+			if (x0 > row_max[idx]) row_max[idx] = x0;
 		}
 		if (x0 == x1 && y0 == y1) break;
 		int e2 = 2 * error;
@@ -717,10 +1046,58 @@ void draw_line_thick(gfx_context_t * ctx, int32_t x0, int32_t x1, int32_t y0, in
 			y0 += sy;
 		}
 	}
+
+	for (int32_t y = 0; y < ctx->height; ++y) {
+		int32_t lo = INT32_MAX;
+		int32_t hi = INT32_MIN;
+		for (int32_t yy = y - thickness; yy <= y + thickness; ++yy) {
+			if (yy < win_lo || yy > win_hi) continue;
+			int32_t idx = yy - win_lo;
+			if (row_min[idx] < lo) lo = row_min[idx];
+			if (row_max[idx] > hi) hi = row_max[idx];
+		}
+		if (lo > hi) continue;
+		fill_span(ctx, y, lo - thickness, hi + thickness, color);
+	}
+
+	free(row_min);
+	free(row_max);
 }
 
+/*
+ * Anti-aliased line of the given total width in pixels; coverage falls
+ * off across the last pixel of the stroke edge.
+ */
+void draw_line_aa(gfx_context_t * ctx, int32_t x0, int32_t x1, int32_t y0, int32_t y1, uint32_t color, float thickness) {
+	int32_t pad = (int32_t)(thickness / 2.0f) + 1;
+	int32_t _left   = max(min(x0, x1) - pad, 0);
+	int32_t _top    = max(min(y0, y1) - pad, 0);
+	int32_t _right  = min(max(x0, x1) + pad, ctx->width - 1);
+	int32_t _bottom = min(max(y0, y1) + pad, ctx->height - 1);
+	mark_rows(ctx, _top, _bottom);
+
+	float dx = (float)(x1 - x0);
+	float dy = (float)(y1 - y0);
+	float len2 = dx * dx + dy * dy;
+
+	for (int32_t y = _top; y <= _bottom; ++y) {
+		for (int32_t x = _left; x <= _right; ++x) {
+			/* Distance from the pixel to the nearest point on the segment */
+			float t = len2 ? (((float)(x - x0) * dx + (float)(y - y0) * dy) / len2) : 0.0f;
+			if (t < 0.0f) t = 0.0f;
+			if (t > 1.0f) t = 1.0f;
+			float px = (float)x0 + t * dx - (float)x;
+			float py = (float)y0 + t * dy - (float)y;
+			float cov = thickness / 2.0f + 0.5f - sqrtf(px * px + py * py);
+			if (cov <= 0.0f) continue;
+			if (cov > 1.0f) cov = 1.0f;
+			GFX(ctx, x, y) = alpha_blend(GFX(ctx, x, y), color, rgb((uint8_t)(cov * 255.0f), 0, 0));
+		}
+	}
+}
 
 void draw_fill(gfx_context_t * ctx, uint32_t color) {
+	mark_rows(ctx, 0, ctx->height - 1);
 	for (uint16_t y = 0; y < ctx->height; ++y) {
 		for (uint16_t x = 0; x < ctx->width; ++x) {
 			GFX(ctx, x, y) = color;
@@ -756,24 +1133,133 @@ uint32_t getBilinearFilteredPixelColor(sprite_t * tex, double u, double v) {
 	return rgb(r_RED,r_GRE,r_BLU) & (0xFFFFFF + (int)r_ALP * 0x1000000);
 }
 
+/*
+ * Scaled blits step through the source in 16.16 fixed point instead
+ * of dividing doubles per destination pixel, and the horizontal walk
+ * is the same for every row, so its offsets and filter weights are
+ * computed once up front. Masked sprites still take the old double
+ * path; they are rare and their alpha lives in a second bitmap.
+ */
+
+/* One bilinear tap with integer weights (0-255 toward x+1 / y+1). */
+static uint32_t bilinear_fetch(sprite_t * tex, int32_t x, int32_t y, uint32_t ux, uint32_t uy) {
+	int32_t x1 = min(x + 1, tex->width - 1);
+	int32_t y1 = min(y + 1, tex->height - 1);
+	uint32_t p00 = SPRITE(tex, x,  y);
+	uint32_t p10 = SPRITE(tex, x1, y);
+	uint32_t p01 = SPRITE(tex, x,  y1);
+	uint32_t p11 = SPRITE(tex, x1, y1);
+	uint32_t out = 0;
+	for (int shift = 0; shift < 32; shift += 8) {
+		uint32_t top = (((p00 >> shift) & 0xFF) * (256 - ux) + ((p10 >> shift) & 0xFF) * ux) >> 8;
+		uint32_t bot = (((p01 >> shift) & 0xFF) * (256 - ux) + ((p11 >> shift) & 0xFF) * ux) >> 8;
+		out |= (((top * (256 - uy) + bot * uy) >> 8) & 0xFF) << shift;
+	}
+	return out;
+}
+
 void draw_sprite_scaled(gfx_context_t * ctx, sprite_t * sprite, int32_t x, int32_t y, uint16_t width, uint16_t height) {
 	int32_t _left   = max(x, 0);
 	int32_t _top    = max(y, 0);
 	int32_t _right  = min(x + width,  ctx->width - 1);
 	int32_t _bottom = min(y + height, ctx->height - 1);
-	for (uint16_t _y = 0; _y < height; ++_y) {
-		for (uint16_t _x = 0; _x < width; ++_x) {
-			if (x + _x < _left || x + _x > _right || y + _y < _top || y + _y > _bottom)
-				continue;
-			if (sprite->alpha > 0) {
+	if (!width || !height) return;
+	mark_rows(ctx, _top, _bottom);
+
+	if (sprite->alpha == ALPHA_MASK) {
+		for (uint16_t _y = 0; _y < height; ++_y) {
+			for (uint16_t _x = 0; _x < width; ++_x) {
+				if (x + _x < _left || x + _x > _right || y + _y < _top || y + _y > _bottom)
+					continue;
 				uint32_t n_color = getBilinearFilteredPixelColor(sprite, (double)_x / (double)width, (double)_y/(double)height);
 				uint32_t f_color = rgb(_ALP(n_color), 0, 0);
 				GFX(ctx, x + _x, y + _y) = alpha_blend(GFX(ctx, x + _x, y + _y), n_color, f_color);
+			}
+		}
+		return;
+	}
+
+	int32_t dx0 = _left - x;
+	int32_t dy0 = _top - y;
+	int32_t dx1 = min(width - 1, _right - x);
+	int32_t dy1 = min(height - 1, _bottom - y);
+	if (dx1 < dx0 || dy1 < dy0) return;
+	size_t w = dx1 - dx0 + 1;
+
+	uint32_t du = ((uint32_t)sprite->width << 16) / width;
+	uint32_t dv = ((uint32_t)sprite->height << 16) / height;
+
+	uint16_t * sxs = malloc(sizeof(uint16_t) * w);
+	uint8_t * uxs = malloc(w);
+	uint32_t fu = du * dx0;
+	for (size_t i = 0; i < w; ++i, fu += du) {
+		sxs[i] = fu >> 16;
+		uxs[i] = (fu >> 8) & 0xFF;
+	}
+
+	uint32_t fv = dv * dy0;
+	for (int32_t _y = dy0; _y <= dy1; ++_y, fv += dv) {
+		int32_t sy = fv >> 16;
+		uint32_t uy = (fv >> 8) & 0xFF;
+		for (size_t i = 0; i < w; ++i) {
+			uint32_t n_color = bilinear_fetch(sprite, sxs[i], sy, uxs[i], uy);
+			if (sprite->alpha > 0) {
+				uint32_t f_color = rgb(_ALP(n_color), 0, 0);
+				GFX(ctx, x + dx0 + i, y + _y) = alpha_blend(GFX(ctx, x + dx0 + i, y + _y), n_color, f_color);
 			} else {
-				GFX(ctx, x + _x, y + _y) = getBilinearFilteredPixelColor(sprite, (double)_x / (double)width, (double)_y/(double)height);
+				GFX(ctx, x + dx0 + i, y + _y) = n_color;
 			}
 		}
 	}
+
+	free(sxs);
+	free(uxs);
+}
+
+/*
+ * Nearest-neighbour variant for callers that would rather have the
+ * speed than the filtering; the row fetch is a cached offset lookup
+ * and nothing else.
+ */
+void draw_sprite_scaled_fast(gfx_context_t * ctx, sprite_t * sprite, int32_t x, int32_t y, uint16_t width, uint16_t height) {
+	int32_t _left   = max(x, 0);
+	int32_t _top    = max(y, 0);
+	int32_t _right  = min(x + width,  ctx->width - 1);
+	int32_t _bottom = min(y + height, ctx->height - 1);
+	if (!width || !height) return;
+	mark_rows(ctx, _top, _bottom);
+
+	int32_t dx0 = _left - x;
+	int32_t dy0 = _top - y;
+	int32_t dx1 = min(width - 1, _right - x);
+	int32_t dy1 = min(height - 1, _bottom - y);
+	if (dx1 < dx0 || dy1 < dy0) return;
+	size_t w = dx1 - dx0 + 1;
+
+	uint32_t du = ((uint32_t)sprite->width << 16) / width;
+	uint32_t dv = ((uint32_t)sprite->height << 16) / height;
+
+	uint16_t * sxs = malloc(sizeof(uint16_t) * w);
+	uint32_t fu = du * dx0;
+	for (size_t i = 0; i < w; ++i, fu += du) {
+		sxs[i] = fu >> 16;
+	}
+
+	uint32_t fv = dv * dy0;
+	for (int32_t _y = dy0; _y <= dy1; ++_y, fv += dv) {
+		uint32_t * srow = &SPRITE(sprite, 0, fv >> 16);
+		for (size_t i = 0; i < w; ++i) {
+			uint32_t n_color = srow[sxs[i]];
+			if (sprite->alpha > 0) {
+				uint32_t f_color = rgb(_ALP(n_color), 0, 0);
+				GFX(ctx, x + dx0 + i, y + _y) = alpha_blend(GFX(ctx, x + dx0 + i, y + _y), n_color, f_color);
+			} else {
+				GFX(ctx, x + dx0 + i, y + _y) = n_color;
+			}
+		}
+	}
+
+	free(sxs);
 }
 
 void draw_sprite_alpha(gfx_context_t * ctx, sprite_t * sprite, int32_t x, int32_t y, float alpha) {
@@ -781,6 +1267,7 @@ void draw_sprite_alpha(gfx_context_t * ctx, sprite_t * sprite, int32_t x, int32_
 	int32_t _top    = max(y, 0);
 	int32_t _right  = min(x + sprite->width,  ctx->width - 1);
 	int32_t _bottom = min(y + sprite->height, ctx->height - 1);
+	mark_rows(ctx, _top, _bottom);
 	for (uint16_t _y = 0; _y < sprite->height; ++_y) {
 		for (uint16_t _x = 0; _x < sprite->width; ++_x) {
 			if (x + _x < _left || x + _x > _right || y + _y < _top || y + _y > _bottom)
@@ -798,14 +1285,53 @@ void draw_sprite_scaled_alpha(gfx_context_t * ctx, sprite_t * sprite, int32_t x,
 	int32_t _top    = max(y, 0);
 	int32_t _right  = min(x + width,  ctx->width - 1);
 	int32_t _bottom = min(y + height, ctx->height - 1);
-	for (uint16_t _y = 0; _y < height; ++_y) {
-		for (uint16_t _x = 0; _x < width; ++_x) {
-			if (x + _x < _left || x + _x > _right || y + _y < _top || y + _y > _bottom)
-				continue;
-			uint32_t n_color = getBilinearFilteredPixelColor(sprite, (double)_x / (double)width, (double)_y/(double)height);
-			uint32_t f_color = rgb(_ALP(n_color) * alpha, 0, 0);
-			GFX(ctx, x + _x, y + _y) = alpha_blend(GFX(ctx, x + _x, y + _y), n_color, f_color);
+	if (!width || !height) return;
+	mark_rows(ctx, _top, _bottom);
+
+	if (sprite->alpha == ALPHA_MASK) {
+		for (uint16_t _y = 0; _y < height; ++_y) {
+			for (uint16_t _x = 0; _x < width; ++_x) {
+				if (x + _x < _left || x + _x > _right || y + _y < _top || y + _y > _bottom)
+					continue;
+				uint32_t n_color = getBilinearFilteredPixelColor(sprite, (double)_x / (double)width, (double)_y/(double)height);
+				uint32_t f_color = rgb(_ALP(n_color) * alpha, 0, 0);
+				GFX(ctx, x + _x, y + _y) = alpha_blend(GFX(ctx, x + _x, y + _y), n_color, f_color);
+			}
 		}
+		return;
+	}
+
+	int32_t dx0 = _left - x;
+	int32_t dy0 = _top - y;
+	int32_t dx1 = min(width - 1, _right - x);
+	int32_t dy1 = min(height - 1, _bottom - y);
+	if (dx1 < dx0 || dy1 < dy0) return;
+	size_t w = dx1 - dx0 + 1;
+
+	uint32_t du = ((uint32_t)sprite->width << 16) / width;
+	uint32_t dv = ((uint32_t)sprite->height << 16) / height;
+	uint32_t af = (uint32_t)(alpha * 256);
+
+	uint16_t * sxs = malloc(sizeof(uint16_t) * w);
+	uint8_t * uxs = malloc(w);
+	uint32_t fu = du * dx0;
+	for (size_t i = 0; i < w; ++i, fu += du) {
+		sxs[i] = fu >> 16;
+		uxs[i] = (fu >> 8) & 0xFF;
 	}
+
+	uint32_t fv = dv * dy0;
+	for (int32_t _y = dy0; _y <= dy1; ++_y, fv += dv) {
+		int32_t sy = fv >> 16;
+		uint32_t uy = (fv >> 8) & 0xFF;
+		for (size_t i = 0; i < w; ++i) {
+			uint32_t n_color = bilinear_fetch(sprite, sxs[i], sy, uxs[i], uy);
+			uint32_t f_color = rgb((_ALP(n_color) * af) >> 8, 0, 0);
+			GFX(ctx, x + dx0 + i, y + _y) = alpha_blend(GFX(ctx, x + dx0 + i, y + _y), n_color, f_color);
+		}
+	}
+
+	free(sxs);
+	free(uxs);
 }
 
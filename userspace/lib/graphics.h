@@ -42,11 +42,21 @@ typedef struct context {
 	uint32_t size;
 	char *   buffer;
 	char *   backbuffer;
+	uint8_t * dirty;	/* Per-row dirty flags, or NULL when not tracking */
 } gfx_context_t;
 
+typedef struct {
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+} gfx_rect_t;
+
 gfx_context_t * init_graphics_fullscreen();
 gfx_context_t * init_graphics_fullscreen_double_buffer();
 void reinit_graphics_fullscreen(gfx_context_t * ctx);
+int framebuffer_wait_vsync(void);
+int framebuffer_set_cursor(uint32_t width, uint32_t height, uint32_t hot_x, uint32_t hot_y, uint32_t * data);
 
 #define ALPHA_OPAQUE   0
 #define ALPHA_MASK     1
@@ -58,9 +68,19 @@ uint32_t rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a);
 uint32_t alpha_blend(uint32_t bottom, uint32_t top, uint32_t mask);
 uint32_t alpha_blend_rgba(uint32_t bottom, uint32_t top);
 
+/* SSE2 scanline blits; see graphics.c */
+uint32_t blit_pixel_blend(uint32_t bottom, uint32_t top);
+void blit_row_copy(uint8_t * dst, uint8_t * src, size_t w);
+void blit_row_blend(uint8_t * dst, uint8_t * src, size_t w);
+
 void flip(gfx_context_t * ctx);
+void flip_rects(gfx_context_t * ctx, gfx_rect_t * rects, size_t count);
 void clear_buffer(gfx_context_t * ctx);
 
+/* Dirty row tracking; see graphics.c */
+void gfx_track_dirty(gfx_context_t * ctx);
+void gfx_mark_dirty(gfx_context_t * ctx, int32_t y, int32_t height);
+
 gfx_context_t * init_graphics_sprite(sprite_t * sprite);
 sprite_t * create_sprite(size_t width, size_t height, int alpha);
 
@@ -71,12 +91,18 @@ void sprite_free(sprite_t * sprite);
 
 void load_sprite(sprite_t * sprite, char * filename);
 int load_sprite_png(sprite_t * sprite, char * file);
+
+/* Refcounted path-keyed image cache; see graphics.c */
+sprite_t * sprite_cache_get(char * path);
+void sprite_cache_release(sprite_t * sprite);
 void draw_sprite(gfx_context_t * ctx, sprite_t * sprite, int32_t x, int32_t y);
 void draw_line(gfx_context_t * ctx, int32_t x0, int32_t x1, int32_t y0, int32_t y1, uint32_t color);
 void draw_line_thick(gfx_context_t * ctx, int32_t x0, int32_t x1, int32_t y0, int32_t y1, uint32_t color, char thickness);
+void draw_line_aa(gfx_context_t * ctx, int32_t x0, int32_t x1, int32_t y0, int32_t y1, uint32_t color, float thickness);
 void draw_fill(gfx_context_t * ctx, uint32_t color);
 
 void draw_sprite_scaled(gfx_context_t * ctx, sprite_t * sprite, int32_t x, int32_t y, uint16_t width, uint16_t height);
+void draw_sprite_scaled_fast(gfx_context_t * ctx, sprite_t * sprite, int32_t x, int32_t y, uint16_t width, uint16_t height);
 void draw_sprite_scaled_alpha(gfx_context_t * ctx, sprite_t * sprite, int32_t x, int32_t y, uint16_t width, uint16_t height, float alpha);
 void draw_sprite_alpha(gfx_context_t * ctx, sprite_t * sprite, int32_t x, int32_t y, float alpha);
 
@@ -10,6 +10,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <syscall.h>
 
 #include "network.h"
 
@@ -38,18 +39,21 @@ struct hostent * gethostbyname(const char * name) {
 }
 
 int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
-	UNIMPLEMENTED;
-	return -1;
+	const struct sockaddr_in * sin = (const struct sockaddr_in *)addr;
+	if (sin->sin_family != AF_INET) return -1;
+	return syscall_connect(sockfd, ntohl(sin->sin_addr.s_addr), ntohs(sin->sin_port));
 }
 
-/* All of these should just be reads. */
+/* Bulk reads straight out of the kernel's receive buffer */
 ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
-	UNIMPLEMENTED;
-	return -1;
+	return syscall_recv(sockfd, buf, len, flags);
 }
 ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen) {
-	UNIMPLEMENTED;
-	return -1;
+	if (src_addr) {
+		UNIMPLEMENTED;
+		return -1;
+	}
+	return recv(sockfd, buf, len, flags);
 }
 ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
 	UNIMPLEMENTED;
@@ -57,12 +61,14 @@ ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
 }
 
 ssize_t send(int sockfd, const void *buf, size_t len, int flags) {
-	UNIMPLEMENTED;
-	return len;
+	return syscall_send(sockfd, buf, len, flags);
 }
 ssize_t sendto(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen) {
-	UNIMPLEMENTED;
-	return len;
+	if (dest_addr) {
+		UNIMPLEMENTED;
+		return -1;
+	}
+	return send(sockfd, buf, len, flags);
 }
 ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags) {
 	UNIMPLEMENTED;
@@ -70,8 +76,8 @@ ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags) {
 }
 
 int socket(int domain, int type, int protocol) {
-	UNIMPLEMENTED;
-	return -1;
+	if (domain != AF_INET) return -1;
+	return syscall_socket(type);
 }
 
 uint32_t htonl(uint32_t hostlong) {
@@ -10,6 +10,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <syscall.h>
 
 #include "pex.h"
 
@@ -56,6 +57,174 @@ FILE * pex_bind(char * target) {
 	return out;
 }
 
+size_t pex_drain(FILE * sock, void * buffer, size_t size) {
+	return read(fileno(sock), buffer, size);
+}
+
 size_t pex_query(FILE * sock) {
 	return ioctl(fileno(sock), IOCTL_PACKETFS_QUEUED, NULL);
 }
+
+/* Shared-memory ring transport */
+
+static size_t ring_used(pex_shm_ring_t * ring) {
+	return (ring->tail + PEX_SHM_RING_SIZE - ring->head) % PEX_SHM_RING_SIZE;
+}
+
+/* Copy into the ring at *cursor, splitting around the wrap point;
+ * the caller publishes the updated index when the message is whole. */
+static void ring_put(pex_shm_ring_t * ring, uint32_t * cursor, const void * data, size_t len) {
+	size_t first = PEX_SHM_RING_SIZE - *cursor;
+	if (first > len) first = len;
+	memcpy((uint8_t *)ring->data + *cursor, data, first);
+	if (len > first) {
+		memcpy((uint8_t *)ring->data, (const uint8_t *)data + first, len - first);
+	}
+	*cursor = (*cursor + len) % PEX_SHM_RING_SIZE;
+}
+
+static void ring_get(pex_shm_ring_t * ring, uint32_t * cursor, void * data, size_t len) {
+	size_t first = PEX_SHM_RING_SIZE - *cursor;
+	if (first > len) first = len;
+	memcpy(data, (uint8_t *)ring->data + *cursor, first);
+	if (len > first) {
+		memcpy((uint8_t *)data + first, (uint8_t *)ring->data, len - first);
+	}
+	*cursor = (*cursor + len) % PEX_SHM_RING_SIZE;
+}
+
+static pex_shm_ring_t * shm_send_ring(pex_shm_t * shm) {
+	return shm->is_server ? &shm->region->to_client : &shm->region->to_server;
+}
+
+static pex_shm_ring_t * shm_recv_ring(pex_shm_t * shm) {
+	return shm->is_server ? &shm->region->to_server : &shm->region->to_client;
+}
+
+static void pex_shm_kick(pex_shm_t * shm) {
+	uint32_t kick = PEX_SHM_KICK;
+	if (shm->is_server) {
+		pex_send(shm->sock, shm->peer, sizeof(kick), (char *)&kick);
+	} else {
+		pex_reply(shm->sock, sizeof(kick), (char *)&kick);
+	}
+}
+
+pex_shm_t * pex_shm_connect(FILE * sock) {
+	static int counter = 0;
+	pex_shm_t * shm = malloc(sizeof(pex_shm_t));
+
+	sprintf(shm->key, "pex.ring.%d.%d", getpid(), counter++);
+	size_t size = sizeof(pex_shm_region_t);
+	pex_shm_region_t * region = (pex_shm_region_t *)syscall_shm_obtain(shm->key, &size);
+	if (!region || size < sizeof(pex_shm_region_t)) {
+		free(shm);
+		return NULL;
+	}
+
+	memset(region, 0, sizeof(pex_shm_region_t));
+	region->magic = PEX_SHM_MAGIC;
+
+	shm->sock = sock;
+	shm->region = region;
+	shm->is_server = 0;
+	shm->peer = 0;
+
+	pex_shm_announce_t announce;
+	announce.magic = PEX_SHM_ANNOUNCE;
+	memcpy(announce.key, shm->key, sizeof(announce.key));
+	pex_reply(sock, sizeof(announce), (char *)&announce);
+
+	return shm;
+}
+
+pex_shm_t * pex_shm_accept(FILE * sock, pex_packet_t * packet) {
+	if (packet->size != sizeof(pex_shm_announce_t)) return NULL;
+	pex_shm_announce_t * announce = (pex_shm_announce_t *)packet->data;
+	if (announce->magic != PEX_SHM_ANNOUNCE) return NULL;
+
+	pex_shm_t * shm = malloc(sizeof(pex_shm_t));
+	memcpy(shm->key, announce->key, sizeof(shm->key));
+	shm->key[sizeof(shm->key)-1] = '\0';
+
+	size_t size = sizeof(pex_shm_region_t);
+	pex_shm_region_t * region = (pex_shm_region_t *)syscall_shm_obtain(shm->key, &size);
+	if (!region || size < sizeof(pex_shm_region_t) || region->magic != PEX_SHM_MAGIC) {
+		free(shm);
+		return NULL;
+	}
+
+	shm->sock = sock;
+	shm->region = region;
+	shm->is_server = 1;
+	shm->peer = packet->source;
+
+	return shm;
+}
+
+size_t pex_shm_send(pex_shm_t * shm, size_t size, char * blob) {
+	pex_shm_ring_t * ring = shm_send_ring(shm);
+
+	size_t available = PEX_SHM_RING_SIZE - 1 - ring_used(ring);
+	if (size > MAX_PACKET_SIZE || size + sizeof(uint32_t) > available) {
+		/* Too big or ring is backed up; use the descriptor path */
+		if (shm->is_server) {
+			return pex_send(shm->sock, shm->peer, size, blob);
+		}
+		return pex_reply(shm->sock, size, blob);
+	}
+
+	uint32_t cursor = ring->tail;
+	uint32_t length = size;
+	ring_put(ring, &cursor, &length, sizeof(length));
+	ring_put(ring, &cursor, blob, size);
+	ring->tail = cursor;
+
+	if (ring->waiting) {
+		pex_shm_kick(shm);
+	}
+
+	return size;
+}
+
+size_t pex_shm_recv(pex_shm_t * shm, char * blob) {
+	pex_shm_ring_t * ring = shm_recv_ring(shm);
+
+	if (ring->head == ring->tail) return 0;
+
+	uint32_t cursor = ring->head;
+	uint32_t length = 0;
+	ring_get(ring, &cursor, &length, sizeof(length));
+	ring_get(ring, &cursor, blob, length);
+	ring->head = cursor;
+
+	return length;
+}
+
+size_t pex_shm_queued(pex_shm_t * shm) {
+	return ring_used(shm_recv_ring(shm));
+}
+
+/* Call before blocking on the exchange descriptor, then recheck
+ * pex_shm_queued — the producer only kicks when it saw the flag. */
+void pex_shm_prepare_wait(pex_shm_t * shm) {
+	shm_recv_ring(shm)->waiting = 1;
+}
+
+void pex_shm_finish_wait(pex_shm_t * shm) {
+	shm_recv_ring(shm)->waiting = 0;
+}
+
+/* Kicks and announces arrive over the normal descriptor stream;
+ * message loops should skip anything this recognizes. */
+int pex_shm_is_control(pex_packet_t * packet) {
+	if (packet->size == sizeof(uint32_t) && *(uint32_t *)packet->data == PEX_SHM_KICK) return 1;
+	if (packet->size == sizeof(pex_shm_announce_t) &&
+		((pex_shm_announce_t *)packet->data)->magic == PEX_SHM_ANNOUNCE) return 1;
+	return 0;
+}
+
+void pex_shm_close(pex_shm_t * shm) {
+	syscall_shm_release(shm->key);
+	free(shm);
+}
@@ -17,6 +17,45 @@ typedef struct pex_header {
 	uint8_t data[];
 } pex_header_t;
 
+/*
+ * Shared-memory ring transport. A client may negotiate a pair of
+ * single-producer rings in a shm region; small messages then move
+ * through the rings without copies or allocations in the kernel and
+ * the exchange descriptor is only used to wake a sleeping peer.
+ * Oversized messages and ring-full conditions fall back to the
+ * descriptor transparently.
+ */
+#define PEX_SHM_RING_SIZE 0x8000
+#define PEX_SHM_MAGIC     0x58454853
+#define PEX_SHM_ANNOUNCE  0x58454801
+#define PEX_SHM_KICK      0x58454802
+
+typedef struct pex_shm_ring {
+	volatile uint32_t head;    /* Read index, owned by the consumer */
+	volatile uint32_t tail;    /* Write index, owned by the producer */
+	volatile uint32_t waiting; /* Consumer may be blocked on the descriptor */
+	uint8_t data[PEX_SHM_RING_SIZE];
+} pex_shm_ring_t;
+
+typedef struct pex_shm_region {
+	uint32_t magic;
+	pex_shm_ring_t to_server;
+	pex_shm_ring_t to_client;
+} pex_shm_region_t;
+
+typedef struct pex_shm_announce {
+	uint32_t magic; /* PEX_SHM_ANNOUNCE */
+	char key[64];
+} pex_shm_announce_t;
+
+typedef struct pex_shm {
+	FILE * sock;
+	pex_shm_region_t * region;
+	int is_server;
+	uintptr_t peer; /* Client handle for server-side kicks */
+	char key[64];
+} pex_shm_t;
+
 size_t pex_send(FILE * sock, unsigned int rcpt, size_t size, char * blob);
 size_t pex_broadcast(FILE * sock, size_t size, char * blob);
 size_t pex_listen(FILE * sock, pex_packet_t * packet);
@@ -25,7 +64,29 @@ size_t pex_reply(FILE * sock, size_t size, char * blob);
 size_t pex_recv(FILE * sock, char * blob);
 size_t pex_query(FILE * sock);
 
+/*
+ * Batched reads: a buffer larger than PACKET_SIZE returns as many
+ * consecutive pex_packet_t records as were queued and fit (headers
+ * included on both endpoints, so records self-frame); walk them
+ * with pex_packet_next.
+ */
+size_t pex_drain(FILE * sock, void * buffer, size_t size);
+
+static inline pex_packet_t * pex_packet_next(pex_packet_t * packet) {
+	return (pex_packet_t *)((uintptr_t)packet + sizeof(pex_packet_t) + packet->size);
+}
+
 FILE * pex_bind(char * target);
 FILE * pex_connect(char * target);
 
+pex_shm_t * pex_shm_connect(FILE * sock);
+pex_shm_t * pex_shm_accept(FILE * sock, pex_packet_t * announce);
+size_t pex_shm_send(pex_shm_t * shm, size_t size, char * blob);
+size_t pex_shm_recv(pex_shm_t * shm, char * blob);
+size_t pex_shm_queued(pex_shm_t * shm);
+void pex_shm_prepare_wait(pex_shm_t * shm);
+void pex_shm_finish_wait(pex_shm_t * shm);
+int pex_shm_is_control(pex_packet_t * packet);
+void pex_shm_close(pex_shm_t * shm);
+
 #endif
@@ -40,3 +40,79 @@ void pthread_exit(void * value) {
 	void (*magic_exit_func)(void) = (void *)magic_exit_target;
 	magic_exit_func();
 }
+
+static inline int atomic_swap(volatile int * x, int v) {
+	__asm__ __volatile__("xchg %0, %1" : "=r"(v), "=m"(*x) : "0"(v) : "memory");
+	return v;
+}
+
+/*
+ * Blocking mutexes over the kernel futex calls. Uncontended lock and
+ * unlock stay entirely in userspace; we only enter the kernel when we
+ * actually have to sleep or when someone may be sleeping on us.
+ */
+int pthread_mutex_init(pthread_mutex_t * mutex, const pthread_mutexattr_t * attr) {
+	(void)attr;
+	mutex->state = 0;
+	return 0;
+}
+
+int pthread_mutex_trylock(pthread_mutex_t * mutex) {
+	return atomic_swap(&mutex->state, 1) ? -1 : 0;
+}
+
+int pthread_mutex_lock(pthread_mutex_t * mutex) {
+	if (!atomic_swap(&mutex->state, 1)) {
+		return 0; /* Uncontended */
+	}
+	/* Mark contended so the holder knows to wake us, then sleep until
+	 * the state we saw has changed. */
+	while (atomic_swap(&mutex->state, 2)) {
+		syscall_futex_wait(&mutex->state, 2);
+	}
+	return 0;
+}
+
+int pthread_mutex_unlock(pthread_mutex_t * mutex) {
+	if (atomic_swap(&mutex->state, 0) == 2) {
+		/* Someone is (or was about to be) asleep on us */
+		syscall_futex_wake(&mutex->state, 1);
+	}
+	return 0;
+}
+
+int pthread_mutex_destroy(pthread_mutex_t * mutex) {
+	(void)mutex;
+	return 0;
+}
+
+int pthread_cond_init(pthread_cond_t * cond, const pthread_condattr_t * attr) {
+	(void)attr;
+	cond->seq = 0;
+	return 0;
+}
+
+int pthread_cond_wait(pthread_cond_t * cond, pthread_mutex_t * mutex) {
+	int seq = cond->seq;
+	pthread_mutex_unlock(mutex);
+	syscall_futex_wait(&cond->seq, seq);
+	pthread_mutex_lock(mutex);
+	return 0;
+}
+
+int pthread_cond_signal(pthread_cond_t * cond) {
+	__sync_fetch_and_add(&cond->seq, 1);
+	syscall_futex_wake(&cond->seq, 1);
+	return 0;
+}
+
+int pthread_cond_broadcast(pthread_cond_t * cond) {
+	__sync_fetch_and_add(&cond->seq, 1);
+	syscall_futex_wake(&cond->seq, 0x7FFFFFFF);
+	return 0;
+}
+
+int pthread_cond_destroy(pthread_cond_t * cond) {
+	(void)cond;
+	return 0;
+}
@@ -11,10 +11,36 @@ typedef struct {
 } pthread_t;
 typedef unsigned int pthread_attr_t;
 
+/* Futex-backed blocking mutex: 0 = free, 1 = locked, 2 = contended */
+typedef struct {
+	int state;
+} pthread_mutex_t;
+typedef unsigned int pthread_mutexattr_t;
+
+typedef struct {
+	int seq;
+} pthread_cond_t;
+typedef unsigned int pthread_condattr_t;
+
+#define PTHREAD_MUTEX_INITIALIZER { 0 }
+#define PTHREAD_COND_INITIALIZER  { 0 }
+
 int pthread_create(pthread_t * thread, pthread_attr_t * attr, void *(*start_routine)(void *), void * arg);
 void pthread_exit(void * value);
 int pthread_kill(pthread_t thread, int sig);
 
+int pthread_mutex_init(pthread_mutex_t * mutex, const pthread_mutexattr_t * attr);
+int pthread_mutex_lock(pthread_mutex_t * mutex);
+int pthread_mutex_trylock(pthread_mutex_t * mutex);
+int pthread_mutex_unlock(pthread_mutex_t * mutex);
+int pthread_mutex_destroy(pthread_mutex_t * mutex);
+
+int pthread_cond_init(pthread_cond_t * cond, const pthread_condattr_t * attr);
+int pthread_cond_wait(pthread_cond_t * cond, pthread_mutex_t * mutex);
+int pthread_cond_signal(pthread_cond_t * cond);
+int pthread_cond_broadcast(pthread_cond_t * cond);
+int pthread_cond_destroy(pthread_cond_t * cond);
+
 int clone(uintptr_t,uintptr_t,void*);
 int gettid();
 
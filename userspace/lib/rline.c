@@ -304,31 +304,38 @@ int rline(char * buffer, int buf_size, rline_callbacks_t * callbacks) {
 				}
 				continue;
 			case KEY_CTRL_ARROW_RIGHT:
-				while (context.offset < context.collected && context.buffer[context.offset] == ' ') {
-					context.offset++;
-					printf("\033[C");
-				}
-				while (context.offset < context.collected) {
-					context.offset++;
-					printf("\033[C");
-					if (context.buffer[context.offset] == ' ') break;
+				{
+					int jump = 0;
+					while (context.offset < context.collected && context.buffer[context.offset] == ' ') {
+						context.offset++;
+						jump++;
+					}
+					while (context.offset < context.collected) {
+						context.offset++;
+						jump++;
+						if (context.buffer[context.offset] == ' ') break;
+					}
+					if (jump) printf("\033[%dC", jump);
+					fflush(stdout);
 				}
-				fflush(stdout);
 				continue;
 			case KEY_CTRL_ARROW_LEFT:
-				if (context.offset == 0) continue;
-				context.offset--;
-				printf("\033[D");
-				while (context.offset && context.buffer[context.offset] == ' ') {
-					context.offset--;
-					printf("\033[D");
-				}
-				while (context.offset > 0) {
-					if (context.buffer[context.offset-1] == ' ') break;
+				{
+					if (context.offset == 0) continue;
+					int jump = 1;
 					context.offset--;
-					printf("\033[D");
+					while (context.offset && context.buffer[context.offset] == ' ') {
+						context.offset--;
+						jump++;
+					}
+					while (context.offset > 0) {
+						if (context.buffer[context.offset-1] == ' ') break;
+						context.offset--;
+						jump++;
+					}
+					printf("\033[%dD", jump);
+					fflush(stdout);
 				}
-				fflush(stdout);
 				continue;
 			case KEY_ARROW_RIGHT:
 				if (callbacks->key_right) {
@@ -354,17 +361,17 @@ int rline(char * buffer, int buf_size, rline_callbacks_t * callbacks) {
 				continue;
 			case KEY_CTRL_A:
 			case KEY_HOME:
-				while (context.offset > 0) {
-					printf("\033[D");
-					context.offset--;
+				if (context.offset > 0) {
+					printf("\033[%dD", context.offset);
+					context.offset = 0;
 				}
 				fflush(stdout);
 				continue;
 			case KEY_CTRL_E:
 			case KEY_END:
-				while (context.offset < context.collected) {
-					printf("\033[C");
-					context.offset++;
+				if (context.offset < context.collected) {
+					printf("\033[%dC", context.collected - context.offset);
+					context.offset = context.collected;
 				}
 				fflush(stdout);
 				continue;
@@ -386,16 +393,10 @@ int rline(char * buffer, int buf_size, rline_callbacks_t * callbacks) {
 					if (context.offset == context.collected) {
 						continue;
 					}
-					int remaining = context.collected - context.offset;
-					for (int i = 1; i < remaining; ++i) {
-						printf("%c", context.buffer[context.offset + i]);
-						context.buffer[context.offset + i - 1] = context.buffer[context.offset + i];
-					}
-					printf(" ");
-					for (int i = 0; i < remaining; ++i) {
-						printf("\033[D");
-					}
+					memmove(&context.buffer[context.offset], &context.buffer[context.offset + 1], context.collected - context.offset - 1);
 					context.collected--;
+					context.buffer[context.collected] = '\0';
+					printf("\033[P");
 					fflush(stdout);
 				}
 				continue;
@@ -405,25 +406,19 @@ int rline(char * buffer, int buf_size, rline_callbacks_t * callbacks) {
 					if (!context.offset) {
 						continue;
 					}
-					printf("\010 \010");
 					if (context.buffer[context.offset-1] == '\t') {
 						should_redraw = 1;
 					}
 					if (context.offset != context.collected) {
-						int remaining = context.collected - context.offset;
-						for (int i = 0; i < remaining; ++i) {
-							printf("%c", context.buffer[context.offset + i]);
-							context.buffer[context.offset + i - 1] = context.buffer[context.offset + i];
-						}
-						printf(" ");
-						for (int i = 0; i < remaining + 1; ++i) {
-							printf("\033[D");
-						}
+						memmove(&context.buffer[context.offset - 1], &context.buffer[context.offset], context.collected - context.offset);
 						context.offset--;
 						context.collected--;
+						context.buffer[context.collected] = '\0';
+						printf("\033[D\033[P");
 					} else {
 						context.buffer[--context.collected] = '\0';
 						context.offset--;
+						printf("\010 \010");
 					}
 					if (should_redraw) {
 						rline_redraw_clean(&context);
@@ -452,22 +447,16 @@ int rline(char * buffer, int buf_size, rline_callbacks_t * callbacks) {
 						continue;
 					}
 					do {
-						printf("\010 \010");
 						if (context.offset != context.collected) {
-							int remaining = context.collected - context.offset;
-							for (int i = 0; i < remaining; ++i) {
-								printf("%c", context.buffer[context.offset + i]);
-								context.buffer[context.offset + i - 1] = context.buffer[context.offset + i];
-							}
-							printf(" ");
-							for (int i = 0; i < remaining + 1; ++i) {
-								printf("\033[D");
-							}
+							memmove(&context.buffer[context.offset - 1], &context.buffer[context.offset], context.collected - context.offset);
 							context.offset--;
 							context.collected--;
+							context.buffer[context.collected] = '\0';
+							printf("\033[D\033[P");
 						} else {
 							context.buffer[--context.collected] = '\0';
 							context.offset--;
+							printf("\010 \010");
 						}
 					} while ((context.offset) && (context.buffer[context.offset-1] != ' '));
 					fflush(stdout);
@@ -479,9 +468,9 @@ int rline(char * buffer, int buf_size, rline_callbacks_t * callbacks) {
 				}
 				continue;
 			case '\n':
-				while (context.offset < context.collected) {
-					printf("\033[C");
-					context.offset++;
+				if (context.offset < context.collected) {
+					printf("\033[%dC", context.collected - context.offset);
+					context.offset = context.collected;
 				}
 				if (context.collected < context.requested) {
 					context.buffer[context.collected] = '\n';
@@ -494,19 +483,13 @@ int rline(char * buffer, int buf_size, rline_callbacks_t * callbacks) {
 				continue;
 		}
 		if (context.offset != context.collected) {
-			for (int i = context.collected; i > context.offset; --i) {
-				context.buffer[i] = context.buffer[i-1];
-			}
 			if (context.collected < context.requested) {
+				memmove(&context.buffer[context.offset + 1], &context.buffer[context.offset], context.collected - context.offset);
 				context.buffer[context.offset] = (char)key_sym;
 				context.buffer[++context.collected] = '\0';
 				context.offset++;
-			}
-			for (int i = context.offset - 1; i < context.collected; ++i) {
-				printf("%c", context.buffer[i]);
-			}
-			for (int i = context.offset; i < context.collected; ++i) {
-				printf("\033[D");
+				/* Open a cell with ICH rather than rewriting the tail */
+				printf("\033[@%c", (char)key_sym);
 			}
 			fflush(stdout);
 		} else {
@@ -31,10 +31,20 @@
  *
  */
 
+#include <stdio.h>	/* SHA256_File()/SHA512_File() */
+#include <stdlib.h>
 #include <string.h>	/* memcpy()/memset() or bcopy()/bzero() */
 #include <assert.h>	/* assert() */
 #include "sha2.h"
 
+/*
+ * ToaruOS userspace is built with -msse2 (see USER_CFLAGS), so the
+ * input block byte-swap is done a whole XMM register at a time and
+ * the unrolled transform loops are always used.
+ */
+#define SHA2_UNROLL_TRANSFORM
+#include <emmintrin.h>
+
 /*
  * ASSERT NOTE:
  * Some sanity checking code is included using assert().  On my FreeBSD
@@ -139,6 +149,29 @@ typedef u_int64_t sha2_word64;	/* Exactly 8 bytes */
 	(x) = ((tmp & 0xffff0000ffff0000ULL) >> 16) | \
 	      ((tmp & 0x0000ffff0000ffffULL) << 16); \
 }
+/*
+ * SSE2 versions of the above, converting a whole input block at
+ * once: swap the bytes within each 16-bit lane, then swap the lanes
+ * within each word.
+ */
+static void sha2_swap_block_256(sha2_word32 * W, const sha2_byte * data) {
+	for (int i = 0; i < 4; ++i) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(data + i * 16));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+		_mm_storeu_si128((__m128i *)(W + i * 4), v);
+	}
+}
+
+static void sha2_swap_block_512(sha2_word64 * W, const sha2_byte * data) {
+	for (int i = 0; i < 8; ++i) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(data + i * 16));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+		v = _mm_or_si128(_mm_slli_epi64(v, 32), _mm_srli_epi64(v, 32));
+		_mm_storeu_si128((__m128i *)(W + i * 2), v);
+	}
+}
 #endif /* BYTE_ORDER == LITTLE_ENDIAN */
 
 /*
@@ -347,8 +380,8 @@ void SHA256_Init(SHA256_CTX* context) {
 
 #if BYTE_ORDER == LITTLE_ENDIAN
 
+/* The whole block was byte-swapped into W256 up front with SSE2 */
 #define ROUND256_0_TO_15(a,b,c,d,e,f,g,h)	\
-	REVERSE32(*data++, W256[j]); \
 	T1 = (h) + Sigma1_256(e) + Ch((e), (f), (g)) + \
              K256[j] + W256[j]; \
 	(d) += T1; \
@@ -395,6 +428,11 @@ void SHA256_Transform(SHA256_CTX* context, const sha2_word32* data) {
 	g = context->state[6];
 	h = context->state[7];
 
+#if BYTE_ORDER == LITTLE_ENDIAN
+	/* Convert the whole block to host byte order */
+	sha2_swap_block_256(W256, (const sha2_byte *)data);
+#endif
+
 	j = 0;
 	do {
 		/* Rounds 0 to 15 (unrolled): */
@@ -674,8 +712,8 @@ void SHA512_Init(SHA512_CTX* context) {
 /* Unrolled SHA-512 round macros: */
 #if BYTE_ORDER == LITTLE_ENDIAN
 
+/* The whole block was byte-swapped into W512 up front with SSE2 */
 #define ROUND512_0_TO_15(a,b,c,d,e,f,g,h)	\
-	REVERSE64(*data++, W512[j]); \
 	T1 = (h) + Sigma1_512(e) + Ch((e), (f), (g)) + \
              K512[j] + W512[j]; \
 	(d) += T1, \
@@ -720,6 +758,11 @@ void SHA512_Transform(SHA512_CTX* context, const sha2_word64* data) {
 	g = context->state[6];
 	h = context->state[7];
 
+#if BYTE_ORDER == LITTLE_ENDIAN
+	/* Convert the whole block to host byte order */
+	sha2_swap_block_512(W512, (const sha2_byte *)data);
+#endif
+
 	j = 0;
 	do {
 		ROUND512_0_TO_15(a,b,c,d,e,f,g,h);
@@ -1062,3 +1105,50 @@ char* SHA384_Data(const sha2_byte* data, size_t len, char digest[SHA384_DIGEST_S
 	return SHA384_End(&context, digest);
 }
 
+
+/*** Whole files: *****************************************************/
+/*
+ * Hash a file through the incremental API in large chunks, so
+ * integrity sweeps never hold more than one chunk in memory.
+ * Returns nonzero if the file could not be opened.
+ */
+#define SHA2_FILE_CHUNK (1 << 20)
+
+int SHA256_File(const char* path, char digest[SHA256_DIGEST_STRING_LENGTH]) {
+	FILE * f = fopen(path, "r");
+	if (!f) return 1;
+
+	SHA256_CTX	context;
+	sha2_byte * buf = malloc(SHA2_FILE_CHUNK);
+	size_t r;
+
+	SHA256_Init(&context);
+	while ((r = fread(buf, 1, SHA2_FILE_CHUNK, f)) > 0) {
+		SHA256_Update(&context, buf, r);
+	}
+	SHA256_End(&context, digest);
+
+	free(buf);
+	fclose(f);
+	return 0;
+}
+
+int SHA512_File(const char* path, char digest[SHA512_DIGEST_STRING_LENGTH]) {
+	FILE * f = fopen(path, "r");
+	if (!f) return 1;
+
+	SHA512_CTX	context;
+	sha2_byte * buf = malloc(SHA2_FILE_CHUNK);
+	size_t r;
+
+	SHA512_Init(&context);
+	while ((r = fread(buf, 1, SHA2_FILE_CHUNK, f)) > 0) {
+		SHA512_Update(&context, buf, r);
+	}
+	SHA512_End(&context, digest);
+
+	free(buf);
+	fclose(f);
+	return 0;
+}
+
@@ -148,6 +148,9 @@ void SHA512_Final(uint8_t[SHA512_DIGEST_LENGTH], SHA512_CTX*);
 char* SHA512_End(SHA512_CTX*, char[SHA512_DIGEST_STRING_LENGTH]);
 char* SHA512_Data(const uint8_t*, size_t, char[SHA512_DIGEST_STRING_LENGTH]);
 
+int SHA256_File(const char*, char[SHA256_DIGEST_STRING_LENGTH]);
+int SHA512_File(const char*, char[SHA512_DIGEST_STRING_LENGTH]);
+
 #else /* SHA2_USE_INTTYPES_H */
 
 void SHA256_Init(SHA256_CTX *);
@@ -168,6 +171,9 @@ void SHA512_Final(u_int8_t[SHA512_DIGEST_LENGTH], SHA512_CTX*);
 char* SHA512_End(SHA512_CTX*, char[SHA512_DIGEST_STRING_LENGTH]);
 char* SHA512_Data(const u_int8_t*, size_t, char[SHA512_DIGEST_STRING_LENGTH]);
 
+int SHA256_File(const char*, char[SHA256_DIGEST_STRING_LENGTH]);
+int SHA512_File(const char*, char[SHA512_DIGEST_STRING_LENGTH]);
+
 #endif /* SHA2_USE_INTTYPES_H */
 
 #else /* NOPROTO */
@@ -190,6 +196,9 @@ void SHA512_Final();
 char* SHA512_End();
 char* SHA512_Data();
 
+int SHA256_File();
+int SHA512_File();
+
 #endif /* NOPROTO */
 
 #ifdef	__cplusplus
@@ -16,14 +16,13 @@
 
 #include "lib/yutani.h"
 #include "lib/graphics.h"
+#include "lib/hashmap.h"
 
 #include "shmemfonts.h"
 #include "utf8decode.h"
 
 static FT_Library   library;
 static FT_Face      faces[FONTS_TOTAL]; /* perhaps make this an array ? */
-static FT_GlyphSlot slot;
-static FT_UInt      glyph_index;
 static int initialized = 0;
 static int _font_size = 12;
 static int selected_face = 0;
@@ -91,147 +90,276 @@ char * shmem_font_name(int i) {
 }
 
 /*
- * Draw a character to a context.
+ * Rendered glyph cache.
+ *
+ * The font files themselves are shared between processes, but every
+ * caller was still shaping and rasterizing through FreeType on every
+ * draw_string() - a ttk label pays the full FreeType cost each frame.
+ * We keep each rendered glyph's coverage bitmap and metrics keyed on
+ * (face, pixel size, codepoint), and on top of that cache whole
+ * rendered runs keyed on (face, size, color, string) as premultiplied
+ * sprites, so repeated strings become a single blended blit with no
+ * FreeType calls at all.
  */
-static void draw_char(FT_Bitmap * bitmap, int x, int y, uint32_t fg, gfx_context_t * ctx) {
+typedef struct {
+	int width;
+	int rows;
+	int left;
+	int top;
+	int advance_x;
+	int advance_y;
+	uint8_t * coverage; /* width * rows alpha values; NULL if the glyph is blank */
+} glyph_cache_entry_t;
+
+typedef struct {
+	sprite_t * sprite; /* NULL for runs that render nothing */
+	int off_x; /* sprite position relative to the pen origin */
+	int off_y;
+} string_cache_entry_t;
+
+static hashmap_t * glyph_cache = NULL;
+static hashmap_t * string_cache = NULL;
+static int string_cache_count = 0;
+
+/* Runs longer than this, or sizes/codepoints that don't fit the packed
+ * glyph key, fall back to drawing directly. */
+#define STRING_CACHE_MAX_LEN 128
+#define STRING_CACHE_MAX_ENTRIES 64
+
+/*
+ * Decode the next UTF-8 codepoint from *s, advancing it.
+ * Returns 0 at the end of the string.
+ */
+static uint32_t next_codepoint(uint8_t ** s) {
+	uint32_t codepoint;
+	uint32_t state = 0;
+	while (**s) {
+		if (!decode(&state, &codepoint, **s)) {
+			(*s)++;
+			return codepoint;
+		} else if (state == UTF8_REJECT) {
+			state = 0;
+		}
+		(*s)++;
+	}
+	return 0;
+}
+
+/*
+ * Fetch the rendered glyph for a codepoint in the current face and
+ * size, rasterizing and caching it (fallback resolution included) on
+ * the first use.
+ */
+static glyph_cache_entry_t * glyph_load(int face, uint32_t codepoint) {
+	int size = faces[face]->size->metrics.x_ppem;
+	if (size > 0x7F || codepoint > 0x1FFFFF) return NULL;
+	uintptr_t key = ((uintptr_t)face << 28) | ((uintptr_t)size << 21) | codepoint;
+
+	if (!glyph_cache) {
+		glyph_cache = hashmap_create_int(0x100);
+	}
+	glyph_cache_entry_t * out = hashmap_get(glyph_cache, (void *)key);
+	if (out) return out;
+
+	FT_Face f = faces[face];
+	FT_UInt glyph_index = FT_Get_Char_Index(f, codepoint);
+	if (!glyph_index) {
+		int i = 0;
+		while (!glyph_index && fallbacks[i] != -1) {
+			int fallback = fallbacks[i++];
+			glyph_index = FT_Get_Char_Index(faces[fallback], codepoint);
+			if (glyph_index) {
+				f = faces[fallback];
+			}
+		}
+	}
+	int error = FT_Load_Glyph(f, glyph_index, FT_LOAD_RENDER);
+	if (error) {
+		fprintf(stderr, "Error loading glyph for '%d'\n", codepoint);
+		return NULL;
+	}
+	FT_GlyphSlot slot = f->glyph;
+
+	out = malloc(sizeof(glyph_cache_entry_t));
+	out->width = slot->bitmap.width;
+	out->rows  = slot->bitmap.rows;
+	out->left  = slot->bitmap_left;
+	out->top   = slot->bitmap_top;
+	out->advance_x = slot->advance.x >> 6;
+	out->advance_y = slot->advance.y >> 6;
+	if (out->width && out->rows) {
+		out->coverage = malloc(out->width * out->rows);
+		for (int q = 0; q < out->rows; ++q) {
+			memcpy(&out->coverage[q * out->width], &slot->bitmap.buffer[q * slot->bitmap.pitch], out->width);
+		}
+	} else {
+		out->coverage = NULL;
+	}
+	hashmap_set(glyph_cache, (void *)key, out);
+	return out;
+}
+
+/*
+ * Draw a cached glyph to a context.
+ */
+static void draw_char(glyph_cache_entry_t * glyph, int x, int y, uint32_t fg, gfx_context_t * ctx) {
+	/* Premultiplied color for each coverage level, rebuilt when the
+	 * text color changes. */
+	static uint32_t color_lut[256];
+	static uint32_t color_lut_fg;
+	static int color_lut_set = 0;
+
+	if (!glyph->coverage) return;
+	if (!color_lut_set || color_lut_fg != fg) {
+		for (int a = 0; a < 256; ++a) {
+			color_lut[a] = premultiply(rgba(_RED(fg), _GRE(fg), _BLU(fg), (_ALP(fg) * a) / 255));
+		}
+		color_lut_fg = fg;
+		color_lut_set = 1;
+	}
+
 	int i, j, p, q;
-	int x_max = x + bitmap->width;
-	int y_max = y + bitmap->rows;
+	int x_max = x + glyph->width;
+	int y_max = y + glyph->rows;
+	gfx_mark_dirty(ctx, y, glyph->rows);
 	for (j = y, q = 0; j < y_max; j++, q++) {
 		if (j < 0 || j >= ctx->height) continue;
 		for ( i = x, p = 0; i < x_max; i++, p++) {
-			uint32_t a = _ALP(fg);
-			a = (a * bitmap->buffer[q * bitmap->width + p]) / 255;
-			uint32_t tmp = premultiply(rgba(_RED(fg),_GRE(fg),_BLU(fg),a));
 			if (i < 0 || i >= ctx->width) continue;
+			uint32_t tmp = color_lut[glyph->coverage[q * glyph->width + p]];
 			SGFX(ctx->backbuffer,i,j,ctx->width) = alpha_blend_rgba(SGFX(ctx->backbuffer,i,j,ctx->width),tmp);
 		}
 	}
 }
 
 uint32_t draw_string_width(char * string) {
-	slot = faces[selected_face]->glyph;
-	int pen_x = 0, i = 0;
-	int error;
-
-	uint8_t * s = string;
-
-	uint32_t codepoint;
-	uint32_t state = 0;
-
-	while (*s) {
-		uint32_t o = 0;
-		while (*s) {
-			if (!decode(&state, &codepoint, (uint8_t)*s)) {
-				o = (uint32_t)codepoint;
-				s++;
-				goto finished_width;
-			} else if (state == UTF8_REJECT) {
-				state = 0;
-			}
-			s++;
-		}
-
-finished_width:
-		if (!o) continue;
-
-		FT_UInt glyph_index;
-
-		glyph_index = FT_Get_Char_Index( faces[selected_face], o);
-		if (glyph_index) {
-			error = FT_Load_Glyph(faces[selected_face], glyph_index, FT_LOAD_DEFAULT);
-			if (error) {
-				fprintf(stderr, "Error loading glyph for '%d'\n", o);
-				continue;
-			}
-			slot = (faces[selected_face])->glyph;
-		} else {
-			int i = 0;
-			while (!glyph_index && fallbacks[i] != -1) {
-				int fallback = fallbacks[i++];
-				glyph_index = FT_Get_Char_Index( faces[fallback], o);
-				error = FT_Load_Glyph(faces[fallback], glyph_index, FT_LOAD_DEFAULT);
-				if (error) {
-					fprintf(stderr, "Error loading glyph for '%d'\n", o);
-					continue;
-				}
-				slot = (faces[fallback])->glyph;
-			}
-		}
-		pen_x += slot->advance.x >> 6;
+	int pen_x = 0;
+	uint8_t * s = (uint8_t *)string;
+	uint32_t o;
+
+	while ((o = next_codepoint(&s))) {
+		glyph_cache_entry_t * glyph = glyph_load(selected_face, o);
+		if (!glyph) continue;
+		pen_x += glyph->advance_x;
 	}
 	return pen_x;
 }
 
-void draw_string(gfx_context_t * ctx, int x, int y, uint32_t fg, char * string) {
-	slot = faces[selected_face]->glyph;
-	int pen_x = x, pen_y = y, i = 0;
-	int error;
+/*
+ * Draw a string, glyph by glyph, with no run caching.
+ */
+static void draw_string_direct(gfx_context_t * ctx, int x, int y, uint32_t fg, char * string) {
+	int pen_x = x, pen_y = y;
+	uint8_t * s = (uint8_t *)string;
+	uint32_t o;
+
+	while ((o = next_codepoint(&s))) {
+		glyph_cache_entry_t * glyph = glyph_load(selected_face, o);
+		if (!glyph) continue;
+		draw_char(glyph, pen_x + glyph->left, pen_y - glyph->top, fg, ctx);
+		pen_x += glyph->advance_x;
+		pen_y += glyph->advance_y;
+	}
+}
+
+/*
+ * Fetch (building if needed) the cached rendering of a whole string in
+ * the current face, size and color. Returns NULL if the run is not
+ * cacheable and should be drawn directly.
+ */
+static string_cache_entry_t * string_run_load(uint32_t fg, char * string) {
+	size_t len = strlen(string);
+	if (len > STRING_CACHE_MAX_LEN) return NULL;
 
-	uint8_t * s = string;
+	int size = faces[selected_face]->size->metrics.x_ppem;
+	char key[STRING_CACHE_MAX_LEN + 32];
+	snprintf(key, sizeof(key), "%d:%d:%x:%s", selected_face, size, fg, string);
 
-	uint32_t codepoint;
-	uint32_t state = 0;
+	if (!string_cache) {
+		string_cache = hashmap_create(0x40);
+	}
+	string_cache_entry_t * out = hashmap_get(string_cache, key);
+	if (out) return out;
+
+	/* Keep the cache bounded: when it fills up, drop everything. */
+	if (string_cache_count >= STRING_CACHE_MAX_ENTRIES) {
+		list_t * values = hashmap_values(string_cache);
+		foreach(node, values) {
+			string_cache_entry_t * entry = node->value;
+			if (entry->sprite) sprite_free(entry->sprite);
+			free(entry);
+		}
+		list_free(values);
+		free(values);
+		hashmap_free(string_cache);
+		free(string_cache);
+		string_cache = hashmap_create(0x40);
+		string_cache_count = 0;
+	}
 
-	while (*s) {
-		uint32_t o = 0;
-		while (*s) {
-			if (!decode(&state, &codepoint, (uint8_t)*s)) {
-				o = (uint32_t)codepoint;
-				s++;
-				goto finished;
-			} else if (state == UTF8_REJECT) {
-				state = 0;
-			}
-			s++;
+	/* First pass: bounding box of the run relative to the pen origin. */
+	int pen_x = 0, pen_y = 0;
+	int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+	int have_pixels = 0;
+	uint8_t * s = (uint8_t *)string;
+	uint32_t o;
+	while ((o = next_codepoint(&s))) {
+		glyph_cache_entry_t * glyph = glyph_load(selected_face, o);
+		if (!glyph) continue;
+		if (glyph->coverage) {
+			int gx0 = pen_x + glyph->left;
+			int gy0 = pen_y - glyph->top;
+			if (!have_pixels || gx0 < x0) x0 = gx0;
+			if (!have_pixels || gy0 < y0) y0 = gy0;
+			if (!have_pixels || gx0 + glyph->width > x1) x1 = gx0 + glyph->width;
+			if (!have_pixels || gy0 + glyph->rows > y1) y1 = gy0 + glyph->rows;
+			have_pixels = 1;
 		}
+		pen_x += glyph->advance_x;
+		pen_y += glyph->advance_y;
+	}
 
-finished:
-		if (!o) continue;
+	out = malloc(sizeof(string_cache_entry_t));
+	if (!have_pixels) {
+		out->sprite = NULL;
+		out->off_x = 0;
+		out->off_y = 0;
+		hashmap_set(string_cache, key, out);
+	string_cache_count++;
+		return out;
+	}
 
-		FT_UInt glyph_index;
+	/* Second pass: render the glyphs into a transparent sprite. */
+	out->sprite = create_sprite(x1 - x0, y1 - y0, ALPHA_EMBEDDED);
+	out->off_x = x0;
+	out->off_y = y0;
+	gfx_context_t * sctx = init_graphics_sprite(out->sprite);
+	draw_fill(sctx, rgba(0,0,0,0));
+	pen_x = 0; pen_y = 0;
+	s = (uint8_t *)string;
+	while ((o = next_codepoint(&s))) {
+		glyph_cache_entry_t * glyph = glyph_load(selected_face, o);
+		if (!glyph) continue;
+		draw_char(glyph, pen_x + glyph->left - x0, pen_y - glyph->top - y0, fg, sctx);
+		pen_x += glyph->advance_x;
+		pen_y += glyph->advance_y;
+	}
+	free(sctx);
 
-		glyph_index = FT_Get_Char_Index( faces[selected_face], o);
-		if (glyph_index) {
-			error = FT_Load_Glyph(faces[selected_face], glyph_index, FT_LOAD_DEFAULT);
-			if (error) {
-				fprintf(stderr, "Error loading glyph for '%d'\n", o);
-				continue;
-			}
-			slot = (faces[selected_face])->glyph;
-			if (slot->format == FT_GLYPH_FORMAT_OUTLINE) {
-				error = FT_Render_Glyph((faces[selected_face])->glyph, FT_RENDER_MODE_NORMAL);
-				if (error) {
-					fprintf(stderr, "Error rendering glyph for '%d'\n", o);
-					continue;
-				}
-			}
-		} else {
-			int i = 0;
-			while (!glyph_index && fallbacks[i] != -1) {
-				int fallback = fallbacks[i++];
-				glyph_index = FT_Get_Char_Index( faces[fallback], o);
-				error = FT_Load_Glyph(faces[fallback], glyph_index, FT_LOAD_DEFAULT);
-				if (error) {
-					fprintf(stderr, "Error loading glyph for '%d'\n", o);
-					continue;
-				}
-				slot = (faces[fallback])->glyph;
-				if (slot->format == FT_GLYPH_FORMAT_OUTLINE) {
-					error = FT_Render_Glyph((faces[fallback])->glyph, FT_RENDER_MODE_NORMAL);
-					if (error) {
-						fprintf(stderr, "Error rendering glyph for '%d'\n", o);
-						continue;
-					}
-				}
-			}
+	hashmap_set(string_cache, key, out);
+	string_cache_count++;
+	return out;
+}
 
+void draw_string(gfx_context_t * ctx, int x, int y, uint32_t fg, char * string) {
+	string_cache_entry_t * run = string_run_load(fg, string);
+	if (run) {
+		if (run->sprite) {
+			draw_sprite(ctx, run->sprite, x + run->off_x, y + run->off_y);
 		}
-
-		draw_char(&slot->bitmap, pen_x + slot->bitmap_left, pen_y - slot->bitmap_top, fg, ctx);
-		pen_x += slot->advance.x >> 6;
-		pen_y += slot->advance.y >> 6;
+		return;
 	}
+	draw_string_direct(ctx, x, y, fg, string);
 }
 
 void draw_string_shadow(gfx_context_t * ctx, int x, int y, uint32_t fg, char * string, uint32_t shadow_color, int darkness, int offset_x, int offset_y, double radius) {
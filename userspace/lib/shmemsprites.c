@@ -0,0 +1,95 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ * Copyright (C) 2018 Kevin Lange
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ *
+ * Shared-memory sprite cache.
+ *
+ * Companion to shmemfonts: the compositor decodes common PNGs -
+ * decoration pieces, cursors - once at startup and publishes the
+ * pixels in shared memory, keyed by the file path they came from.
+ * Clients map that one system-wide copy instead of decoding their
+ * own; anything not published falls back to reading the file.
+ *
+ * Obtained sprites point straight into the shared region, so they
+ * are read-only by convention and must never be freed.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+#include "lib/graphics.h"
+
+#include "shmemsprites.h"
+
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	uint32_t alpha;
+	uint32_t blank;
+} shm_sprite_header_t;
+
+/*
+ * Sprites are keyed by their source path, slashes folded to the
+ * dots the shared memory namespace is built from.
+ */
+static void sprite_key(char * ident, char * path, char * out, size_t size) {
+	snprintf(out, size, "sys.%s.sprites.%s", ident, path[0] == '/' ? path + 1 : path);
+	for (char * c = out; *c; ++c) {
+		if (*c == '/') *c = '.';
+	}
+}
+
+/*
+ * Map a published sprite. Returns 0 and fills `sprite` on success;
+ * nonzero means nothing was published for this path and the caller
+ * should load the file itself.
+ */
+int shm_sprite_obtain(sprite_t * sprite, char * path) {
+	char * display = getenv("DISPLAY");
+	if (!display) return 1;
+
+	char key[256];
+	sprite_key(display, path, key, 256);
+
+	/* A zero size probes without creating the region */
+	size_t size = 0;
+	shm_sprite_header_t * region = (shm_sprite_header_t *)syscall_shm_obtain(key, &size);
+	if (!region || size < sizeof(shm_sprite_header_t)) return 1;
+	if (size < sizeof(shm_sprite_header_t) + region->width * region->height * 4) return 1;
+
+	sprite->width  = region->width;
+	sprite->height = region->height;
+	sprite->bitmap = (uint32_t *)(region + 1);
+	sprite->masks  = NULL;
+	sprite->blank  = region->blank;
+	sprite->alpha  = region->alpha;
+	return 0;
+}
+
+/*
+ * Publish a loaded sprite for other clients to map. Masked sprites
+ * carry a second plane we don't bother sharing; callers keep their
+ * private copy and we return nonzero.
+ */
+int shm_sprite_publish(char * server_ident, char * path, sprite_t * sprite) {
+	if (!sprite->bitmap || sprite->masks) return 1;
+
+	char key[256];
+	sprite_key(server_ident, path, key, 256);
+
+	size_t size = sizeof(shm_sprite_header_t) + sprite->width * sprite->height * 4;
+	shm_sprite_header_t * region = (shm_sprite_header_t *)syscall_shm_obtain(key, &size);
+	if (!region) return 1;
+
+	region->width  = sprite->width;
+	region->height = sprite->height;
+	region->alpha  = sprite->alpha;
+	region->blank  = sprite->blank;
+	memcpy(region + 1, sprite->bitmap, sprite->width * sprite->height * 4);
+	return 0;
+}
@@ -0,0 +1,11 @@
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ */
+#ifndef SHMEMSPRITES_H
+#define SHMEMSPRITES_H
+
+#include "lib/graphics.h"
+
+int shm_sprite_obtain(sprite_t * sprite, char * path);
+int shm_sprite_publish(char * server_ident, char * path, sprite_t * sprite);
+
+#endif
@@ -35,4 +35,8 @@ typedef struct snd_knob_value {
 #define SND_MIXER_READ_KNOB 2
 #define SND_MIXER_WRITE_KNOB 3
 
+/* /dev/dsp: set this stream's sample rate in Hz (argp: uint32_t *);
+ * the mixer resamples to the device rate */
+#define SND_DSP_SET_RATE 4
+
 #endif  /* USERSPACE_LIB_SOUND_H */
@@ -7,11 +7,14 @@
  *
  */
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <syscall.h>
 #include <pwd.h>
+#include <sys/stat.h>
 #include "lib/sha2.h"
 
 #ifndef fgetpwent
@@ -20,17 +23,89 @@ extern struct passwd *fgetpwent(FILE *stream);
 
 #define MASTER_PASSWD "/etc/master.passwd"
 
+/*
+ * The parsed user table is kept in a process-local cache keyed by the
+ * file's mtime, so repeated checks in one process skip the re-parse;
+ * only the deliberately slow password hash is recomputed per check.
+ * This must stay private to the process: shm segments have no access
+ * control, so a shared table would let anyone plant a root entry.
+ */
+#define AUTH_CACHE_MAX 64
+
+typedef struct {
+	char name[64];
+	char hash[SHA512_DIGEST_STRING_LENGTH];
+	int  uid;
+} auth_cache_entry_t;
+
+typedef struct {
+	uint32_t mtime;
+	uint32_t count;
+	auth_cache_entry_t entries[AUTH_CACHE_MAX];
+} auth_cache_t;
+
+static int auth_cache_fill(auth_cache_t * cache, uint32_t mtime) {
+	FILE * master = fopen(MASTER_PASSWD, "r");
+	if (!master) return 1;
+
+	struct passwd * p;
+	uint32_t count = 0;
+	cache->mtime = 0;
+
+	while ((p = fgetpwent(master))) {
+		if (count == AUTH_CACHE_MAX ||
+		    strlen(p->pw_name) >= sizeof(cache->entries[0].name) ||
+		    strlen(p->pw_passwd) >= sizeof(cache->entries[0].hash)) {
+			/* Does not fit; leave the cache invalid */
+			fclose(master);
+			return 1;
+		}
+		strcpy(cache->entries[count].name, p->pw_name);
+		strcpy(cache->entries[count].hash, p->pw_passwd);
+		cache->entries[count].uid = p->pw_uid;
+		count++;
+	}
+	fclose(master);
+
+	cache->count = count;
+	cache->mtime = mtime;
+	return 0;
+}
+
 int toaru_auth_check_pass(char * user, char * pass) {
 
 	/* Generate SHA512 */
 	char hash[SHA512_DIGEST_STRING_LENGTH];
 	SHA512_Data(pass, strlen(pass), hash);
 
-	/* Open up /etc/master.passwd */
+	/* Check against the parsed table, refreshing it if the file has
+	 * changed since it was parsed */
+	static auth_cache_t auth_cache = {0};
+	struct stat statbuf;
+	if (!stat(MASTER_PASSWD, &statbuf)) {
+		auth_cache_t * cache = &auth_cache;
+		if (!cache->mtime || cache->mtime != (uint32_t)statbuf.st_mtime) {
+			if (auth_cache_fill(cache, (uint32_t)statbuf.st_mtime)) {
+				cache = NULL;
+			}
+		}
+		if (cache) {
+			for (uint32_t i = 0; i < cache->count; ++i) {
+				if (!strcmp(cache->entries[i].name, user) && !strcmp(cache->entries[i].hash, hash)) {
+					return cache->entries[i].uid;
+				}
+			}
+			return -1;
+		}
+	}
+
+	/* No cache available; parse /etc/master.passwd directly */
 
 	FILE * master = fopen(MASTER_PASSWD, "r");
 	struct passwd * p;
 
+	if (!master) return -1;
+
 	while ((p = fgetpwent(master))) {
 		if (!strcmp(p->pw_name, user) && !strcmp(p->pw_passwd, hash)) {
 			fclose(master);
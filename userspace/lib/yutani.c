@@ -15,16 +15,38 @@
 #include "lib/hashmap.h"
 #include "lib/list.h"
 
+/*
+ * Received messages are carved from a small per-connection arena of
+ * recycled MAX_PACKET_SIZE buffers, so an event loop stops being a
+ * malloc/free pair per mouse movement. Hand events back with
+ * yutani_msg_free; the buffers are ordinary allocations, so code
+ * that still calls free() merely opts out of the recycling.
+ */
+#define YUTANI_ARENA_DEPTH 8
+
+static yutani_msg_t * yutani_msg_buffer(yutani_t * y) {
+	if (y->free_msgs->length) {
+		node_t * node = list_pop(y->free_msgs);
+		yutani_msg_t * out = (yutani_msg_t *)node->value;
+		free(node);
+		return out;
+	}
+	return malloc(MAX_PACKET_SIZE);
+}
+
+void yutani_msg_free(yutani_t * y, yutani_msg_t * msg) {
+	if (!msg) return;
+	if (y->free_msgs->length < YUTANI_ARENA_DEPTH) {
+		list_insert(y->free_msgs, msg);
+	} else {
+		free(msg);
+	}
+}
+
 yutani_msg_t * yutani_wait_for(yutani_t * y, uint32_t type) {
 	do {
-		yutani_msg_t * out;
-		size_t size;
-		{
-			char tmp[MAX_PACKET_SIZE];
-			size = pex_recv(y->sock, tmp);
-			out = malloc(size);
-			memcpy(out, tmp, size);
-		}
+		yutani_msg_t * out = yutani_msg_buffer(y);
+		pex_recv(y->sock, (char *)out);
 
 		if (out->type == type) {
 			return out;
@@ -49,13 +71,8 @@ yutani_msg_t * yutani_poll(yutani_t * y) {
 		return out;
 	}
 
-	size_t size;
-	{
-		char tmp[MAX_PACKET_SIZE];
-		size = pex_recv(y->sock, tmp);
-		out = malloc(size);
-		memcpy(out, tmp, size);
-	}
+	out = yutani_msg_buffer(y);
+	pex_recv(y->sock, (char *)out);
 
 	if (out->type == YUTANI_MSG_WELCOME) {
 		struct yutani_msg_welcome * mw = (void *)out->data;
@@ -73,6 +90,23 @@ yutani_msg_t * yutani_poll_async(yutani_t * y) {
 	return NULL;
 }
 
+/*
+ * Fetch up to `max` messages in one call: blocks for the first, then
+ * drains whatever else is already pending. Event loops with expensive
+ * per-call overhead (language bindings in particular) can collapse a
+ * burst of mouse movement into a single native call this way. Each
+ * returned message should be handed back with yutani_msg_free.
+ */
+size_t yutani_poll_many(yutani_t * y, yutani_msg_t ** out, size_t max) {
+	if (!max) return 0;
+	size_t count = 0;
+	out[count++] = yutani_poll(y);
+	while (count < max && yutani_query(y) > 0) {
+		out[count++] = yutani_poll(y);
+	}
+	return count;
+}
+
 yutani_msg_t * yutani_msg_build_hello(void) {
 	size_t s = sizeof(struct yutani_message);
 	yutani_msg_t * msg = malloc(s);
@@ -542,10 +576,36 @@ yutani_msg_t * yutani_msg_build_timer_tick(void) {
 }
 
 
+/*
+ * The send path had the same problem in the other direction: each
+ * yutani_msg_build_* is a malloc the caller frees the moment the
+ * message hits the wire. Fixed-size messages are a few words, so the
+ * wrappers below stage them in a stack buffer instead. The build
+ * functions remain for variable-length messages and for the server,
+ * which constructs messages it does not send immediately.
+ */
+typedef struct {
+	uint32_t raw[(sizeof(struct yutani_message) + 64) / sizeof(uint32_t)];
+} yutani_msg_inline_t;
+
+static yutani_msg_t * yutani_msg_stage(yutani_msg_inline_t * buf, uint32_t type, size_t payload) {
+	yutani_msg_t * msg = (yutani_msg_t *)buf;
+	msg->magic = YUTANI_MSG__MAGIC;
+	msg->type  = type;
+	msg->size  = sizeof(struct yutani_message) + payload;
+	return msg;
+}
+
 int yutani_msg_send(yutani_t * y, yutani_msg_t * msg) {
 	return pex_reply(y->sock, msg->size, (char *)msg);
 }
 
+/* Several requests are nothing but their type field. */
+static void yutani_send_empty(yutani_t * y, uint32_t type) {
+	yutani_msg_inline_t buf;
+	int result = yutani_msg_send(y, yutani_msg_stage(&buf, type, 0));
+}
+
 yutani_t * yutani_context_create(FILE * socket) {
 	yutani_t * out = malloc(sizeof(yutani_t));
 
@@ -554,6 +614,7 @@ yutani_t * yutani_context_create(FILE * socket) {
 	out->display_height = 0;
 	out->windows = hashmap_create_int(10);
 	out->queued = list_create();
+	out->free_msgs = list_create();
 	return out;
 }
 
@@ -569,16 +630,16 @@ yutani_t * yutani_init(void) {
 	if (!c) return NULL; /* Connection failed. */
 
 	yutani_t * y = yutani_context_create(c);
-	yutani_msg_t * m = yutani_msg_build_hello();
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, YUTANI_MSG_HELLO, 0);
 	int result = yutani_msg_send(y, m);
-	free(m);
 
 	m = yutani_wait_for(y, YUTANI_MSG_WELCOME);
 	struct yutani_msg_welcome * mw = (void *)&m->data;
 	y->display_width = mw->display_width;
 	y->display_height = mw->display_height;
 	y->server_ident = server_name;
-	free(m);
+	yutani_msg_free(y, m);
 
 	return y;
 }
@@ -586,9 +647,13 @@ yutani_t * yutani_init(void) {
 yutani_window_t * yutani_window_create_flags(yutani_t * y, int width, int height, uint32_t flags) {
 	yutani_window_t * win = malloc(sizeof(yutani_window_t));
 
-	yutani_msg_t * m = yutani_msg_build_window_new_flags(width, height, flags);
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, YUTANI_MSG_WINDOW_NEW_FLAGS, sizeof(struct yutani_msg_window_new_flags));
+	struct yutani_msg_window_new_flags * mn = (void *)m->data;
+	mn->width = width;
+	mn->height = height;
+	mn->flags = flags;
 	int result = yutani_msg_send(y, m);
-	free(m);
 
 	m = yutani_wait_for(y, YUTANI_MSG_WINDOW_INIT);
 	struct yutani_msg_window_init * mw = (void *)&m->data;
@@ -598,14 +663,21 @@ yutani_window_t * yutani_window_create_flags(yutani_t * y, int width, int height
 	win->bufid = mw->bufid;
 	win->wid = mw->wid;
 	win->focused = 0;
+	win->flags = flags;
+	win->draw_buffer = 0;
+	win->buffer_age = 0;
+	win->buffer_drawn[0] = 0;
+	win->buffer_drawn[1] = 0;
+	yutani_msg_free(y, m);
 
 	hashmap_set(y->windows, (void*)win->wid, win);
 
 	char key[1024];
 	YUTANI_SHMKEY(y->server_ident, key, 1024, win);
 
-	size_t size = (width * height * 4);
-	win->buffer = (uint8_t *)syscall_shm_obtain(key, &size);
+	size_t size = (width * height * 4) * ((flags & YUTANI_WINDOW_FLAG_DOUBLE_BUFFER) ? 2 : 1);
+	win->buffer_base = (uint8_t *)syscall_shm_obtain(key, &size);
+	win->buffer = win->buffer_base;
 	return win;
 
 }
@@ -614,22 +686,48 @@ yutani_window_t * yutani_window_create(yutani_t * y, int width, int height) {
 	return yutani_window_create_flags(y,width,height,0);
 }
 
+/*
+ * After a flip the server displays the half we just finished, so
+ * move our draw pointer to the other one. The server swaps on the
+ * same flip message, and the channel is ordered, so both sides stay
+ * in step without a round trip.
+ */
+static void yutani_window_swap(yutani_window_t * win) {
+	if (!(win->flags & YUTANI_WINDOW_FLAG_DOUBLE_BUFFER)) return;
+	win->buffer_drawn[win->draw_buffer] = 1;
+	win->draw_buffer ^= 1;
+	win->buffer = win->buffer_base + (win->draw_buffer ? win->width * win->height * 4 : 0);
+	win->buffer_age = win->buffer_drawn[win->draw_buffer] ? 2 : 0;
+}
+
 void yutani_flip(yutani_t * y, yutani_window_t * win) {
-	yutani_msg_t * m = yutani_msg_build_flip(win->wid);
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, YUTANI_MSG_FLIP, sizeof(struct yutani_msg_flip));
+	struct yutani_msg_flip * mw = (void *)m->data;
+	mw->wid = win->wid;
 	int result = yutani_msg_send(y, m);
-	free(m);
+	yutani_window_swap(win);
 }
 
 void yutani_flip_region(yutani_t * yctx, yutani_window_t * win, int32_t x, int32_t y, int32_t width, int32_t height) {
-	yutani_msg_t * m = yutani_msg_build_flip_region(win->wid, x, y, width, height);
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, YUTANI_MSG_FLIP_REGION, sizeof(struct yutani_msg_flip_region));
+	struct yutani_msg_flip_region * mw = (void *)m->data;
+	mw->wid = win->wid;
+	mw->x = x;
+	mw->y = y;
+	mw->width = width;
+	mw->height = height;
 	int result = yutani_msg_send(yctx, m);
-	free(m);
+	yutani_window_swap(win);
 }
 
 void yutani_close(yutani_t * y, yutani_window_t * win) {
-	yutani_msg_t * m = yutani_msg_build_window_close(win->wid);
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, YUTANI_MSG_WINDOW_CLOSE, sizeof(struct yutani_msg_window_close));
+	struct yutani_msg_window_close * mw = (void *)m->data;
+	mw->wid = win->wid;
 	int result = yutani_msg_send(y, m);
-	free(m);
 
 	/* Now destroy our end of the window */
 	{
@@ -643,33 +741,47 @@ void yutani_close(yutani_t * y, yutani_window_t * win) {
 }
 
 void yutani_window_move(yutani_t * yctx, yutani_window_t * window, int x, int y) {
-	yutani_msg_t * m = yutani_msg_build_window_move(window->wid, x, y);
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, YUTANI_MSG_WINDOW_MOVE, sizeof(struct yutani_msg_window_move));
+	struct yutani_msg_window_move * mw = (void *)m->data;
+	mw->wid = window->wid;
+	mw->x = x;
+	mw->y = y;
 	int reuslt = yutani_msg_send(yctx, m);
-	free(m);
 }
 
 void yutani_set_stack(yutani_t * yctx, yutani_window_t * window, int z) {
-	yutani_msg_t * m = yutani_msg_build_window_stack(window->wid, z);
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, YUTANI_MSG_WINDOW_STACK, sizeof(struct yutani_msg_window_stack));
+	struct yutani_msg_window_stack * mw = (void *)m->data;
+	mw->wid = window->wid;
+	mw->z = z;
 	int reuslt = yutani_msg_send(yctx, m);
-	free(m);
 }
 
-void yutani_window_resize(yutani_t * yctx, yutani_window_t * window, uint32_t width, uint32_t height) {
-	yutani_msg_t * m = yutani_msg_build_window_resize(YUTANI_MSG_RESIZE_REQUEST, window->wid, width, height, 0);
+/* The resize messages all share a payload; stage it once. */
+static void yutani_send_resize(yutani_t * yctx, uint32_t type, yutani_wid_t wid, uint32_t width, uint32_t height, uint32_t bufid) {
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, type, sizeof(struct yutani_msg_window_resize));
+	struct yutani_msg_window_resize * mw = (void *)m->data;
+	mw->wid = wid;
+	mw->width = width;
+	mw->height = height;
+	mw->bufid = bufid;
 	int result = yutani_msg_send(yctx, m);
-	free(m);
+}
+
+void yutani_window_resize(yutani_t * yctx, yutani_window_t * window, uint32_t width, uint32_t height) {
+	yutani_send_resize(yctx, YUTANI_MSG_RESIZE_REQUEST, window->wid, width, height, 0);
 }
 
 void yutani_window_resize_offer(yutani_t * yctx, yutani_window_t * window, uint32_t width, uint32_t height) {
-	yutani_msg_t * m = yutani_msg_build_window_resize(YUTANI_MSG_RESIZE_OFFER, window->wid, width, height, 0);
-	int result = yutani_msg_send(yctx, m);
-	free(m);
+	yutani_send_resize(yctx, YUTANI_MSG_RESIZE_OFFER, window->wid, width, height, 0);
 }
 
 void yutani_window_resize_accept(yutani_t * yctx, yutani_window_t * window, uint32_t width, uint32_t height) {
-	yutani_msg_t * m = yutani_msg_build_window_resize(YUTANI_MSG_RESIZE_ACCEPT, window->wid, width, height, 0);
-	int result = yutani_msg_send(yctx, m);
-	free(m);
+	yutani_send_resize(yctx, YUTANI_MSG_RESIZE_ACCEPT, window->wid, width, height, 0);
+	yutani_msg_t * m;
 
 	/* Now wait for the new bufid */
 	m = yutani_wait_for(yctx, YUTANI_MSG_RESIZE_BUFID);
@@ -685,29 +797,44 @@ void yutani_window_resize_accept(yutani_t * yctx, yutani_window_t * window, uint
 	window->height = wr->height;
 	window->oldbufid = window->bufid;
 	window->bufid = wr->bufid;
-	free(m);
+	yutani_msg_free(yctx, m);
+
+	if (window->bufid == window->oldbufid) {
+		/* The server reused the region we already have mapped - the
+		 * reserved buffer is larger than the window - so just restart
+		 * on the first half. */
+		window->buffer = window->buffer_base;
+		window->draw_buffer = 0;
+		window->buffer_age = 0;
+		window->buffer_drawn[0] = 0;
+		window->buffer_drawn[1] = 0;
+		return;
+	}
 
 	/* Allocate the buffer */
 	{
 		char key[1024];
 		YUTANI_SHMKEY(yctx->server_ident, key, 1024, window);
 
-		size_t size = (window->width * window->height * 4);
-		window->buffer = (uint8_t *)syscall_shm_obtain(key, &size);
+		size_t size = (window->width * window->height * 4) * ((window->flags & YUTANI_WINDOW_FLAG_DOUBLE_BUFFER) ? 2 : 1);
+		window->buffer_base = (uint8_t *)syscall_shm_obtain(key, &size);
+		window->buffer = window->buffer_base;
+		window->draw_buffer = 0;
+		window->buffer_age = 0;
+		window->buffer_drawn[0] = 0;
+		window->buffer_drawn[1] = 0;
 	}
 }
 
 void yutani_window_resize_done(yutani_t * yctx, yutani_window_t * window) {
-	/* Destroy the old buffer */
-	{
+	/* Destroy the old buffer, unless the resize happened in place */
+	if (window->oldbufid != window->bufid) {
 		char key[1024];
 		YUTANI_SHMKEY_EXP(yctx->server_ident, key, 1024, window->oldbufid);
 		syscall_shm_release(key);
 	}
 
-	yutani_msg_t * m = yutani_msg_build_window_resize(YUTANI_MSG_RESIZE_DONE, window->wid, window->width, window->height, window->bufid);
-	int result = yutani_msg_send(yctx, m);
-	free(m);
+	yutani_send_resize(yctx, YUTANI_MSG_RESIZE_DONE, window->wid, window->width, window->height, window->bufid);
 }
 
 void yutani_window_advertise(yutani_t * yctx, yutani_window_t * window, char * name) {
@@ -765,81 +892,95 @@ void yutani_window_advertise_icon(yutani_t * yctx, yutani_window_t * window, cha
 }
 
 void yutani_subscribe_windows(yutani_t * y) {
-	yutani_msg_t * m = yutani_msg_build_subscribe();
-	int result = yutani_msg_send(y, m);
-	free(m);
+	yutani_send_empty(y, YUTANI_MSG_SUBSCRIBE);
 }
 
 void yutani_unsubscribe_windows(yutani_t * y) {
-	yutani_msg_t * m = yutani_msg_build_unsubscribe();
-	int result = yutani_msg_send(y, m);
-	free(m);
+	yutani_send_empty(y, YUTANI_MSG_UNSUBSCRIBE);
 }
 
 void yutani_query_windows(yutani_t * y) {
-	yutani_msg_t * m = yutani_msg_build_query_windows();
-	int result = yutani_msg_send(y, m);
-	free(m);
+	yutani_send_empty(y, YUTANI_MSG_QUERY_WINDOWS);
 }
 
 void yutani_session_end(yutani_t * y) {
-	yutani_msg_t * m = yutani_msg_build_session_end();
-	int result = yutani_msg_send(y, m);
-	free(m);
+	yutani_send_empty(y, YUTANI_MSG_SESSION_END);
 }
 
 void yutani_focus_window(yutani_t * yctx, yutani_wid_t wid) {
-	yutani_msg_t * m = yutani_msg_build_window_focus(wid);
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, YUTANI_MSG_WINDOW_FOCUS, sizeof(struct yutani_msg_window_focus));
+	struct yutani_msg_window_focus * mw = (void *)m->data;
+	mw->wid = wid;
 	int result = yutani_msg_send(yctx, m);
-	free(m);
 }
 
 void yutani_key_bind(yutani_t * yctx, kbd_key_t key, kbd_mod_t mod, int response) {
-	yutani_msg_t * m = yutani_msg_build_key_bind(key,mod,response);
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, YUTANI_MSG_KEY_BIND, sizeof(struct yutani_msg_key_bind));
+	struct yutani_msg_key_bind * mw = (void *)m->data;
+	mw->key = key;
+	mw->modifiers = mod;
+	mw->response = response;
 	int result = yutani_msg_send(yctx, m);
-	free(m);
 }
 
-void yutani_window_drag_start(yutani_t * yctx, yutani_window_t * window) {
-	yutani_msg_t * m = yutani_msg_build_window_drag_start(window->wid);
+void yutani_window_drag_start_wid(yutani_t * yctx, yutani_wid_t wid) {
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, YUTANI_MSG_WINDOW_DRAG_START, sizeof(struct yutani_msg_window_drag_start));
+	struct yutani_msg_window_drag_start * mw = (void *)m->data;
+	mw->wid = wid;
 	int result = yutani_msg_send(yctx, m);
-	free(m);
 }
 
-void yutani_window_drag_start_wid(yutani_t * yctx, yutani_wid_t wid) {
-	yutani_msg_t * m = yutani_msg_build_window_drag_start(wid);
-	int result = yutani_msg_send(yctx, m);
-	free(m);
+void yutani_window_drag_start(yutani_t * yctx, yutani_window_t * window) {
+	yutani_window_drag_start_wid(yctx, window->wid);
 }
 
 void yutani_window_update_shape(yutani_t * yctx, yutani_window_t * window, int set_shape) {
-	yutani_msg_t * m = yutani_msg_build_window_update_shape(window->wid, set_shape);
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, YUTANI_MSG_WINDOW_UPDATE_SHAPE, sizeof(struct yutani_msg_window_update_shape));
+	struct yutani_msg_window_update_shape * mw = (void *)m->data;
+	mw->wid = window->wid;
+	mw->set_shape = set_shape;
 	int result = yutani_msg_send(yctx, m);
-	free(m);
 }
 
 void yutani_window_warp_mouse(yutani_t * yctx, yutani_window_t * window, int32_t x, int32_t y) {
-	yutani_msg_t * m = yutani_msg_build_window_warp_mouse(window->wid, x, y);
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, YUTANI_MSG_WINDOW_WARP_MOUSE, sizeof(struct yutani_msg_window_warp_mouse));
+	struct yutani_msg_window_warp_mouse * mw = (void *)m->data;
+	mw->wid = window->wid;
+	mw->x = x;
+	mw->y = y;
 	int result = yutani_msg_send(yctx, m);
-	free(m);
 }
 
 void yutani_window_show_mouse(yutani_t * yctx, yutani_window_t * window, int32_t show_mouse) {
-	yutani_msg_t * m = yutani_msg_build_window_show_mouse(window->wid, show_mouse);
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, YUTANI_MSG_WINDOW_SHOW_MOUSE, sizeof(struct yutani_msg_window_show_mouse));
+	struct yutani_msg_window_show_mouse * mw = (void *)m->data;
+	mw->wid = window->wid;
+	mw->show_mouse = show_mouse;
 	int result = yutani_msg_send(yctx, m);
-	free(m);
 }
 
 void yutani_window_resize_start(yutani_t * yctx, yutani_window_t * window, yutani_scale_direction_t direction) {
-	yutani_msg_t * m = yutani_msg_build_window_resize_start(window->wid, direction);
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, YUTANI_MSG_WINDOW_RESIZE_START, sizeof(struct yutani_msg_window_resize_start));
+	struct yutani_msg_window_resize_start * mw = (void *)m->data;
+	mw->wid = window->wid;
+	mw->direction = direction;
 	int result = yutani_msg_send(yctx, m);
-	free(m);
 }
 
 void yutani_timer_request(yutani_t * yctx, uint32_t precision, uint32_t flags) {
-	yutani_msg_t * m = yutani_msg_build_timer_request(precision, flags);
+	yutani_msg_inline_t buf;
+	yutani_msg_t * m = yutani_msg_stage(&buf, YUTANI_MSG_TIMER_REQUEST, sizeof(struct yutani_msg_timer_request));
+	struct yutani_msg_timer_request * tr = (void *)m->data;
+	tr->precision = precision;
+	tr->flags = flags;
 	int result = yutani_msg_send(yctx, m);
-	free(m);
 }
 
 gfx_context_t * init_graphics_yutani(yutani_window_t * window) {
@@ -850,6 +991,7 @@ gfx_context_t * init_graphics_yutani(yutani_window_t * window) {
 	out->size   = GFX_H(out) * GFX_W(out) * GFX_B(out);
 	out->buffer = window->buffer;
 	out->backbuffer = out->buffer;
+	out->dirty  = NULL;
 	return out;
 }
 
@@ -871,6 +1013,9 @@ void reinit_graphics_yutani(gfx_context_t * out, yutani_window_t * window) {
 		out->buffer = window->buffer;
 		out->backbuffer = realloc(out->backbuffer, GFX_B(out) * GFX_W(out) * GFX_H(out));
 	}
+	if (out->dirty) {
+		gfx_track_dirty(out);
+	}
 }
 
 void release_graphics_yutani(gfx_context_t * gfx) {
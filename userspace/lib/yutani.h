@@ -41,6 +41,7 @@ typedef struct yutani_context {
 
 	hashmap_t * windows;
 	list_t * queued;
+	list_t * free_msgs;
 
 	char * server_ident;
 } yutani_t;
@@ -196,6 +197,13 @@ typedef struct yutani_window {
 	uint8_t focused;
 
 	uint32_t oldbufid;
+
+	/* Double buffering (YUTANI_WINDOW_FLAG_DOUBLE_BUFFER) */
+	uint32_t flags;
+	uint8_t * buffer_base;   /* Start of the shm region; buffer points at the draw half */
+	int draw_buffer;         /* Which half buffer points at */
+	uint32_t buffer_age;     /* Frames since the draw half was last displayed; 0 = never drawn */
+	uint8_t buffer_drawn[2]; /* Has each half ever been flipped? */
 } yutani_window_t;
 
 /* Magic value */
@@ -391,6 +399,15 @@ typedef struct yutani_window {
 #define YUTANI_WINDOW_FLAG_DISALLOW_DRAG    (1 << 1)
 #define YUTANI_WINDOW_FLAG_DISALLOW_RESIZE  (1 << 2)
 #define YUTANI_WINDOW_FLAG_ALT_ANIMATION    (1 << 3)
+/*
+ * Two shm halves; each flip swaps which one the server displays.
+ * The library repoints window->buffer at the new draw half after
+ * every flip, so re-fetch it (or re-init your graphics context)
+ * rather than caching the pointer across frames. buffer_age says
+ * how stale the draw half is: 0 = never drawn, 2 = two flips old,
+ * so repaint only what changed in the last two frames.
+ */
+#define YUTANI_WINDOW_FLAG_DOUBLE_BUFFER    (1 << 4)
 
 typedef struct {
 	int x;
@@ -402,7 +419,9 @@ typedef struct {
 extern yutani_msg_t * yutani_wait_for(yutani_t * y, uint32_t type);
 extern yutani_msg_t * yutani_poll(yutani_t * y);
 extern yutani_msg_t * yutani_poll_async(yutani_t * y);
+extern size_t yutani_poll_many(yutani_t * y, yutani_msg_t ** out, size_t max);
 extern size_t yutani_query(yutani_t * y);
+extern void yutani_msg_free(yutani_t * y, yutani_msg_t * msg);
 
 extern yutani_msg_t * yutani_msg_build_hello(void);
 extern yutani_msg_t * yutani_msg_build_welcome(uint32_t width, uint32_t height);
@@ -0,0 +1,91 @@
+#!/usr/bin/python3
+"""
+Bindings for the batched rendering library (libtoaru-batch).
+
+Instead of crossing into the graphics library once per rectangle or
+string, build a list of Op objects describing the frame and hand the
+whole thing to render() in one native call. Dashboards that redraw
+dozens of cells per tick should see their Python overhead collapse to
+a handful of calls.
+"""
+
+import ctypes
+
+_lib = None
+
+if not _lib:
+    _lib = ctypes.CDLL('libtoaru-batch.so')
+    _lib.batch_render.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+    _lib.batch_render.restype = ctypes.c_size_t
+    _lib.batch_text.argtypes = [ctypes.c_void_p, ctypes.c_int32, ctypes.c_int32, ctypes.c_void_p, ctypes.c_size_t]
+    _lib.batch_text.restype = ctypes.c_int32
+    _lib.batch_text_width.argtypes = [ctypes.c_void_p, ctypes.c_size_t]
+    _lib.batch_text_width.restype = ctypes.c_int32
+
+OP_FILL          = 1
+OP_SPRITE        = 2
+OP_SPRITE_SCALED = 3
+OP_TEXT          = 4
+
+class Op(ctypes.Structure):
+    """One drawing command; mirrors batch_op_t."""
+    _fields_ = [
+        ('op', ctypes.c_int32),
+        ('x', ctypes.c_int32),
+        ('y', ctypes.c_int32),
+        ('width', ctypes.c_int32),
+        ('height', ctypes.c_int32),
+        ('font', ctypes.c_int32),
+        ('size', ctypes.c_int32),
+        ('color', ctypes.c_uint32),
+        ('sprite', ctypes.c_void_p),
+        ('string', ctypes.c_char_p),
+    ]
+
+def fill(x, y, width, height, color):
+    """A rectangle fill command."""
+    return Op(op=OP_FILL, x=x, y=y, width=width, height=height, color=color)
+
+def sprite(sprite_ptr, x, y, width=0, height=0):
+    """A sprite blit command, scaled if dimensions are given."""
+    if width and height:
+        return Op(op=OP_SPRITE_SCALED, x=x, y=y, width=width, height=height, sprite=sprite_ptr)
+    return Op(op=OP_SPRITE, x=x, y=y, sprite=sprite_ptr)
+
+def text(string, x, y, font=0, size=13, color=0xFF000000):
+    """A text draw command. Accepts a toaru_fonts.Font for `font`."""
+    if hasattr(font, 'font_number'):
+        size = font.font_size
+        color = font.font_color
+        font = font.font_number
+    return Op(op=OP_TEXT, x=x, y=y, font=font, size=size, color=color,
+              string=string.encode('utf-8'))
+
+def _context(ctx):
+    # Allow a yutani.Window or GraphicsBuffer in place of a raw context.
+    if hasattr(ctx, '_gfx'):
+        return ctx._gfx
+    return ctx
+
+def _array(ops):
+    arr = (Op * len(ops))(*ops)
+    return arr
+
+def render(ctx, ops):
+    """Execute a list of commands against a window or graphics context."""
+    if not ops:
+        return 0
+    return _lib.batch_render(_context(ctx), _array(ops), len(ops))
+
+def text_run(ctx, x, y, runs):
+    """Draw consecutive text commands as one line starting at x,y.
+    Fonts and colors may differ per run. Returns the final pen x."""
+    if not runs:
+        return x
+    return _lib.batch_text(_context(ctx), x, y, _array(runs), len(runs))
+
+def text_run_width(runs):
+    """Measure a sequence of text commands without drawing."""
+    if not runs:
+        return 0
+    return _lib.batch_text_width(_array(runs), len(runs))
@@ -333,6 +333,23 @@ class Yutani(object):
         msg_class = _message_types.get(msg_ptr.contents.type, Message)
         return msg_class(msg_ptr)
 
+    def poll_many(self, maximum=32):
+        """Fetch a batch of event messages in one native call.
+
+        Blocks for the first message, then drains whatever else is
+        already pending, up to `maximum`. A redraw loop that processes
+        the returned list coalesces a burst of mouse movement into a
+        single crossing into the library instead of one poll() per
+        packet."""
+        buf = (c_void_p * maximum)()
+        count = yutani_lib.yutani_poll_many(self._ptr, buf, maximum)
+        messages = []
+        for i in range(count):
+            msg_ptr = cast(buf[i], POINTER(Message._yutani_msg_t))
+            msg_class = _message_types.get(msg_ptr.contents.type, Message)
+            messages.append(msg_class(msg_ptr))
+        return messages
+
     def wait_for(self, message):
         """Wait for a particular kind of message to be delivered."""
         result = yutani_lib.yutani_wait_for(self._ptr, message)
@@ -0,0 +1,94 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * futex test
+ *
+ * Exercises the raw futex syscalls with a wait/wake handshake
+ * between two threads, then hammers a pthread mutex from several
+ * threads and checks the count comes out right.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <syscall.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "lib/pthread.h"
+
+#define NUM_THREADS 4
+#define PER_THREAD  100000
+
+static volatile int futex_word = 0;
+static volatile int woke = 0;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile int counter = 0;
+
+static void * waiter(void * arg) {
+	/* Blocks while futex_word is still 0 */
+	syscall_futex_wait((int *)&futex_word, 0);
+	if (futex_word == 1) {
+		woke = 1;
+	}
+	pthread_exit(NULL);
+	return NULL;
+}
+
+static void * incrementer(void * arg) {
+	for (int i = 0; i < PER_THREAD; ++i) {
+		pthread_mutex_lock(&mutex);
+		counter++;
+		pthread_mutex_unlock(&mutex);
+	}
+	pthread_exit(NULL);
+	return NULL;
+}
+
+int main(int argc, char * argv[]) {
+	int failures = 0;
+
+	/* Handshake: the waiter blocks on the word, we flip it and wake */
+	pthread_t w;
+	pthread_create(&w, NULL, waiter, NULL);
+	usleep(50000);
+	futex_word = 1;
+	syscall_futex_wake((int *)&futex_word, 1);
+	waitpid(w.id, NULL, 0);
+	if (woke) {
+		printf("futex wait/wake handshake: ok\n");
+	} else {
+		printf("futex wait/wake handshake: FAILED\n");
+		failures++;
+	}
+
+	/* A wake with no waiters should be a quiet no-op */
+	syscall_futex_wake((int *)&futex_word, 1);
+
+	/* Mutex contention */
+	pthread_t thread[NUM_THREADS];
+	for (int i = 0; i < NUM_THREADS; ++i) {
+		pthread_create(&thread[i], NULL, incrementer, NULL);
+	}
+	for (int i = 0; i < NUM_THREADS; ++i) {
+		waitpid(thread[i].id, NULL, 0);
+	}
+	if (counter == NUM_THREADS * PER_THREAD) {
+		printf("mutex contention (%d): ok\n", counter);
+	} else {
+		printf("mutex contention: FAILED (%d != %d)\n", counter, NUM_THREADS * PER_THREAD);
+		failures++;
+	}
+
+	/* trylock on a held mutex should refuse */
+	pthread_mutex_lock(&mutex);
+	if (pthread_mutex_trylock(&mutex)) {
+		printf("trylock on held mutex: ok\n");
+	} else {
+		printf("trylock on held mutex: FAILED (acquired twice)\n");
+		failures++;
+	}
+	pthread_mutex_unlock(&mutex);
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * readv/writev test
+ *
+ * Gathers three segments into a pipe with one writev, reads the
+ * concatenation back, then scatters a single write across two
+ * buffers with readv.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+int main(int argc, char * argv[]) {
+	int failures = 0;
+	int fd = syscall_mkpipe();
+	if (fd < 0) {
+		printf("mkpipe failed\n");
+		return 1;
+	}
+
+	/* Gather */
+	char * parts[] = { "Hello, ", "vectored ", "world!" };
+	struct iovec iov[3];
+	size_t total = 0;
+	for (int i = 0; i < 3; ++i) {
+		iov[i].iov_base = parts[i];
+		iov[i].iov_len  = strlen(parts[i]);
+		total += iov[i].iov_len;
+	}
+	int written = syscall_writev(fd, iov, 3);
+	if (written != (int)total) {
+		printf("writev: FAILED (wrote %d of %d)\n", written, total);
+		failures++;
+	}
+	char buf[64] = {0};
+	read(fd, buf, total);
+	if (!strcmp(buf, "Hello, vectored world!")) {
+		printf("writev gather: ok\n");
+	} else {
+		printf("writev gather: FAILED (got '%s')\n", buf);
+		failures++;
+	}
+
+	/* Scatter */
+	write(fd, "abcdefghij", 10);
+	char first[6] = {0};
+	char second[6] = {0};
+	iov[0].iov_base = first;
+	iov[0].iov_len  = 5;
+	iov[1].iov_base = second;
+	iov[1].iov_len  = 5;
+	int readed = syscall_readv(fd, iov, 2);
+	if (readed == 10 && !strcmp(first, "abcde") && !strcmp(second, "fghij")) {
+		printf("readv scatter: ok\n");
+	} else {
+		printf("readv scatter: FAILED (%d, '%s', '%s')\n", readed, first, second);
+		failures++;
+	}
+
+	/* Bad descriptor */
+	if (syscall_writev(1234, iov, 2) < 0) {
+		printf("writev on bad fd: ok\n");
+	} else {
+		printf("writev on bad fd: FAILED\n");
+		failures++;
+	}
+
+	return failures ? 1 : 0;
+}
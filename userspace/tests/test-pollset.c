@@ -0,0 +1,89 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * pollset test
+ *
+ * Registers two pipes with a pollset, makes one of them readable, and
+ * checks that waiting reports exactly that one.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include <unistd.h>
+
+/* Matches kernel/include/pollset.h */
+#define POLLSET_ADD    0x5901
+#define POLLSET_REMOVE 0x5902
+#define POLLSET_WAIT   0x5903
+
+typedef struct pollset_wait {
+	int timeout; /* milliseconds; -1 blocks, 0 polls */
+	int max;
+	int fds[4];
+} pollset_wait_t;
+
+int main(int argc, char * argv[]) {
+	int failures = 0;
+
+	int pfd = syscall_pollset();
+	if (pfd < 0) {
+		printf("pollset: no pollset support (%d)\n", pfd);
+		return 1;
+	}
+
+	int quiet = syscall_mkpipe();
+	int noisy = syscall_mkpipe();
+	syscall_ioctl(pfd, POLLSET_ADD, &quiet);
+	syscall_ioctl(pfd, POLLSET_ADD, &noisy);
+
+	/* Nothing readable yet; a zero-timeout wait should come back empty */
+	pollset_wait_t wait;
+	wait.timeout = 0;
+	wait.max = 4;
+	int ready = syscall_ioctl(pfd, POLLSET_WAIT, &wait);
+	if (ready == 0) {
+		printf("empty poll: ok\n");
+	} else {
+		printf("empty poll: FAILED (%d ready)\n", ready);
+		failures++;
+	}
+
+	/* Make one pipe readable and wait for it */
+	write(noisy, "x", 1);
+	wait.timeout = -1;
+	wait.max = 4;
+	ready = syscall_ioctl(pfd, POLLSET_WAIT, &wait);
+	if (ready == 1 && wait.fds[0] == noisy) {
+		printf("one ready descriptor: ok\n");
+	} else {
+		printf("one ready descriptor: FAILED (ready=%d fd=%d want %d)\n",
+				ready, ready > 0 ? wait.fds[0] : -1, noisy);
+		failures++;
+	}
+
+	/* Drain it, remove it, and make sure a write no longer shows up */
+	char c;
+	read(noisy, &c, 1);
+	if (syscall_ioctl(pfd, POLLSET_REMOVE, &noisy) < 0) {
+		printf("POLLSET_REMOVE: FAILED\n");
+		failures++;
+	}
+	write(noisy, "x", 1);
+	wait.timeout = 0;
+	wait.max = 4;
+	ready = syscall_ioctl(pfd, POLLSET_WAIT, &wait);
+	if (ready == 0) {
+		printf("removed descriptor ignored: ok\n");
+	} else {
+		printf("removed descriptor ignored: FAILED (%d ready)\n", ready);
+		failures++;
+	}
+
+	close(quiet);
+	close(noisy);
+	close(pfd);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,67 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * socket syscall test
+ *
+ * Exercises the socket syscall surface: descriptor creation when a
+ * network stack is loaded, graceful failure when it is not, and the
+ * argument checks on connect/send/recv.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include <unistd.h>
+
+/* Matches kernel/include/ipv4.h */
+#define SOCK_STREAM 1
+#define SOCK_DGRAM  2
+
+int main(int argc, char * argv[]) {
+	int failures = 0;
+	char buf[16];
+
+	/* connect/send/recv must refuse descriptors we never opened */
+	if (syscall_connect(1234, 0x7F000001, 80) < 0 &&
+		syscall_send(1234, buf, sizeof(buf), 0) < 0 &&
+		syscall_recv(1234, buf, sizeof(buf), 0) < 0) {
+		printf("bad descriptor checks: ok\n");
+	} else {
+		printf("bad descriptor checks: FAILED\n");
+		failures++;
+	}
+
+	/* An unsupported socket type is refused whether or not a stack
+	 * module is loaded */
+	if (syscall_socket(42) < 0) {
+		printf("unsupported socket type: ok\n");
+	} else {
+		printf("unsupported socket type: FAILED\n");
+		failures++;
+	}
+
+	int fd = syscall_socket(SOCK_STREAM);
+	if (fd < 0) {
+		/* No network stack module loaded; the syscall should fail
+		 * cleanly rather than hand back a broken descriptor */
+		printf("socket without network stack refused: ok\n");
+		return failures ? 1 : 0;
+	}
+	printf("socket created: fd %d\n", fd);
+
+	/* connect should at least refuse a descriptor that is not a
+	 * socket, even with a stack loaded */
+	int pipe = syscall_mkpipe();
+	if (syscall_connect(pipe, 0x7F000001, 80) < 0) {
+		printf("connect on non-socket: ok\n");
+	} else {
+		printf("connect on non-socket: FAILED\n");
+		failures++;
+	}
+	close(pipe);
+
+	close(fd);
+	return failures ? 1 : 0;
+}
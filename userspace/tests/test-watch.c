@@ -0,0 +1,100 @@
+/* This file is part of ToaruOS and is released under the terms
+ * of the NCSA / University of Illinois License - see LICENSE.md
+ */
+/* vim: tabstop=4 shiftwidth=4 noexpandtab
+ * file watch test
+ *
+ * Watches /tmp, creates and removes a file under it, and checks the
+ * expected events come back out of the watch descriptor.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include <unistd.h>
+
+/* Matches kernel/include/watch.h */
+#define WATCH_ADD    0x5701
+#define WATCH_REMOVE 0x5702
+
+#define WATCH_EVENT_CREATE 1
+#define WATCH_EVENT_UNLINK 2
+#define WATCH_EVENT_MODIFY 3
+
+typedef struct watch_event {
+	int wd;
+	int type;
+	char name[256];
+} watch_event_t;
+
+static const char * type_name(int type) {
+	switch (type) {
+		case WATCH_EVENT_CREATE: return "create";
+		case WATCH_EVENT_UNLINK: return "unlink";
+		case WATCH_EVENT_MODIFY: return "modify";
+		default: return "?";
+	}
+}
+
+int main(int argc, char * argv[]) {
+	int failures = 0;
+	char path[64];
+	char name[32];
+
+	sprintf(name, "watch-test-%d", getpid());
+	sprintf(path, "/tmp/%s", name);
+
+	int wfd = syscall_watch();
+	if (wfd < 0) {
+		printf("watch: no watch support (%d)\n", wfd);
+		return 1;
+	}
+
+	int wd = syscall_ioctl(wfd, WATCH_ADD, "/tmp");
+	if (wd < 0) {
+		printf("WATCH_ADD /tmp: FAILED (%d)\n", wd);
+		return 1;
+	}
+	printf("watching /tmp as wd %d\n", wd);
+
+	/* Create a file under the watched directory */
+	FILE * f = fopen(path, "w");
+	if (!f) {
+		printf("could not create %s\n", path);
+		return 1;
+	}
+	fprintf(f, "hello\n");
+	fclose(f);
+
+	watch_event_t ev;
+	int r = read(wfd, (char *)&ev, sizeof(ev));
+	if (r == sizeof(ev) && ev.wd == wd && ev.type == WATCH_EVENT_CREATE && !strcmp(ev.name, name)) {
+		printf("create event for '%s': ok\n", ev.name);
+	} else {
+		printf("create event: FAILED (r=%d wd=%d type=%s name='%s')\n",
+				r, ev.wd, type_name(ev.type), ev.name);
+		failures++;
+	}
+
+	/* And remove it */
+	unlink(path);
+	r = read(wfd, (char *)&ev, sizeof(ev));
+	if (r == sizeof(ev) && ev.wd == wd && ev.type == WATCH_EVENT_UNLINK && !strcmp(ev.name, name)) {
+		printf("unlink event for '%s': ok\n", ev.name);
+	} else {
+		printf("unlink event: FAILED (r=%d wd=%d type=%s name='%s')\n",
+				r, ev.wd, type_name(ev.type), ev.name);
+		failures++;
+	}
+
+	if (syscall_ioctl(wfd, WATCH_REMOVE, &wd) < 0) {
+		printf("WATCH_REMOVE: FAILED\n");
+		failures++;
+	} else {
+		printf("WATCH_REMOVE: ok\n");
+	}
+
+	close(wfd);
+	return failures ? 1 : 0;
+}
@@ -40,7 +40,9 @@ class Classifier(object):
         '"lib/sha2.h"':        (None, '-ltoaru-sha2',        []),
         '"lib/pex.h"':         (None, '-ltoaru-pex',         []),
         '"lib/graphics.h"':    (None, '-ltoaru-graphics',    ['<png.h>']),
-        '"lib/shmemfonts.h"':  (None, '-ltoaru-shmemfonts',  ['"lib/graphics.h"', '<ft2build.h>']),
+        '"lib/shmemfonts.h"':  (None, '-ltoaru-shmemfonts',  ['"lib/graphics.h"', '"lib/hashmap.h"', '<ft2build.h>']),
+        '"lib/shmemsprites.h"': (None, '-ltoaru-shmemsprites', ['"lib/graphics.h"']),
+        '"lib/batch.h"':       (None, '-ltoaru-batch',       ['"lib/shmemfonts.h"', '"lib/graphics.h"']),
         '"lib/rline.h"':       (None, '-ltoaru-rline',       ['"lib/kbd.h"']),
         '"lib/confreader.h"':  (None, '-ltoaru-confreader',  ['"lib/hashmap.h"']),
         '"lib/network.h"':     (None, '-ltoaru-network',     []),